@@ -1,64 +1,324 @@
-#include <string.h>
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Hyphenates a word, or measures the hyphenation throughput of a corpus.
+//
+//   hyphtool [options] word
+//       Prints the word with a '-' at every hyphenation point. A '-' in the word is a soft hyphen.
+//
+//   hyphtool [options] --corpus file
+//       Hyphenates every whitespace separated word of the UTF-8 file and reports the words per
+//       second, the word cache hit rate and the pages of the pattern file touched.
+//
+// Options:
+//   --hyb file        The pattern file (default /tmp/en.hyb).
+//   --locale locale   The locale of the patterns (default en).
+//   --min-prefix n    The minimum number of characters before a hyphen (default 2).
+//   --min-suffix n    The minimum number of characters after a hyphen (default 3).
+//   --threads n       The number of threads hyphenating the corpus at once (default 1).
+//   --iterations n    The number of times each thread hyphenates the corpus (default 1).
+//   --word-cache      Enables the word cache, see Hyphenator::setWordCacheEnabled().
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
-#include <utils/Log.h>
-
+#include "minikin/CacheStats.h"
 #include "minikin/Hyphenator.h"
+#include "minikin/Utf8Text.h"
 
+using minikin::CacheStats;
 using minikin::HyphenationType;
 using minikin::Hyphenator;
+using minikin::Range;
+using minikin::U16StringPiece;
+using minikin::Utf8Text;
+
+namespace {
+
+struct Options {
+    std::string hybPath = "/tmp/en.hyb";
+    std::string locale = "en";
+    int minPrefix = 2;
+    int minSuffix = 3;
+    int threads = 1;
+    int iterations = 1;
+    bool wordCache = false;
+    std::string corpusPath;
+};
+
+// A read-only mapping of the pattern file, so that the pages touched by the hyphenation can be
+// counted.
+class MappedFile {
+public:
+    MappedFile() : mData(nullptr), mSize(0) {}
+    ~MappedFile() {
+        if (mData != nullptr) {
+            munmap(mData, mSize);
+        }
+    }
+
+    bool open(const char* path) {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        mSize = st.st_size;
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        mData = data;
+        return true;
+    }
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(mData); }
 
-Hyphenator* loadHybFile(const char* fn, int minPrefix, int minSuffix, const char* language) {
-    struct stat statbuf;
-    int status = stat(fn, &statbuf);
-    if (status < 0) {
-        fprintf(stderr, "error opening %s\n", fn);
-        return nullptr;
-    }
-    size_t size = statbuf.st_size;
-    FILE* f = fopen(fn, "rb");
-    if (f == NULL) {
-        fprintf(stderr, "error opening %s\n", fn);
-        return nullptr;
-    }
-    uint8_t* buf = new uint8_t[size];
-    size_t read_size = fread(buf, 1, size, f);
-    fclose(f);
-    if (read_size < size) {
-        fprintf(stderr, "error reading %s\n", fn);
-        delete[] buf;
-        return nullptr;
-    }
-    return Hyphenator::loadBinary(buf, minPrefix, minSuffix, language);
+    size_t getPageCount() const {
+        const size_t pageSize = sysconf(_SC_PAGESIZE);
+        return (mSize + pageSize - 1) / pageSize;
+    }
+
+    // Returns the number of the pages of the file in the page cache, see mincore().
+    size_t getResidentPageCount() const {
+        std::vector<unsigned char> residency(getPageCount());
+        if (mincore(mData, mSize, residency.data()) < 0) {
+            return 0;
+        }
+        size_t count = 0;
+        for (unsigned char page : residency) {
+            count += page & 1;
+        }
+        return count;
+    }
+
+private:
+    void* mData;
+    size_t mSize;
+};
+
+long getPageFaults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
 }
 
-int main(int argc, char** argv) {
-    Hyphenator* hyph = loadHybFile("/tmp/en.hyb", 2, 3, "en");  // should also be configurable
-    std::vector<HyphenationType> result;
-    std::vector<uint16_t> word;
-    if (argc < 2) {
-        fprintf(stderr, "usage: hyphtool word\n");
-        return 1;
+void printUsage() {
+    fprintf(stderr,
+            "usage: hyphtool [--hyb file] [--locale locale] [--min-prefix n] [--min-suffix n]\n"
+            "                [--threads n] [--iterations n] [--word-cache]\n"
+            "                (word | --corpus file)\n");
+}
+
+bool parseOptions(int argc, char** argv, Options* options, std::string* word) {
+    static const struct option kLongOptions[] = {
+            {"hyb", required_argument, nullptr, 'h'},
+            {"locale", required_argument, nullptr, 'l'},
+            {"min-prefix", required_argument, nullptr, 'p'},
+            {"min-suffix", required_argument, nullptr, 's'},
+            {"threads", required_argument, nullptr, 't'},
+            {"iterations", required_argument, nullptr, 'i'},
+            {"word-cache", no_argument, nullptr, 'w'},
+            {"corpus", required_argument, nullptr, 'c'},
+            {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", kLongOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'h':
+                options->hybPath = optarg;
+                break;
+            case 'l':
+                options->locale = optarg;
+                break;
+            case 'p':
+                options->minPrefix = atoi(optarg);
+                break;
+            case 's':
+                options->minSuffix = atoi(optarg);
+                break;
+            case 't':
+                options->threads = std::max(1, atoi(optarg));
+                break;
+            case 'i':
+                options->iterations = std::max(1, atoi(optarg));
+                break;
+            case 'w':
+                options->wordCache = true;
+                break;
+            case 'c':
+                options->corpusPath = optarg;
+                break;
+            default:
+                return false;
+        }
+    }
+    if (optind < argc) {
+        *word = argv[optind];
     }
-    char* asciiword = argv[1];
-    size_t len = strlen(asciiword);
-    for (size_t i = 0; i < len; i++) {
-        uint32_t c = asciiword[i];
+    return options->corpusPath.empty() != word->empty();
+}
+
+int hyphenateWord(const Hyphenator& hyph, const std::string& utf8Word) {
+    const Utf8Text text(utf8Word);
+    std::vector<uint16_t> word(text.utf16().data(), text.utf16().data() + text.utf16().size());
+    for (uint16_t& c : word) {
         if (c == '-') {
             c = 0x00AD;
         }
-        // ASCII (or possibly ISO Latin 1), but kinda painful to do utf conversion :(
-        word.push_back(c);
     }
-    hyph->hyphenate(word, &result);
-    for (size_t i = 0; i < len; i++) {
+    std::vector<HyphenationType> result;
+    hyph.hyphenate(word, &result);
+    std::string out;
+    for (size_t i = 0; i < word.size(); i++) {
         if (result[i] != HyphenationType::DONT_BREAK) {
-            printf("-");
+            out += '-';
+        }
+        const uint32_t end = i + 1 < word.size() ? text.toUtf8Offset(i + 1) : utf8Word.size();
+        const uint32_t start = text.toUtf8Offset(i);
+        if (start < end) {
+            out += utf8Word.substr(start, end - start);
         }
-        printf("%c", word[i]);
     }
-    printf("\n");
+    printf("%s\n", out.c_str());
     return 0;
 }
+
+// A line of the corpus with the ranges of its words.
+struct CorpusLine {
+    std::vector<uint16_t> text;
+    std::vector<Range> words;
+};
+
+bool readCorpus(const std::string& path, std::vector<CorpusLine>* lines, size_t* wordCount) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    *wordCount = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        const Utf8Text text(line);
+        CorpusLine corpusLine;
+        corpusLine.text.assign(text.utf16().data(), text.utf16().data() + text.utf16().size());
+        uint32_t start = 0;
+        for (uint32_t i = 0; i <= corpusLine.text.size(); ++i) {
+            if (i == corpusLine.text.size() || corpusLine.text[i] == ' ' ||
+                corpusLine.text[i] == '\t') {
+                if (start < i) {
+                    corpusLine.words.emplace_back(start, i);
+                }
+                start = i + 1;
+            }
+        }
+        *wordCount += corpusLine.words.size();
+        lines->push_back(std::move(corpusLine));
+    }
+    return true;
+}
+
+int hyphenateCorpus(const Hyphenator& hyph, const MappedFile& patterns, const Options& options) {
+    std::vector<CorpusLine> lines;
+    size_t wordCount = 0;
+    if (!readCorpus(options.corpusPath, &lines, &wordCount)) {
+        fprintf(stderr, "error reading %s\n", options.corpusPath.c_str());
+        return 1;
+    }
+
+    const size_t residentBefore = patterns.getResidentPageCount();
+    const long faultsBefore = getPageFaults();
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threads; ++t) {
+        threads.emplace_back([&] {
+            std::vector<HyphenationType> result;
+            for (int i = 0; i < options.iterations; ++i) {
+                for (const CorpusLine& line : lines) {
+                    for (const Range& word : line.words) {
+                        hyph.hyphenate(U16StringPiece(line.text).substr(word), &result);
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const long faults = getPageFaults() - faultsBefore;
+    const size_t residentAfter = patterns.getResidentPageCount();
+
+    const double totalWords = static_cast<double>(wordCount) * options.threads * options.iterations;
+    printf("words: %zu x %d threads x %d iterations\n", wordCount, options.threads,
+           options.iterations);
+    printf("time: %.3f s, %.0f words/s\n", elapsed.count(), totalWords / elapsed.count());
+    printf("page faults: %ld\n", faults);
+    printf("pattern pages resident: %zu -> %zu of %zu\n", residentBefore, residentAfter,
+           patterns.getPageCount());
+    const CacheStats* stats = hyph.getWordCacheStats();
+    if (stats != nullptr) {
+        const uint64_t lookups = stats->getHitCount() + stats->getMissCount();
+        printf("word cache: %" PRIu64 " hits, %" PRIu64 " misses, %.1f%% hit rate\n",
+               stats->getHitCount(), stats->getMissCount(),
+               lookups == 0 ? 0.0 : 100.0 * stats->getHitCount() / lookups);
+    } else if (options.wordCache) {
+        printf("word cache: no lookups\n");
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string word;
+    if (!parseOptions(argc, argv, &options, &word)) {
+        printUsage();
+        return 1;
+    }
+    MappedFile patterns;
+    if (!patterns.open(options.hybPath.c_str())) {
+        fprintf(stderr, "error opening %s\n", options.hybPath.c_str());
+        return 1;
+    }
+    Hyphenator::setWordCacheEnabled(options.wordCache);
+    std::unique_ptr<Hyphenator> hyph(Hyphenator::loadBinary(
+            patterns.data(), options.minPrefix, options.minSuffix, options.locale));
+    if (options.corpusPath.empty()) {
+        return hyphenateWord(*hyph, word);
+    }
+    return hyphenateCorpus(*hyph, patterns, options);
+}
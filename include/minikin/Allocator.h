@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_ALLOCATOR_H
+#define MINIKIN_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace minikin {
+
+// The source of the memory of the long lived data of minikin, i.e. the glyphs of the layouts and
+// the texts of the cache keys, e.g. to serve them from a pool separate from the short lived
+// allocations of the text rendering.
+class Allocator {
+public:
+    virtual ~Allocator() {}
+
+    // Returns a block of the given size aligned for any scalar type. Must not return nullptr.
+    virtual void* allocate(size_t bytes) = 0;
+
+    // Frees a block returned by allocate().
+    virtual void deallocate(void* ptr) = 0;
+
+    // Returns the allocator of the process, which uses operator new unless set otherwise.
+    static Allocator& get();
+
+    // Sets the allocator of the process, or the default one if nullptr. The blocks allocated
+    // before are still freed by the allocator that allocated them, which must outlive them.
+    static void set(Allocator* allocator);
+};
+
+// Allocates a block with the allocator of the process. The block records its allocator in a
+// header, so that freeBlock() frees it with the same one even if the allocator of the process has
+// been changed since.
+void* allocateBlock(size_t bytes);
+
+// Frees a block returned by allocateBlock(), or does nothing if nullptr.
+void freeBlock(void* ptr);
+
+// Frees the memory of a unique_ptr allocated by allocateBlock().
+struct AllocatorDeleter {
+    void operator()(void* ptr) const { freeBlock(ptr); }
+};
+
+// An array of bytes allocated by the allocator of the process.
+using AllocatedBytes = std::unique_ptr<uint8_t[], AllocatorDeleter>;
+
+inline AllocatedBytes allocateBytes(size_t size) {
+    return AllocatedBytes(static_cast<uint8_t*>(allocateBlock(size)));
+}
+
+}  // namespace minikin
+
+#endif  // MINIKIN_ALLOCATOR_H
@@ -18,7 +18,9 @@
 #define MINIKIN_ANDROID_LINE_BREAKER_HELPERS_H
 
 #include <algorithm>
+#include <memory>
 
+#include "minikin/LineBreakResultCache.h"
 #include "minikin/LineBreaker.h"
 
 namespace minikin {
@@ -93,6 +95,38 @@ public:
                               TabStops(tabStops, tabStopSize, defaultTabStopWidth));
     }
 
+    // Same as computeBreaks, but returns the result kept by the measured text for the same
+    // arguments if it keeps them, see MeasuredText::setLineBreakResultCachingEnabled.
+    std::shared_ptr<const LineBreakResult> computeBreaksShared(
+            const U16StringPiece& textBuf, const MeasuredText& measuredText, float firstWidth,
+            int32_t firstWidthLineCount, float restWidth, int32_t indentsOffset,
+            const float* tabStops, int32_t tabStopSize, float defaultTabStopWidth) const {
+        LineBreakResultCache* cache = measuredText.getLineBreakResultCache();
+        if (cache == nullptr) {
+            return std::make_shared<const LineBreakResult>(computeBreaks(
+                    textBuf, measuredText, firstWidth, firstWidthLineCount, restWidth,
+                    indentsOffset, tabStops, tabStopSize, defaultTabStopWidth));
+        }
+        LineBreakParams params = {mStrategy,
+                                  mFrequency,
+                                  mIsJustified,
+                                  firstWidth,
+                                  firstWidthLineCount,
+                                  restWidth,
+                                  mIndents,
+                                  indentsOffset,
+                                  std::vector<float>(tabStops, tabStops + tabStopSize),
+                                  defaultTabStopWidth};
+        std::shared_ptr<const LineBreakResult> result = cache->get(params);
+        if (result == nullptr) {
+            result = std::make_shared<const LineBreakResult>(computeBreaks(
+                    textBuf, measuredText, firstWidth, firstWidthLineCount, restWidth,
+                    indentsOffset, tabStops, tabStopSize, defaultTabStopWidth));
+            cache->put(std::move(params), result);
+        }
+        return result;
+    }
+
     inline BreakStrategy getStrategy() const { return mStrategy; }
     inline HyphenationFrequency getFrequency() const { return mFrequency; }
     inline bool isJustified() const { return mIsJustified; }
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_API_TRACE_H
+#define MINIKIN_API_TRACE_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "minikin/Buffer.h"
+#include "minikin/FamilyVariant.h"
+#include "minikin/FontStyle.h"
+#include "minikin/FontVariation.h"
+#include "minikin/Hyphenator.h"
+#include "minikin/Layout.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinPaint.h"
+#include "minikin/Range.h"
+#include "minikin/U16StringPiece.h"
+
+namespace minikin {
+
+// A recorder of the Layout, Layout::measureText, MeasuredTextBuilder::build and breakIntoLines
+// calls, for reproducing the performance of an app with its own text instead of the synthetic text
+// of the benchmarks. A trace written with writeTo() is replayed by BM_TraceReplay in
+// tests/perftests, which reports the latency percentiles of each kind of call.
+//
+// The font collections are written as the file names and the styles of their fonts, which the
+// replay looks up in a font directory. The texts are kept as is unless anonymized, which replaces
+// the letters with a sample letter of their script and the digits with the zero of their digits,
+// so that the font fallback and the shaping paths are the same but the text can't be read back.
+//
+// The other entry points, e.g. Layout::measureTexts, MeasuredTextBuilder::buildIncremental or the
+// breakIntoLines of several widths, are not recorded.
+class ApiTrace {
+public:
+    static ApiTrace& getInstance() {
+        static ApiTrace trace;
+        return trace;
+    }
+
+    enum class CallType : uint8_t {
+        Layout = 0,
+        MeasureText = 1,
+        Build = 2,
+        BreakIntoLines = 3,
+    };
+
+    struct FontEntry {
+        // The file name of the font, without the directory.
+        std::string fileName;
+        uint32_t index;
+        FontStyle style;
+        std::vector<FontVariation> axes;
+    };
+
+    struct FamilyEntry {
+        std::string locales;
+        FamilyVariant variant;
+        bool isCustomFallback;
+        std::vector<FontEntry> fonts;
+    };
+
+    struct PaintEntry {
+        // The index of the font collection in Trace::collections.
+        uint32_t collection;
+        float size;
+        float scaleX;
+        float skewX;
+        float letterSpacing;
+        float wordSpacing;
+        uint32_t fontFlags;
+        std::string locales;
+        FontStyle fontStyle;
+        FamilyVariant familyVariant;
+        std::string fontFeatureSettings;
+    };
+
+    // A style run, or a replacement run of the given width. The custom runs are recorded as
+    // replacement runs of their measured width.
+    struct RunEntry {
+        Range range;
+        bool isStyleRun;
+        PaintEntry paint;
+        int lineBreakStyle;
+        int lineBreakWordStyle;
+        bool isRtl;
+        float width;
+        std::string locales;
+    };
+
+    struct Call {
+        CallType type;
+        // The text of Layout, MeasureText and Build. Empty for BreakIntoLines, which breaks the
+        // text of its measuredText.
+        std::vector<uint16_t> text;
+
+        // Layout and MeasureText.
+        Range range;
+        Bidi bidi;
+        PaintEntry paint;
+        StartHyphenEdit startHyphen;
+        EndHyphenEdit endHyphen;
+
+        // Build.
+        std::vector<RunEntry> runs;
+        bool computeHyphenation;
+        bool computeLayout;
+        bool ignoreHyphenKerning;
+
+        // BreakIntoLines. measuredText is the index of the Build call of the text.
+        uint32_t measuredText;
+        BreakStrategy strategy;
+        HyphenationFrequency frequency;
+        bool justified;
+        // The widths of the lines broken into, the last one for the lines after them.
+        std::vector<float> lineWidths;
+        float minLineWidth;
+        std::vector<float> tabStops;
+        float tabWidth;
+        // The maximum of uint32_t for the breakIntoLines without the maximum number of lines.
+        uint32_t maxLines;
+    };
+
+    struct Trace {
+        // The families of each font collection.
+        std::vector<std::vector<FamilyEntry>> collections;
+        std::vector<Call> calls;
+    };
+
+    // Starts or stops recording. The recorded calls are kept until clear(). If anonymize is true,
+    // the texts recorded from now on are anonymized. Recording is disabled by default.
+    void setRecording(bool enabled, bool anonymize = false);
+    bool isRecording() const { return mRecording.load(std::memory_order_relaxed); }
+
+    // Called by the recorded entry points. Each of them is a single load while not recording.
+    void recordLayout(const U16StringPiece& text, const Range& range, Bidi bidiFlags,
+                      const MinikinPaint& paint, StartHyphenEdit startHyphen,
+                      EndHyphenEdit endHyphen) {
+        if (isRecording()) {
+            recordLayoutInternal(CallType::Layout, text, range, bidiFlags, paint, startHyphen,
+                                 endHyphen);
+        }
+    }
+    void recordMeasureText(const U16StringPiece& text, const Range& range, Bidi bidiFlags,
+                           const MinikinPaint& paint, StartHyphenEdit startHyphen,
+                           EndHyphenEdit endHyphen) {
+        if (isRecording()) {
+            recordLayoutInternal(CallType::MeasureText, text, range, bidiFlags, paint, startHyphen,
+                                 endHyphen);
+        }
+    }
+    void recordBuild(const U16StringPiece& text, const MeasuredText& measuredText,
+                     bool computeHyphenation, bool computeLayout, bool ignoreHyphenKerning) {
+        if (isRecording()) {
+            recordBuildInternal(text, measuredText, computeHyphenation, computeLayout,
+                                ignoreHyphenKerning);
+        }
+    }
+    // The breaking of a text built before the recording started is not recorded. lineCount is
+    // the number of the lines the text was broken into.
+    void recordBreakIntoLines(const U16StringPiece& text, BreakStrategy strategy,
+                              HyphenationFrequency frequency, bool justified,
+                              const MeasuredText& measuredText, const LineWidth& lineWidth,
+                              const TabStops& tabStops, uint32_t maxLines, size_t lineCount) {
+        if (isRecording()) {
+            recordBreakIntoLinesInternal(text, strategy, frequency, justified, measuredText,
+                                         lineWidth, tabStops, maxLines, lineCount);
+        }
+    }
+
+    void writeTo(BufferWriter* writer);
+
+    // Reads a trace written by writeTo(). Returns false if it was written by a different version
+    // of the format or is malformed: a count or an index past what has been read, a range out of
+    // its text, or a read past the end. The reader must be bounded for the latter to be detected.
+    static bool readFrom(BufferReader* reader, Trace* out);
+
+    // Returns the text with the letters and the digits anonymized as described above. The length
+    // and the offsets of the characters are the same.
+    static std::vector<uint16_t> anonymize(const U16StringPiece& text);
+
+    void clear();
+    uint32_t size();
+
+    // The number of calls to record. The calls made after this many are ignored.
+    static constexpr uint32_t kMaxRecordedCalls = 65536;
+
+protected:
+    ApiTrace() : mRecording(false), mAnonymize(false) {}
+
+private:
+    struct BuiltText {
+        uint32_t callIndex;
+        // Checks that breakIntoLines is given the text of the recorded build, not the one of
+        // another text allocated at the same address.
+        uint32_t textHash;
+    };
+
+    void recordLayoutInternal(CallType type, const U16StringPiece& text, const Range& range,
+                              Bidi bidiFlags, const MinikinPaint& paint,
+                              StartHyphenEdit startHyphen, EndHyphenEdit endHyphen);
+    void recordBuildInternal(const U16StringPiece& text, const MeasuredText& measuredText,
+                             bool computeHyphenation, bool computeLayout,
+                             bool ignoreHyphenKerning);
+    void recordBreakIntoLinesInternal(const U16StringPiece& text, BreakStrategy strategy,
+                                      HyphenationFrequency frequency, bool justified,
+                                      const MeasuredText& measuredText,
+                                      const LineWidth& lineWidth, const TabStops& tabStops,
+                                      uint32_t maxLines, size_t lineCount);
+
+    std::vector<uint16_t> copyText(const U16StringPiece& text) const;
+    PaintEntry makePaintEntry(const MinikinPaint& paint) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    std::atomic<bool> mRecording;
+    std::atomic<bool> mAnonymize;
+    std::mutex mMutex;
+    Trace mTrace GUARDED_BY(mMutex);
+    // The indices of the font collections in mTrace.collections by their IDs.
+    std::unordered_map<uint32_t, uint32_t> mCollections GUARDED_BY(mMutex);
+    // The Build calls by the measured texts they built.
+    std::unordered_map<const MeasuredText*, BuiltText> mBuiltTexts GUARDED_BY(mMutex);
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(ApiTrace);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_API_TRACE_H
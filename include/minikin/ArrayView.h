@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_ARRAY_VIEW_H
+#define MINIKIN_ARRAY_VIEW_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace minikin {
+
+// A read-only view of a contiguous array owned by someone else.
+template <typename T>
+class ArrayView {
+public:
+    using value_type = T;
+    using iterator = const T*;
+    using const_iterator = const T*;
+
+    ArrayView() : mData(nullptr), mSize(0) {}
+    ArrayView(const T* data, size_t size) : mData(data), mSize(size) {}
+    ArrayView(const std::vector<T>& v)  // Intentionally not explicit.
+            : mData(v.data()), mSize(v.size()) {}
+
+    const T* data() const { return mData; }
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    const T& operator[](size_t i) const { return mData[i]; }
+
+    const T* begin() const { return mData; }
+    const T* end() const { return mData + mSize; }
+
+    std::vector<T> toVector() const { return std::vector<T>(begin(), end()); }
+
+    bool operator==(const ArrayView<T>& o) const {
+        return mSize == o.mSize && std::equal(begin(), end(), o.begin());
+    }
+    bool operator!=(const ArrayView<T>& o) const { return !(*this == o); }
+
+private:
+    const T* mData;
+    size_t mSize;
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_ARRAY_VIEW_H
@@ -19,12 +19,16 @@
 
 #include "minikin/LayoutCache.h"
 
+#include <atomic>
 #include <mutex>
 
 #include <utils/LruCache.h>
 
 #include "minikin/BoundsCache.h"
+#include "minikin/CachePartition.h"
+#include "minikin/CacheStats.h"
 #include "minikin/FontCollection.h"
+#include "minikin/FrequencySketch.h"
 #include "minikin/Hasher.h"
 #include "minikin/MinikinPaint.h"
 
@@ -47,22 +51,51 @@ public:
     void clear() {
         std::lock_guard<std::mutex> lock(mMutex);
         mCache.clear();
+        if (mSketch) {
+            mSketch->clear();
+        }
+    }
+
+    // Same as LayoutCache::trim().
+    void trim(uint32_t percent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t target = mMemoryUsage * percent / 100;
+        while (mMemoryUsage > target && mCache.removeOldest()) {
+            mStats.recordEvictions(1);
+        }
+    }
+
+    // Same as LayoutCache::removeCollections().
+    void removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        removeCollectionEntries(mCache, collectionIds);
     }
 
     // Do not use BoundsCache inside the callback function, otherwise dead-lock may happen.
     template <typename F>
     void getOrCreate(const U16StringPiece& text, const Range& range, const MinikinPaint& paint,
                      bool dir, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, F& f) {
+        if (mAttachToLayoutCache.load(std::memory_order_relaxed)) {
+            // The callback is called while LayoutCache holds the entry.
+            auto extractor = [&f](const LayoutPiece& layoutPiece, const MinikinPaint& paint) {
+                f(layoutPiece.getOrCalculateBounds(paint), layoutPiece.advance());
+            };
+            LayoutCache::getInstance().getOrCreate(text, range, paint, dir, startHyphen, endHyphen,
+                                                   extractor);
+            return;
+        }
         LayoutCacheKey key(text, range, paint, dir, startHyphen, endHyphen);
-        if (paint.skipCache() || range.getLength() >= LENGTH_LIMIT_CACHE) {
+        if (range.getLength() >= LENGTH_LIMIT_CACHE) {
+            mStats.recordBypass(CacheStats::BypassReason::TooLong);
             LayoutPiece piece = LayoutPiece(text, range, dir, paint, startHyphen, endHyphen);
             f(getBounds(piece, paint), piece.advance());
             return;
         }
         {
-            std::lock_guard<std::mutex> lock(mMutex);
+            std::unique_lock<std::mutex> lock = mStats.getLockStats().lock(mMutex);
             BoundsValue* value = mCache.get(key);
             if (value != nullptr) {
+                mStats.recordHit();
                 f(value->rect, value->advance);
                 return;
             }
@@ -71,15 +104,38 @@ public:
         // Don't care even if we do the same layout in other thread.
         key.copyText();
         ValueExtractor ve;
+        const CacheStats::TimePoint start = CacheStats::now();
         LayoutCache::getInstance().getOrCreate(text, range, paint, dir, startHyphen, endHyphen, ve);
+        mStats.recordMiss(start);
         f(ve.value->rect, ve.value->advance);
         {
-            std::lock_guard<std::mutex> lock(mMutex);
-            mCache.put(key, ve.value.release());
+            std::unique_lock<std::mutex> lock = mStats.getLockStats().lock(mMutex);
+            if (!admitLocked(key)) {
+                key.freeText();
+                mStats.recordRejection();
+                return;
+            }
+            const size_t sizeBefore = mCache.size();
+            if (!mCache.put(key, ve.value.get())) {
+                // The same value has been inserted by other thread.
+                key.freeText();
+                return;
+            }
+            ve.value.release();
+            mMemoryUsage += getEntryMemoryUsage(key);
+            // The LruCache evicts the oldest entry by itself when it is full.
+            mStats.recordEvictions(sizeBefore + 1 - mCache.size());
         }
     }
 
-    static BoundsCache& getInstance() {
+    // Returns the instance of the partition of the calling thread, see CachePartitionScope.
+    static BoundsCache& getInstance() { return getInstance(CachePartitionScope::getCurrent()); }
+
+    static BoundsCache& getInstance(CachePartition partition) {
+        if (partition == CachePartition::Bulk) {
+            static BoundsCache bulkCache(kMaxEntries);
+            return bulkCache;
+        }
         static BoundsCache cache(kMaxEntries);
         return cache;
     }
@@ -87,20 +143,69 @@ public:
     // Compute new bounding box for the layout piece.
     static MinikinRect getBounds(const LayoutPiece& layoutPiece, const MinikinPaint& paint);
 
+    // Makes the bounds be attached lazily to the LayoutCache entries instead of stored in the
+    // separate LRU of this cache. A single LayoutCache lookup then answers both the advance and
+    // the bounds, and the word is keyed and its text copied only once. Disabled by default. The
+    // entries already in this cache are kept until clear() but no longer looked up.
+    void setAttachToLayoutCache(bool enabled) {
+        mAttachToLayoutCache.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Same as LayoutCache::setFrequencyAdmission(), for the bounds stored in this cache.
+    void setFrequencyAdmission(bool enabled) {
+        mFrequencyAdmission.store(enabled, std::memory_order_relaxed);
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+
+    size_t getMemoryUsage() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMemoryUsage;
+    }
+
 protected:
-    BoundsCache(uint32_t maxEntries) : mCache(maxEntries) {
+    BoundsCache(uint32_t maxEntries)
+            : mCache(maxEntries),
+              mMemoryUsage(0),
+              mMaxEntries(maxEntries),
+              mAttachToLayoutCache(false),
+              mFrequencyAdmission(false) {
         mCache.setOnEntryRemovedListener(this);
     }
 
 private:
+    static size_t getEntryMemoryUsage(const LayoutCacheKey& key) {
+        return key.getMemoryUsage() + sizeof(BoundsValue);
+    }
+
+    // Same as LayoutCache::Shard::admitLocked().
+    bool admitLocked(const LayoutCacheKey& key) EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+        if (!mFrequencyAdmission.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (!mSketch) {
+            mSketch = std::make_unique<FrequencySketch>(mMaxEntries);
+        }
+        return mSketch->increment(key.hash()) >= LayoutCache::kAdmissionFrequency ||
+               mCache.size() < mMaxEntries;
+    }
+
     // callback for OnEntryRemoved
     void operator()(LayoutCacheKey& key, BoundsValue*& value) {
+        mMemoryUsage -= getEntryMemoryUsage(key);
         key.freeText();
         delete value;
     }
 
     std::mutex mMutex;
     android::LruCache<LayoutCacheKey, BoundsValue*> mCache GUARDED_BY(mMutex) GUARDED_BY(mMutex);
+    size_t mMemoryUsage GUARDED_BY(mMutex);
+    const uint32_t mMaxEntries;
+    std::atomic<bool> mAttachToLayoutCache;
+    std::atomic<bool> mFrequencyAdmission;
+    // Created on the first miss after the frequency admission is enabled.
+    std::unique_ptr<FrequencySketch> mSketch GUARDED_BY(mMutex);
+    CacheStats mStats;
     // LRU cache capacity. Should be fine to be less than LayoutCache#kMaxEntries since bbox
     // calculation happens less than layout calculation.
     static const size_t kMaxEntries = 500;
@@ -17,10 +17,12 @@
 #ifndef MINIKIN_BUFFER_H
 #define MINIKIN_BUFFER_H
 
+#include <cstdint>
 #include <cstring>
 #include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace minikin {
 
@@ -48,7 +50,20 @@ public:
 
     explicit BufferReader(const void* buffer) : BufferReader(buffer, 0) {}
     BufferReader(const void* buffer, uint32_t pos)
-            : mCurrent(reinterpret_cast<const uint8_t*>(buffer) + pos) {}
+            : mCurrent(reinterpret_cast<const uint8_t*>(buffer) + pos),
+              mEnd(nullptr),
+              mOverflowed(false) {}
+    // A reader of the data which can't be trusted, e.g. read from a file, which doesn't read past
+    // the first size bytes of the buffer. Once a read goes past them, it returns zeros or an empty
+    // array, and overflowed() returns true.
+    BufferReader(const void* buffer, uint32_t pos, size_t size)
+            : mCurrent(reinterpret_cast<const uint8_t*>(buffer) + pos),
+              mEnd(reinterpret_cast<const uint8_t*>(buffer) + size),
+              mOverflowed(pos > size) {
+        if (mOverflowed) {
+            mCurrent = mEnd;
+        }
+    }
 
     // align() adds padding if necessary so that the returned pointer is aligned
     // at 'align' template parameter (i.e. align<T, _align>(p) % _align == 0).
@@ -72,13 +87,21 @@ public:
     template <typename T, size_t align = sizeof(T)>
     const T& read() {
         const T* data = map<T, align>(sizeof(T));
+        if (data == nullptr) {
+            static const T zero{};
+            return zero;
+        }
         return *data;
     }
 
+    // Returns nullptr if the reader is bounded and the size bytes go past the end.
     template <typename T, size_t align = sizeof(T)>
     const T* map(uint32_t size) {
         static_assert(std::is_pod<T>::value, "T must be a POD");
         mCurrent = BufferReader::align<T, align>(mCurrent);
+        if (!hasBytes(size)) {
+            return nullptr;
+        }
         const T* data = reinterpret_cast<const T*>(mCurrent);
         mCurrent += size;
         return data;
@@ -86,9 +109,7 @@ public:
 
     template <typename T, size_t align = sizeof(T)>
     void skip() {
-        static_assert(std::is_pod<T>::value, "T must be a POD");
-        mCurrent = BufferReader::align<T, align>(mCurrent);
-        mCurrent += sizeof(T);
+        map<T, align>(sizeof(T));
     }
 
     // Return a pointer to an array and its number of elements.
@@ -99,16 +120,17 @@ public:
         uint32_t size = read<uint32_t>();
         mCurrent = BufferReader::align<T, align>(mCurrent);
         const T* data = reinterpret_cast<const T*>(mCurrent);
+        if (mEnd != nullptr && (mCurrent > mEnd || size > (mEnd - mCurrent) / sizeof(T))) {
+            overflow();
+            return std::make_pair(data, 0u);
+        }
         mCurrent += size * sizeof(T);
         return std::make_pair(data, size);
     }
 
     template <typename T, size_t align = sizeof(T)>
     void skipArray() {
-        static_assert(std::is_pod<T>::value, "T must be a POD");
-        uint32_t size = read<uint32_t>();
-        mCurrent = BufferReader::align<T, align>(mCurrent);
-        mCurrent += size * sizeof(T);
+        readArray<T, align>();
     }
 
     std::string_view readString() {
@@ -120,8 +142,32 @@ public:
 
     const void* current() const { return mCurrent; }
 
+    // Returns true if a read of a bounded reader went past the end.
+    bool overflowed() const { return mOverflowed; }
+
+    // Returns the number of the bytes left in a bounded reader, or SIZE_MAX if it is unbounded.
+    size_t remaining() const {
+        return mEnd == nullptr ? SIZE_MAX : mCurrent < mEnd ? mEnd - mCurrent : 0;
+    }
+
 private:
+    inline bool hasBytes(size_t size) {
+        if (mEnd == nullptr || (mCurrent <= mEnd && size <= static_cast<size_t>(mEnd - mCurrent))) {
+            return true;
+        }
+        overflow();
+        return false;
+    }
+
+    void overflow() {
+        mOverflowed = true;
+        mCurrent = mEnd;
+    }
+
     const uint8_t* mCurrent;
+    // The end of the buffer if the reader is bounded, otherwise nullptr.
+    const uint8_t* mEnd;
+    bool mOverflowed;
 };
 
 // This is a helper class to write data to a memory buffer.
@@ -177,14 +223,22 @@ public:
     // TODO: use std::type_identity_t when C++20 is available.
     template <typename T, size_t align = sizeof(T)>
     void writeArray(const std::common_type_t<T>* data, uint32_t size) {
+        T* out = reserveArray<T, align>(size);
+        if (out != nullptr && size != 0) {
+            memcpy(out, data, size * sizeof(T));
+        }
+    }
+
+    // Write the size of an array of type T and reserve the region of its elements, which the
+    // caller fills in place instead of writing them one by one. The layout is the same as
+    // writeArray, so the array is read with BufferReader::readArray.
+    // Returns nullptr for a fake writer.
+    template <typename T, size_t align = sizeof(T)>
+    T* reserveArray(uint32_t size) {
         static_assert(std::is_pod<T>::value, "T must be a POD");
         static_assert(sizeof(T) % align == 0);
         write<uint32_t>(size);
-        mPos = BufferWriter::align<T, align>(mPos);
-        if (mData != nullptr) {
-            memcpy(mData + mPos, data, size * sizeof(T));
-        }
-        mPos += size * sizeof(T);
+        return reserve<T, align>(size * sizeof(T));
     }
 
     void writeString(std::string_view string) { writeArray<char>(string.data(), string.size()); }
@@ -192,6 +246,18 @@ public:
     // Return the number of bytes written.
     size_t size() const { return mPos; }
 
+    // Run the two passes described above with writeFunc, which takes a BufferWriter*, and return
+    // the buffer. The buffer is allocated once at the measured size.
+    template <typename F>
+    static std::vector<uint8_t> writeToVector(F&& writeFunc) {
+        BufferWriter fakeWriter(nullptr);
+        writeFunc(&fakeWriter);
+        std::vector<uint8_t> buffer(fakeWriter.size());
+        BufferWriter writer(buffer.data());
+        writeFunc(&writer);
+        return buffer;
+    }
+
 private:
     uint8_t* mData;
     size_t mPos;
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_CACHE_PARTITION_H
+#define MINIKIN_CACHE_PARTITION_H
+
+#include <cstdint>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// The independent instances of LayoutCache and BoundsCache. Each partition has its own capacity,
+// memory budget and settings, so that the bulk work, e.g. pre-measuring a whole book, doesn't
+// evict the layouts of the text drawn on the screen.
+enum class CachePartition : uint8_t {
+    // The default partition, used for the text laid out to be drawn.
+    Interactive = 0,
+    // The partition for the background work laying out a lot of text which is never seen again.
+    Bulk = 1,
+};
+
+constexpr CachePartition kCachePartitions[] = {CachePartition::Interactive, CachePartition::Bulk};
+
+// Makes LayoutCache::getInstance() and BoundsCache::getInstance() return the instances of the
+// partition on this thread while the instance is alive, including for the work the thread hands
+// to the worker pool. The scopes may be nested.
+class CachePartitionScope {
+public:
+    explicit CachePartitionScope(CachePartition partition);
+    ~CachePartitionScope();
+
+    // Returns the partition of the innermost instance alive on this thread, or Interactive.
+    static CachePartition getCurrent();
+
+private:
+    const CachePartition mOuter;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(CachePartitionScope);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_CACHE_PARTITION_H
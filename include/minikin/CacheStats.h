@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_CACHE_STATS_H
+#define MINIKIN_CACHE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// Counters of the contention on a mutex. The mutex is tried first and only the acquisitions which
+// have to wait are timed, so an uncontended lock costs no more than before. Counting all the
+// acquisitions writes a shared counter on every lock, so it is disabled by default.
+class LockStats {
+public:
+    // The wait time histogram buckets, below 1us, 10us, 100us, 1ms, 10ms and the longer waits.
+    static constexpr size_t kWaitBucketCount = 6;
+
+    LockStats() {}
+
+    // Enables or disables the counting of all the acquisitions, of all the instances.
+    static void setAcquisitionCountEnabled(bool enabled) {
+        sAcquisitionCountEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    template <typename Mutex>
+    std::unique_lock<Mutex> lock(Mutex& mutex) {
+        if (sAcquisitionCountEnabled.load(std::memory_order_relaxed)) {
+            mAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::unique_lock<Mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start);
+            recordWait(elapsed.count());
+        }
+        return lock;
+    }
+
+    // The number of the acquisitions while the counting was enabled.
+    uint64_t getAcquisitionCount() const { return mAcquisitions.load(std::memory_order_relaxed); }
+
+    // The number of the acquisitions which waited for another thread, and their total wait time.
+    uint64_t getWaitCount() const { return mWaits.load(std::memory_order_relaxed); }
+    uint64_t getWaitNanos() const { return mWaitNanos.load(std::memory_order_relaxed); }
+
+    // The number of the waits in the bucket of the histogram.
+    uint64_t getWaitCount(size_t bucket) const {
+        return mWaitBuckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    // Returns the histogram bucket of a wait of the given length.
+    static size_t getWaitBucket(uint64_t nanos) {
+        size_t bucket = 0;
+        for (uint64_t limit = 1000; bucket < kWaitBucketCount - 1 && nanos >= limit; limit *= 10) {
+            bucket++;
+        }
+        return bucket;
+    }
+
+    // Writes the counters as lines of the statistics dump.
+    void dump(int fd) const;
+
+private:
+    void recordWait(uint64_t nanos) {
+        const size_t bucket = getWaitBucket(nanos);
+        mWaits.fetch_add(1, std::memory_order_relaxed);
+        mWaitNanos.fetch_add(nanos, std::memory_order_relaxed);
+        mWaitBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static std::atomic<bool> sAcquisitionCountEnabled;
+
+    std::atomic<uint64_t> mAcquisitions{0};
+    std::atomic<uint64_t> mWaits{0};
+    std::atomic<uint64_t> mWaitNanos{0};
+    std::atomic<uint64_t> mWaitBuckets[kWaitBucketCount] = {};
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(LockStats);
+};
+
+// Counters of a layout related cache. All updates are relaxed atomic operations, so recording is
+// cheap enough to be always on. The values are only meant for the statistics dump, e.g. for sizing
+// the caches from field data, and must not be used for synchronization.
+class CacheStats {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    // The reasons of looking up a layout without using the cache at all.
+    enum class BypassReason {
+        TooLong,  // The text is longer than the cache accepts.
+    };
+
+    // Passed to dump() when the cache doesn't know its memory usage.
+    static constexpr size_t kUnknownMemoryUsage = static_cast<size_t>(-1);
+
+    CacheStats() {}
+
+    static TimePoint now() { return std::chrono::steady_clock::now(); }
+
+    void recordHit() { mHits.fetch_add(1, std::memory_order_relaxed); }
+
+    // Records a miss which has been resolved by other cache, i.e. without shaping by itself.
+    void recordMiss() { mMisses.fetch_add(1, std::memory_order_relaxed); }
+
+    // Records a miss whose shaping started at the given time and has just finished.
+    void recordMiss(TimePoint shapingStart) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - shapingStart);
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        mMissShapingNanos.fetch_add(elapsed.count(), std::memory_order_relaxed);
+    }
+
+    void recordEvictions(uint64_t count) {
+        mEvictions.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Records a new entry which was not stored because the admission policy rejected it.
+    void recordRejection() { mRejections.fetch_add(1, std::memory_order_relaxed); }
+
+    void recordBypass(BypassReason) { mTooLongBypasses.fetch_add(1, std::memory_order_relaxed); }
+
+    uint64_t getHitCount() const { return mHits.load(std::memory_order_relaxed); }
+    uint64_t getMissCount() const { return mMisses.load(std::memory_order_relaxed); }
+    uint64_t getEvictionCount() const { return mEvictions.load(std::memory_order_relaxed); }
+    uint64_t getRejectionCount() const { return mRejections.load(std::memory_order_relaxed); }
+    uint64_t getBypassCount(BypassReason) const {
+        return mTooLongBypasses.load(std::memory_order_relaxed);
+    }
+    uint64_t getMissShapingNanos() const {
+        return mMissShapingNanos.load(std::memory_order_relaxed);
+    }
+
+    // The contention on the lock of the cache, for the caches which record it.
+    LockStats& getLockStats() { return mLockStats; }
+    const LockStats& getLockStats() const { return mLockStats; }
+
+    // Writes the counters to the file descriptor in a human readable form. memoryUsage is the
+    // number of bytes resident in the cache, or kUnknownMemoryUsage.
+    void dump(int fd, const char* name, size_t memoryUsage) const;
+
+private:
+    std::atomic<uint64_t> mHits{0};
+    std::atomic<uint64_t> mMisses{0};
+    std::atomic<uint64_t> mEvictions{0};
+    std::atomic<uint64_t> mRejections{0};
+    std::atomic<uint64_t> mTooLongBypasses{0};
+    std::atomic<uint64_t> mMissShapingNanos{0};
+    LockStats mLockStats;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(CacheStats);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_CACHE_STATS_H
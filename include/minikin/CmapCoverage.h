@@ -28,6 +28,10 @@ class CmapCoverage {
 public:
     static SparseBitSet getCoverage(const uint8_t* cmap_data, size_t cmap_size,
                                     std::vector<SparseBitSet>* out);
+
+    // Makes getCoverage parse each distinct cmap table once per process. The later calls with the
+    // same table return bit sets sharing the memory of the first result. Disabled by default.
+    static void setCacheEnabled(bool enabled);
 };
 
 }  // namespace minikin
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_EXECUTOR_H
+#define MINIKIN_EXECUTOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace minikin {
+
+enum class TaskPriority : uint8_t {
+    // Work the calling thread is waiting for, e.g. the other half of a paragraph being shaped.
+    High = 0,
+    // Work ahead of its use, e.g. pre-measuring or warming up fonts.
+    Low = 1,
+};
+
+// Set once the result of a task is no longer needed. The copies share the same state.
+class CancellationToken {
+public:
+    CancellationToken() : mCancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const { mCancelled->store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return mCancelled->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> mCancelled;
+};
+
+// The thread pool of the host, which runs the parallel and background work of minikin instead of
+// the threads minikin would start otherwise: the helpers of the parallel shaping, measuring and
+// coverage computation, MeasuredTextBuilder::buildAsync and Font::warmUpAsync.
+class Executor {
+public:
+    Executor() {}
+    virtual ~Executor() = 0;
+
+    // Runs the task once on some thread, the High ones before the Low ones. The task may be
+    // dropped without running once the token is cancelled, and minikin never waits for a task
+    // whose token it cancelled. The task must not run on the calling thread within this call.
+    virtual void execute(std::function<void()>&& task, TaskPriority priority,
+                         const CancellationToken& token) = 0;
+
+    // The number of tasks worth running at once besides the calling thread, e.g. the number of
+    // the threads of the pool. The parallel work is split into this many helper tasks at most.
+    virtual uint32_t getConcurrency() const = 0;
+
+    // Returns the registered executor, or nullptr if minikin uses its own threads.
+    static Executor* getInstance();
+
+    // Registers the executor of the host. Must be called before any parallel or background work
+    // starts, since the process wide worker pool is created on the first use with either the
+    // executor or its own threads. The executor must live as long as the process, and cannot be
+    // changed once it is set. Not thread safe.
+    static void setInstance(Executor* executor);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_EXECUTOR_H
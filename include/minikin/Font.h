@@ -19,10 +19,15 @@
 
 #include <gtest/gtest_prod.h>
 
+#include <algorithm>
 #include <atomic>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <unordered_set>
+#include <vector>
 
+#include "minikin/ArrayView.h"
 #include "minikin/Buffer.h"
 #include "minikin/FontStyle.h"
 #include "minikin/FontVariation.h"
@@ -67,6 +72,19 @@ struct FakedFont {
     FontFakery fakery;
 };
 
+// The nominal glyphs of the printable ASCII characters of a font, which are used as they are
+// instead of shaping the text with HarfBuzz.
+struct SimpleAsciiGlyphs {
+    static constexpr uint32_t kFirst = 0x20;
+    static constexpr uint32_t kLast = 0x7E;
+
+    // False if the font has tables which can change the glyphs or their positions, e.g. GSUB or
+    // GPOS, so that the text must be shaped.
+    bool isSimple;
+    // Zero if the font doesn't support the character.
+    uint16_t glyphIds[kLast - kFirst + 1];
+};
+
 // Represents a single font file.
 class Font {
 public:
@@ -126,7 +144,71 @@ public:
     const HbFontUniquePtr& baseFont() const;
     BufferReader typefaceMetadataReader() const { return mTypefaceMetadataReader; }
 
-    std::unordered_set<AxisTag> getSupportedAxes() const;
+    // The sorted axes of the fvar table of the font. Computed once when the font is built and
+    // serialized with it, so this doesn't touch the font file.
+    ArrayView<AxisTag> getSupportedAxes() const {
+        return ArrayView<AxisTag>(mSupportedAxes, mSupportedAxesCount);
+    }
+    bool isAxisSupported(AxisTag tag) const {
+        return std::binary_search(mSupportedAxes, mSupportedAxes + mSupportedAxesCount, tag);
+    }
+
+    // Returns the font of typeface()->createFontWithVariation(variations) with the style of this
+    // font, or null if the typeface can't be created. If the new typeface refers to the same font
+    // data, the HarfBuzz face of this font is shared and the HarfBuzz fonts instanced for the
+    // recently used variations are kept on this font, so that a variation used again, e.g. on every
+    // frame of a weight animation, is not instanced again. Such fonts also share the sub-fonts
+    // set up for shaping.
+    std::shared_ptr<Font> createFontWithVariation(
+            const std::vector<FontVariation>& variations) const;
+
+    // Creates the typeface and the HarfBuzz font now if they are created lazily, i.e. if this font
+    // is read from a buffer, so that the first layout with this font doesn't pay for it.
+    void warmUp() const { getExternalRefs(); }
+
+    // Warms up the fonts on a new background thread, or as a task of the registered Executor,
+    // e.g. at process start. The returned future becomes ready once all the fonts are warmed up.
+    static std::shared_future<void> warmUpAsync(std::vector<std::shared_ptr<Font>>&& fonts);
+
+    // Keeps the objects returned by typeface(), baseFont() and getSimpleAsciiGlyphs() of every font
+    // from being deleted by releaseIdleExternalRefs() while it is alive, e.g. around a shaping or
+    // bounds call. Entering and leaving only touch a per-thread counter. Guards may be nested.
+    class ExternalRefsGuard {
+    public:
+        ExternalRefsGuard();
+        ~ExternalRefsGuard();
+
+    private:
+        std::atomic<uint32_t>* mCounter;
+
+        MINIKIN_PREVENT_COPY_AND_ASSIGN(ExternalRefsGuard);
+    };
+
+    // Releases the typefaces and HarfBuzz fonts of the fonts read from a buffer which haven't been
+    // used since the previous call, e.g. on a memory trim request. They are created again on the
+    // next use. The released objects are deleted by a later call once no ExternalRefsGuard entered
+    // before their release is alive. Without a guard, the references returned by typeface(),
+    // baseFont() and getSimpleAsciiGlyphs() must not be kept across two calls.
+    // Returns the number of fonts released.
+    static size_t releaseIdleExternalRefs();
+
+    // Returns the bytes of the ExternalRefs which releaseIdleExternalRefs() may release or has
+    // released but not deleted yet, including their variation fonts. The typefaces and HarfBuzz
+    // fonts don't expose their sizes, so only the references to them are counted.
+    static size_t getExternalRefsMemoryUsage();
+
+    // Returns the glyphs of the printable ASCII characters if they can be laid out without
+    // shaping, otherwise null. Computed on the first call.
+    const SimpleAsciiGlyphs* getSimpleAsciiGlyphs() const;
+
+    // Returns the character to shape for the hyphen character of a hyphen edit. The Armenian
+    // hyphen, the maqaf and the UCAS hyphen fall back to U+2010 HYPHEN, and U+2010 falls back to
+    // U+002D HYPHEN-MINUS, if the font doesn't support them. Computed on the first call.
+    uint32_t getHyphenChar(uint32_t preferredHyphen) const;
+
+    // Returns true if the glyphs of the font are color bitmaps, i.e. the font has a CBDT table.
+    // Computed on the first call.
+    bool isColorBitmapFont() const;
 
 private:
     // ExternalRefs holds references to objects provided by external libraries.
@@ -135,31 +217,68 @@ private:
     class ExternalRefs {
     public:
         ExternalRefs(std::shared_ptr<MinikinFont>&& typeface, HbFontUniquePtr&& baseFont)
-                : mTypeface(std::move(typeface)), mBaseFont(std::move(baseFont)) {}
+                : mTypeface(std::move(typeface)), mBaseFont(std::move(baseFont)),
+                  mAsciiGlyphs(nullptr), mHyphenSupport(0), mColorBitmap(0) {}
+        ~ExternalRefs() { delete mAsciiGlyphs.load(); }
+
+        // Returns the HarfBuzz font of the font data of mBaseFont instanced for the variations.
+        HbFontUniquePtr getVariationFont(const std::vector<FontVariation>& variations) const;
 
         std::shared_ptr<MinikinFont> mTypeface;
         HbFontUniquePtr mBaseFont;
+        // Lazily created by getSimpleAsciiGlyphs().
+        mutable std::atomic<SimpleAsciiGlyphs*> mAsciiGlyphs;
+        // The hyphen characters supported by the font, see analyzeHyphenSupport(). Lazily computed
+        // by getHyphenChar().
+        mutable std::atomic<uint8_t> mHyphenSupport;
+        // 0 until isColorBitmapFont() is called, then kIsColorBitmap or kIsNotColorBitmap.
+        mutable std::atomic<uint8_t> mColorBitmap;
+
+        static constexpr size_t kMaxVariationFonts = 8;
+        // The recently used fonts of getVariationFont(), the most recent one at the back.
+        mutable std::mutex mVariationFontsMutex;
+        mutable std::vector<std::pair<std::vector<FontVariation>, HbFontUniquePtr>> mVariationFonts
+                GUARDED_BY(mVariationFontsMutex);
     };
 
     // Use Builder instead.
     Font(std::shared_ptr<MinikinFont>&& typeface, FontStyle style, HbFontUniquePtr&& baseFont,
-         uint32_t localeListId)
-            : mExternalRefsHolder(new ExternalRefs(std::move(typeface), std::move(baseFont))),
-              mStyle(style),
-              mLocaleListId(localeListId),
-              mTypefaceMetadataReader(nullptr) {}
+         uint32_t localeListId);
+
+    // The number of locks the ExternalRefs creation is striped over.
+    static constexpr size_t kExternalRefsMutexCount = 16;
+
+    // The fonts whose ExternalRefs can be released and the released ones to be deleted.
+    struct ExternalRefsRegistry;
+    static ExternalRefsRegistry sExternalRefsRegistry;
 
     void resetExternalRefs(ExternalRefs* refs);
+    // Detaches the ExternalRefs from this font and returns it.
+    ExternalRefs* takeExternalRefs();
 
     const ExternalRefs* getExternalRefs() const;
 
     static HbFontUniquePtr prepareFont(const std::shared_ptr<MinikinFont>& typeface);
+    // Creates a sub-font of the font scaled to the units per em with the variations applied.
+    static HbFontUniquePtr createVariationFont(hb_font_t* parent,
+                                               const std::vector<FontVariation>& variations);
     static FontStyle analyzeStyle(const HbFontUniquePtr& font);
+    static std::unique_ptr<SimpleAsciiGlyphs> analyzeAsciiGlyphs(const HbFontUniquePtr& font);
+    static uint8_t analyzeHyphenSupport(const HbFontUniquePtr& font);
+    static std::unordered_set<AxisTag> analyzeSupportedAxes(const HbFontUniquePtr& font);
 
     // Lazy-initialized if created by readFrom().
     mutable std::atomic<ExternalRefs*> mExternalRefsHolder;
+    // The number of releaseIdleExternalRefs() calls when the ExternalRefs was last used. Only
+    // updated if created by readFrom().
+    mutable std::atomic<uint32_t> mLastUsedEpoch;
     FontStyle mStyle;
     uint32_t mLocaleListId;
+    uint16_t mSupportedAxesCount;
+    // mSupportedAxes is sorted. It points to mOwnedSupportedAxes or into the buffer if created by
+    // readFrom().
+    const AxisTag* mSupportedAxes;
+    std::unique_ptr<AxisTag[]> mOwnedSupportedAxes;
 
     // Non-null if created by readFrom().
     BufferReader mTypefaceMetadataReader;
@@ -170,6 +289,10 @@ private:
 
     FRIEND_TEST(FontTest, MoveConstructorTest);
     FRIEND_TEST(FontTest, MoveAssignmentTest);
+    FRIEND_TEST(FontTest, getSupportedAxesTest);
+    FRIEND_TEST(FontTest, warmUpTest);
+    FRIEND_TEST(FontTest, releaseIdleExternalRefsTest);
+    FRIEND_TEST(FontTest, releaseIdleExternalRefsGuardTest);
 };
 
 }  // namespace minikin
@@ -19,43 +19,72 @@
 
 #include <gtest/gtest_prod.h>
 
+#include <atomic>
+#include <deque>
+#include <future>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "minikin/ArrayView.h"
 #include "minikin/Buffer.h"
 #include "minikin/Font.h"
 #include "minikin/FontFamily.h"
+#include "minikin/FontVariation.h"
+#include "minikin/Macros.h"
 #include "minikin/MinikinFont.h"
+#include "minikin/Range.h"
 #include "minikin/U16StringPiece.h"
 
 namespace minikin {
 
-// The maximum number of font families.
+// The maximum number of font families of a collection in the compact form, whose family indices
+// fit in a byte.
 constexpr uint32_t MAX_FAMILY_COUNT = 254;
+// The maximum number of font families. The collections of more than MAX_FAMILY_COUNT families keep
+// 16-bit family indices instead.
+constexpr uint32_t MAX_WIDE_FAMILY_COUNT = 0xFFFE;
 
 class FontCollection {
 public:
     static std::shared_ptr<FontCollection> create(
             const std::vector<std::shared_ptr<FontFamily>>& typefaces);
     static std::shared_ptr<FontCollection> create(std::shared_ptr<FontFamily>&& typeface);
+    // Same as calling create for each list of families in order, but the collections are built on
+    // the worker pool. Combined with FontFamily::createBatch when loading the system fonts.
+    static std::vector<std::shared_ptr<FontCollection>> createBatch(
+            const std::vector<std::vector<std::shared_ptr<FontFamily>>>& typefacesList);
 
+    ~FontCollection();
+
+    // Reads the collections written by writeVector. The coverages, pages, lookup tables and axes
+    // are used in place, so the buffer must outlive the collections and may be a read-only
+    // mapping shared by processes.
     static std::vector<std::shared_ptr<FontCollection>> readVector(BufferReader* reader);
     static void writeVector(BufferWriter* writer,
                             const std::vector<std::shared_ptr<FontCollection>>& fontCollections);
 
-    // Helper class for representing font family match result in packed bits.
+    // Helper class for representing font family match result in packed bits. Holds up to seven
+    // 8-bit family indices. For the collections of more than MAX_FAMILY_COUNT families, up to
+    // three 16-bit indices are packed and the larger results are held in a shared array instead,
+    // so that no matching family is dropped.
     struct FamilyMatchResult {
     public:
         struct Builder {
         public:
-            Builder() : mSize(0), mBits(0) {}
-
-            Builder& add(uint8_t x) {
-                if (mSize >= 7) [[unlikely]] {
-                        return *this;
-                    }
-                mBits = mBits | (static_cast<uint64_t>(x) << (8 * mSize));
+            Builder() : Builder(false) {}
+            explicit Builder(bool wide) : mSize(0), mWide(wide), mBits(0) {}
+
+            Builder& add(uint16_t x) {
+                if (mWide && mSize >= kMaxWideSize) [[unlikely]] {
+                    return addOutOfLine(x);
+                }
+                if (mSize >= kMaxSize) [[unlikely]] {
+                    return *this;
+                }
+                mBits = mBits | (static_cast<uint64_t>(x) << ((mWide ? 16 : 8) * mSize));
                 mSize++;
                 return *this;
             }
@@ -63,31 +92,40 @@ public:
             Builder& reset() {
                 mSize = 0;
                 mBits = 0;
+                mFamilies.reset();
                 return *this;
             }
 
-            uint8_t size() const { return mSize; }
+            uint32_t size() const { return mSize; }
 
             bool empty() const { return size() == 0; }
 
             FamilyMatchResult build() {
-                return FamilyMatchResult(mBits | (static_cast<uint64_t>(mSize) << 56));
+                if (mFamilies) [[unlikely]] {
+                    return FamilyMatchResult(kWideBit, mFamilies);
+                }
+                return FamilyMatchResult(mBits | (static_cast<uint64_t>(mSize) << 56) |
+                                         (mWide ? kWideBit : 0));
             }
 
         private:
-            uint8_t mSize;
+            Builder& addOutOfLine(uint16_t x);
+
+            uint32_t mSize;
+            bool mWide;
             uint64_t mBits;
+            std::shared_ptr<std::vector<uint16_t>> mFamilies;
         };
 
         // Helper class for iterating FamilyMatchResult
         class iterator {
         public:
             inline bool operator==(const iterator& o) const {
-                return mOffset == o.mOffset && mResult == o.mResult;
+                return mOffset == o.mOffset && &mResult == &o.mResult;
             }
 
             inline bool operator!=(const iterator& o) const { return !(*this == o); }
-            inline uint8_t operator*() const { return mResult[mOffset]; }
+            inline uint16_t operator*() const { return mResult[mOffset]; }
             inline iterator& operator++() {
                 mOffset++;
                 return *this;
@@ -104,18 +142,35 @@ public:
         // Create empty FamilyMatchResult.
         FamilyMatchResult() : mBits(0) {}
 
-        inline uint8_t size() const { return static_cast<uint8_t>(mBits >> 56); }
+        inline uint32_t size() const {
+            if (mFamilies) [[unlikely]] {
+                return mFamilies->size();
+            }
+            return static_cast<uint8_t>(mBits >> 56) & 0x7F;
+        }
+
+        // Returns true if the family indices are 16-bit.
+        inline bool isWide() const { return (mBits & kWideBit) != 0; }
 
-        inline uint8_t operator[](uint32_t pos) const {
-            return static_cast<uint8_t>(mBits >> (pos * 8));
+        inline uint16_t operator[](uint32_t pos) const {
+            if (mFamilies) [[unlikely]] {
+                return (*mFamilies)[pos];
+            }
+            return isWide() ? static_cast<uint16_t>(mBits >> (pos * 16))
+                            : static_cast<uint8_t>(mBits >> (pos * 8));
         }
 
         inline bool empty() const { return size() == 0; }
 
-        inline bool operator==(const FamilyMatchResult& o) const { return mBits == o.mBits; }
+        inline bool operator==(const FamilyMatchResult& o) const {
+            if (mFamilies || o.mFamilies) [[unlikely]] {
+                return mFamilies && o.mFamilies && *mFamilies == *o.mFamilies;
+            }
+            return mBits == o.mBits;
+        }
 
         // Returns the common family indices between l and r.
-        static FamilyMatchResult intersect(FamilyMatchResult l, FamilyMatchResult r);
+        static FamilyMatchResult intersect(const FamilyMatchResult& l, const FamilyMatchResult& r);
 
         // Iterator
         inline iterator begin() const { return iterator(*this, 0); }
@@ -125,8 +180,22 @@ public:
         FamilyMatchResult& operator=(const FamilyMatchResult& o) = default;
 
     private:
+        friend class FontCollection;  // For caching the packed bits.
+
+        static constexpr uint8_t kMaxSize = 7;
+        static constexpr uint8_t kMaxWideSize = 3;
+        static constexpr uint64_t kWideBit = 1ull << 63;
+
         explicit FamilyMatchResult(uint64_t bits) : mBits(bits) {}
+        FamilyMatchResult(uint64_t bits, std::shared_ptr<const std::vector<uint16_t>> families)
+                : mBits(bits), mFamilies(std::move(families)) {}
+
+        // Returns true if the result is packed in mBits, thus can be cached as the bits alone.
+        bool isPacked() const { return !mFamilies; }
+
         uint64_t mBits;
+        // The family indices of the wide results of more than kMaxWideSize families.
+        std::shared_ptr<const std::vector<uint16_t>> mFamilies;
     };
 
     struct Run {
@@ -147,6 +216,27 @@ public:
         return itemize(text, style, localeListId, familyVariant, text.size());
     }
 
+    // A style run of a paragraph. Only the properties affecting the font fallback are needed.
+    struct StyleRange {
+        uint32_t start;
+        uint32_t end;
+        uint32_t localeListId;
+        FamilyVariant familyVariant;
+    };
+
+    // Perform the itemization of a paragraph of multiple style runs at once. The last families are
+    // carried across the style runs as if the paragraph were a single run, thus a returned run may
+    // span multiple style runs. The style ranges must be sorted and cover the whole text.
+    std::vector<Run> itemize(U16StringPiece text, const std::vector<StyleRange>& styleRanges) const;
+
+    // Fills outRuns with the runs of text.substr(range) taken from the runs of the paragraph
+    // returned by the above itemize, if they are known to be the same as itemizing the substring
+    // alone. The range must be in a single style range having the given locales and variant.
+    // Returns false if the substring needs to be itemized.
+    bool sliceParagraphRuns(U16StringPiece text, const std::vector<Run>& paragraphRuns,
+                            const minikin::Range& range, uint32_t localeListId,
+                            FamilyVariant familyVariant, std::vector<Run>* outRuns) const;
+
     // Returns true if there is a glyph for the code point and variation selector pair.
     // Returns false if no fonts have a glyph for the code point and variation
     // selector pair, or invalid variation selector is passed.
@@ -155,6 +245,10 @@ public:
     // Get base font with fakery information (fake bold could affect metrics)
     FakedFont baseFontFaked(FontStyle style);
 
+    // Warms up the fonts of the primary families and of the fallback families supporting one of
+    // the locales on a background thread. See Font::warmUpAsync.
+    std::shared_future<void> warmUpFontsAsync(uint32_t localeListId) const;
+
     // Creates new FontCollection based on this collection while applying font variations. Returns
     // nullptr if none of variations apply to this collection.
     std::shared_ptr<FontCollection> createCollectionWithVariation(
@@ -169,6 +263,38 @@ public:
 
     uint32_t getId() const;
 
+    // Returns an ID derived from the families: the files, indices, axis values and styles of the
+    // fonts, and the locales and variants of the families. Unlike getId(), it is the same in every
+    // process for the same collection, so it can key the data shared across processes. Computed
+    // on the first call, or read from the buffer the collection is read from.
+    uint64_t getStableId() const;
+
+    // Makes the font fallback resolve the characters supported by a single family, or by a
+    // primary family, from a per character table instead of scoring the families. The table is
+    // built lazily for each page of characters, and written together with the collection so that
+    // readers don't need to build it again. Disabled by default.
+    static void setFamilyLookupTableEnabled(bool enabled);
+
+    // Makes create() and createCollectionWithVariation() return the live collection created from
+    // the same font families, and with the same variations, if any, instead of a new one, so that
+    // the equivalent collections share one ID, one coverage table and the cached layouts. The
+    // families are told apart by identity. Disabled by default.
+    static void setInterningEnabled(bool enabled);
+
+    // Makes itemize() split a long text at the characters which start a run or continue it the same
+    // way whatever precedes them, and itemize the chunks on the WorkerPool. The runs of adjacent
+    // chunks are joined as the sequential itemization does, so the result is the same. The short
+    // texts and the itemizations limited to fewer runs are itemized sequentially. Disabled by
+    // default.
+    static void setParallelItemizationEnabled(bool enabled);
+
+    // Returns the IDs of the collections destroyed since the previous call, so that the caches
+    // keyed by getId() can evict their entries, see Layout::purgeDestroyedCollections(). The
+    // destructor only records the ID, so that destroying a collection never takes a cache lock.
+    static std::vector<uint32_t> takeDestroyedIds();
+    // Returns true if takeDestroyedIds() would return some IDs. A single atomic load.
+    static bool hasDestroyedIds();
+
     size_t getFamilyCount() const { return mFamilyCount; }
 
     const std::shared_ptr<FontFamily>& getFamilyAt(size_t index) const {
@@ -182,6 +308,10 @@ private:
     FRIEND_TEST(FontCollectionTest, bufferTest);
 
     explicit FontCollection(const std::vector<std::shared_ptr<FontFamily>>& typefaces);
+    // Creates a collection of the families with variations derived from the parent's families,
+    // sharing the pages of the parent.
+    FontCollection(const FontCollection& parent,
+                   std::vector<std::shared_ptr<FontFamily>>&& families);
     FontCollection(
             BufferReader* reader,
             const std::shared_ptr<std::vector<std::shared_ptr<FontFamily>>>& allFontFamilies);
@@ -209,14 +339,107 @@ private:
         uint16_t end;
     };
 
+    // The family indices of a page: bytes, or 16-bit integers if mWideIndices is true.
+    class PageFamilies {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = uint16_t;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const uint16_t*;
+            using reference = uint16_t;
+
+            iterator(const PageFamilies* families, uint32_t pos) : mFamilies(families), mPos(pos) {}
+            uint16_t operator*() const { return (*mFamilies)[mPos]; }
+            iterator& operator++() {
+                mPos++;
+                return *this;
+            }
+            iterator operator++(int) {
+                iterator it = *this;
+                mPos++;
+                return it;
+            }
+            bool operator==(const iterator& o) const { return mPos == o.mPos; }
+            bool operator!=(const iterator& o) const { return mPos != o.mPos; }
+
+        private:
+            const PageFamilies* mFamilies;
+            uint32_t mPos;
+        };
+
+        PageFamilies(const uint8_t* families, uint32_t size)
+                : mFamilies(families), mWideFamilies(nullptr), mSize(size) {}
+        PageFamilies(const uint16_t* families, uint32_t size)
+                : mFamilies(nullptr), mWideFamilies(families), mSize(size) {}
+
+        uint32_t size() const { return mSize; }
+        uint16_t operator[](uint32_t pos) const {
+            return mWideFamilies != nullptr ? mWideFamilies[pos] : mFamilies[pos];
+        }
+        iterator begin() const { return iterator(this, 0); }
+        iterator end() const { return iterator(this, mSize); }
+
+    private:
+        const uint8_t* mFamilies;
+        const uint16_t* mWideFamilies;
+        uint32_t mSize;
+    };
+
     // Initialize the FontCollection.
     void init(const std::vector<std::shared_ptr<FontFamily>>& typefaces);
 
+    // Returns the indices of the families which support any character of the page, in the
+    // collection order. Same as mFamilyVec in mRanges[page] unless the pages are built lazily.
+    PageFamilies getPageFamilies(uint32_t page) const;
+    const uint8_t* buildLazyPage(uint32_t page) const;
+    // Returns mMaxChar, or computes it from the family coverages if the pages are built lazily.
+    uint32_t getMaxChar() const;
+    static constexpr uint32_t kUnknownMaxChar = ~0u;
+
+    std::vector<Run> itemizeStyleRanges(U16StringPiece text, const StyleRange* styleRanges,
+                                        size_t styleRangeCount, uint32_t runMax) const;
+    std::vector<Run> itemizeSequentially(U16StringPiece text, const StyleRange* styleRanges,
+                                         size_t styleRangeCount, uint32_t runMax) const;
+    // Itemizes the chunks of the text in parallel, see setParallelItemizationEnabled. Returns false
+    // if the text can't be split.
+    bool itemizeInParallel(U16StringPiece text, const StyleRange* styleRanges,
+                           size_t styleRangeCount, std::vector<Run>* outRuns) const;
+
+    // Returns a builder of the match results in the form of the family indices of this collection.
+    FamilyMatchResult::Builder matchBuilder() const {
+        return FamilyMatchResult::Builder(mWideIndices);
+    }
+
+    // Same as getFamilyForCharUncached but memoizes the results in a per-thread cache.
     FamilyMatchResult getFamilyForChar(uint32_t ch, uint32_t vs, uint32_t localeListId,
                                        FamilyVariant variant) const;
 
+    FamilyMatchResult getFamilyForCharUncached(uint32_t ch, uint32_t vs, uint32_t localeListId,
+                                               FamilyVariant variant) const;
+
+    // The family lookup table holds a family index for each character of a page, or
+    // kAmbiguousFamily if the family depends on the locale or the variant, or no family supports
+    // the character.
+    static constexpr uint8_t kAmbiguousFamily = 0xFF;  // Larger than any family index.
+    static constexpr uint32_t kCharsPerPage = 1 << kLogCharsPerPage;
+    static constexpr uint16_t kNoLookupPage = 0xFFFF;
+    static bool isFamilyLookupTableEnabled();
+    static bool isInterningEnabled();
+    static bool isParallelItemizationEnabled();
+    const uint8_t* getFamilyLookupPage(uint32_t page) const;
+    void buildFamilyLookupPage(uint32_t page, uint8_t* outFamilies) const;
+    std::atomic<const uint8_t*>* getFamilyLookupPages() const;
+    bool isOwnedFamilyLookupPage(const uint8_t* families) const;
+
+    // Returns the end of the span of characters from pos which are known to continue the run of
+    // the given family without looking up the family for each of them.
+    size_t scanRunContinuation(const uint16_t* text, size_t pos, size_t size,
+                               uint16_t familyIndex) const;
+
     uint32_t calcFamilyScore(uint32_t ch, uint32_t vs, FamilyVariant variant, uint32_t localeListId,
-                             const std::shared_ptr<FontFamily>& fontFamily) const;
+                             uint16_t familyIndex) const;
 
     uint32_t calcCoverageScore(uint32_t ch, uint32_t vs, uint32_t localeListId,
                                const std::shared_ptr<FontFamily>& fontFamily) const;
@@ -226,11 +449,25 @@ private:
     static uint32_t calcLocaleMatchingScore(uint32_t userLocaleListId,
                                             const FontFamily& fontFamily);
 
+    // The locale matching scores of all the families for a locale list, computed on the first
+    // lookup of the locale list.
+    struct LocaleScoreRow {
+        uint32_t localeListId;
+        std::vector<uint32_t> scores;  // Indexed by the family index.
+    };
+    static constexpr size_t kLocaleScoreRowCount = 4;
+
+    // Same as calcLocaleMatchingScore but memoized in mLocaleScoreRows.
+    uint32_t getLocaleMatchingScore(uint32_t userLocaleListId, uint16_t familyIndex) const;
+
     static uint32_t calcVariantMatchingScore(FamilyVariant variant, const FontFamily& fontFamily);
 
     // unique id for this font collection (suitable for cache key)
     uint32_t mId;
 
+    // The ID returned by getStableId(), zero until computed.
+    mutable std::atomic<uint64_t> mStableId;
+
     // Highest UTF-32 code point that can be mapped
     uint32_t mMaxChar;
 
@@ -259,19 +496,55 @@ private:
     const Range* mRanges;
     uint32_t mFamilyVecCount;
     const uint8_t* mFamilyVec;
+    // Used instead of mFamilyVec if mWideIndices is true.
+    const uint16_t* mWideFamilyVec;
+
+    // True if the collection has more than MAX_FAMILY_COUNT families, thus the family indices of
+    // the pages and of the match results are 16-bit. The lazy pages and the family lookup table
+    // are only used for the compact form.
+    bool mWideIndices;
 
-    // This vector has pointers to the font family instances which have cmap 14 subtables.
-    std::vector<std::shared_ptr<FontFamily>> mVSFamilyVec;
+    // The sorted indices of the font families which have cmap 14 subtables. Only these families
+    // and the families of the page can support a variation sequence.
+    std::vector<uint16_t> mVSFamilyIndices;
 
     // Set of supported axes in this collection.
     uint32_t mSupportedAxesCount;
-    // mSupportedAxes is sorted.
-    std::unique_ptr<AxisTag[]> mSupportedAxes;
+    // mSupportedAxes is sorted. It points to mOwnedSupportedAxes or the buffer this collection
+    // is read from.
+    const AxisTag* mSupportedAxes;
 
     // Owns allocated memory if this class is created from font families, otherwise these are
     // nullptr.
-    std::unique_ptr<Range[]> mOwnedRanges;
-    std::vector<uint8_t> mOwnedFamilyVec;
+    // Shared with the collections created with variations.
+    std::shared_ptr<Range[]> mOwnedRanges;
+    std::shared_ptr<const std::vector<uint8_t>> mOwnedFamilyVec;
+    std::shared_ptr<const std::vector<uint16_t>> mOwnedWideFamilyVec;
+    std::shared_ptr<AxisTag[]> mOwnedSupportedAxes;
+
+    // If the collection is created while FontFamily::isLazyCoverageEnabled() is true, mRanges
+    // and mFamilyVec are left empty and each page is built on the first lookup instead. A page
+    // holds the number of families followed by their indices. nullptr otherwise.
+    std::unique_ptr<std::atomic<const uint8_t*>[]> mLazyPages;
+    // mMaxChar of the lazily built collection, computed on the first lookup.
+    mutable std::atomic<uint32_t> mLazyMaxChar;
+
+    // The pages of the family lookup table, allocated on the first lookup. Each page is built
+    // lazily, or points to mSerializedLookupFamilies if the collection is read from a buffer.
+    mutable std::atomic<std::atomic<const uint8_t*>*> mFamilyLookupPages;
+    const uint8_t* mSerializedLookupFamilies;
+    uint32_t mSerializedLookupFamiliesCount;
+
+    // Most apps use only a few locale lists, so a few rows are enough. The scores for the other
+    // locale lists are computed every time once all the rows are taken.
+    mutable std::atomic<const LocaleScoreRow*> mLocaleScoreRows[kLocaleScoreRowCount];
+
+    // The recent collections created with variations, to return the same collection for the same
+    // variations.
+    static constexpr size_t kMaxVariationCollections = 8;
+    std::mutex mVariationMutex;
+    std::deque<std::pair<std::vector<FontVariation>, std::weak_ptr<FontCollection>>>
+            mVariationCollections GUARDED_BY(mVariationMutex);
 };
 
 }  // namespace minikin
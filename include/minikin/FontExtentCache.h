@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_FONT_EXTENT_CACHE_H
+#define MINIKIN_FONT_EXTENT_CACHE_H
+
+#include <memory>
+#include <mutex>
+
+#include <utils/LruCache.h>
+
+#include "minikin/CacheStats.h"
+#include "minikin/Font.h"
+#include "minikin/Hasher.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinExtent.h"
+#include "minikin/MinikinPaint.h"
+
+namespace minikin {
+
+// The key of the vertical extent of a font. Only the paint values passed on to
+// MinikinFont::GetFontExtent which may change the metrics are in the key. As in GlyphBoundsKey, the
+// font is only identified by its address, the entry tells whether it is still the same font.
+class FontExtentKey {
+public:
+    FontExtentKey(const FakedFont& fakedFont, const MinikinPaint& paint)
+            : mFont(fakedFont.font.get()),
+              mSize(paint.size),
+              mScaleX(paint.scaleX),
+              mSkewX(paint.skewX),
+              mFontFlags(paint.fontFlags),
+              mFakery(fakedFont.fakery),
+              mHash(computeHash()) {}
+
+    bool operator==(const FontExtentKey& o) const {
+        return mFont == o.mFont && mSize == o.mSize && mScaleX == o.mScaleX &&
+               mSkewX == o.mSkewX && mFontFlags == o.mFontFlags && mFakery == o.mFakery;
+    }
+
+    android::hash_t hash() const { return mHash; }
+
+private:
+    android::hash_t computeHash() const {
+        FontFakery fakery = mFakery;
+        return Hasher()
+                .update(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(mFont)))
+                .update(mSize)
+                .update(mScaleX)
+                .update(mSkewX)
+                .update(mFontFlags)
+                .update(static_cast<uint32_t>(fakery.isFakeBold()) |
+                        static_cast<uint32_t>(fakery.isFakeItalic()) << 1)
+                .hash();
+    }
+
+    const Font* mFont;
+    float mSize;
+    float mScaleX;
+    float mSkewX;
+    uint32_t mFontFlags;
+    FontFakery mFakery;
+    android::hash_t mHash;
+};
+
+inline android::hash_t hash_type(const FontExtentKey& key) {
+    return key.hash();
+}
+
+// An LRU cache of the vertical extents of the fonts, so that laying out a new text doesn't ask the
+// fonts again for each run. The extent of a text only depends on the fonts it is drawn with, so a
+// few entries per paint are enough.
+class FontExtentCache {
+public:
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCache.clear();
+    }
+
+    // Same as LayoutCache::trim(). The entries have a fixed size.
+    void trim(uint32_t percent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t target = mCache.size() * percent / 100;
+        while (mCache.size() > target && mCache.removeOldest()) {
+            mStats.recordEvictions(1);
+        }
+    }
+
+    // Returns the same extent as MinikinFont::GetFontExtent of the font.
+    MinikinExtent getExtent(const FakedFont& fakedFont, const MinikinPaint& paint);
+
+    static FontExtentCache& getInstance() {
+        static FontExtentCache cache(kMaxEntries);
+        return cache;
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+
+    size_t getMemoryUsage() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCache.size() * kEntryMemoryUsage;
+    }
+
+protected:
+    FontExtentCache(uint32_t maxEntries) : mCache(maxEntries) {}
+
+private:
+    struct Entry {
+        // Tells whether the font at the address of the key is still the font the extent was
+        // computed for. Empty for the null value of the LRU cache.
+        std::weak_ptr<Font> font;
+        MinikinExtent extent;
+    };
+
+    static constexpr size_t kEntryMemoryUsage = sizeof(FontExtentKey) + sizeof(Entry);
+
+    std::mutex mMutex;
+    android::LruCache<FontExtentKey, Entry> mCache GUARDED_BY(mMutex);
+    CacheStats mStats;
+    // The fallback fonts of a few text sizes fit.
+    static const size_t kMaxEntries = 256;
+};
+
+}  // namespace minikin
+#endif  // MINIKIN_FONT_EXTENT_CACHE_H
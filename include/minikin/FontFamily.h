@@ -17,6 +17,7 @@
 #ifndef MINIKIN_FONT_FAMILY_H
 #define MINIKIN_FONT_FAMILY_H
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -27,6 +28,7 @@
 #include "minikin/HbUtils.h"
 #include "minikin/Macros.h"
 #include "minikin/SparseBitSet.h"
+#include "minikin/VariationSequenceCoverage.h"
 
 namespace minikin {
 
@@ -39,8 +41,22 @@ public:
                                               std::vector<std::shared_ptr<Font>>&& fonts,
                                               bool isCustomFallback, bool isDefaultFallback);
 
-    FontFamily(FontFamily&&) = default;
-    FontFamily& operator=(FontFamily&&) = default;
+    // The arguments of a family created by createBatch.
+    struct BatchEntry {
+        uint32_t localeListId;
+        FamilyVariant variant;
+        std::vector<std::shared_ptr<Font>> fonts;
+        bool isCustomFallback;
+        bool isDefaultFallback;
+    };
+
+    // Same as calling create for each entry in order, but the fonts are parsed for the coverages
+    // and the supported axes on the worker pool, e.g. for loading the system fonts.
+    static std::vector<std::shared_ptr<FontFamily>> createBatch(std::vector<BatchEntry>&& entries);
+
+    FontFamily(FontFamily&& o) noexcept;
+    FontFamily& operator=(FontFamily&& o) noexcept;
+    ~FontFamily();
 
     static std::vector<std::shared_ptr<FontFamily>> readVector(BufferReader* reader);
     static void writeVector(BufferWriter* writer,
@@ -63,36 +79,98 @@ public:
     bool isDefaultFallback() const { return mIsDefaultFallback; }
 
     // Get Unicode coverage.
-    const SparseBitSet& getCoverage() const { return mCoverage; }
+    const SparseBitSet& getCoverage() const {
+        if (mCoverageSource != nullptr) {
+            return mCoverageSource->getCoverage();
+        }
+        return mIsCoverageLazy ? getLazyCoverage().coverage : mCoverage;
+    }
 
     // Returns true if the font has a glyph for the code point and variation selector pair.
     // Caller should acquire a lock before calling the method.
     bool hasGlyph(uint32_t codepoint, uint32_t variationSelector) const;
 
     // Returns true if this font family has a variaion sequence table (cmap format 14 subtable).
-    bool hasVSTable() const { return mCmapFmt14CoverageCount != 0; }
+    bool hasVSTable() const;
 
     // Creates new FontFamily based on this family while applying font variations. Returns nullptr
     // if none of variations apply to this family.
     std::shared_ptr<FontFamily> createFamilyWithVariation(
             const std::vector<FontVariation>& variations) const;
 
+    // Same as family->createFamilyWithVariation(variations), but the new family shares the
+    // coverage of the family instead of parsing the cmap table again, since the cmap table
+    // doesn't change with the axis values.
+    static std::shared_ptr<FontFamily> createFamilyWithVariation(
+            const std::shared_ptr<FontFamily>& family,
+            const std::vector<FontVariation>& variations);
+
+    // Makes the families created afterwards parse their cmap tables on the first coverage query
+    // instead of at construction, the families read from a buffer afterwards read their coverages
+    // on the first query, and the font collections created afterwards build the family
+    // list of each page on the first lookup of the page. This saves the startup cost of large
+    // fallback chains most of which are never used. Disabled by default.
+    static void setLazyCoverageEnabled(bool enabled);
+    static bool isLazyCoverageEnabled();
+
 private:
     FontFamily(uint32_t localeListId, FamilyVariant variant,
                std::vector<std::shared_ptr<Font>>&& fonts, bool isCustomFallback,
-               bool isDefaultFallback);
+               bool isDefaultFallback, bool isDeferred);
     explicit FontFamily(BufferReader* reader, const std::shared_ptr<std::vector<Font>>& fonts);
+    // Creates a family of the variation instances of the fonts of coverageSource.
+    FontFamily(const std::shared_ptr<const FontFamily>& coverageSource,
+               std::vector<std::shared_ptr<Font>>&& fonts);
 
     void writeTo(BufferWriter* writer, uint32_t* fontIndex) const;
 
-    void computeCoverage();
+    struct Coverage {
+        SparseBitSet coverage;
+        VariationSequenceCoverage vsCoverage;
+    };
+
+    // Parses the cmap table of the font closest to the default style.
+    Coverage computeCoverage() const;
+    void computeSupportedAxes();
+    // Parses the fonts for the supported axes and, unless the coverage is lazy, the coverages.
+    // Called by the constructor unless the family is deferred by createBatch.
+    void initFromFonts();
+    // Returns the coverage computed on the first call. Only used if mIsCoverageLazy is true.
+    const Coverage& getLazyCoverage() const;
+    // Reads the coverages written by writeTo.
+    static Coverage readCoverage(BufferReader* reader, uint16_t cmapFmt14CoverageCount);
+    // Returns the coverage of the variation sequences.
+    const VariationSequenceCoverage& getVsCoverage() const;
+    // Fills outFonts with the fonts applying the variations. Returns false if none of the
+    // variations apply to this family.
+    bool createFontsWithVariation(const std::vector<FontVariation>& variations,
+                                  std::vector<std::shared_ptr<Font>>* outFonts) const;
+
+    // Returns the index of the font closest to the style, remembering the recent styles.
+    uint32_t getClosestMatchIndex(FontStyle style) const;
+
+    // The recently requested styles and the indices of their closest fonts, packed as in
+    // FontFamily.cpp. Indexed by the weight and the slant, so a slot is only replaced by a style
+    // of a similar weight.
+    static constexpr size_t kStyleMatchCacheSize = 8;
 
     // Note: to minimize padding, small member fields are grouped at the end.
     std::unique_ptr<std::shared_ptr<Font>[]> mFonts;
-    // mSupportedAxes is sorted.
-    std::unique_ptr<AxisTag[]> mSupportedAxes;
+    // mSupportedAxes is sorted. It points to mOwnedSupportedAxes, the axes of mCoverageSource or
+    // the buffer this family is read from, so that the axes are not copied into every process.
+    const AxisTag* mSupportedAxes;
+    std::unique_ptr<AxisTag[]> mOwnedSupportedAxes;
     SparseBitSet mCoverage;
-    std::unique_ptr<SparseBitSet[]> mCmapFmt14Coverage;
+    VariationSequenceCoverage mVsCoverage;
+    // Lazily computed coverage, used instead of mCoverage and mVsCoverage if
+    // mIsCoverageLazy is true.
+    mutable std::atomic<Coverage*> mLazyCoverage;
+    // The coverages in the buffer this family is read from, read into mLazyCoverage on the first
+    // query. nullptr unless the family is read while the lazy coverage is enabled.
+    const uint8_t* mSerializedCoverage;
+    // The family owning the coverage for a family created with variations, otherwise nullptr.
+    std::shared_ptr<const FontFamily> mCoverageSource;
+    mutable std::atomic<uint32_t> mStyleMatchCache[kStyleMatchCacheSize];
     uint32_t mLocaleListId;  // 4 bytes
     uint32_t mFontsCount;    // 4 bytes
     // OpenType supports up to 2^16-1 (uint16) axes.
@@ -103,6 +181,7 @@ private:
     bool mIsColorEmoji;                // 1 byte
     bool mIsCustomFallback;            // 1 byte
     bool mIsDefaultFallback;           // 1 byte
+    bool mIsCoverageLazy;              // 1 byte
 
     MINIKIN_PREVENT_COPY_AND_ASSIGN(FontFamily);
 };
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_FONT_FEATURE_SETTINGS_CACHE_H
+#define MINIKIN_FONT_FEATURE_SETTINGS_CACHE_H
+
+#include <hb.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// Interns the font feature settings strings, so that the layout cache can identify them with an
+// integer instead of comparing and hashing the strings.
+class FontFeatureSettingsCache {
+public:
+    // The ID of the empty font feature settings.
+    const static uint32_t kEmptyId = 0;
+
+    // Returns the ID for the given font feature settings. The same string always gets the same ID.
+    static inline uint32_t getId(const std::string& settings) {
+        if (settings.empty()) {
+            return kEmptyId;
+        }
+        return getInstance().getIdInternal(settings);
+    }
+
+    static inline const std::string& getById(uint32_t id) {
+        return getInstance().getByIdInternal(id);
+    }
+
+    // Returns the shaping features of the given font feature settings with the default features
+    // added, see cleanAndAddDefaultFontFeatures(). They are parsed on the first call for the
+    // settings and letter spacing state, and the returned vector is never modified nor freed.
+    static inline const std::vector<hb_feature_t>& getFeatures(const std::string& settings,
+                                                                bool noLigatures) {
+        return getInstance().getFeaturesInternal(settings, noLigatures);
+    }
+
+private:
+    FontFeatureSettingsCache();  // Singleton
+    ~FontFeatureSettingsCache() {}
+
+    struct Entry {
+        std::string settings;
+        // The parsed features, with and without the optional ligatures, built on demand.
+        std::unique_ptr<const std::vector<hb_feature_t>> features[2];
+    };
+
+    uint32_t getIdInternal(const std::string& settings);
+    const std::string& getByIdInternal(uint32_t id);
+    const std::vector<hb_feature_t>& getFeaturesInternal(const std::string& settings,
+                                                         bool noLigatures);
+    uint32_t getIdLocked(const std::string& settings) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    static FontFeatureSettingsCache& getInstance() {
+        static FontFeatureSettingsCache instance;
+        return instance;
+    }
+
+    // A deque keeps the references returned by getById() valid while new settings are added.
+    std::deque<Entry> mSettings GUARDED_BY(mMutex);
+    std::unordered_map<std::string, uint32_t> mSettingsLookupTable GUARDED_BY(mMutex);
+
+    std::mutex mMutex;
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_FONT_FEATURE_SETTINGS_CACHE_H
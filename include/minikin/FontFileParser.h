@@ -18,9 +18,11 @@
 #define MINIKIN_FONT_FILE_PARSER_H
 
 #include "minikin/HbUtils.h"
+#include "minikin/Range.h"
 
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace minikin {
 
@@ -38,6 +40,23 @@ public:
     std::optional<std::string> getPostScriptName() const;
     std::optional<bool> isPostScriptType1Font() const;
 
+    // The values of all the getters above.
+    struct Metadata {
+        std::optional<uint32_t> fontRevision;
+        std::optional<std::string> postScriptName;
+        std::optional<bool> isPostScriptType1Font;
+    };
+
+    // Returns the same values as the getters of FontFileParser(buffer, size, index), but reads the
+    // sfnt table directory and the tables directly from the buffer in one pass instead of creating
+    // a HarfBuzz face, e.g. for validating many font files.
+    static Metadata readMetadata(const void* buffer, size_t size, uint32_t index);
+
+    // Returns the byte ranges of the tables of the face at the index read by the itemization, the
+    // shaping and the horizontal metrics, e.g. cmap, hmtx and GSUB, sorted by offset. Read from the
+    // sfnt table directory like readMetadata. Empty if the buffer has no such face.
+    static std::vector<Range> getHotTableRanges(const void* buffer, size_t size, uint32_t index);
+
 protected:  // protected for testing purposes.
     static bool analyzeFontRevision(const uint8_t* head_data, size_t head_size, uint32_t* out);
     static bool checkPSName(const std::string& psName);
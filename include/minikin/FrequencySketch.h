@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_FREQUENCY_SKETCH_H
+#define MINIKIN_FREQUENCY_SKETCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// A count-min sketch of how often the keys of a cache were recently seen, identified by their
+// hashes, as used by the TinyLFU admission of the caches. The counts saturate at kMaxCount and
+// are halved every getSampleSize() increments, so that the old accesses fade out.
+//
+// The counts are estimates which may be too high but never too low. Each row has twice as many
+// counters as the capacity, so that a scan over unique keys rarely reaches a count of 2. This
+// class is not thread safe, the caches use it under their own locks.
+class FrequencySketch {
+public:
+    static constexpr uint32_t kMaxCount = 15;
+
+    // Sized for the given number of cache entries.
+    explicit FrequencySketch(uint32_t capacity);
+
+    // Records an access to the key of the hash and returns its estimated count including it.
+    uint32_t increment(uint32_t hash);
+
+    // Returns the estimated count of the key of the hash.
+    uint32_t frequency(uint32_t hash) const;
+
+    void clear();
+
+    // The number of increments between two halvings, the capacity or kMinSampleSize.
+    uint32_t getSampleSize() const { return mSampleSize; }
+
+    static constexpr uint32_t kMinSampleSize = 64;
+
+private:
+    static constexpr uint32_t kDepth = 4;
+
+    uint32_t getIndex(uint32_t hash, uint32_t row) const;
+    void halve();
+
+    // kDepth rows of mMask + 1 counters.
+    std::vector<uint8_t> mCounters;
+    const uint32_t mMask;
+    const uint32_t mSampleSize;
+    uint32_t mIncrements;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(FrequencySketch);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_FREQUENCY_SKETCH_H
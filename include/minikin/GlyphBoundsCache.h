@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_GLYPH_BOUNDS_CACHE_H
+#define MINIKIN_GLYPH_BOUNDS_CACHE_H
+
+#include <memory>
+#include <mutex>
+
+#include <utils/LruCache.h>
+
+#include "minikin/CacheStats.h"
+#include "minikin/Font.h"
+#include "minikin/Hasher.h"
+#include "minikin/LayoutCore.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinPaint.h"
+#include "minikin/MinikinRect.h"
+
+namespace minikin {
+
+// The key of the bounds of a glyph. Only the paint values passed on to MinikinFont::GetBounds
+// which change the outline are in the key. The font is only identified by its address here, the
+// entry tells whether it is still the same font.
+class GlyphBoundsKey {
+public:
+    GlyphBoundsKey(const FakedFont& fakedFont, uint32_t glyphId, const MinikinPaint& paint)
+            : mFont(fakedFont.font.get()),
+              mGlyphId(glyphId),
+              mSize(paint.size),
+              mScaleX(paint.scaleX),
+              mSkewX(paint.skewX),
+              mFontFlags(paint.fontFlags),
+              mFakery(fakedFont.fakery),
+              mHash(computeHash()) {}
+
+    bool operator==(const GlyphBoundsKey& o) const {
+        return mFont == o.mFont && mGlyphId == o.mGlyphId && mSize == o.mSize &&
+               mScaleX == o.mScaleX && mSkewX == o.mSkewX && mFontFlags == o.mFontFlags &&
+               mFakery == o.mFakery;
+    }
+
+    android::hash_t hash() const { return mHash; }
+
+private:
+    android::hash_t computeHash() const {
+        FontFakery fakery = mFakery;
+        return Hasher()
+                .update(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(mFont)))
+                .update(mGlyphId)
+                .update(mSize)
+                .update(mScaleX)
+                .update(mSkewX)
+                .update(mFontFlags)
+                .update(static_cast<uint32_t>(fakery.isFakeBold()) |
+                        static_cast<uint32_t>(fakery.isFakeItalic()) << 1)
+                .hash();
+    }
+
+    const Font* mFont;
+    uint32_t mGlyphId;
+    float mSize;
+    float mScaleX;
+    float mSkewX;
+    uint32_t mFontFlags;
+    FontFakery mFakery;
+    android::hash_t mHash;
+};
+
+inline android::hash_t hash_type(const GlyphBoundsKey& key) {
+    return key.hash();
+}
+
+// An LRU cache of the bounds of single glyphs, so that the bounds of a new text made of the glyphs
+// already seen are computed without calling the font. BoundsCache only keeps whole texts.
+class GlyphBoundsCache {
+public:
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCache.clear();
+    }
+
+    // Same as LayoutCache::trim(). The entries have a fixed size.
+    void trim(uint32_t percent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t target = mCache.size() * percent / 100;
+        while (mCache.size() > target && mCache.removeOldest()) {
+            mStats.recordEvictions(1);
+        }
+    }
+
+    // Returns the same bounds as LayoutPiece::calculateBounds.
+    MinikinRect calculateBounds(const LayoutPiece& layoutPiece, const MinikinPaint& paint);
+
+    static GlyphBoundsCache& getInstance() {
+        static GlyphBoundsCache cache(kMaxEntries);
+        return cache;
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+
+    size_t getMemoryUsage() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCache.size() * kEntryMemoryUsage;
+    }
+
+protected:
+    GlyphBoundsCache(uint32_t maxEntries) : mCache(maxEntries) {}
+
+private:
+    struct Entry {
+        // Tells whether the font at the address of the key is still the font the bounds were
+        // computed for. Empty for the null value of the LRU cache.
+        std::weak_ptr<Font> font;
+        MinikinRect bounds;
+    };
+
+    static constexpr size_t kEntryMemoryUsage = sizeof(GlyphBoundsKey) + sizeof(Entry);
+
+    std::mutex mMutex;
+    android::LruCache<GlyphBoundsKey, Entry> mCache GUARDED_BY(mMutex);
+    CacheStats mStats;
+    // A few paragraphs of several scripts fit.
+    static const size_t kMaxEntries = 4096;
+};
+
+}  // namespace minikin
+#endif  // MINIKIN_GLYPH_BOUNDS_CACHE_H
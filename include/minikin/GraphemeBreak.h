@@ -19,6 +19,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 namespace minikin {
 
@@ -33,6 +34,11 @@ public:
     static bool isGraphemeBreak(const float* advances, const uint16_t* buf, size_t start,
                                 size_t count, size_t offset);
 
+    // Same as isGraphemeBreak() for every offset from start to start + count inclusive, computed
+    // in one pass over the text. The result for the offset i is (*outBreaks)[i - start].
+    static void getGraphemeBreaks(const float* advances, const uint16_t* buf, size_t start,
+                                  size_t count, std::vector<bool>* outBreaks);
+
     // Matches Android's Java API. Note, return (size_t)-1 for AT to
     // signal non-break because unsigned return type.
     static size_t getTextRunCursor(const float* advances, const uint16_t* buf, size_t start,
@@ -18,6 +18,7 @@
 #define MINIKIN_HASHER_H
 
 #include <cstdint>
+#include <cstring>
 
 #include <string>
 
@@ -25,6 +26,8 @@
 
 namespace minikin {
 
+#ifdef MINIKIN_JENKINS_HASHER
+
 // Provides a Jenkins hash implementation.
 class Hasher {
 public:
@@ -98,6 +101,96 @@ private:
     uint32_t mHash;
 };
 
+#else  // MINIKIN_JENKINS_HASHER
+
+// Provides a multiply-based hash, which mixes 64 bits at a time. The text of the cache keys is
+// hashed four code units per multiplication, and the final avalanche spreads the bits evenly,
+// so the low bits used for bucketing collide less than with the Jenkins hash.
+// Define MINIKIN_JENKINS_HASHER for all the modules including this header to use the previous
+// Jenkins hash instead. The values differ between the two and between builds, so they must not
+// be persisted.
+class Hasher {
+public:
+    // A non-zero seed, so that the leading zero words are not lost.
+    Hasher() : mHash(0x9E3779B97F4A7C15ull) {}
+
+    inline Hasher& update(uint32_t data) { return mix(data); }
+
+    inline Hasher& update(int32_t data) {
+        update(static_cast<uint32_t>(data));
+        return *this;
+    }
+
+    inline Hasher& update(uint64_t data) { return mix(data); }
+
+    inline Hasher& update(float data) {
+        union {
+            float f;
+            uint32_t i;
+        } bits;
+        bits.f = data;
+        return update(bits.i);
+    }
+
+    inline Hasher& updateShorts(const uint16_t* data, uint32_t length) {
+        update(length);
+        uint32_t i;
+        for (i = 0; i < (length & -4); i += 4) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            mix(word);
+        }
+        uint64_t tail = 0;
+        for (uint32_t shift = 0; i < length; ++i, shift += 16) {
+            tail |= static_cast<uint64_t>(data[i]) << shift;
+        }
+        if (length & 3) {
+            mix(tail);
+        }
+        return *this;
+    }
+
+    inline Hasher& updateString(const std::string& str) {
+        uint32_t size = str.size();
+        update(size);
+        uint32_t i;
+        for (i = 0; i < (size & -8); i += 8) {
+            uint64_t word;
+            memcpy(&word, str.data() + i, sizeof(word));
+            mix(word);
+        }
+        uint64_t tail = 0;
+        for (uint32_t shift = 0; i < size; ++i, shift += 8) {
+            tail |= static_cast<uint64_t>(static_cast<uint8_t>(str[i])) << shift;
+        }
+        if (size & 7) {
+            mix(tail);
+        }
+        return *this;
+    }
+
+    // The 64-bit finalizer of MurmurHash3, folded to 32 bits.
+    IGNORE_INTEGER_OVERFLOW inline uint32_t hash() {
+        uint64_t hash = mHash;
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return static_cast<uint32_t>(hash) ^ static_cast<uint32_t>(hash >> 32);
+    }
+
+private:
+    IGNORE_INTEGER_OVERFLOW inline Hasher& mix(uint64_t data) {
+        mHash = (((mHash << 5) | (mHash >> 59)) ^ data) * 0x517CC1B727220A95ull;
+        return *this;
+    }
+
+    uint64_t mHash;
+};
+
+#endif  // MINIKIN_JENKINS_HASHER
+
 }  // namespace minikin
 
 #endif  // MINIKIN_HASHER_H
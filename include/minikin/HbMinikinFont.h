@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_HB_MINIKIN_FONT_H
+#define MINIKIN_HB_MINIKIN_FONT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "minikin/HbUtils.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinFont.h"
+#include "minikin/MinikinFontFactory.h"
+
+namespace minikin {
+
+// A MinikinFont reading the metrics from the font tables with HarfBuzz, for the users of minikin
+// without Skia, e.g. measuring text on a server. The metrics are the unhinted design metrics
+// scaled to the paint size and scaleX. The fakery is ignored, as fake bold and italic only change
+// the drawn outlines.
+//
+// Layout lets HarfBuzz read the advances of this font directly while shaping instead of calling
+// GetHorizontalAdvance, see HasHarfBuzzAdvances(). Thread safe.
+class HbMinikinFont : public MinikinFont {
+public:
+    // Maps the font file read only. Returns nullptr if the file can't be opened or mapped.
+    static std::shared_ptr<HbMinikinFont> create(const std::string& path, int index);
+
+    // The font of the given data of size bytes, e.g. a font the caller already loaded. The data is
+    // shared with the variations of the font and released with the last of them.
+    HbMinikinFont(std::shared_ptr<const void> data, size_t size, const std::string& path,
+                  int index, const std::vector<FontVariation>& axes);
+
+    float GetHorizontalAdvance(uint32_t glyph_id, const MinikinPaint& paint,
+                               const FontFakery& fakery) const override;
+    void GetHorizontalAdvances(uint16_t* glyph_ids, uint32_t count, const MinikinPaint& paint,
+                               const FontFakery& fakery, float* outAdvances) const override;
+    void GetBounds(MinikinRect* bounds, uint32_t glyph_id, const MinikinPaint& paint,
+                   const FontFakery& fakery) const override;
+    void GetFontExtent(MinikinExtent* extent, const MinikinPaint& paint,
+                       const FontFakery& fakery) const override;
+
+    const std::string& GetFontPath() const override { return mPath; }
+    const void* GetFontData() const override { return mData.get(); }
+    size_t GetFontSize() const override { return mSize; }
+    int GetFontIndex() const override { return mIndex; }
+    const std::vector<FontVariation>& GetAxes() const override { return mAxes; }
+    bool HasHarfBuzzAdvances() const override { return true; }
+
+    // Shares the font data with this font.
+    std::shared_ptr<MinikinFont> createFontWithVariation(
+            const std::vector<FontVariation>& variations) const override;
+
+private:
+    const std::shared_ptr<const void> mData;
+    const size_t mSize;
+    const std::string mPath;
+    const int mIndex;
+    const std::vector<FontVariation> mAxes;
+    // Scaled to the units per em, with the variations applied. Immutable.
+    HbFontUniquePtr mFont;
+    float mUpem;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(HbMinikinFont);
+};
+
+// Serializes HbMinikinFont by its path, index and variations, and maps the file again when
+// reading. Call init() once before serializing the fonts, e.g. writing a SystemFonts snapshot.
+class HbMinikinFontFactory : public MinikinFontFactory {
+public:
+    static const HbMinikinFontFactory& getInstance();
+
+    // Makes this factory the MinikinFontFactory of the process.
+    static void init() { MinikinFontFactory::setInstance(&getInstance()); }
+
+    std::shared_ptr<MinikinFont> create(BufferReader reader) const override;
+    void skip(BufferReader* reader) const override;
+    void write(BufferWriter* writer, const MinikinFont* minikinFont) const override;
+
+private:
+    HbMinikinFontFactory() {}
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_HB_MINIKIN_FONT_H
@@ -21,10 +21,15 @@
 #ifndef MINIKIN_HYPHENATOR_H
 #define MINIKIN_HYPHENATOR_H
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "minikin/CacheStats.h"
 #include "minikin/Characters.h"
+#include "minikin/Range.h"
 #include "minikin/U16StringPiece.h"
 
 namespace minikin {
@@ -35,6 +40,14 @@ class Hyphenator;
 // This doesn't take ownership of the hyphenator but we don't need to care about the ownership.
 // In Android, the Hyphenator is allocated in Zygote and never gets released.
 void addHyphenator(const std::string& localeStr, const Hyphenator* hyphenator);
+
+// Loads the hyphenator of a locale, e.g. by mapping its pattern file. May return nullptr.
+using HyphenatorLoader = std::function<const Hyphenator*()>;
+
+// Registers a hyphenator which is only loaded when the locale is first looked up, so that the
+// patterns of the locales never used are not mapped. The same ownership as addHyphenator applies
+// to the loaded hyphenator.
+void addHyphenatorLoader(const std::string& localeStr, HyphenatorLoader&& loader);
 void addHyphenatorAlias(const std::string& fromLocaleStr, const std::string& toLocaleStr);
 
 enum class HyphenationType : uint8_t {
@@ -172,6 +185,8 @@ struct Header;
 
 class Hyphenator {
 public:
+    ~Hyphenator();
+
     // Compute the hyphenation of a word, storing the hyphenation in result vector. Each entry in
     // the vector is a "hyphenation type" for a potential hyphenation that can be applied at the
     // corresponding code unit offset in the word.
@@ -190,6 +205,14 @@ public:
         return hyphenate(word, out->data());
     }
 
+    // Compute the hyphenation of the words at the given ranges of a text at once, e.g. all the
+    // words of a paragraph, storing the result of each word at the offsets of its range in out.
+    //
+    // out must have at least the length of the text. The entries outside of the ranges are left
+    // as they are.
+    void hyphenateBatch(const U16StringPiece& text, const std::vector<Range>& wordRanges,
+                        HyphenationType* out) const;
+
     // Returns true if the codepoint is like U+2010 HYPHEN in line breaking and usage: a character
     // immediately after which line breaks are allowed, but words containing it should not be
     // automatically hyphenated.
@@ -205,7 +228,30 @@ public:
     static Hyphenator* loadBinary(const uint8_t* patternData, size_t minPrefix, size_t minSuffix,
                                   const std::string& locale);
 
+    struct PackedEntry {
+        std::string locale;
+        Hyphenator* hyphenator;
+    };
+
+    // Loads the hyphenators of all the locales packed in a container, as described in
+    // doc/hyb_file_format.md, so that a single mapping of the container serves every locale. The
+    // caller owns the returned hyphenators and must keep the data valid until they are deleted.
+    // Returns an empty vector if the container is malformed.
+    static std::vector<PackedEntry> loadPackedBinary(const uint8_t* data, size_t size);
+
+    // Makes every hyphenator remember the results of the recent words hyphenated by the patterns,
+    // keyed by their case folded alphabet codes, so that a recurring word skips the trie walk.
+    // Each hyphenator keeps up to a few thousand words. Disabled by default.
+    static void setWordCacheEnabled(bool enabled);
+
+    // Returns the counters of the word cache of this hyphenator, or nullptr if it has not looked
+    // up any word.
+    const CacheStats* getWordCacheStats() const;
+
 private:
+    // The results of the recent words, created on the first lookup.
+    class WordCache;
+
     enum class HyphenationLocale : uint8_t {
         OTHER = 0,
         CATALAN = 1,
@@ -217,6 +263,11 @@ private:
     Hyphenator(const uint8_t* patternData, size_t minPrefix, size_t minSuffix,
                HyphenationLocale hyphenLocale);
 
+    // Same as hyphenate, with the scratch buffer of the alphabet codes of the caller, which must
+    // hold MAX_HYPHENATED_SIZE entries. The longer words use a buffer of the thread instead.
+    void hyphenateWord(const U16StringPiece& word, uint16_t* alpha_codes, bool useWordCache,
+                       HyphenationType* out) const;
+
     // apply various hyphenation rules including hard and soft hyphens, ignoring patterns
     void hyphenateWithNoPatterns(const U16StringPiece& word, HyphenationType* out) const;
 
@@ -230,14 +281,30 @@ private:
     void hyphenateFromCodes(const uint16_t* codes, size_t len, HyphenationType hyphenValue,
                             HyphenationType* out) const;
 
-    // See also LONGEST_HYPHENATED_WORD in LineBreaker.cpp. Here the constant is used so
-    // that temporary buffers can be stack-allocated without waste, which is a slightly
-    // different use case. It measures UTF-16 code units.
+    // Same as hyphenateFromCodes, but the result is looked up in the word cache first.
+    void hyphenateFromCodesCached(const uint16_t* codes, size_t len, HyphenationType hyphenValue,
+                                  HyphenationType* out) const;
+
+    // See also LONGEST_HYPHENATED_WORD in LineBreakerUtil.cpp. Here the constant is the size of
+    // the temporary buffers allocated on the stack, and of the longest words kept in the word
+    // cache. The longer words are still hyphenated, with a growable buffer of the thread. It
+    // measures UTF-16 code units, including the start and stop codes.
     static const size_t MAX_HYPHENATED_SIZE = 64;
 
+    // The largest range of code points of an alphabet of version 1 put in mAlphabetCodes. The
+    // alphabets of wider ranges are still binary searched.
+    static const uint32_t MAX_DENSE_ALPHABET_SIZE = 16384;
+
     const uint8_t* mPatternData;
     const size_t mMinPrefix, mMinSuffix;
     const HyphenationLocale mHyphenationLocale;
+    // The alphabet codes of the code points in [mAlphabetCodesStart, mAlphabetCodesEnd) if the
+    // alphabet is of version 1, which would be binary searched for every character otherwise.
+    // 0 for a code point not in the alphabet.
+    std::unique_ptr<uint16_t[]> mAlphabetCodes;
+    uint32_t mAlphabetCodesStart;
+    uint32_t mAlphabetCodesEnd;
+    mutable std::atomic<WordCache*> mWordCache;
 
     // accessors for binary data
     const Header* getHeader() const { return reinterpret_cast<const Header*>(mPatternData); }
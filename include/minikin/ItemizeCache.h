@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_ITEMIZE_CACHE_H
+#define MINIKIN_ITEMIZE_CACHE_H
+
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include <utils/LruCache.h>
+
+#include "minikin/Allocator.h"
+#include "minikin/CacheStats.h"
+#include "minikin/FamilyVariant.h"
+#include "minikin/FontCollection.h"
+#include "minikin/FontStyle.h"
+#include "minikin/Hasher.h"
+#include "minikin/Macros.h"
+#include "minikin/Range.h"
+#include "minikin/U16StringPiece.h"
+
+namespace minikin {
+
+// The key of the itemization result. Only the properties which affect the font fallback are in
+// the key, so that the same text drawn with different sizes or paints shares the result.
+class ItemizeCacheKey {
+public:
+    ItemizeCacheKey(const U16StringPiece& text, uint32_t collectionId, FontStyle style,
+                    uint32_t localeListId, FamilyVariant familyVariant)
+            : mChars(text.data()),
+              mNchars(text.size()),
+              mId(collectionId),
+              mStyle(style),
+              mLocaleListId(localeListId),
+              mFamilyVariant(familyVariant),
+              mHash(computeHash()) {}
+
+    bool operator==(const ItemizeCacheKey& o) const {
+        return mId == o.mId && mStyle == o.mStyle && mLocaleListId == o.mLocaleListId &&
+               mFamilyVariant == o.mFamilyVariant && mNchars == o.mNchars &&
+               !memcmp(mChars, o.mChars, mNchars * sizeof(uint16_t));
+    }
+
+    android::hash_t hash() const { return mHash; }
+
+    void copyText() {
+        uint16_t* charsCopy = static_cast<uint16_t*>(allocateBlock(mNchars * sizeof(uint16_t)));
+        memcpy(charsCopy, mChars, mNchars * sizeof(uint16_t));
+        mChars = charsCopy;
+    }
+    void freeText() {
+        if (mChars != nullptr) {
+            freeBlock(const_cast<uint16_t*>(mChars));
+        }
+        mChars = nullptr;
+    }
+
+    uint32_t getCollectionId() const { return mId; }
+
+    uint32_t getMemoryUsage() const { return sizeof(ItemizeCacheKey) + sizeof(uint16_t) * mNchars; }
+
+private:
+    android::hash_t computeHash() const {
+        return Hasher()
+                .update(mId)
+                .update(mStyle.identifier())
+                .update(mLocaleListId)
+                .update(static_cast<uint32_t>(mFamilyVariant))
+                .updateShorts(mChars, mNchars)
+                .hash();
+    }
+
+    const uint16_t* mChars;
+    uint32_t mNchars;
+    uint32_t mId;  // for the font collection
+    FontStyle mStyle;
+    uint32_t mLocaleListId;
+    FamilyVariant mFamilyVariant;
+    android::hash_t mHash;
+};
+
+inline android::hash_t hash_type(const ItemizeCacheKey& key) {
+    return key.hash();
+}
+
+// Lets the ItemizeCache::itemize calls on this thread take the runs out of the paragraph
+// itemized at once while the instance is alive, e.g. for the layout misses of a MeasuredText.
+// Each paragraph is itemized on the first such call, so nothing is done if all the layouts are
+// cached. The text must outlive the instance.
+class ParagraphItemizeScope {
+public:
+    explicit ParagraphItemizeScope(const U16StringPiece& text);
+    ~ParagraphItemizeScope();
+
+    // Adds a style run of the paragraph. The adjacent style runs of the same font collection are
+    // itemized together. The style runs must be added in order.
+    void addStyleRun(const FontCollection* collection, const Range& range, uint32_t localeListId,
+                     FamilyVariant familyVariant);
+
+    // Fills outRuns with the runs of the text and returns true if the text is a part of a style
+    // run with the given properties and its runs are known from the paragraph.
+    bool itemize(const FontCollection& collection, const U16StringPiece& text,
+                 uint32_t localeListId, FamilyVariant familyVariant,
+                 std::vector<FontCollection::Run>* outRuns);
+
+    // Returns the innermost instance alive on this thread, or nullptr.
+    static ParagraphItemizeScope* getCurrent();
+
+private:
+    struct Paragraph {
+        const FontCollection* collection;
+        Range range;
+        // Relative to the start of the range.
+        std::vector<FontCollection::StyleRange> styleRanges;
+        std::vector<FontCollection::Run> runs;
+        bool isItemized;
+    };
+
+    U16StringPiece mText;
+    std::vector<Paragraph> mParagraphs;
+    ParagraphItemizeScope* mOuter;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(ParagraphItemizeScope);
+};
+
+// An LRU cache of FontCollection::itemize results. Short texts like labels and names are
+// itemized again for every size and paint they are laid out with, while the font fallback only
+// depends on the text, the collection, the style, the locales and the family variant.
+class ItemizeCache
+        : private android::OnEntryRemoved<ItemizeCacheKey, std::vector<FontCollection::Run>*> {
+public:
+    using Runs = std::vector<FontCollection::Run>;
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCache.clear();
+    }
+
+    // Same as LayoutCache::trim().
+    void trim(uint32_t percent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t target = mMemoryUsage * percent / 100;
+        while (mMemoryUsage > target && mCache.removeOldest()) {
+            mStats.recordEvictions(1);
+        }
+    }
+
+    // Same as LayoutCache::removeCollections().
+    void removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::vector<ItemizeCacheKey> keys;
+        android::LruCache<ItemizeCacheKey, Runs*>::Iterator it(mCache);
+        while (it.next()) {
+            if (collectionIds.count(it.key().getCollectionId()) != 0) {
+                keys.push_back(it.key());
+            }
+        }
+        for (const ItemizeCacheKey& key : keys) {
+            mCache.remove(key);
+        }
+    }
+
+    // Returns the same result as collection.itemize(text, style, localeListId, familyVariant).
+    Runs itemize(const FontCollection& collection, const U16StringPiece& text, FontStyle style,
+                 uint32_t localeListId, FamilyVariant familyVariant);
+
+    static ItemizeCache& getInstance() {
+        static ItemizeCache cache(kMaxEntries);
+        return cache;
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+
+    size_t getMemoryUsage() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMemoryUsage;
+    }
+
+protected:
+    ItemizeCache(uint32_t maxEntries) : mCache(maxEntries), mMemoryUsage(0) {
+        mCache.setOnEntryRemovedListener(this);
+    }
+
+private:
+    static size_t getEntryMemoryUsage(const ItemizeCacheKey& key, const Runs& runs) {
+        return key.getMemoryUsage() + sizeof(Runs) + sizeof(FontCollection::Run) * runs.size();
+    }
+
+    // callback for OnEntryRemoved
+    void operator()(ItemizeCacheKey& key, Runs*& value) {
+        mMemoryUsage -= getEntryMemoryUsage(key, *value);
+        key.freeText();
+        delete value;
+    }
+
+    std::mutex mMutex;
+    android::LruCache<ItemizeCacheKey, Runs*> mCache GUARDED_BY(mMutex);
+    size_t mMemoryUsage GUARDED_BY(mMutex);
+    CacheStats mStats;
+    // Same as BoundsCache, fewer entries than LayoutCache are enough since only the misses of the
+    // layout cache are itemized.
+    static const size_t kMaxEntries = 500;
+};
+
+}  // namespace minikin
+#endif  // MINIKIN_ITEMIZE_CACHE_H
@@ -17,6 +17,7 @@
 #ifndef MINIKIN_LAYOUT_H
 #define MINIKIN_LAYOUT_H
 
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -53,6 +54,46 @@ enum class Bidi : uint8_t {
     FORCE_RTL = 0b0101,    // Must be same with Paint.BIDI_FORCE_RTL
 };
 
+// The glyphs of a layout grouped into the runs of consecutive glyphs drawn with the same font. The
+// glyph IDs and the positions of all the runs are kept in two contiguous arrays, so that the arrays
+// of a run can be handed to a text blob builder as they are instead of querying the layout glyph by
+// glyph. See Layout::getGlyphRuns().
+class GlyphRuns {
+public:
+    // The number of runs.
+    size_t size() const { return mFonts.size(); }
+    size_t glyphCount() const { return mGlyphIds.size(); }
+
+    const FakedFont& getFont(size_t run) const { return mFonts[run]; }
+    ArrayView<uint32_t> getGlyphIds(size_t run) const {
+        return ArrayView<uint32_t>(mGlyphIds.data() + mRunStarts[run], getRunLength(run));
+    }
+    // The positions of the glyphs, which are relative to the start of the layout.
+    ArrayView<Point> getPositions(size_t run) const {
+        return ArrayView<Point>(mPositions.data() + mRunStarts[run], getRunLength(run));
+    }
+
+    void clear() {
+        mFonts.clear();
+        mRunStarts.clear();
+        mGlyphIds.clear();
+        mPositions.clear();
+    }
+
+private:
+    friend class Layout;
+
+    size_t getRunLength(size_t run) const {
+        const size_t end = run + 1 < mRunStarts.size() ? mRunStarts[run + 1] : mGlyphIds.size();
+        return end - mRunStarts[run];
+    }
+
+    std::vector<FakedFont> mFonts;     // per run
+    std::vector<uint32_t> mRunStarts;  // per run, the index of the first glyph of the run
+    std::vector<uint32_t> mGlyphIds;   // per glyph
+    std::vector<Point> mPositions;     // per glyph
+};
+
 inline bool isRtl(Bidi bidi) {
     return static_cast<uint8_t>(bidi) & 0b0001;
 }
@@ -67,11 +108,20 @@ class Layout {
 public:
     Layout(const U16StringPiece& str, const Range& range, Bidi bidiFlags, const MinikinPaint& paint,
            StartHyphenEdit startHyphen, EndHyphenEdit endHyphen)
-            : mAdvance(0) {
+            : Layout(str, range, bidiFlags, paint, startHyphen, endHyphen,
+                     false /* share pieces */) {}
+
+    // If sharePieces is true, the layout keeps shared references to the immutable LayoutPieces,
+    // e.g. the ones in LayoutCache, with their x offsets instead of copying every glyph. Building
+    // and destroying such a layout costs O(pieces) instead of O(glyphs). The glyph accessors below
+    // work in both modes, but forEachGlyph() is cheaper for iterating all glyphs.
+    Layout(const U16StringPiece& str, const Range& range, Bidi bidiFlags, const MinikinPaint& paint,
+           StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, bool sharePieces)
+            : mAdvance(0), mSharePieces(sharePieces), mSharedGlyphCount(0) {
         doLayout(str, range, bidiFlags, paint, startHyphen, endHyphen);
     }
 
-    Layout(uint32_t count) : mAdvance(0) {
+    Layout(uint32_t count) : mAdvance(0), mSharePieces(false), mSharedGlyphCount(0) {
         mAdvances.resize(count, 0);
         mGlyphs.reserve(count);
     }
@@ -80,32 +130,128 @@ public:
                              const MinikinPaint& paint, StartHyphenEdit startHyphen,
                              EndHyphenEdit endHyphen, float* advances);
 
+    // Returns the same widths as measureText() for each of the ranges of the buffer, e.g. the
+    // labels of a list, without the hyphen edits. The words of all the ranges are looked up in
+    // LayoutCache by a single batch per direction, so the cache is locked once per batch rather
+    // than once per text, and the misses may be shaped in parallel, see
+    // LayoutCache::setParallelShaping().
+    static std::vector<float> measureTexts(const U16StringPiece& str,
+                                           const std::vector<Range>& ranges, Bidi bidiFlags,
+                                           const MinikinPaint& paint);
+
+    // Returns the end of the longest prefix of the range, in the logical order and ending at a
+    // grapheme boundary, whose width is at most maxWidth, and stores its width to outWidth if not
+    // null. The words are laid out one by one until the width is exceeded, so that the cost is
+    // proportional to the fitting text rather than to the whole range, e.g. for ellipsizing.
+    static size_t fitPrefix(const U16StringPiece& str, const Range& range, Bidi bidiFlags,
+                            const MinikinPaint& paint, float maxWidth, float* outWidth);
+
     const std::vector<float>& advances() const { return mAdvances; }
 
     // public accessors
-    size_t nGlyphs() const { return mGlyphs.size(); }
-    const Font* getFont(int i) const { return mGlyphs[i].font.font.get(); }
-    const std::shared_ptr<Font>& getFontRef(int i) const { return mGlyphs[i].font.font; }
-    FontFakery getFakery(int i) const { return mGlyphs[i].font.fakery; }
-    unsigned int getGlyphId(int i) const { return mGlyphs[i].glyph_id; }
-    float getX(int i) const { return mGlyphs[i].x; }
-    float getY(int i) const { return mGlyphs[i].y; }
+    size_t nGlyphs() const { return mSharePieces ? mSharedGlyphCount : mGlyphs.size(); }
+    const Font* getFont(int i) const { return getFakedFont(i).font.get(); }
+    const std::shared_ptr<Font>& getFontRef(int i) const { return getFakedFont(i).font; }
+    FontFakery getFakery(int i) const { return getFakedFont(i).fakery; }
+    unsigned int getGlyphId(int i) const {
+        if (!mSharePieces) {
+            return mGlyphs[i].glyph_id;
+        }
+        const SharedPiece& piece = findSharedPiece(i);
+        return piece.layout->glyphIdAt(i - piece.glyphStart);
+    }
+    float getX(int i) const {
+        if (!mSharePieces) {
+            return mGlyphs[i].x;
+        }
+        const SharedPiece& piece = findSharedPiece(i);
+        return piece.x + piece.layout->pointAt(i - piece.glyphStart).x;
+    }
+    float getY(int i) const {
+        if (!mSharePieces) {
+            return mGlyphs[i].y;
+        }
+        const SharedPiece& piece = findSharedPiece(i);
+        return piece.layout->pointAt(i - piece.glyphStart).y;
+    }
+
+    // Calls f(const FakedFont& font, uint32_t glyphId, float x, float y) for every glyph in order.
+    template <typename F>
+    void forEachGlyph(F&& f) const {
+        if (!mSharePieces) {
+            for (const LayoutGlyph& glyph : mGlyphs) {
+                f(glyph.font, glyph.glyph_id, glyph.x, glyph.y);
+            }
+            return;
+        }
+        for (const SharedPiece& piece : mSharedPieces) {
+            const LayoutPiece& layout = *piece.layout;
+            for (uint32_t i = 0; i < layout.glyphCount(); ++i) {
+                const Point point = layout.pointAt(i);
+                f(layout.fontAt(i), layout.glyphIdAt(i), piece.x + point.x, point.y);
+            }
+        }
+    }
+
+    // Fills out with the glyphs of this layout grouped by font. The previous contents of out are
+    // discarded, but its storage is reused, so the same object can be passed for every draw.
+    void getGlyphRuns(GlyphRuns* out) const;
+
     float getAdvance() const { return mAdvance; }
     float getCharAdvance(size_t i) const { return mAdvances[i]; }
+
+    // The same as minikin::getBounds() for the text and the paint of this layout, computed from
+    // its glyphs instead of looking the words up again. The bounds of the shared pieces are cached
+    // on them, so this is cheaper on a layout sharing the pieces.
+    MinikinRect getBounds(const MinikinPaint& paint) const;
+
+    // The extent of the fonts of the laid out pieces, i.e. minikin::getFontExtent() for the text
+    // of this layout.
+    const MinikinExtent& getExtent() const { return mExtent; }
     const std::vector<float>& getAdvances() const { return mAdvances; }
 
+    // Returns the number of bytes used by this layout. The shared pieces are not counted since
+    // they are owned by LayoutCache.
+    size_t getMemoryUsage() const {
+        return sizeof(Layout) + mGlyphs.capacity() * sizeof(LayoutGlyph) +
+               mAdvances.capacity() * sizeof(float) +
+               mSharedPieces.capacity() * sizeof(SharedPiece);
+    }
+
     // Purge all caches, useful in low memory conditions
     static void purgeCaches();
 
+    // Evicts the cached entries of the font collection of the ID, see FontCollection::getId(),
+    // e.g. when the app drops a typeface. The fonts referred to by the entries are released
+    // together with the collection.
+    static void purgeCaches(uint32_t fontCollectionId);
+
+    // Evicts the cached entries of the font collections destroyed since the previous call. This is
+    // called by the layout and measurement functions, and costs a single atomic load if no
+    // collection has been destroyed.
+    static void purgeDestroyedCollections() {
+        if (FontCollection::hasDestroyedIds()) {
+            purgeCollections(FontCollection::takeDestroyedIds());
+        }
+    }
+
     // Dump minikin internal statistics, cache usage, cache hit ratio, etc.
     static void dumpMinikinStats(int fd);
 
     // Append another layout (for example, cached value) into this one
     void appendLayout(const LayoutPiece& src, size_t start, float extraAdvance);
 
+    // Same as above, but keeps the reference to the layout instead of copying the glyphs if this
+    // layout shares the pieces.
+    void appendLayout(const std::shared_ptr<const LayoutPiece>& src, size_t start,
+                      float extraAdvance);
+
 private:
     FRIEND_TEST(LayoutTest, doLayoutWithPrecomputedPiecesTest);
 
+    // Evicts the entries of the collections of the IDs from all the caches keyed by them.
+    static void purgeCollections(const std::vector<uint32_t>& fontCollectionIds);
+
     void doLayout(const U16StringPiece& str, const Range& range, Bidi bidiFlags,
                   const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen);
 
@@ -117,23 +263,47 @@ private:
                                    StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
                                    Layout* layout, float* advances);
 
-    // Lay out a single word
-    static float doLayoutWord(const uint16_t* buf, size_t start, size_t count, size_t bufSize,
-                              bool isRtl, const MinikinPaint& paint, size_t bufStart,
-                              StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, Layout* layout,
-                              float* advances);
-
     // Lay out a single bidi run
     void doLayoutRun(const uint16_t* buf, size_t start, size_t count, size_t bufSize, bool isRtl,
                      const MinikinPaint& paint, StartHyphenEdit startHyphen,
                      EndHyphenEdit endHyphen);
 
+    // A LayoutPiece referred by the layout sharing the pieces.
+    struct SharedPiece {
+        std::shared_ptr<const LayoutPiece> layout;
+        float x;              // The x offset of the piece.
+        uint32_t glyphStart;  // The index of the first glyph of the piece in this layout.
+    };
+
+    const SharedPiece& findSharedPiece(int glyphIndex) const {
+        auto it = std::upper_bound(mSharedPieces.begin(), mSharedPieces.end(),
+                                   static_cast<uint32_t>(glyphIndex),
+                                   [](uint32_t index, const SharedPiece& piece) {
+                                       return index < piece.glyphStart;
+                                   });
+        return *(it - 1);
+    }
+
+    const FakedFont& getFakedFont(int i) const {
+        if (!mSharePieces) {
+            return mGlyphs[i].font;
+        }
+        const SharedPiece& piece = findSharedPiece(i);
+        return piece.layout->fontAt(i - piece.glyphStart);
+    }
+
     std::vector<LayoutGlyph> mGlyphs;
 
     // This vector defined per code unit, so their length is identical to the input text.
     std::vector<float> mAdvances;
 
     float mAdvance;
+    MinikinExtent mExtent;
+
+    bool mSharePieces;
+    // Used instead of mGlyphs if mSharePieces is true. Pieces without glyphs are not stored.
+    std::vector<SharedPiece> mSharedPieces;
+    uint32_t mSharedGlyphCount;
 };
 
 }  // namespace minikin
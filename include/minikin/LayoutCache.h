@@ -19,12 +19,27 @@
 
 #include "minikin/LayoutCore.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <utils/LruCache.h>
 
+#include "minikin/Allocator.h"
+#include "minikin/CachePartition.h"
+#include "minikin/CacheStats.h"
 #include "minikin/FontCollection.h"
+#include "minikin/FrequencySketch.h"
 #include "minikin/Hasher.h"
+#include "minikin/Macros.h"
 #include "minikin/MinikinPaint.h"
 
 #ifdef _WIN32
@@ -48,10 +63,10 @@ public:
               mScaleX(paint.scaleX),
               mSkewX(paint.skewX),
               mLetterSpacing(paint.letterSpacing),
-              mWordSpacing(paint.wordSpacing),
               mFontFlags(paint.fontFlags),
               mLocaleListId(paint.localeListId),
               mFamilyVariant(paint.familyVariant),
+              mFontFeatureSettingsId(paint.fontFeatureSettings.getId()),
               mStartHyphen(startHyphen),
               mEndHyphen(endHyphen),
               mIsRtl(dir),
@@ -60,29 +75,76 @@ public:
     bool operator==(const LayoutCacheKey& o) const {
         return mId == o.mId && mStart == o.mStart && mCount == o.mCount && mStyle == o.mStyle &&
                mSize == o.mSize && mScaleX == o.mScaleX && mSkewX == o.mSkewX &&
-               mLetterSpacing == o.mLetterSpacing && mWordSpacing == o.mWordSpacing &&
-               mFontFlags == o.mFontFlags && mLocaleListId == o.mLocaleListId &&
-               mFamilyVariant == o.mFamilyVariant && mStartHyphen == o.mStartHyphen &&
-               mEndHyphen == o.mEndHyphen && mIsRtl == o.mIsRtl && mNchars == o.mNchars &&
-               !memcmp(mChars, o.mChars, mNchars * sizeof(uint16_t));
+               mLetterSpacing == o.mLetterSpacing && mFontFlags == o.mFontFlags &&
+               mLocaleListId == o.mLocaleListId &&
+               mFamilyVariant == o.mFamilyVariant &&
+               mFontFeatureSettingsId == o.mFontFeatureSettingsId &&
+               mStartHyphen == o.mStartHyphen && mEndHyphen == o.mEndHyphen && mIsRtl == o.mIsRtl &&
+               mNchars == o.mNchars &&
+               !memcmp(mChars.get(), o.mChars.get(), mNchars * sizeof(uint16_t));
     }
 
     android::hash_t hash() const { return mHash; }
 
-    void copyText() {
-        uint16_t* charsCopy = new uint16_t[mNchars];
-        memcpy(charsCopy, mChars, mNchars * sizeof(uint16_t));
-        mChars = charsCopy;
-    }
-    void freeText() {
-        delete[] mChars;
-        mChars = NULL;
+    void copyText() { mChars.copy(mNchars); }
+    void freeText() { mChars.free(); }
+
+    uint32_t getCollectionId() const { return mId; }
+
+    uint32_t getMemoryUsage() const {
+        return sizeof(LayoutCacheKey) + (mChars.isInline(mNchars) ? 0 : sizeof(uint16_t) * mNchars);
     }
 
-    uint32_t getMemoryUsage() const { return sizeof(LayoutCacheKey) + sizeof(uint16_t) * mNchars; }
+    // Texts up to this length are copied into the key itself instead of the heap.
+    static constexpr uint32_t kInlineCharsCapacity = 24;
 
 private:
-    const uint16_t* mChars;
+    // A pointer to the text, which either refers to the caller's buffer or owns a copy after
+    // copy(). Short texts are copied into the inline storage, so that inserting a cache entry
+    // does not need a separate allocation for the key text in the common case.
+    class Chars {
+    public:
+        Chars(const uint16_t* chars) : mChars(chars) {}
+        Chars(const Chars& o) { *this = o; }
+        Chars& operator=(const Chars& o) {
+            if (this == &o) {
+                return *this;
+            }
+            if (o.mChars == o.mInline) {
+                memcpy(mInline, o.mInline, sizeof(mInline));
+                mChars = mInline;
+            } else {
+                mChars = o.mChars;
+            }
+            return *this;
+        }
+
+        const uint16_t* get() const { return mChars; }
+
+        static bool isInline(uint32_t length) { return length <= kInlineCharsCapacity; }
+
+        void copy(uint32_t length) {
+            uint16_t* charsCopy =
+                    isInline(length) ? mInline
+                                     : static_cast<uint16_t*>(allocateBlock(
+                                               length * sizeof(uint16_t)));
+            memcpy(charsCopy, mChars, length * sizeof(uint16_t));
+            mChars = charsCopy;
+        }
+
+        void free() {
+            if (mChars != mInline && mChars != nullptr) {
+                freeBlock(const_cast<uint16_t*>(mChars));
+            }
+            mChars = nullptr;
+        }
+
+    private:
+        const uint16_t* mChars;
+        uint16_t mInline[kInlineCharsCapacity];
+    };
+
+    Chars mChars;
     uint32_t mNchars;
     uint32_t mStart;
     uint32_t mCount;
@@ -92,14 +154,15 @@ private:
     float mScaleX;
     float mSkewX;
     float mLetterSpacing;
-    float mWordSpacing;
     int32_t mFontFlags;
     uint32_t mLocaleListId;
     FamilyVariant mFamilyVariant;
+    uint32_t mFontFeatureSettingsId;
     StartHyphenEdit mStartHyphen;
     EndHyphenEdit mEndHyphen;
     bool mIsRtl;
-    // Note: any fields added to MinikinPaint must also be reflected here.
+    // Note: any fields added to MinikinPaint must also be reflected here, unless they are applied
+    // outside of the shaping like the word spacing.
     // TODO: language matching (possibly integrate into style)
     android::hash_t mHash;
 
@@ -113,84 +176,1219 @@ private:
                 .update(mScaleX)
                 .update(mSkewX)
                 .update(mLetterSpacing)
-                .update(mWordSpacing)
                 .update(mFontFlags)
                 .update(mLocaleListId)
                 .update(static_cast<uint8_t>(mFamilyVariant))
+                .update(mFontFeatureSettingsId)
                 .update(packHyphenEdit(mStartHyphen, mEndHyphen))
                 .update(mIsRtl)
-                .updateShorts(mChars, mNchars)
+                .updateShorts(mChars.get(), mNchars)
                 .hash();
     }
 };
 
-class LayoutCache : private android::OnEntryRemoved<LayoutCacheKey, LayoutPiece*> {
+// Removes the entries of the cache whose keys are of the font collections of the IDs. The keys
+// must have getCollectionId().
+template <typename TKey, typename TValue>
+void removeCollectionEntries(android::LruCache<TKey, TValue>& cache,
+                             const std::unordered_set<uint32_t>& collectionIds) {
+    std::vector<TKey> keys;
+    typename android::LruCache<TKey, TValue>::Iterator it(cache);
+    while (it.next()) {
+        if (collectionIds.count(it.key().getCollectionId()) != 0) {
+            keys.push_back(it.key());
+        }
+    }
+    // The copied keys refer to the text of the entries, which is alive until each is removed.
+    for (const TKey& key : keys) {
+        cache.remove(key);
+    }
+}
+
+// A hash table of immutable layouts whose lookups never take a lock.
+//
+// Readers enter a read-side critical section with ReadGuard and traverse the bucket chains with
+// atomic loads only. Writers are serialized by a mutex; they publish new entries at the head of a
+// bucket chain and unlink evicted entries, which are freed only after every reader that could have
+// seen them has left its critical section (epoch based reclamation). Instead of the strict LRU
+// reordering, which would require writes on every hit, hits only set a reference bit and the
+// eviction uses the CLOCK (second chance) algorithm.
+class ReadMostlyLayoutTable {
+public:
+    // The evictions are recorded to the given stats, which must outlive the table.
+    ReadMostlyLayoutTable(uint32_t maxEntries, CacheStats& stats);
+    ~ReadMostlyLayoutTable();
+
+    // A read-side critical section. The layouts returned by find() are valid while the guard is
+    // alive. Do not call the mutating methods of the same table while holding a guard, otherwise
+    // dead-lock happens.
+    class ReadGuard {
+    public:
+        ReadGuard(const ReadMostlyLayoutTable& table);
+        ~ReadGuard();
+
+    private:
+        const ReadMostlyLayoutTable& mTable;
+        std::atomic<uint32_t>* mCounter;
+
+        MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(ReadGuard);
+    };
+
+    // Returns the cached layout or nullptr if not found. Must be called with a ReadGuard alive.
+    const std::shared_ptr<const LayoutPiece>* find(const LayoutCacheKey& key) const;
+
+    // Inserts the layout. Takes the ownership of the key text, which must have been copied with
+    // LayoutCacheKey::copyText().
+    void insert(LayoutCacheKey& key, const std::shared_ptr<const LayoutPiece>& layout);
+
+    void clear();
+    void setMemoryBudget(size_t bytes);
+    void trim(uint32_t percent);
+    void removeCollections(const std::unordered_set<uint32_t>& collectionIds);
+    uint32_t size();
+    size_t getMemoryUsage();
+
+private:
+    struct Node;
+
+    // Unlinks the node in the given clock slot and queues it for the deletion.
+    void evictLocked(uint32_t slot) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    // Evicts one node chosen by the CLOCK algorithm. Returns false if the table is empty.
+    bool evictOneLocked() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    // Evicts until the memory usage becomes less than or equal to the given bytes.
+    void trimLocked(size_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    // Waits until all the readers which may see the retired nodes leave, then deletes them.
+    void synchronizeLocked() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    static constexpr uint32_t kReaderStripes = 16;
+    // The number of retired nodes to batch before waiting for the readers.
+    static constexpr uint32_t kRetireBatchSize = 64;
+
+    // Per-epoch-parity reader counts, striped by thread to avoid bouncing a single cache line.
+    struct alignas(64) ReaderCounter {
+        std::atomic<uint32_t> count;
+    };
+    mutable ReaderCounter mReaders[2][kReaderStripes];
+    std::atomic<uint64_t> mEpoch;
+
+    const uint32_t mMaxEntries;
+    const uint32_t mBucketMask;
+    std::unique_ptr<std::atomic<Node*>[]> mBuckets;
+
+    std::mutex mMutex;
+    // The clock ring. nullptr for an unused slot.
+    std::vector<Node*> mClock GUARDED_BY(mMutex);
+    std::vector<uint32_t> mFreeSlots GUARDED_BY(mMutex);
+    uint32_t mClockHand GUARDED_BY(mMutex);
+    std::vector<Node*> mRetired GUARDED_BY(mMutex);
+    size_t mMemoryUsage GUARDED_BY(mMutex);
+    size_t mMemoryBudget GUARDED_BY(mMutex);
+
+    CacheStats& mStats;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(ReadMostlyLayoutTable);
+};
+
+struct LayoutSegment;
+
+// A cache for the layouts of runs whose length is LENGTH_LIMIT_CACHE or more, which LayoutCache
+// doesn't store. A long run is split at safe-to-break cluster boundaries into segments of at
+// most kMaxSegmentLength code units, each of which is cached as an independent entry, and the run
+// itself is kept as the list of its split points. A run laid out again is concatenated from the
+// cached segments, and a segment that has been evicted is shaped on its own, which gives the same
+// result since its boundaries are safe to break.
+//
+// The cache has its own memory budget and is disabled until a non-zero budget is set.
+class LayoutSegmentCache : private android::OnEntryRemoved<LayoutCacheKey, LayoutSegment*> {
+public:
+    LayoutSegmentCache();
+    ~LayoutSegmentCache();
+
+    bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    // Enables the cache with the given budget in bytes. Passing 0 disables and clears the cache.
+    void setMemoryBudget(size_t bytes);
+
+    std::shared_ptr<const LayoutPiece> getOrCreate(const U16StringPiece& text, const Range& range,
+                                                   const MinikinPaint& paint, bool dir,
+                                                   StartHyphenEdit startHyphen,
+                                                   EndHyphenEdit endHyphen);
+
+    void clear();
+    void trim(uint32_t percent);
+    void removeCollections(const std::unordered_set<uint32_t>& collectionIds);
+    uint32_t size();
+    size_t getMemoryUsage();
+    const CacheStats& getStats() const { return mStats; }
+
+    static constexpr uint32_t kMaxSegmentLength = 64;
+
+private:
+    std::shared_ptr<const LayoutPiece> getOrCreateSegment(const U16StringPiece& text,
+                                                          const Range& range,
+                                                          const std::vector<uint32_t>& breaks,
+                                                          size_t index, const MinikinPaint& paint,
+                                                          bool dir, StartHyphenEdit startHyphen,
+                                                          EndHyphenEdit endHyphen);
+
+    // Takes the ownership of the segment. The key text is copied.
+    void put(LayoutCacheKey& key, LayoutSegment* segment);
+    void trimLocked(size_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    // callback for OnEntryRemoved
+    void operator()(LayoutCacheKey& key, LayoutSegment*& value);
+
+    std::atomic<bool> mEnabled;
+    std::mutex mMutex;
+    android::LruCache<LayoutCacheKey, LayoutSegment*> mCache GUARDED_BY(mMutex);
+    size_t mMemoryBudget GUARDED_BY(mMutex);
+    size_t mMemoryUsage GUARDED_BY(mMutex);
+    CacheStats mStats;
+};
+
+// A small direct-mapped cache of the layouts recently used by the calling thread, which is
+// looked up before LayoutCache without taking any lock. The entries are tagged with the generation
+// of the LayoutCache they came from and are ignored once it changes, e.g. by clear(). The layouts
+// are immutable and shared with LayoutCache, so an entry costs only its key.
+class ThreadLocalLayoutCache {
+public:
+    ~ThreadLocalLayoutCache() {
+        for (Entry& entry : mEntries) {
+            if (entry.key) {
+                entry.key->freeText();
+            }
+        }
+    }
+
+    static ThreadLocalLayoutCache& getInstance() {
+        thread_local ThreadLocalLayoutCache cache;
+        return cache;
+    }
+
+    // Returns the layout stored for the key with the given generation, or nullptr if not found.
+    const std::shared_ptr<const LayoutPiece>* find(const LayoutCacheKey& key, uint64_t generation,
+                                                   bool needGlyphs) const {
+        const Entry& entry = mEntries[key.hash() % kSize];
+        if (entry.generation != generation || !entry.key || !(*entry.key == key) ||
+            (needGlyphs && entry.layout->isAdvancesOnly())) {
+            return nullptr;
+        }
+        return &entry.layout;
+    }
+
+    // Stores the layout, replacing the entry in the same slot. The key text is copied.
+    void put(const LayoutCacheKey& key, const std::shared_ptr<const LayoutPiece>& layout,
+             uint64_t generation) {
+        Entry& entry = mEntries[key.hash() % kSize];
+        if (entry.generation == generation && entry.layout == layout) {
+            return;
+        }
+        if (entry.key) {
+            entry.key->freeText();
+        }
+        entry.key = key;
+        entry.key->copyText();
+        entry.layout = layout;
+        entry.generation = generation;
+    }
+
+    static constexpr uint32_t kSize = 128;
+
+private:
+    ThreadLocalLayoutCache() {}
+
+    struct Entry {
+        std::optional<LayoutCacheKey> key;
+        std::shared_ptr<const LayoutPiece> layout;
+        uint64_t generation = 0;
+    };
+
+    Entry mEntries[kSize];
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(ThreadLocalLayoutCache);
+};
+
+class LayoutCache {
 public:
     void clear() {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mCache.clear();
+        mSegmentCache.clear();
+        if (mTable) {
+            mTable->clear();
+        } else {
+            for (const auto& shard : mShards) {
+                shard->clear();
+            }
+        }
+        invalidateThreadLocalCaches();
     }
 
     // Do not use LayoutCache inside the callback function, otherwise dead-lock may happen.
     template <typename F>
     void getOrCreate(const U16StringPiece& text, const Range& range, const MinikinPaint& paint,
                      bool dir, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, F& f) {
+        if (isScalable(paint)) {
+            const MinikinPaint scalablePaint = getScalablePaint(paint);
+            const float scale = paint.size / kScalableLayoutSize;
+            auto scaleLayout = [&f, &paint, scale](const LayoutPiece& layout, const MinikinPaint&) {
+                call(f, std::make_shared<const LayoutPiece>(layout, scale), paint);
+            };
+            getOrCreate(text, range, scalablePaint, dir, startHyphen, endHyphen, scaleLayout);
+            return;
+        }
+        if (isLetterSpacingDeferred(paint)) {
+            const MinikinPaint spacedPaint = getDeferredLetterSpacingPaint(paint);
+            auto respaceLayout = [&](const LayoutPiece& layout, const MinikinPaint&) {
+                if (layout.hasLetterSpacings()) {
+                    call(f, std::make_shared<const LayoutPiece>(layout, spacedPaint, paint), paint);
+                } else {
+                    callWithNewLayout(f, text, range, paint, dir, startHyphen, endHyphen);
+                }
+            };
+            getOrCreate(text, range, spacedPaint, dir, startHyphen, endHyphen, respaceLayout);
+            return;
+        }
         LayoutCacheKey key(text, range, paint, dir, startHyphen, endHyphen);
-        if (paint.skipCache() || range.getLength() >= LENGTH_LIMIT_CACHE) {
+        if (range.getLength() >= LENGTH_LIMIT_CACHE) {
+            if (mSegmentCache.isEnabled()) {
+                std::shared_ptr<const LayoutPiece> layout = mSegmentCache.getOrCreate(
+                        text, range, paint, dir, startHyphen, endHyphen);
+                call(f, layout, paint);
+            } else {
+                mStats.recordBypass(CacheStats::BypassReason::TooLong);
+                callWithNewLayout(f, text, range, paint, dir, startHyphen, endHyphen);
+            }
+            return;
+        }
+        if (mThreadLocalCache.load(std::memory_order_relaxed)) {
+            // Read the generation before looking up the shared cache, so that a layout found
+            // there before a clear() is never stored as valid after it.
+            const uint64_t generation = mGeneration.load(std::memory_order_acquire);
+            ThreadLocalLayoutCache& local = ThreadLocalLayoutCache::getInstance();
+            const std::shared_ptr<const LayoutPiece>* layout =
+                    local.find(key, generation, true /* need glyphs */);
+            if (layout != nullptr) {
+                mStats.recordHit();
+                call(f, *layout, paint);
+                return;
+            }
+            auto remember = [&f, &local, &key, generation](
+                                    const std::shared_ptr<const LayoutPiece>& layout,
+                                    const MinikinPaint& paint) {
+                local.put(key, layout, generation);
+                call(f, layout, paint);
+            };
+            getOrCreateShared(key, text, range, paint, dir, startHyphen, endHyphen, remember);
+            return;
+        }
+        getOrCreateShared(key, text, range, paint, dir, startHyphen, endHyphen, f);
+    }
+
+    // A word looked up by getOrCreateBatch().
+    struct BatchEntry {
+        U16StringPiece text;
+        Range range;
+        StartHyphenEdit startHyphen;
+        EndHyphenEdit endHyphen;
+    };
+
+    // Same as calling getOrCreate() for each entry, e.g. for all the words of a run, but every
+    // lookup takes the shard lock only once per pass no matter how many words are in the batch.
+    // The hits are found under the lock, the misses are shaped without the lock, and then the
+    // results are stored in the second pass. f is called as f(index, layout, paint) in the order of
+    // the entries. Words appearing more than once in a batch are shaped only once. If the parallel
+    // shaping is enabled, the misses may be shaped on the worker threads, but the callbacks are
+    // still made on the calling thread in order.
+    //
+    // If needGlyphs is false, the callback may be given an advances only layout, see
+    // setAdvancesOnlyMeasurement().
+    //
+    // Do not use LayoutCache inside the callback function, otherwise dead-lock may happen.
+    template <typename F>
+    void getOrCreateBatch(const std::vector<BatchEntry>& entries, const MinikinPaint& paint,
+                          bool dir, F& f, bool needGlyphs = true) {
+        if (isScalable(paint)) {
+            const MinikinPaint scalablePaint = getScalablePaint(paint);
+            const float scale = paint.size / kScalableLayoutSize;
+            auto scaleLayout = [&f, &paint, scale](size_t index, const LayoutPiece& layout,
+                                                   const MinikinPaint&) {
+                callBatch(f, index, std::make_shared<const LayoutPiece>(layout, scale), paint);
+            };
+            getOrCreateBatch(entries, scalablePaint, dir, scaleLayout, needGlyphs);
+            return;
+        }
+        if (isLetterSpacingDeferred(paint)) {
+            const MinikinPaint spacedPaint = getDeferredLetterSpacingPaint(paint);
+            auto respaceLayout = [&](size_t index, const LayoutPiece& layout, const MinikinPaint&) {
+                if (layout.hasLetterSpacings()) {
+                    callBatch(f, index,
+                              std::make_shared<const LayoutPiece>(layout, spacedPaint, paint),
+                              paint);
+                } else {
+                    const BatchEntry& entry = entries[index];
+                    callBatch(f, index,
+                              std::make_shared<const LayoutPiece>(entry.text, entry.range, dir,
+                                                                  paint, entry.startHyphen,
+                                                                  entry.endHyphen),
+                              paint);
+                }
+            };
+            getOrCreateBatch(entries, spacedPaint, dir, respaceLayout, needGlyphs);
+            return;
+        }
+        if (mThreadLocalCache.load(std::memory_order_relaxed)) {
+            getOrCreateBatchThreadLocal(entries, paint, dir, f, needGlyphs);
+            return;
+        }
+        getOrCreateBatchShared(entries, paint, dir, f, needGlyphs);
+    }
+
+    // Returns the instance of the partition of the calling thread, see CachePartitionScope.
+    static LayoutCache& getInstance() { return getInstance(CachePartitionScope::getCurrent()); }
+
+    // Returns the instance of the partition. The partitions are configured separately, e.g. the
+    // settings applied to the Interactive instance don't apply to the Bulk one.
+    static LayoutCache& getInstance(CachePartition partition) {
+        if (partition == CachePartition::Bulk) {
+            static LayoutCache bulkCache(kMaxEntries, getStartupShardCount(),
+                                         startupLockFreeReads().load(std::memory_order_relaxed));
+            return bulkCache;
+        }
+        static LayoutCache cache(kMaxEntries, getStartupShardCount(),
+                                 startupLockFreeReads().load(std::memory_order_relaxed));
+        return cache;
+    }
+
+    // Sets the number of independently locked shards the global instances are created with. The
+    // entries are partitioned by LayoutCacheKey::hash() and each shard keeps its own LRU order,
+    // so that threads looking up different words do not serialize on a single mutex.
+    //
+    // This must be called before the first call of getInstance(), e.g. at process startup. Calls
+    // after that point have no effect. The value is rounded up to a power of two and clamped to
+    // kMaxShardCount. The default is 1, i.e. a single global LRU.
+    static void setShardCount(uint32_t shardCount) {
+        startupShardCount().store(shardCount, std::memory_order_relaxed);
+    }
+
+    static constexpr uint32_t kMaxShardCount = 64;
+
+    // Makes the global instances use ReadMostlyLayoutTable, with which cache hits take no lock and
+    // leave the recency order untouched except for a reference bit. Misses are inserted under a
+    // single writer lock, so the shard count and the miss de-duplication are ignored in this mode.
+    //
+    // Like setShardCount(), this must be called before the first call of getInstance().
+    static void setLockFreeReads(bool enabled) {
+        startupLockFreeReads().store(enabled, std::memory_order_relaxed);
+    }
+
+    // Switches the cache to the memory budget mode. In this mode, the least recently used entries
+    // are evicted until the total of LayoutCacheKey::getMemoryUsage() and
+    // LayoutPiece::getMemoryUsage() of all entries fits in the given number of bytes. The budget is
+    // split evenly among the shards. The entry count limit passed at construction still applies.
+    // Passing 0 disables the budget, i.e. the eviction only happens based on the entry count.
+    void setMemoryBudget(size_t bytes) {
+        if (mTable) {
+            mTable->setMemoryBudget(bytes);
+        } else {
+            const size_t bytesPerShard = (bytes + mShards.size() - 1) / mShards.size();
+            for (const auto& shard : mShards) {
+                shard->setMemoryBudget(bytesPerShard);
+            }
+        }
+        invalidateThreadLocalCaches();
+    }
+
+    // Evicts the least recently used entries until the memory usage of the cache falls to the
+    // given percentage of the current usage. Intended to be called on low memory signals.
+    // trim(0) is equivalent to clear().
+    void trim(uint32_t percent) {
+        mSegmentCache.trim(percent);
+        if (mTable) {
+            mTable->trim(percent);
+        } else {
+            for (const auto& shard : mShards) {
+                shard->trim(percent);
+            }
+        }
+        invalidateThreadLocalCaches();
+    }
+
+    // Evicts the entries of the font collections of the IDs, see FontCollection::getId(), e.g.
+    // once the collections are destroyed.
+    void removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
+        mSegmentCache.removeCollections(collectionIds);
+        if (mTable) {
+            mTable->removeCollections(collectionIds);
+        } else {
+            for (const auto& shard : mShards) {
+                shard->removeCollections(collectionIds);
+            }
+        }
+        invalidateThreadLocalCaches();
+    }
+
+    // Enables caching the layouts of runs of LENGTH_LIMIT_CACHE or more code units as chains of
+    // segments, with the given memory budget in bytes, which is separate from the budget of the
+    // main cache. Passing 0 disables it, which is the default.
+    void setSegmentCacheBudget(size_t bytes) { mSegmentCache.setMemoryBudget(bytes); }
+
+    // Enables or disables sharing the layouts among the text sizes for the paints whose metrics
+    // are linear in the size, i.e. with LinearMetrics_Flag and Subpixel_Flag but without
+    // ForceAutoHinting_Flag. Such layouts are cached at kScalableLayoutSize and scaled to the size
+    // of the paint on every lookup, so that animating the text size hits the cache. The scaled
+    // values may differ from the ones shaped at the size in the last bits, so this is disabled by
+    // default.
+    void setScalableLayouts(bool enabled) {
+        mScalableLayouts.store(enabled, std::memory_order_relaxed);
+    }
+
+    // The text size the scalable layouts are cached at.
+    static constexpr float kScalableLayoutSize = 256.0f;
+
+    // Enables or disables sharing the layouts among the letter spacings. The letter spacing only
+    // changes the font features when crossing kLigatureLetterSpacingLimit, so the layouts are
+    // cached at kLetterSpacingWithLigatures or kLetterSpacingWithoutLigatures and re-spaced to the
+    // letter spacing of the paint on every lookup, so that animating the letter spacing hits the
+    // cache. Only the scripts which allow the letter spacing are re-spaced. Like the scalable
+    // layouts, the results may differ in the last bits, so this is disabled by default. The
+    // layouts only record where the letter spacing was added while this is enabled.
+    void setDeferredLetterSpacing(bool enabled) {
+        LayoutPiece::setLetterSpacingsRecorded(enabled);
+        mDeferredLetterSpacing.store(enabled, std::memory_order_relaxed);
+    }
+
+    // The letter spacings the re-spaced layouts are cached at, on each side of the absolute
+    // letter spacing above which the ligatures are disabled, see FontFeatureUtils.
+    static constexpr float kLetterSpacingWithLigatures = 0.01f;
+    static constexpr float kLetterSpacingWithoutLigatures = 0.1f;
+    static constexpr double kLigatureLetterSpacingLimit = 0.03;
+
+    // Enables or disables the de-duplication of concurrent misses. When enabled, a thread that
+    // misses on a key which is being laid out by other thread waits for that result instead of
+    // shaping the same text again. Disabled by default.
+    void setDeduplicateMisses(bool enabled) {
+        mDeduplicateMisses.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Enables or disables shaping the misses of a batch lookup, i.e. of a run laid out by
+    // Layout, on the process wide worker pool. This only pays off for long runs on cold caches,
+    // so small batches are still shaped on the calling thread. The resulting layouts are the same
+    // in either case. Disabled by default.
+    void setParallelShaping(bool enabled) {
+        mParallelShaping.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Enables or disables shaping the misses of the lookups which only need advances, i.e. of
+    // Layout::measureText(), without keeping the glyphs. The advances only layouts are cached like
+    // the others, and a later lookup which needs the glyphs shapes the text again and replaces the
+    // entry. This saves memory and time for text which is measured but never drawn, but text which
+    // is drawn after being measured is shaped twice, so this is disabled by default.
+    void setAdvancesOnlyMeasurement(bool enabled) {
+        mAdvancesOnlyMeasurement.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Enables or disables looking up the layouts in ThreadLocalLayoutCache before the shared
+    // cache, so that a thread drawing the same text again takes no lock. The thread local entries
+    // are invalidated by clear(), trim(), removeCollections() and setMemoryBudget(), but each
+    // thread keeps its last ThreadLocalLayoutCache::kSize layouts alive until they are replaced.
+    // Disabled by default.
+    void setThreadLocalCache(bool enabled) {
+        mThreadLocalCache.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Enables or disables the TinyLFU admission of the new entries, which protects the frequently
+    // used words from a single pass over a lot of unique text, e.g. a log or a large paste. Once a
+    // shard is full, a miss is only stored if its key was missed at least kAdmissionFrequency
+    // times recently, as estimated by a FrequencySketch of the misses of the shard. Otherwise the
+    // layout is returned without being cached, and the least recently used entries stay. New text
+    // is then shaped twice before it is cached, so this is disabled by default. Only applies to
+    // the sharded mode, not to the lock-free reads.
+    void setFrequencyAdmission(bool enabled) {
+        mFrequencyAdmission.store(enabled, std::memory_order_relaxed);
+    }
+
+    static constexpr uint32_t kAdmissionFrequency = 2;
+
+    // Returns the number of layouts that were not shaped thanks to the miss de-duplication.
+    uint64_t getDeduplicatedMissCount() const {
+        return mDeduplicatedMissCount.load(std::memory_order_relaxed);
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+    const CacheStats& getSegmentCacheStats() const { return mSegmentCache.getStats(); }
+
+    size_t getSegmentCacheMemoryUsage() { return mSegmentCache.getMemoryUsage(); }
+
+    // Returns the total number of bytes used by the cached keys and layouts.
+    size_t getMemoryUsage() {
+        if (mTable) {
+            return mTable->getMemoryUsage();
+        }
+        size_t usage = 0;
+        for (const auto& shard : mShards) {
+            std::lock_guard<std::mutex> lock(shard->mMutex);
+            usage += shard->mMemoryUsage;
+        }
+        return usage;
+    }
+
+protected:
+    LayoutCache(uint32_t maxEntries) : LayoutCache(maxEntries, 1) {}
+
+    LayoutCache(uint32_t maxEntries, uint32_t shardCount)
+            : LayoutCache(maxEntries, shardCount, false /* lock-free reads */) {}
+
+    LayoutCache(uint32_t maxEntries, uint32_t shardCount, bool lockFreeReads)
+            : mShardShift(32),
+              mDeduplicateMisses(false),
+              mDeduplicatedMissCount(0),
+              mParallelShaping(false),
+              mAdvancesOnlyMeasurement(false),
+              mScalableLayouts(false),
+              mDeferredLetterSpacing(false),
+              mThreadLocalCache(false),
+              mFrequencyAdmission(false),
+              mGeneration(nextGeneration()) {
+        if (lockFreeReads) {
+            mTable = std::make_unique<ReadMostlyLayoutTable>(maxEntries, mStats);
+            return;
+        }
+        uint32_t shardBits = 0;
+        while ((1u << shardBits) < std::min(shardCount, kMaxShardCount)) {
+            shardBits++;
+        }
+        const uint32_t count = 1u << shardBits;
+        mShardShift = 32 - shardBits;
+        // Distribute the capacity evenly. Round up so that the total capacity never goes below
+        // maxEntries.
+        const uint32_t entriesPerShard = std::max(1u, (maxEntries + count - 1) / count);
+        mShards.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            mShards.push_back(
+                    std::make_unique<Shard>(entriesPerShard, mStats, mFrequencyAdmission));
+        }
+    }
+
+    uint32_t getCacheSize() {
+        if (mTable) {
+            return mTable->size();
+        }
+        uint32_t size = 0;
+        for (const auto& shard : mShards) {
+            std::lock_guard<std::mutex> lock(shard->mMutex);
+            size += shard->mCache.size();
+        }
+        return size;
+    }
+
+    uint32_t getSegmentCacheSize() { return mSegmentCache.size(); }
+
+    uint32_t getShardCount() const { return mTable ? 0 : mShards.size(); }
+
+    // Blocks until count lookups of the shard of the key wait for the layouts in flight, i.e. for
+    // the other threads laying out the same keys. Only for the sharded mode.
+    void waitForInFlightWaiters(const LayoutCacheKey& key, uint32_t count) {
+        Shard& shard = getShard(key);
+        std::unique_lock<std::mutex> lock(shard.mMutex);
+        shard.mInFlightCv.wait(lock, [&] { return shard.mInFlightWaiters >= count; });
+    }
+
+private:
+    // A layout being created by a thread, which other threads missing on the same key can wait for.
+    struct InFlight {
+        bool done = false;
+    };
+
+    struct KeyHasher {
+        std::size_t operator()(const LayoutCacheKey& key) const { return key.hash(); }
+    };
+
+    // The callbacks may take either const LayoutPiece& or const std::shared_ptr<const LayoutPiece>&
+    // as the layout. The latter can keep the layout alive after the callback returns.
+    template <typename F>
+    static constexpr bool kTakesSharedLayout =
+            std::is_invocable_v<F&, const std::shared_ptr<const LayoutPiece>&, const MinikinPaint&>;
+
+    template <typename F>
+    static void call(F& f, const std::shared_ptr<const LayoutPiece>& layout,
+                     const MinikinPaint& paint) {
+        if constexpr (kTakesSharedLayout<F>) {
+            f(layout, paint);
+        } else {
+            f(*layout, paint);
+        }
+    }
+
+    template <typename F>
+    static void callBatch(F& f, size_t index, const std::shared_ptr<const LayoutPiece>& layout,
+                          const MinikinPaint& paint) {
+        if constexpr (std::is_invocable_v<F&, size_t, const std::shared_ptr<const LayoutPiece>&,
+                                          const MinikinPaint&>) {
+            f(index, layout, paint);
+        } else {
+            f(index, *layout, paint);
+        }
+    }
+
+    // Calls back with a layout which is not stored in the cache. Avoids the heap allocation unless
+    // the callback takes the shared layout.
+    template <typename F>
+    static void callWithNewLayout(F& f, const U16StringPiece& text, const Range& range,
+                                  const MinikinPaint& paint, bool dir, StartHyphenEdit startHyphen,
+                                  EndHyphenEdit endHyphen) {
+        if constexpr (kTakesSharedLayout<F>) {
+            f(std::make_shared<const LayoutPiece>(text, range, dir, paint, startHyphen, endHyphen),
+              paint);
+        } else {
             f(LayoutPiece(text, range, dir, paint, startHyphen, endHyphen), paint);
+        }
+    }
+
+    // Returns true if the cached layout can be used by a lookup, i.e. it exists and it has glyphs
+    // if they are needed.
+    static bool isUsableLayout(const std::shared_ptr<const LayoutPiece>& layout, bool needGlyphs) {
+        return layout && !(needGlyphs && layout->isAdvancesOnly());
+    }
+
+    // Shapes the text, or reads the layout from PersistentLayoutCache if it is enabled.
+    static std::shared_ptr<const LayoutPiece> shapeLayout(const U16StringPiece& text,
+                                                          const Range& range,
+                                                          const MinikinPaint& paint, bool dir,
+                                                          StartHyphenEdit startHyphen,
+                                                          EndHyphenEdit endHyphen,
+                                                          bool advancesOnly);
+
+    std::shared_ptr<const LayoutPiece> createLayout(const BatchEntry& entry,
+                                                    const MinikinPaint& paint, bool dir,
+                                                    bool advancesOnly) {
+        const CacheStats::TimePoint shapingStart = CacheStats::now();
+        std::shared_ptr<const LayoutPiece> layout =
+                shapeLayout(entry.text, entry.range, paint, dir, entry.startHyphen,
+                            entry.endHyphen, advancesOnly);
+        mStats.recordMiss(shapingStart);
+        return layout;
+    }
+
+    // Shapes the entries flagged in missed, except for the repeated keys, and stores the layouts at
+    // the same indices of created. Uses the worker pool if the parallel shaping is enabled.
+    void createLayouts(const std::vector<BatchEntry>& entries,
+                       const std::vector<LayoutCacheKey>& keys, const std::vector<bool>& missed,
+                       const MinikinPaint& paint, bool dir, bool advancesOnly,
+                       std::vector<std::shared_ptr<const LayoutPiece>>* created);
+
+    // Returns the layout of the key in the lock-free table if it can be used by a lookup, otherwise
+    // null. Must be called with a ReadGuard.
+    const std::shared_ptr<const LayoutPiece>* findUsableLayout(const LayoutCacheKey& key,
+                                                               bool needGlyphs) const {
+        const std::shared_ptr<const LayoutPiece>* layout = mTable->find(key);
+        return layout != nullptr && isUsableLayout(*layout, needGlyphs) ? layout : nullptr;
+    }
+
+    // getOrCreate() in the shared cache, once the key is known to be cacheable.
+    template <typename F>
+    void getOrCreateShared(LayoutCacheKey& key, const U16StringPiece& text, const Range& range,
+                           const MinikinPaint& paint, bool dir, StartHyphenEdit startHyphen,
+                           EndHyphenEdit endHyphen, F& f) {
+        if (mTable) {
+            {
+                ReadMostlyLayoutTable::ReadGuard guard(*mTable);
+                const std::shared_ptr<const LayoutPiece>* layout =
+                        findUsableLayout(key, true /* need glyphs */);
+                if (layout != nullptr) {
+                    mStats.recordHit();
+                    call(f, *layout, paint);
+                    return;
+                }
+            }
+            key.copyText();
+            const CacheStats::TimePoint shapingStart = CacheStats::now();
+            std::shared_ptr<const LayoutPiece> layout = shapeLayout(
+                    text, range, paint, dir, startHyphen, endHyphen, false /* advances only */);
+            mStats.recordMiss(shapingStart);
+            call(f, layout, paint);
+            mTable->insert(key, layout);
             return;
         }
+        Shard& shard = getShard(key);
+        std::shared_ptr<InFlight> inFlight;
         {
-            std::lock_guard<std::mutex> lock(mMutex);
-            LayoutPiece* layout = mCache.get(key);
-            if (layout != nullptr) {
-                f(*layout, paint);
+            std::unique_lock<std::mutex> lock = shard.acquire();
+            const std::shared_ptr<const LayoutPiece>& layout = shard.mCache.get(key);
+            if (isUsableLayout(layout, true /* need glyphs */)) {
+                mStats.recordHit();
+                call(f, layout, paint);
                 return;
             }
+            if (mDeduplicateMisses.load(std::memory_order_relaxed)) {
+                auto it = shard.mInFlight.find(key);
+                if (it == shard.mInFlight.end()) {
+                    // The key refers to the caller's text, which outlives the in-flight entry.
+                    inFlight = std::make_shared<InFlight>();
+                    shard.mInFlight.emplace(key, inFlight);
+                } else {
+                    // Other thread is doing the same layout. Wait for it instead of shaping the
+                    // same text again.
+                    std::shared_ptr<InFlight> other = it->second;
+                    shard.mInFlightWaiters++;
+                    // Wakes up waitForInFlightWaiters() too.
+                    shard.mInFlightCv.notify_all();
+                    shard.mInFlightCv.wait(lock, [&other] { return other->done; });
+                    shard.mInFlightWaiters--;
+                    const std::shared_ptr<const LayoutPiece>& result = shard.mCache.get(key);
+                    if (isUsableLayout(result, true /* need glyphs */)) {
+                        mDeduplicatedMissCount.fetch_add(1, std::memory_order_relaxed);
+                        mStats.recordHit();
+                        call(f, result, paint);
+                        return;
+                    }
+                    // The result has already been evicted. Do the layout by ourselves.
+                }
+            }
         }
         // Doing text layout takes long time, so releases the mutex during doing layout.
-        // Don't care even if we do the same layout in other thred.
+        // Unless the de-duplication is enabled, don't care even if we do the same layout in other
+        // thread.
         key.copyText();
-        std::unique_ptr<LayoutPiece> layout =
-                std::make_unique<LayoutPiece>(text, range, dir, paint, startHyphen, endHyphen);
-        f(*layout, paint);
+        const CacheStats::TimePoint shapingStart = CacheStats::now();
+        std::shared_ptr<const LayoutPiece> layout = shapeLayout(text, range, paint, dir, startHyphen,
+                                                                endHyphen, false /* advances only */);
+        mStats.recordMiss(shapingStart);
+        call(f, layout, paint);
+        shard.put(key, layout, inFlight.get());
+    }
+
+    // getOrCreateBatch() which looks up the thread local cache first. It is used only if it has
+    // all the entries, which is the common case of the text drawn again. Otherwise the batch is
+    // looked up in the shared cache and the results are stored in the thread local cache.
+    template <typename F>
+    void getOrCreateBatchThreadLocal(const std::vector<BatchEntry>& entries,
+                                     const MinikinPaint& paint, bool dir, F& f, bool needGlyphs) {
+        const uint64_t generation = mGeneration.load(std::memory_order_acquire);
+        ThreadLocalLayoutCache& local = ThreadLocalLayoutCache::getInstance();
+        std::vector<LayoutCacheKey> keys;
+        keys.reserve(entries.size());
+        std::vector<const std::shared_ptr<const LayoutPiece>*> found;
+        found.reserve(entries.size());
+        for (const BatchEntry& entry : entries) {
+            keys.emplace_back(entry.text, entry.range, paint, dir, entry.startHyphen,
+                              entry.endHyphen);
+            if (found.size() + 1 == keys.size() && entry.range.getLength() < LENGTH_LIMIT_CACHE) {
+                const std::shared_ptr<const LayoutPiece>* layout =
+                        local.find(keys.back(), generation, needGlyphs);
+                if (layout != nullptr) {
+                    found.push_back(layout);
+                }
+            }
+        }
+        if (found.size() == entries.size()) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                mStats.recordHit();
+                callBatch(f, i, *found[i], paint);
+            }
+            return;
+        }
+        auto remember = [&f, &entries, &keys, &local, generation](
+                                size_t index, const std::shared_ptr<const LayoutPiece>& layout,
+                                const MinikinPaint& paint) {
+            if (entries[index].range.getLength() < LENGTH_LIMIT_CACHE) {
+                local.put(keys[index], layout, generation);
+            }
+            callBatch(f, index, layout, paint);
+        };
+        getOrCreateBatchShared(entries, paint, dir, remember, needGlyphs);
+    }
+
+    // getOrCreateBatch() in the shared cache.
+    template <typename F>
+    void getOrCreateBatchShared(const std::vector<BatchEntry>& entries, const MinikinPaint& paint,
+                                bool dir, F& f, bool needGlyphs) {
+        const bool parallel = mParallelShaping.load(std::memory_order_relaxed);
+        const bool advancesOnly =
+                !needGlyphs && mAdvancesOnlyMeasurement.load(std::memory_order_relaxed);
+        if (mTable && !parallel && !advancesOnly) {
+            // Nothing to batch. The lock-free table doesn't take a lock for lookups.
+            for (size_t i = 0; i < entries.size(); ++i) {
+                getOrCreateBatchEntry(entries, i, paint, dir, f);
+            }
+            return;
+        }
+        std::vector<LayoutCacheKey> keys;
+        keys.reserve(entries.size());
+        for (const BatchEntry& entry : entries) {
+            keys.emplace_back(entry.text, entry.range, paint, dir, entry.startHyphen,
+                              entry.endHyphen);
+        }
+        if (mTable) {
+            getOrCreateBatchLockFree(entries, keys, paint, dir, f, needGlyphs, advancesOnly);
+            return;
+        }
+        // The first pass finds the misses.
+        std::vector<bool> missed(entries.size(), false);
         {
+            ShardLocker locker;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (entries[i].range.getLength() >= LENGTH_LIMIT_CACHE) {
+                    continue;
+                }
+                Shard& shard = getShard(keys[i]);
+                locker.lock(shard);
+                missed[i] = !isUsableLayout(shard.mCache.get(keys[i]), needGlyphs);
+            }
+        }
+        // Shape the misses without holding any lock.
+        std::vector<std::shared_ptr<const LayoutPiece>> created(entries.size());
+        createLayouts(entries, keys, missed, paint, dir, advancesOnly, &created);
+        // The second pass calls back in order and stores the created layouts.
+        ShardLocker locker;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const BatchEntry& entry = entries[i];
+            if (entry.range.getLength() >= LENGTH_LIMIT_CACHE) {
+                locker.unlock();
+                getOrCreateBatchEntry(entries, i, paint, dir, f);
+                continue;
+            }
+            Shard& shard = getShard(keys[i]);
+            locker.lock(shard);
+            if (!isUsableLayout(shard.mCache.get(keys[i]), needGlyphs) && !created[i]) {
+                // Evicted since the first pass, or it was a duplicate of an evicted word.
+                locker.unlock();
+                created[i] = createLayout(entry, paint, dir, advancesOnly);
+                locker.lock(shard);
+            }
+            const std::shared_ptr<const LayoutPiece>& layout = shard.mCache.get(keys[i]);
+            if (isUsableLayout(layout, needGlyphs)) {
+                if (!created[i]) {
+                    mStats.recordHit();
+                }
+                callBatch(f, i, layout, paint);
+                continue;
+            }
+            callBatch(f, i, created[i], paint);
+            keys[i].copyText();
+            shard.putLocked(keys[i], created[i]);
+        }
+    }
+
+    // getOrCreateBatch() for the lock-free table, used for the parallel shaping and the advances
+    // only measurement.
+    template <typename F>
+    void getOrCreateBatchLockFree(const std::vector<BatchEntry>& entries,
+                                  std::vector<LayoutCacheKey>& keys, const MinikinPaint& paint,
+                                  bool dir, F& f, bool needGlyphs, bool advancesOnly) {
+        std::vector<bool> missed(entries.size(), false);
+        {
+            ReadMostlyLayoutTable::ReadGuard guard(*mTable);
+            for (size_t i = 0; i < entries.size(); ++i) {
+                missed[i] = entries[i].range.getLength() < LENGTH_LIMIT_CACHE &&
+                            findUsableLayout(keys[i], needGlyphs) == nullptr;
+            }
+        }
+        std::vector<std::shared_ptr<const LayoutPiece>> created(entries.size());
+        createLayouts(entries, keys, missed, paint, dir, advancesOnly, &created);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!created[i] && entries[i].range.getLength() < LENGTH_LIMIT_CACHE) {
+                // A hit or a repeated word. The lookup is cheap without a lock.
+                ReadMostlyLayoutTable::ReadGuard guard(*mTable);
+                const std::shared_ptr<const LayoutPiece>* layout =
+                        findUsableLayout(keys[i], needGlyphs);
+                if (layout != nullptr) {
+                    mStats.recordHit();
+                    callBatch(f, i, *layout, paint);
+                    continue;
+                }
+            }
+            if (!created[i]) {
+                // A long word, or evicted since the first pass.
+                getOrCreateBatchEntry(entries, i, paint, dir, f);
+                continue;
+            }
+            callBatch(f, i, created[i], paint);
+            keys[i].copyText();
+            mTable->insert(keys[i], created[i]);
+        }
+    }
+
+    template <typename F>
+    void getOrCreateBatchEntry(const std::vector<BatchEntry>& entries, size_t index,
+                               const MinikinPaint& paint, bool dir, F& f) {
+        const BatchEntry& entry = entries[index];
+        auto callback = [&f, index](const std::shared_ptr<const LayoutPiece>& layout,
+                                    const MinikinPaint& paint) { callBatch(f, index, layout, paint); };
+        getOrCreate(entry.text, entry.range, paint, dir, entry.startHyphen, entry.endHyphen,
+                    callback);
+    }
+
+    // A partition of the cache. Each shard owns an independent LRU list and lock.
+    class Shard
+            : private android::OnEntryRemoved<LayoutCacheKey, std::shared_ptr<const LayoutPiece>> {
+    public:
+        // The entry count limit is enforced by the shard itself instead of the LruCache, so that
+        // both the entry count and the memory budget are checked in a single place.
+        Shard(uint32_t maxEntries, CacheStats& stats, const std::atomic<bool>& frequencyAdmission)
+                : mCache(android::LruCache<LayoutCacheKey, std::shared_ptr<const LayoutPiece>>::
+                                 kUnlimitedCapacity),
+                  mMemoryUsage(0),
+                  mMaxEntries(maxEntries),
+                  mMemoryBudget(0),
+                  mStats(stats),
+                  mFrequencyAdmission(frequencyAdmission) {
+            mCache.setOnEntryRemovedListener(this);
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCache.clear();
+            if (mSketch) {
+                mSketch->clear();
+            }
+        }
+
+        // Takes the ownership of the key text. If inFlight is not null, the waiters for it are
+        // woken up.
+        void put(LayoutCacheKey& key, const std::shared_ptr<const LayoutPiece>& layout,
+                 InFlight* inFlight) {
+            std::unique_lock<std::mutex> lock = acquire();
+            if (inFlight != nullptr) {
+                mInFlight.erase(key);
+                inFlight->done = true;
+                mInFlightCv.notify_all();
+            }
+            putLocked(key, layout);
+        }
+
+        void putLocked(LayoutCacheKey& key, const std::shared_ptr<const LayoutPiece>& layout)
+                EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+            if (!admitLocked(key)) {
+                key.freeText();
+                mStats.recordRejection();
+                return;
+            }
+            if (!mCache.put(key, layout)) {
+                if (!mCache.get(key)->isAdvancesOnly() || layout->isAdvancesOnly()) {
+                    // The same layout has been inserted by other thread.
+                    key.freeText();
+                    return;
+                }
+                // Replace the advances only layout with the full one.
+                mCache.remove(key);
+                mCache.put(key, layout);
+            }
+            mMemoryUsage += getEntryMemoryUsage(key, layout);
+            trimLocked(mMemoryBudget);
+        }
+
+        void setMemoryBudget(size_t bytes) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mMemoryBudget = bytes;
+            trimLocked(mMemoryBudget);
+        }
+
+        void trim(uint32_t percent) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (percent == 0) {
+                mCache.clear();
+            } else if (percent < 100) {
+                trimLocked(std::max<size_t>(1, mMemoryUsage * percent / 100));
+            }
+        }
+
+        void removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
             std::lock_guard<std::mutex> lock(mMutex);
-            mCache.put(key, layout.release());
+            removeCollectionEntries(mCache, collectionIds);
+        }
+
+        // Locks the shard on the lookup paths, recording the contention in the cache stats.
+        std::unique_lock<std::mutex> acquire() { return mStats.getLockStats().lock(mMutex); }
+
+        std::mutex mMutex;
+        android::LruCache<LayoutCacheKey, std::shared_ptr<const LayoutPiece>> mCache
+                GUARDED_BY(mMutex);
+        size_t mMemoryUsage GUARDED_BY(mMutex);
+
+        // The keys being laid out, used only when the miss de-duplication is enabled.
+        std::unordered_map<LayoutCacheKey, std::shared_ptr<InFlight>, KeyHasher> mInFlight
+                GUARDED_BY(mMutex);
+        std::condition_variable mInFlightCv;
+        // The number of the lookups waiting for the keys in mInFlight.
+        uint32_t mInFlightWaiters GUARDED_BY(mMutex) = 0;
+
+    private:
+        static size_t getEntryMemoryUsage(const LayoutCacheKey& key,
+                                          const std::shared_ptr<const LayoutPiece>& layout) {
+            return key.getMemoryUsage() + layout->getMemoryUsage();
+        }
+
+        // Returns false if the frequency admission is enabled and rejects the key, which is new
+        // to the full shard and has been rarely missed.
+        bool admitLocked(const LayoutCacheKey& key) EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+            if (!mFrequencyAdmission.load(std::memory_order_relaxed)) {
+                return true;
+            }
+            if (!mSketch) {
+                mSketch = std::make_unique<FrequencySketch>(mMaxEntries);
+            }
+            if (mSketch->increment(key.hash()) >= kAdmissionFrequency) {
+                return true;
+            }
+            const bool isFull = mCache.size() >= mMaxEntries ||
+                                (mMemoryBudget != 0 && mMemoryUsage >= mMemoryBudget);
+            // An existing entry, i.e. an advances only layout, is always replaced.
+            return !isFull || mCache.get(key) != nullptr;
+        }
+
+        // Evicts the oldest entries until both the entry count limit and the given number of bytes
+        // are satisfied. A zero byte limit means no limit.
+        void trimLocked(size_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+            while (mCache.size() > mMaxEntries || (bytes != 0 && mMemoryUsage > bytes)) {
+                if (!mCache.removeOldest()) {
+                    break;
+                }
+                mStats.recordEvictions(1);
+            }
+        }
+
+        // callback for OnEntryRemoved
+        void operator()(LayoutCacheKey& key, std::shared_ptr<const LayoutPiece>& value)
+                EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+            mMemoryUsage -= getEntryMemoryUsage(key, value);
+            key.freeText();
+            value.reset();
         }
+
+        const uint32_t mMaxEntries;
+        size_t mMemoryBudget GUARDED_BY(mMutex);
+        CacheStats& mStats;
+        const std::atomic<bool>& mFrequencyAdmission;
+        // Created on the first miss after the frequency admission is enabled.
+        std::unique_ptr<FrequencySketch> mSketch GUARDED_BY(mMutex);
+    };
+
+    // Holds the lock of one shard at a time. The lock is switched only when a different shard is
+    // requested, so consecutive words in the same shard share a single acquisition.
+    class ShardLocker {
+    public:
+        ShardLocker() : mShard(nullptr) {}
+
+        void lock(Shard& shard) {
+            if (mShard != &shard) {
+                unlock();
+                mLock = shard.acquire();
+                mShard = &shard;
+            }
+        }
+
+        void unlock() {
+            if (mShard != nullptr) {
+                mLock.unlock();
+                mShard = nullptr;
+            }
+        }
+
+    private:
+        Shard* mShard;
+        std::unique_lock<std::mutex> mLock;
+    };
+
+    Shard& getShard(const LayoutCacheKey& key) const {
+        if (mShardShift == 32) {
+            return *mShards[0];
+        }
+        // Use the upper bits of the hash so that the shard selection is independent from the
+        // bucket selection inside the LruCache, which uses the lower bits.
+        return *mShards[static_cast<uint32_t>(key.hash()) >> mShardShift];
     }
 
-    static LayoutCache& getInstance() {
-        static LayoutCache cache(kMaxEntries);
-        return cache;
+    static std::atomic<uint32_t>& startupShardCount() {
+        static std::atomic<uint32_t> shardCount(1);
+        return shardCount;
     }
 
-protected:
-    LayoutCache(uint32_t maxEntries) : mCache(maxEntries) {
-        mCache.setOnEntryRemovedListener(this);
+    // Returns true if the layouts of the paint are looked up at kScalableLayoutSize and scaled,
+    // see setScalableLayouts().
+    bool isScalable(const MinikinPaint& paint) const {
+        constexpr uint32_t kScalableFlags = LinearMetrics_Flag | Subpixel_Flag;
+        return mScalableLayouts.load(std::memory_order_relaxed) &&
+               (paint.fontFlags & (kScalableFlags | ForceAutoHinting_Flag)) == kScalableFlags &&
+               paint.size > 0 && paint.size != kScalableLayoutSize;
     }
 
-    uint32_t getCacheSize() {
-        std::lock_guard<std::mutex> lock(mMutex);
-        return mCache.size();
+    static MinikinPaint getScalablePaint(const MinikinPaint& paint) {
+        MinikinPaint scalablePaint(paint);
+        scalablePaint.size = kScalableLayoutSize;
+        return scalablePaint;
     }
 
-private:
-    // callback for OnEntryRemoved
-    void operator()(LayoutCacheKey& key, LayoutPiece*& value) {
-        key.freeText();
-        delete value;
+    // Returns true if the layouts of the paint are looked up at the letter spacing of
+    // getDeferredLetterSpacingPaint() and re-spaced, see setDeferredLetterSpacing().
+    bool isLetterSpacingDeferred(const MinikinPaint& paint) const {
+        return mDeferredLetterSpacing.load(std::memory_order_relaxed) &&
+               paint.letterSpacing != 0 &&
+               paint.letterSpacing != getDeferredLetterSpacing(paint.letterSpacing);
+    }
+
+    static float getDeferredLetterSpacing(float letterSpacing) {
+        return std::fabs(letterSpacing) > kLigatureLetterSpacingLimit
+                       ? kLetterSpacingWithoutLigatures
+                       : kLetterSpacingWithLigatures;
     }
 
-    android::LruCache<LayoutCacheKey, LayoutPiece*> mCache GUARDED_BY(mMutex);
+    static MinikinPaint getDeferredLetterSpacingPaint(const MinikinPaint& paint) {
+        MinikinPaint spacedPaint(paint);
+        spacedPaint.letterSpacing = getDeferredLetterSpacing(paint.letterSpacing);
+        return spacedPaint;
+    }
+
+    // Returns a generation never used by any instance, so that the thread local entries of one
+    // instance are never found by another.
+    static uint64_t nextGeneration() {
+        static std::atomic<uint64_t> generation(1);
+        return generation.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Called after the shared cache is modified, so that a thread which sees the new generation
+    // also sees the modification.
+    void invalidateThreadLocalCaches() {
+        mGeneration.store(nextGeneration(), std::memory_order_release);
+    }
+
+    static std::atomic<bool>& startupLockFreeReads() {
+        static std::atomic<bool> lockFreeReads(false);
+        return lockFreeReads;
+    }
+
+    static uint32_t getStartupShardCount() {
+        return startupShardCount().load(std::memory_order_relaxed);
+    }
 
     // static const size_t kMaxEntries = LruCache<LayoutCacheKey, Layout*>::kUnlimitedCapacity;
 
-    // TODO: eviction based on memory footprint; for now, we just use a constant
-    // number of strings
+    // The minimum number of misses in a batch for the parallel shaping. Handing off fewer words costs
+    // more than shaping them on the calling thread.
+    static const size_t kMinParallelShapingCount = 4;
+
+    // The default entry count limit. Use setMemoryBudget() for the eviction based on the memory
+    // footprint.
     static const size_t kMaxEntries = 5000;
 
-    std::mutex mMutex;
+    std::vector<std::unique_ptr<Shard>> mShards;
+    uint32_t mShardShift;
+    // Non-null if the cache is in the lock-free read mode. The shards are not used in that case.
+    std::unique_ptr<ReadMostlyLayoutTable> mTable;
+
+    LayoutSegmentCache mSegmentCache;
+
+    std::atomic<bool> mDeduplicateMisses;
+    std::atomic<uint64_t> mDeduplicatedMissCount;
+    std::atomic<bool> mParallelShaping;
+    std::atomic<bool> mAdvancesOnlyMeasurement;
+    std::atomic<bool> mScalableLayouts;
+    std::atomic<bool> mDeferredLetterSpacing;
+    std::atomic<bool> mThreadLocalCache;
+    std::atomic<bool> mFrequencyAdmission;
+    // The generation of the thread local entries which are valid for this instance.
+    std::atomic<uint64_t> mGeneration;
+
+    // Shared by the shards or the lock-free table.
+    CacheStats mStats;
 };
 
 inline android::hash_t hash_type(const LayoutCacheKey& key) {
@@ -17,10 +17,15 @@
 #ifndef MINIKIN_LAYOUT_CORE_H
 #define MINIKIN_LAYOUT_CORE_H
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include <gtest/gtest_prod.h>
 
+#include "minikin/Allocator.h"
+#include "minikin/ArrayView.h"
+#include "minikin/Buffer.h"
 #include "minikin/FontFamily.h"
 #include "minikin/Hyphenator.h"
 #include "minikin/MinikinExtent.h"
@@ -42,45 +47,251 @@ struct Point {
 };
 
 // Immutable, recycle-able layout result.
+//
+// All the per glyph and per code unit arrays, as well as the fonts, are packed into a single heap
+// block to keep cached layouts small and avoid fragmentation. Glyph IDs are stored in 16 bits
+// unless some glyph ID doesn't fit, and only the x coordinates of the glyphs are stored unless some
+// glyph has a vertical offset, which is rare for horizontal text.
 class LayoutPiece {
 public:
+    // Per glyph cluster information, which is only needed for splitting a layout.
+    struct ClusterInfo {
+        // The offset of the cluster each glyph belongs to, relative to the start of the range.
+        std::vector<uint32_t> clusters;
+        // The sorted offsets, relative to the start of the range, at which the text can be split
+        // and each side can be shaped independently with the same result, i.e. the starts of the
+        // clusters that HarfBuzz did not flag as unsafe to break.
+        std::vector<uint32_t> safeBreaks;
+    };
+
+    LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool isRtl,
+                const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen)
+            : LayoutPiece(textBuf, range, isRtl, paint, startHyphen, endHyphen, nullptr) {}
+
+    // Same as above, but also fills the cluster information of the result if outClusterInfo is not
+    // null.
+    LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool isRtl,
+                const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
+                ClusterInfo* outClusterInfo)
+            : LayoutPiece(textBuf, range, isRtl, paint, startHyphen, endHyphen, outClusterInfo,
+                          false /* advances only */) {}
+
+    // If advancesOnly is true, only the advances, the fonts and the extent are kept, i.e. the
+    // result has no glyphs. This is enough for measuring text and saves the memory of the glyphs.
+    // The cluster information can't be requested in that case.
     LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool isRtl,
-                const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen);
+                const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
+                ClusterInfo* outClusterInfo, bool advancesOnly);
+
+    // Extracts the layout of the sub range from the given layout. The range is relative to the
+    // start of the range of the given layout and both ends of it should be safe breaks.
+    LayoutPiece(const LayoutPiece& piece, const ClusterInfo& clusterInfo, const Range& range,
+                bool isRtl, const MinikinPaint& paint);
+
+    // Concatenates the layouts of consecutive ranges of text. The layouts must be given in logical
+    // order.
+    LayoutPiece(const std::vector<const LayoutPiece*>& pieces, bool isRtl);
+
+    // Scales the advances, the glyph positions and the extent of the given layout, e.g. to get the
+    // layout at other text size from the layout of a paint whose metrics are linear in the size.
+    // The bounds are not copied.
+    LayoutPiece(const LayoutPiece& piece, float scale);
+
+    // Re-spaces the given layout, which was laid out with shapedPaint, to the letter spacing of
+    // paint. The paints must only differ in the letter spacing, which must not change the font
+    // features, and the given layout must have hasLetterSpacings(). The bounds are not copied.
+    LayoutPiece(const LayoutPiece& piece, const MinikinPaint& shapedPaint,
+                const MinikinPaint& paint);
+
+    // Reads a layout written by writeTo. The fonts are not in the buffer, so they are given in the
+    // order of fonts() of the written layout.
+    LayoutPiece(BufferReader* reader, const std::vector<FakedFont>& fonts);
+
+    // Returns true if the reader has a layout written by writeTo() with the given number of fonts,
+    // so that the data which can't be trusted is checked before it is read. The reader should be
+    // bounded.
+    static bool isValidBuffer(BufferReader reader, uint32_t fontCount);
+
+    // Writes the glyphs, the advances and the extent, but not the fonts, which the caller writes
+    // in its own way, e.g. as indices into a font set.
+    void writeTo(BufferWriter* writer) const;
+
+    // Enables or disables recording where the letter spacing was added by the layouts shaped from
+    // now on, which is only needed for re-spacing them, see
+    // LayoutCache::setDeferredLetterSpacing(). Disabled by default.
+    static void setLetterSpacingsRecorded(bool enabled) {
+        sLetterSpacingsRecorded.store(enabled, std::memory_order_relaxed);
+    }
+
+    LayoutPiece(const LayoutPiece& o);
+    LayoutPiece& operator=(const LayoutPiece& o);
+    LayoutPiece(LayoutPiece&& o) = default;
+    LayoutPiece& operator=(LayoutPiece&& o) = default;
 
     // Low level accessors.
-    const std::vector<uint8_t>& fontIndices() const { return mFontIndices; }
-    const std::vector<uint32_t>& glyphIds() const { return mGlyphIds; }
-    const std::vector<Point>& points() const { return mPoints; }
-    const std::vector<float>& advances() const { return mAdvances; }
+    ArrayView<uint8_t> fontIndices() const {
+        return ArrayView<uint8_t>(mData.get() + fontIndicesOffset(), mGlyphCount);
+    }
+    ArrayView<float> advances() const {
+        return ArrayView<float>(reinterpret_cast<const float*>(mData.get() + advancesOffset()),
+                                mAdvanceCount);
+    }
     float advance() const { return mAdvance; }
     const MinikinExtent& extent() const { return mExtent; }
-    const std::vector<FakedFont>& fonts() const { return mFonts; }
+    ArrayView<FakedFont> fonts() const {
+        return ArrayView<FakedFont>(reinterpret_cast<const FakedFont*>(mData.get()), mFontCount);
+    }
 
     // Helper accessors
-    uint32_t glyphCount() const { return mGlyphIds.size(); }
-    const FakedFont& fontAt(int glyphPos) const { return mFonts[mFontIndices[glyphPos]]; }
-    uint32_t glyphIdAt(int glyphPos) const { return mGlyphIds[glyphPos]; }
-    const Point& pointAt(int glyphPos) const { return mPoints[glyphPos]; }
+    uint32_t glyphCount() const { return mGlyphCount; }
+    // Returns true if the glyphs were dropped at the construction. Note that a layout of empty text
+    // also has no glyphs but is not advances only.
+    bool isAdvancesOnly() const { return mAdvancesOnly; }
+    // Returns true if the layout records where the letter spacing was added, so that it can be
+    // re-spaced. This is the case for the layouts shaped with a nonzero letter spacing while
+    // setLetterSpacingsRecorded() is enabled.
+    bool hasLetterSpacings() const { return mHasLetterSpacings; }
+    const FakedFont& fontAt(int glyphPos) const { return fonts()[fontIndices()[glyphPos]]; }
+    uint32_t glyphIdAt(int glyphPos) const {
+        const uint8_t* glyphIds = mData.get() + glyphIdsOffset();
+        return mHasWideGlyphIds ? reinterpret_cast<const uint32_t*>(glyphIds)[glyphPos]
+                                : reinterpret_cast<const uint16_t*>(glyphIds)[glyphPos];
+    }
+    Point pointAt(int glyphPos) const {
+        const float* positions = reinterpret_cast<const float*>(mData.get() + positionsOffset());
+        return mHasYOffsets ? Point(positions[glyphPos * 2], positions[glyphPos * 2 + 1])
+                            : Point(positions[glyphPos], 0);
+    }
+
+    // Computes the bounding box of the glyphs. The paint must be the one used for the layout. The
+    // bounds of the glyphs are looked up in GlyphBoundsCache first.
+    MinikinRect calculateBounds(const MinikinPaint& paint) const;
+
+    // Same as calculateBounds(), but the result is computed only on the first call and attached to
+    // this layout, so that a cached layout can also answer its bounds. Safe to be called from
+    // multiple threads.
+    const MinikinRect& getOrCalculateBounds(const MinikinPaint& paint) const {
+        const MinikinRect* bounds = mBounds.get();
+        if (bounds != nullptr) {
+            return *bounds;
+        }
+        return mBounds.publish(std::make_unique<MinikinRect>(calculateBounds(paint)));
+    }
 
     uint32_t getMemoryUsage() const {
-        return sizeof(uint8_t) * mFontIndices.size() + sizeof(uint32_t) * mGlyphIds.size() +
-               sizeof(Point) * mPoints.size() + sizeof(float) * mAdvances.size() + sizeof(float) +
-               sizeof(MinikinRect) + sizeof(MinikinExtent);
+        return dataSize() + sizeof(float) + sizeof(MinikinRect) + sizeof(MinikinExtent);
     }
 
 private:
     FRIEND_TEST(LayoutTest, doLayoutWithPrecomputedPiecesTest);
 
-    std::vector<uint8_t> mFontIndices;  // per glyph
-    std::vector<uint32_t> mGlyphIds;    // per glyph
-    std::vector<Point> mPoints;         // per glyph
+    // The unpacked arrays filled by the constructors.
+    struct Builder {
+        std::vector<uint8_t> fontIndices;  // per glyph
+        std::vector<uint32_t> glyphIds;    // per glyph
+        std::vector<Point> points;         // per glyph
+        std::vector<float> advances;       // per code units
+        std::vector<FakedFont> fonts;
+        // The number of the halves of the letter spacing added before each glyph and after each
+        // code unit, only if hasLetterSpacings is true.
+        bool hasLetterSpacings = false;
+        std::vector<uint32_t> glyphSpacings;  // per glyph
+        std::vector<uint8_t> charSpacings;    // per code units
+    };
+
+    // Packs the arrays of the builder into mData.
+    void pack(const Builder& builder);
 
-    std::vector<float> mAdvances;  // per code units
+    // Lays out a run of printable ASCII characters in a font which doesn't need shaping for them,
+    // using the nominal glyphs and their advances. Returns false without touching anything if the
+    // font needs shaping or lacks some of the characters.
+    bool layoutSimpleAscii(const U16StringPiece& text, const FakedFont& fakedFont,
+                           const MinikinPaint& paint, bool advancesOnly,
+                           ClusterInfo* outClusterInfo, Builder* b);
+
+    // The offsets in mData. The arrays are sorted by the alignment requirement.
+    size_t advancesOffset() const { return sizeof(FakedFont) * mFontCount; }
+    size_t positionsOffset() const { return advancesOffset() + sizeof(float) * mAdvanceCount; }
+    size_t glyphSpacingsOffset() const {
+        return positionsOffset() + (mHasYOffsets ? sizeof(Point) : sizeof(float)) * mGlyphCount;
+    }
+    size_t glyphIdsOffset() const {
+        return glyphSpacingsOffset() + (mHasLetterSpacings ? sizeof(uint32_t) * mGlyphCount : 0);
+    }
+    size_t fontIndicesOffset() const {
+        return glyphIdsOffset() +
+               (mHasWideGlyphIds ? sizeof(uint32_t) : sizeof(uint16_t)) * mGlyphCount;
+    }
+    size_t charSpacingsOffset() const {
+        return fontIndicesOffset() + sizeof(uint8_t) * mGlyphCount;
+    }
+    size_t dataSize() const {
+        return charSpacingsOffset() + (mHasLetterSpacings ? sizeof(uint8_t) * mAdvanceCount : 0);
+    }
+
+    const uint32_t* glyphSpacings() const {
+        return reinterpret_cast<const uint32_t*>(mData.get() + glyphSpacingsOffset());
+    }
+    const uint8_t* charSpacings() const { return mData.get() + charSpacingsOffset(); }
+
+    // The fonts, the advances, the glyph positions, the glyph spacings, the glyph IDs, the font
+    // indices and the char spacings in this order. The glyph positions are Points if mHasYOffsets
+    // is true, otherwise x coordinates. The spacings are only there if mHasLetterSpacings is true.
+    AllocatedBytes mData;
+    uint32_t mGlyphCount;
+    uint32_t mAdvanceCount;
+    uint16_t mFontCount;
+    bool mHasWideGlyphIds;
+    bool mHasYOffsets;
+    bool mAdvancesOnly;
+    bool mHasLetterSpacings;
+
+    static std::atomic<bool> sLetterSpacingsRecorded;
 
     float mAdvance;
     MinikinExtent mExtent;
 
-    std::vector<FakedFont> mFonts;
+    // The bounding box attached on demand. Copying a layout copies the bounds if already computed.
+    class LazyBounds {
+    public:
+        LazyBounds() : mRect(nullptr) {}
+        LazyBounds(const LazyBounds& o) : mRect(o.copy()) {}
+        LazyBounds& operator=(const LazyBounds& o) {
+            if (this != &o) {
+                delete mRect.exchange(o.copy());
+            }
+            return *this;
+        }
+        LazyBounds(LazyBounds&& o) : mRect(o.mRect.exchange(nullptr)) {}
+        LazyBounds& operator=(LazyBounds&& o) {
+            if (this != &o) {
+                delete mRect.exchange(o.mRect.exchange(nullptr));
+            }
+            return *this;
+        }
+        ~LazyBounds() { delete mRect.load(); }
+
+        const MinikinRect* get() const { return mRect.load(std::memory_order_acquire); }
+
+        // Attaches the rect unless other thread has attached one first. Returns the attached one.
+        const MinikinRect& publish(std::unique_ptr<MinikinRect>&& rect) const {
+            MinikinRect* expected = nullptr;
+            if (mRect.compare_exchange_strong(expected, rect.get(), std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+                return *rect.release();
+            }
+            return *expected;
+        }
+
+    private:
+        MinikinRect* copy() const {
+            const MinikinRect* rect = get();
+            return rect == nullptr ? nullptr : new MinikinRect(*rect);
+        }
+
+        mutable std::atomic<MinikinRect*> mRect;
+    };
+    LazyBounds mBounds;
 };
 
 // For gtest output
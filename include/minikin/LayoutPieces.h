@@ -17,8 +17,13 @@
 #ifndef MINIKIN_LAYOUT_PIECES_H
 #define MINIKIN_LAYOUT_PIECES_H
 
+#include <memory>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "minikin/CacheStats.h"
 #include "minikin/LayoutCache.h"
 #include "minikin/LayoutCore.h"
 #include "minikin/MinikinPaint.h"
@@ -70,20 +75,39 @@ struct LayoutPieces {
 
     uint32_t nextPaintId;
     std::unordered_map<MinikinPaint, uint32_t, PaintHasher> paintMap;
-    std::unordered_map<Key, LayoutPiece, KeyHasher> offsetMap;
+    // The pieces are immutable and shared with the LayoutCache, so a word repeated in the text or
+    // still in the cache is stored only once.
+    std::unordered_map<Key, std::shared_ptr<const LayoutPiece>, KeyHasher> offsetMap;
 
-    void insert(const Range& range, HyphenEdit edit, const LayoutPiece& layout, bool dir,
+    void insert(const Range& range, HyphenEdit edit,
+                const std::shared_ptr<const LayoutPiece>& layout, bool dir,
                 const MinikinPaint& paint) {
-        uint32_t paintId = findPaintId(paint);
-        if (paintId == kNoPaintId) {
-            paintId = nextPaintId++;
-            paintMap.insert(std::make_pair(paint, paintId));
-        }
+        insert(range, edit, layout, dir, addPaint(paint));
+    }
+
+    // Same as above with the ID returned by addPaint(), so that the pieces of a run don't hash
+    // and compare its paint again.
+    void insert(const Range& range, HyphenEdit edit,
+                const std::shared_ptr<const LayoutPiece>& layout, bool dir, uint32_t paintId) {
         offsetMap.emplace(std::piecewise_construct,
                           std::forward_as_tuple(range, edit, dir, paintId),
                           std::forward_as_tuple(layout));
     }
 
+    // Adds the pieces of other, e.g. the ones measured on another thread, renumbering its paints.
+    // The pieces already in this object are kept.
+    void merge(const LayoutPieces& other) {
+        std::vector<uint32_t> paintIds(other.nextPaintId, kNoPaintId);
+        for (const auto& [paint, paintId] : other.paintMap) {
+            paintIds[paintId] = addPaint(paint);
+        }
+        for (const auto& [key, piece] : other.offsetMap) {
+            Key mergedKey = key;
+            mergedKey.paintId = paintIds[key.paintId];
+            offsetMap.emplace(mergedKey, piece);
+        }
+    }
+
     template <typename F>
     void getOrCreate(const U16StringPiece& textBuf, const Range& range, const Range& context,
                      const MinikinPaint& paint, bool dir, StartHyphenEdit startEdit,
@@ -91,11 +115,19 @@ struct LayoutPieces {
         const HyphenEdit edit = packHyphenEdit(startEdit, endEdit);
         auto it = offsetMap.find(Key(range, edit, dir, paintId));
         if (it == offsetMap.end()) {
+            getStats().recordMiss();
             LayoutCache::getInstance().getOrCreate(textBuf.substr(context),
                                                    range - context.getStart(), paint, dir,
                                                    startEdit, endEdit, f);
         } else {
-            f(it->second, paint);
+            getStats().recordHit();
+            // Same as LayoutCache, the callback may take the shared piece or a reference to it.
+            if constexpr (std::is_invocable_v<F&, const std::shared_ptr<const LayoutPiece>&,
+                                              const MinikinPaint&>) {
+                f(it->second, paint);
+            } else {
+                f(*it->second, paint);
+            }
         }
     }
 
@@ -104,10 +136,31 @@ struct LayoutPieces {
         return paintIt == paintMap.end() ? kNoPaintId : paintIt->second;
     }
 
+    // Returns the ID of the paint, assigning a new one if the paint is not known yet.
+    uint32_t addPaint(const MinikinPaint& paint) {
+        uint32_t paintId = findPaintId(paint);
+        if (paintId == kNoPaintId) {
+            paintId = nextPaintId++;
+            paintMap.insert(std::make_pair(paint, paintId));
+        }
+        return paintId;
+    }
+
+    // The lookups of all instances are accumulated to the single stats.
+    static CacheStats& getStats() {
+        static CacheStats stats;
+        return stats;
+    }
+
+    // Each shared piece is counted once, no matter how many keys refer to it.
     uint32_t getMemoryUsage() const {
         uint32_t result = 0;
+        std::unordered_set<const LayoutPiece*> counted;
         for (const auto& i : offsetMap) {
-            result += i.first.getMemoryUsage() + i.second.getMemoryUsage();
+            result += i.first.getMemoryUsage() + sizeof(std::shared_ptr<const LayoutPiece>);
+            if (counted.insert(i.second.get()).second) {
+                result += i.second->getMemoryUsage();
+            }
         }
         result += (sizeof(MinikinPaint) + sizeof(uint32_t)) * paintMap.size();
         return result;
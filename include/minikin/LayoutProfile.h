@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_LAYOUT_PROFILE_H
+#define MINIKIN_LAYOUT_PROFILE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "minikin/Buffer.h"
+#include "minikin/FontCollection.h"
+#include "minikin/LayoutCache.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinPaint.h"
+
+namespace minikin {
+
+// A recorder of the words looked up in LayoutCache and BoundsCache, for warming up the caches at
+// the next startup. An app shaping the same UI strings on every launch records them once, writes
+// the most frequent ones to a profile with writeTo(), and replays the profile with warmUp() on a
+// background thread before the first frame.
+//
+// The font collections are process specific, so the profile refers to them by the indices the
+// caller maps them to when writing, and the caller resolves the indices back when replaying. The
+// locales are stored as strings.
+class LayoutProfile {
+public:
+    static LayoutProfile& getInstance() {
+        static LayoutProfile profile;
+        return profile;
+    }
+
+    // Starts or stops recording. The recorded words are kept until clear(). Recording is disabled
+    // by default.
+    void setRecording(bool enabled) { mRecording.store(enabled, std::memory_order_relaxed); }
+    bool isRecording() const { return mRecording.load(std::memory_order_relaxed); }
+
+    // Counts a lookup of a word. needBounds tells whether the bounds were looked up, i.e. whether
+    // the replay also needs to populate BoundsCache. This is a single load while not recording.
+    void record(const U16StringPiece& text, const Range& range, const MinikinPaint& paint,
+                bool dir, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, bool needBounds) {
+        if (isRecording()) {
+            recordInternal(text, range, paint, dir, startHyphen, endHyphen, needBounds);
+        }
+    }
+
+    // Returns the index the collection is known by at the replay, or -1 to leave out the words of
+    // the collection.
+    using CollectionIndexFunc = std::function<int32_t(const FontCollection& collection)>;
+
+    // Writes the maxEntries most frequently recorded words, the most frequent first.
+    void writeTo(BufferWriter* writer, uint32_t maxEntries, const CollectionIndexFunc& indexOf);
+
+    // Returns the collection written with the index, or nullptr to skip the words of it.
+    using CollectionResolver = std::function<std::shared_ptr<FontCollection>(uint32_t index)>;
+
+    // Lays out the words of a profile written by writeTo(), which populates LayoutCache and, for
+    // the words whose bounds were looked up, BoundsCache. The words are laid out in the order of
+    // the profile and the call blocks until all of them are done, so call this on a background
+    // thread. Returns the number of the words laid out. A profile written by a different version
+    // of the format is ignored. The reader should be bounded by the size of the profile, in which
+    // case the words past a truncated end are not read. The words whose ranges are out of their
+    // text are skipped.
+    static uint32_t warmUp(BufferReader* reader, const CollectionResolver& resolve);
+
+    void clear();
+    uint32_t size();
+
+    // The number of distinct words to record. The words first seen after this many are ignored.
+    static constexpr uint32_t kMaxRecordedWords = 4096;
+
+protected:
+    LayoutProfile() : mRecording(false) {}
+
+private:
+    struct Record {
+        std::vector<uint16_t> text;
+        Range range;
+        // Keeps the font collection alive while the word is recorded.
+        MinikinPaint paint;
+        bool isRtl;
+        StartHyphenEdit startHyphen;
+        EndHyphenEdit endHyphen;
+        bool needBounds;
+        uint32_t count;
+    };
+
+    struct KeyHasher {
+        size_t operator()(const LayoutCacheKey& key) const { return key.hash(); }
+    };
+
+    void recordInternal(const U16StringPiece& text, const Range& range, const MinikinPaint& paint,
+                        bool dir, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
+                        bool needBounds);
+
+    std::atomic<bool> mRecording;
+    std::mutex mMutex;
+    // The keys refer to the text of their records.
+    std::unordered_map<LayoutCacheKey, Record, KeyHasher> mRecords GUARDED_BY(mMutex);
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(LayoutProfile);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_LAYOUT_PROFILE_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_LINE_BREAK_RESULT_CACHE_H
+#define MINIKIN_LINE_BREAK_RESULT_CACHE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "minikin/LineBreaker.h"
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// The arguments of a line breaking other than the text, which determine its result for a measured
+// text. The widths are the ones of android::AndroidLineWidth and the tab stops are copied.
+struct LineBreakParams {
+    BreakStrategy strategy;
+    HyphenationFrequency frequency;
+    bool justified;
+    float firstWidth;
+    int32_t firstWidthLineCount;
+    float restWidth;
+    std::vector<float> indents;
+    int32_t indentsOffset;
+    std::vector<float> tabStops;
+    float defaultTabStopWidth;
+
+    bool operator==(const LineBreakParams& o) const {
+        return strategy == o.strategy && frequency == o.frequency && justified == o.justified &&
+               firstWidth == o.firstWidth && firstWidthLineCount == o.firstWidthLineCount &&
+               restWidth == o.restWidth && indentsOffset == o.indentsOffset &&
+               defaultTabStopWidth == o.defaultTabStopWidth && indents == o.indents &&
+               tabStops == o.tabStops;
+    }
+};
+
+// The last few line breaking results of a measured text, see
+// MeasuredText::setLineBreakResultCachingEnabled. A measure pass of a view usually breaks the same
+// text at the same width two or three times, and all of them share the first result. Thread safe.
+class LineBreakResultCache {
+public:
+    LineBreakResultCache() {}
+
+    // Returns the result of the params, or nullptr if not cached.
+    std::shared_ptr<const LineBreakResult> get(const LineBreakParams& params);
+
+    // Keeps the result of the params, dropping the least recently used one if full.
+    void put(LineBreakParams&& params, const std::shared_ptr<const LineBreakResult>& result);
+
+    // Returns the bytes of the kept params and results.
+    uint32_t getMemoryUsage();
+
+    // The results kept per text. A text is usually laid out at one or two widths.
+    static constexpr size_t kMaxEntries = 4;
+
+private:
+    std::mutex mMutex;
+    // The most recently used first.
+    std::deque<std::pair<LineBreakParams, std::shared_ptr<const LineBreakResult>>> mEntries
+            GUARDED_BY(mMutex);
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(LineBreakResultCache);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_LINE_BREAK_RESULT_CACHE_H
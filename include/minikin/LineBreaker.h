@@ -22,13 +22,17 @@
 #ifndef MINIKIN_LINE_BREAKER_H
 #define MINIKIN_LINE_BREAKER_H
 
+#include <algorithm>
 #include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "minikin/FontCollection.h"
 #include "minikin/Layout.h"
 #include "minikin/Macros.h"
 #include "minikin/MeasuredText.h"
+#include "minikin/MinikinExtent.h"
 #include "minikin/MinikinFont.h"
 #include "minikin/Range.h"
 #include "minikin/U16StringPiece.h"
@@ -48,18 +52,32 @@ enum class HyphenationFrequency : uint8_t {
 };
 
 class Hyphenator;
+class OptimalBreakScratch;
 class WordBreaker;
 
 class TabStops {
 public:
     // Caller must free stops. stops can be nullprt.
     TabStops(const float* stops, size_t nStops, float tabWidth)
-            : mStops(stops), mStopsSize(nStops), mTabWidth(tabWidth) {}
+            : mStops(stops),
+              mStopsSize(nStops),
+              mTabWidth(tabWidth),
+              mSorted(std::is_sorted(stops, stops + nStops)) {}
 
     float nextTab(float widthSoFar) const {
-        for (size_t i = 0; i < mStopsSize; i++) {
-            if (mStops[i] > widthSoFar) {
-                return mStops[i];
+        if (mSorted) {
+            // The stops are usually in increasing order, then the first one after widthSoFar is
+            // binary searched instead of visiting all the stops before it for each tab.
+            const float* end = mStops + mStopsSize;
+            const float* stop = std::upper_bound(mStops, end, widthSoFar);
+            if (stop != end) {
+                return *stop;
+            }
+        } else {
+            for (size_t i = 0; i < mStopsSize; i++) {
+                if (mStops[i] > widthSoFar) {
+                    return mStops[i];
+                }
             }
         }
         if (mTabWidth == 0) {
@@ -68,10 +86,17 @@ public:
         return floor(widthSoFar / mTabWidth + 1) * mTabWidth;
     }
 
+    const float* getStops() const { return mStops; }
+    size_t getStopCount() const { return mStopsSize; }
+    float getTabWidth() const { return mTabWidth; }
+
 private:
     const float* mStops;
     size_t mStopsSize;
     float mTabWidth;
+    // True if the stops are in non-decreasing order, checked once since nextTab is called for
+    // every tab character.
+    bool mSorted;
 };
 
 // Implement this for the additional information during line breaking.
@@ -92,7 +117,8 @@ struct LineBreakResult {
 public:
     LineBreakResult() = default;
 
-    // Following five vectors have the same length.
+    // Following five vectors have the same length, except for ascents and descents which are
+    // empty if the extents are deferred, see MeasuredText::setDeferredLineExtentsEnabled.
     // TODO: Introduce individual line info struct if copy cost in JNI is negligible.
     std::vector<int> breakPoints;
     std::vector<float> widths;
@@ -103,6 +129,39 @@ public:
     LineBreakResult(LineBreakResult&&) = default;
     LineBreakResult& operator=(LineBreakResult&&) = default;
 
+    // Returns true if the line breaker left the extents to getLineExtent.
+    bool hasDeferredExtents() const { return mDeferredExtents != nullptr; }
+
+    // Returns the extent of the line. If the extents are deferred, the extent is computed from the
+    // measured text on the first call for the line and kept for the next ones. Thread safe.
+    MinikinExtent getLineExtent(size_t lineNo, const U16StringPiece& textBuf,
+                                const MeasuredText& measured) const;
+
+    // Leaves the extents of the lines to getLineExtent. Called by the line breakers once
+    // breakPoints is final.
+    void deferExtents();
+
+    // Returns the bytes of the lines, including the deferred extents.
+    uint32_t getMemoryUsage() const {
+        uint32_t usage = sizeof(int) * (breakPoints.size() + flags.size()) +
+                         sizeof(float) * (widths.size() + ascents.size() + descents.size());
+        if (mDeferredExtents) {
+            usage += sizeof(DeferredExtents) +
+                     (sizeof(std::once_flag) + sizeof(MinikinExtent)) * breakPoints.size();
+        }
+        return usage;
+    }
+
+    // Removes all the lines, keeping the capacity of the vectors for the next line breaking.
+    void clear() {
+        breakPoints.clear();
+        widths.clear();
+        ascents.clear();
+        descents.clear();
+        flags.clear();
+        mDeferredExtents.reset();
+    }
+
     void reverse() {
         std::reverse(breakPoints.begin(), breakPoints.end());
         std::reverse(widths.begin(), widths.end());
@@ -112,6 +171,13 @@ public:
     }
 
 private:
+    struct DeferredExtents {
+        std::unique_ptr<std::once_flag[]> computed;
+        std::unique_ptr<MinikinExtent[]> extents;
+    };
+    // Kept behind a pointer so that the result stays movable.
+    std::unique_ptr<DeferredExtents> mDeferredExtents;
+
     MINIKIN_PREVENT_COPY_AND_ASSIGN(LineBreakResult);
 };
 
@@ -120,6 +186,97 @@ LineBreakResult breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy s
                                const MeasuredText& measuredText, const LineWidth& lineWidth,
                                const TabStops& tabStops);
 
+// Same as above, but only returns the first maxLines lines, e.g. for an ellipsized text. The
+// greedy line breaking stops after them, and the optimal one skips the extents of the other lines.
+LineBreakResult breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                               HyphenationFrequency frequency, bool justified,
+                               const MeasuredText& measuredText, const LineWidth& lineWidth,
+                               const TabStops& tabStops, uint32_t maxLines);
+
+// The scratch memory of the line breakers, e.g. the break candidates of the optimal line breaking.
+// Breaking with the same scratch reuses the capacity it grew to in the previous calls, so that
+// breaking many short paragraphs in a row doesn't allocate it for each of them. Not thread safe,
+// use one per thread.
+class LineBreakScratch {
+public:
+    LineBreakScratch();
+    ~LineBreakScratch();
+
+    // Used by the line breakers.
+    OptimalBreakScratch* optimal() { return mOptimal.get(); }
+
+private:
+    std::unique_ptr<OptimalBreakScratch> mOptimal;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(LineBreakScratch);
+};
+
+// Same as above, but writes the lines to result, whose previous lines are removed and whose
+// vectors keep their capacity, and keeps the state of the line breaking in scratch.
+void breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                    HyphenationFrequency frequency, bool justified,
+                    const MeasuredText& measuredText, const LineWidth& lineWidth,
+                    const TabStops& tabStops, uint32_t maxLines, LineBreakScratch* scratch,
+                    LineBreakResult* result);
+
+// Same as above for textBuffer, the text of prev after the edit, where prev is the full result of
+// the text before the edit broken with the same arguments. With BreakStrategy::Greedy, only the
+// lines around the edit are broken again and the others are taken from prev. The other strategies
+// break the whole text again.
+LineBreakResult breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                               HyphenationFrequency frequency, bool justified,
+                               const MeasuredText& measuredText, const LineWidth& lineWidth,
+                               const TabStops& tabStops, const LineBreakResult& prev,
+                               const TextEdit& edit);
+
+// Returns the number of lines of breakIntoLines, without computing the widths and the extents of
+// the lines.
+uint32_t countLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                    HyphenationFrequency frequency, bool justified,
+                    const MeasuredText& measuredText, const LineWidth& lineWidth,
+                    const TabStops& tabStops);
+
+// Breaks the text into lines at each of the line widths, e.g. to find the text size or the width
+// needed for some number of lines. Same as breakIntoLines at each width, but the word breaking and
+// the hyphenation are shared by all the widths when breaking with BreakStrategy::HighQuality or
+// BreakStrategy::Balanced.
+std::vector<LineBreakResult> breakIntoLines(const U16StringPiece& textBuffer,
+                                            BreakStrategy strategy, HyphenationFrequency frequency,
+                                            bool justified, const MeasuredText& measuredText,
+                                            const std::vector<const LineWidth*>& lineWidths,
+                                            const TabStops& tabStops);
+
+// Returns the number of lines of each result of the above, without computing the widths and the
+// extents of the lines.
+std::vector<uint32_t> countLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                                 HyphenationFrequency frequency, bool justified,
+                                 const MeasuredText& measuredText,
+                                 const std::vector<const LineWidth*>& lineWidths,
+                                 const TabStops& tabStops);
+
+// A paragraph for breakParagraphsIntoLines, with the same arguments as breakIntoLines. The
+// pointed objects must outlive the call.
+struct ParagraphBreakRequest {
+    U16StringPiece textBuffer;
+    BreakStrategy strategy;
+    HyphenationFrequency frequency;
+    bool justified;
+    const MeasuredText* measuredText;
+    const LineWidth* lineWidth;
+    const TabStops* tabStops;
+};
+
+// Breaks each of the paragraphs into lines, like breakIntoLines, on the threads of the worker pool
+// together with the calling thread. The results are in the order of the requests.
+//
+// The line breaking itself only reads the measured text, the line width and the tab stops, so the
+// paragraphs may share them as long as LineWidth::getAt and getMin are thread safe. The rest of
+// the state is safe to share between the threads: the word breakers and the ICU breakers in use
+// are owned by the thread, the ICU breaker pool, the hyphenator map and the layout cache are
+// guarded by their locks, and the state cached in a MeasuredText is published atomically.
+std::vector<LineBreakResult> breakParagraphsIntoLines(
+        const std::vector<ParagraphBreakRequest>& requests);
+
 }  // namespace minikin
 
 #endif  // MINIKIN_LINE_BREAKER_H
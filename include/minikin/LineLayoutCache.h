@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_LINE_LAYOUT_CACHE_H
+#define MINIKIN_LINE_LAYOUT_CACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include <utils/LruCache.h>
+
+#include "minikin/CacheStats.h"
+#include "minikin/Hasher.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinPaint.h"
+
+namespace minikin {
+
+// The key of the layout of a whole line. The bidi flags are kept as given instead of the direction
+// only, since the default ones resolve the paragraph direction from the text.
+class LineLayoutCacheKey {
+public:
+    LineLayoutCacheKey(const U16StringPiece& text, const Range& range, Bidi bidiFlags,
+                       const MinikinPaint& paint, StartHyphenEdit startHyphen,
+                       EndHyphenEdit endHyphen)
+            : mKey(text, range, paint, isRtl(bidiFlags), startHyphen, endHyphen),
+              mBidiFlags(bidiFlags),
+              mHash(Hasher()
+                            .update(static_cast<uint32_t>(mKey.hash()))
+                            .update(static_cast<uint32_t>(bidiFlags))
+                            .hash()) {}
+
+    bool operator==(const LineLayoutCacheKey& o) const {
+        return mBidiFlags == o.mBidiFlags && mKey == o.mKey;
+    }
+
+    android::hash_t hash() const { return mHash; }
+
+    void copyText() { mKey.copyText(); }
+    void freeText() { mKey.freeText(); }
+
+    uint32_t getCollectionId() const { return mKey.getCollectionId(); }
+
+    uint32_t getMemoryUsage() const {
+        return sizeof(LineLayoutCacheKey) - sizeof(LayoutCacheKey) + mKey.getMemoryUsage();
+    }
+
+private:
+    LayoutCacheKey mKey;
+    Bidi mBidiFlags;
+    android::hash_t mHash;
+};
+
+inline android::hash_t hash_type(const LineLayoutCacheKey& key) {
+    return key.hash();
+}
+
+// A second level cache of the layouts of whole lines, for the text drawn again and again without
+// changes, e.g. the labels of a list while scrolling. A hit costs a single lookup instead of the
+// bidi analysis and a LayoutCache lookup per word. The layouts share the pieces of LayoutCache, so
+// a cached line costs little more than its key.
+//
+// The cache has its own memory budget and is disabled until a non-zero budget is set.
+class LineLayoutCache
+        : private android::OnEntryRemoved<LineLayoutCacheKey, std::shared_ptr<const Layout>> {
+public:
+    // Returns the same layout as Layout(text, range, bidiFlags, paint, startHyphen, endHyphen,
+    // true /* share pieces */). The layout is created every time while the cache is disabled.
+    std::shared_ptr<const Layout> getOrCreate(const U16StringPiece& text, const Range& range,
+                                              Bidi bidiFlags, const MinikinPaint& paint,
+                                              StartHyphenEdit startHyphen, EndHyphenEdit endHyphen);
+
+    bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    // Enables the cache with the given budget in bytes. Passing 0 disables and clears the cache.
+    void setMemoryBudget(size_t bytes);
+
+    void clear();
+    void trim(uint32_t percent);
+    // Same as LayoutCache::removeCollections().
+    void removeCollections(const std::unordered_set<uint32_t>& collectionIds);
+    uint32_t size();
+    size_t getMemoryUsage();
+    const CacheStats& getStats() const { return mStats; }
+
+    static LineLayoutCache& getInstance() {
+        static LineLayoutCache cache;
+        return cache;
+    }
+
+    // The texts longer than this are not cached, since each line of such a text would keep its own
+    // copy of the whole text, which the bidi analysis depends on.
+    static constexpr uint32_t kMaxTextLength = 1024;
+
+protected:
+    LineLayoutCache();
+    ~LineLayoutCache();
+
+private:
+    void trimLocked(size_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    // callback for OnEntryRemoved
+    void operator()(LineLayoutCacheKey& key, std::shared_ptr<const Layout>& value);
+
+    std::atomic<bool> mEnabled;
+    std::mutex mMutex;
+    android::LruCache<LineLayoutCacheKey, std::shared_ptr<const Layout>> mCache GUARDED_BY(mMutex);
+    size_t mMemoryBudget GUARDED_BY(mMutex);
+    size_t mMemoryUsage GUARDED_BY(mMutex);
+    CacheStats mStats;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(LineLayoutCache);
+};
+
+}  // namespace minikin
+#endif  // MINIKIN_LINE_LAYOUT_CACHE_H
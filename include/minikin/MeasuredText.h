@@ -18,24 +18,42 @@
 #define MINIKIN_MEASURED_TEXT_H
 
 #include <deque>
+#include <memory>
+#include <utility>
 #include <vector>
 
+#include "minikin/Buffer.h"
 #include "minikin/FontCollection.h"
 #include "minikin/Layout.h"
 #include "minikin/LayoutPieces.h"
 #include "minikin/LineBreakStyle.h"
 #include "minikin/Macros.h"
 #include "minikin/MinikinFont.h"
+#include "minikin/PublishedPtr.h"
 #include "minikin/Range.h"
+#include "minikin/TextScan.h"
 #include "minikin/U16StringPiece.h"
+#include "minikin/WordBreakRecord.h"
 
 namespace minikin {
 
+class LineBreakResultCache;
+class OptimalBreakCandidates;
+
 class Run {
 public:
+    // The kinds of runs MeasuredText::writeTo can write. It can't write the custom runs.
+    enum class Type : uint8_t {
+        Custom = 0,
+        Style = 1,
+        Replacement = 2,
+    };
+
     Run(const Range& range) : mRange(range) {}
     virtual ~Run() {}
 
+    virtual Type getType() const { return Type::Custom; }
+
     // Returns true if this run is RTL. Otherwise returns false.
     virtual bool isRtl() const = 0;
 
@@ -55,6 +73,18 @@ public:
     virtual void getMetrics(const U16StringPiece& text, std::vector<float>* advances,
                             LayoutPieces* precomputed, LayoutPieces* outPieces) const = 0;
 
+    // Fills the advances of the characters in the given range of this run, which starts and ends
+    // at word boundaries or at the run boundaries. Used for re-measuring the edited words of a
+    // text. The default implementation fills the whole run.
+    virtual void getMetricsForRange(const U16StringPiece& text, const Range& /* range */,
+                                    std::vector<float>* advances, LayoutPieces* outPieces) const {
+        getMetrics(text, advances, nullptr /* precomputed */, outPieces);
+    }
+
+    // Returns true if getMetricsForRange only fills the given range, so that the ranges of this
+    // run can be measured separately, e.g. on several threads.
+    virtual bool canMeasureRangesSeparately() const { return false; }
+
     virtual std::pair<float, MinikinRect> getBounds(const U16StringPiece& text, const Range& range,
                                                     const LayoutPieces& pieces) const = 0;
     virtual MinikinExtent getExtent(const U16StringPiece& text, const Range& range,
@@ -87,10 +117,11 @@ public:
     inline const Range& getRange() const { return mRange; }
 
 protected:
-    const Range mRange;
+    // Not const, so that MeasuredTextBuilder can reuse the runs of recycled texts.
+    Range mRange;
 };
 
-class StyleRun : public Run {
+class StyleRun final : public Run {
 public:
     StyleRun(const Range& range, MinikinPaint&& paint, int lineBreakStyle, int lineBreakWordStyle,
              bool isRtl)
@@ -100,6 +131,7 @@ public:
               mLineBreakWordStyle(lineBreakWordStyle),
               mIsRtl(isRtl) {}
 
+    Type getType() const override { return Type::Style; }
     bool canBreak() const override { return true; }
     LineBreakStyle lineBreakStyle() const override {
         return static_cast<LineBreakStyle>(mLineBreakStyle);
@@ -113,6 +145,10 @@ public:
     void getMetrics(const U16StringPiece& text, std::vector<float>* advances,
                     LayoutPieces* precomputed, LayoutPieces* outPieces) const override;
 
+    void getMetricsForRange(const U16StringPiece& text, const Range& range,
+                            std::vector<float>* advances, LayoutPieces* outPieces) const override;
+    bool canMeasureRangesSeparately() const override { return true; }
+
     std::pair<float, MinikinRect> getBounds(const U16StringPiece& text, const Range& range,
                                             const LayoutPieces& pieces) const override;
 
@@ -131,11 +167,33 @@ public:
                              LayoutPieces* pieces) const override;
     float measureText(const U16StringPiece& text) const;
 
+    // Same as getMetrics without the precomputed pieces for an LTR run, but looks up the layouts
+    // of the words with LayoutCache::getOrCreateBatch, a batch of words at a time, see
+    // MeasuredText::setSingleRunFastPathEnabled.
+    void getMetricsBatched(const U16StringPiece& text, std::vector<float>* advances,
+                           LayoutPieces* outPieces) const;
+
 private:
+    friend class MeasuredTextBuilder;
+
+    // Makes this run the run of the given values. The paint is only assigned if it differs, so
+    // that reusing a run for the same style doesn't copy the font feature settings again.
+    template <typename Paint>
+    void reset(const Range& range, Paint&& paint, int lineBreakStyle, int lineBreakWordStyle,
+               bool isRtl) {
+        mRange = range;
+        if (!(mPaint == paint)) {
+            mPaint = std::forward<Paint>(paint);
+        }
+        mLineBreakStyle = lineBreakStyle;
+        mLineBreakWordStyle = lineBreakWordStyle;
+        mIsRtl = isRtl;
+    }
+
     MinikinPaint mPaint;
     int mLineBreakStyle;
     int mLineBreakWordStyle;
-    const bool mIsRtl;
+    bool mIsRtl;
 };
 
 class ReplacementRun : public Run {
@@ -143,6 +201,8 @@ public:
     ReplacementRun(const Range& range, float width, uint32_t localeListId)
             : Run(range), mWidth(width), mLocaleListId(localeListId) {}
 
+    Type getType() const override { return Type::Replacement; }
+    float getWidth() const { return mWidth; }
     bool isRtl() const { return false; }
     bool canBreak() const { return false; }
     LineBreakStyle lineBreakStyle() const override { return LineBreakStyle::None; }
@@ -198,32 +258,220 @@ struct HyphenBreak {
             : offset(offset), type(type), first(first), second(second) {}
 };
 
+// Represents a replacement of a range of a text with another text.
+struct TextEdit {
+    // The offset of the edit, same in the text before and after the edit.
+    uint32_t offset;
+
+    // The length of the replaced text in the text before the edit.
+    uint32_t removedLength;
+
+    // The length of the replacing text in the text after the edit.
+    uint32_t insertedLength;
+
+    TextEdit(uint32_t offset, uint32_t removedLength, uint32_t insertedLength)
+            : offset(offset), removedLength(removedLength), insertedLength(insertedLength) {}
+
+    // Returns the change of the text length.
+    int32_t delta() const {
+        return static_cast<int32_t>(insertedLength) - static_cast<int32_t>(removedLength);
+    }
+};
+
+// A lossless compact copy of the character widths. Most widths are zero, e.g. for the trailing
+// surrogates and the cluster continuations, or repeat a few values, so each character keeps an
+// index into a palette of the distinct widths. The widths which don't fit in the palette are kept
+// aside and binary searched.
+class CompactWidths {
+public:
+    // Returns false and leaves this empty if the widths have too many distinct values for the
+    // compact copy to be smaller.
+    bool build(const std::vector<float>& widths);
+
+    float get(uint32_t offset) const {
+        const uint8_t index = mIndices[offset];
+        return index != kEscape ? mPalette[index] : getEscaped(offset);
+    }
+
+    size_t size() const { return mIndices.size(); }
+
+    uint32_t getMemoryUsage() const {
+        return sizeof(float) * mPalette.size() + sizeof(uint8_t) * mIndices.size() +
+               sizeof(std::pair<uint32_t, float>) * mEscaped.size();
+    }
+
+private:
+    static constexpr uint8_t kEscape = 0xFF;
+
+    float getEscaped(uint32_t offset) const;
+
+    std::vector<float> mPalette;
+    std::vector<uint8_t> mIndices;
+    // The widths out of the palette, sorted by their offsets.
+    std::vector<std::pair<uint32_t, float>> mEscaped;
+};
+
 class MeasuredText {
 public:
-    // Character widths.
+    // Character widths. Empty if the widths are compacted, see setCompactWidthsEnabled, so use
+    // getCharWidth unless the widths are known not to be.
     std::vector<float> widths;
 
+    // Running sums of the character widths: the i-th element is the sum of the first i widths.
+    // Kept in double precision so that the differences of two sums stay accurate. Only built when
+    // the hyphenation is computed, otherwise empty.
+    std::vector<double> widthPrefixSums;
+
     // Hyphenation points.
     std::vector<HyphenBreak> hyphenBreaks;
 
     // The style information.
     std::vector<std::unique_ptr<Run>> runs;
 
-    // The copied layout pieces for construcing final layouts.
+    // The ICU line break boundaries, replayed by the line breakers. Only recorded if enabled with
+    // setWordBreakRecordingEnabled, otherwise only for the runs of LineBreakWordStyle::Phrase.
+    WordBreakRecord wordBreaks;
+
+    // The layout pieces for construcing final layouts, shared with the LayoutCache.
     // TODO: Stop assigning width/extents if layout pieces are available for reducing memory impact.
     LayoutPieces layoutPieces;
 
-    uint32_t getMemoryUsage() const {
-        return sizeof(float) * widths.size() + sizeof(HyphenBreak) * hyphenBreaks.size() +
-               layoutPieces.getMemoryUsage();
+    // The compacted character widths, which replace widths if setCompactWidthsEnabled. Empty
+    // otherwise.
+    CompactWidths compactWidths;
+
+    // Returns the width of the character at the offset, whether the widths are compacted or not.
+    float getCharWidth(uint32_t offset) const {
+        return compactWidths.size() == 0 ? widths[offset] : compactWidths.get(offset);
     }
 
+    // Returns the length of the measured text.
+    size_t getCharCount() const {
+        return compactWidths.size() == 0 ? widths.size() : compactWidths.size();
+    }
+
+    // Includes the line breaking results kept by getLineBreakResultCache().
+    uint32_t getMemoryUsage() const;
+
+    // Makes the texts measured from now on with the hyphenation leave hyphenBreaks empty, so that
+    // the line breakers only compute the hyphenation points where they may break inside a word.
+    // The greedy line breaker hyphenates the words it breaks by itself, and the optimal one skips
+    // the paragraphs which fit in their first line. Disabled by default.
+    static void setDeferredHyphenationEnabled(bool enabled);
+
+    // Makes the texts measured from now on record their ICU line break boundaries in wordBreaks,
+    // so that breaking them again at another width doesn't run ICU. The incrementally measured
+    // texts don't record them. Disabled by default.
+    static void setWordBreakRecordingEnabled(bool enabled);
+
+    // Makes the texts measured from now on keep the line break candidates of their first optimal
+    // line breaking, so that breaking them again at another width only runs the optimization. The
+    // candidates are about as large as the widths. Disabled by default.
+    static void setBreakCandidatesCachingEnabled(bool enabled);
+
+    // Makes the line breakers leave the line extents of the texts measured from now on to
+    // LineBreakResult::getLineExtent, so that only the extents of the drawn lines are computed.
+    // Disabled by default.
+    static void setDeferredLineExtentsEnabled(bool enabled);
+
+    // Makes the texts measured from now on shape their runs and measure their hyphenated pieces on
+    // the threads of the WorkerPool. The runs longer than a few thousand characters are split at
+    // word boundaries, so that a single long run is also spread over the threads. The layout
+    // pieces and the hyphenation points of the tasks are merged in the order of the text, so the
+    // result is the same as measuring serially. The runs must be safe to measure from several
+    // threads at once, which the text runs are. Disabled by default.
+    static void setParallelMeasurementEnabled(bool enabled);
+
+    // Makes the texts measured from now on keep their character widths in compactWidths instead of
+    // widths, which is about a quarter of the size for most texts. The widths are the same, so are
+    // the line breaks, but reading them is a little slower. Disabled by default.
+    static void setCompactWidthsEnabled(bool enabled);
+
+    // Makes the texts measured from now on without ignoreHyphenKerning estimate the width of a
+    // hyphenated piece of Latin, Greek, Cyrillic or Armenian text from its character widths and the
+    // advance of the hyphen, which is measured once per run, instead of shaping the piece with the
+    // hyphen. The kerning against the hyphen is lost, and so are the ligatures across the
+    // hyphenation point: the piece keeps its share of the ligature of the unbroken word, e.g. of
+    // "fi" in "of-fice", instead of being shaped without it. The words of the other scripts, where
+    // the hyphen may change the shaping, and the hyphens replacing a character are still shaped.
+    // Disabled by default.
+    static void setHyphenPieceEstimationEnabled(bool enabled);
+
+    // Makes the texts measured from now on which are a single LTR style run, the most common
+    // paragraphs, look up the layouts of their words in batches with
+    // LayoutCache::getOrCreateBatch, which takes the cache locks once per batch instead of once
+    // per word. The widths and the layout pieces are the same. The texts measured with a hint or
+    // in parallel are measured as usual. Disabled by default.
+    static void setSingleRunFastPathEnabled(bool enabled);
+
+    // Makes the texts measured from now on keep the results of their last few line breakings in a
+    // LineBreakResultCache, which StaticLayoutNative::computeBreaksShared looks up before breaking
+    // the text again with the same arguments. The texts read with readFrom don't keep them.
+    // Disabled by default.
+    static void setLineBreakResultCachingEnabled(bool enabled);
+
+    // Returns the cache of the line breaking results, or nullptr if they are not cached, see
+    // setLineBreakResultCachingEnabled.
+    LineBreakResultCache* getLineBreakResultCache() const { return mBreakResults.get(); }
+
+    // Returns what the text has, computed once when it is measured, so that the passes over the
+    // text don't scan it again, e.g. for the tabs.
+    const TextClass& getTextClass() const { return mTextClass; }
+
+    // Returns true if the text is a single style run in the LTR direction.
+    bool isSingleLtrStyleRun() const {
+        return runs.size() == 1 && runs[0]->getType() == Run::Type::Style && !runs[0]->isRtl();
+    }
+
+    // Returns true if the line extents are left to LineBreakResult::getLineExtent, see
+    // setDeferredLineExtentsEnabled.
+    bool isLineExtentsDeferred() const { return mLineExtentsDeferred; }
+
+    // Returns true if the hyphenation was requested but left to the line breakers, see
+    // setDeferredHyphenationEnabled.
+    bool isHyphenationDeferred() const { return mHyphenationDeferred; }
+
+    // Returns the hyphenation points hyphenBreaks would hold if the hyphenation was not deferred.
+    std::vector<HyphenBreak> computeHyphenBreaks(const U16StringPiece& textBuf) const;
+
+    // Returns the sum of the character widths in the range. Constant time if the prefix sums are
+    // available, linear otherwise.
+    float getWidth(const Range& range) const;
+
+    // Returns the largest offset in the range such that the sum of the character widths from the
+    // start of the range to the offset doesn't exceed the given width. Logarithmic time if the
+    // prefix sums are available, linear otherwise.
+    uint32_t getOffsetForWidth(const Range& range, float width) const;
+
     Layout buildLayout(const U16StringPiece& textBuf, const Range& range, const Range& contextRange,
                        const MinikinPaint& paint, StartHyphenEdit startHyphen,
                        EndHyphenEdit endHyphen);
     MinikinRect getBounds(const U16StringPiece& textBuf, const Range& range) const;
     MinikinExtent getExtent(const U16StringPiece& textBuf, const Range& range) const;
 
+    // Same as getBounds() above for each of the ranges, e.g. the lines of the paragraph, looking
+    // only at the runs from the first one intersecting each range. The ranges must be sorted by
+    // their start.
+    std::vector<MinikinRect> getBounds(const U16StringPiece& textBuf,
+                                       const std::vector<Range>& ranges) const;
+
+    // Writes this text for readFrom, which restores it without measuring it again, e.g. in another
+    // process or after the activity is recreated. The fonts of the paints are written as their
+    // indices in fontCollections, and the fonts of the layout pieces as their positions in the
+    // families of fontCollections, so the same collections must be given to readFrom. The layout
+    // pieces using other fonts are dropped, and shaped again when needed. Returns false if the
+    // text can't be written, i.e. if it has a custom run or a paint whose font is not in
+    // fontCollections. Write to a BufferWriter(nullptr) first to compute the size of the buffer.
+    bool writeTo(BufferWriter* writer,
+                 const std::vector<std::shared_ptr<FontCollection>>& fontCollections) const;
+
+    // Reads a text written by writeTo with the same font collections. Returns nullptr if the text
+    // was written by another version of the format or refers to fonts not in fontCollections.
+    // The layout pieces are copied, so the buffer may be released afterwards.
+    static std::unique_ptr<MeasuredText> readFrom(
+            BufferReader* reader,
+            const std::vector<std::shared_ptr<FontCollection>>& fontCollections);
+
     MeasuredText(MeasuredText&&) = default;
     MeasuredText& operator=(MeasuredText&&) = default;
 
@@ -231,9 +479,56 @@ public:
 
 private:
     friend class MeasuredTextBuilder;
+    friend class OptimalBreakCandidates;
 
     void measure(const U16StringPiece& textBuf, bool computeHyphenation, bool computeLayout,
                  bool ignoreHyphenKerning, MeasuredText* hint);
+    void measureIncremental(const U16StringPiece& textBuf, bool computeHyphenation,
+                            bool computeLayout, bool ignoreHyphenKerning, const MeasuredText& prev,
+                            const TextEdit& edit);
+    // Records the word breaks of the runs, only the ones of the phrase based breaking if
+    // phraseOnly is true.
+    void recordWordBreaks(const U16StringPiece& textBuf, bool phraseOnly);
+    bool canMeasureIncrementally(const U16StringPiece& textBuf, bool computeHyphenation,
+                                 bool computeLayout, bool ignoreHyphenKerning,
+                                 const MeasuredText& prev, const TextEdit& edit) const;
+    void populateHyphenBreaks(const U16StringPiece& textBuf, bool ignoreHyphenKerning,
+                              LayoutPieces* piecesOut, const MeasuredText* prev,
+                              const Range& dirtyRange, int32_t delta,
+                              std::vector<HyphenBreak>* out) const;
+    // Fills the widths and the layout pieces of the runs on the WorkerPool, see
+    // setParallelMeasurementEnabled.
+    void measureRunsInParallel(const U16StringPiece& textBuf, LayoutPieces* precomputed,
+                               LayoutPieces* piecesOut);
+    void buildWidthPrefixSums();
+    // Moves the widths to compactWidths if setCompactWidthsEnabled.
+    void compactWidthsIfEnabled();
+
+    TextClass mTextClass;
+
+    // True if some character has a negative width, so the prefix sums can't be binary searched.
+    bool mHasNegativeWidth = false;
+
+    // The options this text was measured with, for validating the incremental re-measurement.
+    bool mComputeHyphenation = false;
+    bool mComputeLayout = false;
+    bool mIgnoreHyphenKerning = false;
+    bool mHyphenationDeferred = false;
+    bool mCacheBreakCandidates = false;
+    bool mLineExtentsDeferred = false;
+    bool mMeasuredInParallel = false;
+    bool mHyphenPiecesEstimated = false;
+
+    // The line break candidates kept for the next optimal line breakings, see
+    // setBreakCandidatesCachingEnabled. Replaced at most once, when the deferred hyphenation
+    // points are first needed.
+    mutable PublishedPtr<OptimalBreakCandidates> mBreakCandidates;
+
+    // The line breaking results, see setLineBreakResultCachingEnabled.
+    std::shared_ptr<LineBreakResultCache> mBreakResults;
+
+    // Use readFrom instead.
+    MeasuredText() {}
 
     // Use MeasuredTextBuilder instead.
     MeasuredText(const U16StringPiece& textBuf, std::vector<std::unique_ptr<Run>>&& runs,
@@ -241,7 +536,51 @@ private:
                  MeasuredText* hint)
             : widths(textBuf.size()), runs(std::move(runs)) {
         measure(textBuf, computeHyphenation, computeLayout, ignoreHyphenKerning, hint);
+        compactWidthsIfEnabled();
     }
+
+    // Use MeasuredTextBuilder::buildIncremental instead.
+    MeasuredText(const U16StringPiece& textBuf, std::vector<std::unique_ptr<Run>>&& runs,
+                 bool computeHyphenation, bool computeLayout, bool ignoreHyphenKerning,
+                 const MeasuredText& prev, const TextEdit& edit)
+            : widths(textBuf.size()), runs(std::move(runs)) {
+        measureIncremental(textBuf, computeHyphenation, computeLayout, ignoreHyphenKerning, prev,
+                           edit);
+        compactWidthsIfEnabled();
+    }
+};
+
+// The order of the asynchronous measurements, see MeasuredTextBuilder::buildAsync.
+enum class MeasurePriority : uint8_t {
+    // Measured before the Low ones, e.g. the paragraphs about to be shown.
+    High = 0,
+    // E.g. the paragraphs pre-measured further away from the viewport.
+    Low = 1,
+};
+
+struct MeasureRequest;
+
+// The result of MeasuredTextBuilder::buildAsync.
+class MeasureHandle {
+public:
+    explicit MeasureHandle(std::shared_ptr<MeasureRequest> request);
+    ~MeasureHandle();
+
+    // Stops the measurement, e.g. when the paragraph is no longer needed. If it has started, it
+    // stops at the next run or word, and the pieces shaped until then stay in the LayoutCache.
+    void cancel();
+
+    // Returns true if the measurement has finished or has been cancelled.
+    bool isDone() const;
+
+    // Waits for the measurement and returns the measured text, or nullptr if it was cancelled.
+    // The measured text is only returned by the first call.
+    std::unique_ptr<MeasuredText> get();
+
+private:
+    std::shared_ptr<MeasureRequest> mRequest;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(MeasureHandle);
 };
 
 class MeasuredTextBuilder {
@@ -250,8 +589,15 @@ public:
 
     void addStyleRun(int32_t start, int32_t end, MinikinPaint&& paint, int lineBreakStyle,
                      int lineBreakWordStyle, bool isRtl) {
-        mRuns.emplace_back(std::make_unique<StyleRun>(Range(start, end), std::move(paint),
-                                                      lineBreakStyle, lineBreakWordStyle, isRtl));
+        addStyleRunImpl(Range(start, end), std::move(paint), lineBreakStyle, lineBreakWordStyle,
+                        isRtl);
+    }
+
+    // Same as above, but the paint is copied. A run reused from a recycled text keeps its paint
+    // if it is the same, so building the same styles again and again doesn't copy the paints.
+    void addStyleRun(int32_t start, int32_t end, const MinikinPaint& paint, int lineBreakStyle,
+                     int lineBreakWordStyle, bool isRtl) {
+        addStyleRunImpl(Range(start, end), paint, lineBreakStyle, lineBreakWordStyle, isRtl);
     }
 
     void addReplacementRun(int32_t start, int32_t end, float width, uint32_t localeListId) {
@@ -266,17 +612,66 @@ public:
 
     std::unique_ptr<MeasuredText> build(const U16StringPiece& textBuf, bool computeHyphenation,
                                         bool computeLayout, bool ignoreHyphenKerning,
-                                        MeasuredText* hint) {
-        // Unable to use make_unique here since make_unique is not a friend of MeasuredText.
+                                        MeasuredText* hint);
+
+    // Builds the MeasuredText of textBuf, which is the text of prev after the given edit. The
+    // widths, hyphenation points and layout pieces of prev are shifted and reused except for the
+    // edited words, which are measured and hyphenated again. The added runs must be the runs of
+    // prev shifted by the edit, and prev must have been built with the same options. Otherwise
+    // the whole text is measured.
+    std::unique_ptr<MeasuredText> buildIncremental(const U16StringPiece& textBuf,
+                                                   bool computeHyphenation, bool computeLayout,
+                                                   bool ignoreHyphenKerning,
+                                                   const MeasuredText& prev, const TextEdit& edit) {
         return std::unique_ptr<MeasuredText>(new MeasuredText(textBuf, std::move(mRuns),
                                                               computeHyphenation, computeLayout,
-                                                              ignoreHyphenKerning, hint));
+                                                              ignoreHyphenKerning, prev, edit));
     }
 
+    // Same as build, but measures on a background thread and returns immediately. The text is
+    // copied, so the caller doesn't need to keep it. The measurements are run one at a time, the
+    // ones of MeasurePriority::High first and in the order of the calls otherwise. If an Executor
+    // is registered, they are its tasks of the same priority instead.
+    std::unique_ptr<MeasureHandle> buildAsync(const U16StringPiece& textBuf,
+                                              bool computeHyphenation, bool computeLayout,
+                                              bool ignoreHyphenKerning, MeasurePriority priority);
+
+    // Discards the runs added since the last build, keeping them for the next runs added.
+    void reset();
+
+    // Takes back the runs of a measured text which is no longer needed, e.g. of a message scrolled
+    // out of view. The next style runs added are made from them instead of being allocated, and
+    // the next text built uses the array of the runs. A builder reused this way doesn't allocate
+    // the runs once it has recycled a text with as many style runs.
+    void recycle(std::unique_ptr<MeasuredText>&& mt);
+
     MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(MeasuredTextBuilder);
 
 private:
+    // The number of the runs kept for the next runs at most.
+    static constexpr size_t kMaxRecycledRuns = 256;
+
+    template <typename Paint>
+    void addStyleRunImpl(const Range& range, Paint&& paint, int lineBreakStyle,
+                         int lineBreakWordStyle, bool isRtl) {
+        if (mRecycledRuns.empty()) {
+            MinikinPaint runPaint(std::forward<Paint>(paint));
+            mRuns.emplace_back(std::make_unique<StyleRun>(range, std::move(runPaint),
+                                                          lineBreakStyle, lineBreakWordStyle,
+                                                          isRtl));
+            return;
+        }
+        std::unique_ptr<StyleRun> run = std::move(mRecycledRuns.back());
+        mRecycledRuns.pop_back();
+        run->reset(range, std::forward<Paint>(paint), lineBreakStyle, lineBreakWordStyle, isRtl);
+        mRuns.emplace_back(std::move(run));
+    }
+
+    // Moves the style runs to mRecycledRuns and clears the array.
+    void recycleRuns(std::vector<std::unique_ptr<Run>>* runs);
+
     std::vector<std::unique_ptr<Run>> mRuns;
+    std::vector<std::unique_ptr<StyleRun>> mRecycledRuns;
 };
 
 }  // namespace minikin
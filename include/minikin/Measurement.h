@@ -22,6 +22,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 namespace minikin {
 
@@ -33,6 +34,31 @@ void distributeAdvances(float* advances, const uint16_t* buf, size_t start, size
 size_t getOffsetForAdvance(const float* advances, const uint16_t* buf, size_t start, size_t count,
                            float advance);
 
+// An index of a run for repeated hit testing, e.g. while dragging a selection on a long line. It
+// gives the same results as getRunAdvance() and getOffsetForAdvance() in logarithmic time, after
+// a linear time build. The advances and the text must be kept unchanged while it is used. As with
+// these functions, the advances are those of a single bidi run in logical order.
+class RunHitTestIndex {
+public:
+    RunHitTestIndex(const float* advances, const uint16_t* buf, size_t start, size_t count);
+
+    float getRunAdvance(size_t offset) const;
+    size_t getOffsetForAdvance(float advance) const;
+
+private:
+    bool isGraphemeBreak(size_t offset) const;
+
+    const float* mAdvances;
+    const uint16_t* mBuf;
+    const size_t mStart;
+    const size_t mCount;
+    std::vector<float> mPrefixAdvances;   // The sum of the advances before each offset.
+    std::vector<uint32_t> mBreakCounts;   // The number of grapheme breaks before each offset.
+    std::vector<size_t> mAdvancedOffsets;  // The offsets having an advance, ascending.
+    std::vector<size_t> mControlOffsets;   // The offsets of control characters, ascending.
+    bool mHasNegativeAdvance = false;
+};
+
 void getBounds(const U16StringPiece& str, const Range& range, Bidi bidiFlags,
                const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
                MinikinRect* out);
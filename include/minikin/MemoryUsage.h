@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_MEMORY_USAGE_H
+#define MINIKIN_MEMORY_USAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace minikin {
+
+// The number of bytes used by the process wide caches of minikin.
+struct MemoryUsage {
+    struct Entry {
+        const char* name;  // The same name as in Layout::dumpMinikinStats(), if dumped there.
+        size_t bytes;
+    };
+    std::vector<Entry> entries;
+
+    size_t getTotal() const;
+};
+
+// Returns the memory used by each of the caches. The pooled ICU line breakers are not counted,
+// since ICU doesn't expose their sizes.
+MemoryUsage getMemoryUsage();
+
+// Must be the same values with ComponentCallbacks2.java
+enum class TrimMemoryLevel : int32_t {
+    RUNNING_MODERATE = 5,   // Must be same with ComponentCallbacks2.TRIM_MEMORY_RUNNING_MODERATE
+    RUNNING_LOW = 10,       // Must be same with ComponentCallbacks2.TRIM_MEMORY_RUNNING_LOW
+    RUNNING_CRITICAL = 15,  // Must be same with ComponentCallbacks2.TRIM_MEMORY_RUNNING_CRITICAL
+    UI_HIDDEN = 20,         // Must be same with ComponentCallbacks2.TRIM_MEMORY_UI_HIDDEN
+    BACKGROUND = 40,        // Must be same with ComponentCallbacks2.TRIM_MEMORY_BACKGROUND
+    MODERATE = 60,          // Must be same with ComponentCallbacks2.TRIM_MEMORY_MODERATE
+    COMPLETE = 80,          // Must be same with ComponentCallbacks2.TRIM_MEMORY_COMPLETE
+};
+
+// Sheds the memory of the caches in proportion to the level, e.g. from onTrimMemory(). The least
+// recently used entries of every cache are evicted so that 75%, 50% or 25% of its memory is kept
+// for the increasingly severe levels, and the caches are cleared from TRIM_MEMORY_MODERATE on.
+// From TRIM_MEMORY_RUNNING_CRITICAL and TRIM_MEMORY_BACKGROUND on, the pooled ICU line breakers
+// and the typefaces of the fonts not used since the previous such trim are also released.
+void trimMemory(TrimMemoryLevel level);
+
+}  // namespace minikin
+
+#endif  // MINIKIN_MEMORY_USAGE_H
@@ -69,6 +69,11 @@ public:
 
     virtual int GetSourceId() const { return 0; }
 
+    // Override to return true if the advances are the ones HarfBuzz reads from the font tables of
+    // GetFontData(), scaled linearly. The shaping then reads them with HarfBuzz directly instead
+    // of calling GetHorizontalAdvance for every glyph.
+    virtual bool HasHarfBuzzAdvances() const { return false; }
+
     virtual const std::vector<minikin::FontVariation>& GetAxes() const = 0;
 
     virtual std::shared_ptr<MinikinFont> createFontWithVariation(
@@ -19,6 +19,8 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "minikin/FamilyVariant.h"
 #include "minikin/FontCollection.h"
@@ -44,8 +46,43 @@ enum MinikinFontFlags {
     ForceAutoHinting_Flag = 1 << ForceAutoHinting_Shift,
 };
 
+// The font feature settings of a paint, e.g. "'liga' off". They are interned by
+// FontFeatureSettingsCache when set, so that the layout cache keys and the paint comparisons use
+// the ID without taking the lock of the cache for every lookup.
+class FontFeatureSettings {
+public:
+    FontFeatureSettings() : mId(0) {}
+    // Intentionally not explicit, so that the settings can be assigned from a string.
+    FontFeatureSettings(const std::string& settings) : mSettings(settings) { intern(); }
+    FontFeatureSettings(std::string&& settings) : mSettings(std::move(settings)) { intern(); }
+    FontFeatureSettings(const char* settings) : mSettings(settings) { intern(); }
+    FontFeatureSettings(std::string_view settings) : mSettings(settings) { intern(); }
+
+    FontFeatureSettings(const FontFeatureSettings&) = default;
+    FontFeatureSettings& operator=(const FontFeatureSettings&) = default;
+    FontFeatureSettings(FontFeatureSettings&&) = default;
+    FontFeatureSettings& operator=(FontFeatureSettings&&) = default;
+
+    // The ID given by FontFeatureSettingsCache, which is 0 for the empty settings.
+    uint32_t getId() const { return mId; }
+    const std::string& str() const { return mSettings; }
+    bool empty() const { return mSettings.empty(); }
+    const char* c_str() const { return mSettings.c_str(); }
+    operator const std::string&() const { return mSettings; }
+
+    bool operator==(const FontFeatureSettings& o) const { return mId == o.mId; }
+    bool operator!=(const FontFeatureSettings& o) const { return mId != o.mId; }
+
+private:
+    // Sets mId, taking the lock of FontFeatureSettingsCache unless the settings are empty.
+    void intern();
+
+    std::string mSettings;
+    uint32_t mId;
+};
+
 // Possibly move into own .h file?
-// Note: if you add a field here, either add it to LayoutCacheKey or to skipCache()
+// Note: if you add a field here, add it to LayoutCacheKey.
 struct MinikinPaint {
     MinikinPaint(const std::shared_ptr<FontCollection>& font)
             : size(0),
@@ -59,8 +96,6 @@ struct MinikinPaint {
               fontFeatureSettings(),
               font(font) {}
 
-    bool skipCache() const { return !fontFeatureSettings.empty(); }
-
     float size;
     float scaleX;
     float skewX;
@@ -70,7 +105,7 @@ struct MinikinPaint {
     uint32_t localeListId;
     FontStyle fontStyle;
     FamilyVariant familyVariant;
-    std::string fontFeatureSettings;
+    FontFeatureSettings fontFeatureSettings;
     std::shared_ptr<FontCollection> font;
 
     void copyFrom(const MinikinPaint& paint) { *this = paint; }
@@ -86,7 +121,7 @@ struct MinikinPaint {
                letterSpacing == paint.letterSpacing && wordSpacing == paint.wordSpacing &&
                fontFlags == paint.fontFlags && localeListId == paint.localeListId &&
                fontStyle == paint.fontStyle && familyVariant == paint.familyVariant &&
-               fontFeatureSettings == paint.fontFeatureSettings && font.get() == paint.font.get();
+               font.get() == paint.font.get() && fontFeatureSettings == paint.fontFeatureSettings;
     }
 
     uint32_t hash() const {
@@ -100,7 +135,7 @@ struct MinikinPaint {
                 .update(localeListId)
                 .update(fontStyle.identifier())
                 .update(static_cast<uint8_t>(familyVariant))
-                .updateString(fontFeatureSettings)
+                .update(fontFeatureSettings.getId())
                 .update(font->getId())
                 .hash();
     }
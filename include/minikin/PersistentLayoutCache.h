@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_PERSISTENT_LAYOUT_CACHE_H
+#define MINIKIN_PERSISTENT_LAYOUT_CACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "minikin/CacheStats.h"
+#include "minikin/LayoutCore.h"
+#include "minikin/Macros.h"
+#include "minikin/MinikinPaint.h"
+
+namespace minikin {
+
+// An opt-in cache of the layouts in a file, which LayoutCache consults on a miss before shaping
+// the text, so that the words laid out by the previous runs of the process are not shaped again.
+//
+// The file is mapped when opened, and the layouts shaped afterwards are appended to it, so they
+// are found from the next open. A layout is keyed by the text, the paint and
+// FontCollection::getStableId() instead of the process local IDs, and the fonts of the layout are
+// stored as their positions in the collection together with the checksums of the fonts, so that a
+// layout is not used once a font file is updated in place. The file must not be shared by
+// processes opening it at the same time.
+//
+// The cache is disabled until open() succeeds.
+class PersistentLayoutCache {
+public:
+    static PersistentLayoutCache& getInstance() {
+        static PersistentLayoutCache cache;
+        return cache;
+    }
+
+    bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    // Maps the file, which is created if it doesn't exist, and enables the cache. A file written
+    // by a different version of the format is emptied. The layouts are appended until the file
+    // reaches maxFileSize bytes. Returns false if the file can't be opened, in which case the
+    // cache stays disabled. The file opened before is closed.
+    bool open(const std::string& path, size_t maxFileSize);
+
+    // Writes the pending layouts and disables the cache.
+    void close();
+
+    // Writes the appended layouts which are still buffered in memory to the file.
+    void flush();
+
+    // Returns the layout stored in the file or shapes the text. The layout shaped here is appended
+    // unless it is advances only, see LayoutPiece. The layout in the file has the glyphs, so it
+    // is returned even if advancesOnly is true.
+    std::shared_ptr<const LayoutPiece> getOrCreate(const U16StringPiece& text, const Range& range,
+                                                   const MinikinPaint& paint, bool dir,
+                                                   StartHyphenEdit startHyphen,
+                                                   EndHyphenEdit endHyphen, bool advancesOnly);
+
+    // Returns the number of the layouts in the file, including the pending ones.
+    uint32_t size();
+    const CacheStats& getStats() const { return mStats; }
+
+protected:
+    PersistentLayoutCache();
+    ~PersistentLayoutCache();
+
+private:
+    // Returns the layout of the key in the mapped file if the fonts it refers to are the same.
+    std::shared_ptr<const LayoutPiece> find(const std::vector<uint8_t>& key,
+                                            const FontCollection& collection);
+    void append(const std::vector<uint8_t>& key, const LayoutPiece& layout,
+                const FontCollection& collection);
+    // Returns the checksum of the font at the position in the collection. Computed once per font
+    // of a collection, since it reads the font file.
+    uint32_t getFontChecksum(const FontCollection& collection, uint32_t family, uint32_t font);
+    void flushLocked() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    void closeLocked() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    std::atomic<bool> mEnabled;
+    std::mutex mMutex;
+    int mFd GUARDED_BY(mMutex);
+    const uint8_t* mMapped GUARDED_BY(mMutex);
+    size_t mMappedSize GUARDED_BY(mMutex);
+    // The size of the file including the pending records.
+    size_t mFileSize GUARDED_BY(mMutex);
+    size_t mMaxFileSize GUARDED_BY(mMutex);
+    struct Value {
+        size_t valueOffset;
+        uint32_t valueSize;
+    };
+    // The values of the records in the mapped file, keyed by the key bytes.
+    std::unordered_map<std::string_view, Value> mIndex GUARDED_BY(mMutex);
+    // The keys appended since the open, so that a layout evicted from LayoutCache is not
+    // appended twice.
+    std::unordered_set<std::string> mAppendedKeys GUARDED_BY(mMutex);
+    std::vector<uint8_t> mPending GUARDED_BY(mMutex);
+    // The font checksums keyed by the collection ID and the position of the font.
+    std::unordered_map<uint64_t, uint32_t> mFontChecksums GUARDED_BY(mMutex);
+    CacheStats mStats;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(PersistentLayoutCache);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_PERSISTENT_LAYOUT_CACHE_H
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_PUBLISHED_PTR_H
+#define MINIKIN_PUBLISHED_PTR_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// A pointer to an immutable object which is read without any lock and rarely replaced. The
+// replaced objects may still be read by other threads, so they are kept until clear() or the
+// destruction. Only for objects replaced a bounded number of times, e.g. once per locale.
+//
+// The objects are owned through shared_ptr only so that T may be incomplete where the owner is
+// destroyed. The readers never touch the reference counts.
+template <typename T>
+class PublishedPtr {
+public:
+    PublishedPtr() : mCurrent(nullptr) {}
+
+    // Not thread-safe: no other thread may use o meanwhile.
+    PublishedPtr(PublishedPtr&& o) noexcept
+            : mCurrent(o.mCurrent.exchange(nullptr, std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(o.mMutex);
+        mObjects = std::move(o.mObjects);
+        o.mObjects.clear();
+    }
+
+    // Not thread-safe: no other thread may use this or o meanwhile.
+    PublishedPtr& operator=(PublishedPtr&& o) noexcept {
+        if (this != &o) {
+            std::scoped_lock lock(mMutex, o.mMutex);
+            mCurrent.store(o.mCurrent.exchange(nullptr, std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+            mObjects = std::move(o.mObjects);
+            o.mObjects.clear();
+        }
+        return *this;
+    }
+
+    // Returns the current object, which stays valid until clear() or the destruction.
+    const T* get() const { return mCurrent.load(std::memory_order_acquire); }
+
+    // Replaces the current object. The object may be null.
+    void publish(std::unique_ptr<const T> object) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        publishLocked(std::move(object));
+    }
+
+    // Replaces the current object unless keepCurrent(current) returns true for a non-null one, and
+    // returns the current object afterwards. Lets the racing writers agree on one object.
+    template <typename F>
+    const T* publishUnless(std::unique_ptr<const T> object, F keepCurrent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const T* current = mCurrent.load(std::memory_order_relaxed);
+        if (current != nullptr && keepCurrent(*current)) {
+            return current;
+        }
+        return publishLocked(std::move(object));
+    }
+
+    // Calls f for the current object and the replaced ones, e.g. to count their memory.
+    template <typename F>
+    void forEach(F f) const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const std::shared_ptr<const T>& object : mObjects) {
+            f(*object);
+        }
+    }
+
+    // Deletes the current object and the replaced ones. No other thread may be reading them.
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCurrent.store(nullptr, std::memory_order_relaxed);
+        mObjects.clear();
+    }
+
+private:
+    const T* publishLocked(std::unique_ptr<const T> object) EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+        const T* current = object.get();
+        if (object != nullptr) {
+            mObjects.push_back(std::move(object));
+        }
+        mCurrent.store(current, std::memory_order_release);
+        return current;
+    }
+
+    std::atomic<const T*> mCurrent;
+    mutable std::mutex mMutex;
+    // The published objects in the order of publication, so the current one is the last one.
+    std::vector<std::shared_ptr<const T>> mObjects GUARDED_BY(mMutex);
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(PublishedPtr);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_PUBLISHED_PTR_H
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_READ_AHEAD_H
+#define MINIKIN_READ_AHEAD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace minikin {
+
+// Read ahead hints for the mapped font files and hyphenation patterns. The tables used by the
+// first layout, e.g. cmap, hmtx and GSUB, and the hyphenation tries are otherwise faulted in one
+// page at a time by the first layout, which stalls on slow storage. When enabled, the fonts and the
+// hyphenators advise the kernel with madvise(MADV_WILLNEED) to read those pages as soon as they are
+// created, so that the reads are issued early and in large chunks.
+class ReadAhead {
+public:
+    // Makes the fonts prepared and the hyphenators loaded from now on advise their hot data.
+    // Disabled by default.
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // Advises the pages of [data, data + size). Returns the number of the advised bytes, rounded
+    // to whole pages, or 0 if the advice failed or is not supported.
+    static size_t advise(const void* data, size_t size);
+
+    // Advises the pages of the hot tables of the face at the index of the font file, see
+    // FontFileParser::getHotTableRanges. The tables sharing a page are advised once.
+    static size_t adviseFont(const void* data, size_t size, uint32_t index);
+
+    struct Stats {
+        uint64_t adviceCount;  // The successful madvise calls.
+        uint64_t advisedBytes;  // The bytes advised by them, in whole pages.
+        uint64_t failureCount;  // The failed madvise calls.
+    };
+    static Stats getStats();
+
+    // Writes the counters as lines of the statistics dump.
+    static void dump(int fd);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_READ_AHEAD_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_SHAPING_STATS_H
+#define MINIKIN_SHAPING_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+class Font;
+
+// The time spent shaping the script runs of the LayoutPiece misses, broken down by the script,
+// the font file and the font feature settings of the runs, e.g. to find that a fallback font or
+// a paint with many features accounts for most of the shaping. Only one in every
+// getSamplingInterval() runs of each thread is timed, and counted as that many runs. Disabled by
+// default.
+class ShapingStats {
+public:
+    static ShapingStats& getInstance() {
+        static ShapingStats stats;
+        return stats;
+    }
+
+    // The shaping cost of the runs of one script, font and feature settings.
+    struct Entry {
+        // The ISO 15924 tag of the script, e.g. 'Arab'.
+        uint32_t script;
+        std::string fontPath;
+        int fontIndex;
+        std::string fontFeatureSettings;
+        // Estimated from the sampled runs.
+        uint64_t calls;
+        uint64_t nanos;
+    };
+
+    // Times one in every interval runs, or none for 0.
+    void setSamplingInterval(uint32_t interval) {
+        mSamplingInterval.store(interval, std::memory_order_relaxed);
+    }
+    uint32_t getSamplingInterval() const {
+        return mSamplingInterval.load(std::memory_order_relaxed);
+    }
+
+    // Returns true if the run about to be shaped on this thread is to be timed and recorded. This
+    // is a single load while disabled.
+    bool shouldSample() {
+        const uint32_t interval = getSamplingInterval();
+        return interval != 0 && shouldSampleInternal(interval);
+    }
+
+    // Records a sampled run. The runs of the new keys are ignored once there are kMaxEntries.
+    void record(uint32_t script, const Font& font, const std::string& fontFeatureSettings,
+                uint64_t nanos);
+
+    // Returns the entries, the most expensive first.
+    std::vector<Entry> getEntries() const;
+
+    // Writes the kMaxDumpedEntries most expensive entries as lines of the statistics dump.
+    void dump(int fd) const;
+
+    void clear();
+
+    static constexpr size_t kMaxEntries = 1024;
+    static constexpr size_t kMaxDumpedEntries = 20;
+
+protected:
+    ShapingStats() : mSamplingInterval(0) {}
+
+private:
+    using Key = std::tuple<uint32_t, std::string, int, std::string>;
+    struct Cost {
+        uint64_t calls = 0;
+        uint64_t nanos = 0;
+    };
+
+    bool shouldSampleInternal(uint32_t interval);
+
+    std::atomic<uint32_t> mSamplingInterval;
+    mutable std::mutex mMutex;
+    std::map<Key, Cost> mCosts GUARDED_BY(mMutex);
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(ShapingStats);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_SHAPING_STATS_H
@@ -68,6 +68,11 @@ public:
     // if none exists.
     uint32_t nextSetBit(uint32_t fromIndex) const;
 
+    // Returns the offset of the first code point of the UTF-16 text which
+    // is not in the set, or size if all of them are. Unpaired surrogates
+    // are looked up as they are.
+    size_t findFirstUnset(const uint16_t* text, size_t size) const;
+
     static const uint32_t kNotFound = ~0u;
 
 private:
@@ -123,6 +128,10 @@ private:
         static MappableData* allocate(uint32_t indicesCount, uint32_t bitmapsCount);
     };
 
+    // Returns the data with the identical pages stored once, e.g. the full pages of a large
+    // block. The given data is freed unless it is returned as is because no pages are identical.
+    static MappableData* mergeIdenticalPages(MappableData* data);
+
     // MappableDataDeleter does NOT call free() if the data is on a memory map.
     class MappableDataDeleter {
     public:
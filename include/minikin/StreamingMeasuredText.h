@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_STREAMING_MEASURED_TEXT_H
+#define MINIKIN_STREAMING_MEASURED_TEXT_H
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "minikin/LineBreaker.h"
+#include "minikin/Macros.h"
+#include "minikin/MeasuredText.h"
+#include "minikin/Range.h"
+#include "minikin/U16StringPiece.h"
+
+namespace minikin {
+
+// Measures a large text, e.g. a log file in a viewer, a chunk at a time instead of holding the
+// widths, the hyphenation points and the layout pieces of the whole text. The chunks are the
+// paragraphs of the text, ending after their line feed. The paragraphs longer than
+// kMaxChunkLength are split after a space, which is then always a line break. A chunk is
+// measured on its first use, and the least recently used chunks are evicted once the measured
+// chunks exceed the memory budget. Not thread safe.
+class StreamingMeasuredText {
+public:
+    // Adds the runs of the chunk of the given range to the builder. The runs are relative to the
+    // start of the chunk and must cover it.
+    using RunProvider = std::function<void(const Range& chunk, MeasuredTextBuilder* builder)>;
+
+    // Takes the lines of a chunk broken by streamLines, whose break points are relative to the
+    // start of the chunk. Returns false to stop, e.g. once the lines fill the viewport.
+    using LineCallback = std::function<bool(size_t chunk, LineBreakResult&& lines)>;
+
+    static constexpr uint32_t kMaxChunkLength = 16 * 1024;
+
+    // The text must outlive this object. memoryBudget is in the bytes of
+    // MeasuredText::getMemoryUsage; the chunk used last is kept even if it exceeds the budget.
+    StreamingMeasuredText(const U16StringPiece& text, RunProvider runProvider,
+                          bool computeHyphenation, bool computeLayout, bool ignoreHyphenKerning,
+                          uint32_t memoryBudget);
+    ~StreamingMeasuredText();
+
+    size_t getChunkCount() const { return mChunks.size(); }
+    const Range& getChunkRange(size_t chunk) const { return mChunks[chunk].range; }
+
+    // Returns the index of the chunk containing the offset, or the last chunk for the end of the
+    // text.
+    size_t findChunk(uint32_t offset) const;
+
+    // Returns the measured text of the chunk, whose offsets are relative to the chunk start,
+    // measuring it if it is not resident. The returned text stays valid after its eviction.
+    std::shared_ptr<const MeasuredText> getChunk(size_t chunk);
+
+    // Breaks the chunk into lines. The break points are relative to the start of the chunk.
+    LineBreakResult breakChunkIntoLines(size_t chunk, BreakStrategy strategy,
+                                        HyphenationFrequency frequency, bool justified,
+                                        const LineWidth& lineWidth, const TabStops& tabStops);
+
+    // Breaks the chunks from firstChunk to the end of the text into lines, passing the lines of
+    // each chunk to the callback as soon as they are broken. The next chunk is measured on the
+    // background thread of MeasuredTextBuilder::buildAsync while the current one is broken and
+    // passed to the callback, so the first lines only wait for the measurement of their chunk.
+    void streamLines(size_t firstChunk, BreakStrategy strategy, HyphenationFrequency frequency,
+                     bool justified, const LineWidth& lineWidth, const TabStops& tabStops,
+                     const LineCallback& callback);
+
+    // Evicts the chunks outside of [first, last], e.g. the ones far from the viewport.
+    void evictOutside(size_t first, size_t last);
+
+    // Returns true if the chunk is measured and not evicted.
+    bool isResident(size_t chunk) const { return mChunks[chunk].measured != nullptr; }
+
+    // Returns the sum of MeasuredText::getMemoryUsage of the resident chunks.
+    uint32_t getMemoryUsage() const { return mMemoryUsage; }
+
+private:
+    struct Chunk {
+        Range range;
+        std::shared_ptr<const MeasuredText> measured;
+        uint32_t memoryUsage = 0;
+        // The position in mLru if resident.
+        std::list<size_t>::iterator lruIt;
+    };
+
+    // Makes the measured text of the chunk resident, evicting the others over the budget.
+    std::shared_ptr<const MeasuredText> insert(size_t chunk,
+                                               std::unique_ptr<MeasuredText>&& measured);
+    std::unique_ptr<MeasureHandle> measureAsync(size_t chunk);
+    void evict(size_t chunk);
+
+    U16StringPiece mText;
+    RunProvider mRunProvider;
+    bool mComputeHyphenation;
+    bool mComputeLayout;
+    bool mIgnoreHyphenKerning;
+    uint32_t mMemoryBudget;
+
+    std::vector<Chunk> mChunks;
+    // The resident chunks, the most recently used first.
+    std::list<size_t> mLru;
+    uint32_t mMemoryUsage = 0;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(StreamingMeasuredText);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_STREAMING_MEASURED_TEXT_H
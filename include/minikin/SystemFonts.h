@@ -17,17 +17,22 @@
 #ifndef MINIKIN_SYSTEM_FONTS_H
 #define MINIKIN_SYSTEM_FONTS_H
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
+#include "minikin/Buffer.h"
+#include "minikin/CacheStats.h"
 #include "minikin/FontCollection.h"
 #include "minikin/U16StringPiece.h"
 
 namespace minikin {
 
-// Provides a system font mapping.
+// Provides a system font mapping. The mapping is an immutable registry replaced as a whole on
+// every update, so that the lookups read it without locking while the fonts are updated.
 class SystemFonts {
 public:
     static std::shared_ptr<FontCollection> findFontCollection(const std::string& familyName) {
@@ -49,11 +54,36 @@ public:
         return getInstance().addFontMapInternal(std::move(collections));
     }
 
-    // This obtains a mutex inside, so do not call this method inside callback.
+    // The font set is built once per update of the fonts, and the callback is called without a
+    // lock held, with the fonts registered at the call.
     static void getFontSet(std::function<void(const std::vector<std::shared_ptr<Font>>&)> func) {
         return getInstance().getFontSetInternal(func);
     }
 
+    // The contention on the lock of the updates of the registered fonts.
+    static const LockStats& getLockStats() { return getInstance().mLockStats; }
+
+    // The snapshot begins with a header of this size, so that the collections begin on a page
+    // boundary of a mapped file.
+    static constexpr uint32_t kSnapshotHeaderSize = 4096;
+
+    // Writes the default fallback, the named fallbacks and the font maps as a snapshot which
+    // adoptSnapshot restores without building the collections again, e.g. from a file mapped by
+    // a process which doesn't start from the zygote. The locale lists of the families are written
+    // with them. Write to a BufferWriter(nullptr) first to compute the size of the buffer. The
+    // writer must be at the beginning of the buffer.
+    static void writeSnapshot(BufferWriter* writer) {
+        return getInstance().writeSnapshotInternal(writer);
+    }
+
+    // Replaces the registered fonts with the ones of the snapshot of the given size. The coverages
+    // are used in place, so the data must outlive SystemFonts and is best a read-only mapping of
+    // the file, aligned at a page. Returns false without changing the fonts if the snapshot is
+    // truncated, corrupted or of another format version.
+    static bool adoptSnapshot(const void* data, size_t size) {
+        return getInstance().adoptSnapshotInternal(data, size);
+    }
+
 protected:
     // Visible for testing purposes.
     SystemFonts() {}
@@ -62,39 +92,64 @@ protected:
     std::shared_ptr<FontCollection> findFontCollectionInternal(const std::string& familyName);
     void registerFallbackInternal(const std::string& familyName,
                                   const std::shared_ptr<FontCollection>& fc) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mSystemFallbacks[familyName] = fc;
+        update([&](Registry* registry) { registry->fallbacks[familyName] = fc; });
     }
 
     void registerDefaultInternal(const std::shared_ptr<FontCollection>& fc) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mDefaultFallback = fc;
+        update([&](Registry* registry) { registry->defaultFallback = fc; });
     }
 
     void addFontMapInternal(std::shared_ptr<FontCollection>&& collections) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mCollections.emplace_back(std::move(collections));
+        update([&](Registry* registry) {
+            registry->collections.emplace_back(std::move(collections));
+        });
     }
 
-    void getFontSetInternal(std::function<void(const std::vector<std::shared_ptr<Font>>&)> func) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        if (!mFonts) {
-            buildFontSetLocked();
-        }
-        func(mFonts.value());
-    }
+    void getFontSetInternal(std::function<void(const std::vector<std::shared_ptr<Font>>&)> func);
+
+    void writeSnapshotInternal(BufferWriter* writer);
+    bool adoptSnapshotInternal(const void* data, size_t size);
 
 private:
+    // The fonts registered at some point. Never modified once published.
+    struct Registry {
+        Registry() {}
+        Registry(const Registry& o)
+                : fallbacks(o.fallbacks),
+                  defaultFallback(o.defaultFallback),
+                  collections(o.collections) {}
+
+        std::map<std::string, std::shared_ptr<FontCollection>> fallbacks;
+        std::shared_ptr<FontCollection> defaultFallback;
+        std::vector<std::shared_ptr<FontCollection>> collections;
+
+        // The fonts of the collections, built by the first getFontSet.
+        mutable std::once_flag fontSetOnce;
+        mutable std::vector<std::shared_ptr<Font>> fontSet;
+
+        const std::vector<std::shared_ptr<Font>>& getFontSet() const;
+    };
+
     static SystemFonts& getInstance();
 
-    void buildFontSetLocked() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    // Returns the current registry. Doesn't lock.
+    std::shared_ptr<const Registry> load() const { return std::atomic_load(&mRegistry); }
+
+    // Publishes a copy of the current registry modified by the function.
+    template <typename F>
+    void update(F&& f) {
+        std::unique_lock<std::mutex> lock = mLockStats.lock(mUpdateMutex);
+        auto registry = std::make_shared<Registry>(*load());
+        f(registry.get());
+        std::atomic_store(&mRegistry, std::shared_ptr<const Registry>(std::move(registry)));
+    }
 
-    std::map<std::string, std::shared_ptr<FontCollection>> mSystemFallbacks GUARDED_BY(mMutex);
-    std::shared_ptr<FontCollection> mDefaultFallback GUARDED_BY(mMutex);
-    std::vector<std::shared_ptr<FontCollection>> mCollections GUARDED_BY(mMutex);
-    std::optional<std::vector<std::shared_ptr<Font>>> mFonts GUARDED_BY(mMutex);
+    // Only accessed with the atomic shared_ptr functions.
+    std::shared_ptr<const Registry> mRegistry = std::make_shared<Registry>();
 
-    std::mutex mMutex;
+    // Serializes the updates, so that none is lost. The lookups don't take it.
+    std::mutex mUpdateMutex;
+    LockStats mLockStats;
 };
 
 }  // namespace minikin
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_TEXT_SCAN_H
+#define MINIKIN_TEXT_SCAN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "minikin/Characters.h"
+#include "minikin/U16StringPiece.h"
+
+namespace minikin {
+
+// The scans shared by the per-character passes. The indices are checked a block at a time, and
+// the loop over a block has no early exit so that the compiler can vectorize it. The predicates
+// must be cheap and free of side effects, since they are evaluated for whole blocks.
+constexpr size_t kScanBlockSize = 64;
+
+// Returns true if pred(i) is true for every i in [start, end).
+template <typename Pred>
+inline bool scanAll(size_t start, size_t end, Pred pred) {
+    for (size_t blockStart = start; blockStart < end; blockStart += kScanBlockSize) {
+        const size_t blockEnd = std::min(end, blockStart + kScanBlockSize);
+        bool all = true;
+        for (size_t i = blockStart; i < blockEnd; ++i) {
+            all &= pred(i);
+        }
+        if (!all) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Calls f(blockStart, blockEnd) for each block of [start, end) in which mayMatch(i) is true for
+// some i, skipping the other blocks. f returns false to stop the scan, in which case this returns
+// false too.
+template <typename Pred, typename F>
+inline bool scanCandidateBlocks(size_t start, size_t end, Pred mayMatch, F f) {
+    for (size_t blockStart = start; blockStart < end; blockStart += kScanBlockSize) {
+        const size_t blockEnd = std::min(end, blockStart + kScanBlockSize);
+        bool mayMatchInBlock = false;
+        for (size_t i = blockStart; i < blockEnd; ++i) {
+            mayMatchInBlock |= mayMatch(i);
+        }
+        if (mayMatchInBlock && !f(blockStart, blockEnd)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the largest code unit of the text, or 0 if it is empty.
+inline uint16_t maxCodeUnit(const uint16_t* text, size_t size) {
+    uint16_t maxChar = 0;
+    for (size_t i = 0; i < size; ++i) {
+        maxChar = std::max(maxChar, text[i]);
+    }
+    return maxChar;
+}
+
+// What a paragraph has, computed in a single pass by MeasuredText and handed down to the passes
+// over the paragraph, so that they skip what it can't have. Only the line breakers use it for now.
+struct TextClass {
+    bool hasTab = false;
+
+    static TextClass of(const U16StringPiece& textBuf) {
+        const uint16_t* text = textBuf.data();
+        bool hasTab = false;
+        for (size_t i = 0; i < textBuf.size(); ++i) {
+            hasTab |= text[i] == CHAR_TAB;
+        }
+        return TextClass{hasTab};
+    }
+
+    inline bool operator==(const TextClass& o) const { return hasTab == o.hasTab; }
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_TEXT_SCAN_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_UTF8_TEXT_H
+#define MINIKIN_UTF8_TEXT_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "minikin/Macros.h"
+#include "minikin/Range.h"
+#include "minikin/U16StringPiece.h"
+
+namespace minikin {
+
+// A UTF-8 text transcoded in a single pass to the UTF-16 taken by Layout, MeasuredTextBuilder and
+// breakIntoLines, with the mapping of the offsets between the two encodings, e.g. to pass a range
+// of the UTF-8 text to Layout or to map the line breaks back to the UTF-8 text.
+//
+// The ill-formed sequences are transcoded to U+FFFD, one per maximal subpart as done by ICU.
+class Utf8Text {
+public:
+    explicit Utf8Text(std::string_view utf8);
+
+    // The transcoded text, valid while this object is alive.
+    U16StringPiece utf16() const { return mText; }
+
+    uint32_t utf8Size() const { return mUtf8Offsets.back(); }
+
+    // Returns the UTF-8 offset of the character at the UTF-16 offset. The offset of a trailing
+    // surrogate is the one of its character.
+    uint32_t toUtf8Offset(uint32_t utf16Offset) const { return mUtf8Offsets[utf16Offset]; }
+
+    // Returns the UTF-16 offset of the character at the UTF-8 offset. An offset in the middle of a
+    // character is rounded up to the next character.
+    uint32_t toUtf16Offset(uint32_t utf8Offset) const;
+
+    Range toUtf8(const Range& utf16Range) const {
+        return Range(toUtf8Offset(utf16Range.getStart()), toUtf8Offset(utf16Range.getEnd()));
+    }
+
+    Range toUtf16(const Range& utf8Range) const {
+        return Range(toUtf16Offset(utf8Range.getStart()), toUtf16Offset(utf8Range.getEnd()));
+    }
+
+private:
+    std::vector<uint16_t> mText;
+    // The UTF-8 offset of each UTF-16 code unit, followed by the size of the UTF-8 text.
+    std::vector<uint32_t> mUtf8Offsets;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(Utf8Text);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_UTF8_TEXT_H
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_VARIATION_SEQUENCE_COVERAGE_H
+#define MINIKIN_VARIATION_SEQUENCE_COVERAGE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "minikin/Buffer.h"
+#include "minikin/SparseBitSet.h"
+
+namespace minikin {
+
+// The base code points of the variation sequences of a font (cmap format 14 subtable), indexed by
+// the VS index of the variation selector (see getVsIndex()).
+//
+// Most variation selectors of a font cover a few code points, so a set of up to
+// kMaxSortedSize code points is kept as a sorted array shared by all the variation selectors, and
+// only the larger sets are kept as SparseBitSet.
+class VariationSequenceCoverage {
+public:
+    // The largest set stored as sorted code points.
+    static constexpr uint32_t kMaxSortedSize = 256;
+
+    VariationSequenceCoverage()
+            : mEntries(nullptr), mEntryCount(0), mCodePoints(nullptr), mCodePointCount(0) {}
+
+    // Builds the coverage from the sets indexed by the VS index, as returned by
+    // CmapCoverage::getCoverage. The small sets are freed.
+    explicit VariationSequenceCoverage(std::vector<SparseBitSet>&& coverages);
+
+    // Reads the coverage written by writeTo. The arrays are mapped from the buffer.
+    explicit VariationSequenceCoverage(BufferReader* reader);
+
+    VariationSequenceCoverage(VariationSequenceCoverage&& o) noexcept
+            : VariationSequenceCoverage() {
+        *this = std::move(o);
+    }
+    VariationSequenceCoverage& operator=(VariationSequenceCoverage&& o) noexcept;
+
+    void writeTo(BufferWriter* writer) const;
+
+    // Returns true if the variation sequence of the code point and the VS index is covered.
+    bool get(uint32_t codePoint, uint16_t vsIndex) const {
+        if (vsIndex >= mEntryCount) {
+            return false;
+        }
+        const Entry& entry = mEntries[vsIndex];
+        if (entry.end == kBitSetEntry) {
+            return mBitSets[entry.start].get(codePoint);
+        }
+        return containsSorted(entry, codePoint);
+    }
+
+    // The number of the VS indices, one more than the largest VS index with a set.
+    uint16_t size() const { return mEntryCount; }
+
+    bool empty() const { return mEntryCount == 0; }
+
+private:
+    // The range of the code points of a VS index in mCodePoints, or the index in mBitSets if end
+    // is kBitSetEntry.
+    struct Entry {
+        uint32_t start;
+        uint32_t end;
+    };
+
+    static constexpr uint32_t kBitSetEntry = ~0u;
+
+    bool containsSorted(const Entry& entry, uint32_t codePoint) const;
+
+    // Point to mOwnedEntries and mOwnedCodePoints, or to the buffer the coverage is read from.
+    const Entry* mEntries;
+    uint16_t mEntryCount;
+    const uint32_t* mCodePoints;
+    uint32_t mCodePointCount;
+    std::vector<Entry> mOwnedEntries;
+    std::vector<uint32_t> mOwnedCodePoints;
+    std::vector<SparseBitSet> mBitSets;
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_VARIATION_SEQUENCE_COVERAGE_H
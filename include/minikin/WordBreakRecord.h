@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_WORD_BREAK_RECORD_H
+#define MINIKIN_WORD_BREAK_RECORD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "minikin/LineBreakStyle.h"
+
+namespace minikin {
+
+// The ICU line break boundaries of a paragraph, recorded once so that the line breakers can break
+// the paragraph again at other widths without running ICU. The boundaries don't depend on the
+// width.
+//
+// A segment holds the boundaries found by an ICU breaker of a locale and line break styles,
+// starting after the offset where the breaker is set. Offsets out of the recorded boundaries are
+// left to ICU.
+class WordBreakRecord {
+public:
+    struct Segment {
+        // The offset the breaker is set at, i.e. the start of the run changing the locale.
+        uint32_t start;
+        uint64_t localeId;
+        LineBreakStyle lbStyle;
+        LineBreakWordStyle lbWordStyle;
+
+        // The boundaries of the segment in boundaries.
+        uint32_t boundaryStart;
+        uint32_t boundaryEnd;
+
+        // True if there is no boundary after the recorded ones.
+        bool reachesEnd;
+    };
+
+    // Sorted by start.
+    std::vector<Segment> segments;
+    // The boundaries of all the segments, each sorted and all greater than the segment start.
+    std::vector<uint32_t> boundaries;
+
+    bool empty() const { return segments.empty(); }
+
+    void clear() {
+        segments.clear();
+        boundaries.clear();
+    }
+
+    // Returns the segment recorded for a breaker set at the offset, or nullptr.
+    const Segment* find(uint32_t start, uint64_t localeId, LineBreakStyle lbStyle,
+                        LineBreakWordStyle lbWordStyle) const;
+
+    uint32_t getMemoryUsage() const {
+        return sizeof(Segment) * segments.size() + sizeof(uint32_t) * boundaries.size();
+    }
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_WORD_BREAK_RECORD_H
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/Allocator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace minikin {
+
+namespace {
+
+class DefaultAllocator : public Allocator {
+public:
+    void* allocate(size_t bytes) override { return ::operator new(bytes); }
+    void deallocate(void* ptr) override { ::operator delete(ptr); }
+};
+
+DefaultAllocator gDefaultAllocator;
+std::atomic<Allocator*> gAllocator(&gDefaultAllocator);
+
+// The header of a block, padded so that the block keeps the alignment of the allocator.
+constexpr size_t kBlockHeaderSize = alignof(std::max_align_t);
+static_assert(sizeof(Allocator*) <= kBlockHeaderSize, "The header must fit the allocator");
+
+}  // namespace
+
+// static
+Allocator& Allocator::get() {
+    return *gAllocator.load(std::memory_order_relaxed);
+}
+
+// static
+void Allocator::set(Allocator* allocator) {
+    gAllocator.store(allocator == nullptr ? &gDefaultAllocator : allocator,
+                     std::memory_order_relaxed);
+}
+
+void* allocateBlock(size_t bytes) {
+    Allocator* allocator = &Allocator::get();
+    uint8_t* block = static_cast<uint8_t*>(allocator->allocate(kBlockHeaderSize + bytes));
+    *reinterpret_cast<Allocator**>(block) = allocator;
+    return block + kBlockHeaderSize;
+}
+
+void freeBlock(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    uint8_t* block = static_cast<uint8_t*>(ptr) - kBlockHeaderSize;
+    (*reinterpret_cast<Allocator**>(block))->deallocate(block);
+}
+
+}  // namespace minikin
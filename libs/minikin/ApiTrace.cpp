@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/ApiTrace.h"
+
+#include <unicode/uchar.h>
+#include <unicode/uscript.h>
+#include <unicode/utf16.h>
+
+#include <algorithm>
+
+#include "minikin/Font.h"
+#include "minikin/FontCollection.h"
+#include "minikin/FontFamily.h"
+#include "minikin/Hasher.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+namespace minikin {
+
+namespace {
+
+// Bump this when changing the format written by ApiTrace::writeTo().
+constexpr uint32_t kTraceVersion = 1;
+
+constexpr uint16_t kReplacementChar = 0xFFFD;
+
+// The fewest bytes taken by an entry of each kind in a trace, e.g. a family with empty locales and
+// no fonts, which bound the counts read from it.
+constexpr size_t kMinCollectionSize = 4;
+constexpr size_t kMinFamilySize = 10;
+constexpr size_t kMinFontSize = 15;
+constexpr size_t kMinAxisSize = 8;
+constexpr size_t kMinRunSize = 17;
+constexpr size_t kMinCallSize = 12;
+
+uint32_t hashText(const U16StringPiece& text) {
+    return Hasher().updateShorts(text.data(), text.size()).hash();
+}
+
+std::string getFileName(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::vector<ApiTrace::FamilyEntry> makeFamilyEntries(const FontCollection& collection) {
+    std::vector<ApiTrace::FamilyEntry> families;
+    families.reserve(collection.getFamilyCount());
+    Font::ExternalRefsGuard externalRefsGuard;
+    for (size_t i = 0; i < collection.getFamilyCount(); ++i) {
+        const FontFamily& family = *collection.getFamilyAt(i);
+        ApiTrace::FamilyEntry entry = {getLocaleString(family.localeListId()), family.variant(),
+                                       family.isCustomFallback(), {}};
+        for (size_t j = 0; j < family.getNumFonts(); ++j) {
+            const Font* font = family.getFont(j);
+            const std::shared_ptr<MinikinFont>& typeface = font->typeface();
+            entry.fonts.push_back({getFileName(typeface->GetFontPath()),
+                                   static_cast<uint32_t>(typeface->GetFontIndex()), font->style(),
+                                   typeface->GetAxes()});
+        }
+        families.push_back(std::move(entry));
+    }
+    return families;
+}
+
+void writePaint(BufferWriter* writer, const ApiTrace::PaintEntry& paint) {
+    writer->write<uint32_t>(paint.collection);
+    writer->write<float>(paint.size);
+    writer->write<float>(paint.scaleX);
+    writer->write<float>(paint.skewX);
+    writer->write<float>(paint.letterSpacing);
+    writer->write<float>(paint.wordSpacing);
+    writer->write<uint32_t>(paint.fontFlags);
+    writer->writeString(paint.locales);
+    paint.fontStyle.writeTo(writer);
+    writer->write<uint8_t>(static_cast<uint8_t>(paint.familyVariant));
+    writer->writeString(paint.fontFeatureSettings.str());
+}
+
+ApiTrace::PaintEntry readPaint(BufferReader* reader) {
+    ApiTrace::PaintEntry paint;
+    paint.collection = reader->read<uint32_t>();
+    paint.size = reader->read<float>();
+    paint.scaleX = reader->read<float>();
+    paint.skewX = reader->read<float>();
+    paint.letterSpacing = reader->read<float>();
+    paint.wordSpacing = reader->read<float>();
+    paint.fontFlags = reader->read<uint32_t>();
+    paint.locales = reader->readString();
+    paint.fontStyle = FontStyle(reader);
+    paint.familyVariant = static_cast<FamilyVariant>(reader->read<uint8_t>());
+    paint.fontFeatureSettings = reader->readString();
+    return paint;
+}
+
+void writeRange(BufferWriter* writer, const Range& range) {
+    writer->write<uint32_t>(range.getStart());
+    writer->write<uint32_t>(range.getEnd());
+}
+
+Range readRange(BufferReader* reader) {
+    const uint32_t start = reader->read<uint32_t>();
+    const uint32_t end = reader->read<uint32_t>();
+    return Range(start, end);
+}
+
+template <typename T>
+std::vector<T> readVector(BufferReader* reader) {
+    const auto [data, size] = reader->readArray<T>();
+    return std::vector<T>(data, data + size);
+}
+
+// Reads the count of the entries that follow. A count of more entries than the bytes left can hold
+// is malformed and rejected before anything is allocated for it.
+bool readCount(BufferReader* reader, size_t minEntrySize, uint32_t* out) {
+    *out = reader->read<uint32_t>();
+    return !reader->overflowed() && *out <= reader->remaining() / minEntrySize;
+}
+
+bool isValidRange(const Range& range, const std::vector<uint16_t>& text) {
+    return range.getStart() <= range.getEnd() && range.getEnd() <= text.size();
+}
+
+bool isValidPaint(const ApiTrace::PaintEntry& paint, size_t collectionCount) {
+    return paint.collection < collectionCount && paint.familyVariant <= FamilyVariant::ELEGANT;
+}
+
+void writeCall(BufferWriter* writer, const ApiTrace::Call& call) {
+    writer->write<uint8_t>(static_cast<uint8_t>(call.type));
+    switch (call.type) {
+        case ApiTrace::CallType::Layout:
+        case ApiTrace::CallType::MeasureText:
+            writer->writeArray<uint16_t>(call.text.data(), call.text.size());
+            writeRange(writer, call.range);
+            writer->write<uint8_t>(static_cast<uint8_t>(call.bidi));
+            writePaint(writer, call.paint);
+            writer->write<uint8_t>(static_cast<uint8_t>(call.startHyphen));
+            writer->write<uint8_t>(static_cast<uint8_t>(call.endHyphen));
+            break;
+        case ApiTrace::CallType::Build:
+            writer->writeArray<uint16_t>(call.text.data(), call.text.size());
+            writer->write<uint8_t>(call.computeHyphenation);
+            writer->write<uint8_t>(call.computeLayout);
+            writer->write<uint8_t>(call.ignoreHyphenKerning);
+            writer->write<uint32_t>(call.runs.size());
+            for (const ApiTrace::RunEntry& run : call.runs) {
+                writeRange(writer, run.range);
+                writer->write<uint8_t>(run.isStyleRun);
+                if (run.isStyleRun) {
+                    writePaint(writer, run.paint);
+                    writer->write<int32_t>(run.lineBreakStyle);
+                    writer->write<int32_t>(run.lineBreakWordStyle);
+                    writer->write<uint8_t>(run.isRtl);
+                } else {
+                    writer->write<float>(run.width);
+                    writer->writeString(run.locales);
+                }
+            }
+            break;
+        case ApiTrace::CallType::BreakIntoLines:
+            writer->write<uint32_t>(call.measuredText);
+            writer->write<uint8_t>(static_cast<uint8_t>(call.strategy));
+            writer->write<uint8_t>(static_cast<uint8_t>(call.frequency));
+            writer->write<uint8_t>(call.justified);
+            writer->writeArray<float>(call.lineWidths.data(), call.lineWidths.size());
+            writer->write<float>(call.minLineWidth);
+            writer->writeArray<float>(call.tabStops.data(), call.tabStops.size());
+            writer->write<float>(call.tabWidth);
+            writer->write<uint32_t>(call.maxLines);
+            break;
+    }
+}
+
+// Reads the index-th call of the trace, whose collections and previous calls are already read.
+// Returns false if the call is malformed or refers to what has not been read.
+bool readCall(BufferReader* reader, uint32_t index, const ApiTrace::Trace& trace,
+              ApiTrace::Call* out) {
+    ApiTrace::Call& call = *out;
+    call = {};
+    call.type = static_cast<ApiTrace::CallType>(reader->read<uint8_t>());
+    switch (call.type) {
+        case ApiTrace::CallType::Layout:
+        case ApiTrace::CallType::MeasureText:
+            call.text = readVector<uint16_t>(reader);
+            call.range = readRange(reader);
+            call.bidi = static_cast<Bidi>(reader->read<uint8_t>());
+            call.paint = readPaint(reader);
+            call.startHyphen = static_cast<StartHyphenEdit>(reader->read<uint8_t>());
+            call.endHyphen = static_cast<EndHyphenEdit>(reader->read<uint8_t>());
+            if (!isValidRange(call.range, call.text) || call.bidi > Bidi::FORCE_RTL ||
+                !isValidPaint(call.paint, trace.collections.size()) ||
+                call.startHyphen > StartHyphenEdit::INSERT_ZWJ ||
+                call.endHyphen > EndHyphenEdit::INSERT_ZWJ_AND_HYPHEN) {
+                return false;
+            }
+            break;
+        case ApiTrace::CallType::Build: {
+            call.text = readVector<uint16_t>(reader);
+            call.computeHyphenation = reader->read<uint8_t>();
+            call.computeLayout = reader->read<uint8_t>();
+            call.ignoreHyphenKerning = reader->read<uint8_t>();
+            uint32_t runCount;
+            if (!readCount(reader, kMinRunSize, &runCount)) {
+                return false;
+            }
+            call.runs.resize(runCount);
+            for (ApiTrace::RunEntry& run : call.runs) {
+                run.range = readRange(reader);
+                run.isStyleRun = reader->read<uint8_t>();
+                if (run.isStyleRun) {
+                    run.paint = readPaint(reader);
+                    run.lineBreakStyle = reader->read<int32_t>();
+                    run.lineBreakWordStyle = reader->read<int32_t>();
+                    run.isRtl = reader->read<uint8_t>();
+                } else {
+                    run.width = reader->read<float>();
+                    run.locales = reader->readString();
+                }
+                if (!isValidRange(run.range, call.text) ||
+                    (run.isStyleRun && !isValidPaint(run.paint, trace.collections.size()))) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case ApiTrace::CallType::BreakIntoLines:
+            call.measuredText = reader->read<uint32_t>();
+            call.strategy = static_cast<BreakStrategy>(reader->read<uint8_t>());
+            call.frequency = static_cast<HyphenationFrequency>(reader->read<uint8_t>());
+            call.justified = reader->read<uint8_t>();
+            call.lineWidths = readVector<float>(reader);
+            call.minLineWidth = reader->read<float>();
+            call.tabStops = readVector<float>(reader);
+            call.tabWidth = reader->read<float>();
+            call.maxLines = reader->read<uint32_t>();
+            // The text must be built by a previous call.
+            if (call.measuredText >= index ||
+                trace.calls[call.measuredText].type != ApiTrace::CallType::Build ||
+                call.strategy > BreakStrategy::Balanced ||
+                call.frequency > HyphenationFrequency::Full || call.lineWidths.empty()) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    return !reader->overflowed();
+}
+
+}  // namespace
+
+void ApiTrace::setRecording(bool enabled, bool anonymize) {
+    mAnonymize.store(anonymize, std::memory_order_relaxed);
+    mRecording.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+std::vector<uint16_t> ApiTrace::anonymize(const U16StringPiece& text) {
+    std::vector<uint16_t> out;
+    out.reserve(text.size());
+    uint32_t i = 0;
+    while (i < text.size()) {
+        UChar32 c;
+        const uint32_t start = i;
+        U16_NEXT(text.data(), i, text.size(), c);
+        const uint32_t length = i - start;
+        if (U_GET_GC_MASK(c) & U_GC_L_MASK) {
+            UErrorCode status = U_ZERO_ERROR;
+            const UScriptCode script = uscript_getScript(c, &status);
+            UChar sample[U16_MAX_LENGTH];
+            const int32_t sampleLength =
+                    U_SUCCESS(status)
+                            ? uscript_getSampleString(script, sample, U16_MAX_LENGTH, &status)
+                            : 0;
+            if (U_SUCCESS(status) && static_cast<uint32_t>(sampleLength) == length) {
+                out.insert(out.end(), sample, sample + sampleLength);
+            } else {
+                // Keeps the offsets of the following characters.
+                out.insert(out.end(), length, kReplacementChar);
+            }
+        } else if (u_charType(c) == U_DECIMAL_DIGIT_NUMBER) {
+            // The ten digits of a script are contiguous, so the zero is in the same plane.
+            const UChar32 zero = c - u_charDigitValue(c);
+            uint32_t outLength = 0;
+            UChar units[U16_MAX_LENGTH];
+            U16_APPEND_UNSAFE(units, outLength, zero);
+            out.insert(out.end(), units, units + outLength);
+        } else {
+            out.insert(out.end(), text.data() + start, text.data() + i);
+        }
+    }
+    return out;
+}
+
+std::vector<uint16_t> ApiTrace::copyText(const U16StringPiece& text) const {
+    if (mAnonymize.load(std::memory_order_relaxed)) {
+        return anonymize(text);
+    }
+    return std::vector<uint16_t>(text.data(), text.data() + text.size());
+}
+
+ApiTrace::PaintEntry ApiTrace::makePaintEntry(const MinikinPaint& paint) {
+    auto it = mCollections.find(paint.font->getId());
+    if (it == mCollections.end()) {
+        it = mCollections.emplace(paint.font->getId(), mTrace.collections.size()).first;
+        mTrace.collections.push_back(makeFamilyEntries(*paint.font));
+    }
+    return {it->second,
+            paint.size,
+            paint.scaleX,
+            paint.skewX,
+            paint.letterSpacing,
+            paint.wordSpacing,
+            paint.fontFlags,
+            getLocaleString(paint.localeListId),
+            paint.fontStyle,
+            paint.familyVariant,
+            paint.fontFeatureSettings};
+}
+
+void ApiTrace::recordLayoutInternal(CallType type, const U16StringPiece& text, const Range& range,
+                                    Bidi bidiFlags, const MinikinPaint& paint,
+                                    StartHyphenEdit startHyphen, EndHyphenEdit endHyphen) {
+    Call call = {};
+    call.type = type;
+    call.text = copyText(text);
+    call.range = range;
+    call.bidi = bidiFlags;
+    call.startHyphen = startHyphen;
+    call.endHyphen = endHyphen;
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTrace.calls.size() >= kMaxRecordedCalls) {
+        return;
+    }
+    call.paint = makePaintEntry(paint);
+    mTrace.calls.push_back(std::move(call));
+}
+
+void ApiTrace::recordBuildInternal(const U16StringPiece& text, const MeasuredText& measuredText,
+                                   bool computeHyphenation, bool computeLayout,
+                                   bool ignoreHyphenKerning) {
+    Call call = {};
+    call.type = CallType::Build;
+    call.text = copyText(text);
+    call.computeHyphenation = computeHyphenation;
+    call.computeLayout = computeLayout;
+    call.ignoreHyphenKerning = ignoreHyphenKerning;
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTrace.calls.size() >= kMaxRecordedCalls) {
+        return;
+    }
+    for (const auto& run : measuredText.runs) {
+        RunEntry entry = {};
+        entry.range = run->getRange();
+        if (run->getType() == Run::Type::Style) {
+            entry.isStyleRun = true;
+            entry.paint = makePaintEntry(*run->getPaint());
+            entry.lineBreakStyle = static_cast<int>(run->lineBreakStyle());
+            entry.lineBreakWordStyle = static_cast<int>(run->lineBreakWordStyle());
+            entry.isRtl = run->isRtl();
+        } else {
+            entry.isStyleRun = false;
+            for (uint32_t i : run->getRange()) {
+                entry.width += measuredText.getCharWidth(i);
+            }
+            entry.locales = getLocaleString(run->getLocaleListId());
+        }
+        call.runs.push_back(std::move(entry));
+    }
+    mBuiltTexts[&measuredText] = {static_cast<uint32_t>(mTrace.calls.size()), hashText(text)};
+    mTrace.calls.push_back(std::move(call));
+}
+
+void ApiTrace::recordBreakIntoLinesInternal(const U16StringPiece& text, BreakStrategy strategy,
+                                            HyphenationFrequency frequency, bool justified,
+                                            const MeasuredText& measuredText,
+                                            const LineWidth& lineWidth, const TabStops& tabStops,
+                                            uint32_t maxLines, size_t lineCount) {
+    Call call = {};
+    call.type = CallType::BreakIntoLines;
+    call.strategy = strategy;
+    call.frequency = frequency;
+    call.justified = justified;
+    // The breaking may have asked for the width of the line after the last one.
+    for (size_t i = 0; i <= lineCount; ++i) {
+        call.lineWidths.push_back(lineWidth.getAt(i));
+    }
+    call.minLineWidth = lineWidth.getMin();
+    call.tabStops.assign(tabStops.getStops(), tabStops.getStops() + tabStops.getStopCount());
+    call.tabWidth = tabStops.getTabWidth();
+    call.maxLines = maxLines;
+    const uint32_t textHash = hashText(text);
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTrace.calls.size() >= kMaxRecordedCalls) {
+        return;
+    }
+    auto it = mBuiltTexts.find(&measuredText);
+    if (it == mBuiltTexts.end() || it->second.textHash != textHash) {
+        return;
+    }
+    call.measuredText = it->second.callIndex;
+    mTrace.calls.push_back(std::move(call));
+}
+
+void ApiTrace::writeTo(BufferWriter* writer) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    writer->write<uint32_t>(kTraceVersion);
+    writer->write<uint32_t>(mTrace.collections.size());
+    for (const std::vector<FamilyEntry>& families : mTrace.collections) {
+        writer->write<uint32_t>(families.size());
+        for (const FamilyEntry& family : families) {
+            writer->writeString(family.locales);
+            writer->write<uint8_t>(static_cast<uint8_t>(family.variant));
+            writer->write<uint8_t>(family.isCustomFallback);
+            writer->write<uint32_t>(family.fonts.size());
+            for (const FontEntry& font : family.fonts) {
+                writer->writeString(font.fileName);
+                writer->write<uint32_t>(font.index);
+                font.style.writeTo(writer);
+                writer->write<uint32_t>(font.axes.size());
+                for (const FontVariation& axis : font.axes) {
+                    writer->write<uint32_t>(axis.axisTag);
+                    writer->write<float>(axis.value);
+                }
+            }
+        }
+    }
+    writer->write<uint32_t>(mTrace.calls.size());
+    for (const Call& call : mTrace.calls) {
+        writeCall(writer, call);
+    }
+}
+
+// static
+bool ApiTrace::readFrom(BufferReader* reader, Trace* out) {
+    if (reader->read<uint32_t>() != kTraceVersion) {
+        return false;
+    }
+    uint32_t count;
+    if (!readCount(reader, kMinCollectionSize, &count)) {
+        return false;
+    }
+    out->collections.clear();
+    out->collections.resize(count);
+    for (std::vector<FamilyEntry>& families : out->collections) {
+        if (!readCount(reader, kMinFamilySize, &count)) {
+            return false;
+        }
+        families.resize(count);
+        for (FamilyEntry& family : families) {
+            family.locales = reader->readString();
+            family.variant = static_cast<FamilyVariant>(reader->read<uint8_t>());
+            family.isCustomFallback = reader->read<uint8_t>();
+            if (family.variant > FamilyVariant::ELEGANT ||
+                !readCount(reader, kMinFontSize, &count)) {
+                return false;
+            }
+            family.fonts.resize(count);
+            for (FontEntry& font : family.fonts) {
+                font.fileName = reader->readString();
+                font.index = reader->read<uint32_t>();
+                font.style = FontStyle(reader);
+                if (!readCount(reader, kMinAxisSize, &count)) {
+                    return false;
+                }
+                font.axes.resize(count);
+                for (FontVariation& axis : font.axes) {
+                    axis.axisTag = reader->read<uint32_t>();
+                    axis.value = reader->read<float>();
+                }
+            }
+        }
+    }
+    if (!readCount(reader, kMinCallSize, &count)) {
+        return false;
+    }
+    out->calls.clear();
+    out->calls.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        ApiTrace::Call call;
+        if (!readCall(reader, i, *out, &call)) {
+            return false;
+        }
+        out->calls.push_back(std::move(call));
+    }
+    return !reader->overflowed();
+}
+
+void ApiTrace::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTrace.collections.clear();
+    mTrace.calls.clear();
+    mCollections.clear();
+    mBuiltTexts.clear();
+}
+
+uint32_t ApiTrace::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTrace.calls.size();
+}
+
+}  // namespace minikin
@@ -19,11 +19,13 @@
 #include "BidiUtils.h"
 
 #include <algorithm>
+#include <vector>
 
 #include <unicode/ubidi.h>
 #include <unicode/utf16.h>
 
 #include "minikin/Emoji.h"
+#include "minikin/TextScan.h"
 
 #include "MinikinInternal.h"
 
@@ -49,6 +51,68 @@ static inline UBiDiLevel bidiToUBidiLevel(Bidi bidi) {
     }
 }
 
+// Returns true if the code unit is a character of the right-to-left blocks, including the
+// unassigned ones defaulting to R or AL and the Arabic digits, or an explicit embedding, override
+// or isolate, or the high surrogate of such a character.
+static inline bool mayBeRtl(uint16_t c) {
+    return (0x0590 <= c && c <= 0x08FF)        // Hebrew to Arabic Extended-A
+           || c == 0x200F                      // RIGHT-TO-LEFT MARK
+           || (0x202A <= c && c <= 0x202E)     // Embeddings and overrides
+           || (0x2066 <= c && c <= 0x2069)     // Isolates
+           || (0xFB1D <= c && c <= 0xFDFF)     // Hebrew and Arabic presentation forms
+           || (0xFE70 <= c && c <= 0xFEFE)     // Arabic Presentation Forms-B
+           || c == 0xD802 || c == 0xD803       // The high surrogates of U+10800..U+10FFF
+           || c == 0xD83A || c == 0xD83B;      // The high surrogates of U+1E800..U+1EFFF
+}
+
+// Returns true if the text may have a character resolved to an RTL or a higher level in an LTR
+// paragraph. Its only purpose is to skip ubidi, so it may err on the side of true.
+static bool mayHaveRtlLevels(const U16StringPiece& textBuf) {
+    const uint16_t* text = textBuf.data();
+    // The blocks below Hebrew are skipped with a test simple enough to be vectorized.
+    return !scanCandidateBlocks(
+            0, textBuf.size(), [text](size_t i) { return text[i] >= 0x0590; },
+            [text](size_t blockStart, size_t blockEnd) {
+                for (size_t i = blockStart; i < blockEnd; ++i) {
+                    if (mayBeRtl(text[i])) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+}
+
+// The UBiDi objects released by the BidiTexts of a thread, kept for the next ones with the emoji
+// class callback already set. A few are enough for the nested BidiTexts.
+constexpr size_t kMaxPooledBidiCount = 4;
+
+static std::vector<UBiDiUniquePtr>& getThreadBidiPool() {
+    thread_local std::vector<UBiDiUniquePtr> pool;
+    return pool;
+}
+
+static UBiDiUniquePtr obtainBidi() {
+    std::vector<UBiDiUniquePtr>& pool = getThreadBidiPool();
+    if (!pool.empty()) {
+        UBiDiUniquePtr bidi = std::move(pool.back());
+        pool.pop_back();
+        return bidi;
+    }
+    UBiDiUniquePtr bidi(ubidi_open());
+    if (!bidi) {
+        ALOGE("error creating bidi object");
+        return nullptr;
+    }
+    UErrorCode status = U_ZERO_ERROR;
+    // Set callbacks to override bidi classes of new emoji
+    ubidi_setClassCallback(bidi.get(), emojiBidiOverride, nullptr, nullptr, nullptr, &status);
+    if (!U_SUCCESS(status)) {
+        ALOGE("error setting bidi callback function, status = %d", status);
+        return nullptr;
+    }
+    return bidi;
+}
+
 BidiText::RunInfo BidiText::getRunInfoAt(uint32_t runOffset) const {
     MINIKIN_ASSERT(runOffset < mRunCount, "Out of range access. %d/%d", runOffset, mRunCount);
     if (mRunCount == 1) {
@@ -78,20 +142,18 @@ BidiText::BidiText(const U16StringPiece& textBuf, const Range& range, Bidi bidiF
         // force single run.
         return;
     }
-
-    mBidi.reset(ubidi_open());
-    if (!mBidi) {
-        ALOGE("error creating bidi object");
+    if ((bidiFlags == Bidi::LTR || bidiFlags == Bidi::DEFAULT_LTR) &&
+        !mayHaveRtlLevels(textBuf)) {
+        // An LTR paragraph without RTL characters is a single LTR run, so skip ubidi.
         return;
     }
-    UErrorCode status = U_ZERO_ERROR;
-    // Set callbacks to override bidi classes of new emoji
-    ubidi_setClassCallback(mBidi.get(), emojiBidiOverride, nullptr, nullptr, nullptr, &status);
-    if (!U_SUCCESS(status)) {
-        ALOGE("error setting bidi callback function, status = %d", status);
+
+    mBidi = obtainBidi();
+    if (!mBidi) {
         return;
     }
 
+    UErrorCode status = U_ZERO_ERROR;
     const UBiDiLevel bidiReq = bidiToUBidiLevel(bidiFlags);
     ubidi_setPara(mBidi.get(), reinterpret_cast<const UChar*>(textBuf.data()), textBuf.size(),
                   bidiReq, nullptr, &status);
@@ -120,4 +182,11 @@ BidiText::BidiText(const U16StringPiece& textBuf, const Range& range, Bidi bidiF
     mRunCount = rc;
 }
 
+BidiText::~BidiText() {
+    std::vector<UBiDiUniquePtr>& pool = getThreadBidiPool();
+    if (mBidi && pool.size() < kMaxPooledBidiCount) {
+        pool.push_back(std::move(mBidi));
+    }
+}
+
 }  // namespace minikin
@@ -45,6 +45,7 @@ public:
     };
 
     BidiText(const U16StringPiece& textBuf, const Range& range, Bidi bidiFlags);
+    ~BidiText();
 
     RunInfo getRunInfoAt(uint32_t runOffset) const;
 
@@ -77,7 +78,7 @@ public:
     inline iterator end() const { return iterator(this, mRunCount); }
 
 private:
-    UBiDiUniquePtr mBidi;  // Maybe null for single run.
+    UBiDiUniquePtr mBidi;  // Maybe null for single run. Returned to the thread's pool.
     const Range mRange;    // The range in the original buffer. Used for range check.
     bool mIsRtl;           // The paragraph direction.
     uint32_t mRunCount;    // The number of the bidi run in this text.
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/CacheStats.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace minikin {
+
+std::atomic<bool> LockStats::sAcquisitionCountEnabled(false);
+
+void LockStats::dump(int fd) const {
+    const uint64_t waits = getWaitCount();
+    const uint64_t waitNanos = getWaitNanos();
+    const uint64_t acquisitions = getAcquisitionCount();
+    if (acquisitions != 0) {
+        dprintf(fd, "    lock acquisitions: %" PRIu64 " (%.2f%% contended)\n", acquisitions,
+                100.0 * waits / acquisitions);
+    }
+    dprintf(fd, "    lock waits: %" PRIu64 " (%.3f ms, %.3f us per wait)\n", waits,
+            waitNanos / 1e6, waits == 0 ? 0.0 : waitNanos / 1e3 / waits);
+    if (waits != 0) {
+        static const char* kBucketNames[kWaitBucketCount] = {"<1us", "<10us", "<100us",
+                                                             "<1ms", "<10ms", ">=10ms"};
+        dprintf(fd, "    lock wait histogram:");
+        for (size_t i = 0; i < kWaitBucketCount; ++i) {
+            dprintf(fd, " %s: %" PRIu64, kBucketNames[i], getWaitCount(i));
+        }
+        dprintf(fd, "\n");
+    }
+}
+
+void CacheStats::dump(int fd, const char* name, size_t memoryUsage) const {
+    const uint64_t hits = getHitCount();
+    const uint64_t misses = getMissCount();
+    const uint64_t lookups = hits + misses;
+    const double hitRatio = lookups == 0 ? 0.0 : 100.0 * hits / lookups;
+    dprintf(fd, "  %s:\n", name);
+    dprintf(fd, "    hits: %" PRIu64 ", misses: %" PRIu64 " (hit ratio: %.2f%%)\n", hits, misses,
+            hitRatio);
+    dprintf(fd, "    evictions: %" PRIu64 "\n", getEvictionCount());
+    if (getRejectionCount() != 0) {
+        dprintf(fd, "    admission rejections: %" PRIu64 "\n", getRejectionCount());
+    }
+    dprintf(fd, "    bypasses: %" PRIu64 " (too long)\n", getBypassCount(BypassReason::TooLong));
+    if (memoryUsage != kUnknownMemoryUsage) {
+        dprintf(fd, "    bytes resident: %zu\n", memoryUsage);
+    }
+    const uint64_t shapingNanos = getMissShapingNanos();
+    dprintf(fd, "    shaping time on misses: %.3f ms (%.3f us per miss)\n", shapingNanos / 1e6,
+            misses == 0 ? 0.0 : shapingNanos / 1e3 / misses);
+    if (mLockStats.getWaitCount() != 0 || mLockStats.getAcquisitionCount() != 0) {
+        mLockStats.dump(fd);
+    }
+}
+
+}  // namespace minikin
@@ -19,8 +19,15 @@
 #include "minikin/CmapCoverage.h"
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "minikin/Buffer.h"
+#include "minikin/Macros.h"
 #include "minikin/Range.h"
 #include "minikin/SparseBitSet.h"
 
@@ -422,8 +429,8 @@ static void getCoverageFormat14(std::vector<SparseBitSet>* out, const uint8_t* d
     out->shrink_to_fit();
 }
 
-SparseBitSet CmapCoverage::getCoverage(const uint8_t* cmap_data, size_t cmap_size,
-                                       std::vector<SparseBitSet>* out) {
+static SparseBitSet parseCoverage(const uint8_t* cmap_data, size_t cmap_size,
+                                  std::vector<SparseBitSet>* out) {
     constexpr size_t kHeaderSize = 4;
     constexpr size_t kNumTablesOffset = 2;
     constexpr size_t kTableSize = 8;
@@ -538,4 +545,113 @@ SparseBitSet CmapCoverage::getCoverage(const uint8_t* cmap_data, size_t cmap_siz
     return coverage;
 }
 
+namespace {
+
+// The coverages of the cmap tables parsed so far, shared by the font families using the same
+// cmap table, e.g. the same font file in several families. The entries are never freed since the
+// returned bit sets refer to them.
+class CoverageCache {
+public:
+    static CoverageCache& getInstance() {
+        static CoverageCache* cache = new CoverageCache();
+        return *cache;
+    }
+
+    SparseBitSet getCoverage(const uint8_t* cmap_data, size_t cmap_size,
+                             std::vector<SparseBitSet>* out) {
+        const Key key = {cmap_size, std::hash<std::string_view>()(std::string_view(
+                                            reinterpret_cast<const char*>(cmap_data), cmap_size))};
+        const std::string_view prefix(reinterpret_cast<const char*>(cmap_data),
+                                      std::min(cmap_size, kPrefixSize));
+        const uint8_t* buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mEntries.find(key);
+            if (it != mEntries.end() && it->second.prefix == prefix) {
+                buffer = it->second.buffer.get();
+            }
+        }
+        if (buffer == nullptr) {
+            SparseBitSet coverage = parseCoverage(cmap_data, cmap_size, out);
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mEntries.size() >= kMaxEntries || mEntries.count(key) != 0) {
+                return coverage;
+            }
+            Entry& entry = mEntries[key];
+            entry.prefix = prefix;
+            entry.buffer = serialize(coverage, *out);
+            buffer = entry.buffer.get();
+        }
+        // The bit sets are mapped from the entry, so nothing is copied.
+        BufferReader reader(buffer);
+        SparseBitSet coverage(&reader);
+        const uint32_t vsCount = reader.read<uint32_t>();
+        out->clear();
+        out->reserve(vsCount);
+        for (uint32_t i = 0; i < vsCount; ++i) {
+            out->emplace_back(&reader);
+        }
+        return coverage;
+    }
+
+private:
+    // Distinct cmap tables are about as many as the font files, so this is only hit by the apps
+    // creating a lot of fonts at runtime. They parse the tables as before.
+    static constexpr size_t kMaxEntries = 512;
+    // The start of the table is compared on top of the hash to rule out a collision.
+    static constexpr size_t kPrefixSize = 64;
+
+    struct Key {
+        size_t size;
+        size_t hash;
+        bool operator==(const Key& o) const { return size == o.size && hash == o.hash; }
+    };
+    struct KeyHasher {
+        size_t operator()(const Key& key) const { return key.hash; }
+    };
+    struct Entry {
+        std::string prefix;
+        std::unique_ptr<uint8_t[]> buffer;
+    };
+
+    static std::unique_ptr<uint8_t[]> serialize(const SparseBitSet& coverage,
+                                                const std::vector<SparseBitSet>& vsCoverage) {
+        BufferWriter fakeWriter(nullptr);
+        write(&fakeWriter, coverage, vsCoverage);
+        auto buffer = std::make_unique<uint8_t[]>(fakeWriter.size());
+        BufferWriter writer(buffer.get());
+        write(&writer, coverage, vsCoverage);
+        return buffer;
+    }
+
+    static void write(BufferWriter* writer, const SparseBitSet& coverage,
+                      const std::vector<SparseBitSet>& vsCoverage) {
+        coverage.writeTo(writer);
+        writer->write<uint32_t>(vsCoverage.size());
+        for (const SparseBitSet& bitset : vsCoverage) {
+            bitset.writeTo(writer);
+        }
+    }
+
+    std::mutex mMutex;
+    std::unordered_map<Key, Entry, KeyHasher> mEntries GUARDED_BY(mMutex);
+};
+
+std::atomic<bool> gCoverageCacheEnabled(false);
+
+}  // namespace
+
+// static
+void CmapCoverage::setCacheEnabled(bool enabled) {
+    gCoverageCacheEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+SparseBitSet CmapCoverage::getCoverage(const uint8_t* cmap_data, size_t cmap_size,
+                                       std::vector<SparseBitSet>* out) {
+    if (gCoverageCacheEnabled.load(std::memory_order_relaxed)) {
+        return CoverageCache::getInstance().getCoverage(cmap_data, cmap_size, out);
+    }
+    return parseCoverage(cmap_data, cmap_size, out);
+}
+
 }  // namespace minikin
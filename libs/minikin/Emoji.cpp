@@ -16,27 +16,84 @@
 
 #include "minikin/Emoji.h"
 
+#include <vector>
+
+#include "minikin/SparseBitSet.h"
+
 namespace minikin {
 
+namespace {
+
+// The emoji properties are looked up in sets built from ICU on first use. All the emoji are in the
+// first two planes. Below kTableStart only some ASCII and Latin-1 symbols are emoji, which are
+// checked directly.
+constexpr uint32_t kTableStart = 0x2000;
+constexpr uint32_t kTableEnd = 0x20000;
+
+bool isEmojiOverride(uint32_t c, UProperty property) {
+    // These two characters were removed from Emoji_Modifier_Base in Emoji 4.0, but we need to keep
+    // them as emoji modifier bases since there are fonts and user-generated text out there that
+    // treats these as potential emoji bases.
+    if (property == UCHAR_EMOJI_MODIFIER_BASE && (c == 0x1F91D || c == 0x1F93C)) {
+        return true;
+    }
+    return u_hasBinaryProperty(c, property);
+}
+
+class EmojiPropertySet {
+public:
+    explicit EmojiPropertySet(UProperty property) : mProperty(property) {
+        std::vector<uint32_t> ranges;
+        for (uint32_t c = kTableStart; c < kTableEnd; ++c) {
+            if (!isEmojiOverride(c, property)) {
+                continue;
+            }
+            if (!ranges.empty() && ranges.back() == c) {
+                ranges.back() = c + 1;
+            } else {
+                ranges.push_back(c);
+                ranges.push_back(c + 1);
+            }
+        }
+        mSet = SparseBitSet(ranges.data(), ranges.size() / 2);
+    }
+
+    bool get(uint32_t c) const {
+        return c < kTableEnd ? mSet.get(c) : isEmojiOverride(c, mProperty);
+    }
+
+private:
+    const UProperty mProperty;
+    SparseBitSet mSet;
+};
+
+}  // namespace
+
 bool isEmoji(uint32_t c) {
-    return u_hasBinaryProperty(c, UCHAR_EMOJI);
+    if (c < kTableStart) {
+        // Number sign, asterisk, digits, copyright sign and registered sign.
+        return c == '#' || c == '*' || ('0' <= c && c <= '9') || c == 0x00A9 || c == 0x00AE;
+    }
+    static const EmojiPropertySet emoji(UCHAR_EMOJI);
+    return emoji.get(c);
 }
 
 bool isEmojiModifier(uint32_t c) {
     // Emoji modifier are not expected to change, so there's a small change we need to customize
     // this.
-    return u_hasBinaryProperty(c, UCHAR_EMOJI_MODIFIER);
+    if (c < kTableStart) {
+        return false;
+    }
+    static const EmojiPropertySet emojiModifier(UCHAR_EMOJI_MODIFIER);
+    return emojiModifier.get(c);
 }
 
 bool isEmojiBase(uint32_t c) {
-    // These two characters were removed from Emoji_Modifier_Base in Emoji 4.0, but we need to keep
-    // them as emoji modifier bases since there are fonts and user-generated text out there that
-    // treats these as potential emoji bases.
-    if (c == 0x1F91D || c == 0x1F93C) {
-        return true;
+    if (c < kTableStart) {
+        return false;
     }
-
-    return u_hasBinaryProperty(c, UCHAR_EMOJI_MODIFIER_BASE);
+    static const EmojiPropertySet emojiBase(UCHAR_EMOJI_MODIFIER_BASE);
+    return emojiBase.get(c);
 }
 
 UCharDirection emojiBidiOverride(const void* /* context */, UChar32 c) {
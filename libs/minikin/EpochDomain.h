@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_EPOCH_DOMAIN_H
+#define MINIKIN_EPOCH_DOMAIN_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// The epoch based reclamation of the objects of type T which are read through raw pointers
+// without any lock, with the same two-parity reader counters as ReadMostlyLayoutTable. Unlike
+// there, the writers never wait for the readers: an object retired in an epoch is deleted by
+// reclaim() once the epoch has advanced twice, and the epoch only advances while no reader of the
+// previous one is left.
+template <typename T>
+class EpochDomain {
+public:
+    EpochDomain() : mEpoch(0) {
+        for (uint32_t i = 0; i < 2; ++i) {
+            for (uint32_t j = 0; j < kReaderStripes; ++j) {
+                mReaders[i][j].count.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // No reader can exist at this point, so the retired objects are deleted.
+    ~EpochDomain() = default;
+
+    // Enters a read-side critical section, in which the objects reachable when it was entered
+    // are not deleted. Returns the counter to give to leave().
+    std::atomic<uint32_t>* enter() const {
+        const uint32_t stripe = getReaderStripe();
+        for (;;) {
+            const uint64_t epoch = mEpoch.load();
+            std::atomic<uint32_t>* counter = &mReaders[epoch & 1][stripe].count;
+            counter->fetch_add(1);
+            // If the epoch advanced in the meantime, the counter may already have been checked.
+            // Retry with the new epoch.
+            if (mEpoch.load() == epoch) {
+                return counter;
+            }
+            counter->fetch_sub(1);
+        }
+    }
+
+    static void leave(std::atomic<uint32_t>* counter) { counter->fetch_sub(1); }
+
+    // Deletes the object once no reader can be using it. It must already be unreachable for the
+    // readers entering from now on.
+    void retire(std::unique_ptr<T> object) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRetired.emplace_back(mEpoch.load(), std::move(object));
+    }
+
+    // Deletes the retired objects which no reader can be using. Returns the number of them.
+    size_t reclaim() {
+        std::vector<std::unique_ptr<T>> reclaimed;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mRetired.empty()) {
+                return 0;
+            }
+            // Advance twice if no reader is in a critical section, so that the objects retired
+            // before the call are deleted right away in that case.
+            for (int i = 0; i < 2 && !hasReaders((mEpoch.load() + 1) & 1); ++i) {
+                mEpoch.fetch_add(1);
+            }
+            const uint64_t epoch = mEpoch.load();
+            auto it = mRetired.begin();
+            for (; it != mRetired.end() && it->first + 2 <= epoch; ++it) {
+                reclaimed.push_back(std::move(it->second));
+            }
+            mRetired.erase(mRetired.begin(), it);
+        }
+        // Deleted outside of the lock.
+        return reclaimed.size();
+    }
+
+    // Calls f for each retired object which is not deleted yet, e.g. to count their memory.
+    template <typename F>
+    void forEachRetired(F f) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& entry : mRetired) {
+            f(*entry.second);
+        }
+    }
+
+private:
+    static constexpr uint32_t kReaderStripes = 16;
+
+    static uint32_t getReaderStripe() {
+        static std::atomic<uint32_t> nextStripe(0);
+        thread_local uint32_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed);
+        return stripe % kReaderStripes;
+    }
+
+    bool hasReaders(uint64_t parity) const {
+        for (const ReaderCounter& counter : mReaders[parity]) {
+            if (counter.count.load() != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Per-epoch-parity reader counts, striped by thread to avoid bouncing a single cache line.
+    struct alignas(64) ReaderCounter {
+        std::atomic<uint32_t> count;
+    };
+    mutable ReaderCounter mReaders[2][kReaderStripes];
+    // Only advanced under mMutex.
+    std::atomic<uint64_t> mEpoch;
+
+    std::mutex mMutex;
+    // The retired objects and the epochs they were retired in, in the order of the epochs.
+    std::vector<std::pair<uint64_t, std::unique_ptr<T>>> mRetired GUARDED_BY(mMutex);
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(EpochDomain);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_EPOCH_DOMAIN_H
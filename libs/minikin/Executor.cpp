@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Minikin"
+
+#include "minikin/Executor.h"
+
+#include <log/log.h>
+
+#include "MinikinInternal.h"
+
+namespace minikin {
+
+namespace {
+Executor* gExecutor = nullptr;
+}
+
+Executor::~Executor() {}
+
+// static
+Executor* Executor::getInstance() {
+    return gExecutor;
+}
+
+// static
+void Executor::setInstance(Executor* executor) {
+    MINIKIN_ASSERT(gExecutor == nullptr || gExecutor == executor,
+                   "Executor cannot be changed after it is set.");
+    gExecutor = executor;
+}
+
+}  // namespace minikin
@@ -22,14 +22,23 @@
 #include <hb.h>
 #include <log/log.h>
 
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
+#include "EpochDomain.h"
 #include "FontUtils.h"
 #include "LocaleListCache.h"
 #include "MinikinInternal.h"
+#include "minikin/Characters.h"
+#include "minikin/Executor.h"
 #include "minikin/HbUtils.h"
 #include "minikin/MinikinFont.h"
 #include "minikin/MinikinFontFactory.h"
+#include "minikin/ReadAhead.h"
 
 namespace minikin {
 
@@ -52,9 +61,42 @@ std::shared_ptr<Font> Font::Builder::build() {
                                           std::move(font), mLocaleListId));
 }
 
-Font::Font(BufferReader* reader) : mExternalRefsHolder(nullptr), mTypefaceMetadataReader(nullptr) {
+Font::Font(std::shared_ptr<MinikinFont>&& typeface, FontStyle style, HbFontUniquePtr&& baseFont,
+           uint32_t localeListId)
+        : mExternalRefsHolder(nullptr),
+          mLastUsedEpoch(0),
+          mStyle(style),
+          mLocaleListId(localeListId),
+          mSupportedAxesCount(0),
+          mSupportedAxes(nullptr),
+          mOwnedSupportedAxes(nullptr),
+          mTypefaceMetadataReader(nullptr) {
+    const std::unordered_set<AxisTag> supportedAxes = analyzeSupportedAxes(baseFont);
+    MINIKIN_ASSERT(supportedAxes.size() <= std::numeric_limits<uint16_t>::max(),
+                   "Number of supported axes must be less than 2^16.");
+    mSupportedAxesCount = static_cast<uint16_t>(supportedAxes.size());
+    if (mSupportedAxesCount > 0) {
+        mOwnedSupportedAxes = sortedArrayFromSet(supportedAxes);
+        mSupportedAxes = mOwnedSupportedAxes.get();
+    }
+    mExternalRefsHolder.store(new ExternalRefs(std::move(typeface), std::move(baseFont)));
+}
+
+Font::Font(BufferReader* reader)
+        : mExternalRefsHolder(nullptr),
+          mLastUsedEpoch(0),
+          mSupportedAxesCount(0),
+          mSupportedAxes(nullptr),
+          mOwnedSupportedAxes(nullptr),
+          mTypefaceMetadataReader(nullptr) {
     mStyle = FontStyle(reader);
     mLocaleListId = LocaleListCache::readFrom(reader);
+    // AxisTag is uint32_t
+    static_assert(sizeof(AxisTag) == 4);
+    const auto& [axesPtr, axesCount] = reader->readArray<AxisTag>();
+    // The axes are used in place as the buffer outlives the font.
+    mSupportedAxesCount = static_cast<uint16_t>(axesCount);
+    mSupportedAxes = axesCount > 0 ? axesPtr : nullptr;
     mTypefaceMetadataReader = *reader;
     MinikinFontFactory::getInstance().skip(reader);
 }
@@ -62,21 +104,53 @@ Font::Font(BufferReader* reader) : mExternalRefsHolder(nullptr), mTypefaceMetada
 void Font::writeTo(BufferWriter* writer) const {
     mStyle.writeTo(writer);
     LocaleListCache::writeTo(writer, mLocaleListId);
+    writer->writeArray<AxisTag>(mSupportedAxes, mSupportedAxesCount);
+    ExternalRefsGuard guard;
     MinikinFontFactory::getInstance().write(writer, typeface().get());
 }
 
+struct Font::ExternalRefsRegistry {
+    std::mutex mutex;
+    // The fonts read from a buffer which have an ExternalRefs. std::set doesn't keep any memory
+    // once it gets empty.
+    std::set<const Font*> fonts GUARDED_BY(mutex);
+    // The released ones, deleted once no ExternalRefsGuard entered before the release is alive.
+    EpochDomain<ExternalRefs> retired;
+    // Incremented by every releaseIdleExternalRefs() call.
+    std::atomic<uint32_t> epoch{0};
+};
+
+Font::ExternalRefsRegistry Font::sExternalRefsRegistry;
+
+Font::ExternalRefsGuard::ExternalRefsGuard()
+        : mCounter(sExternalRefsRegistry.retired.enter()) {}
+
+Font::ExternalRefsGuard::~ExternalRefsGuard() {
+    EpochDomain<ExternalRefs>::leave(mCounter);
+}
+
 Font::Font(Font&& o) noexcept
-        : mStyle(o.mStyle),
+        : mExternalRefsHolder(nullptr),
+          mLastUsedEpoch(o.mLastUsedEpoch.load(std::memory_order_relaxed)),
+          mStyle(o.mStyle),
           mLocaleListId(o.mLocaleListId),
+          mSupportedAxesCount(o.mSupportedAxesCount),
+          mSupportedAxes(o.mSupportedAxes),
+          mOwnedSupportedAxes(std::move(o.mOwnedSupportedAxes)),
           mTypefaceMetadataReader(o.mTypefaceMetadataReader) {
-    mExternalRefsHolder.store(o.mExternalRefsHolder.exchange(nullptr));
+    resetExternalRefs(o.takeExternalRefs());
 }
 
 Font& Font::operator=(Font&& o) noexcept {
-    resetExternalRefs(o.mExternalRefsHolder.exchange(nullptr));
     mStyle = o.mStyle;
     mLocaleListId = o.mLocaleListId;
+    mSupportedAxesCount = o.mSupportedAxesCount;
+    mSupportedAxes = o.mSupportedAxes;
+    mOwnedSupportedAxes = std::move(o.mOwnedSupportedAxes);
     mTypefaceMetadataReader = o.mTypefaceMetadataReader;
+    mLastUsedEpoch.store(o.mLastUsedEpoch.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+    resetExternalRefs(o.takeExternalRefs());
     return *this;
 }
 
@@ -85,12 +159,73 @@ Font::~Font() {
 }
 
 void Font::resetExternalRefs(ExternalRefs* refs) {
-    ExternalRefs* oldRefs = mExternalRefsHolder.exchange(refs);
+    ExternalRefs* oldRefs;
+    {
+        std::lock_guard<std::mutex> lock(sExternalRefsRegistry.mutex);
+        oldRefs = mExternalRefsHolder.exchange(refs);
+        if (refs != nullptr && mTypefaceMetadataReader.current() != nullptr) {
+            sExternalRefsRegistry.fonts.insert(this);
+        } else {
+            sExternalRefsRegistry.fonts.erase(this);
+        }
+    }
     if (oldRefs != nullptr) {
         delete oldRefs;
     }
 }
 
+Font::ExternalRefs* Font::takeExternalRefs() {
+    std::lock_guard<std::mutex> lock(sExternalRefsRegistry.mutex);
+    sExternalRefsRegistry.fonts.erase(this);
+    return mExternalRefsHolder.exchange(nullptr);
+}
+
+// static
+size_t Font::releaseIdleExternalRefs() {
+    // The ones released by the previous calls, unless a guard may still be using them. The ones
+    // released by this call are kept for the readers without a guard until the next call.
+    sExternalRefsRegistry.retired.reclaim();
+    size_t releasedCount = 0;
+    std::lock_guard<std::mutex> lock(sExternalRefsRegistry.mutex);
+    const uint32_t epoch = sExternalRefsRegistry.epoch.load(std::memory_order_relaxed);
+    std::set<const Font*>& fonts = sExternalRefsRegistry.fonts;
+    for (auto it = fonts.begin(); it != fonts.end();) {
+        const Font* font = *it;
+        if (font->mLastUsedEpoch.load(std::memory_order_relaxed) == epoch) {
+            ++it;
+            continue;
+        }
+        sExternalRefsRegistry.retired.retire(
+                std::unique_ptr<ExternalRefs>(font->mExternalRefsHolder.exchange(nullptr)));
+        it = fonts.erase(it);
+        releasedCount++;
+    }
+    sExternalRefsRegistry.epoch.store(epoch + 1, std::memory_order_relaxed);
+    return releasedCount;
+}
+
+// static
+size_t Font::getExternalRefsMemoryUsage() {
+    size_t bytes = 0;
+    auto countRefs = [&bytes](const ExternalRefs& refs) {
+        bytes += sizeof(ExternalRefs);
+        std::lock_guard<std::mutex> variationLock(refs.mVariationFontsMutex);
+        for (const auto& [variations, hbFont] : refs.mVariationFonts) {
+            bytes += sizeof(std::pair<std::vector<FontVariation>, HbFontUniquePtr>) +
+                     sizeof(FontVariation) * variations.capacity();
+        }
+    };
+    std::lock_guard<std::mutex> lock(sExternalRefsRegistry.mutex);
+    for (const Font* font : sExternalRefsRegistry.fonts) {
+        const ExternalRefs* refs = font->mExternalRefsHolder.load(std::memory_order_relaxed);
+        if (refs != nullptr) {
+            countRefs(*refs);
+        }
+    }
+    sExternalRefsRegistry.retired.forEachRetired(countRefs);
+    return bytes;
+}
+
 const std::shared_ptr<MinikinFont>& Font::typeface() const {
     return getExternalRefs()->mTypeface;
 }
@@ -101,31 +236,58 @@ const HbFontUniquePtr& Font::baseFont() const {
 
 const Font::ExternalRefs* Font::getExternalRefs() const {
     // Thread safety note: getExternalRefs() is thread-safe.
-    // getExternalRefs() returns the first ExternalRefs set to mExternalRefsHolder.
-    // When multiple threads called getExternalRefs() at the same time and
-    // mExternalRefsHolder is not set, multiple ExternalRefs may be created,
-    // but only one ExternalRefs will be set to mExternalRefsHolder and
-    // others will be deleted.
-    Font::ExternalRefs* externalRefs = mExternalRefsHolder.load();
+    // The ExternalRefs is created under a lock shared by a few fonts, so that the threads calling
+    // getExternalRefs() at the same time, e.g. a layout racing with warmUp(), wait for the one
+    // creating it instead of creating and deleting their own.
+    Font::ExternalRefs* externalRefs = mExternalRefsHolder.load(std::memory_order_acquire);
+    if (externalRefs) {
+        if (mTypefaceMetadataReader.current() != nullptr) {
+            // Keep it from being released by releaseIdleExternalRefs().
+            const uint32_t epoch = sExternalRefsRegistry.epoch.load(std::memory_order_relaxed);
+            if (mLastUsedEpoch.load(std::memory_order_relaxed) != epoch) {
+                mLastUsedEpoch.store(epoch, std::memory_order_relaxed);
+            }
+        }
+        return externalRefs;
+    }
+    static std::mutex creationMutexes[kExternalRefsMutexCount];
+    std::lock_guard<std::mutex> lock(
+            creationMutexes[(reinterpret_cast<uintptr_t>(this) / alignof(Font)) %
+                            kExternalRefsMutexCount]);
+    externalRefs = mExternalRefsHolder.load(std::memory_order_acquire);
     if (externalRefs) return externalRefs;
-    // mExternalRefsHolder is null. Try creating an ExternalRefs.
     std::shared_ptr<MinikinFont> typeface =
             MinikinFontFactory::getInstance().create(mTypefaceMetadataReader);
     HbFontUniquePtr font = prepareFont(typeface);
-    Font::ExternalRefs* newExternalRefs =
-            new Font::ExternalRefs(std::move(typeface), std::move(font));
-    // Set the new ExternalRefs to mExternalRefsHolder if it is still null.
-    Font::ExternalRefs* expected = nullptr;
-    if (mExternalRefsHolder.compare_exchange_strong(expected, newExternalRefs)) {
-        return newExternalRefs;
+    externalRefs = new Font::ExternalRefs(std::move(typeface), std::move(font));
+    {
+        std::lock_guard<std::mutex> registryLock(sExternalRefsRegistry.mutex);
+        mLastUsedEpoch.store(sExternalRefsRegistry.epoch.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+        mExternalRefsHolder.store(externalRefs, std::memory_order_release);
+        sExternalRefsRegistry.fonts.insert(this);
+    }
+    return externalRefs;
+}
+
+// static
+std::shared_future<void> Font::warmUpAsync(std::vector<std::shared_ptr<Font>>&& fonts) {
+    // Shared since the tasks of an Executor must be copyable.
+    auto promise = std::make_shared<std::promise<void>>();
+    std::shared_future<void> future = promise->get_future().share();
+    // The task owns the fonts until they are warmed up.
+    auto task = [fonts = std::move(fonts), promise]() {
+        for (const std::shared_ptr<Font>& font : fonts) {
+            font->warmUp();
+        }
+        promise->set_value();
+    };
+    if (Executor* executor = Executor::getInstance()) {
+        executor->execute(std::move(task), TaskPriority::Low, CancellationToken());
     } else {
-        // Another thread has already created and set an ExternalRefs.
-        // Delete ours and use theirs instead.
-        delete newExternalRefs;
-        // compare_exchange_strong writes the stored value into 'expected'
-        // when comparison fails.
-        return expected;
+        std::thread(std::move(task)).detach();
     }
+    return future;
 }
 
 // static
@@ -133,6 +295,9 @@ HbFontUniquePtr Font::prepareFont(const std::shared_ptr<MinikinFont>& typeface)
     const char* buf = reinterpret_cast<const char*>(typeface->GetFontData());
     size_t size = typeface->GetFontSize();
     uint32_t ttcIndex = typeface->GetFontIndex();
+    if (ReadAhead::isEnabled()) {
+        ReadAhead::adviseFont(buf, size, ttcIndex);
+    }
 
     HbBlobUniquePtr blob(hb_blob_create(buf, size, HB_MEMORY_MODE_READONLY, nullptr, nullptr));
     HbFaceUniquePtr face(hb_face_create(blob.get(), ttcIndex));
@@ -142,16 +307,71 @@ HbFontUniquePtr Font::prepareFont(const std::shared_ptr<MinikinFont>& typeface)
     uint32_t upem = hb_face_get_upem(face.get());
     hb_font_set_scale(parent.get(), upem, upem);
 
-    HbFontUniquePtr font(hb_font_create_sub_font(parent.get()));
-    std::vector<hb_variation_t> variations;
-    variations.reserve(typeface->GetAxes().size());
-    for (const FontVariation& variation : typeface->GetAxes()) {
-        variations.push_back({variation.axisTag, variation.value});
+    return createVariationFont(parent.get(), typeface->GetAxes());
+}
+
+// static
+HbFontUniquePtr Font::createVariationFont(hb_font_t* parent,
+                                          const std::vector<FontVariation>& variations) {
+    HbFontUniquePtr font(hb_font_create_sub_font(parent));
+    std::vector<hb_variation_t> hbVariations;
+    hbVariations.reserve(variations.size());
+    for (const FontVariation& variation : variations) {
+        hbVariations.push_back({variation.axisTag, variation.value});
     }
-    hb_font_set_variations(font.get(), variations.data(), variations.size());
+    hb_font_set_variations(font.get(), hbVariations.data(), hbVariations.size());
     return font;
 }
 
+HbFontUniquePtr Font::ExternalRefs::getVariationFont(
+        const std::vector<FontVariation>& variations) const {
+    std::lock_guard<std::mutex> lock(mVariationFontsMutex);
+    auto it = std::find_if(
+            mVariationFonts.begin(), mVariationFonts.end(), [&variations](const auto& entry) {
+                return std::equal(entry.first.begin(), entry.first.end(), variations.begin(),
+                                  variations.end(),
+                                  [](const FontVariation& a, const FontVariation& b) {
+                                      return a.axisTag == b.axisTag && a.value == b.value;
+                                  });
+            });
+    if (it == mVariationFonts.end()) {
+        if (mVariationFonts.size() == kMaxVariationFonts) {
+            mVariationFonts.erase(mVariationFonts.begin());
+        }
+        // The base font is a sub-font of the font scaled to the units per em, see prepareFont().
+        mVariationFonts.emplace_back(
+                variations, createVariationFont(hb_font_get_parent(mBaseFont.get()), variations));
+        it = mVariationFonts.end() - 1;
+    } else if (it != mVariationFonts.end() - 1) {
+        // Keep the most recently used entry at the back.
+        std::rotate(it, it + 1, mVariationFonts.end());
+        it = mVariationFonts.end() - 1;
+    }
+    return HbFontUniquePtr(hb_font_reference(it->second.get()));
+}
+
+std::shared_ptr<Font> Font::createFontWithVariation(
+        const std::vector<FontVariation>& variations) const {
+    ExternalRefsGuard guard;
+    const ExternalRefs* refs = getExternalRefs();
+    std::shared_ptr<MinikinFont> typeface = refs->mTypeface->createFontWithVariation(variations);
+    if (typeface == nullptr) {
+        return nullptr;
+    }
+    HbFontUniquePtr baseFont;
+    if (typeface->GetFontData() != nullptr &&
+        typeface->GetFontData() == refs->mTypeface->GetFontData() &&
+        typeface->GetFontSize() == refs->mTypeface->GetFontSize() &&
+        typeface->GetFontIndex() == refs->mTypeface->GetFontIndex()) {
+        // The face refers to the same data, which the new typeface keeps alive.
+        baseFont = refs->getVariationFont(typeface->GetAxes());
+    } else {
+        baseFont = prepareFont(typeface);
+    }
+    return std::shared_ptr<Font>(
+            new Font(std::move(typeface), mStyle, std::move(baseFont), kEmptyLocaleListId));
+}
+
 // static
 FontStyle Font::analyzeStyle(const HbFontUniquePtr& font) {
     HbBlob os2Table(font, MinikinFont::MakeTag('O', 'S', '/', '2'));
@@ -168,8 +388,138 @@ FontStyle Font::analyzeStyle(const HbFontUniquePtr& font) {
     return FontStyle(static_cast<uint16_t>(weight), static_cast<FontStyle::Slant>(italic));
 }
 
-std::unordered_set<AxisTag> Font::getSupportedAxes() const {
-    HbBlob fvarTable(baseFont(), MinikinFont::MakeTag('f', 'v', 'a', 'r'));
+// static
+std::unique_ptr<SimpleAsciiGlyphs> Font::analyzeAsciiGlyphs(const HbFontUniquePtr& font) {
+    std::unique_ptr<SimpleAsciiGlyphs> glyphs = std::make_unique<SimpleAsciiGlyphs>();
+    glyphs->isSimple = false;
+    hb_face_t* face = hb_font_get_face(font.get());
+    if (hb_ot_layout_has_substitution(face) || hb_ot_layout_has_positioning(face)) {
+        return glyphs;
+    }
+    // The AAT layout and the legacy kerning are also applied by HarfBuzz. Color bitmap fonts use
+    // different font functions for shaping.
+    for (uint32_t tag : {MinikinFont::MakeTag('k', 'e', 'r', 'n'),
+                         MinikinFont::MakeTag('m', 'o', 'r', 'x'),
+                         MinikinFont::MakeTag('m', 'o', 'r', 't'),
+                         MinikinFont::MakeTag('k', 'e', 'r', 'x'),
+                         MinikinFont::MakeTag('t', 'r', 'a', 'k'),
+                         MinikinFont::MakeTag('C', 'B', 'D', 'T')}) {
+        if (HbBlob(font, tag)) {
+            return glyphs;
+        }
+    }
+    for (uint32_t c = SimpleAsciiGlyphs::kFirst; c <= SimpleAsciiGlyphs::kLast; ++c) {
+        hb_codepoint_t glyph = 0;
+        if (!hb_font_get_nominal_glyph(font.get(), c, &glyph) || glyph > UINT16_MAX) {
+            glyph = 0;
+        }
+        glyphs->glyphIds[c - SimpleAsciiGlyphs::kFirst] = glyph;
+    }
+    glyphs->isSimple = true;
+    return glyphs;
+}
+
+const SimpleAsciiGlyphs* Font::getSimpleAsciiGlyphs() const {
+    const ExternalRefs* refs = getExternalRefs();
+    SimpleAsciiGlyphs* glyphs = refs->mAsciiGlyphs.load(std::memory_order_acquire);
+    if (glyphs == nullptr) {
+        // Same as getExternalRefs(), the first one set wins if multiple threads get here.
+        std::unique_ptr<SimpleAsciiGlyphs> newGlyphs = analyzeAsciiGlyphs(refs->mBaseFont);
+        SimpleAsciiGlyphs* expected = nullptr;
+        if (refs->mAsciiGlyphs.compare_exchange_strong(expected, newGlyphs.get(),
+                                                       std::memory_order_acq_rel,
+                                                       std::memory_order_acquire)) {
+            glyphs = newGlyphs.release();
+        } else {
+            glyphs = expected;
+        }
+    }
+    return glyphs->isSimple ? glyphs : nullptr;
+}
+
+namespace {
+
+// The bits of ExternalRefs::mHyphenSupport. kHyphenSupportComputed is set once the others are.
+constexpr uint8_t kHyphenSupportComputed = 1 << 0;
+constexpr uint8_t kHasHyphen = 1 << 1;
+constexpr uint8_t kHasArmenianHyphen = 1 << 2;
+constexpr uint8_t kHasMaqaf = 1 << 3;
+constexpr uint8_t kHasUcasHyphen = 1 << 4;
+
+}  // namespace
+
+// static
+uint8_t Font::analyzeHyphenSupport(const HbFontUniquePtr& font) {
+    uint8_t support = kHyphenSupportComputed;
+    for (auto [c, bit] : {std::make_pair(CHAR_HYPHEN, kHasHyphen),
+                          std::make_pair(CHAR_ARMENIAN_HYPHEN, kHasArmenianHyphen),
+                          std::make_pair(CHAR_MAQAF, kHasMaqaf),
+                          std::make_pair(CHAR_UCAS_HYPHEN, kHasUcasHyphen)}) {
+        hb_codepoint_t glyph;
+        if (hb_font_get_nominal_glyph(font.get(), c, &glyph)) {
+            support |= bit;
+        }
+    }
+    return support;
+}
+
+uint32_t Font::getHyphenChar(uint32_t preferredHyphen) const {
+    uint8_t preferredBit;
+    switch (preferredHyphen) {
+        case CHAR_HYPHEN:
+            preferredBit = kHasHyphen;
+            break;
+        case CHAR_ARMENIAN_HYPHEN:
+            preferredBit = kHasArmenianHyphen;
+            break;
+        case CHAR_MAQAF:
+            preferredBit = kHasMaqaf;
+            break;
+        case CHAR_UCAS_HYPHEN:
+            preferredBit = kHasUcasHyphen;
+            break;
+        default:
+            return preferredHyphen;
+    }
+    const ExternalRefs* refs = getExternalRefs();
+    // Racing threads compute the same value, so there is no need to synchronize them.
+    uint8_t support = refs->mHyphenSupport.load(std::memory_order_relaxed);
+    if (support == 0) {
+        support = analyzeHyphenSupport(refs->mBaseFont);
+        refs->mHyphenSupport.store(support, std::memory_order_relaxed);
+    }
+    if (support & preferredBit) {
+        return preferredHyphen;
+    }
+    // Fall back to U+2010 and then to ASCII HYPHEN-MINUS.
+    // Note that we intentionally don't do anything special if the font doesn't have a
+    // HYPHEN-MINUS either, so a tofu could be shown, hinting towards something missing.
+    return (support & kHasHyphen) ? CHAR_HYPHEN : 0x002D;
+}
+
+namespace {
+
+// The values of ExternalRefs::mColorBitmap once computed.
+constexpr uint8_t kIsColorBitmap = 1;
+constexpr uint8_t kIsNotColorBitmap = 2;
+
+}  // namespace
+
+bool Font::isColorBitmapFont() const {
+    const ExternalRefs* refs = getExternalRefs();
+    // Same as getHyphenChar(), racing threads compute the same value.
+    uint8_t colorBitmap = refs->mColorBitmap.load(std::memory_order_relaxed);
+    if (colorBitmap == 0) {
+        HbBlob cbdt(refs->mBaseFont, MinikinFont::MakeTag('C', 'B', 'D', 'T'));
+        colorBitmap = cbdt ? kIsColorBitmap : kIsNotColorBitmap;
+        refs->mColorBitmap.store(colorBitmap, std::memory_order_relaxed);
+    }
+    return colorBitmap == kIsColorBitmap;
+}
+
+// static
+std::unordered_set<AxisTag> Font::analyzeSupportedAxes(const HbFontUniquePtr& font) {
+    HbBlob fvarTable(font, MinikinFont::MakeTag('f', 'v', 'a', 'r'));
     if (!fvarTable) {
         return std::unordered_set<AxisTag>();
     }
@@ -22,14 +22,21 @@
 #include <unicode/unorm2.h>
 
 #include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "Locale.h"
 #include "LocaleListCache.h"
 #include "MinikinInternal.h"
+#include "MinikinTrace.h"
+#include "WorkerPool.h"
 #include "minikin/Characters.h"
 #include "minikin/Emoji.h"
 #include "minikin/FontFileParser.h"
+#include "minikin/Hasher.h"
+#include "minikin/Macros.h"
 
 using std::vector;
 
@@ -47,6 +54,176 @@ static std::atomic<uint32_t> gNextCollectionId = {0};
 
 namespace {
 
+// The IDs of the destroyed collections, see FontCollection::takeDestroyedIds().
+struct DestroyedIds {
+    std::mutex mutex;
+    std::vector<uint32_t> ids GUARDED_BY(mutex);
+    std::atomic<bool> hasIds = {false};
+};
+
+// Never deleted, since the collections owned by other static objects may be destroyed at exit.
+DestroyedIds& getDestroyedIds() {
+    static DestroyedIds* ids = new DestroyedIds();
+    return *ids;
+}
+
+void recordDestroyedId(uint32_t id) {
+    DestroyedIds& destroyed = getDestroyedIds();
+    std::lock_guard<std::mutex> lock(destroyed.mutex);
+    destroyed.ids.push_back(id);
+    destroyed.hasIds.store(true, std::memory_order_relaxed);
+}
+
+// The identity of an interned collection: the families it is created from, and the variations
+// applied to them if it is created with FontCollection::createCollectionWithVariation().
+struct InternKey {
+    std::vector<const FontFamily*> families;
+    std::vector<FontVariation> variations;
+
+    bool operator==(const InternKey& o) const {
+        return families == o.families && variations.size() == o.variations.size() &&
+               std::equal(variations.begin(), variations.end(), o.variations.begin(),
+                          [](const FontVariation& l, const FontVariation& r) {
+                              return l.axisTag == r.axisTag && l.value == r.value;
+                          });
+    }
+};
+
+struct InternKeyHasher {
+    size_t operator()(const InternKey& key) const {
+        Hasher hasher;
+        for (const FontFamily* family : key.families) {
+            hasher.update(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(family)));
+        }
+        for (const FontVariation& variation : key.variations) {
+            hasher.update(variation.axisTag).update(variation.value);
+        }
+        return hasher.hash();
+    }
+};
+
+// The collections shared by FontCollection::setInterningEnabled(). The entries don't own the
+// collections, so a family is only looked up by its address while a live collection holds it.
+struct InternTable {
+    std::mutex mutex;
+    std::unordered_map<InternKey, std::weak_ptr<FontCollection>, InternKeyHasher> collections
+            GUARDED_BY(mutex);
+    // The expired entries are removed once the table grows to this size.
+    size_t pruneSize GUARDED_BY(mutex) = kMinInternPruneSize;
+
+    static constexpr size_t kMinInternPruneSize = 64;
+
+    // Returns the live collection of the key, or nullptr.
+    std::shared_ptr<FontCollection> find(const InternKey& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = collections.find(key);
+        return it == collections.end() ? nullptr : it->second.lock();
+    }
+
+    // Stores the collection for the key unless another thread stored a live one first, and
+    // returns the stored one.
+    std::shared_ptr<FontCollection> insert(InternKey&& key,
+                                           std::shared_ptr<FontCollection>&& collection) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::weak_ptr<FontCollection>& entry = collections[std::move(key)];
+        if (std::shared_ptr<FontCollection> existing = entry.lock()) {
+            return existing;
+        }
+        entry = collection;
+        if (collections.size() >= pruneSize) {
+            for (auto it = collections.begin(); it != collections.end();) {
+                it = it->second.expired() ? collections.erase(it) : std::next(it);
+            }
+            pruneSize = std::max(kMinInternPruneSize, collections.size() * 2);
+        }
+        return std::move(collection);
+    }
+};
+
+// Never deleted, like the destroyed IDs.
+InternTable& getInternTable() {
+    static InternTable* table = new InternTable();
+    return *table;
+}
+
+InternKey makeInternKey(const vector<std::shared_ptr<FontFamily>>& typefaces,
+                        const std::vector<FontVariation>& variations) {
+    InternKey key;
+    key.families.reserve(typefaces.size());
+    for (const std::shared_ptr<FontFamily>& family : typefaces) {
+        key.families.push_back(family.get());
+    }
+    key.variations = variations;
+    return key;
+}
+
+}  // namespace
+
+static std::atomic<bool> gInterningEnabled = {false};
+static std::atomic<bool> gFamilyLookupTableEnabled = {false};
+static std::atomic<bool> gParallelItemizationEnabled = {false};
+
+namespace {
+
+// FNV-1a for FontCollection::getStableId(). Unlike Hasher, the values are fixed, so that they are
+// the same in every process and build.
+class StableHasher {
+public:
+    StableHasher& update(uint64_t data) {
+        for (int i = 0; i < 8; ++i) {
+            updateByte(data >> (i * 8));
+        }
+        return *this;
+    }
+
+    StableHasher& update(const std::string& str) {
+        update(str.size());
+        for (char c : str) {
+            updateByte(c);
+        }
+        return *this;
+    }
+
+    uint64_t hash() const { return mHash; }
+
+private:
+    IGNORE_INTEGER_OVERFLOW void updateByte(uint8_t data) {
+        mHash = (mHash ^ data) * 0x100000001B3ull;
+    }
+
+    uint64_t mHash = 0xCBF29CE484222325ull;
+};
+
+// A direct-mapped cache of the getFamilyForChar results. The itemization asks for the same
+// characters over and over, and scoring every family of the page for them is expensive. The cache
+// is kept per thread so that the lookups don't need any synchronization, thus the collection ID is
+// a part of the key. An entry with the empty result is unused since a result is never empty.
+class FamilyForCharCache {
+public:
+    struct Entry {
+        uint32_t collectionId;
+        uint32_t charKey;
+        uint32_t localeListId;
+        uint64_t result;
+    };
+
+    static FamilyForCharCache& getInstance() {
+        thread_local FamilyForCharCache cache;
+        return cache;
+    }
+
+    Entry& get(uint32_t collectionId, uint32_t charKey, uint32_t localeListId) {
+        const uint32_t hash =
+                Hasher().update(collectionId).update(charKey).update(localeListId).hash();
+        return mEntries[hash & (kSize - 1)];
+    }
+
+private:
+    static constexpr uint32_t kSize = 512;  // Must be a power of two.
+
+    Entry mEntries[kSize] = {};
+};
+
 inline bool isEmojiBreak(uint32_t prevCh, uint32_t ch) {
     return !(isEmojiModifier(ch) || (isRegionalIndicator(prevCh) && isRegionalIndicator(ch)) ||
              isKeyCap(ch) || isTagChar(ch) || ch == CHAR_ZWJ || prevCh == CHAR_ZWJ);
@@ -132,15 +309,65 @@ std::shared_ptr<FontCollection> FontCollection::create(std::shared_ptr<FontFamil
 // static
 std::shared_ptr<FontCollection> FontCollection::create(
         const vector<std::shared_ptr<FontFamily>>& typefaces) {
-    // TODO(b/174672300): Revert back to make_shared.
-    return std::shared_ptr<FontCollection>(new FontCollection(typefaces));
+    if (!isInterningEnabled()) {
+        // TODO(b/174672300): Revert back to make_shared.
+        return std::shared_ptr<FontCollection>(new FontCollection(typefaces));
+    }
+    InternTable& table = getInternTable();
+    InternKey key = makeInternKey(typefaces, {});
+    if (std::shared_ptr<FontCollection> collection = table.find(key)) {
+        return collection;
+    }
+    return table.insert(std::move(key),
+                        std::shared_ptr<FontCollection>(new FontCollection(typefaces)));
+}
+
+// static
+std::vector<std::shared_ptr<FontCollection>> FontCollection::createBatch(
+        const vector<vector<std::shared_ptr<FontFamily>>>& typefacesList) {
+    std::vector<std::shared_ptr<FontCollection>> collections(typefacesList.size());
+    // A family may be in many collections, which only read its coverage.
+    WorkerPool::getInstance().parallelFor(typefacesList.size(), [&](size_t i) {
+        collections[i].reset(new FontCollection(typefacesList[i]));
+    });
+    return collections;
 }
 
 FontCollection::FontCollection(const vector<std::shared_ptr<FontFamily>>& typefaces)
-        : mMaxChar(0), mSupportedAxes(nullptr) {
+        : mMaxChar(0),
+          mSupportedAxes(nullptr),
+          mLazyMaxChar(kUnknownMaxChar),
+          mFamilyLookupPages(nullptr),
+          mSerializedLookupFamilies(nullptr),
+          mSerializedLookupFamiliesCount(0),
+          mStableId(0),
+          mLocaleScoreRows() {
     init(typefaces);
 }
 
+FontCollection::~FontCollection() {
+    recordDestroyedId(mId);
+    for (std::atomic<const LocaleScoreRow*>& row : mLocaleScoreRows) {
+        delete row.load(std::memory_order_relaxed);
+    }
+    if (mLazyPages) {
+        for (size_t i = 0; i < mRangesCount; ++i) {
+            delete[] mLazyPages[i].load(std::memory_order_relaxed);
+        }
+    }
+    std::atomic<const uint8_t*>* pages = mFamilyLookupPages.load(std::memory_order_acquire);
+    if (pages == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < mRangesCount; ++i) {
+        const uint8_t* families = pages[i].load(std::memory_order_relaxed);
+        if (isOwnedFamilyLookupPage(families)) {
+            delete[] families;
+        }
+    }
+    delete[] pages;
+}
+
 void FontCollection::init(const vector<std::shared_ptr<FontFamily>>& typefaces) {
     mId = gNextCollectionId++;
     vector<uint32_t> lastChar;
@@ -148,18 +375,26 @@ void FontCollection::init(const vector<std::shared_ptr<FontFamily>>& typefaces)
     const FontStyle defaultStyle;
     auto families = std::make_shared<vector<std::shared_ptr<FontFamily>>>();
     std::unordered_set<AxisTag> supportedAxesSet;
+    // The lazy pages hold byte indices, so the pages of a larger collection are built eagerly.
+    const bool isLazy = FontFamily::isLazyCoverageEnabled() && nTypefaces <= MAX_FAMILY_COUNT;
     for (size_t i = 0; i < nTypefaces; i++) {
         const std::shared_ptr<FontFamily>& family = typefaces[i];
         if (family->getClosestMatch(defaultStyle).font == nullptr) {
             continue;
         }
-        const SparseBitSet& coverage = family->getCoverage();
         families->emplace_back(family);
-        if (family->hasVSTable()) {
-            mVSFamilyVec.push_back(family);
+        if (isLazy) {
+            // Don't touch the coverage here. The families without a variation sequence table
+            // never have a glyph for a sequence, so it is fine to list all of them.
+            mVSFamilyIndices.push_back(families->size() - 1);
+        } else {
+            const SparseBitSet& coverage = family->getCoverage();
+            if (family->hasVSTable()) {
+                mVSFamilyIndices.push_back(families->size() - 1);
+            }
+            mMaxChar = max(mMaxChar, coverage.length());
+            lastChar.push_back(coverage.nextSetBit(0));
         }
-        mMaxChar = max(mMaxChar, coverage.length());
-        lastChar.push_back(coverage.nextSetBit(0));
 
         for (size_t i = 0; i < family->getSupportedAxesCount(); i++) {
             supportedAxesSet.insert(family->getSupportedAxisAt(i));
@@ -170,70 +405,166 @@ void FontCollection::init(const vector<std::shared_ptr<FontFamily>>& typefaces)
     mFamilyCount = families->size();
     mFamilyIndices = nullptr;
     MINIKIN_ASSERT(mFamilyCount > 0, "Font collection must have at least one valid typeface");
-    MINIKIN_ASSERT(mFamilyCount <= MAX_FAMILY_COUNT,
-                   "Font collection may only have up to %d font families.", MAX_FAMILY_COUNT);
+    MINIKIN_ASSERT(mFamilyCount <= MAX_WIDE_FAMILY_COUNT,
+                   "Font collection may only have up to %d font families.", MAX_WIDE_FAMILY_COUNT);
+    mWideIndices = mFamilyCount > MAX_FAMILY_COUNT;
+    mWideFamilyVec = nullptr;
     // Although OpenType supports up to 2^16-1 axes per font,
     // mSupportedAxesCount may exceed 2^16-1 as we have multiple fonts.
     mSupportedAxesCount = static_cast<uint32_t>(supportedAxesSet.size());
     if (mSupportedAxesCount > 0) {
-        mSupportedAxes = sortedArrayFromSet(supportedAxesSet);
+        mOwnedSupportedAxes = sortedArrayFromSet(supportedAxesSet);
+        mSupportedAxes = mOwnedSupportedAxes.get();
+    }
+    if (isLazy) {
+        mRangesCount = (MAX_UNICODE_CODE_POINT + 1 + kPageMask) >> kLogCharsPerPage;
+        mRanges = nullptr;
+        mLazyPages.reset(new std::atomic<const uint8_t*>[mRangesCount]());
+        mFamilyVec = nullptr;
+        mFamilyVecCount = 0;
+        return;
     }
     size_t nPages = (mMaxChar + kPageMask) >> kLogCharsPerPage;
     // TODO: Use variation selector map for mRanges construction.
     // A font can have a glyph for a base code point and variation selector pair but no glyph for
     // the base code point without variation selector. The family won't be listed in the range in
     // this case.
-    mOwnedRanges = std::make_unique<Range[]>(nPages);
-    mRanges = mOwnedRanges.get();
-    mRangesCount = nPages;
+    std::shared_ptr<Range[]> ranges(new Range[nPages]);
+    std::vector<uint16_t> familyVec;
     for (size_t i = 0; i < nPages; i++) {
-        Range* range = &mOwnedRanges[i];
-        range->start = mOwnedFamilyVec.size();
+        Range* range = &ranges[i];
+        range->start = familyVec.size();
         for (size_t j = 0; j < getFamilyCount(); j++) {
             if (lastChar[j] < (i + 1) << kLogCharsPerPage) {
                 const std::shared_ptr<FontFamily>& family = getFamilyAt(j);
-                mOwnedFamilyVec.push_back(static_cast<uint8_t>(j));
+                familyVec.push_back(static_cast<uint16_t>(j));
                 uint32_t nextChar = family->getCoverage().nextSetBit((i + 1) << kLogCharsPerPage);
                 lastChar[j] = nextChar;
             }
         }
-        range->end = mOwnedFamilyVec.size();
+        range->end = familyVec.size();
     }
     // See the comment in Range for more details.
-    LOG_ALWAYS_FATAL_IF(mOwnedFamilyVec.size() >= 0xFFFF,
+    LOG_ALWAYS_FATAL_IF(familyVec.size() >= 0xFFFF,
                         "Exceeded the maximum indexable cmap coverage.");
-    mFamilyVec = mOwnedFamilyVec.data();
-    mFamilyVecCount = mOwnedFamilyVec.size();
+    mOwnedRanges = std::move(ranges);
+    mRanges = mOwnedRanges.get();
+    mRangesCount = nPages;
+    mFamilyVecCount = familyVec.size();
+    if (mWideIndices) {
+        mOwnedWideFamilyVec = std::make_shared<std::vector<uint16_t>>(std::move(familyVec));
+        mWideFamilyVec = mOwnedWideFamilyVec->data();
+        mFamilyVec = nullptr;
+    } else {
+        mOwnedFamilyVec =
+                std::make_shared<std::vector<uint8_t>>(familyVec.begin(), familyVec.end());
+        mFamilyVec = mOwnedFamilyVec->data();
+    }
+}
+
+FontCollection::FontCollection(const FontCollection& parent,
+                               std::vector<std::shared_ptr<FontFamily>>&& families)
+        : mMaxChar(parent.mMaxChar),
+          mSupportedAxes(nullptr),
+          mLazyMaxChar(kUnknownMaxChar),
+          mFamilyLookupPages(nullptr),
+          mSerializedLookupFamilies(nullptr),
+          mSerializedLookupFamiliesCount(0),
+          mStableId(0),
+          mLocaleScoreRows() {
+    mId = gNextCollectionId++;
+    mMaybeSharedFamilies =
+            std::make_shared<std::vector<std::shared_ptr<FontFamily>>>(std::move(families));
+    mFamilyCount = mMaybeSharedFamilies->size();
+    mFamilyIndices = nullptr;
+    // The families of the same coverages have the same variation sequence tables.
+    mVSFamilyIndices = parent.mVSFamilyIndices;
+    mSupportedAxesCount = parent.mSupportedAxesCount;
+    mSupportedAxes = parent.mSupportedAxes;
+    mOwnedSupportedAxes = parent.mOwnedSupportedAxes;
+    // The families have the same coverages in the same order, thus the same pages. The pages read
+    // from a buffer outlive this collection as well as the parent.
+    mRangesCount = parent.mRangesCount;
+    mRanges = parent.mRanges;
+    mFamilyVecCount = parent.mFamilyVecCount;
+    mFamilyVec = parent.mFamilyVec;
+    mWideFamilyVec = parent.mWideFamilyVec;
+    mWideIndices = parent.mWideIndices;
+    mOwnedRanges = parent.mOwnedRanges;
+    mOwnedFamilyVec = parent.mOwnedFamilyVec;
+    mOwnedWideFamilyVec = parent.mOwnedWideFamilyVec;
 }
 
 FontCollection::FontCollection(
         BufferReader* reader,
         const std::shared_ptr<std::vector<std::shared_ptr<FontFamily>>>& families)
-        : mSupportedAxes(nullptr) {
+        : mSupportedAxes(nullptr),
+          mFamilyLookupPages(nullptr),
+          mSerializedLookupFamilies(nullptr),
+          mSerializedLookupFamiliesCount(0),
+          mLocaleScoreRows() {
     mId = gNextCollectionId++;
+    mStableId = reader->read<uint64_t>();
     mMaxChar = reader->read<uint32_t>();
     mMaybeSharedFamilies = families;
     std::tie(mFamilyIndices, mFamilyCount) = reader->readArray<uint32_t>();
     for (size_t i = 0; i < getFamilyCount(); i++) {
-        const auto& family = getFamilyAt(i);
-        if (family->hasVSTable()) mVSFamilyVec.emplace_back(family);
+        if (getFamilyAt(i)->hasVSTable()) mVSFamilyIndices.push_back(i);
     }
     // Range is two packed uint16_t
     static_assert(sizeof(Range) == 4);
     std::tie(mRanges, mRangesCount) = reader->readArray<Range>();
-    std::tie(mFamilyVec, mFamilyVecCount) = reader->readArray<uint8_t>();
+    // The pages of a collection of more than MAX_FAMILY_COUNT families are written in 16 bits.
+    mWideIndices = mFamilyCount > MAX_FAMILY_COUNT;
+    if (mWideIndices) {
+        mFamilyVec = nullptr;
+        std::tie(mWideFamilyVec, mFamilyVecCount) = reader->readArray<uint16_t>();
+    } else {
+        mWideFamilyVec = nullptr;
+        std::tie(mFamilyVec, mFamilyVecCount) = reader->readArray<uint8_t>();
+    }
     const auto& [axesPtr, axesCount] = reader->readArray<AxisTag>();
+    // Used in place like the pages.
     mSupportedAxesCount = axesCount;
-    if (axesCount > 0) {
-        mSupportedAxes = std::unique_ptr<AxisTag[]>(new AxisTag[axesCount]);
-        std::copy(axesPtr, axesPtr + axesCount, mSupportedAxes.get());
+    mSupportedAxes = axesCount > 0 ? axesPtr : nullptr;
+    // The family lookup table, if written. Its pages are used in place.
+    const auto& [lookupSlots, lookupSlotsCount] = reader->readArray<uint16_t>();
+    if (lookupSlotsCount != 0) {
+        std::tie(mSerializedLookupFamilies, mSerializedLookupFamiliesCount) =
+                reader->readArray<uint8_t>();
+        std::atomic<const uint8_t*>* pages = getFamilyLookupPages();
+        for (uint32_t i = 0; i < lookupSlotsCount && i < mRangesCount; ++i) {
+            if (lookupSlots[i] != kNoLookupPage) {
+                pages[i].store(mSerializedLookupFamilies + lookupSlots[i] * kCharsPerPage,
+                               std::memory_order_relaxed);
+            }
+        }
     }
 }
 
 void FontCollection::writeTo(BufferWriter* writer,
                              const std::unordered_map<std::shared_ptr<FontFamily>, uint32_t>&
                                      fontFamilyToIndexMap) const {
-    writer->write<uint32_t>(mMaxChar);
+    // The lazily built pages are written in the same layout as the eagerly built ones, trimmed to
+    // the pages up to the highest supported character.
+    const uint32_t maxChar = getMaxChar();
+    ArrayView<Range> ranges(mRanges, mRangesCount);
+    ArrayView<uint8_t> familyVec(mFamilyVec, mFamilyVecCount);
+    std::vector<Range> lazyRanges;
+    std::vector<uint8_t> lazyFamilyVec;
+    if (mLazyPages) {
+        lazyRanges.resize((maxChar + kPageMask) >> kLogCharsPerPage);
+        for (uint32_t page = 0; page < lazyRanges.size(); ++page) {
+            const PageFamilies pageFamilies = getPageFamilies(page);
+            lazyRanges[page].start = lazyFamilyVec.size();
+            lazyFamilyVec.insert(lazyFamilyVec.end(), pageFamilies.begin(), pageFamilies.end());
+            lazyRanges[page].end = lazyFamilyVec.size();
+        }
+        ranges = lazyRanges;
+        familyVec = lazyFamilyVec;
+    }
+    writer->write<uint64_t>(getStableId());
+    writer->write<uint32_t>(maxChar);
     std::vector<uint32_t> indices;
     indices.reserve(getFamilyCount());
     for (size_t i = 0; i < getFamilyCount(); ++i) {
@@ -246,10 +577,196 @@ void FontCollection::writeTo(BufferWriter* writer,
         }
     }
     writer->writeArray<uint32_t>(indices.data(), indices.size());
-    writer->writeArray<Range>(mRanges, mRangesCount);
-    writer->writeArray<uint8_t>(mFamilyVec, mFamilyVecCount);
-    // No need to serialize mVSFamilyVec as it can be reconstructed easily from mFamilies.
-    writer->writeArray<AxisTag>(mSupportedAxes.get(), mSupportedAxesCount);
+    writer->writeArray<Range>(ranges.data(), ranges.size());
+    if (mWideIndices) {
+        writer->writeArray<uint16_t>(mWideFamilyVec, mFamilyVecCount);
+    } else {
+        writer->writeArray<uint8_t>(familyVec.data(), familyVec.size());
+    }
+    // No need to serialize mVSFamilyIndices as it can be reconstructed easily from mFamilies.
+    writer->writeArray<AxisTag>(mSupportedAxes, mSupportedAxesCount);
+    if (!isFamilyLookupTableEnabled() || mWideIndices) {
+        writer->write<uint32_t>(0);  // An empty array of the lookup table slots.
+        return;
+    }
+    // Write the whole table so that the size doesn't depend on which pages have been looked up.
+    // The pages without any families are always ambiguous, thus omitted.
+    std::vector<uint16_t> lookupSlots(ranges.size(), kNoLookupPage);
+    std::vector<uint8_t> lookupFamilies;
+    for (uint32_t page = 0; page < ranges.size(); ++page) {
+        if (ranges[page].start == ranges[page].end) {
+            continue;
+        }
+        lookupSlots[page] = lookupFamilies.size() / kCharsPerPage;
+        const uint8_t* families = getFamilyLookupPage(page);
+        lookupFamilies.insert(lookupFamilies.end(), families, families + kCharsPerPage);
+    }
+    writer->writeArray<uint16_t>(lookupSlots.data(), lookupSlots.size());
+    writer->writeArray<uint8_t>(lookupFamilies.data(), lookupFamilies.size());
+}
+
+// static
+bool FontCollection::isFamilyLookupTableEnabled() {
+    return gFamilyLookupTableEnabled.load(std::memory_order_relaxed);
+}
+
+// static
+void FontCollection::setFamilyLookupTableEnabled(bool enabled) {
+    gFamilyLookupTableEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+bool FontCollection::isInterningEnabled() {
+    return gInterningEnabled.load(std::memory_order_relaxed);
+}
+
+// static
+void FontCollection::setInterningEnabled(bool enabled) {
+    gInterningEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+bool FontCollection::isParallelItemizationEnabled() {
+    return gParallelItemizationEnabled.load(std::memory_order_relaxed);
+}
+
+// static
+void FontCollection::setParallelItemizationEnabled(bool enabled) {
+    gParallelItemizationEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool FontCollection::isOwnedFamilyLookupPage(const uint8_t* families) const {
+    return families != nullptr &&
+           (families < mSerializedLookupFamilies ||
+            families >= mSerializedLookupFamilies + mSerializedLookupFamiliesCount);
+}
+
+std::atomic<const uint8_t*>* FontCollection::getFamilyLookupPages() const {
+    std::atomic<const uint8_t*>* pages = mFamilyLookupPages.load(std::memory_order_acquire);
+    if (pages == nullptr) {
+        // The first one set wins if multiple threads get here.
+        std::unique_ptr<std::atomic<const uint8_t*>[]> newPages(
+                new std::atomic<const uint8_t*>[mRangesCount]());
+        std::atomic<const uint8_t*>* expected = nullptr;
+        if (mFamilyLookupPages.compare_exchange_strong(expected, newPages.get(),
+                                                       std::memory_order_acq_rel,
+                                                       std::memory_order_acquire)) {
+            pages = newPages.release();
+        } else {
+            pages = expected;
+        }
+    }
+    return pages;
+}
+
+const uint8_t* FontCollection::getFamilyLookupPage(uint32_t page) const {
+    std::atomic<const uint8_t*>& slot = getFamilyLookupPages()[page];
+    const uint8_t* families = slot.load(std::memory_order_acquire);
+    if (families == nullptr) {
+        std::unique_ptr<uint8_t[]> newFamilies(new uint8_t[kCharsPerPage]);
+        buildFamilyLookupPage(page, newFamilies.get());
+        const uint8_t* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, newFamilies.get(), std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+            families = newFamilies.release();
+        } else {
+            families = expected;
+        }
+    }
+    return families;
+}
+
+FontCollection::PageFamilies FontCollection::getPageFamilies(uint32_t page) const {
+    if (!mLazyPages) {
+        const Range& range = mRanges[page];
+        if (mWideIndices) {
+            return PageFamilies(mWideFamilyVec + range.start, range.end - range.start);
+        }
+        return PageFamilies(mFamilyVec + range.start, range.end - range.start);
+    }
+    const uint8_t* families = mLazyPages[page].load(std::memory_order_acquire);
+    if (families == nullptr) {
+        families = buildLazyPage(page);
+    }
+    return PageFamilies(families + 1, families[0]);
+}
+
+uint32_t FontCollection::getMaxChar() const {
+    if (!mLazyPages) {
+        return mMaxChar;
+    }
+    uint32_t maxChar = mLazyMaxChar.load(std::memory_order_relaxed);
+    if (maxChar == kUnknownMaxChar) {
+        // Every thread computes the same value, thus no need to synchronize.
+        maxChar = 0;
+        for (size_t i = 0; i < getFamilyCount(); ++i) {
+            maxChar = max(maxChar, getFamilyAt(i)->getCoverage().length());
+        }
+        mLazyMaxChar.store(maxChar, std::memory_order_relaxed);
+    }
+    return maxChar;
+}
+
+const uint8_t* FontCollection::buildLazyPage(uint32_t page) const {
+    const uint32_t pageStart = page << kLogCharsPerPage;
+    std::vector<uint8_t> indices;
+    for (size_t i = 0; i < getFamilyCount(); ++i) {
+        const uint32_t nextChar = getFamilyAt(i)->getCoverage().nextSetBit(pageStart);
+        if (nextChar != SparseBitSet::kNotFound && nextChar < pageStart + kCharsPerPage) {
+            indices.push_back(static_cast<uint8_t>(i));
+        }
+    }
+    std::unique_ptr<uint8_t[]> newFamilies(new uint8_t[indices.size() + 1]);
+    newFamilies[0] = static_cast<uint8_t>(indices.size());
+    std::copy(indices.begin(), indices.end(), newFamilies.get() + 1);
+    // The first one set wins if multiple threads get here.
+    const uint8_t* expected = nullptr;
+    if (mLazyPages[page].compare_exchange_strong(expected, newFamilies.get(),
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+        return newFamilies.release();
+    }
+    return expected;
+}
+
+void FontCollection::buildFamilyLookupPage(uint32_t page, uint8_t* outFamilies) const {
+    const PageFamilies pageFamilies = getPageFamilies(page);
+    for (uint32_t i = 0; i < kCharsPerPage; ++i) {
+        const uint32_t ch = (page << kLogCharsPerPage) | i;
+        // Same as getFamilyForChar without a variation selector: the first primary family
+        // supporting the character always wins, otherwise the family is only known without
+        // scoring if just one family supports it.
+        uint8_t family = kAmbiguousFamily;
+        uint32_t supportedCount = 0;
+        for (const uint16_t familyIndex : pageFamilies) {
+            const std::shared_ptr<FontFamily>& fontFamily = getFamilyAt(familyIndex);
+            if (!fontFamily->getCoverage().get(ch)) {
+                continue;
+            }
+            if (isPrimaryFamily(fontFamily)) {
+                family = static_cast<uint8_t>(familyIndex);
+                supportedCount = 1;
+                break;
+            }
+            family = static_cast<uint8_t>(familyIndex);
+            supportedCount++;
+        }
+        outFamilies[i] = supportedCount == 1 ? family : kAmbiguousFamily;
+    }
+}
+
+std::shared_future<void> FontCollection::warmUpFontsAsync(uint32_t localeListId) const {
+    std::vector<std::shared_ptr<Font>> fonts;
+    for (size_t i = 0; i < getFamilyCount(); ++i) {
+        const std::shared_ptr<FontFamily>& family = getFamilyAt(i);
+        if (!isPrimaryFamily(family) && getLocaleMatchingScore(localeListId, i) == 0) {
+            continue;
+        }
+        for (size_t j = 0; j < family->getNumFonts(); ++j) {
+            fonts.push_back(family->getFontRef(j));
+        }
+    }
+    return Font::warmUpAsync(std::move(fonts));
 }
 
 // static
@@ -318,15 +835,15 @@ const uint32_t kFirstFontScore = UINT32_MAX;
 //  - kFirstFontScore: When the font is the first font family in the collection and it supports the
 //    given character or variation sequence.
 uint32_t FontCollection::calcFamilyScore(uint32_t ch, uint32_t vs, FamilyVariant variant,
-                                         uint32_t localeListId,
-                                         const std::shared_ptr<FontFamily>& fontFamily) const {
+                                         uint32_t localeListId, uint16_t familyIndex) const {
+    const std::shared_ptr<FontFamily>& fontFamily = getFamilyAt(familyIndex);
     const uint32_t coverageScore = calcCoverageScore(ch, vs, localeListId, fontFamily);
     if (coverageScore == kFirstFontScore || coverageScore == kUnsupportedFontScore) {
         // No need to calculate other scores.
         return coverageScore;
     }
 
-    const uint32_t localeScore = calcLocaleMatchingScore(localeListId, *fontFamily);
+    const uint32_t localeScore = getLocaleMatchingScore(localeListId, familyIndex);
     const uint32_t variantScore = calcVariantMatchingScore(variant, *fontFamily);
 
     // Subscores are encoded into 31 bits representation to meet the subscore priority.
@@ -435,6 +952,35 @@ uint32_t FontCollection::calcLocaleMatchingScore(uint32_t userLocaleListId,
     return score;
 }
 
+uint32_t FontCollection::getLocaleMatchingScore(uint32_t userLocaleListId,
+                                                uint16_t familyIndex) const {
+    for (std::atomic<const LocaleScoreRow*>& slot : mLocaleScoreRows) {
+        const LocaleScoreRow* row = slot.load(std::memory_order_acquire);
+        if (row == nullptr) {
+            // The first one set wins if multiple threads get here. The loser looks for its locale
+            // list in the following rows.
+            auto newRow = std::make_unique<LocaleScoreRow>();
+            newRow->localeListId = userLocaleListId;
+            newRow->scores.reserve(getFamilyCount());
+            for (size_t i = 0; i < getFamilyCount(); ++i) {
+                newRow->scores.push_back(
+                        calcLocaleMatchingScore(userLocaleListId, *getFamilyAt(i)));
+            }
+            const LocaleScoreRow* expected = nullptr;
+            if (slot.compare_exchange_strong(expected, newRow.get(), std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+                row = newRow.release();
+            } else {
+                row = expected;
+            }
+        }
+        if (row->localeListId == userLocaleListId) {
+            return row->scores[familyIndex];
+        }
+    }
+    return calcLocaleMatchingScore(userLocaleListId, *getFamilyAt(familyIndex));
+}
+
 // Calculates a font score based on variant ("compact" or "elegant") matching.
 //  - Returns 1 if the font doesn't have variant or the variant matches with the text style.
 //  - No score if the font has a variant but it doesn't match with the text style.
@@ -462,23 +1008,66 @@ uint32_t FontCollection::calcVariantMatchingScore(FamilyVariant variant,
 FontCollection::FamilyMatchResult FontCollection::getFamilyForChar(uint32_t ch, uint32_t vs,
                                                                    uint32_t localeListId,
                                                                    FamilyVariant variant) const {
-    if (ch >= mMaxChar) {
-        return FamilyMatchResult::Builder().add(0).build();
+    if (ch >= getMaxChar()) {
+        return matchBuilder().add(0).build();
     }
+    const uint16_t vsIndex = vs == 0 ? 0 : getVsIndex(vs);
+    if (vsIndex == INVALID_VS_INDEX) {
+        return getFamilyForCharUncached(ch, vs, localeListId, variant);
+    }
+    // The code point takes 21 bits, the variation selector index plus one 9 bits and the variant
+    // the remaining 2 bits.
+    const uint32_t charKey = ch | (static_cast<uint32_t>(vs == 0 ? 0 : vsIndex + 1) << 21) |
+                             (static_cast<uint32_t>(variant) << 30);
+    FamilyForCharCache::Entry& entry =
+            FamilyForCharCache::getInstance().get(mId, charKey, localeListId);
+    if (entry.result != 0 && entry.collectionId == mId && entry.charKey == charKey &&
+        entry.localeListId == localeListId) {
+        return FamilyMatchResult(entry.result);
+    }
+    const FamilyMatchResult result = getFamilyForCharUncached(ch, vs, localeListId, variant);
+    if (result.isPacked()) {
+        entry = {mId, charKey, localeListId, result.mBits};
+    }
+    return result;
+}
 
-    Range range = mRanges[ch >> kLogCharsPerPage];
+FontCollection::FamilyMatchResult FontCollection::getFamilyForCharUncached(
+        uint32_t ch, uint32_t vs, uint32_t localeListId, FamilyVariant variant) const {
+    if (ch >= getMaxChar()) {
+        return matchBuilder().add(0).build();
+    }
+
+    if (vs == 0 && !mWideIndices && isFamilyLookupTableEnabled()) {
+        const uint8_t family = getFamilyLookupPage(ch >> kLogCharsPerPage)[ch & kPageMask];
+        if (family != kAmbiguousFamily) {
+            return FamilyMatchResult::Builder().add(family).build();
+        }
+    }
 
+    // The page families aren't aware of the variation sequences. A family can support the sequence
+    // without the base character only if it has a variation sequence table, so the candidates are
+    // the page families merged with those families, still in the order of the collection.
+    PageFamilies candidates = getPageFamilies(ch >> kLogCharsPerPage);
+    uint16_t mergedFamilies[MAX_FAMILY_COUNT];
+    std::vector<uint16_t> wideMergedFamilies;
     if (vs != 0) {
-        range = {0, static_cast<uint16_t>(getFamilyCount())};
+        uint16_t* merged = mergedFamilies;
+        if (mWideIndices) {
+            wideMergedFamilies.resize(getFamilyCount());
+            merged = wideMergedFamilies.data();
+        }
+        uint16_t* mergedEnd = std::set_union(candidates.begin(), candidates.end(),
+                                             mVSFamilyIndices.begin(), mVSFamilyIndices.end(),
+                                             merged);
+        candidates = PageFamilies(merged, mergedEnd - merged);
     }
 
     uint32_t bestScore = kUnsupportedFontScore;
-    FamilyMatchResult::Builder builder;
+    FamilyMatchResult::Builder builder = matchBuilder();
 
-    for (size_t i = range.start; i < range.end; i++) {
-        const uint8_t familyIndex = vs == 0 ? mFamilyVec[i] : i;
-        const std::shared_ptr<FontFamily>& family = getFamilyAt(familyIndex);
-        const uint32_t score = calcFamilyScore(ch, vs, variant, localeListId, family);
+    for (const uint16_t familyIndex : candidates) {
+        const uint32_t score = calcFamilyScore(ch, vs, variant, localeListId, familyIndex);
         if (score == kFirstFontScore) {
             // If the first font family supports the given character or variation sequence, always
             // use it.
@@ -501,10 +1090,10 @@ FontCollection::FamilyMatchResult FontCollection::getFamilyForChar(uint32_t ch,
             if (U_SUCCESS(errorCode) && len > 0) {
                 int off = 0;
                 U16_NEXT_UNSAFE(decomposed, off, ch);
-                return getFamilyForChar(ch, vs, localeListId, variant);
+                return getFamilyForCharUncached(ch, vs, localeListId, variant);
             }
         }
-        return FamilyMatchResult::Builder().add(0).build();
+        return matchBuilder().add(0).build();
     }
     return builder.build();
 }
@@ -553,13 +1142,13 @@ bool FontCollection::hasVariationSelector(uint32_t baseCodepoint,
     if (!isVariationSelector(variationSelector)) {
         return false;
     }
-    if (baseCodepoint >= mMaxChar) {
+    if (baseCodepoint >= getMaxChar()) {
         return false;
     }
 
     // Currently mRanges can not be used here since it isn't aware of the variation sequence.
-    for (size_t i = 0; i < mVSFamilyVec.size(); i++) {
-        if (mVSFamilyVec[i]->hasGlyph(baseCodepoint, variationSelector)) {
+    for (const uint16_t familyIndex : mVSFamilyIndices) {
+        if (getFamilyAt(familyIndex)->hasGlyph(baseCodepoint, variationSelector)) {
             return true;
         }
     }
@@ -570,8 +1159,9 @@ bool FontCollection::hasVariationSelector(uint32_t baseCodepoint,
     // sequences, since Unicode is adding variation sequences more frequently now and may even move
     // towards allowing text and emoji variation selectors on any character.
     if (variationSelector == TEXT_STYLE_VS) {
-        for (size_t i = 0; i < getFamilyCount(); ++i) {
-            const std::shared_ptr<FontFamily>& family = getFamilyAt(i);
+        // Only the families of the page can have the base character.
+        for (const uint16_t familyIndex : getPageFamilies(baseCodepoint >> kLogCharsPerPage)) {
+            const std::shared_ptr<FontFamily>& family = getFamilyAt(familyIndex);
             if (!family->isColorEmojiFamily() && family->hasGlyph(baseCodepoint, 0)) {
                 return true;
             }
@@ -583,15 +1173,31 @@ bool FontCollection::hasVariationSelector(uint32_t baseCodepoint,
 
 constexpr uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
 
+FontCollection::FamilyMatchResult::Builder&
+FontCollection::FamilyMatchResult::Builder::addOutOfLine(uint16_t x) {
+    if (!mFamilies) {
+        mFamilies = std::make_shared<std::vector<uint16_t>>();
+        for (uint32_t i = 0; i < mSize; ++i) {
+            mFamilies->push_back(static_cast<uint16_t>(mBits >> (i * 16)));
+        }
+    } else if (mFamilies.use_count() > 1) {
+        // Shared with a built result.
+        mFamilies = std::make_shared<std::vector<uint16_t>>(*mFamilies);
+    }
+    mFamilies->push_back(x);
+    mSize++;
+    return *this;
+}
+
 FontCollection::FamilyMatchResult FontCollection::FamilyMatchResult::intersect(
-        FontCollection::FamilyMatchResult l, FontCollection::FamilyMatchResult r) {
+        const FontCollection::FamilyMatchResult& l, const FontCollection::FamilyMatchResult& r) {
     if (l == r) {
         return l;
     }
 
     uint32_t li = 0;
     uint32_t ri = 0;
-    FamilyMatchResult::Builder b;
+    FamilyMatchResult::Builder b(l.isWide());
     while (li < l.size() && ri < r.size()) {
         if (l[li] < r[ri]) {
             li++;
@@ -606,10 +1212,209 @@ FontCollection::FamilyMatchResult FontCollection::FamilyMatchResult::intersect(
     return b.build();
 }
 
+static bool isSameVariations(const std::vector<FontVariation>& l,
+                             const std::vector<FontVariation>& r) {
+    return l.size() == r.size() &&
+           std::equal(l.begin(), l.end(), r.begin(),
+                      [](const FontVariation& lv, const FontVariation& rv) {
+                          return lv.axisTag == rv.axisTag && lv.value == rv.value;
+                      });
+}
+
+// Returns true if the code unit is a BMP character other than a variation selector, i.e. it
+// neither needs decoding nor changes the family lookup of the previous character.
+static inline bool isSimpleCodeUnit(uint16_t c) {
+    return !U16_IS_SURROGATE(c) && !(0xFE00 <= c && c <= 0xFE0F);
+}
+
+size_t FontCollection::scanRunContinuation(const uint16_t* text, size_t pos, size_t size,
+                                           uint16_t familyIndex) const {
+    const std::shared_ptr<FontFamily>& family = getFamilyAt(familyIndex);
+    if (family->isColorEmojiFamily() || !isPrimaryFamily(family)) {
+        return pos;
+    }
+    // If the family is the first primary family of the page, getFamilyForChar returns only the
+    // family for all the characters it supports in the page. Every such character continues the
+    // run, either as a sticky or combining character or by the family lookup.
+    const SparseBitSet& coverage = family->getCoverage();
+    size_t end = pos;
+    while (end < size && isSimpleCodeUnit(text[end])) {
+        const uint32_t page = text[end] >> kLogCharsPerPage;
+        if (text[end] >= getMaxChar()) {
+            break;
+        }
+        bool isFirstPrimaryInPage = false;
+        for (const uint16_t pageFamily : getPageFamilies(page)) {
+            if (pageFamily == familyIndex) {
+                isFirstPrimaryInPage = true;
+                break;
+            }
+            if (isPrimaryFamily(getFamilyAt(pageFamily))) {
+                break;
+            }
+        }
+        if (!isFirstPrimaryInPage) {
+            break;
+        }
+        // Test the coverage of the simple code units of the page at once.
+        size_t pageEnd = end + 1;
+        while (pageEnd < size && isSimpleCodeUnit(text[pageEnd]) &&
+               (text[pageEnd] >> kLogCharsPerPage) == page) {
+            ++pageEnd;
+        }
+        const size_t covered = coverage.findFirstUnset(text + end, pageEnd - end);
+        end += covered;
+        if (end != pageEnd) {
+            break;
+        }
+    }
+    // The last character is looked up with the following variation selector, if any.
+    if (end < size && end > pos && !isSimpleCodeUnit(text[end])) {
+        --end;
+    }
+    return end;
+}
+
 std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, FontStyle,
                                                          uint32_t localeListId,
                                                          FamilyVariant familyVariant,
                                                          uint32_t runMax) const {
+    const StyleRange styleRange = {0, static_cast<uint32_t>(text.size()), localeListId,
+                                   familyVariant};
+    return itemizeStyleRanges(text, &styleRange, 1, runMax);
+}
+
+std::vector<FontCollection::Run> FontCollection::itemize(
+        U16StringPiece text, const std::vector<StyleRange>& styleRanges) const {
+    if (styleRanges.empty()) {
+        return std::vector<Run>();
+    }
+    return itemizeStyleRanges(text, styleRanges.data(), styleRanges.size(), text.size());
+}
+
+// The texts shorter than this are itemized sequentially, since the chunks would be too short to
+// be worth a task.
+constexpr uint32_t kMinParallelItemizeLength = 16384;
+// The shortest chunk of a text itemized in parallel.
+constexpr uint32_t kMinItemizeChunkLength = 4096;
+// How far from the even split a chunk boundary is searched for.
+constexpr uint32_t kMaxItemizeChunkBoundarySearch = 1024;
+
+// Returns true if the itemization of the text from pos is the same whatever precedes pos, except
+// for the run pos starts or continues: the character at pos always looks up its families, is never
+// attached to the previous run, and breaks the run unless the previous run has the same first
+// family, which is not a color emoji family.
+static bool isItemizeChunkBoundary(const uint16_t* text, size_t pos) {
+    const uint16_t c = text[pos];
+    // The surrogate pairs and the emoji sequences are not split. isEmojiBreak() is true for any
+    // other pair of characters.
+    if (U16_IS_SURROGATE(c) || text[pos - 1] == CHAR_ZWJ || isEmojiModifier(c) || isKeyCap(c)) {
+        return false;
+    }
+    return !doesNotNeedFontSupport(c) && !isStickyAllowlisted(c) && !isCombining(c);
+}
+
+bool FontCollection::itemizeInParallel(U16StringPiece text, const StyleRange* styleRanges,
+                                       size_t styleRangeCount, std::vector<Run>* outRuns) const {
+    const uint16_t* string = text.data();
+    const uint32_t size = text.size();
+    WorkerPool& pool = WorkerPool::getInstance();
+    const uint32_t chunkCount =
+            std::min(pool.getThreadCount() + 1, size / kMinItemizeChunkLength);
+    if (chunkCount < 2) {
+        return false;
+    }
+
+    // The first chunk needs a character needing a font, otherwise its characters would join the
+    // first run of the next chunk.
+    uint32_t firstFontChar = 0;
+    while (firstFontChar < size) {
+        size_t next = firstFontChar;
+        uint32_t ch;
+        U16_NEXT(string, next, size, ch);
+        if (!doesNotNeedFontSupport(ch)) {
+            break;
+        }
+        firstFontChar = next;
+    }
+
+    std::vector<uint32_t> boundaries = {0};
+    for (uint32_t i = 1; i < chunkCount; ++i) {
+        const uint32_t target = static_cast<uint64_t>(size) * i / chunkCount;
+        const uint32_t searchEnd = std::min(size - 1, target + kMaxItemizeChunkBoundarySearch);
+        const uint32_t searchStart = std::max({target, firstFontChar + 1, boundaries.back() + 1});
+        for (uint32_t pos = searchStart; pos < searchEnd; ++pos) {
+            if (isItemizeChunkBoundary(string, pos)) {
+                boundaries.push_back(pos);
+                break;
+            }
+        }
+    }
+    if (boundaries.size() < 2) {
+        return false;
+    }
+    boundaries.push_back(size);
+
+    std::vector<std::vector<Run>> chunkRuns(boundaries.size() - 1);
+    pool.parallelFor(chunkRuns.size(), [&](size_t i) {
+        const uint32_t start = boundaries[i];
+        const uint32_t end = boundaries[i + 1];
+        std::vector<StyleRange> chunkStyles;
+        for (size_t j = 0; j < styleRangeCount; ++j) {
+            const StyleRange& style = styleRanges[j];
+            if (style.end > start && style.start < end) {
+                chunkStyles.push_back({std::max(style.start, start) - start,
+                                       std::min(style.end, end) - start, style.localeListId,
+                                       style.familyVariant});
+            }
+        }
+        const U16StringPiece chunk = text.substr(minikin::Range(start, end));
+        chunkRuns[i] = itemizeSequentially(chunk, chunkStyles.data(), chunkStyles.size(),
+                                           chunk.size());
+        for (Run& run : chunkRuns[i]) {
+            run.start += start;
+            run.end += start;
+        }
+    });
+
+    // The first character of a chunk continues the last run of the previous chunk if the
+    // sequential itemization would not break the run there. The run keeps its families.
+    std::vector<Run>& result = *outRuns;
+    result = std::move(chunkRuns[0]);
+    for (size_t i = 1; i < chunkRuns.size(); ++i) {
+        const std::vector<Run>& runs = chunkRuns[i];
+        Run& last = result.back();
+        auto first = runs.begin();
+        if (first->familyMatch[0] == last.familyMatch[0] &&
+            !getFamilyAt(last.familyMatch[0])->isColorEmojiFamily()) {
+            last.end = first->end;
+            ++first;
+        }
+        result.insert(result.end(), first, runs.end());
+    }
+    return true;
+}
+
+std::vector<FontCollection::Run> FontCollection::itemizeStyleRanges(U16StringPiece text,
+                                                                    const StyleRange* styleRanges,
+                                                                    size_t styleRangeCount,
+                                                                    uint32_t runMax) const {
+    if (runMax >= text.size() && text.size() >= kMinParallelItemizeLength &&
+        isParallelItemizationEnabled()) {
+        MINIKIN_TRACE_NAME("FontCollection::itemizeInParallel");
+        std::vector<Run> result;
+        if (itemizeInParallel(text, styleRanges, styleRangeCount, &result)) {
+            return result;
+        }
+    }
+    return itemizeSequentially(text, styleRanges, styleRangeCount, runMax);
+}
+
+std::vector<FontCollection::Run> FontCollection::itemizeSequentially(U16StringPiece text,
+                                                                     const StyleRange* styleRanges,
+                                                                     size_t styleRangeCount,
+                                                                     uint32_t runMax) const {
+    MINIKIN_TRACE_NAME("FontCollection::itemize");
     const uint16_t* string = text.data();
     const uint32_t string_size = text.size();
 
@@ -631,6 +1436,7 @@ std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, Fo
     if (U_IS_SURROGATE(nextCh)) {
         nextCh = REPLACEMENT_CHARACTER;
     }
+    size_t styleIndex = 0;
 
     do {
         const uint32_t ch = nextCh;
@@ -656,7 +1462,7 @@ std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, Fo
             if (lastFamily->isColorEmojiFamily()) {
                 // If the last family is color emoji font, find the longest family.
                 shouldContinueRun = false;
-                for (uint8_t ix : lastFamilyIndices) {
+                for (uint16_t ix : lastFamilyIndices) {
                     shouldContinueRun |= getFamilyAt(ix)->getCoverage().get(ch);
                 }
             } else {
@@ -665,8 +1471,13 @@ std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, Fo
         }
 
         if (!shouldContinueRun) {
-            FamilyMatchResult familyIndices = getFamilyForChar(
-                    ch, isVariationSelector(nextCh) ? nextCh : 0, localeListId, familyVariant);
+            while (styleIndex + 1 < styleRangeCount && utf16Pos >= styleRanges[styleIndex].end) {
+                ++styleIndex;
+            }
+            const StyleRange& styleRange = styleRanges[styleIndex];
+            FamilyMatchResult familyIndices =
+                    getFamilyForChar(ch, isVariationSelector(nextCh) ? nextCh : 0,
+                                     styleRange.localeListId, styleRange.familyVariant);
             bool breakRun;
             if (utf16Pos == 0 || lastFamilyIndices.empty()) {
                 breakRun = true;
@@ -702,7 +1513,7 @@ std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, Fo
                 // handled properly by this since it's a combining mark too.
                 if (utf16Pos != 0 &&
                     (isCombining(ch) || (isEmojiModifier(ch) && isEmojiBase(prevCh)))) {
-                    for (uint8_t ix : familyIndices) {
+                    for (uint16_t ix : familyIndices) {
                         if (getFamilyAt(ix)->getCoverage().get(prevCh)) {
                             const size_t prevChLength = U16_LENGTH(prevCh);
                             if (run != nullptr) {
@@ -741,13 +1552,34 @@ std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, Fo
         if (result.size() >= 2 && runMax == result.size() - 2) {
             break;
         }
+
+        // Extend the run over the following characters at once if they are known to continue it,
+        // e.g. for the plain text in the primary font.
+        if (run != nullptr && nextCh != kEndOfString) {
+            const size_t spanEnd =
+                    scanRunContinuation(string, nextUtf16Pos, string_size, lastFamilyIndices[0]);
+            if (spanEnd > nextUtf16Pos) {
+                prevCh = string[spanEnd - 1];
+                run->end = spanEnd;
+                nextUtf16Pos = spanEnd;
+                readLength = spanEnd;
+                if (readLength < string_size) {
+                    U16_NEXT(string, readLength, string_size, nextCh);
+                    if (U_IS_SURROGATE(nextCh)) {
+                        nextCh = REPLACEMENT_CHARACTER;
+                    }
+                } else {
+                    nextCh = kEndOfString;
+                }
+            }
+        }
     } while (nextCh != kEndOfString);
 
     if (lastFamilyIndices.empty()) {
         // No character needed any font support, so it doesn't really matter which font they end up
         // getting displayed in. We put the whole string in one run, using the first font.
         result.push_back(
-                {FamilyMatchResult::Builder().add(0).build(), 0, static_cast<int>(string_size)});
+                {matchBuilder().add(0).build(), 0, static_cast<int>(string_size)});
     }
 
     if (result.size() > runMax) {
@@ -758,12 +1590,80 @@ std::vector<FontCollection::Run> FontCollection::itemize(U16StringPiece text, Fo
     return result;
 }
 
+bool FontCollection::sliceParagraphRuns(U16StringPiece text, const std::vector<Run>& paragraphRuns,
+                                        const minikin::Range& range, uint32_t localeListId,
+                                        FamilyVariant familyVariant,
+                                        std::vector<Run>* outRuns) const {
+    const uint32_t start = range.getStart();
+    const uint32_t end = range.getEnd();
+    if (range.isEmpty() || end > text.size()) {
+        return false;
+    }
+    // The characters split at the range boundaries are decoded differently from the substring.
+    if (U16_IS_TRAIL(text[start]) || (end < text.size() && U16_IS_TRAIL(text[end]))) {
+        return false;
+    }
+    // The following variation selector changes the family of the last character in the paragraph
+    // but not in the substring.
+    if (end < text.size()) {
+        size_t i = end;
+        uint32_t next;
+        U16_NEXT(text.data(), i, text.size(), next);
+        if (isVariationSelector(next)) {
+            return false;
+        }
+    }
+    const auto it = std::upper_bound(
+            paragraphRuns.begin(), paragraphRuns.end(), start,
+            [](uint32_t pos, const Run& run) { return pos < static_cast<uint32_t>(run.end); });
+    if (it == paragraphRuns.end() || static_cast<uint32_t>(it->start) > start ||
+        static_cast<uint32_t>(it->end) < end) {
+        return false;
+    }
+    // The emoji families may be narrowed down in the middle of the run.
+    const FamilyMatchResult& familyMatch = it->familyMatch;
+    if (getFamilyAt(familyMatch[0])->isColorEmojiFamily()) {
+        return false;
+    }
+    // A run of other families never breaks in the middle, so every character of the substring
+    // continues the run of its first character needing a font, if that character gets the same
+    // families when looked up on its own.
+    const U16StringPiece substr = text.substr(range);
+    size_t i = 0;
+    while (i < substr.size()) {
+        uint32_t ch;
+        U16_NEXT(substr.data(), i, substr.size(), ch);
+        if (U_IS_SURROGATE(ch)) {
+            ch = REPLACEMENT_CHARACTER;
+        }
+        if (doesNotNeedFontSupport(ch)) {
+            continue;
+        }
+        uint32_t vs = 0;
+        if (i < substr.size()) {
+            size_t next = i;
+            U16_NEXT(substr.data(), next, substr.size(), vs);
+            if (!isVariationSelector(vs)) {
+                vs = 0;
+            }
+        }
+        if (!(getFamilyForChar(ch, vs, localeListId, familyVariant) == familyMatch)) {
+            return false;
+        }
+        outRuns->assign(1, {familyMatch, 0, static_cast<int>(substr.size())});
+        return true;
+    }
+    // The substring alone gets the first family instead.
+    return false;
+}
+
 FakedFont FontCollection::getBestFont(U16StringPiece text, const Run& run, FontStyle style) {
-    uint8_t bestIndex = 0;
+    uint16_t bestIndex = 0;
     uint32_t bestScore = 0xFFFFFFFF;
 
     const std::shared_ptr<FontFamily>& family = getFamilyAt(run.familyMatch[0]);
     if (family->isColorEmojiFamily() && run.familyMatch.size() > 1) {
+        Font::ExternalRefsGuard externalRefsGuard;
         for (size_t i = 0; i < run.familyMatch.size(); ++i) {
             const std::shared_ptr<FontFamily>& family = getFamilyAt(run.familyMatch[i]);
             const HbFontUniquePtr& font = family->getFont(0)->baseFont();
@@ -792,7 +1692,7 @@ std::shared_ptr<FontCollection> FontCollection::createCollectionWithVariation(
 
     bool hasSupportedAxis = false;
     for (const FontVariation& variation : variations) {
-        if (std::binary_search(mSupportedAxes.get(), mSupportedAxes.get() + mSupportedAxesCount,
+        if (std::binary_search(mSupportedAxes, mSupportedAxes + mSupportedAxesCount,
                                variation.axisTag)) {
             hasSupportedAxis = true;
             break;
@@ -803,18 +1703,67 @@ std::shared_ptr<FontCollection> FontCollection::createCollectionWithVariation(
         return nullptr;
     }
 
-    std::vector<std::shared_ptr<FontFamily>> families;
-    for (size_t i = 0; i < getFamilyCount(); ++i) {
-        const std::shared_ptr<FontFamily>& family = getFamilyAt(i);
-        std::shared_ptr<FontFamily> newFamily = family->createFamilyWithVariation(variations);
-        if (newFamily) {
-            families.push_back(newFamily);
-        } else {
-            families.push_back(family);
+    // Animations of the axis values often request the same variations again.
+    {
+        std::lock_guard<std::mutex> lock(mVariationMutex);
+        for (const auto& [cachedVariations, cachedCollection] : mVariationCollections) {
+            if (isSameVariations(cachedVariations, variations)) {
+                if (std::shared_ptr<FontCollection> collection = cachedCollection.lock()) {
+                    return collection;
+                }
+                break;
+            }
         }
     }
 
-    return std::shared_ptr<FontCollection>(new FontCollection(families));
+    // The equivalent collections share the collections created with the same variations too,
+    // beyond the few recent ones of each collection.
+    InternKey internKey;
+    std::shared_ptr<FontCollection> collection;
+    if (isInterningEnabled()) {
+        std::vector<std::shared_ptr<FontFamily>> baseFamilies;
+        for (size_t i = 0; i < getFamilyCount(); ++i) {
+            baseFamilies.push_back(getFamilyAt(i));
+        }
+        internKey = makeInternKey(baseFamilies, variations);
+        collection = getInternTable().find(internKey);
+    }
+
+    if (!collection) {
+        std::vector<std::shared_ptr<FontFamily>> families;
+        for (size_t i = 0; i < getFamilyCount(); ++i) {
+            const std::shared_ptr<FontFamily>& family = getFamilyAt(i);
+            std::shared_ptr<FontFamily> newFamily =
+                    FontFamily::createFamilyWithVariation(family, variations);
+            if (newFamily) {
+                families.push_back(newFamily);
+            } else {
+                families.push_back(family);
+            }
+        }
+
+        // TODO(b/174672300): Revert back to make_shared.
+        collection.reset(mLazyPages ? new FontCollection(families)
+                                    : new FontCollection(*this, std::move(families)));
+        if (isInterningEnabled()) {
+            collection = getInternTable().insert(std::move(internKey), std::move(collection));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mVariationMutex);
+    auto it = std::find_if(mVariationCollections.begin(), mVariationCollections.end(),
+                           [&variations](const auto& entry) {
+                               return isSameVariations(entry.first, variations);
+                           });
+    if (it != mVariationCollections.end()) {
+        it->second = collection;
+    } else {
+        if (mVariationCollections.size() >= kMaxVariationCollections) {
+            mVariationCollections.pop_front();
+        }
+        mVariationCollections.emplace_back(variations, collection);
+    }
+    return collection;
 }
 
 std::shared_ptr<FontCollection> FontCollection::createCollectionWithFamilies(
@@ -826,8 +1775,70 @@ std::shared_ptr<FontCollection> FontCollection::createCollectionWithFamilies(
     return FontCollection::create(families);
 }
 
+// static
+std::vector<uint32_t> FontCollection::takeDestroyedIds() {
+    DestroyedIds& destroyed = getDestroyedIds();
+    std::vector<uint32_t> ids;
+    std::lock_guard<std::mutex> lock(destroyed.mutex);
+    ids.swap(destroyed.ids);
+    destroyed.hasIds.store(false, std::memory_order_relaxed);
+    return ids;
+}
+
+// static
+bool FontCollection::hasDestroyedIds() {
+    return getDestroyedIds().hasIds.load(std::memory_order_relaxed);
+}
+
 uint32_t FontCollection::getId() const {
     return mId;
 }
 
+uint64_t FontCollection::getStableId() const {
+    uint64_t id = mStableId.load(std::memory_order_relaxed);
+    if (id != 0) {
+        return id;
+    }
+    StableHasher hasher;
+    auto updateLocaleList = [&hasher](uint32_t localeListId) {
+        // The locale list IDs are local to the process, unlike the locale identifiers.
+        const LocaleList& localeList = LocaleListCache::getById(localeListId);
+        hasher.update(localeList.size());
+        for (size_t i = 0; i < localeList.size(); ++i) {
+            hasher.update(localeList[i].getIdentifier());
+        }
+    };
+    hasher.update(getFamilyCount());
+    Font::ExternalRefsGuard externalRefsGuard;
+    for (size_t i = 0; i < getFamilyCount(); ++i) {
+        const FontFamily& family = *getFamilyAt(i);
+        updateLocaleList(family.localeListId());
+        hasher.update(static_cast<uint64_t>(family.variant()))
+                .update(family.isCustomFallback())
+                .update(family.isDefaultFallback())
+                .update(family.getNumFonts());
+        for (size_t j = 0; j < family.getNumFonts(); ++j) {
+            const Font* font = family.getFont(j);
+            updateLocaleList(font->getLocaleListId());
+            hasher.update(font->style().identifier());
+            // The fonts without a file are only told apart by their size.
+            const MinikinFont* typeface = font->typeface().get();
+            hasher.update(typeface->GetFontPath())
+                    .update(typeface->GetFontSize())
+                    .update(typeface->GetFontIndex());
+            const std::vector<FontVariation>& axes = typeface->GetAxes();
+            hasher.update(axes.size());
+            for (const FontVariation& axis : axes) {
+                uint32_t value;
+                memcpy(&value, &axis.value, sizeof(value));
+                hasher.update(axis.axisTag).update(value);
+            }
+        }
+    }
+    // Zero means not computed. The racing threads compute the same value.
+    id = std::max<uint64_t>(hasher.hash(), 1);
+    mStableId.store(id, std::memory_order_relaxed);
+    return id;
+}
+
 }  // namespace minikin
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/FontExtentCache.h"
+
+#include "minikin/MinikinFont.h"
+
+namespace minikin {
+
+// Returns true if the weak pointer was made from the given font. Unlike comparing the addresses,
+// this is false for a font freed and another font created at the same address.
+static bool isSameFont(const std::weak_ptr<Font>& cached, const std::shared_ptr<Font>& font) {
+    return !cached.owner_before(font) && !font.owner_before(cached);
+}
+
+MinikinExtent FontExtentCache::getExtent(const FakedFont& fakedFont, const MinikinPaint& paint) {
+    const FontExtentKey key(fakedFont, paint);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const Entry& entry = mCache.get(key);
+        if (isSameFont(entry.font, fakedFont.font)) {
+            mStats.recordHit();
+            return entry.extent;
+        }
+    }
+
+    // Don't hold the lock while the font is called.
+    const CacheStats::TimePoint start = CacheStats::now();
+    MinikinExtent extent;
+    {
+        Font::ExternalRefsGuard externalRefsGuard;
+        fakedFont.font->typeface()->GetFontExtent(&extent, paint, fakedFont.fakery);
+    }
+    mStats.recordMiss(start);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    // The entry of a freed font at the same address is replaced. put() keeps the existing entry.
+    mCache.remove(key);
+    const size_t sizeBefore = mCache.size();
+    mCache.put(key, {fakedFont.font, extent});
+    mStats.recordEvictions(sizeBefore + 1 - mCache.size());
+    return extent;
+}
+
+}  // namespace minikin
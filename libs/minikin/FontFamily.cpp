@@ -28,6 +28,7 @@
 #include "Locale.h"
 #include "LocaleListCache.h"
 #include "MinikinInternal.h"
+#include "WorkerPool.h"
 #include "minikin/CmapCoverage.h"
 #include "minikin/FamilyVariant.h"
 #include "minikin/HbUtils.h"
@@ -35,6 +36,8 @@
 
 namespace minikin {
 
+static std::atomic<bool> gLazyCoverageEnabled = {false};
+
 // static
 std::shared_ptr<FontFamily> FontFamily::create(std::vector<std::shared_ptr<Font>>&& fonts) {
     return create(FamilyVariant::DEFAULT, std::move(fonts));
@@ -53,17 +56,39 @@ std::shared_ptr<FontFamily> FontFamily::create(uint32_t localeListId, FamilyVari
                                                bool isCustomFallback, bool isDefaultFallback) {
     // TODO(b/174672300): Revert back to make_shared.
     return std::shared_ptr<FontFamily>(new FontFamily(localeListId, variant, std::move(fonts),
-                                                      isCustomFallback, isDefaultFallback));
+                                                      isCustomFallback, isDefaultFallback,
+                                                      false /* isDeferred */));
+}
+
+// static
+std::vector<std::shared_ptr<FontFamily>> FontFamily::createBatch(
+        std::vector<BatchEntry>&& entries) {
+    std::vector<std::shared_ptr<FontFamily>> families;
+    families.reserve(entries.size());
+    for (BatchEntry& entry : entries) {
+        families.emplace_back(new FontFamily(entry.localeListId, entry.variant,
+                                             std::move(entry.fonts), entry.isCustomFallback,
+                                             entry.isDefaultFallback, true /* isDeferred */));
+    }
+    // The families are not shared yet, so each one is only touched by its own task. The locale
+    // lists are resolved above on this thread.
+    WorkerPool::getInstance().parallelFor(
+            families.size(), [&families](size_t i) { families[i]->initFromFonts(); });
+    return families;
 }
 
 FontFamily::FontFamily(uint32_t localeListId, FamilyVariant variant,
                        std::vector<std::shared_ptr<Font>>&& fonts, bool isCustomFallback,
-                       bool isDefaultFallback)
+                       bool isDefaultFallback, bool isDeferred)
         : mFonts(std::make_unique<std::shared_ptr<Font>[]>(fonts.size())),
-          // computeCoverage may update supported axes and coverages later.
+          // initFromFonts updates supported axes and coverages later.
           mSupportedAxes(nullptr),
+          mOwnedSupportedAxes(nullptr),
           mCoverage(),
-          mCmapFmt14Coverage(nullptr),
+          mVsCoverage(),
+          mLazyCoverage(nullptr),
+          mSerializedCoverage(nullptr),
+          mStyleMatchCache(),
           mLocaleListId(localeListId),
           mFontsCount(static_cast<uint32_t>(fonts.size())),
           mSupportedAxesCount(0),
@@ -72,26 +97,44 @@ FontFamily::FontFamily(uint32_t localeListId, FamilyVariant variant,
           mIsColorEmoji(LocaleListCache::getById(localeListId).getEmojiStyle() ==
                         EmojiStyle::EMOJI),
           mIsCustomFallback(isCustomFallback),
-          mIsDefaultFallback(isDefaultFallback) {
+          mIsDefaultFallback(isDefaultFallback),
+          mIsCoverageLazy(isLazyCoverageEnabled()) {
     MINIKIN_ASSERT(!fonts.empty(), "FontFamily must contain at least one font.");
     MINIKIN_ASSERT(fonts.size() <= std::numeric_limits<uint32_t>::max(),
                    "Number of fonts must be less than 2^32.");
     for (size_t i = 0; i < mFontsCount; i++) {
         mFonts[i] = std::move(fonts[i]);
     }
-    computeCoverage();
+    if (!isDeferred) {
+        initFromFonts();
+    }
+}
+
+void FontFamily::initFromFonts() {
+    computeSupportedAxes();
+    if (!mIsCoverageLazy) {
+        Coverage coverage = computeCoverage();
+        mCoverage = std::move(coverage.coverage);
+        mVsCoverage = std::move(coverage.vsCoverage);
+        mCmapFmt14CoverageCount = mVsCoverage.size();
+    }
 }
 
 FontFamily::FontFamily(BufferReader* reader, const std::shared_ptr<std::vector<Font>>& allFonts)
-        : mSupportedAxes(nullptr), mCmapFmt14Coverage(nullptr) {
+        : mSupportedAxes(nullptr),
+          mOwnedSupportedAxes(nullptr),
+          mLazyCoverage(nullptr),
+          mSerializedCoverage(nullptr),
+          mStyleMatchCache(),
+          mIsCoverageLazy(false) {
     mLocaleListId = LocaleListCache::readFrom(reader);
-    mFontsCount = reader->read<uint32_t>();
+    const auto& [fontIndices, fontsCount] = reader->readArray<uint32_t>();
+    mFontsCount = fontsCount;
     mFonts = std::make_unique<std::shared_ptr<Font>[]>(mFontsCount);
     for (size_t i = 0; i < mFontsCount; i++) {
-        uint32_t fontIndex = reader->read<uint32_t>();
         // Use aliasing constructor to save memory.
         // See the comments on FontFamily::readVector for details.
-        mFonts[i] = std::shared_ptr<Font>(allFonts, &(*allFonts)[fontIndex]);
+        mFonts[i] = std::shared_ptr<Font>(allFonts, &(*allFonts)[fontIndices[i]]);
     }
     // FamilyVariant is uint8_t
     static_assert(sizeof(FamilyVariant) == 1);
@@ -99,58 +142,149 @@ FontFamily::FontFamily(BufferReader* reader, const std::shared_ptr<std::vector<F
     // AxisTag is uint32_t
     static_assert(sizeof(AxisTag) == 4);
     const auto& [axesPtr, axesCount] = reader->readArray<AxisTag>();
+    // The axes are used in place as the buffer outlives the family.
     mSupportedAxesCount = axesCount;
-    if (axesCount > 0) {
-        mSupportedAxes = std::unique_ptr<AxisTag[]>(new AxisTag[axesCount]);
-        std::copy(axesPtr, axesPtr + axesCount, mSupportedAxes.get());
-    }
+    mSupportedAxes = axesCount > 0 ? axesPtr : nullptr;
     mIsColorEmoji = static_cast<bool>(reader->read<uint8_t>());
     mIsCustomFallback = static_cast<bool>(reader->read<uint8_t>());
     mIsDefaultFallback = static_cast<bool>(reader->read<uint8_t>());
-    mCoverage = SparseBitSet(reader);
-    // Read mCmapFmt14Coverage. As it can have null entries, it is stored in the buffer as a sparse
-    // array (size, non-null entry count, array of (index, entry)).
     mCmapFmt14CoverageCount = reader->read<uint32_t>();
-    if (mCmapFmt14CoverageCount > 0) {
-        mCmapFmt14Coverage = std::make_unique<SparseBitSet[]>(mCmapFmt14CoverageCount);
-        uint32_t cmapFmt14CoverageEntryCount = reader->read<uint32_t>();
-        for (uint32_t i = 0; i < cmapFmt14CoverageEntryCount; i++) {
-            uint32_t index = reader->read<uint32_t>();
-            mCmapFmt14Coverage[index] = SparseBitSet(reader);
-        }
+    const uint32_t coverageSize = reader->read<uint32_t>();
+    if (isLazyCoverageEnabled()) {
+        // Only remember where the coverages are. Most of the families are never queried.
+        mIsCoverageLazy = true;
+        mSerializedCoverage = reinterpret_cast<const uint8_t*>(reader->current());
+        reader->map<uint8_t>(coverageSize);
+    } else {
+        Coverage coverage = readCoverage(reader, mCmapFmt14CoverageCount);
+        mCoverage = std::move(coverage.coverage);
+        mVsCoverage = std::move(coverage.vsCoverage);
+    }
+}
+
+FontFamily::FontFamily(const std::shared_ptr<const FontFamily>& coverageSource,
+                       std::vector<std::shared_ptr<Font>>&& fonts)
+        : mFonts(std::make_unique<std::shared_ptr<Font>[]>(fonts.size())),
+          // The axes don't change with the axis values either. mCoverageSource keeps them alive.
+          mSupportedAxes(coverageSource->mSupportedAxes),
+          mOwnedSupportedAxes(nullptr),
+          mCoverage(),
+          mVsCoverage(),
+          mLazyCoverage(nullptr),
+          mSerializedCoverage(nullptr),
+          mCoverageSource(coverageSource),
+          // The styles of the variation instances may differ from the ones of coverageSource.
+          mStyleMatchCache(),
+          mLocaleListId(coverageSource->mLocaleListId),
+          mFontsCount(static_cast<uint32_t>(fonts.size())),
+          mSupportedAxesCount(coverageSource->mSupportedAxesCount),
+          mCmapFmt14CoverageCount(0),
+          mVariant(coverageSource->mVariant),
+          mIsColorEmoji(coverageSource->mIsColorEmoji),
+          mIsCustomFallback(coverageSource->mIsCustomFallback),
+          mIsDefaultFallback(coverageSource->mIsDefaultFallback),
+          mIsCoverageLazy(false) {
+    MINIKIN_ASSERT(fonts.size() == coverageSource->mFontsCount,
+                   "The variation instances must replace all the fonts.");
+    for (size_t i = 0; i < mFontsCount; i++) {
+        mFonts[i] = std::move(fonts[i]);
+    }
+}
+
+FontFamily::FontFamily(FontFamily&& o) noexcept
+        : mFonts(std::move(o.mFonts)),
+          mSupportedAxes(o.mSupportedAxes),
+          mOwnedSupportedAxes(std::move(o.mOwnedSupportedAxes)),
+          mCoverage(std::move(o.mCoverage)),
+          mVsCoverage(std::move(o.mVsCoverage)),
+          mLazyCoverage(o.mLazyCoverage.exchange(nullptr)),
+          mSerializedCoverage(o.mSerializedCoverage),
+          mCoverageSource(std::move(o.mCoverageSource)),
+          mStyleMatchCache(),
+          mLocaleListId(o.mLocaleListId),
+          mFontsCount(o.mFontsCount),
+          mSupportedAxesCount(o.mSupportedAxesCount),
+          mCmapFmt14CoverageCount(o.mCmapFmt14CoverageCount),
+          mVariant(o.mVariant),
+          mIsColorEmoji(o.mIsColorEmoji),
+          mIsCustomFallback(o.mIsCustomFallback),
+          mIsDefaultFallback(o.mIsDefaultFallback),
+          mIsCoverageLazy(o.mIsCoverageLazy) {
+    for (size_t i = 0; i < kStyleMatchCacheSize; ++i) {
+        mStyleMatchCache[i].store(o.mStyleMatchCache[i].load(std::memory_order_relaxed),
+                                  std::memory_order_relaxed);
+    }
+}
+
+FontFamily& FontFamily::operator=(FontFamily&& o) noexcept {
+    mFonts = std::move(o.mFonts);
+    mSupportedAxes = o.mSupportedAxes;
+    mOwnedSupportedAxes = std::move(o.mOwnedSupportedAxes);
+    mCoverage = std::move(o.mCoverage);
+    mVsCoverage = std::move(o.mVsCoverage);
+    delete mLazyCoverage.exchange(o.mLazyCoverage.exchange(nullptr));
+    mSerializedCoverage = o.mSerializedCoverage;
+    mCoverageSource = std::move(o.mCoverageSource);
+    for (size_t i = 0; i < kStyleMatchCacheSize; ++i) {
+        mStyleMatchCache[i].store(o.mStyleMatchCache[i].load(std::memory_order_relaxed),
+                                  std::memory_order_relaxed);
     }
+    mLocaleListId = o.mLocaleListId;
+    mFontsCount = o.mFontsCount;
+    mSupportedAxesCount = o.mSupportedAxesCount;
+    mCmapFmt14CoverageCount = o.mCmapFmt14CoverageCount;
+    mVariant = o.mVariant;
+    mIsColorEmoji = o.mIsColorEmoji;
+    mIsCustomFallback = o.mIsCustomFallback;
+    mIsDefaultFallback = o.mIsDefaultFallback;
+    mIsCoverageLazy = o.mIsCoverageLazy;
+    return *this;
+}
+
+FontFamily::~FontFamily() {
+    delete mLazyCoverage.load();
 }
 
 void FontFamily::writeTo(BufferWriter* writer, uint32_t* fontIndex) const {
     LocaleListCache::writeTo(writer, mLocaleListId);
-    writer->write<uint32_t>(mFontsCount);
+    uint32_t* fontIndices = writer->reserveArray<uint32_t>(mFontsCount);
     for (size_t i = 0; i < mFontsCount; i++) {
-        writer->write<uint32_t>(*fontIndex);
+        if (fontIndices != nullptr) {
+            fontIndices[i] = *fontIndex;
+        }
         (*fontIndex)++;
     }
     writer->write<FamilyVariant>(mVariant);
-    writer->writeArray<AxisTag>(mSupportedAxes.get(), mSupportedAxesCount);
+    writer->writeArray<AxisTag>(mSupportedAxes, mSupportedAxesCount);
     writer->write<uint8_t>(mIsColorEmoji);
     writer->write<uint8_t>(mIsCustomFallback);
     writer->write<uint8_t>(mIsDefaultFallback);
-    mCoverage.writeTo(writer);
-    // Write mCmapFmt14Coverage as a sparse array (size, non-null entry count,
-    // array of (index, entry))
-    writer->write<uint32_t>(mCmapFmt14CoverageCount);
-    // Skip writing the sparse entries if the size is zero
-    if (mCmapFmt14CoverageCount > 0) {
-        uint32_t cmapFmt14CoverageEntryCount = 0;
-        for (size_t i = 0; i < mCmapFmt14CoverageCount; i++) {
-            if (!mCmapFmt14Coverage[i].empty()) cmapFmt14CoverageEntryCount++;
-        }
-        writer->write<uint32_t>(cmapFmt14CoverageEntryCount);
-        for (size_t i = 0; i < mCmapFmt14CoverageCount; i++) {
-            if (!mCmapFmt14Coverage[i].empty()) {
-                writer->write<uint32_t>(i);
-                mCmapFmt14Coverage[i].writeTo(writer);
-            }
-        }
+    // The lazy or shared coverage is written in the same way, the reader always has its own
+    // coverage, read at construction or on the first query.
+    const VariationSequenceCoverage& vsCoverage = getVsCoverage();
+    writer->write<uint32_t>(vsCoverage.size());
+    // The size of the coverages lets a lazy reader skip them.
+    uint32_t* coverageSize = writer->reserve<uint32_t>(sizeof(uint32_t));
+    const size_t coverageStart = writer->size();
+    getCoverage().writeTo(writer);
+    // Skip writing the variation sequences if the font has none.
+    if (!vsCoverage.empty()) {
+        vsCoverage.writeTo(writer);
+    }
+    if (coverageSize != nullptr) {
+        *coverageSize = writer->size() - coverageStart;
+    }
+}
+
+// static
+FontFamily::Coverage FontFamily::readCoverage(BufferReader* reader,
+                                              uint16_t cmapFmt14CoverageCount) {
+    Coverage result;
+    result.coverage = SparseBitSet(reader);
+    if (cmapFmt14CoverageCount > 0) {
+        result.vsCoverage = VariationSequenceCoverage(reader);
     }
+    return result;
 }
 
 // static
@@ -222,92 +356,160 @@ static FontFakery computeFakery(FontStyle wanted, FontStyle actual) {
     return FontFakery(isFakeBold, isFakeItalic);
 }
 
-FakedFont FontFamily::getClosestMatch(FontStyle style) const {
-    int bestIndex = 0;
-    Font* bestFont = mFonts[bestIndex].get();
-    int bestMatch = computeMatch(bestFont->style(), style);
-    for (size_t i = 1; i < mFontsCount; i++) {
-        Font* font = mFonts[i].get();
-        int match = computeMatch(font->style(), style);
-        if (i == 0 || match < bestMatch) {
-            bestFont = font;
+// A memoized match is the style in the upper 17 bits and the font index plus one in the lower 15
+// bits, 0 for an empty slot. Families of more fonts are not memoized.
+constexpr uint32_t kStyleMatchIndexMask = (1u << 15) - 1;
+
+static uint32_t packStyle(FontStyle style) {
+    return (static_cast<uint32_t>(style.weight()) << 16) |
+           (static_cast<uint32_t>(style.slant()) << 15);
+}
+
+uint32_t FontFamily::getClosestMatchIndex(FontStyle style) const {
+    const bool isMemoized = mFontsCount > 1 && mFontsCount < kStyleMatchIndexMask;
+    std::atomic<uint32_t>* slot = nullptr;
+    if (isMemoized) {
+        const uint32_t slotIndex = style.weight() / 100 * 2 + static_cast<uint32_t>(style.slant());
+        slot = &mStyleMatchCache[slotIndex % kStyleMatchCacheSize];
+        const uint32_t entry = slot->load(std::memory_order_relaxed);
+        if ((entry & kStyleMatchIndexMask) != 0 &&
+            (entry & ~kStyleMatchIndexMask) == packStyle(style)) {
+            return (entry & kStyleMatchIndexMask) - 1;
+        }
+    }
+    uint32_t bestIndex = 0;
+    int bestMatch = computeMatch(mFonts[bestIndex]->style(), style);
+    for (uint32_t i = 1; i < mFontsCount; i++) {
+        int match = computeMatch(mFonts[i]->style(), style);
+        if (match < bestMatch) {
             bestIndex = i;
             bestMatch = match;
         }
     }
-    return FakedFont{mFonts[bestIndex], computeFakery(style, bestFont->style())};
+    if (isMemoized) {
+        // The entry is a single word, so the racing writers can only replace each other's results.
+        slot->store(packStyle(style) | (bestIndex + 1), std::memory_order_relaxed);
+    }
+    return bestIndex;
+}
+
+FakedFont FontFamily::getClosestMatch(FontStyle style) const {
+    const uint32_t bestIndex = getClosestMatchIndex(style);
+    return FakedFont{mFonts[bestIndex], computeFakery(style, mFonts[bestIndex]->style())};
 }
 
-void FontFamily::computeCoverage() {
+FontFamily::Coverage FontFamily::computeCoverage() const {
+    Coverage result;
     const std::shared_ptr<Font>& font = getClosestMatch(FontStyle()).font;
+    Font::ExternalRefsGuard externalRefsGuard;
     HbBlob cmapTable(font->baseFont(), MinikinFont::MakeTag('c', 'm', 'a', 'p'));
     if (cmapTable.get() == nullptr) {
         ALOGE("Could not get cmap table size!\n");
-        return;
+        return result;
     }
 
     std::vector<SparseBitSet> cmapFmt14Coverage;
-    mCoverage = CmapCoverage::getCoverage(cmapTable.get(), cmapTable.size(), &cmapFmt14Coverage);
+    result.coverage =
+            CmapCoverage::getCoverage(cmapTable.get(), cmapTable.size(), &cmapFmt14Coverage);
     static_assert(INVALID_VS_INDEX <= std::numeric_limits<uint16_t>::max());
     // cmapFmt14Coverage maps VS index to coverage.
     // cmapFmt14Coverage's size cannot exceed INVALID_VS_INDEX.
     MINIKIN_ASSERT(cmapFmt14Coverage.size() <= INVALID_VS_INDEX,
                    "cmapFmt14Coverage's size must not exceed INVALID_VS_INDEX.");
-    mCmapFmt14CoverageCount = static_cast<uint16_t>(cmapFmt14Coverage.size());
-    if (mCmapFmt14CoverageCount > 0) {
-        mCmapFmt14Coverage = std::make_unique<SparseBitSet[]>(mCmapFmt14CoverageCount);
-        for (size_t i = 0; i < mCmapFmt14CoverageCount; i++) {
-            mCmapFmt14Coverage[i] = std::move(cmapFmt14Coverage[i]);
-        }
-    }
+    result.vsCoverage = VariationSequenceCoverage(std::move(cmapFmt14Coverage));
+    return result;
+}
 
+void FontFamily::computeSupportedAxes() {
     std::unordered_set<AxisTag> supportedAxesSet;
     for (size_t i = 0; i < mFontsCount; ++i) {
-        std::unordered_set<AxisTag> supportedAxes = mFonts[i]->getSupportedAxes();
+        const ArrayView<AxisTag> supportedAxes = mFonts[i]->getSupportedAxes();
         supportedAxesSet.insert(supportedAxes.begin(), supportedAxes.end());
     }
     MINIKIN_ASSERT(supportedAxesSet.size() <= std::numeric_limits<uint32_t>::max(),
                    "Number of supported axes must be less than 2^16.");
     mSupportedAxesCount = static_cast<uint16_t>(supportedAxesSet.size());
     if (mSupportedAxesCount > 0) {
-        mSupportedAxes = sortedArrayFromSet(supportedAxesSet);
+        mOwnedSupportedAxes = sortedArrayFromSet(supportedAxesSet);
+        mSupportedAxes = mOwnedSupportedAxes.get();
     }
 }
 
-bool FontFamily::hasGlyph(uint32_t codepoint, uint32_t variationSelector) const {
-    if (variationSelector == 0) {
-        return mCoverage.get(codepoint);
+const FontFamily::Coverage& FontFamily::getLazyCoverage() const {
+    Coverage* coverage = mLazyCoverage.load(std::memory_order_acquire);
+    if (coverage == nullptr) {
+        // Same as Font::getExternalRefs(), the first one set wins if multiple threads get here.
+        std::unique_ptr<Coverage> newCoverage;
+        if (mSerializedCoverage != nullptr) {
+            // The bit sets are mapped from the buffer, so nothing is parsed or copied.
+            BufferReader reader(mSerializedCoverage);
+            newCoverage =
+                    std::make_unique<Coverage>(readCoverage(&reader, mCmapFmt14CoverageCount));
+        } else {
+            newCoverage = std::make_unique<Coverage>(computeCoverage());
+        }
+        Coverage* expected = nullptr;
+        if (mLazyCoverage.compare_exchange_strong(expected, newCoverage.get(),
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire)) {
+            coverage = newCoverage.release();
+        } else {
+            coverage = expected;
+        }
     }
+    return *coverage;
+}
 
-    if (mCmapFmt14CoverageCount == 0) {
-        return false;
+// static
+bool FontFamily::isLazyCoverageEnabled() {
+    return gLazyCoverageEnabled.load(std::memory_order_relaxed);
+}
+
+// static
+void FontFamily::setLazyCoverageEnabled(bool enabled) {
+    gLazyCoverageEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+const VariationSequenceCoverage& FontFamily::getVsCoverage() const {
+    if (mCoverageSource != nullptr) {
+        return mCoverageSource->getVsCoverage();
     }
+    return mIsCoverageLazy ? getLazyCoverage().vsCoverage : mVsCoverage;
+}
 
-    const uint16_t vsIndex = getVsIndex(variationSelector);
+bool FontFamily::hasVSTable() const {
+    if (mCoverageSource != nullptr) {
+        return mCoverageSource->hasVSTable();
+    }
+    if (mSerializedCoverage != nullptr) {
+        // The count is read eagerly so that the collections don't read the coverages for this.
+        return mCmapFmt14CoverageCount != 0;
+    }
+    return !getVsCoverage().empty();
+}
 
-    if (vsIndex >= mCmapFmt14CoverageCount) {
-        // Even if vsIndex is INVALID_VS_INDEX, we reach here since INVALID_VS_INDEX is defined to
-        // be at the maximum end of the range.
-        return false;
+bool FontFamily::hasGlyph(uint32_t codepoint, uint32_t variationSelector) const {
+    if (variationSelector == 0) {
+        return getCoverage().get(codepoint);
     }
 
-    const SparseBitSet& bitset = mCmapFmt14Coverage[vsIndex];
-    if (bitset.empty()) {
+    const VariationSequenceCoverage& vsCoverage = getVsCoverage();
+    if (vsCoverage.empty()) {
         return false;
     }
-
-    return bitset.get(codepoint);
+    // INVALID_VS_INDEX is at the maximum end of the range, so get() returns false for it.
+    return vsCoverage.get(codepoint, getVsIndex(variationSelector));
 }
 
-std::shared_ptr<FontFamily> FontFamily::createFamilyWithVariation(
-        const std::vector<FontVariation>& variations) const {
+bool FontFamily::createFontsWithVariation(const std::vector<FontVariation>& variations,
+                                          std::vector<std::shared_ptr<Font>>* outFonts) const {
     if (variations.empty() || mSupportedAxesCount == 0) {
-        return nullptr;
+        return false;
     }
 
     bool hasSupportedAxis = false;
     for (const FontVariation& variation : variations) {
-        if (std::binary_search(mSupportedAxes.get(), mSupportedAxes.get() + mSupportedAxesCount,
+        if (std::binary_search(mSupportedAxes, mSupportedAxes + mSupportedAxesCount,
                                variation.axisTag)) {
             hasSupportedAxis = true;
             break;
@@ -315,34 +517,47 @@ std::shared_ptr<FontFamily> FontFamily::createFamilyWithVariation(
     }
     if (!hasSupportedAxis) {
         // None of variation axes are suppored by this family.
-        return nullptr;
+        return false;
     }
 
-    std::vector<std::shared_ptr<Font>> fonts;
     for (size_t i = 0; i < mFontsCount; i++) {
         const std::shared_ptr<Font>& font = mFonts[i];
         bool supportedVariations = false;
-        std::unordered_set<AxisTag> supportedAxes = font->getSupportedAxes();
-        if (!supportedAxes.empty()) {
-            for (const FontVariation& variation : variations) {
-                if (supportedAxes.find(variation.axisTag) != supportedAxes.end()) {
-                    supportedVariations = true;
-                    break;
-                }
+        for (const FontVariation& variation : variations) {
+            if (font->isAxisSupported(variation.axisTag)) {
+                supportedVariations = true;
+                break;
             }
         }
-        std::shared_ptr<MinikinFont> minikinFont;
+        std::shared_ptr<Font> variationFont;
         if (supportedVariations) {
-            minikinFont = font->typeface()->createFontWithVariation(variations);
-        }
-        if (minikinFont == nullptr) {
-            fonts.push_back(font);
-        } else {
-            fonts.push_back(Font::Builder(minikinFont).setStyle(font->style()).build());
+            variationFont = font->createFontWithVariation(variations);
         }
+        outFonts->push_back(variationFont != nullptr ? std::move(variationFont) : font);
     }
+    return true;
+}
 
+std::shared_ptr<FontFamily> FontFamily::createFamilyWithVariation(
+        const std::vector<FontVariation>& variations) const {
+    std::vector<std::shared_ptr<Font>> fonts;
+    if (!createFontsWithVariation(variations, &fonts)) {
+        return nullptr;
+    }
     return create(mLocaleListId, mVariant, std::move(fonts), mIsCustomFallback, mIsDefaultFallback);
 }
 
+// static
+std::shared_ptr<FontFamily> FontFamily::createFamilyWithVariation(
+        const std::shared_ptr<FontFamily>& family, const std::vector<FontVariation>& variations) {
+    std::vector<std::shared_ptr<Font>> fonts;
+    if (!family->createFontsWithVariation(variations, &fonts)) {
+        return nullptr;
+    }
+    const std::shared_ptr<const FontFamily>& coverageSource =
+            family->mCoverageSource != nullptr ? family->mCoverageSource : family;
+    // TODO(b/174672300): Revert back to make_shared.
+    return std::shared_ptr<FontFamily>(new FontFamily(coverageSource, std::move(fonts)));
+}
+
 }  // namespace minikin
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Minikin"
+
+#include "minikin/FontFeatureSettingsCache.h"
+
+#include "minikin/MinikinPaint.h"
+
+#include "FontFeatureUtils.h"
+#include "MinikinInternal.h"
+
+namespace minikin {
+
+void FontFeatureSettings::intern() {
+    mId = FontFeatureSettingsCache::getId(mSettings);
+}
+
+FontFeatureSettingsCache::FontFeatureSettingsCache() {
+    // Reserve the ID 0 for the empty settings.
+    mSettings.emplace_back();
+    mSettingsLookupTable[""] = kEmptyId;
+}
+
+uint32_t FontFeatureSettingsCache::getIdInternal(const std::string& settings) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return getIdLocked(settings);
+}
+
+uint32_t FontFeatureSettingsCache::getIdLocked(const std::string& settings) {
+    const auto& it = mSettingsLookupTable.find(settings);
+    if (it != mSettingsLookupTable.end()) {
+        return it->second;
+    }
+    const uint32_t id = mSettings.size();
+    mSettings.push_back({settings, {}});
+    mSettingsLookupTable.insert(std::make_pair(settings, id));
+    return id;
+}
+
+const std::string& FontFeatureSettingsCache::getByIdInternal(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    MINIKIN_ASSERT(id < mSettings.size(), "Lookup by unknown font feature settings ID.");
+    return mSettings[id].settings;
+}
+
+const std::vector<hb_feature_t>& FontFeatureSettingsCache::getFeaturesInternal(
+        const std::string& settings, bool noLigatures) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::unique_ptr<const std::vector<hb_feature_t>>& features =
+            mSettings[getIdLocked(settings)].features[noLigatures ? 1 : 0];
+    if (!features) {
+        features = std::make_unique<const std::vector<hb_feature_t>>(
+                cleanAndAddDefaultFontFeatures(settings, noLigatures));
+    }
+    return *features;
+}
+
+}  // namespace minikin
@@ -16,18 +16,46 @@
 
 #include "FontFeatureUtils.h"
 
+#include "minikin/FontFeatureSettingsCache.h"
+
 #include "StringPiece.h"
 
 namespace minikin {
 
+namespace {
+
+// Disable default-on non-required ligature features if letter-spacing
+// See http://dev.w3.org/csswg/css-text-3/#letter-spacing-property
+// "When the effective spacing between two characters is not zero (due to
+// either justification or a non-zero value of letter-spacing), user agents
+// should not apply optional ligatures."
+inline bool disablesLigatures(const MinikinPaint& paint) {
+    return fabs(paint.letterSpacing) > 0.03;
+}
+
+}  // namespace
+
 std::vector<hb_feature_t> cleanAndAddDefaultFontFeatures(const MinikinPaint& paint) {
+    return cleanAndAddDefaultFontFeatures(paint.fontFeatureSettings, disablesLigatures(paint));
+}
+
+const std::vector<hb_feature_t>& getFontFeatures(const MinikinPaint& paint) {
+    const bool noLigatures = disablesLigatures(paint);
+    if (paint.fontFeatureSettings.empty()) {
+        // The common case, without taking the lock of the settings cache.
+        static const std::vector<hb_feature_t> defaultFeatures =
+                cleanAndAddDefaultFontFeatures("", false /* no ligatures */);
+        static const std::vector<hb_feature_t> noLigatureFeatures =
+                cleanAndAddDefaultFontFeatures("", true /* no ligatures */);
+        return noLigatures ? noLigatureFeatures : defaultFeatures;
+    }
+    return FontFeatureSettingsCache::getFeatures(paint.fontFeatureSettings, noLigatures);
+}
+
+std::vector<hb_feature_t> cleanAndAddDefaultFontFeatures(const std::string& settings,
+                                                         bool noLigatures) {
     std::vector<hb_feature_t> features;
-    // Disable default-on non-required ligature features if letter-spacing
-    // See http://dev.w3.org/csswg/css-text-3/#letter-spacing-property
-    // "When the effective spacing between two characters is not zero (due to
-    // either justification or a non-zero value of letter-spacing), user agents
-    // should not apply optional ligatures."
-    if (fabs(paint.letterSpacing) > 0.03) {
+    if (noLigatures) {
         static constexpr hb_feature_t no_liga = {HB_TAG('l', 'i', 'g', 'a'), 0, 0, ~0u};
         static constexpr hb_feature_t no_clig = {HB_TAG('c', 'l', 'i', 'g'), 0, 0, ~0u};
         features.push_back(no_liga);
@@ -40,10 +68,10 @@ std::vector<hb_feature_t> cleanAndAddDefaultFontFeatures(const MinikinPaint& pai
     static constexpr hb_tag_t halt_tag = HB_TAG('h', 'a', 'l', 't');
     static constexpr hb_tag_t palt_tag = HB_TAG('p', 'a', 'l', 't');
 
-    SplitIterator it(paint.fontFeatureSettings, ',');
+    SplitIterator it(settings, ',');
     while (it.hasNext()) {
         StringPiece featureStr = it.next();
-        static hb_feature_t feature;
+        hb_feature_t feature;
         // We do not allow setting features on ranges. As such, reject any setting that has
         // non-universal range.
         if (hb_feature_from_string(featureStr.data(), featureStr.size(), &feature) &&
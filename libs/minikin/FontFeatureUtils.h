@@ -19,6 +19,9 @@
 
 #include <hb.h>
 
+#include <string>
+#include <vector>
+
 #include "minikin/MinikinPaint.h"
 
 namespace minikin {
@@ -36,5 +39,19 @@ namespace minikin {
  */
 std::vector<hb_feature_t> cleanAndAddDefaultFontFeatures(const MinikinPaint& paint);
 
+/**
+ * Same as cleanAndAddDefaultFontFeatures(), but the features are only parsed once for each font
+ * feature settings string and letter spacing state. The returned vector is shared by all the
+ * threads and is never modified nor freed.
+ */
+const std::vector<hb_feature_t>& getFontFeatures(const MinikinPaint& paint);
+
+/**
+ * Same as cleanAndAddDefaultFontFeatures() for the font feature settings string and whether the
+ * letter spacing disables the optional ligatures.
+ */
+std::vector<hb_feature_t> cleanAndAddDefaultFontFeatures(const std::string& settings,
+                                                         bool noLigatures);
+
 }  // namespace minikin
 #endif  // MINIKIN_LAYOUT_UTILS_H
@@ -18,7 +18,9 @@
 
 #define LOG_TAG "Minikin"
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <optional>
 #include <string>
 #include <vector>
@@ -118,6 +120,162 @@ bool isPostScriptNameAllowedChar(char c) {
     return true;
 }
 
+// The part of a table in the buffer. The range is clamped to the buffer in the same way as HarfBuzz
+// does for hb_face_reference_table, so a table is missing if it is empty or starts out of the
+// buffer.
+struct TableRange {
+    size_t offset = 0;
+    size_t length = 0;
+
+    explicit operator bool() const { return length > 0; }
+};
+
+// The tables of a face used by the metadata.
+struct MetadataTables {
+    TableRange head;
+    TableRange name;
+    TableRange cff;
+    TableRange cff2;
+};
+
+// Returns true if the sfnt version is one that HarfBuzz opens as a single face.
+bool isSingleFaceTag(uint32_t tag) {
+    return tag == 0x00010000 || tag == MinikinFont::MakeTag('O', 'T', 'T', 'O') ||
+           tag == MinikinFont::MakeTag('t', 'r', 'u', 'e') ||
+           tag == MinikinFont::MakeTag('t', 'y', 'p', '1');
+}
+
+// Reads the table directory of the face at the index and calls f(tag, range) for each table. The
+// index is ignored for a single face file like HarfBuzz does. Returns false if the buffer has no
+// such face, which HarfBuzz treats as an empty face.
+template <typename F>
+bool readTableDirectory(const void* buffer, size_t size, uint32_t index, F f) {
+    SafeFontBufferReader reader(buffer, size);
+    uint32_t tag = reader.readU32();
+    if (tag == MinikinFont::MakeTag('t', 't', 'c', 'f')) {
+        reader.readU32();  // version
+        const uint32_t numFonts = reader.readU32();
+        if (reader.error() || index >= numFonts) return false;
+        reader.seek(12 + static_cast<size_t>(index) * 4);
+        const uint32_t faceOffset = reader.readU32();
+        reader.seek(faceOffset);
+        tag = reader.readU32();
+    }
+    if (reader.error() || !isSingleFaceTag(tag)) return false;
+
+    const uint16_t numTables = reader.readU16();
+    reader.readU16();  // searchRange
+    reader.readU16();  // entrySelector
+    reader.readU16();  // rangeShift
+    for (uint16_t i = 0; i < numTables; ++i) {
+        const uint32_t tableTag = reader.readU32();
+        reader.readU32();  // checksum
+        const uint32_t offset = reader.readU32();
+        const uint32_t length = reader.readU32();
+        if (reader.error()) return false;
+        TableRange range;
+        if (offset < size) {
+            range.offset = offset;
+            range.length = std::min<size_t>(length, size - offset);
+        }
+        f(tableTag, range);
+    }
+    return true;
+}
+
+// Reads the tables used by the metadata from the table directory of the face at the index.
+bool readMetadataTables(const void* buffer, size_t size, uint32_t index, MetadataTables* out) {
+    return readTableDirectory(buffer, size, index, [out](uint32_t tag, const TableRange& range) {
+        if (tag == MinikinFont::MakeTag('h', 'e', 'a', 'd')) {
+            out->head = range;
+        } else if (tag == MinikinFont::MakeTag('n', 'a', 'm', 'e')) {
+            out->name = range;
+        } else if (tag == MinikinFont::MakeTag('C', 'F', 'F', ' ')) {
+            out->cff = range;
+        } else if (tag == MinikinFont::MakeTag('C', 'F', 'F', '2')) {
+            out->cff2 = range;
+        }
+    });
+}
+
+// Returns true if the table is read by the itemization, the shaping or the horizontal metrics.
+bool isHotTable(uint32_t tag) {
+    static const uint32_t kHotTables[] = {
+            MinikinFont::MakeTag('c', 'm', 'a', 'p'), MinikinFont::MakeTag('h', 'e', 'a', 'd'),
+            MinikinFont::MakeTag('h', 'h', 'e', 'a'), MinikinFont::MakeTag('h', 'm', 't', 'x'),
+            MinikinFont::MakeTag('m', 'a', 'x', 'p'), MinikinFont::MakeTag('O', 'S', '/', '2'),
+            MinikinFont::MakeTag('G', 'D', 'E', 'F'), MinikinFont::MakeTag('G', 'S', 'U', 'B'),
+            MinikinFont::MakeTag('G', 'P', 'O', 'S'), MinikinFont::MakeTag('k', 'e', 'r', 'n'),
+            MinikinFont::MakeTag('H', 'V', 'A', 'R')};
+    return std::find(std::begin(kHotTables), std::end(kHotTables), tag) != std::end(kHotTables);
+}
+
+// Returns the preference of a name record as the PostScript name, 0 for an unusable record. The
+// PostScript name only consists of ASCII characters, so the records only differ in the encoding.
+int getNameRecordScore(uint16_t platformId, uint16_t encodingId, uint16_t languageId) {
+    constexpr uint16_t kMacintosh = 1;
+    constexpr uint16_t kWindows = 3;
+    constexpr uint16_t kUnicode = 0;
+    const bool isEnglish = (platformId == kWindows && (languageId & 0xFF) == 0x09) ||
+                           (platformId == kMacintosh && languageId == 0) || platformId == kUnicode;
+    int score;
+    if (platformId == kWindows && (encodingId == 0 || encodingId == 1 || encodingId == 10)) {
+        score = 3;
+    } else if (platformId == kUnicode) {
+        score = 2;
+    } else if (platformId == kMacintosh && encodingId == 0) {
+        score = 1;
+    } else {
+        return 0;
+    }
+    return isEnglish ? score + 3 : score;
+}
+
+// Reads the PostScript name from the name table in the same way as hb_ot_name_get_utf8 with a 64
+// byte buffer. The characters out of ASCII are replaced with one not allowed by checkPSName.
+std::optional<std::string> readPostScriptName(const uint8_t* data, size_t size) {
+    SafeFontBufferReader reader(data, size);
+    reader.readU16();  // format
+    const uint16_t count = reader.readU16();
+    const uint16_t stringOffset = reader.readU16();
+    int bestScore = 0;
+    uint16_t bestPlatformId = 0;
+    uint16_t bestLength = 0;
+    uint16_t bestOffset = 0;
+    for (uint16_t i = 0; i < count; ++i) {
+        const uint16_t platformId = reader.readU16();
+        const uint16_t encodingId = reader.readU16();
+        const uint16_t languageId = reader.readU16();
+        const uint16_t nameId = reader.readU16();
+        const uint16_t length = reader.readU16();
+        const uint16_t offset = reader.readU16();
+        if (reader.error()) return std::optional<std::string>();
+        if (nameId != HB_OT_NAME_ID_POSTSCRIPT_NAME) continue;
+        const int score = getNameRecordScore(platformId, encodingId, languageId);
+        if (score > bestScore) {
+            bestScore = score;
+            bestPlatformId = platformId;
+            bestLength = length;
+            bestOffset = offset;
+        }
+    }
+    const size_t start = static_cast<size_t>(stringOffset) + bestOffset;
+    if (bestScore == 0 || bestLength == 0 || start + bestLength > size) {
+        return std::optional<std::string>();
+    }
+
+    const uint8_t* chars = data + start;
+    const bool isUtf16 = bestPlatformId != 1;
+    const size_t charCount = isUtf16 ? bestLength / 2 : bestLength;
+    std::string out;
+    for (size_t i = 0; i < charCount && out.size() < 63; ++i) {
+        const uint32_t c = isUtf16 ? (static_cast<uint32_t>(chars[i * 2]) << 8 | chars[i * 2 + 1])
+                                   : chars[i];
+        out.push_back(c < 0x80 ? static_cast<char>(c) : '%');
+    }
+    return out;
+}
+
 }  // namespace
 
 // static
@@ -216,4 +374,46 @@ std::optional<bool> FontFileParser::isPostScriptType1Font() const {
     return cffTable || cff2Table;
 }
 
+// static
+FontFileParser::Metadata FontFileParser::readMetadata(const void* buffer, size_t size,
+                                                      uint32_t index) {
+    Metadata metadata;
+    MetadataTables tables;
+    if (!readMetadataTables(buffer, size, index, &tables)) {
+        // HarfBuzz gives an empty face, which has no tables.
+        metadata.isPostScriptType1Font = false;
+        return metadata;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer);
+
+    uint32_t revision = 0;
+    if (tables.head &&
+        analyzeFontRevision(data + tables.head.offset, tables.head.length, &revision)) {
+        metadata.fontRevision = revision;
+    }
+    if (tables.name) {
+        std::optional<std::string> psName =
+                readPostScriptName(data + tables.name.offset, tables.name.length);
+        if (psName && checkPSName(*psName)) {
+            metadata.postScriptName = std::move(psName);
+        }
+    }
+    metadata.isPostScriptType1Font = tables.cff || tables.cff2;
+    return metadata;
+}
+
+// static
+std::vector<Range> FontFileParser::getHotTableRanges(const void* buffer, size_t size,
+                                                     uint32_t index) {
+    std::vector<Range> ranges;
+    readTableDirectory(buffer, size, index, [&ranges](uint32_t tag, const TableRange& range) {
+        if (range && isHotTable(tag)) {
+            ranges.emplace_back(range.offset, range.offset + range.length);
+        }
+    });
+    std::sort(ranges.begin(), ranges.end(),
+              [](const Range& l, const Range& r) { return l.getStart() < r.getStart(); });
+    return ranges;
+}
+
 }  // namespace minikin
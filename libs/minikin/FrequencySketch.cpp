@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/FrequencySketch.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace minikin {
+
+namespace {
+
+// The number of counters of a row, a power of two of at least twice the capacity.
+uint32_t getWidth(uint32_t capacity) {
+    uint32_t width = 256;
+    while (width < 2 * static_cast<uint64_t>(capacity) && width < (1u << 24)) {
+        width <<= 1;
+    }
+    return width;
+}
+
+// The finalizer of MurmurHash3, so that the rows index independently even for the hashes which
+// only differ in a few bits, e.g. the ones of the same LayoutCache shard.
+uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(uint32_t capacity)
+        : mCounters(kDepth * getWidth(capacity), 0),
+          mMask(getWidth(capacity) - 1),
+          mSampleSize(std::max(kMinSampleSize, capacity)),
+          mIncrements(0) {}
+
+uint32_t FrequencySketch::getIndex(uint32_t hash, uint32_t row) const {
+    static constexpr uint32_t kSeeds[kDepth] = {0x97CB3127, 0xB1A1C2E3, 0x4A7C15F9, 0x2545F491};
+    return row * (mMask + 1) + (mix(hash ^ kSeeds[row]) & mMask);
+}
+
+uint32_t FrequencySketch::increment(uint32_t hash) {
+    uint32_t count = std::numeric_limits<uint32_t>::max();
+    for (uint32_t row = 0; row < kDepth; ++row) {
+        uint8_t& counter = mCounters[getIndex(hash, row)];
+        if (counter < kMaxCount) {
+            counter++;
+        }
+        count = std::min<uint32_t>(count, counter);
+    }
+    if (++mIncrements >= mSampleSize) {
+        halve();
+    }
+    return count;
+}
+
+uint32_t FrequencySketch::frequency(uint32_t hash) const {
+    uint32_t count = kMaxCount;
+    for (uint32_t row = 0; row < kDepth; ++row) {
+        count = std::min<uint32_t>(count, mCounters[getIndex(hash, row)]);
+    }
+    return count;
+}
+
+void FrequencySketch::clear() {
+    std::fill(mCounters.begin(), mCounters.end(), 0);
+    mIncrements = 0;
+}
+
+void FrequencySketch::halve() {
+    for (uint8_t& counter : mCounters) {
+        counter >>= 1;
+    }
+    mIncrements = 0;
+}
+
+}  // namespace minikin
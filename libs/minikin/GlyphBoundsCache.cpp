@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/GlyphBoundsCache.h"
+
+#include <vector>
+
+#include "minikin/MinikinFont.h"
+
+namespace minikin {
+
+// Returns true if the weak pointer was made from the given font. Unlike comparing the addresses,
+// this is false for a font freed and another font created at the same address.
+static bool isSameFont(const std::weak_ptr<Font>& cached, const std::shared_ptr<Font>& font) {
+    return !cached.owner_before(font) && !font.owner_before(cached);
+}
+
+MinikinRect GlyphBoundsCache::calculateBounds(const LayoutPiece& layoutPiece,
+                                              const MinikinPaint& paint) {
+    const uint32_t count = layoutPiece.glyphCount();
+    std::vector<MinikinRect> glyphBounds(count);
+    std::vector<uint32_t> misses;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (uint32_t i = 0; i < count; ++i) {
+            const FakedFont& font = layoutPiece.fontAt(i);
+            const Entry& entry = mCache.get(GlyphBoundsKey(font, layoutPiece.glyphIdAt(i), paint));
+            if (isSameFont(entry.font, font.font)) {
+                mStats.recordHit();
+                glyphBounds[i] = entry.bounds;
+            } else {
+                misses.push_back(i);
+            }
+        }
+    }
+    if (!misses.empty()) {
+        // Don't hold the lock while the fonts are called.
+        const CacheStats::TimePoint start = CacheStats::now();
+        Font::ExternalRefsGuard externalRefsGuard;
+        for (uint32_t i : misses) {
+            const FakedFont& font = layoutPiece.fontAt(i);
+            font.font->typeface()->GetBounds(&glyphBounds[i], layoutPiece.glyphIdAt(i), paint,
+                                             font.fakery);
+        }
+        mStats.recordMiss(start);
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (uint32_t i : misses) {
+            const FakedFont& font = layoutPiece.fontAt(i);
+            const GlyphBoundsKey key(font, layoutPiece.glyphIdAt(i), paint);
+            // The entry of a freed font at the same address is replaced. put() keeps the existing
+            // entry.
+            mCache.remove(key);
+            const size_t sizeBefore = mCache.size();
+            mCache.put(key, {font.font, glyphBounds[i]});
+            mStats.recordEvictions(sizeBefore + 1 - mCache.size());
+        }
+    }
+
+    MinikinRect pieceBounds;
+    for (uint32_t i = 0; i < count; ++i) {
+        const Point point = layoutPiece.pointAt(i);
+        glyphBounds[i].offset(point.x, point.y);
+        pieceBounds.join(glyphBounds[i]);
+    }
+    return pieceBounds;
+}
+
+}  // namespace minikin
@@ -17,7 +17,9 @@
 #include "minikin/GraphemeBreak.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <memory>
 
 #include <android-base/macros.h>
 #include <unicode/uchar.h>
@@ -59,29 +61,92 @@ bool isPureKiller(uint32_t c) {
             c == 0x1172B);
 }
 
-bool GraphemeBreak::isGraphemeBreak(const float* advances, const uint16_t* buf, size_t start,
-                                    size_t count, const size_t offset) {
-    // This implementation closely follows Unicode Standard Annex #29 on
-    // Unicode Text Segmentation (http://www.unicode.org/reports/tr29/),
-    // implementing a tailored version of extended grapheme clusters.
-    // The GB rules refer to section 3.1.1, Grapheme Cluster Boundary Rules.
+namespace {
 
-    // Rule GB1, sot ÷; Rule GB2, ÷ eot
-    if (offset <= start || offset >= start + count) {
-        return true;
+// The properties of a code point looked up by isGraphemeBreak(), packed in a byte.
+constexpr uint8_t kGcbMask = 0x1F;  // tailoredGraphemeClusterBreak()
+constexpr uint8_t kExtendedPictographic = 1 << 5;
+constexpr uint8_t kBreakingVirama = 1 << 6;  // A virama which is not a pure killer.
+constexpr uint8_t kOtherLetter = 1 << 7;
+static_assert(U_GCB_ZWJ <= kGcbMask, "The grapheme cluster break values must fit in kGcbMask.");
+
+uint8_t computeProperties(uint32_t c) {
+    uint8_t properties = static_cast<uint8_t>(tailoredGraphemeClusterBreak(c));
+    if (u_hasBinaryProperty(c, UCHAR_EXTENDED_PICTOGRAPHIC)) {
+        properties |= kExtendedPictographic;
     }
-    if (U16_IS_TRAIL(buf[offset])) {
-        // Don't break a surrogate pair, but a lonely trailing surrogate pair is a break
-        return !U16_IS_LEAD(buf[offset - 1]);
+    if (u_getIntPropertyValue(c, UCHAR_CANONICAL_COMBINING_CLASS) == 9 && !isPureKiller(c)) {
+        properties |= kBreakingVirama;
     }
-    uint32_t c1 = 0;
-    uint32_t c2 = 0;
-    size_t offset_back = offset;
-    size_t offset_forward = offset;
-    U16_PREV(buf, start, offset_back, c1);
-    U16_NEXT(buf, offset_forward, start + count, c2);
-    int32_t p1 = tailoredGraphemeClusterBreak(c1);
-    int32_t p2 = tailoredGraphemeClusterBreak(c2);
+    if (u_getIntPropertyValue(c, UCHAR_GENERAL_CATEGORY) == U_OTHER_LETTER) {
+        properties |= kOtherLetter;
+    }
+    return properties;
+}
+
+// A two-stage table of the properties of the first two planes, where almost all the text is.
+// Each block of 256 code points is computed on its first lookup, so only the blocks of the
+// scripts in use are ever built. The other code points are looked up in ICU every time.
+class GraphemePropertyTable {
+public:
+    static GraphemePropertyTable& getInstance() {
+        static GraphemePropertyTable table;
+        return table;
+    }
+
+    uint8_t get(uint32_t c) {
+        if (c >= kTableEnd) {
+            return computeProperties(c);
+        }
+        const uint8_t* block = mBlocks[c >> kLogBlockSize].load(std::memory_order_acquire);
+        if (block == nullptr) {
+            block = buildBlock(c >> kLogBlockSize);
+        }
+        return block[c & kBlockMask];
+    }
+
+    ~GraphemePropertyTable() {
+        for (std::atomic<const uint8_t*>& block : mBlocks) {
+            delete[] block.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static constexpr uint32_t kTableEnd = 0x20000;
+    static constexpr uint32_t kLogBlockSize = 8;
+    static constexpr uint32_t kBlockMask = (1 << kLogBlockSize) - 1;
+
+    GraphemePropertyTable() {}
+
+    const uint8_t* buildBlock(uint32_t index) {
+        std::unique_ptr<uint8_t[]> block = std::make_unique<uint8_t[]>(kBlockMask + 1);
+        for (uint32_t i = 0; i <= kBlockMask; ++i) {
+            block[i] = computeProperties((index << kLogBlockSize) | i);
+        }
+        // The first one set wins if multiple threads get here, as the blocks are all the same.
+        const uint8_t* expected = nullptr;
+        if (mBlocks[index].compare_exchange_strong(expected, block.get(),
+                                                   std::memory_order_acq_rel,
+                                                   std::memory_order_acquire)) {
+            return block.release();
+        }
+        return expected;
+    }
+
+    std::atomic<const uint8_t*> mBlocks[kTableEnd >> kLogBlockSize] = {};
+};
+
+// Applies the rules from GB3 on to the boundary between two code points of the properties props1
+// and props2. The rules GB11 and GB12/GB13 need to look further back, which is left to
+// followsPictographic(), telling whether the nearest code point before the first one that is
+// not Extend is Extended_Pictographic, and to isEvenRegionalIndicatorRun(), telling whether the
+// regional indicators before the boundary pair up, which are only called when needed.
+template <typename FollowsPictographic, typename IsEvenRegionalIndicatorRun>
+bool isBreakBetween(uint8_t props1, uint8_t props2, bool hasAdvances, bool c2HasAdvance,
+                    FollowsPictographic followsPictographic,
+                    IsEvenRegionalIndicatorRun isEvenRegionalIndicatorRun) {
+    int32_t p1 = props1 & kGcbMask;
+    int32_t p2 = props2 & kGcbMask;
     // Rule GB3, CR x LF
     if (p1 == U_GCB_CR && p2 == U_GCB_LF) {
         return false;
@@ -107,14 +172,10 @@ bool GraphemeBreak::isGraphemeBreak(const float* advances, const uint16_t* buf,
         return false;
     }
 
-    // This is used to decide font-dependent grapheme clusters. If we don't have the advance
-    // information, we become conservative in grapheme breaking and assume that it has no advance.
-    const bool c2_has_advance = (advances != nullptr && advances[offset - start] != 0.0);
-
     // All the following rules are font-dependent, in the way that if we know c2 has an advance,
     // we definitely know that it cannot form a grapheme with the character(s) before it. So we
     // make the decision in favor a grapheme break early.
-    if (c2_has_advance) {
+    if (c2HasAdvance) {
         return true;
     }
 
@@ -125,23 +186,8 @@ bool GraphemeBreak::isGraphemeBreak(const float* advances, const uint16_t* buf,
 
     // Tailored version of Rule GB11
     // \p{Extended_Pictographic} Extend* ZWJ x \p{Extended_Pictographic}
-    if (offset_back > start && p1 == U_GCB_ZWJ &&
-        u_hasBinaryProperty(c2, UCHAR_EXTENDED_PICTOGRAPHIC)) {
-        uint32_t c0 = 0;
-        size_t offset_backback = offset_back;
-        int32_t p0 = 0;
-
-        U16_PREV(buf, start, offset_backback, c0);
-        p0 = tailoredGraphemeClusterBreak(c0);
-
-        while (p0 == U_GCB_EXTEND && offset_backback > start) {
-            U16_PREV(buf, start, offset_backback, c0);
-            p0 = tailoredGraphemeClusterBreak(c0);
-        }
-
-        if (u_hasBinaryProperty(c0, UCHAR_EXTENDED_PICTOGRAPHIC)) {
-            return false;
-        }
+    if (p1 == U_GCB_ZWJ && (props2 & kExtendedPictographic) != 0 && followsPictographic()) {
+        return false;
     }
 
     // Tailored version of Rule GB12 and Rule GB13 that look at even-odd cases.
@@ -152,39 +198,166 @@ bool GraphemeBreak::isGraphemeBreak(const float* advances, const uint16_t* buf,
     // character had no advance, which means a ligature was formed. If we don't, we look back like
     // UAX #29 recommends, but only up to 1000 code units.
     if (p1 == U_GCB_REGIONAL_INDICATOR && p2 == U_GCB_REGIONAL_INDICATOR) {
-        if (advances != nullptr) {
+        if (hasAdvances) {
             // We have advances information. But if we are here, we already know c2 has no advance.
             // So we should definitely disallow a break.
             return false;
         } else {
-            // Look at up to 1000 code units.
-            const size_t lookback_barrier = std::max((ssize_t)start, (ssize_t)offset_back - 1000);
-            size_t offset_backback = offset_back;
-            while (offset_backback > lookback_barrier) {
-                uint32_t c0 = 0;
-                U16_PREV(buf, lookback_barrier, offset_backback, c0);
-                if (tailoredGraphemeClusterBreak(c0) != U_GCB_REGIONAL_INDICATOR) {
-                    offset_backback += U16_LENGTH(c0);
-                    break;
-                }
-            }
-            // The number 4 comes from the number of code units in a whole flag.
-            return (offset - offset_backback) % 4 == 0;
+            return isEvenRegionalIndicatorRun();
         }
     }
     // Cluster Indic syllables together (tailoring of UAX #29).
     // Immediately after each virama (that is not just a pure killer) followed by a letter, we
     // disallow grapheme breaks (if we are here, we don't know about advances, or we already know
     // that c2 has no advance).
-    if (u_getIntPropertyValue(c1, UCHAR_CANONICAL_COMBINING_CLASS) == 9  // virama
-        && !isPureKiller(c1) &&
-        u_getIntPropertyValue(c2, UCHAR_GENERAL_CATEGORY) == U_OTHER_LETTER) {
+    if ((props1 & kBreakingVirama) != 0 && (props2 & kOtherLetter) != 0) {
         return false;
     }
     // Rule GB999, Any ÷ Any
     return true;
 }
 
+// The regional indicators are looked back up to this many code units.
+constexpr size_t kRegionalIndicatorLookback = 1000;
+
+}  // namespace
+
+bool GraphemeBreak::isGraphemeBreak(const float* advances, const uint16_t* buf, size_t start,
+                                    size_t count, const size_t offset) {
+    // This implementation closely follows Unicode Standard Annex #29 on
+    // Unicode Text Segmentation (http://www.unicode.org/reports/tr29/),
+    // implementing a tailored version of extended grapheme clusters.
+    // The GB rules refer to section 3.1.1, Grapheme Cluster Boundary Rules.
+
+    // Rule GB1, sot ÷; Rule GB2, ÷ eot
+    if (offset <= start || offset >= start + count) {
+        return true;
+    }
+    if (U16_IS_TRAIL(buf[offset])) {
+        // Don't break a surrogate pair, but a lonely trailing surrogate pair is a break
+        return !U16_IS_LEAD(buf[offset - 1]);
+    }
+    uint32_t c1 = 0;
+    uint32_t c2 = 0;
+    size_t offset_back = offset;
+    size_t offset_forward = offset;
+    U16_PREV(buf, start, offset_back, c1);
+    U16_NEXT(buf, offset_forward, start + count, c2);
+    GraphemePropertyTable& table = GraphemePropertyTable::getInstance();
+
+    // This is used to decide font-dependent grapheme clusters. If we don't have the advance
+    // information, we become conservative in grapheme breaking and assume that it has no advance.
+    const bool c2_has_advance = (advances != nullptr && advances[offset - start] != 0.0);
+
+    auto followsPictographic = [&]() {
+        if (offset_back <= start) {
+            return false;
+        }
+        uint32_t c0 = 0;
+        size_t offset_backback = offset_back;
+        uint8_t props0 = 0;
+
+        U16_PREV(buf, start, offset_backback, c0);
+        props0 = table.get(c0);
+
+        while ((props0 & kGcbMask) == U_GCB_EXTEND && offset_backback > start) {
+            U16_PREV(buf, start, offset_backback, c0);
+            props0 = table.get(c0);
+        }
+        return (props0 & kExtendedPictographic) != 0;
+    };
+    auto isEvenRegionalIndicatorRun = [&]() {
+        const size_t lookback_barrier = offset_back > start + kRegionalIndicatorLookback
+                                                ? offset_back - kRegionalIndicatorLookback
+                                                : start;
+        size_t offset_backback = offset_back;
+        while (offset_backback > lookback_barrier) {
+            uint32_t c0 = 0;
+            U16_PREV(buf, lookback_barrier, offset_backback, c0);
+            if ((table.get(c0) & kGcbMask) != U_GCB_REGIONAL_INDICATOR) {
+                offset_backback += U16_LENGTH(c0);
+                break;
+            }
+        }
+        // The number 4 comes from the number of code units in a whole flag.
+        return (offset - offset_backback) % 4 == 0;
+    };
+    return isBreakBetween(table.get(c1), table.get(c2), advances != nullptr, c2_has_advance,
+                          followsPictographic, isEvenRegionalIndicatorRun);
+}
+
+void GraphemeBreak::getGraphemeBreaks(const float* advances, const uint16_t* buf, size_t start,
+                                      size_t count, std::vector<bool>* outBreaks) {
+    // Rule GB1, sot ÷; Rule GB2, ÷ eot
+    outBreaks->assign(count + 1, true);
+    if (count == 0) {
+        return;
+    }
+    GraphemePropertyTable& table = GraphemePropertyTable::getInstance();
+    const size_t end = start + count;
+
+    // The code points are decoded once, front to back, keeping what the rules GB11 and GB12/GB13
+    // would look back for: the properties of the nearest code point before c1 that is not Extend
+    // (or of the first code point if there is none), and where the run of regional indicators
+    // ending with c1 starts.
+    size_t offset_back = start;  // The start of c1.
+    size_t offset = start;       // The start of c2.
+    uint32_t c1 = 0;
+    U16_NEXT(buf, offset, end, c1);
+    if (offset - offset_back == 2) {
+        (*outBreaks)[1] = false;
+    }
+    uint8_t props1 = table.get(c1);
+    uint8_t propsBeforeExtend = 0;
+    size_t regionalIndicatorStart = start;
+
+    while (offset < end) {
+        uint32_t c2 = 0;
+        size_t offset_forward = offset;
+        U16_NEXT(buf, offset_forward, end, c2);
+        const uint8_t props2 = table.get(c2);
+        if (offset_forward - offset == 2) {
+            // Don't break a surrogate pair.
+            (*outBreaks)[offset + 1 - start] = false;
+        }
+
+        // A trailing surrogate decoded on its own is a lonely one, which is a break.
+        if (!U16_IS_TRAIL(buf[offset])) {
+            const bool c2_has_advance = (advances != nullptr && advances[offset - start] != 0.0);
+            auto followsPictographic = [&]() {
+                return offset_back > start && (propsBeforeExtend & kExtendedPictographic) != 0;
+            };
+            auto isEvenRegionalIndicatorRun = [&]() {
+                // Same as the bounded look back of isGraphemeBreak(), which stops at the barrier
+                // or just after it when the barrier falls inside a regional indicator.
+                const size_t lookback_barrier = offset_back > start + kRegionalIndicatorLookback
+                                                        ? offset_back - kRegionalIndicatorLookback
+                                                        : start;
+                size_t offset_backback = regionalIndicatorStart;
+                if (offset_backback < lookback_barrier) {
+                    offset_backback += (lookback_barrier - offset_backback + 1) & ~1;
+                }
+                // The number 4 comes from the number of code units in a whole flag.
+                return (offset - offset_backback) % 4 == 0;
+            };
+            (*outBreaks)[offset - start] =
+                    isBreakBetween(props1, props2, advances != nullptr, c2_has_advance,
+                                   followsPictographic, isEvenRegionalIndicatorRun);
+        }
+
+        if (offset_back == start || (props1 & kGcbMask) != U_GCB_EXTEND) {
+            propsBeforeExtend = props1;
+        }
+        if ((props2 & kGcbMask) == U_GCB_REGIONAL_INDICATOR &&
+            (props1 & kGcbMask) != U_GCB_REGIONAL_INDICATOR) {
+            regionalIndicatorStart = offset;
+        }
+        props1 = props2;
+        offset_back = offset;
+        offset = offset_forward;
+    }
+}
+
 size_t GraphemeBreak::getTextRunCursor(const float* advances, const uint16_t* buf, size_t start,
                                        size_t count, size_t offset, MoveOpt opt) {
     switch (opt) {
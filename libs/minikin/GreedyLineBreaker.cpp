@@ -16,6 +16,11 @@
 
 #define LOG_TAG "GreedyLineBreak"
 
+#include "GreedyLineBreaker.h"
+
+#include <algorithm>
+#include <limits>
+
 #include "minikin/Characters.h"
 #include "minikin/LineBreaker.h"
 #include "minikin/MeasuredText.h"
@@ -34,23 +39,56 @@ namespace {
 
 constexpr uint32_t NOWHERE = 0xFFFFFFFF;
 
+// Returns true if the character may be in an email address or a URL, see WordBreaker.
+bool isEmailOrUrlChar(uint16_t c) {
+    return ' ' < c && c <= 0x007E;
+}
+
+// Returns true if the word at the offset may be an email address or a URL. The breaks in it are
+// only taken when the line doesn't have an earlier one, so a line starting before it depends on
+// where the line before was broken.
+bool startsEmailOrUrl(const U16StringPiece& text, uint32_t offset) {
+    for (uint32_t i = offset; i < text.size() && isEmailOrUrlChar(text[i]); ++i) {
+        if (text[i] == '@' ||
+            (text[i] == ':' && i + 2 < text.size() && text[i + 1] == '/' && text[i + 2] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
 class GreedyLineBreaker {
 public:
     // User of this class must keep measured, lineWidthLimit, tabStop alive until the instance is
     // destructed.
     GreedyLineBreaker(const U16StringPiece& textBuf, const MeasuredText& measured,
                       const LineWidth& lineWidthLimits, const TabStops& tabStops,
-                      bool enableHyphenation)
+                      bool enableHyphenation, uint32_t maxLines)
             : mLineWidthLimit(lineWidthLimits.getAt(0)),
               mTextBuf(textBuf),
               mMeasuredText(measured),
               mLineWidthLimits(lineWidthLimits),
               mTabStops(tabStops),
-              mEnableHyphenation(enableHyphenation) {}
+              mEnableHyphenation(enableHyphenation),
+              mHasTabs(measured.getTextClass().hasTab),
+              mMaxLines(maxLines) {}
 
+    // Makes process() start from the given line of prev, the result of the text before the edit,
+    // and stop at the first break after the edit which is also a break of prev. The line must
+    // start at a word boundary, see isRestartableLine.
+    void resumeFrom(uint32_t lineNum, const LineBreakResult& prev, const TextEdit& edit);
+
+    // Breaks the text until the end, or until maxLines lines are broken.
     void process();
 
-    LineBreakResult getResult() const;
+    // Sets out to the broken lines.
+    void getResult(LineBreakResult* out) const;
+
+    // Returns the lines of prev up to the line given to resumeFrom, then the broken lines, then the
+    // lines of prev after the resynchronized break, shifted by the edit.
+    LineBreakResult getIncrementalResult() const;
+
+    uint32_t getLineCount() const { return std::min<size_t>(mBreakPoints.size(), mMaxLines); }
 
 private:
     struct BreakPoint {
@@ -66,17 +104,38 @@ private:
     };
 
     inline uint32_t getPrevLineBreakOffset() {
-        return mBreakPoints.empty() ? 0 : mBreakPoints.back().offset;
+        return mBreakPoints.empty() ? mStartOffset : mBreakPoints.back().offset;
     }
 
+    // Returns true if one of the breaks found since the last call resynchronizes with prev.
+    bool findResyncPoint();
+
+    // Appends the mBreakPoints in [start, end) to out.
+    void appendLines(uint32_t start, uint32_t end, LineBreakResult* out) const;
+
     // Registers the break point and prepares for next line computation.
     void breakLineAt(uint32_t offset, float lineWidth, float remainingNextLineWidth,
                      float remainingNextSumOfCharWidths, EndHyphenEdit thisLineEndHyphen,
                      StartHyphenEdit nextLineStartHyphen);
 
-    // Update current line width.
+    // Update current line width. Tabs are only handled if kHasTabs is true.
+    template <bool kHasTabs>
     void updateLineWidth(uint16_t c, float width);
 
+    // Adds the widths of the characters in [start, end), which has no word boundary inside, to the
+    // line width. Without tabs the widths are summed in a tight loop, and only the trailing line
+    // end spaces are checked.
+    template <bool kHasTabs, bool kCompactWidths>
+    void addWidths(uint32_t start, uint32_t end);
+
+    // Feeds the characters of the run from start to the line breaking, a word at a time.
+    // Specialized for the texts without tabs and for the compacted widths, so that the loop over
+    // the characters of the common single run paragraphs checks neither for each character.
+    // Returns false once the breaking is done.
+    template <bool kHasTabs, bool kCompactWidths>
+    bool processRun(const Run& run, uint32_t start, WordBreaker* breaker,
+                    uint32_t* nextWordBoundaryOffset);
+
     // Break line if current line exceeds the line limit.
     void processLineBreak(uint32_t offset, WordBreaker* breaker, bool doHyphenation);
 
@@ -121,13 +180,70 @@ private:
     const LineWidth& mLineWidthLimits;
     const TabStops& mTabStops;
     bool mEnableHyphenation;
+    bool mHasTabs;
+    uint32_t mMaxLines;
 
-    // The result of line breaking.
+    // The result of line breaking. Starts with the line mStartLineNum.
     std::vector<BreakPoint> mBreakPoints;
 
+    // The incremental re-break, see resumeFrom.
+    uint32_t mStartLineNum = 0;
+    uint32_t mStartOffset = 0;
+    const LineBreakResult* mPrevResult = nullptr;
+    int32_t mDelta = 0;
+    // The breaks before this can't resynchronize. The character before the break must not be
+    // edited, see findResyncPoint.
+    uint32_t mResyncStart = 0;
+    uint32_t mCheckedBreakCount = 0;
+    // The number of mBreakPoints up to the resynchronized one, or NOWHERE.
+    uint32_t mResyncedBreakCount = NOWHERE;
+
     MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(GreedyLineBreaker);
 };
 
+void GreedyLineBreaker::resumeFrom(uint32_t lineNum, const LineBreakResult& prev,
+                                   const TextEdit& edit) {
+    mStartLineNum = lineNum;
+    mStartOffset = lineNum == 0 ? 0 : prev.breakPoints[lineNum - 1];
+    mLineNum = lineNum;
+    mLineWidthLimit = mLineWidthLimits.getAt(lineNum);
+    mPrevResult = &prev;
+    mDelta = edit.delta();
+    mResyncStart = edit.offset + edit.insertedLength + 1;
+}
+
+bool GreedyLineBreaker::findResyncPoint() {
+    for (; mCheckedBreakCount < mBreakPoints.size(); ++mCheckedBreakCount) {
+        const BreakPoint& breakPoint = mBreakPoints[mCheckedBreakCount];
+        const uint32_t lineNum = mStartLineNum + mCheckedBreakCount;
+        if (breakPoint.offset < mResyncStart || lineNum + 1 >= mPrevResult->breakPoints.size()) {
+            continue;
+        }
+        if (mPrevResult->breakPoints[lineNum] + mDelta != breakPoint.offset) {
+            continue;
+        }
+        // Same as for the restarted line, the lines after the break must not depend on how the
+        // lines before were broken.
+        if (isEmailOrUrlChar(mTextBuf[breakPoint.offset - 1]) ||
+            startsEmailOrUrl(mTextBuf, breakPoint.offset)) {
+            continue;
+        }
+        // The next line must also start with the same hyphen, then breaking it finds the same
+        // breaks as before since the rest of the text hasn't changed.
+        const StartHyphenEdit nextStartHyphen =
+                mCheckedBreakCount + 1 < mBreakPoints.size()
+                        ? startHyphenEdit(mBreakPoints[mCheckedBreakCount + 1].hyphenEdit)
+                        : mStartHyphenEdit;
+        const HyphenEdit prevEdit =
+                static_cast<HyphenEdit>(mPrevResult->flags[lineNum + 1] & MASK_START_OF_LINE);
+        if (startHyphenEdit(prevEdit) == nextStartHyphen) {
+            mResyncedBreakCount = mCheckedBreakCount + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 void GreedyLineBreaker::breakLineAt(uint32_t offset, float lineWidth, float remainingNextLineWidth,
                                     float remainingNextSumOfCharWidths,
                                     EndHyphenEdit thisLineEndHyphen,
@@ -255,11 +371,35 @@ bool GreedyLineBreaker::tryLineBreakWithHyphenation(const Range& range, WordBrea
 
 // TODO: Respect trailing line end spaces.
 bool GreedyLineBreaker::doLineBreakWithGraphemeBounds(const Range& range) {
-    float width = mMeasuredText.widths[range.getStart()];
+    if (!mMeasuredText.widthPrefixSums.empty()) {
+        // Binary search the prefix sums instead of visiting each character of the line, which adds
+        // up for long words broken into many lines, e.g. URLs or CJK text without any word break.
+        // The first character exceeding the limit has a non-zero width, so it is a grapheme bound.
+        uint32_t offset = mMeasuredText.getOffsetForWidth(range, mLineWidthLimit);
+        if (offset == range.getStart()) {
+            // The first character is already too wide. Same as below, it is kept in this line
+            // with the zero width characters following it.
+            offset++;
+            while (offset < range.getEnd() && mMeasuredText.getCharWidth(offset) == 0) {
+                offset++;
+            }
+        }
+        if (offset < range.getEnd()) {
+            const float width = mMeasuredText.getWidth(Range(range.getStart(), offset));
+            breakLineAt(offset, width, mLineWidth - width, mSumOfCharWidths - width,
+                        EndHyphenEdit::NO_EDIT, StartHyphenEdit::NO_EDIT);
+            return false;
+        }
+        breakLineAt(range.getEnd(), mLineWidth, 0, 0, EndHyphenEdit::NO_EDIT,
+                    StartHyphenEdit::NO_EDIT);
+        return true;
+    }
+
+    float width = mMeasuredText.getCharWidth(range.getStart());
 
     // Starting from + 1 since at least one character needs to be assigned to a line.
     for (uint32_t i = range.getStart() + 1; i < range.getEnd(); ++i) {
-        const float w = mMeasuredText.widths[i];
+        const float w = mMeasuredText.getCharWidth(i);
         if (w == 0) {
             continue;  // w == 0 means here is not a grapheme bounds. Don't break here.
         }
@@ -282,8 +422,9 @@ bool GreedyLineBreaker::doLineBreakWithGraphemeBounds(const Range& range) {
     return true;
 }
 
+template <bool kHasTabs>
 void GreedyLineBreaker::updateLineWidth(uint16_t c, float width) {
-    if (c == CHAR_TAB) {
+    if (kHasTabs && c == CHAR_TAB) {
         mSumOfCharWidths = mTabStops.nextTab(mSumOfCharWidths);
         mLineWidth = mSumOfCharWidths;
     } else {
@@ -319,36 +460,111 @@ void GreedyLineBreaker::processLineBreak(uint32_t offset, WordBreaker* breaker,
     }
 }
 
+template <bool kHasTabs, bool kCompactWidths>
+void GreedyLineBreaker::addWidths(uint32_t start, uint32_t end) {
+    const float* widths = mMeasuredText.widths.data();
+    auto widthAt = [&](uint32_t i) -> float {
+        return kCompactWidths ? mMeasuredText.compactWidths.get(i) : widths[i];
+    };
+    if (kHasTabs) {
+        for (uint32_t i = start; i < end; ++i) {
+            updateLineWidth<kHasTabs>(mTextBuf[i], widthAt(i));
+        }
+        return;
+    }
+    // Without tabs, the line width is the sum up to the last character which is not a line end
+    // space, so only the trailing spaces of the word are looked at. The widths are still added one
+    // by one in the same order, so that the sums are the same.
+    uint32_t lineEnd = end;
+    while (lineEnd > start && isLineEndSpace(mTextBuf[lineEnd - 1])) {
+        lineEnd--;
+    }
+    double sum = mSumOfCharWidths;
+    uint32_t i = start;
+    for (; i < lineEnd; ++i) {
+        sum += widthAt(i);
+    }
+    if (lineEnd != start) {
+        mLineWidth = sum;
+    }
+    for (; i < end; ++i) {
+        sum += widthAt(i);
+    }
+    mSumOfCharWidths = sum;
+}
+
+template <bool kHasTabs, bool kCompactWidths>
+bool GreedyLineBreaker::processRun(const Run& run, uint32_t start, WordBreaker* breaker,
+                                   uint32_t* nextWordBoundaryOffset) {
+    const uint32_t end = run.getRange().getEnd();
+    const bool canBreak = run.canBreak();
+    uint32_t i = start;
+    while (i < end) {
+        // A boundary before the characters is never reached again, as in the per character loop.
+        const uint32_t wordEnd = (*nextWordBoundaryOffset > i && *nextWordBoundaryOffset < end)
+                                         ? *nextWordBoundaryOffset
+                                         : end;
+        addWidths<kHasTabs, kCompactWidths>(i, wordEnd);
+        i = wordEnd;
+
+        if (i == *nextWordBoundaryOffset) {
+            // Only process line break at word boundary and the run can break into some pieces.
+            if (canBreak || *nextWordBoundaryOffset == end) {
+                processLineBreak(i, breaker, canBreak);
+                if (mBreakPoints.size() >= mMaxLines) {
+                    return false;  // The lines are final once broken, the rest doesn't change them.
+                }
+                if (mPrevResult != nullptr && findResyncPoint()) {
+                    return false;  // The rest of the lines are the same as before.
+                }
+            }
+            *nextWordBoundaryOffset = breaker->next();
+        }
+    }
+    return true;
+}
+
 void GreedyLineBreaker::process() {
-    WordBreaker wordBreaker;
+    ScopedWordBreaker scopedWordBreaker;
+    WordBreaker& wordBreaker = scopedWordBreaker.get();
     wordBreaker.setText(mTextBuf.data(), mTextBuf.size());
+    wordBreaker.setRecord(&mMeasuredText.wordBreaks);
 
     // Following two will be initialized after the first iteration.
     uint32_t localeListId = LocaleListCache::kInvalidListId;
     uint32_t nextWordBoundaryOffset = 0;
     for (const auto& run : mMeasuredText.runs) {
         const Range range = run->getRange();
+        if (range.getEnd() <= mStartOffset) {
+            continue;
+        }
+        const uint32_t start = std::max(range.getStart(), mStartOffset);
 
         // Update locale if necessary.
         uint32_t newLocaleListId = run->getLocaleListId();
         if (localeListId != newLocaleListId) {
             Locale locale = getEffectiveLocale(newLocaleListId);
             nextWordBoundaryOffset = wordBreaker.followingWithLocale(
-                    locale, run->lineBreakStyle(), run->lineBreakWordStyle(), range.getStart());
+                    locale, run->lineBreakStyle(), run->lineBreakWordStyle(), start);
             mHyphenator = HyphenatorMap::lookup(locale);
             localeListId = newLocaleListId;
         }
 
-        for (uint32_t i = range.getStart(); i < range.getEnd(); ++i) {
-            updateLineWidth(mTextBuf[i], mMeasuredText.widths[i]);
-
-            if ((i + 1) == nextWordBoundaryOffset) {
-                // Only process line break at word boundary and the run can break into some pieces.
-                if (run->canBreak() || nextWordBoundaryOffset == range.getEnd()) {
-                    processLineBreak(i + 1, &wordBreaker, run->canBreak());
-                }
-                nextWordBoundaryOffset = wordBreaker.next();
-            }
+        const bool compactWidths = mMeasuredText.compactWidths.size() != 0;
+        bool more;
+        if (mHasTabs) {
+            more = compactWidths ? processRun<true, true>(*run, start, &wordBreaker,
+                                                          &nextWordBoundaryOffset)
+                                 : processRun<true, false>(*run, start, &wordBreaker,
+                                                           &nextWordBoundaryOffset);
+        } else {
+            more = compactWidths ? processRun<false, true>(*run, start, &wordBreaker,
+                                                           &nextWordBoundaryOffset)
+                                 : processRun<false, false>(*run, start, &wordBreaker,
+                                                            &nextWordBoundaryOffset);
+        }
+        if (!more) {
+            return;
         }
     }
 
@@ -359,42 +575,179 @@ void GreedyLineBreaker::process() {
     }
 }
 
-LineBreakResult GreedyLineBreaker::getResult() const {
+void GreedyLineBreaker::appendLines(uint32_t start, uint32_t end, LineBreakResult* out) const {
     constexpr int TAB_BIT = 1 << 29;  // Must be the same in StaticLayout.java
 
-    LineBreakResult out;
-    uint32_t prevBreakOffset = 0;
-    for (const auto& breakPoint : mBreakPoints) {
+    uint32_t prevBreakOffset = start == 0 ? mStartOffset : mBreakPoints[start - 1].offset;
+    for (uint32_t lineNum = start; lineNum < end; ++lineNum) {
+        const BreakPoint& breakPoint = mBreakPoints[lineNum];
         // TODO: compute these during line breaking if these takes longer time.
         bool hasTabChar = false;
-        for (uint32_t i = prevBreakOffset; i < breakPoint.offset; ++i) {
-            hasTabChar |= mTextBuf[i] == CHAR_TAB;
+        if (mHasTabs) {
+            for (uint32_t i = prevBreakOffset; i < breakPoint.offset; ++i) {
+                hasTabChar |= mTextBuf[i] == CHAR_TAB;
+            }
         }
 
-        MinikinExtent extent =
-                mMeasuredText.getExtent(mTextBuf, Range(prevBreakOffset, breakPoint.offset));
-        out.breakPoints.push_back(breakPoint.offset);
-        out.widths.push_back(breakPoint.lineWidth);
-        out.ascents.push_back(extent.ascent);
-        out.descents.push_back(extent.descent);
-        out.flags.push_back((hasTabChar ? TAB_BIT : 0) | static_cast<int>(breakPoint.hyphenEdit));
+        out->breakPoints.push_back(breakPoint.offset);
+        out->widths.push_back(breakPoint.lineWidth);
+        if (!mMeasuredText.isLineExtentsDeferred()) {
+            MinikinExtent extent =
+                    mMeasuredText.getExtent(mTextBuf, Range(prevBreakOffset, breakPoint.offset));
+            out->ascents.push_back(extent.ascent);
+            out->descents.push_back(extent.descent);
+        }
+        out->flags.push_back((hasTabChar ? TAB_BIT : 0) |
+                             static_cast<int>(breakPoint.hyphenEdit));
 
         prevBreakOffset = breakPoint.offset;
     }
+}
+
+void GreedyLineBreaker::getResult(LineBreakResult* out) const {
+    out->clear();
+    appendLines(0, getLineCount(), out);
+    if (mMeasuredText.isLineExtentsDeferred()) {
+        out->deferExtents();
+    }
+}
+
+LineBreakResult GreedyLineBreaker::getIncrementalResult() const {
+    const LineBreakResult& prev = *mPrevResult;
+    const bool deferred = mMeasuredText.isLineExtentsDeferred();
+    LineBreakResult out;
+    auto copyLines = [&](uint32_t start, uint32_t end, int32_t delta) {
+        for (uint32_t lineNum = start; lineNum < end; ++lineNum) {
+            out.breakPoints.push_back(prev.breakPoints[lineNum] + delta);
+            out.widths.push_back(prev.widths[lineNum]);
+            if (!deferred) {
+                out.ascents.push_back(prev.ascents[lineNum]);
+                out.descents.push_back(prev.descents[lineNum]);
+            }
+            out.flags.push_back(prev.flags[lineNum]);
+        }
+    };
+    copyLines(0, mStartLineNum, 0);
+    if (mResyncedBreakCount == NOWHERE) {
+        appendLines(0, mBreakPoints.size(), &out);
+    } else {
+        appendLines(0, mResyncedBreakCount, &out);
+        copyLines(mStartLineNum + mResyncedBreakCount, prev.breakPoints.size(), mDelta);
+    }
+    if (deferred) {
+        out.deferExtents();
+    }
     return out;
 }
 
+// Returns true if breaking the text from the start of the line finds the same breaks as breaking
+// it from the start of the paragraph, i.e. the line starts at a word boundary and isn't in or just
+// before an email address or a URL.
+bool isRestartableLine(const U16StringPiece& textBuf, const MeasuredText& measured,
+                       const LineBreakResult& prev, uint32_t lineNum, WordBreaker* breaker) {
+    if (lineNum == 0) {
+        return true;
+    }
+    const uint32_t offset = prev.breakPoints[lineNum - 1];
+    if ((prev.flags[lineNum - 1] & (MASK_END_OF_LINE | MASK_START_OF_LINE)) != 0) {
+        return false;  // Broken in a hyphenated word.
+    }
+    if (isEmailOrUrlChar(textBuf[offset - 1]) || startsEmailOrUrl(textBuf, offset)) {
+        return false;
+    }
+    for (const auto& run : measured.runs) {
+        if (run->getRange().contains(offset - 1)) {
+            const Locale locale = getEffectiveLocale(run->getLocaleListId());
+            return breaker->followingWithLocale(locale, run->lineBreakStyle(),
+                                                run->lineBreakWordStyle(),
+                                                offset - 1) == static_cast<ssize_t>(offset);
+        }
+    }
+    return false;
+}
+
 }  // namespace
 
 LineBreakResult breakLineGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
                                 const LineWidth& lineWidthLimits, const TabStops& tabStops,
                                 bool enableHyphenation) {
+    return breakLineGreedy(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation,
+                           std::numeric_limits<uint32_t>::max());
+}
+
+LineBreakResult breakLineGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
+                                const LineWidth& lineWidthLimits, const TabStops& tabStops,
+                                bool enableHyphenation, uint32_t maxLines) {
+    LineBreakResult result;
+    breakLineGreedy(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation, maxLines,
+                    &result);
+    return result;
+}
+
+void breakLineGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
+                     const LineWidth& lineWidthLimits, const TabStops& tabStops,
+                     bool enableHyphenation, uint32_t maxLines, LineBreakResult* out) {
+    if (textBuf.size() == 0 || maxLines == 0) {
+        out->clear();
+        return;
+    }
+    GreedyLineBreaker lineBreaker(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation,
+                                  maxLines);
+    lineBreaker.process();
+    lineBreaker.getResult(out);
+}
+
+LineBreakResult breakLineGreedyIncremental(const U16StringPiece& textBuf,
+                                           const MeasuredText& measured,
+                                           const LineWidth& lineWidthLimits,
+                                           const TabStops& tabStops, bool enableHyphenation,
+                                           const LineBreakResult& prev, const TextEdit& edit) {
+    if (textBuf.size() == 0 || prev.breakPoints.empty() ||
+        prev.breakPoints.back() + edit.delta() != static_cast<int>(textBuf.size()) ||
+        prev.hasDeferredExtents() != measured.isLineExtentsDeferred()) {
+        return breakLineGreedy(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation);
+    }
+
+    // The edit may change the line of the word before it and the line before, e.g. when the first
+    // word of the edited line gets short enough to fit there. Go back to the line before the line
+    // of the word, and further until the line can be broken on its own.
+    const uint32_t lastUnchanged = edit.offset == 0 ? 0 : edit.offset - 1;
+    uint32_t lineNum = std::upper_bound(prev.breakPoints.begin(), prev.breakPoints.end(),
+                                        static_cast<int>(lastUnchanged)) -
+                       prev.breakPoints.begin();
+    lineNum = std::min<uint32_t>(lineNum, prev.breakPoints.size() - 1);
+    {
+        ScopedWordBreaker scopedWordBreaker;
+        WordBreaker& wordBreaker = scopedWordBreaker.get();
+        wordBreaker.setText(textBuf.data(), textBuf.size());
+        while (!isRestartableLine(textBuf, measured, prev, lineNum, &wordBreaker)) {
+            lineNum--;
+        }
+        if (lineNum > 0) {
+            lineNum--;
+            while (!isRestartableLine(textBuf, measured, prev, lineNum, &wordBreaker)) {
+                lineNum--;
+            }
+        }
+    }
+
+    GreedyLineBreaker lineBreaker(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation,
+                                  std::numeric_limits<uint32_t>::max());
+    lineBreaker.resumeFrom(lineNum, prev, edit);
+    lineBreaker.process();
+    return lineBreaker.getIncrementalResult();
+}
+
+uint32_t countLinesGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
+                          const LineWidth& lineWidthLimits, const TabStops& tabStops,
+                          bool enableHyphenation) {
     if (textBuf.size() == 0) {
-        return LineBreakResult();
+        return 0;
     }
-    GreedyLineBreaker lineBreaker(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation);
+    GreedyLineBreaker lineBreaker(textBuf, measured, lineWidthLimits, tabStops, enableHyphenation,
+                                  std::numeric_limits<uint32_t>::max());
     lineBreaker.process();
-    return lineBreaker.getResult();
+    return lineBreaker.getLineCount();
 }
 
 }  // namespace minikin
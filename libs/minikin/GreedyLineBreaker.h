@@ -29,6 +29,33 @@ LineBreakResult breakLineGreedy(const U16StringPiece& textBuf, const MeasuredTex
                                 const LineWidth& lineWidthLimits, const TabStops& tabStops,
                                 bool enableHyphenation);
 
+// Same as above, but stops after the first maxLines lines and only returns them.
+LineBreakResult breakLineGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
+                                const LineWidth& lineWidthLimits, const TabStops& tabStops,
+                                bool enableHyphenation, uint32_t maxLines);
+
+// Same as above, but writes the lines to out, reusing the capacity of its vectors.
+void breakLineGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
+                     const LineWidth& lineWidthLimits, const TabStops& tabStops,
+                     bool enableHyphenation, uint32_t maxLines, LineBreakResult* out);
+
+// Breaks textBuf, the text of prev after the edit, into the same lines as breakLineGreedy. The
+// lines before the edit are taken from prev, and the breaking restarts a line or two before the
+// edit and stops at the first break after the edit which is also a break of prev, since the lines
+// after it are the same as before, only shifted. prev must be the full result of the text before
+// the edit, broken with the same line widths, tab stops and options. The widths of the restarted
+// lines are summed from their start, which may differ from breakLineGreedy in the last bits.
+LineBreakResult breakLineGreedyIncremental(const U16StringPiece& textBuf,
+                                           const MeasuredText& measured,
+                                           const LineWidth& lineWidthLimits,
+                                           const TabStops& tabStops, bool enableHyphenation,
+                                           const LineBreakResult& prev, const TextEdit& edit);
+
+// Returns the number of lines of breakLineGreedy, without building the result.
+uint32_t countLinesGreedy(const U16StringPiece& textBuf, const MeasuredText& measured,
+                          const LineWidth& lineWidthLimits, const TabStops& tabStops,
+                          bool enableHyphenation);
+
 }  // namespace minikin
 
 #endif  // MINIKIN_GREEDY_LINE_BREAKER_H
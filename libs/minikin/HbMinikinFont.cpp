@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Minikin"
+
+#include "minikin/HbMinikinFont.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <hb-ot.h>
+#include <log/log.h>
+
+#include "minikin/MinikinExtent.h"
+#include "minikin/MinikinPaint.h"
+#include "minikin/MinikinRect.h"
+
+namespace minikin {
+
+// static
+std::shared_ptr<HbMinikinFont> HbMinikinFont::create(const std::string& path, int index) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        ALOGE("Failed to open %s", path.c_str());
+        return nullptr;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        ALOGE("Failed to stat %s", path.c_str());
+        return nullptr;
+    }
+    const size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ALOGE("Failed to map %s", path.c_str());
+        return nullptr;
+    }
+    std::shared_ptr<const void> mapped(data, [size](const void* p) {
+        munmap(const_cast<void*>(p), size);
+    });
+    return std::make_shared<HbMinikinFont>(std::move(mapped), size, path, index,
+                                           std::vector<FontVariation>());
+}
+
+HbMinikinFont::HbMinikinFont(std::shared_ptr<const void> data, size_t size,
+                             const std::string& path, int index,
+                             const std::vector<FontVariation>& axes)
+        : mData(std::move(data)), mSize(size), mPath(path), mIndex(index), mAxes(axes) {
+    HbBlobUniquePtr blob(hb_blob_create(reinterpret_cast<const char*>(mData.get()), mSize,
+                                        HB_MEMORY_MODE_READONLY, nullptr, nullptr));
+    HbFaceUniquePtr face(hb_face_create(blob.get(), mIndex));
+    mFont.reset(hb_font_create(face.get()));
+    hb_ot_font_set_funcs(mFont.get());
+    const uint32_t upem = hb_face_get_upem(face.get());
+    hb_font_set_scale(mFont.get(), upem, upem);
+    mUpem = upem;
+    if (!mAxes.empty()) {
+        std::vector<hb_variation_t> variations;
+        variations.reserve(mAxes.size());
+        for (const FontVariation& axis : mAxes) {
+            variations.push_back({axis.axisTag, axis.value});
+        }
+        hb_font_set_variations(mFont.get(), variations.data(), variations.size());
+    }
+    hb_font_make_immutable(mFont.get());
+}
+
+float HbMinikinFont::GetHorizontalAdvance(uint32_t glyph_id, const MinikinPaint& paint,
+                                          const FontFakery& /* fakery */) const {
+    return hb_font_get_glyph_h_advance(mFont.get(), glyph_id) * paint.size * paint.scaleX / mUpem;
+}
+
+void HbMinikinFont::GetHorizontalAdvances(uint16_t* glyph_ids, uint32_t count,
+                                          const MinikinPaint& paint,
+                                          const FontFakery& /* fakery */,
+                                          float* outAdvances) const {
+    // HarfBuzz takes 32 bit glyph IDs, so convert them a batch at a time on the stack.
+    static constexpr uint32_t kBatchSize = 64;
+    hb_codepoint_t glyphs[kBatchSize];
+    hb_position_t advances[kBatchSize];
+    const float scale = paint.size * paint.scaleX / mUpem;
+    for (uint32_t start = 0; start < count; start += kBatchSize) {
+        const uint32_t batch = std::min(kBatchSize, count - start);
+        std::copy(glyph_ids + start, glyph_ids + start + batch, glyphs);
+        hb_font_get_glyph_h_advances(mFont.get(), batch, glyphs, sizeof(hb_codepoint_t), advances,
+                                     sizeof(hb_position_t));
+        for (uint32_t i = 0; i < batch; ++i) {
+            outAdvances[start + i] = advances[i] * scale;
+        }
+    }
+}
+
+void HbMinikinFont::GetBounds(MinikinRect* bounds, uint32_t glyph_id, const MinikinPaint& paint,
+                              const FontFakery& /* fakery */) const {
+    hb_glyph_extents_t extents;
+    if (!hb_font_get_glyph_extents(mFont.get(), glyph_id, &extents)) {
+        *bounds = MinikinRect();
+        return;
+    }
+    // The extents have the y axis going up, while the bounds have it going down. The height is
+    // negative.
+    const float scaleY = paint.size / mUpem;
+    const float scaleX = scaleY * paint.scaleX;
+    bounds->mLeft = extents.x_bearing * scaleX;
+    bounds->mTop = -extents.y_bearing * scaleY;
+    bounds->mRight = (extents.x_bearing + extents.width) * scaleX;
+    bounds->mBottom = -(extents.y_bearing + extents.height) * scaleY;
+}
+
+void HbMinikinFont::GetFontExtent(MinikinExtent* extent, const MinikinPaint& paint,
+                                  const FontFakery& /* fakery */) const {
+    hb_font_extents_t extents;
+    hb_font_get_h_extents(mFont.get(), &extents);
+    extent->ascent = -extents.ascender * paint.size / mUpem;
+    extent->descent = -extents.descender * paint.size / mUpem;
+}
+
+std::shared_ptr<MinikinFont> HbMinikinFont::createFontWithVariation(
+        const std::vector<FontVariation>& variations) const {
+    return std::make_shared<HbMinikinFont>(mData, mSize, mPath, mIndex, variations);
+}
+
+// static
+const HbMinikinFontFactory& HbMinikinFontFactory::getInstance() {
+    static HbMinikinFontFactory factory;
+    return factory;
+}
+
+std::shared_ptr<MinikinFont> HbMinikinFontFactory::create(BufferReader reader) const {
+    const std::string path(reader.readString());
+    const int index = reader.read<int32_t>();
+    auto [axes, axisCount] = reader.readArray<FontVariation>();
+    std::shared_ptr<HbMinikinFont> font = HbMinikinFont::create(path, index);
+    if (font == nullptr || axisCount == 0) {
+        return font;
+    }
+    return font->createFontWithVariation(std::vector<FontVariation>(axes, axes + axisCount));
+}
+
+void HbMinikinFontFactory::skip(BufferReader* reader) const {
+    reader->skipString();                // path
+    reader->skip<int32_t>();             // index
+    reader->skipArray<FontVariation>();  // axes
+}
+
+void HbMinikinFontFactory::write(BufferWriter* writer, const MinikinFont* minikinFont) const {
+    writer->writeString(minikinFont->GetFontPath());
+    writer->write<int32_t>(minikinFont->GetFontIndex());
+    const std::vector<FontVariation>& axes = minikinFont->GetAxes();
+    writer->writeArray<FontVariation>(axes.data(), axes.size());
+}
+
+}  // namespace minikin
@@ -17,14 +17,20 @@
 #include "minikin/Hyphenator.h"
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include <unicode/uchar.h>
 #include <unicode/uscript.h>
+#include <utils/LruCache.h>
 
 #include "minikin/Characters.h"
+#include "minikin/Hasher.h"
+#include "minikin/Macros.h"
+#include "minikin/ReadAhead.h"
 
 namespace minikin {
 
@@ -54,6 +60,9 @@ struct Trie {
     uint32_t pattern_shift;
     uint32_t n_entries;
     uint32_t data[1];  // actually flexible array, size is known at runtime
+
+    // The entries of version 1, which fit in 16 bits.
+    const uint16_t* data16() const { return reinterpret_cast<const uint16_t*>(data); }
 };
 
 struct Pattern {
@@ -96,6 +105,149 @@ struct Header {
     }
 };
 
+static std::atomic<bool> gWordCacheEnabled = {false};
+
+namespace {
+
+// Combines the patterns of the substrings of the codes found in the trie into buffer, by
+// point-wise max. Entry is the type of the trie entries, which depends on the trie version.
+template <typename Entry>
+void matchPatterns(const Trie& trie, const Entry* trieData, const Pattern& pattern,
+                   const uint16_t* codes, size_t len, size_t minPrefix, size_t maxOffset,
+                   uint8_t* buffer) {
+    const uint32_t char_mask = trie.char_mask;
+    const uint32_t link_shift = trie.link_shift;
+    const uint32_t link_mask = trie.link_mask;
+    const uint32_t pattern_shift = trie.pattern_shift;
+    for (size_t i = 0; i < len - 1; i++) {
+        uint32_t node = 0;  // index into Trie table
+        for (size_t j = i; j < len; j++) {
+            uint16_t c = codes[j];
+            uint32_t entry = trieData[node + c];
+            if ((entry & char_mask) == c) {
+                node = (entry & link_mask) >> link_shift;
+            } else {
+                // No pattern continues with this character, so no longer substring from i
+                // matches either.
+                break;
+            }
+            if (j + 1 < len) {
+                // The transition of the next character is a dependent load far from this node.
+                __builtin_prefetch(&trieData[node + codes[j + 1]]);
+            }
+            uint32_t pat_ix = trieData[node] >> pattern_shift;
+            // pat_ix contains a 3-tuple of length, shift (number of trailing zeros), and an offset
+            // into the buf pool. This is the pattern for the substring (i..j) we just matched,
+            // which we combine (via point-wise max) into the buffer vector.
+            if (pat_ix != 0) {
+                uint32_t pat_entry = pattern.data[pat_ix];
+                int pat_len = Pattern::len(pat_entry);
+                int pat_shift = Pattern::shift(pat_entry);
+                const uint8_t* pat_buf = pattern.buf(pat_entry);
+                int offset = j + 1 - (pat_len + pat_shift);
+                // offset is the index within buffer that lines up with the start of pat_buf
+                int start = std::max((int)minPrefix - offset, 0);
+                int end = std::min(pat_len, (int)maxOffset - offset);
+                for (int k = start; k < end; k++) {
+                    buffer[offset + k] = std::max(buffer[offset + k], pat_buf[k]);
+                }
+            }
+        }
+    }
+}
+
+// The alphabet codes of a word, including the start and stop codes, and the hyphenation value of
+// its script. They determine the result of hyphenateFromCodes.
+class HyphenationWordKey {
+public:
+    static constexpr size_t kMaxLength = 64;
+
+    HyphenationWordKey(const uint16_t* codes, size_t len, HyphenationType hyphenValue)
+            : mLength(len), mHyphenValue(hyphenValue) {
+        std::copy(codes, codes + len, mCodes);
+        mHash = Hasher()
+                        .update(static_cast<uint32_t>(hyphenValue))
+                        .updateShorts(mCodes, mLength)
+                        .hash();
+    }
+
+    bool operator==(const HyphenationWordKey& o) const {
+        return mLength == o.mLength && mHyphenValue == o.mHyphenValue &&
+               !memcmp(mCodes, o.mCodes, mLength * sizeof(uint16_t));
+    }
+
+    android::hash_t hash() const { return mHash; }
+
+private:
+    uint16_t mCodes[kMaxLength];
+    size_t mLength;
+    HyphenationType mHyphenValue;
+    android::hash_t mHash;
+};
+
+inline android::hash_t hash_type(const HyphenationWordKey& key) {
+    return key.hash();
+}
+
+// Returns a buffer of at least len alphabet codes for the words too long for the buffers on the
+// stack. It grows to the longest word hyphenated on the thread and is kept for the next ones.
+uint16_t* getLongWordCodes(size_t len) {
+    thread_local std::vector<uint16_t> codes;
+    if (codes.size() < len) {
+        codes.resize(len);
+    }
+    return codes.data();
+}
+
+}  // namespace
+
+class Hyphenator::WordCache {
+public:
+    WordCache() : mCache(kMaxEntries) {}
+
+    // Returns true and fills out with the result of the word if it is cached.
+    bool get(const HyphenationWordKey& key, size_t wordLength, HyphenationType* out) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const std::vector<HyphenationType>& result = mCache.get(key);
+        if (result.empty()) {
+            mStats.recordMiss();
+            return false;
+        }
+        mStats.recordHit();
+        std::copy(result.begin(), result.begin() + wordLength, out);
+        return true;
+    }
+
+    void put(const HyphenationWordKey& key, size_t wordLength, const HyphenationType* result) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t sizeBefore = mCache.size();
+        if (mCache.put(key, std::vector<HyphenationType>(result, result + wordLength))) {
+            mStats.recordEvictions(sizeBefore + 1 - mCache.size());
+        }
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+
+private:
+    // A few pages of a book in most languages.
+    static constexpr size_t kMaxEntries = 4096;
+
+    std::mutex mMutex;
+    // Empty results are never cached, the empty null value means a miss.
+    android::LruCache<HyphenationWordKey, std::vector<HyphenationType>> mCache GUARDED_BY(mMutex);
+    CacheStats mStats;
+};
+
+// static
+void Hyphenator::setWordCacheEnabled(bool enabled) {
+    gWordCacheEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+const CacheStats* Hyphenator::getWordCacheStats() const {
+    const WordCache* cache = mWordCache.load(std::memory_order_acquire);
+    return cache == nullptr ? nullptr : &cache->getStats();
+}
+
 // static
 Hyphenator* Hyphenator::loadBinary(const uint8_t* patternData, size_t minPrefix, size_t minSuffix,
                                    const std::string& locale) {
@@ -107,25 +259,156 @@ Hyphenator* Hyphenator::loadBinary(const uint8_t* patternData, size_t minPrefix,
     } else if (locale == "sl") {
         hyphenLocale = HyphenationLocale::SLOVENIAN;
     }
+    if (patternData != nullptr && ReadAhead::isEnabled()) {
+        // The trie is walked from its root for every word, all over the file.
+        const Header* header = reinterpret_cast<const Header*>(patternData);
+        ReadAhead::advise(patternData, header->file_size);
+    }
     return new Hyphenator(patternData, minPrefix, minSuffix, hyphenLocale);
 }
 
+namespace {
+
+constexpr uint32_t HYB_MAGIC = 0x62ad7968;
+constexpr uint32_t HYB_CONTAINER_MAGIC = 0x62ad7963;
+constexpr size_t HYB_CONTAINER_LOCALE_SIZE = 16;
+
+struct ContainerHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_entries;
+    uint32_t file_size;
+};
+
+struct ContainerEntry {
+    char locale[HYB_CONTAINER_LOCALE_SIZE];
+    uint32_t min_prefix;
+    uint32_t min_suffix;
+    uint32_t offset;
+    uint32_t size;
+};
+
+}  // namespace
+
+std::vector<Hyphenator::PackedEntry> Hyphenator::loadPackedBinary(const uint8_t* data,
+                                                                  size_t size) {
+    std::vector<PackedEntry> result;
+    if (data == nullptr || size < sizeof(ContainerHeader) ||
+        reinterpret_cast<uintptr_t>(data) % alignof(ContainerHeader) != 0) {
+        return result;
+    }
+    const ContainerHeader* header = reinterpret_cast<const ContainerHeader*>(data);
+    if (header->magic != HYB_CONTAINER_MAGIC || header->version != 0 ||
+        header->file_size > size) {
+        return result;
+    }
+    const size_t fileSize = header->file_size;
+    const size_t nEntries = header->n_entries;
+    if (nEntries > (fileSize - sizeof(ContainerHeader)) / sizeof(ContainerEntry)) {
+        return result;
+    }
+    const ContainerEntry* entries =
+            reinterpret_cast<const ContainerEntry*>(data + sizeof(ContainerHeader));
+    // Validate the whole directory first, so that a malformed container loads nothing.
+    for (size_t i = 0; i < nEntries; i++) {
+        const ContainerEntry& entry = entries[i];
+        if (entry.offset % alignof(Header) != 0 || entry.offset > fileSize ||
+            entry.size > fileSize - entry.offset || entry.size < sizeof(Header) ||
+            memchr(entry.locale, '\0', HYB_CONTAINER_LOCALE_SIZE) == nullptr) {
+            return result;
+        }
+        const Header* hyb = reinterpret_cast<const Header*>(data + entry.offset);
+        if (hyb->magic != HYB_MAGIC || hyb->file_size > entry.size) {
+            return result;
+        }
+    }
+    result.reserve(nEntries);
+    for (size_t i = 0; i < nEntries; i++) {
+        const ContainerEntry& entry = entries[i];
+        std::string locale(entry.locale);
+        Hyphenator* hyphenator =
+                loadBinary(data + entry.offset, entry.min_prefix, entry.min_suffix, locale);
+        result.push_back({std::move(locale), hyphenator});
+    }
+    return result;
+}
+
 Hyphenator::Hyphenator(const uint8_t* patternData, size_t minPrefix, size_t minSuffix,
                        HyphenationLocale hyphenLocale)
         : mPatternData(patternData),
           mMinPrefix(minPrefix),
           mMinSuffix(minSuffix),
-          mHyphenationLocale(hyphenLocale) {}
+          mHyphenationLocale(hyphenLocale),
+          mAlphabetCodesStart(0),
+          mAlphabetCodesEnd(0),
+          mWordCache(nullptr) {
+    if (patternData == nullptr || getHeader()->alphabetVersion() != 1) {
+        return;
+    }
+    const AlphabetTable1* alphabet = getHeader()->alphabetTable1();
+    if (alphabet->n_entries == 0) {
+        return;
+    }
+    // The words are looked up by UTF-16 code units, so only the BMP entries can ever match.
+    const uint32_t start = AlphabetTable1::codepoint(alphabet->data[0]);
+    uint32_t end = start;
+    for (uint32_t i = 0; i < alphabet->n_entries; ++i) {
+        const uint32_t codepoint = AlphabetTable1::codepoint(alphabet->data[i]);
+        if (codepoint > 0xFFFF) {
+            break;
+        }
+        end = codepoint + 1;
+    }
+    if (end == start || end - start > MAX_DENSE_ALPHABET_SIZE) {
+        return;
+    }
+    mAlphabetCodes = std::make_unique<uint16_t[]>(end - start);
+    for (uint32_t i = 0; i < alphabet->n_entries; ++i) {
+        const uint32_t entry = alphabet->data[i];
+        if (AlphabetTable1::codepoint(entry) >= end) {
+            break;
+        }
+        mAlphabetCodes[AlphabetTable1::codepoint(entry) - start] = AlphabetTable1::value(entry);
+    }
+    mAlphabetCodesStart = start;
+    mAlphabetCodesEnd = end;
+}
+
+Hyphenator::~Hyphenator() {
+    delete mWordCache.load();
+}
 
 void Hyphenator::hyphenate(const U16StringPiece& word, HyphenationType* out) const {
+    uint16_t alpha_codes[MAX_HYPHENATED_SIZE];
+    hyphenateWord(word, alpha_codes, gWordCacheEnabled.load(std::memory_order_relaxed), out);
+}
+
+void Hyphenator::hyphenateBatch(const U16StringPiece& text, const std::vector<Range>& wordRanges,
+                                HyphenationType* out) const {
+    uint16_t alpha_codes[MAX_HYPHENATED_SIZE];
+    const bool useWordCache = gWordCacheEnabled.load(std::memory_order_relaxed);
+    for (const Range& range : wordRanges) {
+        hyphenateWord(text.substr(range), alpha_codes, useWordCache, out + range.getStart());
+    }
+}
+
+void Hyphenator::hyphenateWord(const U16StringPiece& word, uint16_t* alpha_codes,
+                               bool useWordCache, HyphenationType* out) const {
     const size_t len = word.size();
     const size_t paddedLen = len + 2;  // start and stop code each count for 1
-    if (mPatternData != nullptr && len >= mMinPrefix + mMinSuffix &&
-        paddedLen <= MAX_HYPHENATED_SIZE) {
-        uint16_t alpha_codes[MAX_HYPHENATED_SIZE];
+    if (mPatternData != nullptr && len >= mMinPrefix + mMinSuffix) {
+        const bool isLongWord = paddedLen > MAX_HYPHENATED_SIZE;
+        if (isLongWord) {
+            alpha_codes = getLongWordCodes(paddedLen);
+        }
         const HyphenationType hyphenValue = alphabetLookup(alpha_codes, word);
         if (hyphenValue != HyphenationType::DONT_BREAK) {
-            hyphenateFromCodes(alpha_codes, paddedLen, hyphenValue, out);
+            // The long words are rare enough not to be worth caching.
+            if (useWordCache && !isLongWord) {
+                hyphenateFromCodesCached(alpha_codes, paddedLen, hyphenValue, out);
+            } else {
+                hyphenateFromCodes(alpha_codes, paddedLen, hyphenValue, out);
+            }
             return;
         }
         // TODO: try NFC normalization
@@ -315,6 +598,24 @@ HyphenationType Hyphenator::alphabetLookup(uint16_t* alpha_codes,
         }
         alpha_codes[word.size() + 1] = 0;  // word termination
         return result;
+    } else if (alphabetVersion == 1 && mAlphabetCodes) {
+        alpha_codes[0] = 0;
+        for (size_t i = 0; i < word.size(); i++) {
+            uint16_t c = word[i];
+            if (c < mAlphabetCodesStart || c >= mAlphabetCodesEnd) {
+                return HyphenationType::DONT_BREAK;
+            }
+            uint16_t code = mAlphabetCodes[c - mAlphabetCodesStart];
+            if (code == 0) {
+                return HyphenationType::DONT_BREAK;
+            }
+            if (result == HyphenationType::BREAK_AND_INSERT_HYPHEN) {
+                result = hyphenationTypeBasedOnScript(c);
+            }
+            alpha_codes[i + 1] = code;
+        }
+        alpha_codes[word.size() + 1] = 0;
+        return result;
     } else if (alphabetVersion == 1) {
         const AlphabetTable1* alphabet = header->alphabetTable1();
         size_t n_entries = alphabet->n_entries;
@@ -342,6 +643,32 @@ HyphenationType Hyphenator::alphabetLookup(uint16_t* alpha_codes,
     return HyphenationType::DONT_BREAK;
 }
 
+void Hyphenator::hyphenateFromCodesCached(const uint16_t* codes, size_t len,
+                                          HyphenationType hyphenValue,
+                                          HyphenationType* out) const {
+    static_assert(HyphenationWordKey::kMaxLength == MAX_HYPHENATED_SIZE);
+    WordCache* cache = mWordCache.load(std::memory_order_acquire);
+    if (cache == nullptr) {
+        WordCache* newCache = new WordCache();
+        // The first one set wins.
+        if (mWordCache.compare_exchange_strong(cache, newCache, std::memory_order_acq_rel)) {
+            cache = newCache;
+        } else {
+            delete newCache;
+        }
+    }
+    // The codes include the start and stop codes, the result only covers the word.
+    const size_t wordLength = len - 2;
+    const HyphenationWordKey key(codes, len, hyphenValue);
+    if (cache->get(key, wordLength, out)) {
+        return;
+    }
+    hyphenateFromCodes(codes, len, hyphenValue, out);
+    if (wordLength > 0) {
+        cache->put(key, wordLength, out);
+    }
+}
+
 /**
  * Internal implementation, after conversion to codes. All case folding and normalization
  * has been done by now, and all characters have been found in the alphabet.
@@ -356,39 +683,11 @@ void Hyphenator::hyphenateFromCodes(const uint16_t* codes, size_t len, Hyphenati
     const Header* header = getHeader();
     const Trie* trie = header->trieTable();
     const Pattern* pattern = header->patternTable();
-    uint32_t char_mask = trie->char_mask;
-    uint32_t link_shift = trie->link_shift;
-    uint32_t link_mask = trie->link_mask;
-    uint32_t pattern_shift = trie->pattern_shift;
-    size_t maxOffset = len - mMinSuffix - 1;
-    for (size_t i = 0; i < len - 1; i++) {
-        uint32_t node = 0;  // index into Trie table
-        for (size_t j = i; j < len; j++) {
-            uint16_t c = codes[j];
-            uint32_t entry = trie->data[node + c];
-            if ((entry & char_mask) == c) {
-                node = (entry & link_mask) >> link_shift;
-            } else {
-                break;
-            }
-            uint32_t pat_ix = trie->data[node] >> pattern_shift;
-            // pat_ix contains a 3-tuple of length, shift (number of trailing zeros), and an offset
-            // into the buf pool. This is the pattern for the substring (i..j) we just matched,
-            // which we combine (via point-wise max) into the buffer vector.
-            if (pat_ix != 0) {
-                uint32_t pat_entry = pattern->data[pat_ix];
-                int pat_len = Pattern::len(pat_entry);
-                int pat_shift = Pattern::shift(pat_entry);
-                const uint8_t* pat_buf = pattern->buf(pat_entry);
-                int offset = j + 1 - (pat_len + pat_shift);
-                // offset is the index within buffer that lines up with the start of pat_buf
-                int start = std::max((int)mMinPrefix - offset, 0);
-                int end = std::min(pat_len, (int)maxOffset - offset);
-                for (int k = start; k < end; k++) {
-                    buffer[offset + k] = std::max(buffer[offset + k], pat_buf[k]);
-                }
-            }
-        }
+    const size_t maxOffset = len - mMinSuffix - 1;
+    if (trie->version == 1) {
+        matchPatterns(*trie, trie->data16(), *pattern, codes, len, mMinPrefix, maxOffset, buffer);
+    } else {
+        matchPatterns(*trie, trie->data, *pattern, codes, len, mMinPrefix, maxOffset, buffer);
     }
     // Since the above calculation does not modify values outside
     // [mMinPrefix, len - mMinSuffix], they are left as 0 = DONT_BREAK.
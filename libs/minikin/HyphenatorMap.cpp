@@ -16,6 +16,8 @@
 
 #include "HyphenatorMap.h"
 
+#include <algorithm>
+
 #include "LocaleListCache.h"
 #include "MinikinInternal.h"
 
@@ -31,12 +33,16 @@ constexpr int DEFAULT_MIN_PREFIX = 2;
 constexpr int DEFAULT_MAX_PREFIX = 2;
 }  // namespace
 
-// Following two function's implementations are here since Hyphenator.cpp can't include
+// Following three function's implementations are here since Hyphenator.cpp can't include
 // HyphenatorMap.h due to harfbuzz dependency on the host binary.
 void addHyphenator(const std::string& localeStr, const Hyphenator* hyphenator) {
     HyphenatorMap::add(localeStr, hyphenator);
 }
 
+void addHyphenatorLoader(const std::string& localeStr, HyphenatorLoader&& loader) {
+    HyphenatorMap::addLoader(localeStr, std::move(loader));
+}
+
 void addHyphenatorAlias(const std::string& fromLocaleStr, const std::string& toLocaleStr) {
     HyphenatorMap::addAlias(fromLocaleStr, toLocaleStr);
 }
@@ -47,20 +53,43 @@ HyphenatorMap::HyphenatorMap()
 
 void HyphenatorMap::addInternal(const std::string& localeStr, const Hyphenator* hyphenator) {
     const Locale locale(localeStr);
-    std::lock_guard<std::mutex> lock(mMutex);
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
+    // Overwrite even if there is already a fallback entry.
+    mMap[locale.getIdentifier()] = {hyphenator, nullptr};
+    invalidateSnapshot();
+}
+
+void HyphenatorMap::addLoaderInternal(const std::string& localeStr, HyphenatorLoader&& loader) {
+    const Locale locale(localeStr);
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
+    mLazyHyphenators.push_back(std::make_unique<LazyHyphenator>(std::move(loader)));
     // Overwrite even if there is already a fallback entry.
-    mMap[locale.getIdentifier()] = hyphenator;
+    mMap[locale.getIdentifier()] = {nullptr, mLazyHyphenators.back().get()};
+    invalidateSnapshot();
 }
 
 void HyphenatorMap::clearInternal() {
-    std::lock_guard<std::mutex> lock(mMutex);
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
     mMap.clear();
+    // Test only, so no lookup is running on the other threads.
+    mSnapshot.clear();
+    mLazyHyphenators.clear();
+}
+
+size_t HyphenatorMap::getMemoryUsageInternal() {
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
+    // A node of std::map holds three pointers and the color besides the value.
+    size_t bytes = (4 * sizeof(void*) + sizeof(std::pair<const uint64_t, Entry>)) * mMap.size() +
+                   (sizeof(void*) + sizeof(LazyHyphenator)) * mLazyHyphenators.size();
+    mSnapshot.forEach([&bytes](const Snapshot& snapshot) { bytes += snapshot.getMemoryUsage(); });
+    return bytes;
 }
+
 void HyphenatorMap::addAliasInternal(const std::string& fromLocaleStr,
                                      const std::string& toLocaleStr) {
     const Locale fromLocale(fromLocaleStr);
     const Locale toLocale(toLocaleStr);
-    std::lock_guard<std::mutex> lock(mMutex);
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
     auto it = mMap.find(toLocale.getIdentifier());
     if (it == mMap.end()) {
         ALOGE("Target Hyphenator not found.");
@@ -68,59 +97,110 @@ void HyphenatorMap::addAliasInternal(const std::string& fromLocaleStr,
     }
     // Overwrite even if there is already a fallback entry.
     mMap[fromLocale.getIdentifier()] = it->second;
+    invalidateSnapshot();
 }
 
 const Hyphenator* HyphenatorMap::lookupInternal(const Locale& locale) {
     const uint64_t id = locale.getIdentifier();
-    std::lock_guard<std::mutex> lock(mMutex);
-    const Hyphenator* result = lookupByIdentifier(id);
-    if (result != nullptr) {
+    const Snapshot* snapshot = mSnapshot.get();
+    if (snapshot != nullptr) {
+        const Entry* entry = snapshot->find(id);
+        if (entry != nullptr) {
+            return resolve(*entry);  // Seen before, no lock needed.
+        }
+    }
+    Entry entry;
+    {
+        std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
+        entry = lookupEntry(locale);
+        // Memoize the resolution of the new locale for the lookups without the lock, unless
+        // another thread already did.
+        const Snapshot* current = mSnapshot.get();
+        if (current == nullptr || current->find(id) == nullptr) {
+            publishSnapshot();
+        }
+    }
+    return resolve(entry);
+}
+
+const Hyphenator* HyphenatorMap::resolve(const Entry& entry) {
+    if (entry.lazy == nullptr) {
+        return entry.hyphenator;
+    }
+    // Loaded outside of the lock, so that the lookups of the other locales don't wait for it.
+    const Hyphenator* result = entry.lazy->get();
+    return result != nullptr ? result : mSoftHyphenOnlyHyphenator;
+}
+
+HyphenatorMap::Entry HyphenatorMap::lookupEntry(const Locale& locale) {
+    const uint64_t id = locale.getIdentifier();
+    Entry result = lookupByIdentifier(id);
+    if (result.isFound()) {
         return result;  // Found with exact match.
     }
 
     // First, try with dropping emoji extensions.
     result = lookupBySubtag(locale, LANGUAGE | REGION | SCRIPT | VARIANT);
-    if (result != nullptr) {
+    if (result.isFound()) {
         goto insert_result_and_return;
     }
     // If not found, try with dropping script.
     result = lookupBySubtag(locale, LANGUAGE | REGION | VARIANT);
-    if (result != nullptr) {
+    if (result.isFound()) {
         goto insert_result_and_return;
     }
     // If not found, try with dropping script and region code.
     result = lookupBySubtag(locale, LANGUAGE | VARIANT);
-    if (result != nullptr) {
+    if (result.isFound()) {
         goto insert_result_and_return;
     }
     // If not found, try only with language code.
     result = lookupBySubtag(locale, LANGUAGE);
-    if (result != nullptr) {
+    if (result.isFound()) {
         goto insert_result_and_return;
     }
     // Still not found, try only with script.
     result = lookupBySubtag(locale, SCRIPT);
-    if (result != nullptr) {
+    if (result.isFound()) {
         goto insert_result_and_return;
     }
 
     // If not found, use soft hyphen only hyphenator.
-    result = mSoftHyphenOnlyHyphenator;
+    result = {mSoftHyphenOnlyHyphenator, nullptr};
 
 insert_result_and_return:
     mMap.insert(std::make_pair(id, result));
     return result;
 }
 
-const Hyphenator* HyphenatorMap::lookupByIdentifier(uint64_t id) const {
+const HyphenatorMap::Entry* HyphenatorMap::Snapshot::find(uint64_t id) const {
+    auto it = std::lower_bound(
+            entries.begin(), entries.end(), id,
+            [](const std::pair<uint64_t, Entry>& entry, uint64_t id) { return entry.first < id; });
+    return it != entries.end() && it->first == id ? &it->second : nullptr;
+}
+
+void HyphenatorMap::publishSnapshot() {
+    std::unique_ptr<Snapshot> snapshot = std::make_unique<Snapshot>();
+    // std::map is already sorted by the key.
+    snapshot->entries.assign(mMap.begin(), mMap.end());
+    mSnapshot.publish(std::move(snapshot));
+}
+
+void HyphenatorMap::invalidateSnapshot() {
+    mSnapshot.publish(nullptr);
+}
+
+HyphenatorMap::Entry HyphenatorMap::lookupByIdentifier(uint64_t id) const {
     auto it = mMap.find(id);
-    return it == mMap.end() ? nullptr : it->second;
+    return it == mMap.end() ? Entry{nullptr, nullptr} : it->second;
 }
 
-const Hyphenator* HyphenatorMap::lookupBySubtag(const Locale& locale, SubtagBits bits) const {
+HyphenatorMap::Entry HyphenatorMap::lookupBySubtag(const Locale& locale, SubtagBits bits) const {
     const Locale partialLocale = locale.getPartialLocale(bits);
     if (!partialLocale.isSupported() || partialLocale == locale) {
-        return nullptr;  // Skip the partial locale result in the same locale or not supported.
+        // Skip the partial locale result in the same locale or not supported.
+        return {nullptr, nullptr};
     }
     return lookupByIdentifier(partialLocale.getIdentifier());
 }
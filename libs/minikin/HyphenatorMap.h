@@ -17,11 +17,16 @@
 #ifndef MINIKIN_HYPHENATOR_MAP_H
 #define MINIKIN_HYPHENATOR_MAP_H
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <vector>
 
+#include "minikin/CacheStats.h"
 #include "minikin/Hyphenator.h"
 #include "minikin/Macros.h"
+#include "minikin/PublishedPtr.h"
 
 #include "Locale.h"
 
@@ -35,6 +40,13 @@ public:
         getInstance().addInternal(localeStr, hyphenator);
     }
 
+    // Registers a hyphenator which is loaded by the loader when the locale or one of its aliases
+    // or fallbacks is looked up for the first time. The loader is called at most once and may
+    // return nullptr, in which case the locale only processes soft hyphens.
+    static void addLoader(const std::string& localeStr, HyphenatorLoader&& loader) {
+        getInstance().addLoaderInternal(localeStr, std::move(loader));
+    }
+
     static void addAlias(const std::string& fromLocaleStr, const std::string& toLocaleStr) {
         getInstance().addAliasInternal(fromLocaleStr, toLocaleStr);
     }
@@ -56,14 +68,63 @@ public:
         return getInstance().lookupInternal(locale);
     }
 
+    // The contention on the lock of the registrations and the first lookups of the locales.
+    static const LockStats& getLockStats() { return getInstance().mLockStats; }
+
+    // Returns the bytes of the map and of its snapshots. The hyphenators are not owned by the map,
+    // thus not counted.
+    static size_t getMemoryUsage() { return getInstance().getMemoryUsageInternal(); }
+
 protected:
-    // The following five methods are protected for testing purposes.
+    // The following methods are protected for testing purposes.
     HyphenatorMap();  // Use getInstance() instead.
     void addInternal(const std::string& localeStr, const Hyphenator* hyphenator);
+    void addLoaderInternal(const std::string& localeStr, HyphenatorLoader&& loader);
     void addAliasInternal(const std::string& fromLocaleStr, const std::string& toLocaleStr);
     const Hyphenator* lookupInternal(const Locale& locale);
+    size_t getMemoryUsageInternal();
 
 private:
+    // A hyphenator loaded on the first lookup.
+    class LazyHyphenator {
+    public:
+        explicit LazyHyphenator(HyphenatorLoader&& loader)
+                : mLoader(std::move(loader)), mHyphenator(nullptr) {}
+
+        const Hyphenator* get() {
+            std::call_once(mOnce, [this] {
+                mHyphenator = mLoader();
+                mLoader = nullptr;
+            });
+            return mHyphenator;
+        }
+
+    private:
+        std::once_flag mOnce;
+        HyphenatorLoader mLoader;
+        const Hyphenator* mHyphenator;
+    };
+
+    // Either a loaded hyphenator or a lazy one, both null if not found.
+    struct Entry {
+        const Hyphenator* hyphenator;
+        LazyHyphenator* lazy;
+
+        bool isFound() const { return hyphenator != nullptr || lazy != nullptr; }
+    };
+
+    // An immutable copy of the map, sorted by the locale identifier, which the lookups search
+    // without taking the lock. It includes the results of the fallbacks already resolved.
+    struct Snapshot {
+        std::vector<std::pair<uint64_t, Entry>> entries;
+
+        const Entry* find(uint64_t id) const;
+
+        size_t getMemoryUsage() const {
+            return sizeof(Snapshot) + sizeof(std::pair<uint64_t, Entry>) * entries.capacity();
+        }
+    };
+
     static HyphenatorMap& getInstance() {  // Singleton.
         static HyphenatorMap map;
         return map;
@@ -71,14 +132,26 @@ private:
 
     void clearInternal();
 
-    const Hyphenator* lookupByIdentifier(uint64_t id) const EXCLUSIVE_LOCKS_REQUIRED(mMutex);
-    const Hyphenator* lookupBySubtag(const Locale& locale, SubtagBits bits) const
+    Entry lookupEntry(const Locale& locale) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    const Hyphenator* resolve(const Entry& entry);
+    void publishSnapshot() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    // Called on every change of the map. The next lookup publishes a new snapshot, so that the
+    // registrations at startup don't copy the map each.
+    void invalidateSnapshot() EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    Entry lookupByIdentifier(uint64_t id) const EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+    Entry lookupBySubtag(const Locale& locale, SubtagBits bits) const
             EXCLUSIVE_LOCKS_REQUIRED(mMutex);
 
     const Hyphenator* mSoftHyphenOnlyHyphenator;
-    std::map<uint64_t, const Hyphenator*> mMap GUARDED_BY(mMutex);
+    std::map<uint64_t, Entry> mMap GUARDED_BY(mMutex);
+    // Owns the lazy hyphenators the entries point to.
+    std::vector<std::unique_ptr<LazyHyphenator>> mLazyHyphenators GUARDED_BY(mMutex);
+    // The replaced snapshots may still be searched by other threads, so they are kept until the
+    // map is cleared. Only a new locale or registration replaces the snapshot.
+    PublishedPtr<Snapshot> mSnapshot;
 
     std::mutex mMutex;
+    LockStats mLockStats;
 };
 
 }  // namespace minikin
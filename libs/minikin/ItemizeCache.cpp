@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Minikin"
+
+#include "minikin/ItemizeCache.h"
+
+#include <memory>
+
+#include "minikin/LayoutCache.h"
+
+namespace minikin {
+
+namespace {
+
+thread_local ParagraphItemizeScope* gCurrentParagraphItemizeScope = nullptr;
+
+}  // namespace
+
+ParagraphItemizeScope::ParagraphItemizeScope(const U16StringPiece& text)
+        : mText(text), mOuter(gCurrentParagraphItemizeScope) {
+    gCurrentParagraphItemizeScope = this;
+}
+
+ParagraphItemizeScope::~ParagraphItemizeScope() {
+    gCurrentParagraphItemizeScope = mOuter;
+}
+
+// static
+ParagraphItemizeScope* ParagraphItemizeScope::getCurrent() {
+    return gCurrentParagraphItemizeScope;
+}
+
+void ParagraphItemizeScope::addStyleRun(const FontCollection* collection, const Range& range,
+                                        uint32_t localeListId, FamilyVariant familyVariant) {
+    if (range.isEmpty()) {
+        return;
+    }
+    if (mParagraphs.empty() || mParagraphs.back().collection != collection ||
+        mParagraphs.back().range.getEnd() != range.getStart()) {
+        mParagraphs.push_back({collection, Range(range.getStart(), range.getStart()), {}, {},
+                               false /* isItemized */});
+    }
+    Paragraph& paragraph = mParagraphs.back();
+    const uint32_t offset = paragraph.range.getStart();
+    paragraph.styleRanges.push_back(
+            {range.getStart() - offset, range.getEnd() - offset, localeListId, familyVariant});
+    paragraph.range = Range(offset, range.getEnd());
+}
+
+bool ParagraphItemizeScope::itemize(const FontCollection& collection, const U16StringPiece& text,
+                                    uint32_t localeListId, FamilyVariant familyVariant,
+                                    std::vector<FontCollection::Run>* outRuns) {
+    if (text.data() < mText.data() || text.data() + text.size() > mText.data() + mText.size()) {
+        return false;
+    }
+    const uint32_t start = text.data() - mText.data();
+    const Range range(start, start + text.size());
+    for (Paragraph& paragraph : mParagraphs) {
+        if (paragraph.collection != &collection || !paragraph.range.contains(range)) {
+            continue;
+        }
+        const Range localRange = range - static_cast<int32_t>(paragraph.range.getStart());
+        for (const FontCollection::StyleRange& styleRange : paragraph.styleRanges) {
+            if (styleRange.start <= localRange.getStart() &&
+                localRange.getEnd() <= styleRange.end) {
+                if (styleRange.localeListId != localeListId ||
+                    styleRange.familyVariant != familyVariant) {
+                    return false;
+                }
+                const U16StringPiece paragraphText = mText.substr(paragraph.range);
+                if (!paragraph.isItemized) {
+                    paragraph.runs = collection.itemize(paragraphText, paragraph.styleRanges);
+                    paragraph.isItemized = true;
+                }
+                return collection.sliceParagraphRuns(paragraphText, paragraph.runs, localRange,
+                                                     localeListId, familyVariant, outRuns);
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+ItemizeCache::Runs ItemizeCache::itemize(const FontCollection& collection,
+                                         const U16StringPiece& text, FontStyle style,
+                                         uint32_t localeListId, FamilyVariant familyVariant) {
+    ParagraphItemizeScope* paragraph = ParagraphItemizeScope::getCurrent();
+    if (paragraph != nullptr) {
+        Runs runs;
+        if (paragraph->itemize(collection, text, localeListId, familyVariant, &runs)) {
+            return runs;
+        }
+    }
+    if (text.size() >= LENGTH_LIMIT_CACHE) {
+        mStats.recordBypass(CacheStats::BypassReason::TooLong);
+        return collection.itemize(text, style, localeListId, familyVariant);
+    }
+    ItemizeCacheKey key(text, collection.getId(), style, localeListId, familyVariant);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Runs* runs = mCache.get(key);
+        if (runs != nullptr) {
+            mStats.recordHit();
+            return *runs;
+        }
+    }
+    // Same as BoundsCache, release the mutex during the itemization and don't care even if the
+    // same text is itemized in other thread.
+    const CacheStats::TimePoint start = CacheStats::now();
+    auto runs =
+            std::make_unique<Runs>(collection.itemize(text, style, localeListId, familyVariant));
+    mStats.recordMiss(start);
+    Runs result = *runs;
+    key.copyText();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t sizeBefore = mCache.size();
+        if (!mCache.put(key, runs.get())) {
+            // The same value has been inserted by other thread.
+            key.freeText();
+            return result;
+        }
+        mMemoryUsage += getEntryMemoryUsage(key, *runs);
+        runs.release();
+        // The LruCache evicts the oldest entry by itself when it is full.
+        mStats.recordEvictions(sizeBefore + 1 - mCache.size());
+    }
+    return result;
+}
+
+}  // namespace minikin
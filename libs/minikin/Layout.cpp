@@ -18,10 +18,14 @@
 
 #include "minikin/Layout.h"
 
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <hb-icu.h>
@@ -31,26 +35,47 @@
 #include <unicode/utf16.h>
 #include <utils/LruCache.h>
 
+#include "minikin/ApiTrace.h"
+#include "minikin/BoundsCache.h"
+#include "minikin/CachePartition.h"
+#include "minikin/CacheStats.h"
 #include "minikin/Emoji.h"
+#include "minikin/FontExtentCache.h"
+#include "minikin/GlyphBoundsCache.h"
+#include "minikin/GraphemeBreak.h"
 #include "minikin/HbUtils.h"
+#include "minikin/ItemizeCache.h"
 #include "minikin/LayoutCache.h"
 #include "minikin/LayoutPieces.h"
+#include "minikin/LayoutProfile.h"
+#include "minikin/LineLayoutCache.h"
 #include "minikin/Macros.h"
+#include "minikin/PersistentLayoutCache.h"
+#include "minikin/ReadAhead.h"
+#include "minikin/ShapingStats.h"
+#include "minikin/SystemFonts.h"
 
 #include "BidiUtils.h"
+#include "HyphenatorMap.h"
 #include "LayoutSplitter.h"
 #include "LayoutUtils.h"
 #include "LocaleListCache.h"
 #include "MinikinInternal.h"
+#include "PhraseBreakCache.h"
+#include "WordBreaker.h"
 
 namespace minikin {
 
 void Layout::doLayout(const U16StringPiece& textBuf, const Range& range, Bidi bidiFlags,
                       const MinikinPaint& paint, StartHyphenEdit startHyphen,
                       EndHyphenEdit endHyphen) {
+    ApiTrace::getInstance().recordLayout(textBuf, range, bidiFlags, paint, startHyphen, endHyphen);
+    purgeDestroyedCollections();
     const uint32_t count = range.getLength();
     mAdvances.resize(count, 0);
-    mGlyphs.reserve(count);
+    if (!mSharePieces) {
+        mGlyphs.reserve(count);
+    }
     for (const BidiText::RunInfo& runInfo : BidiText(textBuf, range, bidiFlags)) {
         doLayoutRunCached(textBuf, runInfo.range, runInfo.isRtl, paint, range.getStart(),
                           startHyphen, endHyphen, this, nullptr);
@@ -60,6 +85,9 @@ void Layout::doLayout(const U16StringPiece& textBuf, const Range& range, Bidi bi
 float Layout::measureText(const U16StringPiece& textBuf, const Range& range, Bidi bidiFlags,
                           const MinikinPaint& paint, StartHyphenEdit startHyphen,
                           EndHyphenEdit endHyphen, float* advances) {
+    ApiTrace::getInstance().recordMeasureText(textBuf, range, bidiFlags, paint, startHyphen,
+                                              endHyphen);
+    purgeDestroyedCollections();
     float advance = 0;
     for (const BidiText::RunInfo& runInfo : BidiText(textBuf, range, bidiFlags)) {
         const size_t offset = range.toRangeOffset(runInfo.range.getStart());
@@ -70,88 +98,237 @@ float Layout::measureText(const U16StringPiece& textBuf, const Range& range, Bid
     return advance;
 }
 
-float Layout::doLayoutRunCached(const U16StringPiece& textBuf, const Range& range, bool isRtl,
-                                const MinikinPaint& paint, size_t dstStart,
-                                StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
-                                Layout* layout, float* advances) {
-    if (!range.isValid()) {
-        return 0.0f;  // ICU failed to retrieve the bidi run?
+std::vector<float> Layout::measureTexts(const U16StringPiece& textBuf,
+                                        const std::vector<Range>& ranges, Bidi bidiFlags,
+                                        const MinikinPaint& paint) {
+    purgeDestroyedCollections();
+    // The bidi runs of all the texts in order, and the words of the runs of each direction.
+    std::vector<float> runAdvances;
+    std::vector<uint32_t> runEnds;  // The end of the runs of each text in runAdvances.
+    std::vector<LayoutCache::BatchEntry> words[2];
+    std::vector<Range> pieces[2];
+    std::vector<uint32_t> wordRuns[2];
+    LayoutProfile& profile = LayoutProfile::getInstance();
+    for (const Range& range : ranges) {
+        for (const BidiText::RunInfo& runInfo : BidiText(textBuf, range, bidiFlags)) {
+            if (!runInfo.range.isValid()) {
+                continue;
+            }
+            const int dir = runInfo.isRtl ? 1 : 0;
+            for (const auto[context, piece] :
+                 LayoutSplitter(textBuf, runInfo.range, runInfo.isRtl)) {
+                words[dir].push_back({textBuf.substr(context), piece - context.getStart(),
+                                      StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT});
+                profile.record(textBuf.substr(context), piece - context.getStart(), paint,
+                               runInfo.isRtl, StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT,
+                               false /* need bounds */);
+                pieces[dir].push_back(piece);
+                wordRuns[dir].push_back(runAdvances.size());
+            }
+            runAdvances.push_back(0.0f);
+        }
+        runEnds.push_back(runAdvances.size());
     }
-    float advance = 0;
-    for (const auto[context, piece] : LayoutSplitter(textBuf, range, isRtl)) {
-        // Hyphenation only applies to the start/end of run.
-        const StartHyphenEdit pieceStartHyphen =
-                (piece.getStart() == range.getStart()) ? startHyphen : StartHyphenEdit::NO_EDIT;
-        const EndHyphenEdit pieceEndHyphen =
-                (piece.getEnd() == range.getEnd()) ? endHyphen : EndHyphenEdit::NO_EDIT;
-        float* advancesForRun =
-                advances ? advances + (piece.getStart() - range.getStart()) : nullptr;
-        advance += doLayoutWord(textBuf.data() + context.getStart(),
-                                piece.getStart() - context.getStart(), piece.getLength(),
-                                context.getLength(), isRtl, paint, piece.getStart() - dstStart,
-                                pieceStartHyphen, pieceEndHyphen, layout, advancesForRun);
+    for (int dir = 0; dir < 2; ++dir) {
+        if (words[dir].empty()) {
+            continue;
+        }
+        auto f = [&](size_t index, const LayoutPiece& layout, const MinikinPaint& layoutPaint) {
+            const Range& piece = pieces[dir][index];
+            const float wordSpacing =
+                    piece.getLength() == 1 && isWordSpace(textBuf[piece.getStart()])
+                            ? layoutPaint.wordSpacing
+                            : 0;
+            runAdvances[wordRuns[dir][index]] += layout.advance() + wordSpacing;
+        };
+        LayoutCache::getInstance().getOrCreateBatch(words[dir], paint, dir == 1, f,
+                                                    false /* need glyphs */);
     }
-    return advance;
+    // Sum up the runs in the same order as measureText().
+    std::vector<float> widths(ranges.size(), 0.0f);
+    uint32_t run = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        for (; run < runEnds[i]; ++run) {
+            widths[i] += runAdvances[run];
+        }
+    }
+    return widths;
 }
 
+size_t Layout::fitPrefix(const U16StringPiece& textBuf, const Range& range, Bidi bidiFlags,
+                         const MinikinPaint& paint, float maxWidth, float* outWidth) {
+    purgeDestroyedCollections();
+    std::vector<BidiText::RunInfo> runs;
+    for (const BidiText::RunInfo& runInfo : BidiText(textBuf, range, bidiFlags)) {
+        if (runInfo.range.isValid()) {
+            runs.push_back(runInfo);
+        }
+    }
+    // The runs are in the visual order, but the prefix is in the logical order.
+    std::sort(runs.begin(), runs.end(), [](const auto& l, const auto& r) {
+        return l.range.getStart() < r.range.getStart();
+    });
+    float width = 0;
+    std::vector<float> advances;
+    for (const BidiText::RunInfo& run : runs) {
+        // The splitter walks the words in the logical order if not RTL. The direction of the
+        // layouts is given to the cache.
+        for (const auto[context, piece] : LayoutSplitter(textBuf, run.range, false /* LTR */)) {
+            const bool isSpace = piece.getLength() == 1 && isWordSpace(textBuf[piece.getStart()]);
+            float pieceAdvance = 0;
+            auto f = [&](const LayoutPiece& layout, const MinikinPaint& layoutPaint) {
+                const float wordSpacing = isSpace ? layoutPaint.wordSpacing : 0;
+                const ArrayView<float> pieceAdvances = layout.advances();
+                advances.assign(pieceAdvances.begin(), pieceAdvances.end());
+                if (!advances.empty()) {
+                    advances[0] += wordSpacing;
+                }
+                pieceAdvance = layout.advance() + wordSpacing;
+            };
+            LayoutCache::getInstance().getOrCreate(textBuf.substr(context),
+                                                   piece - context.getStart(), paint, run.isRtl,
+                                                   StartHyphenEdit::NO_EDIT,
+                                                   EndHyphenEdit::NO_EDIT, f);
+            if (width + pieceAdvance <= maxWidth) {
+                width += pieceAdvance;
+                continue;
+            }
+            // Find the last grapheme boundary in the word where the prefix still fits.
+            size_t end = piece.getStart();
+            float prefixWidth = width;
+            for (size_t i = piece.getStart() + 1; i <= piece.getEnd(); ++i) {
+                prefixWidth += advances[i - 1 - piece.getStart()];
+                if (prefixWidth > maxWidth) {
+                    break;
+                }
+                if (GraphemeBreak::isGraphemeBreak(nullptr, textBuf.data(), range.getStart(),
+                                                   range.getLength(), i)) {
+                    end = i;
+                    width = prefixWidth;
+                }
+            }
+            if (outWidth != nullptr) {
+                *outWidth = width;
+            }
+            return end;
+        }
+    }
+    if (outWidth != nullptr) {
+        *outWidth = width;
+    }
+    return range.getEnd();
+}
+
+// Appends the words of a run looked up by LayoutCache::getOrCreateBatch().
 class LayoutAppendFunctor {
 public:
-    LayoutAppendFunctor(Layout* layout, float* advances, float* totalAdvance, uint32_t outOffset,
-                        float wordSpacing)
-            : mLayout(layout),
+    LayoutAppendFunctor(const U16StringPiece& textBuf, const Range& range,
+                        const std::vector<Range>& pieces, size_t dstStart, Layout* layout,
+                        float* advances)
+            : mTextBuf(textBuf),
+              mRange(range),
+              mPieces(pieces),
+              mDstStart(dstStart),
+              mLayout(layout),
               mAdvances(advances),
-              mTotalAdvance(totalAdvance),
-              mOutOffset(outOffset),
-              mWordSpacing(wordSpacing) {}
+              mTotalAdvance(0) {}
 
-    void operator()(const LayoutPiece& layoutPiece, const MinikinPaint& /* paint */) {
+    void operator()(size_t index, const std::shared_ptr<const LayoutPiece>& layoutPtr,
+                    const MinikinPaint& paint) {
+        const LayoutPiece& layoutPiece = *layoutPtr;
+        const Range& piece = mPieces[index];
+        const float wordSpacing =
+                piece.getLength() == 1 && isWordSpace(mTextBuf[piece.getStart()])
+                        ? paint.wordSpacing
+                        : 0;
         if (mLayout) {
-            mLayout->appendLayout(layoutPiece, mOutOffset, mWordSpacing);
+            mLayout->appendLayout(layoutPtr, piece.getStart() - mDstStart, wordSpacing);
         }
         if (mAdvances) {
-            const std::vector<float>& advances = layoutPiece.advances();
-            std::copy(advances.begin(), advances.end(), mAdvances);
-        }
-        if (mTotalAdvance) {
-            *mTotalAdvance = layoutPiece.advance();
+            float* advances = mAdvances + (piece.getStart() - mRange.getStart());
+            const ArrayView<float> pieceAdvances = layoutPiece.advances();
+            std::copy(pieceAdvances.begin(), pieceAdvances.end(), advances);
+            if (wordSpacing != 0) {
+                advances[0] += wordSpacing;
+            }
         }
+        mTotalAdvance += layoutPiece.advance() + wordSpacing;
     }
 
+    float getTotalAdvance() const { return mTotalAdvance; }
+
 private:
+    const U16StringPiece& mTextBuf;
+    const Range mRange;
+    const std::vector<Range>& mPieces;
+    const size_t mDstStart;
     Layout* mLayout;
     float* mAdvances;
-    float* mTotalAdvance;
-    const uint32_t mOutOffset;
-    const float mWordSpacing;
+    float mTotalAdvance;
 };
 
-float Layout::doLayoutWord(const uint16_t* buf, size_t start, size_t count, size_t bufSize,
-                           bool isRtl, const MinikinPaint& paint, size_t bufStart,
-                           StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, Layout* layout,
-                           float* advances) {
-    float wordSpacing = count == 1 && isWordSpace(buf[start]) ? paint.wordSpacing : 0;
-    float totalAdvance = 0;
-
-    const U16StringPiece textBuf(buf, bufSize);
-    const Range range(start, start + count);
-    LayoutAppendFunctor f(layout, advances, &totalAdvance, bufStart, wordSpacing);
-    LayoutCache::getInstance().getOrCreate(textBuf, range, paint, isRtl, startHyphen, endHyphen, f);
-
-    if (wordSpacing != 0) {
-        totalAdvance += wordSpacing;
-        if (advances) {
-            advances[0] += wordSpacing;
-        }
+float Layout::doLayoutRunCached(const U16StringPiece& textBuf, const Range& range, bool isRtl,
+                                const MinikinPaint& paint, size_t dstStart,
+                                StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
+                                Layout* layout, float* advances) {
+    if (!range.isValid()) {
+        return 0.0f;  // ICU failed to retrieve the bidi run?
+    }
+    std::vector<LayoutCache::BatchEntry> words;
+    std::vector<Range> pieces;
+    LayoutProfile& profile = LayoutProfile::getInstance();
+    for (const auto[context, piece] : LayoutSplitter(textBuf, range, isRtl)) {
+        // Hyphenation only applies to the start/end of run.
+        const StartHyphenEdit pieceStartHyphen =
+                (piece.getStart() == range.getStart()) ? startHyphen : StartHyphenEdit::NO_EDIT;
+        const EndHyphenEdit pieceEndHyphen =
+                (piece.getEnd() == range.getEnd()) ? endHyphen : EndHyphenEdit::NO_EDIT;
+        words.push_back({textBuf.substr(context), piece - context.getStart(), pieceStartHyphen,
+                         pieceEndHyphen});
+        profile.record(textBuf.substr(context), piece - context.getStart(), paint, isRtl,
+                       pieceStartHyphen, pieceEndHyphen, false /* need bounds */);
+        pieces.push_back(piece);
+    }
+    // Look up all the words of the run at once to amortize the cache locking.
+    LayoutAppendFunctor f(textBuf, range, pieces, dstStart, layout, advances);
+    // Measurement only needs the advances.
+    LayoutCache::getInstance().getOrCreateBatch(words, paint, isRtl, f,
+                                                layout != nullptr /* need glyphs */);
+    return f.getTotalAdvance();
+}
+
+void Layout::appendLayout(const std::shared_ptr<const LayoutPiece>& src, size_t start,
+                          float extraAdvance) {
+    if (!mSharePieces) {
+        appendLayout(*src, start, extraAdvance);
+        return;
+    }
+    mExtent.extendBy(src->extent());
+    if (src->glyphCount() != 0) {
+        mSharedPieces.push_back({src, mAdvance, mSharedGlyphCount});
+        mSharedGlyphCount += src->glyphCount();
+    }
+    const ArrayView<float> advances = src->advances();
+    for (size_t i = 0; i < advances.size(); i++) {
+        mAdvances[i + start] = advances[i];
+    }
+    if (!advances.empty()) {
+        mAdvances[start] += extraAdvance;
     }
-    return totalAdvance;
+    mAdvance += src->advance() + extraAdvance;
 }
 
 void Layout::appendLayout(const LayoutPiece& src, size_t start, float extraAdvance) {
+    if (mSharePieces) {
+        appendLayout(std::make_shared<const LayoutPiece>(src), start, extraAdvance);
+        return;
+    }
+    mExtent.extendBy(src.extent());
     for (size_t i = 0; i < src.glyphCount(); i++) {
-        mGlyphs.emplace_back(src.fontAt(i), src.glyphIdAt(i), mAdvance + src.pointAt(i).x,
-                             src.pointAt(i).y);
+        const Point point = src.pointAt(i);
+        mGlyphs.emplace_back(src.fontAt(i), src.glyphIdAt(i), mAdvance + point.x, point.y);
     }
-    const std::vector<float>& advances = src.advances();
+    const ArrayView<float> advances = src.advances();
     for (size_t i = 0; i < advances.size(); i++) {
         mAdvances[i + start] = advances[i];
         if (i == 0) {
@@ -161,8 +338,105 @@ void Layout::appendLayout(const LayoutPiece& src, size_t start, float extraAdvan
     mAdvance += src.advance() + extraAdvance;
 }
 
+void Layout::getGlyphRuns(GlyphRuns* out) const {
+    out->clear();
+    out->mGlyphIds.reserve(nGlyphs());
+    out->mPositions.reserve(nGlyphs());
+    forEachGlyph([out](const FakedFont& font, uint32_t glyphId, float x, float y) {
+        if (out->mFonts.empty() || out->mFonts.back() != font) {
+            out->mFonts.push_back(font);
+            out->mRunStarts.push_back(out->mGlyphIds.size());
+        }
+        out->mGlyphIds.push_back(glyphId);
+        out->mPositions.emplace_back(x, y);
+    });
+}
+
+MinikinRect Layout::getBounds(const MinikinPaint& paint) const {
+    MinikinRect bounds;
+    if (mSharePieces) {
+        for (const SharedPiece& piece : mSharedPieces) {
+            MinikinRect pieceBounds = piece.layout->getOrCalculateBounds(paint);
+            pieceBounds.offset(piece.x, 0);
+            bounds.join(pieceBounds);
+        }
+        return bounds;
+    }
+    Font::ExternalRefsGuard externalRefsGuard;
+    for (const LayoutGlyph& glyph : mGlyphs) {
+        MinikinRect glyphBounds;
+        glyph.font.font->typeface()->GetBounds(&glyphBounds, glyph.glyph_id, paint,
+                                               glyph.font.fakery);
+        glyphBounds.offset(glyph.x, glyph.y);
+        bounds.join(glyphBounds);
+    }
+    return bounds;
+}
+
 void Layout::purgeCaches() {
-    LayoutCache::getInstance().clear();
+    LineLayoutCache::getInstance().clear();
+    for (CachePartition partition : kCachePartitions) {
+        LayoutCache::getInstance(partition).clear();
+        BoundsCache::getInstance(partition).clear();
+    }
+    ItemizeCache::getInstance().clear();
+    GlyphBoundsCache::getInstance().clear();
+    FontExtentCache::getInstance().clear();
+    PhraseBreakCache::getInstance().clear();
+}
+
+void Layout::purgeCaches(uint32_t fontCollectionId) {
+    purgeCollections({fontCollectionId});
+}
+
+void Layout::purgeCollections(const std::vector<uint32_t>& fontCollectionIds) {
+    const std::unordered_set<uint32_t> ids(fontCollectionIds.begin(), fontCollectionIds.end());
+    LineLayoutCache::getInstance().removeCollections(ids);
+    for (CachePartition partition : kCachePartitions) {
+        LayoutCache::getInstance(partition).removeCollections(ids);
+        BoundsCache::getInstance(partition).removeCollections(ids);
+    }
+    ItemizeCache::getInstance().removeCollections(ids);
+}
+
+void Layout::dumpMinikinStats(int fd) {
+    LayoutCache& layoutCache = LayoutCache::getInstance(CachePartition::Interactive);
+    BoundsCache& boundsCache = BoundsCache::getInstance(CachePartition::Interactive);
+    LayoutCache& bulkLayoutCache = LayoutCache::getInstance(CachePartition::Bulk);
+    BoundsCache& bulkBoundsCache = BoundsCache::getInstance(CachePartition::Bulk);
+    dprintf(fd, "Minikin stats:\n");
+    layoutCache.getStats().dump(fd, "LayoutCache", layoutCache.getMemoryUsage());
+    dprintf(fd, "    deduplicated misses: %" PRIu64 "\n", layoutCache.getDeduplicatedMissCount());
+    layoutCache.getSegmentCacheStats().dump(fd, "LayoutSegmentCache",
+                                            layoutCache.getSegmentCacheMemoryUsage());
+    bulkLayoutCache.getStats().dump(fd, "LayoutCache (bulk)", bulkLayoutCache.getMemoryUsage());
+    // The persistent cache is backed by its file, which is not counted as memory.
+    PersistentLayoutCache::getInstance().getStats().dump(fd, "PersistentLayoutCache",
+                                                         CacheStats::kUnknownMemoryUsage);
+    LineLayoutCache& lineLayoutCache = LineLayoutCache::getInstance();
+    lineLayoutCache.getStats().dump(fd, "LineLayoutCache", lineLayoutCache.getMemoryUsage());
+    boundsCache.getStats().dump(fd, "BoundsCache", boundsCache.getMemoryUsage());
+    bulkBoundsCache.getStats().dump(fd, "BoundsCache (bulk)", bulkBoundsCache.getMemoryUsage());
+    GlyphBoundsCache& glyphBoundsCache = GlyphBoundsCache::getInstance();
+    glyphBoundsCache.getStats().dump(fd, "GlyphBoundsCache", glyphBoundsCache.getMemoryUsage());
+    FontExtentCache& fontExtentCache = FontExtentCache::getInstance();
+    fontExtentCache.getStats().dump(fd, "FontExtentCache", fontExtentCache.getMemoryUsage());
+    ItemizeCache& itemizeCache = ItemizeCache::getInstance();
+    itemizeCache.getStats().dump(fd, "ItemizeCache", itemizeCache.getMemoryUsage());
+    PhraseBreakCache& phraseBreakCache = PhraseBreakCache::getInstance();
+    phraseBreakCache.getStats().dump(fd, "PhraseBreakCache", phraseBreakCache.getMemoryUsage());
+    // LayoutPieces are owned by each MeasuredText, so there is no global footprint to report.
+    LayoutPieces::getStats().dump(fd, "LayoutPieces", CacheStats::kUnknownMemoryUsage);
+    dprintf(fd, "  LocaleListCache:\n");
+    LocaleListCache::getLockStats().dump(fd);
+    dprintf(fd, "  ICULineBreakerPool:\n");
+    ICULineBreakerPoolImpl::getInstance().getLockStats().dump(fd);
+    dprintf(fd, "  HyphenatorMap:\n");
+    HyphenatorMap::getLockStats().dump(fd);
+    dprintf(fd, "  SystemFonts:\n");
+    SystemFonts::getLockStats().dump(fd);
+    ShapingStats::getInstance().dump(fd);
+    ReadAhead::dump(fd);
 }
 
 }  // namespace minikin
@@ -0,0 +1,550 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/LayoutCache.h"
+
+#include <thread>
+
+#include "minikin/PersistentLayoutCache.h"
+
+#include "MinikinTrace.h"
+#include "WorkerPool.h"
+
+namespace minikin {
+
+struct ReadMostlyLayoutTable::Node {
+    Node(const LayoutCacheKey& key, const std::shared_ptr<const LayoutPiece>& layout, uint32_t slot)
+            : key(key),
+              layout(layout),
+              next(nullptr),
+              referenced(false),
+              slot(slot),
+              memoryUsage(key.getMemoryUsage() + this->layout->getMemoryUsage()) {}
+    ~Node() { key.freeText(); }
+
+    LayoutCacheKey key;
+    const std::shared_ptr<const LayoutPiece> layout;
+    std::atomic<Node*> next;
+    // Set by readers on hit, cleared by the clock hand.
+    std::atomic<bool> referenced;
+    const uint32_t slot;
+    const size_t memoryUsage;
+};
+
+namespace {
+
+uint32_t getBucketMask(uint32_t maxEntries) {
+    uint32_t bucketCount = 1;
+    while (bucketCount < maxEntries) {
+        bucketCount <<= 1;
+    }
+    return bucketCount - 1;
+}
+
+uint32_t getReaderStripe(uint32_t stripeCount) {
+    static std::atomic<uint32_t> nextStripe(0);
+    thread_local uint32_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed);
+    return stripe % stripeCount;
+}
+
+}  // namespace
+
+// static
+std::shared_ptr<const LayoutPiece> LayoutCache::shapeLayout(const U16StringPiece& text,
+                                                            const Range& range,
+                                                            const MinikinPaint& paint, bool dir,
+                                                            StartHyphenEdit startHyphen,
+                                                            EndHyphenEdit endHyphen,
+                                                            bool advancesOnly) {
+    MINIKIN_TRACE_NAME("LayoutCache::shapeLayout");
+    PersistentLayoutCache& persistentCache = PersistentLayoutCache::getInstance();
+    if (persistentCache.isEnabled()) {
+        return persistentCache.getOrCreate(text, range, paint, dir, startHyphen, endHyphen,
+                                           advancesOnly);
+    }
+    return std::make_shared<LayoutPiece>(text, range, dir, paint, startHyphen, endHyphen,
+                                         nullptr /* cluster info */, advancesOnly);
+}
+
+void LayoutCache::createLayouts(const std::vector<BatchEntry>& entries,
+                                const std::vector<LayoutCacheKey>& keys,
+                                const std::vector<bool>& missed, const MinikinPaint& paint,
+                                bool dir, bool advancesOnly,
+                                std::vector<std::shared_ptr<const LayoutPiece>>* created) {
+    std::vector<size_t> indices;
+    std::unordered_map<LayoutCacheKey, size_t, KeyHasher> firstMisses;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (missed[i] && firstMisses.emplace(keys[i], i).second) {
+            indices.push_back(i);
+        }
+    }
+    if (indices.size() >= kMinParallelShapingCount &&
+        mParallelShaping.load(std::memory_order_relaxed)) {
+        // Every task writes to its own element, so no synchronization is needed on the results.
+        WorkerPool::getInstance().parallelFor(indices.size(), [&](size_t i) {
+            const size_t index = indices[i];
+            (*created)[index] = createLayout(entries[index], paint, dir, advancesOnly);
+        });
+        return;
+    }
+    for (size_t index : indices) {
+        (*created)[index] = createLayout(entries[index], paint, dir, advancesOnly);
+    }
+}
+
+ReadMostlyLayoutTable::ReadGuard::ReadGuard(const ReadMostlyLayoutTable& table) : mTable(table) {
+    const uint32_t stripe = getReaderStripe(kReaderStripes);
+    for (;;) {
+        const uint64_t epoch = mTable.mEpoch.load();
+        mCounter = &mTable.mReaders[epoch & 1][stripe].count;
+        mCounter->fetch_add(1);
+        // If a writer advanced the epoch in the meantime, it may not be waiting for this counter.
+        // Retry with the new epoch.
+        if (mTable.mEpoch.load() == epoch) {
+            break;
+        }
+        mCounter->fetch_sub(1);
+    }
+}
+
+ReadMostlyLayoutTable::ReadGuard::~ReadGuard() {
+    mCounter->fetch_sub(1);
+}
+
+ReadMostlyLayoutTable::ReadMostlyLayoutTable(uint32_t maxEntries, CacheStats& stats)
+        : mEpoch(0),
+          mMaxEntries(std::max(1u, maxEntries)),
+          mBucketMask(getBucketMask(mMaxEntries)),
+          mBuckets(new std::atomic<Node*>[mBucketMask + 1]),
+          mClock(mMaxEntries, nullptr),
+          mClockHand(0),
+          mMemoryUsage(0),
+          mMemoryBudget(0),
+          mStats(stats) {
+    for (uint32_t i = 0; i <= mBucketMask; ++i) {
+        mBuckets[i].store(nullptr, std::memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < 2; ++i) {
+        for (uint32_t j = 0; j < kReaderStripes; ++j) {
+            mReaders[i][j].count.store(0, std::memory_order_relaxed);
+        }
+    }
+    mFreeSlots.reserve(mMaxEntries);
+    for (uint32_t i = mMaxEntries; i > 0; --i) {
+        mFreeSlots.push_back(i - 1);
+    }
+}
+
+ReadMostlyLayoutTable::~ReadMostlyLayoutTable() {
+    // No readers can exist at this point.
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (Node* node : mClock) {
+        delete node;
+    }
+    for (Node* node : mRetired) {
+        delete node;
+    }
+}
+
+const std::shared_ptr<const LayoutPiece>* ReadMostlyLayoutTable::find(
+        const LayoutCacheKey& key) const {
+    const uint32_t hash = static_cast<uint32_t>(key.hash());
+    for (Node* node = mBuckets[hash & mBucketMask].load(std::memory_order_acquire);
+         node != nullptr; node = node->next.load(std::memory_order_acquire)) {
+        if (node->key == key) {
+            // Avoid dirtying the cache line if the bit is already set.
+            if (!node->referenced.load(std::memory_order_relaxed)) {
+                node->referenced.store(true, std::memory_order_relaxed);
+            }
+            return &node->layout;
+        }
+    }
+    return nullptr;
+}
+
+void ReadMostlyLayoutTable::insert(LayoutCacheKey& key,
+                                   const std::shared_ptr<const LayoutPiece>& layout) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::atomic<Node*>& head = mBuckets[static_cast<uint32_t>(key.hash()) & mBucketMask];
+    for (Node* node = head.load(std::memory_order_relaxed); node != nullptr;
+         node = node->next.load(std::memory_order_relaxed)) {
+        if (node->key == key) {
+            if (!node->layout->isAdvancesOnly() || layout->isAdvancesOnly()) {
+                // The same layout has been inserted by other thread.
+                key.freeText();
+                return;
+            }
+            // Replace the advances only layout with the full one.
+            evictLocked(node->slot);
+            break;
+        }
+    }
+    if (mFreeSlots.empty()) {
+        evictOneLocked();
+    }
+    const uint32_t slot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+
+    Node* node = new Node(key, layout, slot);
+    node->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // Publish the fully constructed node.
+    head.store(node, std::memory_order_release);
+    mClock[slot] = node;
+    mMemoryUsage += node->memoryUsage;
+
+    if (mMemoryBudget != 0) {
+        trimLocked(mMemoryBudget);
+    }
+    if (mRetired.size() >= kRetireBatchSize) {
+        synchronizeLocked();
+    }
+}
+
+void ReadMostlyLayoutTable::evictLocked(uint32_t slot) {
+    Node* node = mClock[slot];
+    std::atomic<Node*>* link = &mBuckets[static_cast<uint32_t>(node->key.hash()) & mBucketMask];
+    while (link->load(std::memory_order_relaxed) != node) {
+        link = &link->load(std::memory_order_relaxed)->next;
+    }
+    // Readers standing on the node can still follow its next pointer, which is left intact.
+    link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+
+    mClock[slot] = nullptr;
+    mFreeSlots.push_back(slot);
+    mMemoryUsage -= node->memoryUsage;
+    mRetired.push_back(node);
+}
+
+bool ReadMostlyLayoutTable::evictOneLocked() {
+    if (mFreeSlots.size() == mMaxEntries) {
+        return false;
+    }
+    // Every referenced node gets a second chance, so at most two turns are needed.
+    for (;;) {
+        const uint32_t slot = mClockHand;
+        mClockHand = (mClockHand + 1) % mMaxEntries;
+        Node* node = mClock[slot];
+        if (node == nullptr) {
+            continue;
+        }
+        if (node->referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+        evictLocked(slot);
+        mStats.recordEvictions(1);
+        return true;
+    }
+}
+
+void ReadMostlyLayoutTable::trimLocked(size_t bytes) {
+    while (mMemoryUsage > bytes && evictOneLocked()) {
+    }
+}
+
+void ReadMostlyLayoutTable::synchronizeLocked() {
+    if (mRetired.empty()) {
+        return;
+    }
+    // New readers enter the next epoch and can no longer reach the retired nodes since they have
+    // been unlinked before this point. Wait for the readers of the previous epoch to leave.
+    const uint64_t epoch = mEpoch.fetch_add(1);
+    for (ReaderCounter& counter : mReaders[epoch & 1]) {
+        while (counter.count.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+    for (Node* node : mRetired) {
+        delete node;
+    }
+    mRetired.clear();
+}
+
+void ReadMostlyLayoutTable::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (uint32_t slot = 0; slot < mMaxEntries; ++slot) {
+        if (mClock[slot] != nullptr) {
+            evictLocked(slot);
+        }
+    }
+    synchronizeLocked();
+}
+
+void ReadMostlyLayoutTable::setMemoryBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMemoryBudget = bytes;
+    if (mMemoryBudget != 0) {
+        trimLocked(mMemoryBudget);
+    }
+    synchronizeLocked();
+}
+
+void ReadMostlyLayoutTable::trim(uint32_t percent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (percent < 100) {
+        trimLocked(mMemoryUsage * percent / 100);
+    }
+    synchronizeLocked();
+}
+
+void ReadMostlyLayoutTable::removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (uint32_t slot = 0; slot < mMaxEntries; ++slot) {
+        const Node* node = mClock[slot];
+        if (node != nullptr && collectionIds.count(node->key.getCollectionId()) != 0) {
+            evictLocked(slot);
+        }
+    }
+    synchronizeLocked();
+}
+
+uint32_t ReadMostlyLayoutTable::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMaxEntries - mFreeSlots.size();
+}
+
+size_t ReadMostlyLayoutTable::getMemoryUsage() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMemoryUsage;
+}
+
+// An entry of LayoutSegmentCache. Either a segment layout or the split points of a long run.
+struct LayoutSegment {
+    LayoutSegment(std::shared_ptr<const LayoutPiece>&& piece) : piece(std::move(piece)) {}
+    LayoutSegment(std::vector<uint32_t>&& breaks) : breaks(std::move(breaks)) {}
+
+    size_t getMemoryUsage() const {
+        return sizeof(LayoutSegment) + (piece ? piece->getMemoryUsage() : 0) +
+               sizeof(uint32_t) * breaks.size();
+    }
+
+    // Shared with the callers, so that an eviction doesn't invalidate the layouts being used.
+    const std::shared_ptr<const LayoutPiece> piece;
+    // The split points relative to the start of the run, including 0 and the run length.
+    const std::vector<uint32_t> breaks;
+};
+
+namespace {
+
+// Chooses the split points from the safe breaks so that each segment is as long as possible but
+// not longer than kMaxSegmentLength, unless there is no safe break in the segment.
+std::vector<uint32_t> chooseSegmentBreaks(const std::vector<uint32_t>& safeBreaks,
+                                          uint32_t length, uint32_t maxSegmentLength) {
+    std::vector<uint32_t> breaks = {0};
+    uint32_t last = 0;
+    uint32_t candidate = 0;
+    for (uint32_t safeBreak : safeBreaks) {
+        if (safeBreak <= last || safeBreak >= length) {
+            continue;
+        }
+        if (safeBreak - last > maxSegmentLength && candidate > last) {
+            breaks.push_back(candidate);
+            last = candidate;
+        }
+        if (safeBreak - last > maxSegmentLength) {
+            breaks.push_back(safeBreak);
+            last = safeBreak;
+        }
+        candidate = safeBreak;
+    }
+    if (length - last > maxSegmentLength && candidate > last) {
+        breaks.push_back(candidate);
+    }
+    breaks.push_back(length);
+    return breaks;
+}
+
+// Describes the text a segment is shaped with. The first and the last segments keep the context of
+// the run since it may affect their shaping.
+struct SegmentText {
+    SegmentText(const U16StringPiece& text, const Range& range, const std::vector<uint32_t>& breaks,
+                size_t index, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen) {
+        const bool isFirst = index == 0;
+        const bool isLast = index + 2 == breaks.size();
+        const Range segment(range.getStart() + breaks[index], range.getStart() + breaks[index + 1]);
+        const uint32_t textStart = isFirst ? 0 : segment.getStart();
+        const uint32_t textEnd = isLast ? text.size() : segment.getEnd();
+        this->text = text.substr(Range(textStart, textEnd));
+        this->range = segment - textStart;
+        this->startHyphen = isFirst ? startHyphen : StartHyphenEdit::NO_EDIT;
+        this->endHyphen = isLast ? endHyphen : EndHyphenEdit::NO_EDIT;
+    }
+
+    U16StringPiece text;
+    Range range;
+    StartHyphenEdit startHyphen;
+    EndHyphenEdit endHyphen;
+};
+
+}  // namespace
+
+LayoutSegmentCache::LayoutSegmentCache()
+        : mEnabled(false),
+          mCache(android::LruCache<LayoutCacheKey, LayoutSegment*>::kUnlimitedCapacity),
+          mMemoryBudget(0),
+          mMemoryUsage(0) {
+    mCache.setOnEntryRemovedListener(this);
+}
+
+LayoutSegmentCache::~LayoutSegmentCache() {
+    clear();
+}
+
+void LayoutSegmentCache::setMemoryBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMemoryBudget = bytes;
+    mEnabled.store(bytes != 0, std::memory_order_relaxed);
+    if (bytes == 0) {
+        mCache.clear();
+    } else {
+        trimLocked(bytes);
+    }
+}
+
+std::shared_ptr<const LayoutPiece> LayoutSegmentCache::getOrCreate(
+        const U16StringPiece& text, const Range& range, const MinikinPaint& paint, bool dir,
+        StartHyphenEdit startHyphen, EndHyphenEdit endHyphen) {
+    LayoutCacheKey runKey(text, range, paint, dir, startHyphen, endHyphen);
+    std::vector<uint32_t> breaks;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        LayoutSegment* run = mCache.get(runKey);
+        if (run != nullptr) {
+            mStats.recordHit();
+            if (run->piece) {
+                // The run has no safe break and is stored as a single segment.
+                return run->piece;
+            }
+            breaks = run->breaks;
+        }
+    }
+    if (!breaks.empty()) {
+        std::vector<std::shared_ptr<const LayoutPiece>> segments;
+        std::vector<const LayoutPiece*> pieces;
+        segments.reserve(breaks.size() - 1);
+        pieces.reserve(breaks.size() - 1);
+        for (size_t i = 0; i + 1 < breaks.size(); ++i) {
+            segments.push_back(getOrCreateSegment(text, range, breaks, i, paint, dir, startHyphen,
+                                                  endHyphen));
+            pieces.push_back(segments.back().get());
+        }
+        return std::make_shared<LayoutPiece>(pieces, dir);
+    }
+
+    LayoutPiece::ClusterInfo clusterInfo;
+    const CacheStats::TimePoint shapingStart = CacheStats::now();
+    std::shared_ptr<const LayoutPiece> layout = std::make_shared<LayoutPiece>(
+            text, range, dir, paint, startHyphen, endHyphen, &clusterInfo);
+    mStats.recordMiss(shapingStart);
+    if (!isEnabled()) {
+        return layout;
+    }
+    breaks = chooseSegmentBreaks(clusterInfo.safeBreaks, range.getLength(), kMaxSegmentLength);
+    if (breaks.size() == 2) {
+        put(runKey, new LayoutSegment(std::shared_ptr<const LayoutPiece>(layout)));
+        return layout;
+    }
+    for (size_t i = 0; i + 1 < breaks.size(); ++i) {
+        SegmentText segment(text, range, breaks, i, startHyphen, endHyphen);
+        LayoutCacheKey key(segment.text, segment.range, paint, dir, segment.startHyphen,
+                           segment.endHyphen);
+        put(key, new LayoutSegment(std::make_shared<LayoutPiece>(
+                         *layout, clusterInfo, Range(breaks[i], breaks[i + 1]), dir, paint)));
+    }
+    put(runKey, new LayoutSegment(std::move(breaks)));
+    return layout;
+}
+
+std::shared_ptr<const LayoutPiece> LayoutSegmentCache::getOrCreateSegment(
+        const U16StringPiece& text, const Range& range, const std::vector<uint32_t>& breaks,
+        size_t index, const MinikinPaint& paint, bool dir, StartHyphenEdit startHyphen,
+        EndHyphenEdit endHyphen) {
+    SegmentText segment(text, range, breaks, index, startHyphen, endHyphen);
+    LayoutCacheKey key(segment.text, segment.range, paint, dir, segment.startHyphen,
+                       segment.endHyphen);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        LayoutSegment* cached = mCache.get(key);
+        if (cached != nullptr && cached->piece) {
+            return cached->piece;
+        }
+    }
+    // The segment has been evicted. Since its boundaries are safe to break, shaping it on its own
+    // gives the same result as a part of the run.
+    const CacheStats::TimePoint shapingStart = CacheStats::now();
+    std::shared_ptr<const LayoutPiece> piece =
+            std::make_shared<LayoutPiece>(segment.text, segment.range, dir, paint,
+                                          segment.startHyphen, segment.endHyphen);
+    mStats.recordMiss(shapingStart);
+    put(key, new LayoutSegment(std::shared_ptr<const LayoutPiece>(piece)));
+    return piece;
+}
+
+void LayoutSegmentCache::put(LayoutCacheKey& key, LayoutSegment* segment) {
+    key.copyText();
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mCache.put(key, segment)) {
+        // The same entry has been inserted by other thread.
+        key.freeText();
+        delete segment;
+        return;
+    }
+    mMemoryUsage += key.getMemoryUsage() + segment->getMemoryUsage();
+    trimLocked(mMemoryBudget);
+}
+
+void LayoutSegmentCache::trimLocked(size_t bytes) {
+    while (mMemoryUsage > bytes) {
+        if (!mCache.removeOldest()) {
+            break;
+        }
+        mStats.recordEvictions(1);
+    }
+}
+
+void LayoutSegmentCache::operator()(LayoutCacheKey& key, LayoutSegment*& value) {
+    mMemoryUsage -= key.getMemoryUsage() + value->getMemoryUsage();
+    key.freeText();
+    delete value;
+}
+
+void LayoutSegmentCache::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCache.clear();
+}
+
+void LayoutSegmentCache::trim(uint32_t percent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (percent < 100) {
+        trimLocked(mMemoryUsage * percent / 100);
+    }
+}
+
+void LayoutSegmentCache::removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    removeCollectionEntries(mCache, collectionIds);
+}
+
+uint32_t LayoutSegmentCache::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCache.size();
+}
+
+size_t LayoutSegmentCache::getMemoryUsage() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMemoryUsage;
+}
+
+}  // namespace minikin
@@ -25,10 +25,16 @@
 #include <unicode/utf16.h>
 #include <utils/LruCache.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <mutex>
+#include <new>
+#include <numeric>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "BidiUtils.h"
@@ -37,19 +43,36 @@
 #include "LocaleListCache.h"
 #include "MinikinInternal.h"
 #include "minikin/Emoji.h"
+#include "minikin/FontExtentCache.h"
+#include "minikin/GlyphBoundsCache.h"
 #include "minikin/HbUtils.h"
+#include "minikin/ItemizeCache.h"
 #include "minikin/LayoutCache.h"
 #include "minikin/LayoutPieces.h"
 #include "minikin/Macros.h"
+#include "minikin/ShapingStats.h"
+#include "minikin/TextScan.h"
 
 namespace minikin {
 
 namespace {
 
+// The advances of the recently used glyphs of a sub-font. A sub-font is only used by one thread
+// and the paint values which affect the advances are part of its key in HbSubFontPool, so the
+// advances stay valid for the lifetime of the sub-font.
+struct GlyphAdvanceCache {
+    static constexpr size_t kSize = 128;
+
+    // The glyph ID plus one, 0 for an empty slot.
+    uint32_t keys[kSize] = {};
+    float advances[kSize];
+};
+
 struct SkiaArguments {
     const MinikinFont* font;
     const MinikinPaint* paint;
     FontFakery fakery;
+    GlyphAdvanceCache advanceCache;
 };
 
 // Returns true if the character needs to be excluded for the line spacing.
@@ -60,8 +83,13 @@ inline bool isLineSpaceExcludeChar(uint16_t c) {
 static hb_position_t harfbuzzGetGlyphHorizontalAdvance(hb_font_t* /* hbFont */, void* fontData,
                                                        hb_codepoint_t glyph, void* /* userData */) {
     SkiaArguments* args = reinterpret_cast<SkiaArguments*>(fontData);
-    float advance = args->font->GetHorizontalAdvance(glyph, *args->paint, args->fakery);
-    return 256 * advance + 0.5;
+    GlyphAdvanceCache& cache = args->advanceCache;
+    const size_t slot = glyph % GlyphAdvanceCache::kSize;
+    if (cache.keys[slot] != glyph + 1) {
+        cache.advances[slot] = args->font->GetHorizontalAdvance(glyph, *args->paint, args->fakery);
+        cache.keys[slot] = glyph + 1;
+    }
+    return 256 * cache.advances[slot] + 0.5;
 }
 
 static void harfbuzzGetGlyphHorizontalAdvances(hb_font_t* /* hbFont */, void* fontData,
@@ -70,25 +98,45 @@ static void harfbuzzGetGlyphHorizontalAdvances(hb_font_t* /* hbFont */, void* fo
                                                unsigned glyph_stride, hb_position_t* first_advance,
                                                unsigned advance_stride, void* /* userData */) {
     SkiaArguments* args = reinterpret_cast<SkiaArguments*>(fontData);
-    std::vector<uint16_t> glyphVec(count);
-    std::vector<float> advVec(count);
+    GlyphAdvanceCache& cache = args->advanceCache;
+    // Reused between the calls on this thread to avoid the allocations on every shaping miss.
+    thread_local std::vector<uint16_t> missGlyphs;
+    thread_local std::vector<uint32_t> missIndices;
+    thread_local std::vector<float> missAdvances;
+    missGlyphs.clear();
+    missIndices.clear();
 
     const hb_codepoint_t* glyph = first_glyph;
+    hb_position_t* advances = first_advance;
     for (uint32_t i = 0; i < count; ++i) {
-        glyphVec[i] = *glyph;
+        const size_t slot = *glyph % GlyphAdvanceCache::kSize;
+        if (cache.keys[slot] == *glyph + 1) {
+            *advances = HBFloatToFixed(cache.advances[slot]);
+        } else {
+            missGlyphs.push_back(*glyph);
+            missIndices.push_back(i);
+        }
         glyph = reinterpret_cast<const hb_codepoint_t*>(reinterpret_cast<const uint8_t*>(glyph) +
                                                         glyph_stride);
-    }
-
-    args->font->GetHorizontalAdvances(glyphVec.data(), count, *args->paint, args->fakery,
-                                      advVec.data());
-
-    hb_position_t* advances = first_advance;
-    for (uint32_t i = 0; i < count; ++i) {
-        *advances = HBFloatToFixed(advVec[i]);
         advances = reinterpret_cast<hb_position_t*>(reinterpret_cast<uint8_t*>(advances) +
                                                     advance_stride);
     }
+    if (missGlyphs.empty()) {
+        return;
+    }
+
+    // Ask the font for all the missing glyphs at once, so that its batch API is used.
+    missAdvances.resize(missGlyphs.size());
+    args->font->GetHorizontalAdvances(missGlyphs.data(), missGlyphs.size(), *args->paint,
+                                      args->fakery, missAdvances.data());
+    for (size_t i = 0; i < missGlyphs.size(); ++i) {
+        const size_t slot = missGlyphs[i] % GlyphAdvanceCache::kSize;
+        cache.keys[slot] = missGlyphs[i] + 1;
+        cache.advances[slot] = missAdvances[i];
+        hb_position_t* advance = reinterpret_cast<hb_position_t*>(
+                reinterpret_cast<uint8_t*>(first_advance) + missIndices[i] * advance_stride);
+        *advance = HBFloatToFixed(missAdvances[i]);
+    }
 }
 
 static hb_bool_t harfbuzzGetGlyphHorizontalOrigin(hb_font_t* /* hbFont */, void* /* fontData */,
@@ -121,7 +169,8 @@ hb_font_funcs_t* getFontFuncsForEmoji() {
     std::call_once(once, [&]() {
         fontFuncs = hb_font_funcs_create();
         // Don't override the h_advance function since we use HarfBuzz's implementation for emoji
-        // for performance reasons.
+        // for performance reasons. The sub-font then inherits the batched h_advances function of
+        // its parent, which reads the hmtx table without calling into the typeface.
         // Note that it is technically possible for a TrueType font to have outline and embedded
         // bitmap at the same time. We ignore modified advances of hinted outline glyphs in that
         // case.
@@ -131,9 +180,104 @@ hb_font_funcs_t* getFontFuncsForEmoji() {
     return fontFuncs;
 }
 
-static bool isColorBitmapFont(const HbFontUniquePtr& font) {
-    HbBlob cbdt(font, HB_TAG('C', 'B', 'D', 'T'));
-    return cbdt;
+// Returns the HarfBuzz buffer of the calling thread. LayoutPiece construction does not re-enter
+// itself, so one buffer per thread is enough and it keeps its allocation between pieces.
+const HbBufferUniquePtr& getThreadLocalBuffer() {
+    thread_local HbBufferUniquePtr buffer(hb_buffer_create());
+    return buffer;
+}
+
+// A small per-thread cache of sub-fonts which are already set up for shaping with a paint.
+// Creating a sub-font and installing its font functions is a large part of a shaping miss, while
+// text usually uses only a handful of fonts and sizes.
+class HbSubFontPool {
+public:
+    static HbSubFontPool& getThreadLocalInstance() {
+        thread_local HbSubFontPool pool;
+        return pool;
+    }
+
+    // Returns a sub-font of the given font scaled for the paint. The returned pointer holds its
+    // own reference, so it stays valid even if the entry is evicted while it is in use.
+    HbFontUniquePtr acquire(const FakedFont& fakedFont, const MinikinPaint& paint) {
+        hb_font_t* parent = fakedFont.font->baseFont().get();
+        auto it = std::find_if(mEntries.begin(), mEntries.end(), [&](const Entry& e) {
+            return e.parent == parent && e.size == paint.size && e.scaleX == paint.scaleX &&
+                   e.skewX == paint.skewX && e.fontFlags == paint.fontFlags &&
+                   e.fakery == fakedFont.fakery;
+        });
+        if (it == mEntries.end()) {
+            if (mEntries.size() == kMaxEntries) {
+                mEntries.erase(mEntries.begin());
+            }
+            mEntries.push_back(createEntry(fakedFont, paint));
+            it = mEntries.end() - 1;
+        } else if (it != mEntries.end() - 1) {
+            // Keep the most recently used entry at the back.
+            std::rotate(it, it + 1, mEntries.end());
+            it = mEntries.end() - 1;
+        }
+        // The typeface and paint are only borrowed for the current piece, so rebind them on every
+        // use. Neither of them is part of the key: the paint values which affect shaping and the
+        // cached advances are.
+        it->args->font = fakedFont.font->typeface().get();
+        it->args->paint = &paint;
+        return HbFontUniquePtr(hb_font_reference(it->font.get()));
+    }
+
+private:
+    static constexpr size_t kMaxEntries = 8;
+
+    struct Entry {
+        // The sub-font references its parent, so the parent can not be replaced by another font
+        // at the same address while the entry exists. Font variations are applied to the parent,
+        // so this also identifies the variation settings.
+        hb_font_t* parent;
+        float size;
+        float scaleX;
+        float skewX;
+        uint32_t fontFlags;
+        FontFakery fakery;
+        HbFontUniquePtr font;
+        SkiaArguments* args;  // Owned by font.
+    };
+
+    static Entry createEntry(const FakedFont& fakedFont, const MinikinPaint& paint) {
+        hb_font_t* parent = fakedFont.font->baseFont().get();
+        // We override some functions which are not thread safe.
+        HbFontUniquePtr font(hb_font_create_sub_font(parent));
+        SkiaArguments* args =
+                new SkiaArguments{fakedFont.font->typeface().get(), &paint, fakedFont.fakery, {}};
+        // The table lookup of the color bitmap detection is done once per font, not per sub-font.
+        // The fonts whose advances are the ones of the tables skip the typeface in the same way.
+        const bool tableAdvances = fakedFont.font->isColorBitmapFont() ||
+                                   fakedFont.font->typeface()->HasHarfBuzzAdvances();
+        hb_font_set_funcs(font.get(), tableAdvances ? getFontFuncsForEmoji() : getFontFuncs(),
+                          args,
+                          [](void* data) { delete reinterpret_cast<SkiaArguments*>(data); });
+        const double size = paint.size;
+        const double scaleX = paint.scaleX;
+        hb_font_set_ppem(font.get(), size * scaleX, size);
+        hb_font_set_scale(font.get(), HBFloatToFixed(size * scaleX), HBFloatToFixed(size));
+        return {parent, paint.size, paint.scaleX, paint.skewX, paint.fontFlags, fakedFont.fakery,
+                std::move(font), args};
+    }
+
+    std::vector<Entry> mEntries;
+};
+
+// Returns true if the text can be passed to LayoutPiece::layoutSimpleAscii(), except for the font.
+// HarfBuzz mirrors some characters in RTL, and the hyphenation and letter spacing are only
+// implemented in the shaping path.
+static bool isSimpleAsciiRun(const U16StringPiece& text, bool isRtl, const MinikinPaint& paint,
+                             StartHyphenEdit startHyphen, EndHyphenEdit endHyphen) {
+    if (isRtl || paint.letterSpacing != 0 || startHyphen != StartHyphenEdit::NO_EDIT ||
+        endHyphen != EndHyphenEdit::NO_EDIT) {
+        return false;
+    }
+    return std::all_of(text.data(), text.data() + text.size(), [](uint16_t c) {
+        return SimpleAsciiGlyphs::kFirst <= c && c <= SimpleAsciiGlyphs::kLast;
+    });
 }
 
 static hb_codepoint_t decodeUtf16(const uint16_t* chars, size_t len, ssize_t* iter) {
@@ -175,6 +319,32 @@ static hb_script_t getScriptRun(const uint16_t* chars, size_t len, ssize_t* iter
     return current_script;
 }
 
+// Every code point below U+02B0 is in the Common or the Latin script, and there are no
+// surrogates nor Inherited combining marks there.
+constexpr uint16_t kLatinOrCommonEnd = 0x02B0;
+
+// Returns true if getLatinScriptRun() can be used instead of getScriptRun() for any part of the
+// text. Computed once for the piece.
+static bool isLatinOrCommonText(const uint16_t* chars, size_t len) {
+    return maxCodeUnit(chars, len) < kLatinOrCommonEnd;
+}
+
+// Same as getScriptRun() for text where isLatinOrCommonText() is true. The whole text is one script
+// run, which is Latin as soon as it contains a Latin letter, so the script lookup usually stops at
+// the first character.
+static hb_script_t getLatinScriptRun(const uint16_t* chars, size_t len, ssize_t* iter) {
+    hb_unicode_funcs_t* unicode_func = hb_unicode_funcs_get_default();
+    for (size_t i = *iter; i < len; ++i) {
+        if (hb_unicode_script(unicode_func, chars[i]) != HB_SCRIPT_COMMON) {
+            *iter = len;
+            return HB_SCRIPT_LATIN;
+        }
+    }
+    const bool isEmpty = size_t(*iter) == len;
+    *iter = len;
+    return isEmpty ? HB_SCRIPT_UNKNOWN : HB_SCRIPT_COMMON;
+}
+
 /**
  * Disable certain scripts (mostly those with cursive connection) from having letterspacing
  * applied. See https://github.com/behdad/harfbuzz/issues/64 for more details.
@@ -189,36 +359,12 @@ static bool isScriptOkForLetterspacing(hb_script_t script) {
              script == HB_SCRIPT_TIRHUTA || script == HB_SCRIPT_OGHAM);
 }
 
-static inline hb_codepoint_t determineHyphenChar(hb_codepoint_t preferredHyphen, hb_font_t* font) {
-    hb_codepoint_t glyph;
-    if (preferredHyphen == 0x058A    /* ARMENIAN_HYPHEN */
-        || preferredHyphen == 0x05BE /* HEBREW PUNCTUATION MAQAF */
-        || preferredHyphen == 0x1400 /* CANADIAN SYLLABIC HYPHEN */) {
-        if (hb_font_get_nominal_glyph(font, preferredHyphen, &glyph)) {
-            return preferredHyphen;
-        } else {
-            // The original hyphen requested was not supported. Let's try and see if the
-            // Unicode hyphen is supported.
-            preferredHyphen = CHAR_HYPHEN;
-        }
-    }
-    if (preferredHyphen == CHAR_HYPHEN) { /* HYPHEN */
-        // Fallback to ASCII HYPHEN-MINUS if the font didn't have a glyph for the preferred hyphen.
-        // Note that we intentionally don't do anything special if the font doesn't have a
-        // HYPHEN-MINUS either, so a tofu could be shown, hinting towards something missing.
-        if (!hb_font_get_nominal_glyph(font, preferredHyphen, &glyph)) {
-            return 0x002D;  // HYPHEN-MINUS
-        }
-    }
-    return preferredHyphen;
-}
-
 template <typename HyphenEdit>
-static inline void addHyphenToHbBuffer(const HbBufferUniquePtr& buffer, const HbFontUniquePtr& font,
+static inline void addHyphenToHbBuffer(const HbBufferUniquePtr& buffer, const Font& font,
                                        HyphenEdit hyphen, uint32_t cluster) {
     auto [chars, size] = getHyphenString(hyphen);
     for (size_t i = 0; i < size; i++) {
-        hb_buffer_add(buffer.get(), determineHyphenChar(chars[i], font.get()), cluster);
+        hb_buffer_add(buffer.get(), font.getHyphenChar(chars[i]), cluster);
     }
 }
 
@@ -228,7 +374,7 @@ static inline uint32_t addToHbBuffer(const HbBufferUniquePtr& buffer, const uint
                                      size_t start, size_t count, size_t bufSize,
                                      ssize_t scriptRunStart, ssize_t scriptRunEnd,
                                      StartHyphenEdit inStartHyphen, EndHyphenEdit inEndHyphen,
-                                     const HbFontUniquePtr& hbFont) {
+                                     const Font& font) {
     // Only hyphenate the very first script run for starting hyphens.
     const StartHyphenEdit startHyphen =
             (scriptRunStart == 0) ? inStartHyphen : StartHyphenEdit::NO_EDIT;
@@ -253,7 +399,7 @@ static inline uint32_t addToHbBuffer(const HbBufferUniquePtr& buffer, const uint
     if (isInsertion(startHyphen)) {
         // A cluster value of zero guarantees that the inserted hyphen will be in the same
         // cluster with the next codepoint, since there is no pre-context.
-        addHyphenToHbBuffer(buffer, hbFont, startHyphen, 0 /* cluster */);
+        addHyphenToHbBuffer(buffer, font, startHyphen, 0 /* cluster */);
     }
 
     const uint16_t* hbText;
@@ -313,7 +459,7 @@ static inline uint32_t addToHbBuffer(const HbBufferUniquePtr& buffer, const uint
         } else {
             hyphenCluster = cpInfo[numCodepoints - 1].cluster + (uint32_t)hasEndReplacement;
         }
-        addHyphenToHbBuffer(buffer, hbFont, endHyphen, hyphenCluster);
+        addHyphenToHbBuffer(buffer, font, endHyphen, hyphenCluster);
         // Since we have just added to the buffer, cpInfo no longer necessarily points to
         // the right place. Refresh it.
         cpInfo = hb_buffer_get_glyph_infos(buffer.get(), nullptr /* we don't need the size */);
@@ -323,27 +469,50 @@ static inline uint32_t addToHbBuffer(const HbBufferUniquePtr& buffer, const uint
 
 }  // namespace
 
+std::atomic<bool> LayoutPiece::sLetterSpacingsRecorded(false);
+
 LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool isRtl,
                          const MinikinPaint& paint, StartHyphenEdit startHyphen,
-                         EndHyphenEdit endHyphen) {
+                         EndHyphenEdit endHyphen, ClusterInfo* outClusterInfo,
+                         bool advancesOnly)
+        : mAdvancesOnly(advancesOnly) {
+    LOG_ALWAYS_FATAL_IF(advancesOnly && outClusterInfo != nullptr,
+                        "Cluster information requested for advances only layout");
+    // The typefaces and HarfBuzz fonts are used throughout the shaping.
+    Font::ExternalRefsGuard externalRefsGuard;
     const uint16_t* buf = textBuf.data();
     const size_t start = range.getStart();
     const size_t count = range.getLength();
     const size_t bufSize = textBuf.size();
 
-    mAdvances.resize(count, 0);  // Need zero filling.
+    Builder b;
+    b.advances.resize(count, 0);  // Need zero filling.
+    if (paint.letterSpacing != 0 && sLetterSpacingsRecorded.load(std::memory_order_relaxed)) {
+        b.hasLetterSpacings = true;
+        b.charSpacings.resize(count, 0);
+    }
 
     // Usually the number of glyphs are less than number of code units.
-    mFontIndices.reserve(count);
-    mGlyphIds.reserve(count);
-    mPoints.reserve(count);
+    if (!advancesOnly) {
+        b.fontIndices.reserve(count);
+        b.glyphIds.reserve(count);
+        b.points.reserve(count);
+    }
 
-    HbBufferUniquePtr buffer(hb_buffer_create());
+    const HbBufferUniquePtr& buffer = getThreadLocalBuffer();
+    HbSubFontPool& subFontPool = HbSubFontPool::getThreadLocalInstance();
     U16StringPiece substr = textBuf.substr(range);
-    std::vector<FontCollection::Run> items =
-            paint.font->itemize(substr, paint.fontStyle, paint.localeListId, paint.familyVariant);
+    std::vector<FontCollection::Run> items = ItemizeCache::getInstance().itemize(
+            *paint.font, substr, paint.fontStyle, paint.localeListId, paint.familyVariant);
+
+    if (items.size() == 1 && isSimpleAsciiRun(substr, isRtl, paint, startHyphen, endHyphen) &&
+        layoutSimpleAscii(substr, paint.font->getBestFont(substr, items[0], paint.fontStyle), paint,
+                          advancesOnly, outClusterInfo, &b)) {
+        pack(b);
+        return;
+    }
 
-    std::vector<hb_feature_t> features = cleanAndAddDefaultFontFeatures(paint);
+    const std::vector<hb_feature_t>& features = getFontFeatures(paint);
 
     std::vector<HbFontUniquePtr> hbFonts;
     double size = paint.size;
@@ -351,8 +520,12 @@ LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool
 
     std::unordered_map<const Font*, uint32_t> fontMap;
 
+    const bool isLatinOrCommon = isLatinOrCommonText(substr.data(), count);
+
     float x = 0;
     float y = 0;
+    // The number of the halves of the letter spacing added to x so far.
+    uint32_t halfSpaces = 0;
     for (int run_ix = isRtl ? items.size() - 1 : 0;
          isRtl ? run_ix >= 0 : run_ix < static_cast<int>(items.size());
          isRtl ? --run_ix : ++run_ix) {
@@ -362,17 +535,11 @@ LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool
         uint8_t font_ix;
         if (it == fontMap.end()) {
             // First time to see this font.
-            font_ix = mFonts.size();
-            mFonts.push_back(fakedFont);
+            font_ix = b.fonts.size();
+            b.fonts.push_back(fakedFont);
             fontMap.insert(std::make_pair(fakedFont.font.get(), font_ix));
 
-            // We override some functions which are not thread safe.
-            HbFontUniquePtr font(hb_font_create_sub_font(fakedFont.font->baseFont().get()));
-            hb_font_set_funcs(
-                    font.get(), isColorBitmapFont(font) ? getFontFuncsForEmoji() : getFontFuncs(),
-                    new SkiaArguments({fakedFont.font->typeface().get(), &paint, fakedFont.fakery}),
-                    [](void* data) { delete reinterpret_cast<SkiaArguments*>(data); });
-            hbFonts.push_back(std::move(font));
+            hbFonts.push_back(subFontPool.acquire(fakedFont, paint));
         } else {
             font_ix = it->second;
         }
@@ -386,14 +553,9 @@ LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool
             }
         }
         if (needExtent) {
-            MinikinExtent verticalExtent;
-            fakedFont.font->typeface()->GetFontExtent(&verticalExtent, paint, fakedFont.fakery);
-            mExtent.extendBy(verticalExtent);
+            mExtent.extendBy(FontExtentCache::getInstance().getExtent(fakedFont, paint));
         }
 
-        hb_font_set_ppem(hbFont.get(), size * scaleX, size);
-        hb_font_set_scale(hbFont.get(), HBFloatToFixed(size * scaleX), HBFloatToFixed(size));
-
         // TODO: if there are multiple scripts within a font in an RTL run,
         // we need to reorder those runs. This is unlikely with our current
         // font stack, but should be done for correctness.
@@ -404,43 +566,60 @@ LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool
         for (ssize_t scriptRunStart = run.start; scriptRunStart < run.end;
              scriptRunStart = scriptRunEnd) {
             scriptRunEnd = scriptRunStart;
-            hb_script_t script = getScriptRun(buf + start, run.end, &scriptRunEnd /* iterator */);
+            hb_script_t script =
+                    isLatinOrCommon
+                            ? getLatinScriptRun(buf + start, run.end, &scriptRunEnd /* iterator */)
+                            : getScriptRun(buf + start, run.end, &scriptRunEnd /* iterator */);
             // After the last line, scriptRunEnd is guaranteed to have increased, since the only
-            // time getScriptRun does not increase its iterator is when it has already reached the
-            // end of the buffer. But that can't happen, since if we have already reached the end
-            // of the buffer, we should have had (scriptRunEnd == run.end), which means
-            // (scriptRunStart == run.end) which is impossible due to the exit condition of the for
-            // loop. So we can be sure that scriptRunEnd > scriptRunStart.
+            // time the script run functions do not increase the iterator is when it has already
+            // reached the end of the buffer. But that can't happen, since if we have already
+            // reached the end of the buffer, we should have had (scriptRunEnd == run.end), which
+            // means (scriptRunStart == run.end) which is impossible due to the exit condition of
+            // the for loop. So we can be sure that scriptRunEnd > scriptRunStart.
 
             double letterSpace = 0.0;
             double letterSpaceHalf = 0.0;
 
-            if (paint.letterSpacing != 0.0 && isScriptOkForLetterspacing(script)) {
+            const bool isSpaced = paint.letterSpacing != 0.0 && isScriptOkForLetterspacing(script);
+            if (isSpaced) {
                 letterSpace = paint.letterSpacing * size * scaleX;
                 letterSpaceHalf = letterSpace * 0.5;
             }
+            // Records a half of the letter spacing added after the code unit.
+            const auto recordHalfSpace = [&b, &halfSpaces, isSpaced](size_t index) {
+                if (isSpaced && b.hasLetterSpacings) {
+                    b.charSpacings[index]++;
+                    halfSpaces++;
+                }
+            };
 
             hb_buffer_clear_contents(buffer.get());
             hb_buffer_set_script(buffer.get(), script);
             hb_buffer_set_direction(buffer.get(), isRtl ? HB_DIRECTION_RTL : HB_DIRECTION_LTR);
             const LocaleList& localeList = LocaleListCache::getById(paint.localeListId);
             if (localeList.size() != 0) {
-                hb_language_t hbLanguage = localeList.getHbLanguage(0);
-                for (size_t i = 0; i < localeList.size(); ++i) {
-                    if (localeList[i].supportsScript(hb_script_to_iso15924_tag(script))) {
-                        hbLanguage = localeList.getHbLanguage(i);
-                        break;
-                    }
-                }
-                hb_buffer_set_language(buffer.get(), hbLanguage);
+                hb_buffer_set_language(
+                        buffer.get(),
+                        localeList.getHbLanguageForScript(hb_script_to_iso15924_tag(script)));
             }
 
             const uint32_t clusterStart =
                     addToHbBuffer(buffer, buf, start, count, bufSize, scriptRunStart, scriptRunEnd,
-                                  startHyphen, endHyphen, hbFont);
+                                  startHyphen, endHyphen, *fakedFont.font);
 
-            hb_shape(hbFont.get(), buffer.get(), features.empty() ? NULL : &features[0],
-                     features.size());
+            ShapingStats& shapingStats = ShapingStats::getInstance();
+            if (shapingStats.shouldSample()) {
+                const auto shapeStart = std::chrono::steady_clock::now();
+                hb_shape(hbFont.get(), buffer.get(), features.empty() ? NULL : &features[0],
+                         features.size());
+                const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - shapeStart);
+                shapingStats.record(hb_script_to_iso15924_tag(script), *fakedFont.font,
+                                    paint.fontFeatureSettings, elapsed.count());
+            } else {
+                hb_shape(hbFont.get(), buffer.get(), features.empty() ? NULL : &features[0],
+                         features.size());
+            }
             unsigned int numGlyphs;
             hb_glyph_info_t* info = hb_buffer_get_glyph_infos(buffer.get(), &numGlyphs);
             hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(buffer.get(), NULL);
@@ -448,34 +627,54 @@ LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool
             // At this point in the code, the cluster values in the info buffer correspond to the
             // input characters with some shift. The cluster value clusterStart corresponds to the
             // first character passed to HarfBuzz, which is at buf[start + scriptRunStart] whose
-            // advance needs to be saved into mAdvances[scriptRunStart]. So cluster values need to
+            // advance needs to be saved into advances[scriptRunStart]. So cluster values need to
             // be reduced by (clusterStart - scriptRunStart) to get converted to indices of
-            // mAdvances.
+            // advances.
             const ssize_t clusterOffset = clusterStart - scriptRunStart;
 
             if (numGlyphs) {
-                mAdvances[info[0].cluster - clusterOffset] += letterSpaceHalf;
+                b.advances[info[0].cluster - clusterOffset] += letterSpaceHalf;
                 x += letterSpaceHalf;
+                recordHalfSpace(info[0].cluster - clusterOffset);
             }
             for (unsigned int i = 0; i < numGlyphs; i++) {
                 const size_t clusterBaseIndex = info[i].cluster - clusterOffset;
                 if (i > 0 && info[i - 1].cluster != info[i].cluster) {
-                    mAdvances[info[i - 1].cluster - clusterOffset] += letterSpaceHalf;
-                    mAdvances[clusterBaseIndex] += letterSpaceHalf;
+                    b.advances[info[i - 1].cluster - clusterOffset] += letterSpaceHalf;
+                    b.advances[clusterBaseIndex] += letterSpaceHalf;
                     x += letterSpace;
+                    recordHalfSpace(info[i - 1].cluster - clusterOffset);
+                    recordHalfSpace(clusterBaseIndex);
                 }
 
-                hb_codepoint_t glyph_ix = info[i].codepoint;
-                float xoff = HBFixedToFloat(positions[i].x_offset);
-                float yoff = -HBFixedToFloat(positions[i].y_offset);
-                xoff += yoff * paint.skewX;
-                mFontIndices.push_back(font_ix);
-                mGlyphIds.push_back(glyph_ix);
-                mPoints.emplace_back(x + xoff, y + yoff);
+                if (!advancesOnly) {
+                    hb_codepoint_t glyph_ix = info[i].codepoint;
+                    float xoff = HBFixedToFloat(positions[i].x_offset);
+                    float yoff = -HBFixedToFloat(positions[i].y_offset);
+                    xoff += yoff * paint.skewX;
+                    b.fontIndices.push_back(font_ix);
+                    b.glyphIds.push_back(glyph_ix);
+                    b.points.emplace_back(x + xoff, y + yoff);
+                    if (b.hasLetterSpacings) {
+                        b.glyphSpacings.push_back(halfSpaces);
+                    }
+                }
+                if (outClusterInfo != nullptr) {
+                    outClusterInfo->clusters.push_back(clusterBaseIndex);
+                    // In RTL, the glyphs are in visual order, so the glyph before the boundary is
+                    // the start of the logically following cluster.
+                    const unsigned int clusterStart = isRtl ? i - 1 : i;
+                    if (i > 0 && info[i - 1].cluster != info[i].cluster &&
+                        (hb_glyph_info_get_glyph_flags(&info[clusterStart]) &
+                         HB_GLYPH_FLAG_UNSAFE_TO_BREAK) == 0) {
+                        outClusterInfo->safeBreaks.push_back(info[clusterStart].cluster -
+                                                             clusterOffset);
+                    }
+                }
                 float xAdvance = HBFixedToFloat(positions[i].x_advance);
 
                 if (clusterBaseIndex < count) {
-                    mAdvances[clusterBaseIndex] += xAdvance;
+                    b.advances[clusterBaseIndex] += xAdvance;
                 } else {
                     ALOGE("cluster %zu (start %zu) out of bounds of count %zu", clusterBaseIndex,
                           start, count);
@@ -483,15 +682,389 @@ LayoutPiece::LayoutPiece(const U16StringPiece& textBuf, const Range& range, bool
                 x += xAdvance;
             }
             if (numGlyphs) {
-                mAdvances[info[numGlyphs - 1].cluster - clusterOffset] += letterSpaceHalf;
+                b.advances[info[numGlyphs - 1].cluster - clusterOffset] += letterSpaceHalf;
                 x += letterSpaceHalf;
+                recordHalfSpace(info[numGlyphs - 1].cluster - clusterOffset);
             }
         }
     }
-    mFontIndices.shrink_to_fit();
-    mGlyphIds.shrink_to_fit();
-    mPoints.shrink_to_fit();
     mAdvance = x;
+    pack(b);
+    if (outClusterInfo != nullptr) {
+        std::sort(outClusterInfo->safeBreaks.begin(), outClusterInfo->safeBreaks.end());
+    }
+}
+
+bool LayoutPiece::layoutSimpleAscii(const U16StringPiece& text, const FakedFont& fakedFont,
+                                    const MinikinPaint& paint, bool advancesOnly,
+                                    ClusterInfo* outClusterInfo, Builder* b) {
+    const SimpleAsciiGlyphs* asciiGlyphs = fakedFont.font->getSimpleAsciiGlyphs();
+    if (asciiGlyphs == nullptr) {
+        return false;
+    }
+    const size_t count = text.size();
+    std::vector<uint16_t> glyphIds(count);
+    for (size_t i = 0; i < count; ++i) {
+        glyphIds[i] = asciiGlyphs->glyphIds[text[i] - SimpleAsciiGlyphs::kFirst];
+        if (glyphIds[i] == 0) {
+            return false;
+        }
+    }
+    const MinikinFont* typeface = fakedFont.font->typeface().get();
+    std::vector<float> advances(count);
+    typeface->GetHorizontalAdvances(glyphIds.data(), count, paint, fakedFont.fakery,
+                                    advances.data());
+
+    b->fonts.push_back(fakedFont);
+    mExtent.extendBy(FontExtentCache::getInstance().getExtent(fakedFont, paint));
+
+    float x = 0;
+    for (size_t i = 0; i < count; ++i) {
+        // Round the advance in the same way as it goes through HarfBuzz.
+        const float advance = HBFixedToFloat(HBFloatToFixed(advances[i]));
+        if (!advancesOnly) {
+            b->fontIndices.push_back(0);
+            b->glyphIds.push_back(glyphIds[i]);
+            b->points.emplace_back(x, 0);
+        }
+        if (outClusterInfo != nullptr) {
+            // Every character is a cluster and nothing is unsafe to break without shaping.
+            outClusterInfo->clusters.push_back(i);
+            if (i > 0) {
+                outClusterInfo->safeBreaks.push_back(i);
+            }
+        }
+        b->advances[i] = advance;
+        x += advance;
+    }
+    mAdvance = x;
+    return true;
+}
+
+LayoutPiece::LayoutPiece(const LayoutPiece& piece, const ClusterInfo& clusterInfo,
+                         const Range& range, bool isRtl, const MinikinPaint& paint)
+        : mAdvancesOnly(false) {
+    Builder b;
+    const auto advanceBegin = piece.advances().begin();
+    b.advances.assign(advanceBegin + range.getStart(), advanceBegin + range.getEnd());
+    mAdvance = std::accumulate(b.advances.begin(), b.advances.end(), 0.0f);
+
+    // The pen position at the visual start of the range.
+    const float origin = isRtl ? std::accumulate(advanceBegin + range.getEnd(),
+                                                 piece.advances().end(), 0.0f)
+                               : std::accumulate(advanceBegin, advanceBegin + range.getStart(), 0.0f);
+
+    // The halves of the letter spacing before the visual start of the range.
+    uint32_t originHalfSpaces = 0;
+    if (piece.mHasLetterSpacings) {
+        b.hasLetterSpacings = true;
+        const uint8_t* charSpacings = piece.charSpacings();
+        b.charSpacings.assign(charSpacings + range.getStart(), charSpacings + range.getEnd());
+        originHalfSpaces =
+                isRtl ? std::accumulate(charSpacings + range.getEnd(),
+                                        charSpacings + piece.mAdvanceCount, 0u)
+                      : std::accumulate(charSpacings, charSpacings + range.getStart(), 0u);
+    }
+
+    std::vector<int> fontMap(piece.fonts().size(), -1);
+    for (uint32_t i = 0; i < piece.glyphCount(); ++i) {
+        if (!range.contains(clusterInfo.clusters[i])) {
+            continue;
+        }
+        const uint8_t originalIndex = piece.fontIndices()[i];
+        if (fontMap[originalIndex] == -1) {
+            const FakedFont& font = piece.fonts()[originalIndex];
+            fontMap[originalIndex] = b.fonts.size();
+            b.fonts.push_back(font);
+            mExtent.extendBy(FontExtentCache::getInstance().getExtent(font, paint));
+        }
+        b.fontIndices.push_back(fontMap[originalIndex]);
+        b.glyphIds.push_back(piece.glyphIdAt(i));
+        const Point point = piece.pointAt(i);
+        b.points.emplace_back(point.x - origin, point.y);
+        if (b.hasLetterSpacings) {
+            b.glyphSpacings.push_back(piece.glyphSpacings()[i] - originHalfSpaces);
+        }
+    }
+    pack(b);
+}
+
+LayoutPiece::LayoutPiece(const std::vector<const LayoutPiece*>& pieces, bool isRtl)
+        : mAdvancesOnly(false), mAdvance(0) {
+    Builder b;
+    size_t glyphCount = 0;
+    size_t count = 0;
+    for (const LayoutPiece* piece : pieces) {
+        glyphCount += piece->glyphCount();
+        count += piece->advances().size();
+    }
+    b.fontIndices.reserve(glyphCount);
+    b.glyphIds.reserve(glyphCount);
+    b.points.reserve(glyphCount);
+    b.advances.reserve(count);
+
+    b.hasLetterSpacings = std::all_of(pieces.begin(), pieces.end(), [](const LayoutPiece* piece) {
+        return piece->mHasLetterSpacings;
+    });
+    for (const LayoutPiece* piece : pieces) {
+        b.advances.insert(b.advances.end(), piece->advances().begin(), piece->advances().end());
+        if (b.hasLetterSpacings) {
+            b.charSpacings.insert(b.charSpacings.end(), piece->charSpacings(),
+                                  piece->charSpacings() + piece->mAdvanceCount);
+        }
+    }
+    // The halves of the letter spacing of the pieces visually before the current one.
+    uint32_t halfSpaces = 0;
+    // The glyphs are stored in visual order.
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const LayoutPiece* piece = isRtl ? pieces[pieces.size() - i - 1] : pieces[i];
+        std::vector<uint8_t> fontMap(piece->fonts().size());
+        for (size_t j = 0; j < piece->fonts().size(); ++j) {
+            const FakedFont& font = piece->fonts()[j];
+            auto it = std::find(b.fonts.begin(), b.fonts.end(), font);
+            fontMap[j] = std::distance(b.fonts.begin(), it);
+            if (it == b.fonts.end()) {
+                b.fonts.push_back(font);
+            }
+        }
+        for (uint32_t j = 0; j < piece->glyphCount(); ++j) {
+            b.fontIndices.push_back(fontMap[piece->fontIndices()[j]]);
+            b.glyphIds.push_back(piece->glyphIdAt(j));
+            const Point point = piece->pointAt(j);
+            b.points.emplace_back(point.x + mAdvance, point.y);
+            if (b.hasLetterSpacings) {
+                b.glyphSpacings.push_back(piece->glyphSpacings()[j] + halfSpaces);
+            }
+        }
+        if (b.hasLetterSpacings) {
+            halfSpaces += std::accumulate(piece->charSpacings(),
+                                          piece->charSpacings() + piece->mAdvanceCount, 0u);
+        }
+        mExtent.extendBy(piece->mExtent);
+        mAdvance += piece->mAdvance;
+    }
+    pack(b);
+}
+
+LayoutPiece::LayoutPiece(BufferReader* reader, const std::vector<FakedFont>& fonts)
+        : mFontCount(fonts.size()) {
+    mGlyphCount = reader->read<uint32_t>();
+    mAdvanceCount = reader->read<uint32_t>();
+    mHasWideGlyphIds = reader->read<uint8_t>();
+    mHasYOffsets = reader->read<uint8_t>();
+    mAdvancesOnly = reader->read<uint8_t>();
+    mHasLetterSpacings = reader->read<uint8_t>();
+    mAdvance = reader->read<float>();
+    mExtent.ascent = reader->read<float>();
+    mExtent.descent = reader->read<float>();
+    mData = allocateBytes(dataSize());
+
+    uint8_t* data = mData.get();
+    for (uint32_t i = 0; i < mFontCount; ++i) {
+        new (data + sizeof(FakedFont) * i) FakedFont(fonts[i]);
+    }
+    const auto copyArray = [&](auto array, size_t offset) {
+        memcpy(data + offset, array.first, array.second * sizeof(*array.first));
+    };
+    copyArray(reader->readArray<float>(), advancesOffset());
+    copyArray(reader->readArray<float>(), positionsOffset());
+    if (mHasWideGlyphIds) {
+        copyArray(reader->readArray<uint32_t>(), glyphIdsOffset());
+    } else {
+        copyArray(reader->readArray<uint16_t>(), glyphIdsOffset());
+    }
+    copyArray(reader->readArray<uint8_t>(), fontIndicesOffset());
+    if (mHasLetterSpacings) {
+        copyArray(reader->readArray<uint32_t>(), glyphSpacingsOffset());
+        copyArray(reader->readArray<uint8_t>(), charSpacingsOffset());
+    }
+}
+
+// static
+bool LayoutPiece::isValidBuffer(BufferReader reader, uint32_t fontCount) {
+    const uint32_t glyphCount = reader.read<uint32_t>();
+    const uint32_t advanceCount = reader.read<uint32_t>();
+    const bool hasWideGlyphIds = reader.read<uint8_t>();
+    const bool hasYOffsets = reader.read<uint8_t>();
+    reader.skip<uint8_t>();  // mAdvancesOnly
+    const bool hasLetterSpacings = reader.read<uint8_t>();
+    reader.skip<float>();  // mAdvance
+    reader.skip<float>();  // mExtent.ascent
+    reader.skip<float>();  // mExtent.descent
+
+    if (reader.readArray<float>().second != advanceCount ||
+        reader.readArray<float>().second != (hasYOffsets ? 2ull : 1ull) * glyphCount) {
+        return false;
+    }
+    const uint32_t glyphIdCount = hasWideGlyphIds ? reader.readArray<uint32_t>().second
+                                                  : reader.readArray<uint16_t>().second;
+    const auto [fontIndices, fontIndexCount] = reader.readArray<uint8_t>();
+    if (glyphIdCount != glyphCount || fontIndexCount != glyphCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < fontIndexCount; ++i) {
+        if (fontIndices[i] >= fontCount) {
+            return false;
+        }
+    }
+    if (hasLetterSpacings && (reader.readArray<uint32_t>().second != glyphCount ||
+                              reader.readArray<uint8_t>().second != advanceCount)) {
+        return false;
+    }
+    return !reader.overflowed();
+}
+
+void LayoutPiece::writeTo(BufferWriter* writer) const {
+    writer->write<uint32_t>(mGlyphCount);
+    writer->write<uint32_t>(mAdvanceCount);
+    writer->write<uint8_t>(mHasWideGlyphIds);
+    writer->write<uint8_t>(mHasYOffsets);
+    writer->write<uint8_t>(mAdvancesOnly);
+    writer->write<uint8_t>(mHasLetterSpacings);
+    writer->write<float>(mAdvance);
+    writer->write<float>(mExtent.ascent);
+    writer->write<float>(mExtent.descent);
+
+    const uint8_t* data = mData.get();
+    writer->writeArray<float>(reinterpret_cast<const float*>(data + advancesOffset()),
+                              mAdvanceCount);
+    writer->writeArray<float>(reinterpret_cast<const float*>(data + positionsOffset()),
+                              mHasYOffsets ? mGlyphCount * 2 : mGlyphCount);
+    if (mHasWideGlyphIds) {
+        writer->writeArray<uint32_t>(reinterpret_cast<const uint32_t*>(data + glyphIdsOffset()),
+                                     mGlyphCount);
+    } else {
+        writer->writeArray<uint16_t>(reinterpret_cast<const uint16_t*>(data + glyphIdsOffset()),
+                                     mGlyphCount);
+    }
+    writer->writeArray<uint8_t>(data + fontIndicesOffset(), mGlyphCount);
+    if (mHasLetterSpacings) {
+        writer->writeArray<uint32_t>(glyphSpacings(), mGlyphCount);
+        writer->writeArray<uint8_t>(charSpacings(), mAdvanceCount);
+    }
+}
+
+LayoutPiece::LayoutPiece(const LayoutPiece& o)
+        : mData(allocateBytes(o.dataSize())),
+          mGlyphCount(o.mGlyphCount),
+          mAdvanceCount(o.mAdvanceCount),
+          mFontCount(o.mFontCount),
+          mHasWideGlyphIds(o.mHasWideGlyphIds),
+          mHasYOffsets(o.mHasYOffsets),
+          mAdvancesOnly(o.mAdvancesOnly),
+          mHasLetterSpacings(o.mHasLetterSpacings),
+          mAdvance(o.mAdvance),
+          mExtent(o.mExtent),
+          mBounds(o.mBounds) {
+    static_assert(std::is_trivially_copyable<FakedFont>::value,
+                  "FakedFont must be trivially copyable to be packed");
+    memcpy(mData.get(), o.mData.get(), o.dataSize());
+}
+
+LayoutPiece::LayoutPiece(const LayoutPiece& piece, float scale)
+        : mData(allocateBytes(piece.dataSize())),
+          mGlyphCount(piece.mGlyphCount),
+          mAdvanceCount(piece.mAdvanceCount),
+          mFontCount(piece.mFontCount),
+          mHasWideGlyphIds(piece.mHasWideGlyphIds),
+          mHasYOffsets(piece.mHasYOffsets),
+          mAdvancesOnly(piece.mAdvancesOnly),
+          mHasLetterSpacings(piece.mHasLetterSpacings),
+          mAdvance(piece.mAdvance * scale),
+          mExtent(piece.mExtent.ascent * scale, piece.mExtent.descent * scale) {
+    memcpy(mData.get(), piece.mData.get(), piece.dataSize());
+    // The advances are immediately followed by the glyph positions.
+    float* values = reinterpret_cast<float*>(mData.get() + advancesOffset());
+    const size_t valueCount = mAdvanceCount + (mHasYOffsets ? 2 : 1) * mGlyphCount;
+    for (size_t i = 0; i < valueCount; ++i) {
+        values[i] *= scale;
+    }
+}
+
+LayoutPiece::LayoutPiece(const LayoutPiece& piece, const MinikinPaint& shapedPaint,
+                         const MinikinPaint& paint)
+        : mData(allocateBytes(piece.dataSize())),
+          mGlyphCount(piece.mGlyphCount),
+          mAdvanceCount(piece.mAdvanceCount),
+          mFontCount(piece.mFontCount),
+          mHasWideGlyphIds(piece.mHasWideGlyphIds),
+          mHasYOffsets(piece.mHasYOffsets),
+          mAdvancesOnly(piece.mAdvancesOnly),
+          mHasLetterSpacings(piece.mHasLetterSpacings),
+          mAdvance(piece.mAdvance),
+          mExtent(piece.mExtent) {
+    LOG_ALWAYS_FATAL_IF(!mHasLetterSpacings, "Re-spacing a layout without letter spacings");
+    memcpy(mData.get(), piece.mData.get(), piece.dataSize());
+    // The spacing is linear in the letter spacing, so only the difference needs to be added.
+    const double halfDelta =
+            (paint.letterSpacing - shapedPaint.letterSpacing) * paint.size * paint.scaleX * 0.5;
+    float* advances = reinterpret_cast<float*>(mData.get() + advancesOffset());
+    const uint8_t* charSpacings = this->charSpacings();
+    uint32_t halfSpaces = 0;
+    for (uint32_t i = 0; i < mAdvanceCount; ++i) {
+        advances[i] += charSpacings[i] * halfDelta;
+        halfSpaces += charSpacings[i];
+    }
+    mAdvance += halfSpaces * halfDelta;
+    float* positions = reinterpret_cast<float*>(mData.get() + positionsOffset());
+    const uint32_t* glyphSpacings = this->glyphSpacings();
+    const size_t stride = mHasYOffsets ? 2 : 1;
+    for (uint32_t i = 0; i < mGlyphCount; ++i) {
+        positions[i * stride] += glyphSpacings[i] * halfDelta;
+    }
+}
+
+LayoutPiece& LayoutPiece::operator=(const LayoutPiece& o) {
+    if (this != &o) {
+        LayoutPiece copy(o);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+void LayoutPiece::pack(const Builder& b) {
+    mGlyphCount = b.glyphIds.size();
+    mAdvanceCount = b.advances.size();
+    mFontCount = b.fonts.size();
+    mHasWideGlyphIds = std::any_of(b.glyphIds.begin(), b.glyphIds.end(),
+                                   [](uint32_t glyphId) { return glyphId > UINT16_MAX; });
+    mHasYOffsets = std::any_of(b.points.begin(), b.points.end(),
+                               [](const Point& point) { return point.y != 0; });
+    mHasLetterSpacings = b.hasLetterSpacings;
+    mData = allocateBytes(dataSize());
+
+    uint8_t* data = mData.get();
+    for (uint32_t i = 0; i < mFontCount; ++i) {
+        new (data + sizeof(FakedFont) * i) FakedFont(b.fonts[i]);
+    }
+    std::copy(b.advances.begin(), b.advances.end(),
+              reinterpret_cast<float*>(data + advancesOffset()));
+    if (mHasYOffsets) {
+        std::copy(b.points.begin(), b.points.end(),
+                  reinterpret_cast<Point*>(data + positionsOffset()));
+    } else {
+        float* xs = reinterpret_cast<float*>(data + positionsOffset());
+        for (uint32_t i = 0; i < mGlyphCount; ++i) {
+            xs[i] = b.points[i].x;
+        }
+    }
+    if (mHasWideGlyphIds) {
+        std::copy(b.glyphIds.begin(), b.glyphIds.end(),
+                  reinterpret_cast<uint32_t*>(data + glyphIdsOffset()));
+    } else {
+        std::copy(b.glyphIds.begin(), b.glyphIds.end(),
+                  reinterpret_cast<uint16_t*>(data + glyphIdsOffset()));
+    }
+    std::copy(b.fontIndices.begin(), b.fontIndices.end(), data + fontIndicesOffset());
+    if (mHasLetterSpacings) {
+        std::copy(b.glyphSpacings.begin(), b.glyphSpacings.end(),
+                  reinterpret_cast<uint32_t*>(data + glyphSpacingsOffset()));
+        std::copy(b.charSpacings.begin(), b.charSpacings.end(), data + charSpacingsOffset());
+    }
+}
+
+MinikinRect LayoutPiece::calculateBounds(const MinikinPaint& paint) const {
+    return GlyphBoundsCache::getInstance().calculateBounds(*this, paint);
 }
 
 }  // namespace minikin
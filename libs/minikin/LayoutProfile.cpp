@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/LayoutProfile.h"
+
+#include <algorithm>
+
+#include "minikin/BoundsCache.h"
+#include "minikin/LocaleList.h"
+
+namespace minikin {
+
+namespace {
+
+// Bump this when changing the format written by LayoutProfile::writeTo().
+constexpr uint32_t kProfileVersion = 1;
+
+constexpr uint8_t kRtlFlag = 1 << 0;
+constexpr uint8_t kNeedBoundsFlag = 1 << 1;
+
+// Returns true if the word can be laid out, i.e. the range is in the text and the enums are known
+// ones, since the profile may be corrupted or written by a different build.
+bool isValidEntry(uint32_t length, uint32_t start, uint32_t end, FamilyVariant familyVariant,
+                  StartHyphenEdit startHyphen, EndHyphenEdit endHyphen) {
+    return start <= end && end <= length && familyVariant <= FamilyVariant::ELEGANT &&
+           startHyphen <= StartHyphenEdit::INSERT_ZWJ &&
+           endHyphen <= EndHyphenEdit::INSERT_ZWJ_AND_HYPHEN;
+}
+
+struct NoOpLayoutFunc {
+    void operator()(const LayoutPiece&, const MinikinPaint&) {}
+};
+
+struct NoOpBoundsFunc {
+    void operator()(const MinikinRect&, float) {}
+};
+
+}  // namespace
+
+void LayoutProfile::recordInternal(const U16StringPiece& text, const Range& range,
+                                   const MinikinPaint& paint, bool dir, StartHyphenEdit startHyphen,
+                                   EndHyphenEdit endHyphen, bool needBounds) {
+    const LayoutCacheKey key(text, range, paint, dir, startHyphen, endHyphen);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mRecords.find(key);
+    if (it != mRecords.end()) {
+        it->second.count++;
+        it->second.needBounds |= needBounds;
+        return;
+    }
+    if (mRecords.size() >= kMaxRecordedWords) {
+        return;
+    }
+    Record record = {std::vector<uint16_t>(text.data(), text.data() + text.size()),
+                     range,
+                     paint,
+                     dir,
+                     startHyphen,
+                     endHyphen,
+                     needBounds,
+                     1};
+    // Moving the record keeps the buffer of the text, which the key refers to.
+    const LayoutCacheKey recordKey(record.text, range, paint, dir, startHyphen, endHyphen);
+    mRecords.emplace(recordKey, std::move(record));
+}
+
+void LayoutProfile::writeTo(BufferWriter* writer, uint32_t maxEntries,
+                            const CollectionIndexFunc& indexOf) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<std::pair<const Record*, int32_t>> records;
+    records.reserve(mRecords.size());
+    for (const auto& [key, record] : mRecords) {
+        const int32_t index = indexOf(*record.paint.font);
+        if (index >= 0) {
+            records.emplace_back(&record, index);
+        }
+    }
+    std::stable_sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
+        return a.first->count > b.first->count;
+    });
+    records.resize(std::min<size_t>(records.size(), maxEntries));
+
+    writer->write<uint32_t>(kProfileVersion);
+    writer->write<uint32_t>(records.size());
+    for (const auto& [record, index] : records) {
+        const MinikinPaint& paint = record->paint;
+        writer->write<uint32_t>(index);
+        writer->writeArray<uint16_t>(record->text.data(), record->text.size());
+        writer->write<uint32_t>(record->range.getStart());
+        writer->write<uint32_t>(record->range.getEnd());
+        writer->write<float>(paint.size);
+        writer->write<float>(paint.scaleX);
+        writer->write<float>(paint.skewX);
+        writer->write<float>(paint.letterSpacing);
+        writer->write<float>(paint.wordSpacing);
+        writer->write<uint32_t>(paint.fontFlags);
+        writer->writeString(getLocaleString(paint.localeListId));
+        paint.fontStyle.writeTo(writer);
+        writer->write<uint8_t>(static_cast<uint8_t>(paint.familyVariant));
+        writer->writeString(paint.fontFeatureSettings.str());
+        writer->write<uint8_t>((record->isRtl ? kRtlFlag : 0) |
+                               (record->needBounds ? kNeedBoundsFlag : 0));
+        writer->write<uint8_t>(static_cast<uint8_t>(record->startHyphen));
+        writer->write<uint8_t>(static_cast<uint8_t>(record->endHyphen));
+    }
+}
+
+// static
+uint32_t LayoutProfile::warmUp(BufferReader* reader, const CollectionResolver& resolve) {
+    if (reader->read<uint32_t>() != kProfileVersion) {
+        return 0;
+    }
+    const uint32_t count = reader->read<uint32_t>();
+    if (count > kMaxRecordedWords) {
+        return 0;
+    }
+    uint32_t laidOut = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t index = reader->read<uint32_t>();
+        const auto [chars, length] = reader->readArray<uint16_t>();
+        const uint32_t start = reader->read<uint32_t>();
+        const uint32_t end = reader->read<uint32_t>();
+        MinikinPaint paint(resolve(index));
+        paint.size = reader->read<float>();
+        paint.scaleX = reader->read<float>();
+        paint.skewX = reader->read<float>();
+        paint.letterSpacing = reader->read<float>();
+        paint.wordSpacing = reader->read<float>();
+        paint.fontFlags = reader->read<uint32_t>();
+        const std::string_view locales = reader->readString();
+        paint.fontStyle = FontStyle(reader);
+        paint.familyVariant = static_cast<FamilyVariant>(reader->read<uint8_t>());
+        paint.fontFeatureSettings = reader->readString();
+        const uint8_t flags = reader->read<uint8_t>();
+        const StartHyphenEdit startHyphen = static_cast<StartHyphenEdit>(reader->read<uint8_t>());
+        const EndHyphenEdit endHyphen = static_cast<EndHyphenEdit>(reader->read<uint8_t>());
+        if (reader->overflowed()) {
+            break;
+        }
+        if (!paint.font || !isValidEntry(length, start, end, paint.familyVariant, startHyphen,
+                                         endHyphen)) {
+            continue;
+        }
+        paint.localeListId = registerLocaleList(std::string(locales));
+
+        const U16StringPiece text(chars, length);
+        const Range range(start, end);
+        const bool isRtl = flags & kRtlFlag;
+        NoOpLayoutFunc layoutFunc;
+        LayoutCache::getInstance().getOrCreate(text, range, paint, isRtl, startHyphen, endHyphen,
+                                               layoutFunc);
+        if (flags & kNeedBoundsFlag) {
+            NoOpBoundsFunc boundsFunc;
+            BoundsCache::getInstance().getOrCreate(text, range, paint, isRtl, startHyphen,
+                                                   endHyphen, boundsFunc);
+        }
+        laidOut++;
+    }
+    return laidOut;
+}
+
+void LayoutProfile::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRecords.clear();
+}
+
+uint32_t LayoutProfile::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRecords.size();
+}
+
+}  // namespace minikin
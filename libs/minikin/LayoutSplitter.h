@@ -21,7 +21,9 @@
 
 #include "minikin/Layout.h"
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <unicode/ubidi.h>
 
@@ -52,10 +54,15 @@ namespace minikin {
 // Output:
 //   Context Range :                      |-------------|
 //   Piece Range   :                          |-------|
+//
+// The word breaks of the range are found in one pass when the splitter is created, and the
+// iterator walks over them.
 class LayoutSplitter {
 public:
     LayoutSplitter(const U16StringPiece& textBuf, const Range& range, bool isRtl)
-            : mTextBuf(textBuf), mRange(range), mIsRtl(isRtl) {}
+            : mRange(range), mIsRtl(isRtl) {
+        getWordBreaksForCache(textBuf, range, &mBreaks);
+    }
 
     class iterator {
     public:
@@ -64,24 +71,21 @@ public:
         bool operator!=(const iterator& o) const { return !(*this == o); }
 
         std::pair<Range, Range> operator*() const {
-            return std::make_pair(mContextRange, mPieceRange);
+            const Range& range = mParent->mRange;
+            const Range contextRange(mParent->mBreaks[mIndex], mParent->mBreaks[mIndex + 1]);
+            const Range pieceRange(std::max(contextRange.getStart(), range.getStart()),
+                                   std::min(contextRange.getEnd(), range.getEnd()));
+            return std::make_pair(contextRange, pieceRange);
         }
 
         iterator& operator++() {
-            const U16StringPiece& textBuf = mParent->mTextBuf;
-            const Range& range = mParent->mRange;
+            const Range piece = (**this).second;
             if (mParent->mIsRtl) {
-                mPos = mPieceRange.getStart();
-                mContextRange.setStart(getPrevWordBreakForCache(textBuf, mPos));
-                mContextRange.setEnd(mPos);
-                mPieceRange.setStart(std::max(mContextRange.getStart(), range.getStart()));
-                mPieceRange.setEnd(mPos);
+                mPos = piece.getStart();
+                mIndex--;
             } else {
-                mPos = mPieceRange.getEnd();
-                mContextRange.setStart(mPos);
-                mContextRange.setEnd(getNextWordBreakForCache(textBuf, mPos));
-                mPieceRange.setStart(mPos);
-                mPieceRange.setEnd(std::min(mContextRange.getEnd(), range.getEnd()));
+                mPos = piece.getEnd();
+                mIndex++;
             }
             return *this;
         }
@@ -89,36 +93,26 @@ public:
     private:
         friend class LayoutSplitter;
 
-        iterator(const LayoutSplitter* parent, uint32_t pos) : mParent(parent), mPos(pos) {
-            const U16StringPiece& textBuf = mParent->mTextBuf;
-            const Range& range = mParent->mRange;
-            if (parent->mIsRtl) {
-                mContextRange.setStart(getPrevWordBreakForCache(textBuf, pos));
-                mContextRange.setEnd(getNextWordBreakForCache(textBuf, pos == 0 ? 0 : pos - 1));
-                mPieceRange.setStart(std::max(mContextRange.getStart(), range.getStart()));
-                mPieceRange.setEnd(pos);
-            } else {
-                mContextRange.setStart(
-                        getPrevWordBreakForCache(textBuf, pos == range.getEnd() ? pos : pos + 1));
-                mContextRange.setEnd(getNextWordBreakForCache(textBuf, pos));
-                mPieceRange.setStart(pos);
-                mPieceRange.setEnd(std::min(mContextRange.getEnd(), range.getEnd()));
-            }
-        }
+        iterator(const LayoutSplitter* parent, uint32_t pos, uint32_t index)
+                : mParent(parent), mPos(pos), mIndex(index) {}
 
         const LayoutSplitter* mParent;
         uint32_t mPos;
-        Range mContextRange;
-        Range mPieceRange;
+        uint32_t mIndex;  // The index of the start of the context range in mParent->mBreaks.
     };
 
-    iterator begin() const { return iterator(this, mIsRtl ? mRange.getEnd() : mRange.getStart()); }
-    iterator end() const { return iterator(this, mIsRtl ? mRange.getStart() : mRange.getEnd()); }
+    iterator begin() const {
+        if (mIsRtl) {
+            return iterator(this, mRange.getEnd(), mBreaks.empty() ? 0 : mBreaks.size() - 2);
+        }
+        return iterator(this, mRange.getStart(), 0);
+    }
+    iterator end() const { return iterator(this, mIsRtl ? mRange.getStart() : mRange.getEnd(), 0); }
 
 private:
-    U16StringPiece mTextBuf;
-    Range mRange;  // The range in the original buffer. Used for range check.
-    bool mIsRtl;   // The paragraph direction.
+    Range mRange;                   // The range in the original buffer. Used for range check.
+    bool mIsRtl;                    // The paragraph direction.
+    std::vector<uint32_t> mBreaks;  // The word breaks covering the range, ascending.
 
     MINIKIN_PREVENT_COPY_AND_ASSIGN(LayoutSplitter);
 };
@@ -16,7 +16,10 @@
 
 #include "LayoutUtils.h"
 
+#include <algorithm>
+
 #include "StringPiece.h"
+#include "minikin/TextScan.h"
 
 namespace minikin {
 
@@ -88,4 +91,34 @@ uint32_t getNextWordBreakForCache(const U16StringPiece& textBuf, uint32_t offset
     return textBuf.size();
 }
 
+// Returns false if the code unit is neither isWordBreakBefore() nor isWordBreakAfter(), with a
+// test simple enough to be vectorized.
+static inline bool mayBeWordBreak(uint16_t c) {
+    return c == ' ' || c >= 0x2000;
+}
+
+void getWordBreaksForCache(const U16StringPiece& textBuf, const Range& range,
+                           std::vector<uint32_t>* breaks) {
+    breaks->clear();
+    if (range.isEmpty()) {
+        return;
+    }
+    const uint16_t* text = textBuf.data();
+    const uint32_t end = range.getEnd();
+    breaks->push_back(getPrevWordBreakForCache(textBuf, range.getStart() + 1));
+    // A break at i depends on the code units at i - 1 and i.
+    scanCandidateBlocks(
+            range.getStart() + 1, end,
+            [text](size_t i) { return mayBeWordBreak(text[i - 1]) | mayBeWordBreak(text[i]); },
+            [text, breaks](size_t blockStart, size_t blockEnd) {
+                for (size_t i = blockStart; i < blockEnd; i++) {
+                    if (isWordBreakBefore(text[i]) || isWordBreakAfter(text[i - 1])) {
+                        breaks->push_back(static_cast<uint32_t>(i));
+                    }
+                }
+                return true;
+            });
+    breaks->push_back(getNextWordBreakForCache(textBuf, end - 1));
+}
+
 }  // namespace minikin
@@ -18,7 +18,9 @@
 #define MINIKIN_LAYOUT_UTILS_H
 
 #include <cstdint>
+#include <vector>
 
+#include "minikin/Range.h"
 #include "minikin/U16StringPiece.h"
 
 namespace minikin {
@@ -46,5 +48,14 @@ uint32_t getPrevWordBreakForCache(const U16StringPiece& textBuf, uint32_t offset
  */
 uint32_t getNextWordBreakForCache(const U16StringPiece& textBuf, uint32_t offset);
 
+/**
+ * Sets breaks to the word breaks covering the range in one pass, in ascending order: the last one
+ * at or before the start, the ones inside the range and the first one at or after the end, i.e.
+ * getPrevWordBreakForCache(start + 1) and then getNextWordBreakForCache() of each one until the
+ * end is reached. Empty for an empty range.
+ */
+void getWordBreaksForCache(const U16StringPiece& textBuf, const Range& range,
+                           std::vector<uint32_t>* breaks);
+
 }  // namespace minikin
 #endif  // MINIKIN_LAYOUT_UTILS_H
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/LineBreakResultCache.h"
+
+#include <algorithm>
+
+namespace minikin {
+
+std::shared_ptr<const LineBreakResult> LineBreakResultCache::get(const LineBreakParams& params) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = std::find_if(mEntries.begin(), mEntries.end(),
+                           [&params](const auto& entry) { return entry.first == params; });
+    if (it == mEntries.end()) {
+        return nullptr;
+    }
+    if (it != mEntries.begin()) {
+        auto entry = std::move(*it);
+        mEntries.erase(it);
+        mEntries.push_front(std::move(entry));
+    }
+    return mEntries.front().second;
+}
+
+void LineBreakResultCache::put(LineBreakParams&& params,
+                               const std::shared_ptr<const LineBreakResult>& result) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Another thread may have put the same params, either result is fine.
+    auto it = std::find_if(mEntries.begin(), mEntries.end(),
+                           [&params](const auto& entry) { return entry.first == params; });
+    if (it != mEntries.end()) {
+        mEntries.erase(it);
+    } else if (mEntries.size() >= kMaxEntries) {
+        mEntries.pop_back();
+    }
+    mEntries.emplace_front(std::move(params), result);
+}
+
+uint32_t LineBreakResultCache::getMemoryUsage() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    uint32_t usage = 0;
+    for (const auto& [params, result] : mEntries) {
+        usage += sizeof(LineBreakParams) + sizeof(float) * params.indents.size() +
+                 sizeof(float) * params.tabStops.size() + sizeof(LineBreakResult) +
+                 result->getMemoryUsage();
+    }
+    return usage;
+}
+
+}  // namespace minikin
@@ -16,22 +16,176 @@
 
 #include "minikin/LineBreaker.h"
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "minikin/ApiTrace.h"
+
 #include "GreedyLineBreaker.h"
+#include "MinikinTrace.h"
 #include "OptimalLineBreaker.h"
+#include "WorkerPool.h"
 
 namespace minikin {
 
+MinikinExtent LineBreakResult::getLineExtent(size_t lineNo, const U16StringPiece& textBuf,
+                                             const MeasuredText& measured) const {
+    if (mDeferredExtents == nullptr) {
+        return MinikinExtent(ascents[lineNo], descents[lineNo]);
+    }
+    std::call_once(mDeferredExtents->computed[lineNo], [&]() {
+        const uint32_t lineStart = lineNo == 0 ? 0 : breakPoints[lineNo - 1];
+        mDeferredExtents->extents[lineNo] =
+                measured.getExtent(textBuf, Range(lineStart, breakPoints[lineNo]));
+    });
+    return mDeferredExtents->extents[lineNo];
+}
+
+void LineBreakResult::deferExtents() {
+    mDeferredExtents = std::make_unique<DeferredExtents>();
+    mDeferredExtents->computed = std::make_unique<std::once_flag[]>(breakPoints.size());
+    mDeferredExtents->extents = std::make_unique<MinikinExtent[]>(breakPoints.size());
+}
+
 LineBreakResult breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
                                HyphenationFrequency frequency, bool justified,
                                const MeasuredText& measuredText, const LineWidth& lineWidth,
                                const TabStops& tabStops) {
-    if (strategy == BreakStrategy::Greedy || textBuffer.hasChar(CHAR_TAB)) {
-        return breakLineGreedy(textBuffer, measuredText, lineWidth, tabStops,
-                               frequency != HyphenationFrequency::None);
+    MINIKIN_TRACE_NAME("breakIntoLines");
+    LineBreakResult result =
+            (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab)
+                    ? breakLineGreedy(textBuffer, measuredText, lineWidth, tabStops,
+                                      frequency != HyphenationFrequency::None)
+                    : breakLineOptimal(textBuffer, measuredText, lineWidth, strategy, frequency,
+                                       justified);
+    ApiTrace::getInstance().recordBreakIntoLines(textBuffer, strategy, frequency, justified,
+                                                 measuredText, lineWidth, tabStops,
+                                                 std::numeric_limits<uint32_t>::max(),
+                                                 result.breakPoints.size());
+    return result;
+}
+
+LineBreakResult breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                               HyphenationFrequency frequency, bool justified,
+                               const MeasuredText& measuredText, const LineWidth& lineWidth,
+                               const TabStops& tabStops, uint32_t maxLines) {
+    MINIKIN_TRACE_NAME("breakIntoLines");
+    LineBreakResult result =
+            (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab)
+                    ? breakLineGreedy(textBuffer, measuredText, lineWidth, tabStops,
+                                      frequency != HyphenationFrequency::None, maxLines)
+                    : breakLineOptimal(textBuffer, measuredText, lineWidth, strategy, frequency,
+                                       justified, maxLines);
+    ApiTrace::getInstance().recordBreakIntoLines(textBuffer, strategy, frequency, justified,
+                                                 measuredText, lineWidth, tabStops, maxLines,
+                                                 result.breakPoints.size());
+    return result;
+}
+
+void breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                    HyphenationFrequency frequency, bool justified,
+                    const MeasuredText& measuredText, const LineWidth& lineWidth,
+                    const TabStops& tabStops, uint32_t maxLines, LineBreakScratch* scratch,
+                    LineBreakResult* result) {
+    MINIKIN_TRACE_NAME("breakIntoLines");
+    if (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab) {
+        breakLineGreedy(textBuffer, measuredText, lineWidth, tabStops,
+                        frequency != HyphenationFrequency::None, maxLines, result);
     } else {
+        breakLineOptimal(textBuffer, measuredText, lineWidth, strategy, frequency, justified,
+                         maxLines, scratch->optimal(), result);
+    }
+    ApiTrace::getInstance().recordBreakIntoLines(textBuffer, strategy, frequency, justified,
+                                                 measuredText, lineWidth, tabStops, maxLines,
+                                                 result->breakPoints.size());
+}
+
+LineBreakResult breakIntoLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                               HyphenationFrequency frequency, bool justified,
+                               const MeasuredText& measuredText, const LineWidth& lineWidth,
+                               const TabStops& tabStops, const LineBreakResult& prev,
+                               const TextEdit& edit) {
+    MINIKIN_TRACE_NAME("breakIntoLines");
+    if (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab) {
+        return breakLineGreedyIncremental(textBuffer, measuredText, lineWidth, tabStops,
+                                          frequency != HyphenationFrequency::None, prev, edit);
+    } else {
+        // An edit may change any break of the optimal line breaking before it, since the breaks
+        // minimize the penalty of the whole paragraph, so the whole text is broken again.
         return breakLineOptimal(textBuffer, measuredText, lineWidth, strategy, frequency,
                                 justified);
     }
 }
 
+uint32_t countLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                    HyphenationFrequency frequency, bool justified,
+                    const MeasuredText& measuredText, const LineWidth& lineWidth,
+                    const TabStops& tabStops) {
+    if (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab) {
+        return countLinesGreedy(textBuffer, measuredText, lineWidth, tabStops,
+                                frequency != HyphenationFrequency::None);
+    } else {
+        return countLinesOptimal(textBuffer, measuredText, lineWidth, strategy, frequency,
+                                 justified);
+    }
+}
+
+std::vector<LineBreakResult> breakIntoLines(const U16StringPiece& textBuffer,
+                                            BreakStrategy strategy, HyphenationFrequency frequency,
+                                            bool justified, const MeasuredText& measuredText,
+                                            const std::vector<const LineWidth*>& lineWidths,
+                                            const TabStops& tabStops) {
+    MINIKIN_TRACE_NAME("breakIntoLines");
+    if (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab) {
+        std::vector<LineBreakResult> results;
+        for (const LineWidth* lineWidth : lineWidths) {
+            results.push_back(breakLineGreedy(textBuffer, measuredText, *lineWidth, tabStops,
+                                              frequency != HyphenationFrequency::None));
+        }
+        return results;
+    } else {
+        return breakLineOptimal(textBuffer, measuredText, lineWidths, strategy, frequency,
+                                justified);
+    }
+}
+
+std::vector<uint32_t> countLines(const U16StringPiece& textBuffer, BreakStrategy strategy,
+                                 HyphenationFrequency frequency, bool justified,
+                                 const MeasuredText& measuredText,
+                                 const std::vector<const LineWidth*>& lineWidths,
+                                 const TabStops& tabStops) {
+    if (strategy == BreakStrategy::Greedy || measuredText.getTextClass().hasTab) {
+        std::vector<uint32_t> counts;
+        for (const LineWidth* lineWidth : lineWidths) {
+            counts.push_back(countLinesGreedy(textBuffer, measuredText, *lineWidth, tabStops,
+                                              frequency != HyphenationFrequency::None));
+        }
+        return counts;
+    } else {
+        return countLinesOptimal(textBuffer, measuredText, lineWidths, strategy, frequency,
+                                 justified);
+    }
+}
+
+std::vector<LineBreakResult> breakParagraphsIntoLines(
+        const std::vector<ParagraphBreakRequest>& requests) {
+    // The threads take the paragraphs one by one, so start from the longest ones. Otherwise a long
+    // paragraph taken last keeps a single thread busy after the others have finished.
+    std::vector<size_t> order(requests.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&requests](size_t l, size_t r) {
+        return requests[l].textBuffer.size() > requests[r].textBuffer.size();
+    });
+
+    std::vector<LineBreakResult> results(requests.size());
+    WorkerPool::getInstance().parallelFor(order.size(), [&](size_t i) {
+        const ParagraphBreakRequest& request = requests[order[i]];
+        results[order[i]] = breakIntoLines(request.textBuffer, request.strategy, request.frequency,
+                                           request.justified, *request.measuredText,
+                                           *request.lineWidth, *request.tabStops);
+    });
+    return results;
+}
+
 }  // namespace minikin
@@ -18,43 +18,59 @@
 
 namespace minikin {
 
-// Very long words trigger O(n^2) behavior in hyphenation, so we disable hyphenation for
-// unreasonably long words. This is somewhat of a heuristic because extremely long words are
-// possible in some languages. This does mean that very long real words can get broken by
-// desperate breaks, with no hyphens.
-constexpr size_t LONGEST_HYPHENATED_WORD = 45;
-
-// Hyphenates a string potentially containing non-breaking spaces.
-std::vector<HyphenationType> hyphenate(const U16StringPiece& str, const Hyphenator& hyphenator) {
-    std::vector<HyphenationType> out;
-    const size_t len = str.size();
-    out.resize(len);
+// Very long words trigger O(n^2) behavior in measuring the hyphenated pieces, so we disable
+// hyphenation for unreasonably long words. This is somewhat of a heuristic because extremely long
+// words are possible in some languages. It is high enough for the long compound words of German,
+// Dutch or Finnish, which would otherwise get broken by desperate breaks, with no hyphens.
+constexpr size_t LONGEST_HYPHENATED_WORD = 100;
 
+void appendHyphenationWords(const U16StringPiece& textBuf, const Range& range,
+                            std::vector<Range>* out) {
     // A word here is any consecutive string of non-NBSP characters.
     bool inWord = false;
-    size_t wordStart = 0;  // The initial value will never be accessed, but just in case.
-    for (size_t i = 0; i <= len; i++) {
-        if (i == len || str[i] == CHAR_NBSP) {
-            if (inWord) {
-                // A word just ended. Hyphenate it.
-                const U16StringPiece word = str.substr(Range(wordStart, i));
-                if (word.size() <= LONGEST_HYPHENATED_WORD) {
-                    hyphenator.hyphenate(word, out.data() + wordStart);
-                } else {  // Word is too long. Inefficient to hyphenate.
-                    out.insert(out.end(), word.size(), HyphenationType::DONT_BREAK);
-                }
-                inWord = false;
-            }
-            if (i < len) {
-                // Insert one DONT_BREAK for the NBSP.
-                out.push_back(HyphenationType::DONT_BREAK);
+    uint32_t wordStart = 0;  // The initial value will never be accessed, but just in case.
+    for (uint32_t i = range.getStart(); i <= range.getEnd(); i++) {
+        if (i == range.getEnd() || textBuf[i] == CHAR_NBSP) {
+            // A word just ended. Hyphenate it unless it is too long, which is inefficient.
+            if (inWord && i - wordStart <= LONGEST_HYPHENATED_WORD) {
+                out->emplace_back(wordStart, i);
             }
+            inWord = false;
         } else if (!inWord) {
             inWord = true;
             wordStart = i;
         }
     }
+}
+
+// Hyphenates a string potentially containing non-breaking spaces.
+std::vector<HyphenationType> hyphenate(const U16StringPiece& str, const Hyphenator& hyphenator) {
+    // The NBSPs and the words too long are not hyphenated.
+    std::vector<HyphenationType> out(str.size(), HyphenationType::DONT_BREAK);
+    std::vector<Range> words;
+    appendHyphenationWords(str, Range(0, str.size()), &words);
+    hyphenator.hyphenateBatch(str, words, out.data());
     return out;
 }
 
+float HyphenAdvanceCache::get(const Run& run, StartHyphenEdit edit) {
+    return get(run, packHyphenEdit(edit, EndHyphenEdit::NO_EDIT), getHyphenString(edit));
+}
+
+float HyphenAdvanceCache::get(const Run& run, EndHyphenEdit edit) {
+    return get(run, packHyphenEdit(StartHyphenEdit::NO_EDIT, edit), getHyphenString(edit));
+}
+
+float HyphenAdvanceCache::get(const Run& run, HyphenEdit edit,
+                              const std::pair<const uint16_t*, size_t>& str) {
+    for (const Entry& entry : mEntries) {
+        if (entry.run == &run && entry.edit == edit) {
+            return entry.advance;
+        }
+    }
+    const float advance = run.measureText(U16StringPiece(str.first, str.second));
+    mEntries.push_back({&run, edit, advance});
+    return advance;
+}
+
 }  // namespace minikin
@@ -41,6 +41,12 @@ typedef float ParaWidth;
 // Hyphenates a string potentially containing non-breaking spaces.
 std::vector<HyphenationType> hyphenate(const U16StringPiece& string, const Hyphenator& hypenator);
 
+// Appends the ranges of the words to be hyphenated in the range of the text, to be passed to
+// Hyphenator::hyphenateBatch. These are the strings between non-breaking spaces which are not too
+// long.
+void appendHyphenationWords(const U16StringPiece& textBuf, const Range& range,
+                            std::vector<Range>* out);
+
 // This function determines whether a character is a space that disappears at end of line.
 // It is the Unicode set: [[:General_Category=Space_Separator:]-[:Line_Break=Glue:]], plus '\n'.
 // Note: all such characters are in the BMP, so it's ok to use code units for this.
@@ -60,64 +66,107 @@ inline Locale getEffectiveLocale(uint32_t localeListId) {
     return localeList.empty() ? Locale() : localeList[0];
 }
 
+// The advances of the hyphen strings, measured once per run and hyphen edit instead of once per
+// hyphenation point. The runs are compared by address, so an instance must not outlive the runs
+// it measured. Not thread safe.
+class HyphenAdvanceCache {
+public:
+    float get(const Run& run, StartHyphenEdit edit);
+    float get(const Run& run, EndHyphenEdit edit);
+
+private:
+    struct Entry {
+        const Run* run;
+        HyphenEdit edit;
+        float advance;
+    };
+
+    float get(const Run& run, HyphenEdit edit, const std::pair<const uint16_t*, size_t>& str);
+
+    // A paragraph has a few runs and a run uses one or two edits, so a linear search is enough.
+    std::vector<Entry> mEntries;
+};
+
+// Returns true if inserting a hyphen into the range doesn't change the shaping of its characters,
+// so that a hyphenated piece is as wide as its characters plus the hyphen, up to the kerning
+// against the hyphen and the ligatures across the hyphenation point, which the characters keep
+// from the unbroken word. This is the case of the scripts without contextual shaping: Latin,
+// Greek, Cyrillic and Armenian.
+inline bool isHyphenShapingIndependent(const U16StringPiece& textBuf, const Range& range) {
+    for (uint32_t i = range.getStart(); i < range.getEnd(); ++i) {
+        const uint16_t c = textBuf[i];
+        if (c >= 0x0590 && !(0x1E00 <= c && c <= 0x1FFF)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Retrieves hyphenation break points from a word.
 inline void populateHyphenationPoints(
         const U16StringPiece& textBuf,         // A text buffer.
         const Run& run,                        // A run of this region.
-        const Hyphenator& hyphenator,          // A hyphenator to be used for hyphenation.
+        const HyphenationType* hyphenResult,   // The hyphenation of the target range.
         const Range& contextRange,             // A context range for measuring hyphenated piece.
         const Range& hyphenationTargetRange,   // An actual range for the hyphenation target.
-        const std::vector<float>& charWidths,  // Char width used for hyphen piece estimation.
+        const MeasuredText& measuredText,      // Char widths used for hyphen piece estimation.
         bool ignoreKerning,                    // True use full shaping for hyphenation piece.
+        HyphenAdvanceCache* hyphenAdvances,    // If not null, the pieces of the words whose
+                                               // shaping is independent of the hyphen are
+                                               // estimated with the cached hyphen advances.
         std::vector<HyphenBreak>* out,         // An output to be appended.
         LayoutPieces* pieces) {                // An output of layout pieces. Maybe null.
     if (!run.getRange().contains(contextRange) || !contextRange.contains(hyphenationTargetRange)) {
         return;
     }
+    const bool estimateWord = hyphenAdvances != nullptr && !ignoreKerning &&
+                              isHyphenShapingIndependent(textBuf, contextRange);
 
-    const std::vector<HyphenationType> hyphenResult =
-            hyphenate(textBuf.substr(hyphenationTargetRange), hyphenator);
     for (uint32_t i = hyphenationTargetRange.getStart(); i < hyphenationTargetRange.getEnd(); ++i) {
         const HyphenationType hyph = hyphenResult[hyphenationTargetRange.toRangeOffset(i)];
         if (hyph == HyphenationType::DONT_BREAK) {
             continue;  // Not a hyphenation point.
         }
 
-        if (!ignoreKerning) {
+        EndHyphenEdit endEdit = editForThisLine(hyph);
+        StartHyphenEdit startEdit = editForNextLine(hyph);
+        // A replaced character is in the widths, so only the inserted hyphens can be estimated.
+        const bool estimate = ignoreKerning || (estimateWord && !isReplacement(endEdit));
+        if (!estimate) {
             auto hyphenPart = contextRange.split(i);
             U16StringPiece firstText = textBuf.substr(hyphenPart.first);
             U16StringPiece secondText = textBuf.substr(hyphenPart.second);
             const float first =
                     run.measureHyphenPiece(firstText, Range(0, firstText.size()),
                                            StartHyphenEdit::NO_EDIT /* start hyphen edit */,
-                                           editForThisLine(hyph) /* end hyphen edit */, pieces);
+                                           endEdit /* end hyphen edit */, pieces);
             const float second =
                     run.measureHyphenPiece(secondText, Range(0, secondText.size()),
-                                           editForNextLine(hyph) /* start hyphen edit */,
+                                           startEdit /* start hyphen edit */,
                                            EndHyphenEdit::NO_EDIT /* end hyphen edit */, pieces);
 
             out->emplace_back(i, hyph, first, second);
         } else {
-            float first = 0;
-            float second = 0;
-            for (uint32_t j = contextRange.getStart(); j < i; ++j) {
-                first += charWidths[j];
-            }
-            for (uint32_t j = i; j < contextRange.getEnd(); ++j) {
-                second += charWidths[j];
-            }
-
-            EndHyphenEdit endEdit = editForThisLine(hyph);
-            StartHyphenEdit startEdit = editForNextLine(hyph);
+            auto hyphenPart = contextRange.split(i);
+            float first = measuredText.getWidth(hyphenPart.first);
+            float second = measuredText.getWidth(hyphenPart.second);
 
             if (endEdit != EndHyphenEdit::NO_EDIT) {
-                auto [str, strSize] = getHyphenString(endEdit);
-                first += run.measureText(U16StringPiece(str, strSize));
+                if (hyphenAdvances != nullptr) {
+                    first += hyphenAdvances->get(run, endEdit);
+                } else {
+                    auto [str, strSize] = getHyphenString(endEdit);
+                    first += run.measureText(U16StringPiece(str, strSize));
+                }
             }
 
             if (startEdit != StartHyphenEdit::NO_EDIT) {
-                auto [str, strSize] = getHyphenString(startEdit);
-                second += run.measureText(U16StringPiece(str, strSize));
+                if (hyphenAdvances != nullptr) {
+                    second += hyphenAdvances->get(run, startEdit);
+                } else {
+                    auto [str, strSize] = getHyphenString(startEdit);
+                    second += run.measureText(U16StringPiece(str, strSize));
+                }
             }
 
             out->emplace_back(i, hyph, first, second);
@@ -171,7 +220,11 @@ struct CharProcessor {
     // Returns the break penalty for the current word break point.
     inline int wordBreakPenalty() const { return breaker.breakBadness(); }
 
-    CharProcessor(const U16StringPiece& text) { breaker.setText(text.data(), text.size()); }
+    // The word breaks are taken from the record where it has them.
+    CharProcessor(const U16StringPiece& text, const WordBreakRecord& record) {
+        breaker.setText(text.data(), text.size());
+        breaker.setRecord(&record);
+    }
 
     // The user of CharProcessor must call updateLocaleIfNecessary with valid locale at least one
     // time before feeding characters.
@@ -215,7 +268,9 @@ private:
     // The current locale list id.
     uint32_t localeListId = LocaleListCache::kInvalidListId;
 
-    WordBreaker breaker;
+    // The word breaker of the thread, kept from one paragraph to the next.
+    ScopedWordBreaker scopedBreaker;
+    WordBreaker& breaker = scopedBreaker.get();
 };
 }  // namespace minikin
 
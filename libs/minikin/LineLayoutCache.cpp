@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/LineLayoutCache.h"
+
+namespace minikin {
+
+LineLayoutCache::LineLayoutCache()
+        : mEnabled(false),
+          mCache(android::LruCache<LineLayoutCacheKey,
+                                   std::shared_ptr<const Layout>>::kUnlimitedCapacity),
+          mMemoryBudget(0),
+          mMemoryUsage(0) {
+    mCache.setOnEntryRemovedListener(this);
+}
+
+LineLayoutCache::~LineLayoutCache() {
+    clear();
+}
+
+std::shared_ptr<const Layout> LineLayoutCache::getOrCreate(const U16StringPiece& text,
+                                                           const Range& range, Bidi bidiFlags,
+                                                           const MinikinPaint& paint,
+                                                           StartHyphenEdit startHyphen,
+                                                           EndHyphenEdit endHyphen) {
+    if (!isEnabled()) {
+        return std::make_shared<const Layout>(text, range, bidiFlags, paint, startHyphen,
+                                              endHyphen, true /* share pieces */);
+    }
+    if (text.size() > kMaxTextLength) {
+        mStats.recordBypass(CacheStats::BypassReason::TooLong);
+        return std::make_shared<const Layout>(text, range, bidiFlags, paint, startHyphen,
+                                              endHyphen, true /* share pieces */);
+    }
+    LineLayoutCacheKey key(text, range, bidiFlags, paint, startHyphen, endHyphen);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const std::shared_ptr<const Layout>& layout = mCache.get(key);
+        if (layout) {
+            mStats.recordHit();
+            return layout;
+        }
+    }
+    // Doing text layout takes long time, so releases the mutex during doing layout.
+    // Don't care even if we do the same layout in other thread.
+    const CacheStats::TimePoint start = CacheStats::now();
+    std::shared_ptr<const Layout> layout = std::make_shared<const Layout>(
+            text, range, bidiFlags, paint, startHyphen, endHyphen, true /* share pieces */);
+    mStats.recordMiss(start);
+    key.copyText();
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mCache.put(key, layout)) {
+        // The same layout has been inserted by other thread.
+        key.freeText();
+        return layout;
+    }
+    mMemoryUsage += key.getMemoryUsage() + layout->getMemoryUsage();
+    trimLocked(mMemoryBudget);
+    return layout;
+}
+
+void LineLayoutCache::setMemoryBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMemoryBudget = bytes;
+    mEnabled.store(bytes != 0, std::memory_order_relaxed);
+    if (bytes == 0) {
+        mCache.clear();
+    } else {
+        trimLocked(bytes);
+    }
+}
+
+void LineLayoutCache::trimLocked(size_t bytes) {
+    while (mMemoryUsage > bytes) {
+        if (!mCache.removeOldest()) {
+            break;
+        }
+        mStats.recordEvictions(1);
+    }
+}
+
+void LineLayoutCache::operator()(LineLayoutCacheKey& key, std::shared_ptr<const Layout>& value) {
+    mMemoryUsage -= key.getMemoryUsage() + value->getMemoryUsage();
+    key.freeText();
+    value.reset();
+}
+
+void LineLayoutCache::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCache.clear();
+}
+
+void LineLayoutCache::removeCollections(const std::unordered_set<uint32_t>& collectionIds) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    removeCollectionEntries(mCache, collectionIds);
+}
+
+void LineLayoutCache::trim(uint32_t percent) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (percent < 100) {
+        trimLocked(mMemoryUsage * percent / 100);
+    }
+}
+
+uint32_t LineLayoutCache::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCache.size();
+}
+
+size_t LineLayoutCache::getMemoryUsage() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMemoryUsage;
+}
+
+}  // namespace minikin
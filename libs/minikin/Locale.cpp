@@ -513,7 +513,7 @@ static hb_language_t buildHbLanguage(const Locale& locale) {
 LocaleList::LocaleList(std::vector<Locale>&& locales) : mLocales(std::move(locales)) {
     mIsAllTheSameLocale = true;
     mUnionOfSubScriptBits = 0u;
-    mHbLangs.reserve(mLocales.size());
+    mScriptTable.reserve(mLocales.size());
     mEmojiStyle = EmojiStyle::EMPTY;
     const auto firstLanguage = mLocales.empty() ? NO_LANGUAGE : mLocales[0].mLanguage;
     for (const Locale& locale : mLocales) {
@@ -521,11 +521,23 @@ LocaleList::LocaleList(std::vector<Locale>&& locales) : mLocales(std::move(local
         if (mIsAllTheSameLocale && firstLanguage != locale.mLanguage) {
             mIsAllTheSameLocale = false;
         }
-        mHbLangs.push_back(buildHbLanguage(locale));
+        mScriptTable.push_back({locale.mScript, locale.mSubScriptBits, buildHbLanguage(locale)});
         if (mEmojiStyle == EmojiStyle::EMPTY) {
             mEmojiStyle = locale.getEmojiStyle();
         }
     }
 }
 
+hb_language_t LocaleList::getHbLanguageForScript(uint32_t script) const {
+    const uint32_t packedScript = packScript(script);
+    const uint8_t requestedBits = Locale::scriptToSubScriptBits(packedScript);
+    for (const ScriptEntry& entry : mScriptTable) {
+        if (entry.script == packedScript ||
+            Locale::supportsScript(entry.subScriptBits, requestedBits)) {
+            return entry.hbLanguage;
+        }
+    }
+    return mScriptTable[0].hbLanguage;
+}
+
 }  // namespace minikin
@@ -211,19 +211,35 @@ public:
     bool empty() const { return mLocales.empty(); }
     const Locale& operator[](size_t n) const { return mLocales[n]; }
 
-    hb_language_t getHbLanguage(size_t n) const { return mHbLangs[n]; }
+    hb_language_t getHbLanguage(size_t n) const { return mScriptTable[n].hbLanguage; }
+
+    // Returns the HarfBuzz language of the first locale supporting the given ISO 15924 script, or
+    // of the first locale if none does, for shaping a run of the script. The list must not be
+    // empty. Same as looking for the first Locale::supportsScript, but the script is only packed
+    // once and the locales are read from a flat table.
+    hb_language_t getHbLanguageForScript(uint32_t script) const;
 
     // Returns an effective emoji style of this locale list.
     // The effective means the first non empty emoji style in the list.
     EmojiStyle getEmojiStyle() const { return mEmojiStyle; }
 
+    // Returns the bytes held by the list out of line.
+    size_t getMemoryUsage() const {
+        return sizeof(Locale) * mLocales.capacity() + sizeof(ScriptEntry) * mScriptTable.capacity();
+    }
+
 private:
     friend struct Locale;  // for calcScoreFor
 
     std::vector<Locale> mLocales;
 
-    // The languages to be passed to HarfBuzz shaper.
-    std::vector<hb_language_t> mHbLangs;
+    // What getHbLanguageForScript needs of each locale, precomputed.
+    struct ScriptEntry {
+        uint32_t script;  // The packed script of the locale.
+        uint8_t subScriptBits;
+        hb_language_t hbLanguage;  // The language to be passed to HarfBuzz shaper.
+    };
+    std::vector<ScriptEntry> mScriptTable;
     uint8_t mUnionOfSubScriptBits;
     bool mIsAllTheSameLocale;
     EmojiStyle mEmojiStyle;
@@ -18,6 +18,8 @@
 
 #include "LocaleListCache.h"
 
+#include <functional>
+#include <new>
 #include <unordered_set>
 
 #include <log/log.h>
@@ -117,22 +119,106 @@ size_t LocaleListCache::LocaleVectorHash::operator()(const std::vector<Locale>&
     return hasher.hash();
 }
 
+LocaleListCache::LocaleListArray::~LocaleListArray() {
+    const uint32_t size = mSize.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < size; ++i) {
+        const auto [chunk, offset] = locate(i);
+        mChunks[chunk].load(std::memory_order_relaxed)[offset].~LocaleList();
+    }
+    for (std::atomic<LocaleList*>& chunk : mChunks) {
+        ::operator delete(chunk.load(std::memory_order_relaxed));
+    }
+}
+
+uint32_t LocaleListCache::LocaleListArray::append(LocaleList&& list) {
+    const uint32_t index = mSize.load(std::memory_order_relaxed);
+    const auto [chunk, offset] = locate(index);
+    LocaleList* lists = mChunks[chunk].load(std::memory_order_relaxed);
+    if (lists == nullptr) {
+        // The storage only, the lists are constructed when appended.
+        lists = static_cast<LocaleList*>(
+                ::operator new(sizeof(LocaleList) * (kFirstChunkSize << chunk)));
+        mChunks[chunk].store(lists, std::memory_order_release);
+    }
+    new (lists + offset) LocaleList(std::move(list));
+    // Publishes the list to the readers which check the size.
+    mSize.store(index + 1, std::memory_order_release);
+    return index;
+}
+
+size_t LocaleListCache::LocaleListArray::getMemoryUsage() const {
+    const uint32_t size = mSize.load(std::memory_order_relaxed);
+    size_t bytes = 0;
+    for (uint32_t chunk = 0; chunk < kChunkCount; ++chunk) {
+        if (mChunks[chunk].load(std::memory_order_relaxed) != nullptr) {
+            bytes += sizeof(LocaleList) * (kFirstChunkSize << chunk);
+        }
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+        bytes += get(i).getMemoryUsage();
+    }
+    return bytes;
+}
+
+uint32_t LocaleListCache::StringIdTable::find(const std::string& locales) const {
+    for (size_t i = std::hash<std::string>()(locales);; ++i) {
+        const Entry* entry = mSlots[i & (kSlotCount - 1)].load(std::memory_order_acquire);
+        if (entry == nullptr) {
+            return kInvalidListId;
+        }
+        if (entry->locales == locales) {
+            return entry->id;
+        }
+    }
+}
+
+void LocaleListCache::StringIdTable::add(const std::string& locales, uint32_t id) {
+    if (mEntries.size() >= kMaxEntries) {
+        return;
+    }
+    mEntries.push_back(std::make_unique<Entry>(Entry{locales, id}));
+    for (size_t i = std::hash<std::string>()(locales);; ++i) {
+        std::atomic<const Entry*>& slot = mSlots[i & (kSlotCount - 1)];
+        if (slot.load(std::memory_order_relaxed) == nullptr) {
+            // Publishes the entry to the readers.
+            slot.store(mEntries.back().get(), std::memory_order_release);
+            return;
+        }
+    }
+}
+
+size_t LocaleListCache::StringIdTable::getMemoryUsage() const {
+    size_t bytes = sizeof(Entry*) * mEntries.capacity();
+    for (const std::unique_ptr<Entry>& entry : mEntries) {
+        bytes += sizeof(Entry) + entry->locales.capacity();
+    }
+    return bytes;
+}
+
 LocaleListCache::LocaleListCache() {
     // Insert an empty locale list for mapping default locale list to kEmptyLocaleListId.
     // The default locale list has only one Locale and it is the unsupported locale.
-    mLocaleLists.emplace_back();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLocaleLists.append(LocaleList());
     mLocaleListLookupTable.emplace(std::vector<Locale>(), kEmptyLocaleListId);
     mLocaleListStringCache.emplace("", kEmptyLocaleListId);
+    mLocaleListStringTable.add("", kEmptyLocaleListId);
 }
 
 uint32_t LocaleListCache::getIdInternal(const std::string& locales) {
-    std::lock_guard<std::mutex> lock(mMutex);
+    // Most of the strings are registered again and again, e.g. on every Paint.setTextLocales.
+    const uint32_t cachedId = mLocaleListStringTable.find(locales);
+    if (cachedId != kInvalidListId) {
+        return cachedId;
+    }
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
     const auto& it = mLocaleListStringCache.find(locales);
     if (it != mLocaleListStringCache.end()) {
         return it->second;
     }
     uint32_t id = getIdInternal(parseLocaleList(locales));
     mLocaleListStringCache.emplace(locales, id);
+    mLocaleListStringTable.add(locales, id);
     return id;
 }
 
@@ -148,34 +234,52 @@ uint32_t LocaleListCache::getIdInternal(std::vector<Locale>&& locales) {
     // Given locale list is not in cache. Insert it and return newly assigned ID.
     const uint32_t nextId = mLocaleLists.size();
     mLocaleListLookupTable.emplace(locales, nextId);
-    LocaleList fontLocales(std::move(locales));
-    mLocaleLists.push_back(std::move(fontLocales));
+    mLocaleLists.append(LocaleList(std::move(locales)));
     return nextId;
 }
 
 uint32_t LocaleListCache::readFromInternal(BufferReader* reader) {
-    uint32_t size = reader->read<uint32_t>();
+    const auto& [identifiers, size] = reader->readArray<uint64_t>();
     std::vector<Locale> locales;
     locales.reserve(size);
     for (uint32_t i = 0; i < size; i++) {
-        locales.emplace_back(reader->read<uint64_t>());
+        locales.emplace_back(identifiers[i]);
     }
-    std::lock_guard<std::mutex> lock(mMutex);
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
     return getIdInternal(std::move(locales));
 }
 
 void LocaleListCache::writeToInternal(BufferWriter* writer, uint32_t id) {
     const LocaleList& localeList = getByIdInternal(id);
-    writer->write<uint32_t>(localeList.size());
+    uint64_t* identifiers = writer->reserveArray<uint64_t>(localeList.size());
+    if (identifiers == nullptr) {
+        return;
+    }
     for (size_t i = 0; i < localeList.size(); i++) {
-        writer->write<uint64_t>(localeList[i].getIdentifier());
+        identifiers[i] = localeList[i].getIdentifier();
     }
 }
 
-const LocaleList& LocaleListCache::getByIdInternal(uint32_t id) {
-    std::lock_guard<std::mutex> lock(mMutex);
+size_t LocaleListCache::getMemoryUsageInternal() {
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
+    // The nodes of the maps are counted with their next pointers, and the buckets as pointers.
+    size_t bytes = mLocaleLists.getMemoryUsage() + mLocaleListStringTable.getMemoryUsage() +
+                   sizeof(void*) * (mLocaleListLookupTable.bucket_count() +
+                                    mLocaleListStringCache.bucket_count());
+    for (const auto& [locales, id] : mLocaleListLookupTable) {
+        bytes += sizeof(void*) + sizeof(decltype(mLocaleListLookupTable)::value_type) +
+                 sizeof(Locale) * locales.capacity();
+    }
+    for (const auto& [locales, id] : mLocaleListStringCache) {
+        bytes += sizeof(void*) + sizeof(decltype(mLocaleListStringCache)::value_type) +
+                 locales.capacity();
+    }
+    return bytes;
+}
+
+const LocaleList& LocaleListCache::getByIdInternal(uint32_t id) const {
     MINIKIN_ASSERT(id < mLocaleLists.size(), "Lookup by unknown locale list ID.");
-    return mLocaleLists[id];
+    return mLocaleLists.get(id);
 }
 
 }  // namespace minikin
@@ -17,10 +17,15 @@
 #ifndef MINIKIN_LOCALE_LIST_CACHE_H
 #define MINIKIN_LOCALE_LIST_CACHE_H
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
 
 #include "minikin/Buffer.h"
+#include "minikin/CacheStats.h"
 #include "minikin/Macros.h"
 
 #include "Locale.h"
@@ -50,11 +55,91 @@ public:
         return getInstance().getByIdInternal(id);
     }
 
+    // The contention on the lock taken by the lookups missing the lock-free string table.
+    static inline const LockStats& getLockStats() { return getInstance().mLockStats; }
+
+    // Returns the bytes of the locale lists and of the tables looking them up. The lists are never
+    // evicted, so this only grows with the number of distinct lists.
+    static size_t getMemoryUsage() { return getInstance().getMemoryUsageInternal(); }
+
 private:
     struct LocaleVectorHash {
         size_t operator()(const std::vector<Locale>& locales) const;
     };
 
+    // An append-only array of the locale lists. The lists are stored in chunks doubling in size
+    // which are never moved or freed until the cache is destroyed, so that get() can read them
+    // without locking while append() adds new lists. Only append() must be serialized.
+    class LocaleListArray {
+    public:
+        LocaleListArray() {}
+        ~LocaleListArray();
+
+        // Returns the number of the lists appended so far.
+        uint32_t size() const { return mSize.load(std::memory_order_acquire); }
+
+        // The index must be less than size().
+        const LocaleList& get(uint32_t index) const {
+            const auto [chunk, offset] = locate(index);
+            return mChunks[chunk].load(std::memory_order_acquire)[offset];
+        }
+
+        // Appends the list and returns its index.
+        uint32_t append(LocaleList&& list);
+
+        // Must be serialized with append().
+        size_t getMemoryUsage() const;
+
+    private:
+        static constexpr uint32_t kFirstChunkBits = 6;
+        static constexpr uint64_t kFirstChunkSize = 1u << kFirstChunkBits;
+        // Enough chunks for all the 32-bit indices.
+        static constexpr uint32_t kChunkCount = 33 - kFirstChunkBits;
+
+        // Returns the chunk and the offset in the chunk of the index. The chunk i holds the
+        // indices from kFirstChunkSize * (2^i - 1), and kFirstChunkSize * 2^i of them.
+        static std::pair<uint32_t, uint32_t> locate(uint32_t index) {
+            const uint64_t biased = index + kFirstChunkSize;
+            const uint32_t bit = 63 - __builtin_clzll(biased);
+            return {bit - kFirstChunkBits, static_cast<uint32_t>(biased - (1ull << bit))};
+        }
+
+        std::atomic<LocaleList*> mChunks[kChunkCount] = {};
+        std::atomic<uint32_t> mSize = {0};
+    };
+
+    // A fixed size hash table from the strings given to getId to the IDs, read without locking.
+    // The entries are never removed, so the table stops taking new strings once half full, and
+    // the other strings are looked up in mLocaleListStringCache with the lock held.
+    class StringIdTable {
+    public:
+        StringIdTable() {}
+
+        // Returns the ID of the string, or kInvalidListId if the string is not in the table.
+        uint32_t find(const std::string& locales) const;
+
+        // Adds the string if the table is not full. Must be serialized.
+        void add(const std::string& locales, uint32_t id);
+
+        // Must be serialized with add().
+        size_t getMemoryUsage() const;
+
+    private:
+        struct Entry {
+            std::string locales;
+            uint32_t id;
+        };
+
+        // A power of two, for masking the hash.
+        static constexpr size_t kSlotCount = 1024;
+        // Keeps the probe sequences short and ending in an empty slot.
+        static constexpr size_t kMaxEntries = kSlotCount / 2;
+
+        std::atomic<const Entry*> mSlots[kSlotCount] = {};
+        // Owns the entries. Only touched by add().
+        std::vector<std::unique_ptr<Entry>> mEntries;
+    };
+
     LocaleListCache();  // Singleton
     ~LocaleListCache() {}
 
@@ -62,7 +147,9 @@ private:
     uint32_t getIdInternal(std::vector<Locale>&& locales) EXCLUSIVE_LOCKS_REQUIRED(mMutex);
     uint32_t readFromInternal(BufferReader* reader);
     void writeToInternal(BufferWriter* writer, uint32_t id);
-    const LocaleList& getByIdInternal(uint32_t id);
+    size_t getMemoryUsageInternal();
+    // Doesn't lock, see LocaleListArray.
+    const LocaleList& getByIdInternal(uint32_t id) const;
 
     // Caller should acquire a lock before calling the method.
     static LocaleListCache& getInstance() {
@@ -70,7 +157,8 @@ private:
         return instance;
     }
 
-    std::vector<LocaleList> mLocaleLists GUARDED_BY(mMutex);
+    // Appended with mMutex held, read without it.
+    LocaleListArray mLocaleLists;
 
     // A map from the list of locale identifier to the ID.
     //
@@ -85,7 +173,11 @@ private:
     // mLocaleListLookupTable even if they are not in mLocaleListStringCache.
     std::unordered_map<std::string, uint32_t> mLocaleListStringCache GUARDED_BY(mMutex);
 
+    // The lock-free front of mLocaleListStringCache. Added to with mMutex held.
+    StringIdTable mLocaleListStringTable;
+
     std::mutex mMutex;
+    LockStats mLockStats;
 };
 
 }  // namespace minikin
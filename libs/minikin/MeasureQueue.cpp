@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MeasureQueue.h"
+
+namespace minikin {
+
+namespace {
+
+thread_local const std::atomic<bool>* gCurrentCancelled = nullptr;
+
+}  // namespace
+
+MeasureCancellationScope::MeasureCancellationScope(const std::atomic<bool>* cancelled)
+        : mCancelled(cancelled), mOuter(gCurrentCancelled) {
+    gCurrentCancelled = mCancelled;
+}
+
+MeasureCancellationScope::~MeasureCancellationScope() {
+    gCurrentCancelled = mOuter;
+}
+
+// static
+const std::atomic<bool>* MeasureCancellationScope::getCurrent() {
+    return gCurrentCancelled;
+}
+
+MeasureHandle::MeasureHandle(std::shared_ptr<MeasureRequest> request)
+        : mRequest(std::move(request)) {}
+
+MeasureHandle::~MeasureHandle() {}
+
+void MeasureHandle::cancel() {
+    mRequest->cancelled.store(true, std::memory_order_relaxed);
+    mRequest->token.cancel();
+    std::lock_guard<std::mutex> lock(mRequest->mutex);
+    if (!mRequest->started && !mRequest->done) {
+        // The queue skips the request, so there is nothing to wait for.
+        mRequest->done = true;
+        mRequest->doneCv.notify_all();
+    }
+}
+
+bool MeasureHandle::isDone() const {
+    std::lock_guard<std::mutex> lock(mRequest->mutex);
+    return mRequest->done;
+}
+
+std::unique_ptr<MeasuredText> MeasureHandle::get() {
+    std::unique_lock<std::mutex> lock(mRequest->mutex);
+    mRequest->doneCv.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(mRequest->mutex) {
+        return mRequest->done;
+    });
+    return std::move(mRequest->result);
+}
+
+std::unique_ptr<MeasureHandle> MeasuredTextBuilder::buildAsync(const U16StringPiece& textBuf,
+                                                               bool computeHyphenation,
+                                                               bool computeLayout,
+                                                               bool ignoreHyphenKerning,
+                                                               MeasurePriority priority) {
+    std::shared_ptr<MeasureRequest> request = std::make_shared<MeasureRequest>();
+    request->text.assign(textBuf.data(), textBuf.data() + textBuf.size());
+    request->builder = std::make_unique<MeasuredTextBuilder>();
+    request->builder->mRuns = std::move(mRuns);
+    request->computeHyphenation = computeHyphenation;
+    request->computeLayout = computeLayout;
+    request->ignoreHyphenKerning = ignoreHyphenKerning;
+    request->priority = priority;
+    MeasureQueue::getInstance().post(request);
+    return std::make_unique<MeasureHandle>(std::move(request));
+}
+
+// static
+MeasureQueue& MeasureQueue::getInstance() {
+    // Intentionally leaked so that the thread is never joined during the process exit.
+    static MeasureQueue* queue = new MeasureQueue();
+    return *queue;
+}
+
+MeasureQueue::MeasureQueue() : mExecutor(Executor::getInstance()) {
+    if (mExecutor == nullptr) {
+        mThread = std::thread(&MeasureQueue::threadLoop, this);
+    }
+}
+
+void MeasureQueue::post(const std::shared_ptr<MeasureRequest>& request) {
+    if (mExecutor != nullptr) {
+        mExecutor->execute([request]() { measure(request.get()); },
+                           request->priority == MeasurePriority::High ? TaskPriority::High
+                                                                      : TaskPriority::Low,
+                           request->token);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (request->priority == MeasurePriority::High) {
+            mHighRequests.push_back(request);
+        } else {
+            mLowRequests.push_back(request);
+        }
+    }
+    mCv.notify_one();
+}
+
+void MeasureQueue::threadLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCv.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+            return !mHighRequests.empty() || !mLowRequests.empty();
+        });
+        std::deque<std::shared_ptr<MeasureRequest>>& requests =
+                mHighRequests.empty() ? mLowRequests : mHighRequests;
+        std::shared_ptr<MeasureRequest> request = std::move(requests.front());
+        requests.pop_front();
+        lock.unlock();
+        measure(request.get());
+        lock.lock();
+    }
+}
+
+// static
+void MeasureQueue::measure(MeasureRequest* request) {
+    {
+        std::lock_guard<std::mutex> lock(request->mutex);
+        if (request->done) {
+            return;  // Cancelled before it started.
+        }
+        request->started = true;
+    }
+    std::unique_ptr<MeasuredText> result;
+    {
+        MeasureCancellationScope scope(&request->cancelled);
+        result = request->builder->build(request->text, request->computeHyphenation,
+                                         request->computeLayout, request->ignoreHyphenKerning,
+                                         nullptr /* no hint */);
+    }
+    std::lock_guard<std::mutex> lock(request->mutex);
+    if (!request->cancelled.load(std::memory_order_relaxed)) {
+        request->result = std::move(result);
+    }
+    request->done = true;
+    request->doneCv.notify_all();
+}
+
+}  // namespace minikin
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_MEASURE_QUEUE_H
+#define MINIKIN_MEASURE_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "minikin/Executor.h"
+#include "minikin/Macros.h"
+#include "minikin/MeasuredText.h"
+
+namespace minikin {
+
+// A measurement requested with MeasuredTextBuilder::buildAsync, shared by its MeasureHandle and
+// the MeasureQueue.
+struct MeasureRequest {
+    // The text is copied since the caller may release it before the measurement runs.
+    std::vector<uint16_t> text;
+    std::unique_ptr<MeasuredTextBuilder> builder;
+    bool computeHyphenation;
+    bool computeLayout;
+    bool ignoreHyphenKerning;
+    MeasurePriority priority;
+
+    std::atomic<bool> cancelled = {false};
+    // Lets the Executor drop the task of the request once it is cancelled.
+    CancellationToken token;
+
+    std::mutex mutex;
+    std::condition_variable doneCv;
+    bool started GUARDED_BY(mutex) = false;
+    bool done GUARDED_BY(mutex) = false;
+    std::unique_ptr<MeasuredText> result GUARDED_BY(mutex);
+};
+
+// A background thread measuring the requests of MeasuredTextBuilder::buildAsync one at a time,
+// the ones of MeasurePriority::High first and in the order of the requests otherwise. If an
+// Executor is registered, the requests are its tasks instead and there is no thread.
+class MeasureQueue {
+public:
+    // Returns the process wide queue, whose thread is started on the first call.
+    static MeasureQueue& getInstance();
+
+    void post(const std::shared_ptr<MeasureRequest>& request);
+
+private:
+    MeasureQueue();
+
+    void threadLoop();
+    static void measure(MeasureRequest* request);
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::deque<std::shared_ptr<MeasureRequest>> mHighRequests GUARDED_BY(mMutex);
+    std::deque<std::shared_ptr<MeasureRequest>> mLowRequests GUARDED_BY(mMutex);
+    Executor* const mExecutor;
+    std::thread mThread;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(MeasureQueue);
+};
+
+// Lets the measurements on this thread stop early while the instance is alive, once the flag is
+// set. They check it between the runs and the words, so the pieces shaped until then are still
+// put in the LayoutCache.
+class MeasureCancellationScope {
+public:
+    explicit MeasureCancellationScope(const std::atomic<bool>* cancelled);
+    ~MeasureCancellationScope();
+
+    // Returns the flag of the innermost instance alive on this thread, or nullptr.
+    static const std::atomic<bool>* getCurrent();
+
+    // Returns true if the measurements on this thread should stop.
+    static bool isCancelled() {
+        const std::atomic<bool>* cancelled = getCurrent();
+        return cancelled != nullptr && cancelled->load(std::memory_order_relaxed);
+    }
+
+private:
+    const std::atomic<bool>* mCancelled;
+    const std::atomic<bool>* mOuter;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(MeasureCancellationScope);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_MEASURE_QUEUE_H
@@ -17,32 +17,68 @@
 #define LOG_TAG "Minikin"
 #include "minikin/MeasuredText.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <unordered_map>
+
+#include "minikin/ApiTrace.h"
+#include "minikin/ItemizeCache.h"
 #include "minikin/Layout.h"
+#include "minikin/LineBreakResultCache.h"
 
 #include "BidiUtils.h"
 #include "LayoutSplitter.h"
 #include "LayoutUtils.h"
 #include "LineBreakerUtil.h"
+#include "MeasureQueue.h"
+#include "MinikinTrace.h"
+#include "PhraseBreakCache.h"
+#include "WorkerPool.h"
 
 namespace minikin {
 
+static std::atomic<bool> gDeferredHyphenationEnabled = {false};
+static std::atomic<bool> gWordBreakRecordingEnabled = {false};
+static std::atomic<bool> gBreakCandidatesCachingEnabled = {false};
+static std::atomic<bool> gDeferredLineExtentsEnabled = {false};
+static std::atomic<bool> gParallelMeasurementEnabled = {false};
+static std::atomic<bool> gCompactWidthsEnabled = {false};
+static std::atomic<bool> gHyphenPieceEstimationEnabled = {false};
+static std::atomic<bool> gSingleRunFastPathEnabled = {false};
+static std::atomic<bool> gLineBreakResultCachingEnabled = {false};
+
+// The length of the chunks a long run is split into for the parallel measurement.
+constexpr uint32_t kParallelRunChunkLength = 4096;
+
+// The number of words whose hyphenated pieces are measured by a task of the parallel measurement.
+constexpr size_t kParallelHyphenationWordCount = 256;
+
 // Helper class for composing character advances.
 class AdvancesCompositor {
 public:
     AdvancesCompositor(std::vector<float>* outAdvances, LayoutPieces* outPieces)
-            : mOutAdvances(outAdvances), mOutPieces(outPieces) {}
+            : mOutAdvances(outAdvances),
+              mOutPieces(outPieces),
+              mPaintId(LayoutPieces::kNoPaintId) {}
 
     void setNextRange(const Range& range, bool dir) {
         mRange = range;
         mDir = dir;
     }
 
-    void operator()(const LayoutPiece& layoutPiece, const MinikinPaint& paint) {
-        const std::vector<float>& advances = layoutPiece.advances();
+    // Takes the shared piece so that the output pieces refer to it instead of copying it.
+    void operator()(const std::shared_ptr<const LayoutPiece>& layoutPiece,
+                    const MinikinPaint& paint) {
+        const ArrayView<float> advances = layoutPiece->advances();
         std::copy(advances.begin(), advances.end(), mOutAdvances->begin() + mRange.getStart());
 
         if (mOutPieces != nullptr) {
-            mOutPieces->insert(mRange, 0 /* no edit */, layoutPiece, mDir, paint);
+            // All the pieces are of the paint of the run, so it is looked up only once.
+            if (mPaintId == LayoutPieces::kNoPaintId) {
+                mPaintId = mOutPieces->addPaint(paint);
+            }
+            mOutPieces->insert(mRange, 0 /* no edit */, layoutPiece, mDir, mPaintId);
         }
     }
 
@@ -51,6 +87,7 @@ private:
     bool mDir;
     std::vector<float>* mOutAdvances;
     LayoutPieces* mOutPieces;
+    uint32_t mPaintId;
 };
 
 void StyleRun::getMetrics(const U16StringPiece& textBuf, std::vector<float>* advances,
@@ -61,6 +98,9 @@ void StyleRun::getMetrics(const U16StringPiece& textBuf, std::vector<float>* adv
             (precomputed == nullptr) ? LayoutPieces::kNoPaintId : precomputed->findPaintId(mPaint);
     for (const BidiText::RunInfo info : BidiText(textBuf, mRange, bidiFlag)) {
         for (const auto[context, piece] : LayoutSplitter(textBuf, info.range, info.isRtl)) {
+            if (MeasureCancellationScope::isCancelled()) {
+                return;
+            }
             compositor.setNextRange(piece, info.isRtl);
             if (paintId == LayoutPieces::kNoPaintId) {
                 LayoutCache::getInstance().getOrCreate(
@@ -75,6 +115,60 @@ void StyleRun::getMetrics(const U16StringPiece& textBuf, std::vector<float>* adv
     }
 }
 
+void StyleRun::getMetricsForRange(const U16StringPiece& textBuf, const Range& range,
+                                  std::vector<float>* advances, LayoutPieces* outPieces) const {
+    AdvancesCompositor compositor(advances, outPieces);
+    const Bidi bidiFlag = mIsRtl ? Bidi::FORCE_RTL : Bidi::FORCE_LTR;
+    for (const BidiText::RunInfo info : BidiText(textBuf, range, bidiFlag)) {
+        for (const auto[context, piece] : LayoutSplitter(textBuf, info.range, info.isRtl)) {
+            if (MeasureCancellationScope::isCancelled()) {
+                return;
+            }
+            compositor.setNextRange(piece, info.isRtl);
+            LayoutCache::getInstance().getOrCreate(
+                    textBuf.substr(context), piece - context.getStart(), mPaint, info.isRtl,
+                    StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, compositor);
+        }
+    }
+}
+
+// The number of the words looked up at once by StyleRun::getMetricsBatched. The cancellation is
+// checked between the batches.
+constexpr size_t kMetricsBatchSize = 64;
+
+void StyleRun::getMetricsBatched(const U16StringPiece& textBuf, std::vector<float>* advances,
+                                 LayoutPieces* outPieces) const {
+    AdvancesCompositor compositor(advances, outPieces);
+    LayoutCache& layoutCache = LayoutCache::getInstance();
+    std::vector<LayoutCache::BatchEntry> entries;
+    std::vector<Range> pieces;
+    entries.reserve(kMetricsBatchSize);
+    pieces.reserve(kMetricsBatchSize);
+    auto f = [&compositor, &pieces](size_t index, const std::shared_ptr<const LayoutPiece>& layout,
+                                    const MinikinPaint& paint) {
+        compositor.setNextRange(pieces[index], false /* LTR */);
+        compositor(layout, paint);
+    };
+    // The glyphs are only needed for the layout pieces.
+    const bool needGlyphs = outPieces != nullptr;
+    for (const auto [context, piece] : LayoutSplitter(textBuf, mRange, false /* LTR */)) {
+        entries.push_back({textBuf.substr(context), piece - context.getStart(),
+                           StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT});
+        pieces.push_back(piece);
+        if (entries.size() == kMetricsBatchSize) {
+            layoutCache.getOrCreateBatch(entries, mPaint, false /* LTR */, f, needGlyphs);
+            entries.clear();
+            pieces.clear();
+            if (MeasureCancellationScope::isCancelled()) {
+                return;
+            }
+        }
+    }
+    if (!entries.empty()) {
+        layoutCache.getOrCreateBatch(entries, mPaint, false /* LTR */, f, needGlyphs);
+    }
+}
+
 // Helper class for composing total advances.
 class TotalAdvancesCompositor {
 public:
@@ -109,7 +203,8 @@ float StyleRun::measureText(const U16StringPiece& textBuf) const {
 // Helper class for composing total amount of advance
 class TotalAdvanceCompositor {
 public:
-    TotalAdvanceCompositor(LayoutPieces* outPieces) : mTotalAdvance(0), mOutPieces(outPieces) {}
+    TotalAdvanceCompositor(LayoutPieces* outPieces)
+            : mTotalAdvance(0), mOutPieces(outPieces), mPaintId(LayoutPieces::kNoPaintId) {}
 
     void setNextContext(const Range& range, HyphenEdit edit, bool dir) {
         mRange = range;
@@ -117,10 +212,14 @@ public:
         mDir = dir;
     }
 
-    void operator()(const LayoutPiece& layoutPiece, const MinikinPaint& paint) {
-        mTotalAdvance += layoutPiece.advance();
+    void operator()(const std::shared_ptr<const LayoutPiece>& layoutPiece,
+                    const MinikinPaint& paint) {
+        mTotalAdvance += layoutPiece->advance();
         if (mOutPieces != nullptr) {
-            mOutPieces->insert(mRange, mEdit, layoutPiece, mDir, paint);
+            if (mPaintId == LayoutPieces::kNoPaintId) {
+                mPaintId = mOutPieces->addPaint(paint);
+            }
+            mOutPieces->insert(mRange, mEdit, layoutPiece, mDir, mPaintId);
         }
     }
 
@@ -132,6 +231,7 @@ private:
     HyphenEdit mEdit;
     bool mDir;
     LayoutPieces* mOutPieces;
+    uint32_t mPaintId;
 };
 
 float StyleRun::measureHyphenPiece(const U16StringPiece& textBuf, const Range& range,
@@ -157,17 +257,406 @@ float StyleRun::measureHyphenPiece(const U16StringPiece& textBuf, const Range& r
 
 void MeasuredText::measure(const U16StringPiece& textBuf, bool computeHyphenation,
                            bool computeLayout, bool ignoreHyphenKerning, MeasuredText* hint) {
+    MINIKIN_TRACE_NAME("MeasuredText::measure");
+    traceMemoryUsage();
+    mTextClass = TextClass::of(textBuf);
+    mComputeHyphenation = computeHyphenation;
+    mComputeLayout = computeLayout;
+    mIgnoreHyphenKerning = ignoreHyphenKerning;
+    mHyphenationDeferred =
+            computeHyphenation && gDeferredHyphenationEnabled.load(std::memory_order_relaxed);
+    mCacheBreakCandidates = gBreakCandidatesCachingEnabled.load(std::memory_order_relaxed);
+    mLineExtentsDeferred = gDeferredLineExtentsEnabled.load(std::memory_order_relaxed);
+    mMeasuredInParallel = gParallelMeasurementEnabled.load(std::memory_order_relaxed);
+    mHyphenPiecesEstimated = gHyphenPieceEstimationEnabled.load(std::memory_order_relaxed);
+    if (gLineBreakResultCachingEnabled.load(std::memory_order_relaxed)) {
+        mBreakResults = std::make_shared<LineBreakResultCache>();
+    }
     if (textBuf.size() == 0) {
         return;
     }
 
+    // The layout misses in this paragraph share a single itemization of the paragraph.
+    ParagraphItemizeScope paragraphItemize(textBuf);
+    for (const auto& run : runs) {
+        const MinikinPaint* paint = run->getPaint();
+        if (paint != nullptr) {
+            paragraphItemize.addStyleRun(paint->font.get(), run->getRange(), paint->localeListId,
+                                         paint->familyVariant);
+        }
+    }
+
     LayoutPieces* piecesOut = computeLayout ? &layoutPieces : nullptr;
-    CharProcessor proc(textBuf);
+    if (mMeasuredInParallel) {
+        measureRunsInParallel(textBuf, hint ? &hint->layoutPieces : nullptr, piecesOut);
+    } else if (hint == nullptr && isSingleLtrStyleRun() &&
+               gSingleRunFastPathEnabled.load(std::memory_order_relaxed)) {
+        static_cast<const StyleRun&>(*runs[0]).getMetricsBatched(textBuf, &widths, piecesOut);
+    } else {
+        for (const auto& run : runs) {
+            if (MeasureCancellationScope::isCancelled()) {
+                return;
+            }
+            run->getMetrics(textBuf, &widths, hint ? &hint->layoutPieces : nullptr, piecesOut);
+        }
+    }
+    // The measurement is discarded, but the pieces shaped so far are in the LayoutCache.
+    if (MeasureCancellationScope::isCancelled()) {
+        return;
+    }
+
+    // Recorded before the hyphenation, which replays it. The phrase breaks are always recorded,
+    // since they are cached across the measurements of the same paragraph.
+    recordWordBreaks(textBuf,
+                     !gWordBreakRecordingEnabled.load(std::memory_order_relaxed) /* phraseOnly */);
+
+    if (!computeHyphenation) {
+        return;
+    }
+
+    // The widths are final from here, so the hyphen pieces can be measured from the prefix sums.
+    buildWidthPrefixSums();
+    if (mHyphenationDeferred) {
+        return;
+    }
+    populateHyphenBreaks(textBuf, ignoreHyphenKerning, piecesOut, nullptr /* prev */,
+                         Range(0, textBuf.size()), 0 /* delta */, &hyphenBreaks);
+}
+
+// static
+void MeasuredText::setDeferredHyphenationEnabled(bool enabled) {
+    gDeferredHyphenationEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setWordBreakRecordingEnabled(bool enabled) {
+    gWordBreakRecordingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setBreakCandidatesCachingEnabled(bool enabled) {
+    gBreakCandidatesCachingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setDeferredLineExtentsEnabled(bool enabled) {
+    gDeferredLineExtentsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setParallelMeasurementEnabled(bool enabled) {
+    gParallelMeasurementEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setCompactWidthsEnabled(bool enabled) {
+    gCompactWidthsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setHyphenPieceEstimationEnabled(bool enabled) {
+    gHyphenPieceEstimationEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setSingleRunFastPathEnabled(bool enabled) {
+    gSingleRunFastPathEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void MeasuredText::setLineBreakResultCachingEnabled(bool enabled) {
+    gLineBreakResultCachingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint32_t MeasuredText::getMemoryUsage() const {
+    return sizeof(float) * widths.size() + compactWidths.getMemoryUsage() +
+           sizeof(double) * widthPrefixSums.size() + sizeof(HyphenBreak) * hyphenBreaks.size() +
+           wordBreaks.getMemoryUsage() + layoutPieces.getMemoryUsage() +
+           (mBreakResults ? mBreakResults->getMemoryUsage() : 0);
+}
+
+void MeasuredText::compactWidthsIfEnabled() {
+    if (!gCompactWidthsEnabled.load(std::memory_order_relaxed) || widths.empty()) {
+        return;
+    }
+    if (compactWidths.build(widths)) {
+        std::vector<float>().swap(widths);
+    }
+}
+
+bool CompactWidths::build(const std::vector<float>& widths) {
+    // Keyed by the bits so that the widths are restored exactly, e.g. -0.0f.
+    std::unordered_map<uint32_t, uint8_t> paletteIndices;
+    std::vector<float> palette;
+    std::vector<uint8_t> indices(widths.size());
+    std::vector<std::pair<uint32_t, float>> escaped;
+    for (uint32_t i = 0; i < widths.size(); ++i) {
+        uint32_t bits;
+        memcpy(&bits, &widths[i], sizeof(bits));
+        auto it = paletteIndices.find(bits);
+        if (it != paletteIndices.end()) {
+            indices[i] = it->second;
+        } else if (palette.size() < kEscape) {
+            indices[i] = palette.size();
+            paletteIndices.emplace(bits, palette.size());
+            palette.push_back(widths[i]);
+        } else {
+            indices[i] = kEscape;
+            escaped.emplace_back(i, widths[i]);
+        }
+    }
+    // An escaped width takes two floats, so give up once they outweigh the saving.
+    if (sizeof(std::pair<uint32_t, float>) * escaped.size() + indices.size() >=
+        sizeof(float) * widths.size()) {
+        return false;
+    }
+    mPalette = std::move(palette);
+    mIndices = std::move(indices);
+    mEscaped = std::move(escaped);
+    return true;
+}
+
+float CompactWidths::getEscaped(uint32_t offset) const {
+    auto it = std::lower_bound(
+            mEscaped.begin(), mEscaped.end(), offset,
+            [](const std::pair<uint32_t, float>& e, uint32_t offset) { return e.first < offset; });
+    return it->second;
+}
+
+void MeasuredText::measureRunsInParallel(const U16StringPiece& textBuf, LayoutPieces* precomputed,
+                                         LayoutPieces* piecesOut) {
+    // The tasks fill disjoint ranges of the widths. A long text run is split at the word breaks of
+    // the layout cache, where the incremental measurement also splits it, so that the chunks are
+    // shaped into the same pieces as the whole run. The precomputed pieces are looked up by the
+    // whole runs only.
+    struct Task {
+        const Run* run;
+        Range range;
+    };
+    std::vector<Task> tasks;
     for (const auto& run : runs) {
         const Range& range = run->getRange();
-        run->getMetrics(textBuf, &widths, hint ? &hint->layoutPieces : nullptr, piecesOut);
+        if (!run->canMeasureRangesSeparately() || precomputed != nullptr ||
+            range.getLength() <= kParallelRunChunkLength) {
+            tasks.push_back({run.get(), range});
+            continue;
+        }
+        for (uint32_t start = range.getStart(); start < range.getEnd();) {
+            uint32_t end = range.getEnd();
+            if (end - start > kParallelRunChunkLength) {
+                end = std::min(end,
+                               getNextWordBreakForCache(textBuf, start + kParallelRunChunkLength));
+            }
+            tasks.push_back({run.get(), Range(start, end)});
+            start = end;
+        }
+    }
+
+    // Each task collects its own pieces, merged in the order of the text afterwards.
+    std::vector<LayoutPieces> taskPieces(piecesOut != nullptr ? tasks.size() : 0);
+    const std::atomic<bool>* cancelled = MeasureCancellationScope::getCurrent();
+    WorkerPool::getInstance().parallelFor(tasks.size(), [&](size_t i) {
+        MeasureCancellationScope scope(cancelled);
+        const Task& task = tasks[i];
+        LayoutPieces* out = piecesOut != nullptr ? &taskPieces[i] : nullptr;
+        if (task.range == task.run->getRange()) {
+            task.run->getMetrics(textBuf, &widths, precomputed, out);
+        } else {
+            task.run->getMetricsForRange(textBuf, task.range, &widths, out);
+        }
+    });
+    for (const LayoutPieces& pieces : taskPieces) {
+        piecesOut->merge(pieces);
+    }
+}
+
+void MeasuredText::recordWordBreaks(const U16StringPiece& textBuf, bool phraseOnly) {
+    // The line breakers set the word breaker at the start of each run changing the locale, and
+    // keep it until the next such run.
+    for (size_t i = 0; i < runs.size();) {
+        const Run& run = *runs[i];
+        const uint32_t localeListId = run.getLocaleListId();
+        size_t next = i + 1;
+        while (next < runs.size() && runs[next]->getLocaleListId() == localeListId) {
+            next++;
+        }
+        const uint32_t end =
+                next < runs.size() ? runs[next]->getRange().getStart() : textBuf.size();
+        const Range range(run.getRange().getStart(), end);
+        if (run.lineBreakWordStyle() == LineBreakWordStyle::Phrase) {
+            PhraseBreakCache::getInstance().record(textBuf, getEffectiveLocale(localeListId),
+                                                   run.lineBreakStyle(), range, &wordBreaks);
+        } else if (!phraseOnly) {
+            WordBreaker::record(textBuf, getEffectiveLocale(localeListId), run.lineBreakStyle(),
+                                run.lineBreakWordStyle(), range, &wordBreaks);
+        }
+        i = next;
+    }
+}
 
-        if (!computeHyphenation || !run->canBreak()) {
+std::vector<HyphenBreak> MeasuredText::computeHyphenBreaks(const U16StringPiece& textBuf) const {
+    std::vector<HyphenBreak> out;
+    if (mComputeHyphenation && textBuf.size() != 0) {
+        populateHyphenBreaks(textBuf, mIgnoreHyphenKerning, nullptr /* piecesOut */,
+                             nullptr /* prev */, Range(0, textBuf.size()), 0 /* delta */, &out);
+    }
+    return out;
+}
+
+bool MeasuredText::canMeasureIncrementally(const U16StringPiece& textBuf, bool computeHyphenation,
+                                           bool computeLayout, bool ignoreHyphenKerning,
+                                           const MeasuredText& prev, const TextEdit& edit) const {
+    const bool deferHyphenation =
+            computeHyphenation && gDeferredHyphenationEnabled.load(std::memory_order_relaxed);
+    if (prev.mComputeHyphenation != computeHyphenation || prev.mComputeLayout != computeLayout ||
+        prev.mIgnoreHyphenKerning != ignoreHyphenKerning ||
+        prev.mHyphenationDeferred != deferHyphenation ||
+        prev.mHyphenPiecesEstimated !=
+                gHyphenPieceEstimationEnabled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    const uint32_t prevLength = prev.getCharCount();
+    if (edit.offset + edit.removedLength > prevLength ||
+        prevLength + edit.delta() != textBuf.size() || prev.runs.size() != runs.size()) {
+        return false;
+    }
+    // Each run must be the run of the previous text with its range adjusted by the edit. A run
+    // boundary inside the replaced text may move to either end of the inserted text.
+    const uint32_t editEnd = edit.offset + edit.removedLength;
+    const auto isAdjustedOffset = [&](uint32_t offset, uint32_t prevOffset) {
+        if (prevOffset < edit.offset) {
+            return offset == prevOffset;
+        } else if (prevOffset > editEnd) {
+            return offset == prevOffset + edit.delta();
+        }
+        return offset == edit.offset || offset == edit.offset + edit.insertedLength;
+    };
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const Run& run = *runs[i];
+        const Run& prevRun = *prev.runs[i];
+        const Range& range = run.getRange();
+        const Range& prevRange = prevRun.getRange();
+        if (!isAdjustedOffset(range.getStart(), prevRange.getStart()) ||
+            !isAdjustedOffset(range.getEnd(), prevRange.getEnd()) ||
+            run.isRtl() != prevRun.isRtl() || run.canBreak() != prevRun.canBreak() ||
+            run.getLocaleListId() != prevRun.getLocaleListId() ||
+            run.lineBreakStyle() != prevRun.lineBreakStyle() ||
+            run.lineBreakWordStyle() != prevRun.lineBreakWordStyle()) {
+            return false;
+        }
+        const MinikinPaint* paint = run.getPaint();
+        const MinikinPaint* prevPaint = prevRun.getPaint();
+        if ((paint == nullptr) != (prevPaint == nullptr) ||
+            (paint != nullptr && !(*paint == *prevPaint))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeasuredText::measureIncremental(const U16StringPiece& textBuf, bool computeHyphenation,
+                                      bool computeLayout, bool ignoreHyphenKerning,
+                                      const MeasuredText& prev, const TextEdit& edit) {
+    MINIKIN_TRACE_NAME("MeasuredText::measureIncremental");
+    if (textBuf.size() == 0 || !canMeasureIncrementally(textBuf, computeHyphenation, computeLayout,
+                                                        ignoreHyphenKerning, prev, edit)) {
+        measure(textBuf, computeHyphenation, computeLayout, ignoreHyphenKerning, nullptr);
+        return;
+    }
+    mTextClass = TextClass::of(textBuf);
+    mComputeHyphenation = computeHyphenation;
+    mComputeLayout = computeLayout;
+    mIgnoreHyphenKerning = ignoreHyphenKerning;
+    mHyphenationDeferred = prev.mHyphenationDeferred;
+    mCacheBreakCandidates = gBreakCandidatesCachingEnabled.load(std::memory_order_relaxed);
+    mLineExtentsDeferred = gDeferredLineExtentsEnabled.load(std::memory_order_relaxed);
+    mMeasuredInParallel = gParallelMeasurementEnabled.load(std::memory_order_relaxed);
+    mHyphenPiecesEstimated = gHyphenPieceEstimationEnabled.load(std::memory_order_relaxed);
+    if (gLineBreakResultCachingEnabled.load(std::memory_order_relaxed)) {
+        mBreakResults = std::make_shared<LineBreakResultCache>();
+    }
+
+    // The layout of a word only depends on the word itself, so only the words touching the edit
+    // need to be measured again. The word breaks at both ends of the range depend on the
+    // characters before and after the edit, which are unchanged.
+    const int32_t delta = edit.delta();
+    const Range dirtyRange(getPrevWordBreakForCache(textBuf, edit.offset),
+                           getNextWordBreakForCache(textBuf, edit.offset + edit.insertedLength));
+    const uint32_t prevDirtyEnd = dirtyRange.getEnd() - delta;
+
+    if (prev.compactWidths.size() == 0) {
+        std::copy(prev.widths.begin(), prev.widths.begin() + dirtyRange.getStart(),
+                  widths.begin());
+        std::copy(prev.widths.begin() + prevDirtyEnd, prev.widths.end(),
+                  widths.begin() + dirtyRange.getEnd());
+    } else {
+        for (uint32_t i = 0; i < dirtyRange.getStart(); ++i) {
+            widths[i] = prev.compactWidths.get(i);
+        }
+        for (uint32_t i = prevDirtyEnd; i < prev.compactWidths.size(); ++i) {
+            widths[i + delta] = prev.compactWidths.get(i);
+        }
+    }
+
+    LayoutPieces* piecesOut = computeLayout ? &layoutPieces : nullptr;
+    if (computeLayout) {
+        layoutPieces.nextPaintId = prev.layoutPieces.nextPaintId;
+        layoutPieces.paintMap = prev.layoutPieces.paintMap;
+        for (const auto& [key, piece] : prev.layoutPieces.offsetMap) {
+            if (key.range.getEnd() <= dirtyRange.getStart()) {
+                layoutPieces.offsetMap.emplace(key, piece);
+            } else if (key.range.getStart() >= prevDirtyEnd) {
+                LayoutPieces::Key shiftedKey = key;
+                shiftedKey.range = key.range + delta;
+                layoutPieces.offsetMap.emplace(shiftedKey, piece);
+            }
+        }
+    }
+
+    for (const auto& run : runs) {
+        if (run->getPaint() == nullptr) {
+            // Not a text run. There is nothing to reuse since it is unknown what the widths
+            // depend on.
+            run->getMetrics(textBuf, &widths, nullptr /* precomputed */, piecesOut);
+        } else if (Range::intersects(run->getRange(), dirtyRange)) {
+            run->getMetricsForRange(textBuf, Range::intersection(run->getRange(), dirtyRange),
+                                    &widths, piecesOut);
+        }
+    }
+
+    if (!computeHyphenation) {
+        return;
+    }
+
+    buildWidthPrefixSums();
+    if (mHyphenationDeferred) {
+        return;
+    }
+    populateHyphenBreaks(textBuf, ignoreHyphenKerning, piecesOut, &prev, dirtyRange, delta,
+                         &hyphenBreaks);
+}
+
+void MeasuredText::populateHyphenBreaks(const U16StringPiece& textBuf, bool ignoreHyphenKerning,
+                                        LayoutPieces* piecesOut, const MeasuredText* prev,
+                                        const Range& dirtyRange, int32_t delta,
+                                        std::vector<HyphenBreak>* out) const {
+    MINIKIN_TRACE_NAME("MeasuredText::hyphenate");
+    // The words are collected first, then hyphenated a hyphenator at a time into one buffer, so
+    // that no buffer is allocated per word and the patterns of the hyphenator stay in the cache.
+    struct Word {
+        const Run* run;
+        Range contextRange;
+        Range wordRange;
+        // nullptr if the hyphenation points are taken from prev.
+        const Hyphenator* hyphenator;
+        int32_t shift;
+    };
+    std::vector<Word> words;
+    bool needsHyphenation = false;
+    CharProcessor proc(textBuf, wordBreaks);
+    for (const auto& run : runs) {
+        const Range& range = run->getRange();
+        if (!run->canBreak()) {
             continue;
         }
 
@@ -176,18 +665,146 @@ void MeasuredText::measure(const U16StringPiece& textBuf, bool computeHyphenatio
             // Even if the run is not a candidate of line break, treat the end of run as the line
             // break candidate.
             const bool canBreak = run->canBreak() || (i + 1) == range.getEnd();
-            proc.feedChar(i, textBuf[i], widths[i], canBreak);
+            proc.feedChar(i, textBuf[i], getCharWidth(i), canBreak);
 
             const uint32_t nextCharOffset = i + 1;
             if (nextCharOffset != proc.nextWordBreak) {
                 continue;  // Wait until word break point.
             }
 
-            populateHyphenationPoints(textBuf, *run, *proc.hyphenator, proc.contextRange(),
-                                      proc.wordRange(), widths, ignoreHyphenKerning, &hyphenBreaks,
-                                      piecesOut);
+            const Range contextRange = proc.contextRange();
+            const Range wordRange = proc.wordRange();
+            if (!range.contains(contextRange) || !contextRange.contains(wordRange)) {
+                continue;  // No hyphenation point is retrieved from such a word.
+            }
+            if (prev == nullptr || Range::intersects(contextRange, dirtyRange)) {
+                words.push_back({run.get(), contextRange, wordRange, proc.hyphenator, 0});
+                needsHyphenation = true;
+            } else {
+                const int32_t shift = wordRange.getStart() >= dirtyRange.getEnd() ? delta : 0;
+                words.push_back({run.get(), contextRange, wordRange, nullptr, shift});
+            }
         }
     }
+
+    std::vector<HyphenationType> hyphenResult;
+    if (needsHyphenation) {
+        hyphenResult.resize(textBuf.size(), HyphenationType::DONT_BREAK);
+        std::vector<Range> wordRanges;
+        for (size_t i = 0; i < words.size();) {
+            const Hyphenator* hyphenator = words[i].hyphenator;
+            if (hyphenator == nullptr) {
+                i++;
+                continue;
+            }
+            wordRanges.clear();
+            for (; i < words.size() && words[i].hyphenator == hyphenator; i++) {
+                appendHyphenationWords(textBuf, words[i].wordRange, &wordRanges);
+            }
+            hyphenator->hyphenateBatch(textBuf, wordRanges, hyphenResult.data());
+        }
+    }
+
+    const auto populateWords = [&](size_t begin, size_t end, std::vector<HyphenBreak>* wordsOut,
+                                   LayoutPieces* wordPiecesOut) {
+        HyphenAdvanceCache hyphenAdvances;
+        HyphenAdvanceCache* hyphenAdvancesOut =
+                ignoreHyphenKerning || mHyphenPiecesEstimated ? &hyphenAdvances : nullptr;
+        for (size_t i = begin; i < end; ++i) {
+            if (MeasureCancellationScope::isCancelled()) {
+                return;
+            }
+            const Word& word = words[i];
+            if (word.hyphenator != nullptr) {
+                populateHyphenationPoints(textBuf, *word.run,
+                                          hyphenResult.data() + word.wordRange.getStart(),
+                                          word.contextRange, word.wordRange, *this,
+                                          ignoreHyphenKerning, hyphenAdvancesOut, wordsOut,
+                                          wordPiecesOut);
+                continue;
+            }
+
+            // The word and its widths are unchanged, so are its hyphenation points.
+            const Range prevWordRange = word.wordRange - word.shift;
+            auto it = std::lower_bound(
+                    prev->hyphenBreaks.begin(), prev->hyphenBreaks.end(), prevWordRange.getStart(),
+                    [](const HyphenBreak& hb, uint32_t offset) { return hb.offset < offset; });
+            for (; it != prev->hyphenBreaks.end() && it->offset < prevWordRange.getEnd(); ++it) {
+                wordsOut->emplace_back(it->offset + word.shift, it->type, it->first, it->second);
+            }
+        }
+    };
+
+    // Measuring the hyphenated pieces shapes them, which is what the parallel measurement spreads.
+    if (!mMeasuredInParallel || ignoreHyphenKerning ||
+        words.size() <= kParallelHyphenationWordCount) {
+        populateWords(0, words.size(), out, piecesOut);
+        return;
+    }
+    const size_t taskCount =
+            (words.size() + kParallelHyphenationWordCount - 1) / kParallelHyphenationWordCount;
+    std::vector<std::vector<HyphenBreak>> taskBreaks(taskCount);
+    std::vector<LayoutPieces> taskPieces(piecesOut != nullptr ? taskCount : 0);
+    const std::atomic<bool>* cancelled = MeasureCancellationScope::getCurrent();
+    WorkerPool::getInstance().parallelFor(taskCount, [&](size_t i) {
+        MeasureCancellationScope scope(cancelled);
+        const size_t begin = i * kParallelHyphenationWordCount;
+        populateWords(begin, std::min(words.size(), begin + kParallelHyphenationWordCount),
+                      &taskBreaks[i], piecesOut != nullptr ? &taskPieces[i] : nullptr);
+    });
+    for (size_t i = 0; i < taskCount; ++i) {
+        out->insert(out->end(), taskBreaks[i].begin(), taskBreaks[i].end());
+        if (piecesOut != nullptr) {
+            piecesOut->merge(taskPieces[i]);
+        }
+    }
+}
+
+void MeasuredText::buildWidthPrefixSums() {
+    widthPrefixSums.resize(widths.size() + 1);
+    double sum = 0;
+    widthPrefixSums[0] = 0;
+    for (size_t i = 0; i < widths.size(); ++i) {
+        mHasNegativeWidth |= widths[i] < 0;
+        sum += widths[i];
+        widthPrefixSums[i + 1] = sum;
+    }
+}
+
+float MeasuredText::getWidth(const Range& range) const {
+    if (!widthPrefixSums.empty()) {
+        return widthPrefixSums[range.getEnd()] - widthPrefixSums[range.getStart()];
+    }
+    float width = 0;
+    for (uint32_t i = range.getStart(); i < range.getEnd(); ++i) {
+        width += getCharWidth(i);
+    }
+    return width;
+}
+
+uint32_t MeasuredText::getOffsetForWidth(const Range& range, float width) const {
+    if (!widthPrefixSums.empty() && !mHasNegativeWidth) {
+        // The prefix sums are non-decreasing, so the first sum exceeding the limit is right after
+        // the answer.
+        const double limit = widthPrefixSums[range.getStart()] + width;
+        const auto begin = widthPrefixSums.begin() + range.getStart();
+        const auto end = widthPrefixSums.begin() + range.getEnd() + 1;
+        const auto it = std::upper_bound(begin, end, limit);
+        if (it == begin) {
+            return range.getStart();  // The given width is negative.
+        }
+        return (it - widthPrefixSums.begin()) - 1;
+    }
+    float sum = 0;
+    uint32_t i = range.getStart();
+    for (; i < range.getEnd(); ++i) {
+        const float w = getCharWidth(i);
+        if (sum + w > width) {
+            break;
+        }
+        sum += w;
+    }
+    return i;
 }
 
 // Helper class for composing Layout object.
@@ -248,9 +865,10 @@ public:
     void operator()(const LayoutPiece& layoutPiece, const MinikinPaint& paint) {
         MinikinRect pieceBounds;
         MinikinRect tmpRect;
+        Font::ExternalRefsGuard externalRefsGuard;
         for (uint32_t i = 0; i < layoutPiece.glyphCount(); ++i) {
             const FakedFont& font = layoutPiece.fontAt(i);
-            const Point& point = layoutPiece.pointAt(i);
+            const Point point = layoutPiece.pointAt(i);
 
             MinikinFont* minikinFont = font.font->typeface().get();
             minikinFont->GetBounds(&tmpRect, layoutPiece.glyphIdAt(i), paint, font.fakery);
@@ -335,17 +953,24 @@ Layout MeasuredText::buildLayout(const U16StringPiece& textBuf, const Range& ran
     return outLayout;
 }
 
-MinikinRect MeasuredText::getBounds(const U16StringPiece& textBuf, const Range& range) const {
+// Returns the bounds of the range, looking at the runs from the given one, which must not be
+// after the first run intersecting the range.
+static MinikinRect getRunsBounds(const std::vector<std::unique_ptr<Run>>& runs, size_t firstRun,
+                                 const U16StringPiece& textBuf, const Range& range,
+                                 const LayoutPieces& layoutPieces) {
     MinikinRect rect;
     float totalAdvance = 0.0f;
 
-    for (const auto& run : runs) {
-        const Range& runRange = run->getRange();
+    for (size_t i = firstRun; i < runs.size(); ++i) {
+        const Range& runRange = runs[i]->getRange();
+        if (runRange.getStart() >= range.getEnd()) {
+            break;  // The runs are in order, so none of the following ones intersects.
+        }
         if (!Range::intersects(range, runRange)) {
             continue;
         }
         auto[advance, bounds] =
-                run->getBounds(textBuf, Range::intersection(runRange, range), layoutPieces);
+                runs[i]->getBounds(textBuf, Range::intersection(runRange, range), layoutPieces);
         bounds.offset(totalAdvance, 0);
         rect.join(bounds);
         totalAdvance += advance;
@@ -353,6 +978,25 @@ MinikinRect MeasuredText::getBounds(const U16StringPiece& textBuf, const Range&
     return rect;
 }
 
+MinikinRect MeasuredText::getBounds(const U16StringPiece& textBuf, const Range& range) const {
+    return getRunsBounds(runs, 0, textBuf, range, layoutPieces);
+}
+
+std::vector<MinikinRect> MeasuredText::getBounds(const U16StringPiece& textBuf,
+                                                 const std::vector<Range>& ranges) const {
+    std::vector<MinikinRect> result;
+    result.reserve(ranges.size());
+    size_t firstRun = 0;
+    for (const Range& range : ranges) {
+        // The runs ending before this range also end before the following ones.
+        while (firstRun < runs.size() && runs[firstRun]->getRange().getEnd() <= range.getStart()) {
+            firstRun++;
+        }
+        result.push_back(getRunsBounds(runs, firstRun, textBuf, range, layoutPieces));
+    }
+    return result;
+}
+
 MinikinExtent MeasuredText::getExtent(const U16StringPiece& textBuf, const Range& range) const {
     MinikinExtent extent;
     for (const auto& run : runs) {
@@ -367,4 +1011,42 @@ MinikinExtent MeasuredText::getExtent(const U16StringPiece& textBuf, const Range
     return extent;
 }
 
+std::unique_ptr<MeasuredText> MeasuredTextBuilder::build(const U16StringPiece& textBuf,
+                                                         bool computeHyphenation,
+                                                         bool computeLayout,
+                                                         bool ignoreHyphenKerning,
+                                                         MeasuredText* hint) {
+    // Unable to use make_unique here since make_unique is not a friend of MeasuredText.
+    std::unique_ptr<MeasuredText> mt(new MeasuredText(textBuf, std::move(mRuns), computeHyphenation,
+                                                      computeLayout, ignoreHyphenKerning, hint));
+    ApiTrace::getInstance().recordBuild(textBuf, *mt, computeHyphenation, computeLayout,
+                                        ignoreHyphenKerning);
+    return mt;
+}
+
+void MeasuredTextBuilder::reset() {
+    recycleRuns(&mRuns);
+}
+
+void MeasuredTextBuilder::recycle(std::unique_ptr<MeasuredText>&& mt) {
+    recycleRuns(&mt->runs);
+    if (mRuns.empty() && mRuns.capacity() < mt->runs.capacity()) {
+        mRuns.swap(mt->runs);
+    }
+    mt.reset();
+}
+
+void MeasuredTextBuilder::recycleRuns(std::vector<std::unique_ptr<Run>>* runs) {
+    for (std::unique_ptr<Run>& run : *runs) {
+        if (mRecycledRuns.size() >= kMaxRecycledRuns) {
+            break;
+        }
+        // StyleRun is final, so the type tells that the run is a StyleRun.
+        if (run->getType() == Run::Type::Style) {
+            mRecycledRuns.emplace_back(static_cast<StyleRun*>(run.release()));
+        }
+    }
+    runs->clear();
+}
+
 }  // namespace minikin
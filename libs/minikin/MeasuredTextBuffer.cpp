@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The serialization of MeasuredText, see MeasuredText::writeTo.
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+namespace minikin {
+
+namespace {
+
+// Changed with the format, so that a text written by another version is measured again instead of
+// being misread.
+constexpr uint32_t kFormatVersion = 3;
+
+// The position of a font in the font collections given to writeTo and readFrom.
+struct FontPosition {
+    uint32_t collection;
+    uint32_t family;
+    uint32_t font;
+};
+
+// Finds the indices of the collections and the positions of the fonts.
+class FontIndexer {
+public:
+    explicit FontIndexer(const std::vector<std::shared_ptr<FontCollection>>& fontCollections) {
+        for (uint32_t c = 0; c < fontCollections.size(); ++c) {
+            const FontCollection& collection = *fontCollections[c];
+            mCollections.emplace(&collection, c);
+            for (uint32_t f = 0; f < collection.getFamilyCount(); ++f) {
+                const FontFamily& family = *collection.getFamilyAt(f);
+                for (uint32_t i = 0; i < family.getNumFonts(); ++i) {
+                    mFonts.emplace(family.getFont(i), FontPosition{c, f, i});
+                }
+            }
+        }
+    }
+
+    std::optional<uint32_t> findCollection(const FontCollection* collection) const {
+        auto it = mCollections.find(collection);
+        return it == mCollections.end() ? std::nullopt : std::make_optional(it->second);
+    }
+
+    std::optional<FontPosition> findFont(const Font* font) const {
+        auto it = mFonts.find(font);
+        return it == mFonts.end() ? std::nullopt : std::make_optional(it->second);
+    }
+
+private:
+    std::unordered_map<const FontCollection*, uint32_t> mCollections;
+    std::unordered_map<const Font*, FontPosition> mFonts;
+};
+
+// The locale list IDs are only valid in the process, so the locales are written as a string.
+void writeLocaleList(BufferWriter* writer, uint32_t localeListId) {
+    writer->writeString(getLocaleString(localeListId));
+}
+
+uint32_t readLocaleList(BufferReader* reader) {
+    return registerLocaleList(std::string(reader->readString()));
+}
+
+void writePaint(BufferWriter* writer, const MinikinPaint& paint, uint32_t collection) {
+    writer->write<uint32_t>(collection);
+    writer->write<float>(paint.size);
+    writer->write<float>(paint.scaleX);
+    writer->write<float>(paint.skewX);
+    writer->write<float>(paint.letterSpacing);
+    writer->write<float>(paint.wordSpacing);
+    writer->write<uint32_t>(paint.fontFlags);
+    writeLocaleList(writer, paint.localeListId);
+    paint.fontStyle.writeTo(writer);
+    writer->write<uint8_t>(static_cast<uint8_t>(paint.familyVariant));
+    writer->writeString(paint.fontFeatureSettings.str());
+}
+
+std::optional<MinikinPaint> readPaint(
+        BufferReader* reader, const std::vector<std::shared_ptr<FontCollection>>& fontCollections) {
+    const uint32_t collection = reader->read<uint32_t>();
+    if (collection >= fontCollections.size()) {
+        return std::nullopt;
+    }
+    MinikinPaint paint(fontCollections[collection]);
+    paint.size = reader->read<float>();
+    paint.scaleX = reader->read<float>();
+    paint.skewX = reader->read<float>();
+    paint.letterSpacing = reader->read<float>();
+    paint.wordSpacing = reader->read<float>();
+    paint.fontFlags = reader->read<uint32_t>();
+    paint.localeListId = readLocaleList(reader);
+    paint.fontStyle = FontStyle(reader);
+    paint.familyVariant = static_cast<FamilyVariant>(reader->read<uint8_t>());
+    paint.fontFeatureSettings = std::string(reader->readString());
+    return paint;
+}
+
+// Returns the positions of the fonts of the piece, or nullopt if one of them is not in the
+// collections.
+std::optional<std::vector<FontPosition>> findFonts(const LayoutPiece& piece,
+                                                   const FontIndexer& indexer) {
+    std::vector<FontPosition> positions;
+    for (const FakedFont& font : piece.fonts()) {
+        std::optional<FontPosition> position = indexer.findFont(font.font.get());
+        if (!position) {
+            return std::nullopt;
+        }
+        positions.push_back(*position);
+    }
+    return positions;
+}
+
+std::optional<std::vector<FakedFont>> readFonts(
+        BufferReader* reader, const std::vector<std::shared_ptr<FontCollection>>& fontCollections) {
+    std::vector<FakedFont> fonts;
+    const uint32_t count = reader->read<uint32_t>();
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t collection = reader->read<uint32_t>();
+        const uint32_t family = reader->read<uint32_t>();
+        const uint32_t font = reader->read<uint32_t>();
+        const uint8_t fakery = reader->read<uint8_t>();
+        if (collection >= fontCollections.size() ||
+            family >= fontCollections[collection]->getFamilyCount()) {
+            return std::nullopt;
+        }
+        const std::shared_ptr<FontFamily>& fontFamily =
+                fontCollections[collection]->getFamilyAt(family);
+        if (font >= fontFamily->getNumFonts()) {
+            return std::nullopt;
+        }
+        fonts.push_back(FakedFont{fontFamily->getFontRef(font),
+                                  FontFakery(fakery & 0b01, fakery & 0b10)});
+    }
+    return fonts;
+}
+
+}  // namespace
+
+bool MeasuredText::writeTo(
+        BufferWriter* writer,
+        const std::vector<std::shared_ptr<FontCollection>>& fontCollections) const {
+    const FontIndexer indexer(fontCollections);
+    for (const auto& run : runs) {
+        const MinikinPaint* paint = run->getPaint();
+        if (run->getType() == Run::Type::Custom ||
+            (run->getType() == Run::Type::Style && !indexer.findCollection(paint->font.get()))) {
+            return false;
+        }
+    }
+
+    writer->write<uint32_t>(kFormatVersion);
+    writer->write<uint8_t>(mComputeHyphenation);
+    writer->write<uint8_t>(mComputeLayout);
+    writer->write<uint8_t>(mIgnoreHyphenKerning);
+    writer->write<uint8_t>(mHyphenationDeferred);
+    writer->write<uint8_t>(mCacheBreakCandidates);
+    writer->write<uint8_t>(mLineExtentsDeferred);
+    writer->write<uint8_t>(mMeasuredInParallel);
+    writer->write<uint8_t>(mHyphenPiecesEstimated);
+    writer->write<uint8_t>(mTextClass.hasTab);
+
+    writer->write<uint32_t>(runs.size());
+    for (const auto& run : runs) {
+        writer->write<uint8_t>(static_cast<uint8_t>(run->getType()));
+        writer->write<uint32_t>(run->getRange().getStart());
+        writer->write<uint32_t>(run->getRange().getEnd());
+        if (run->getType() == Run::Type::Style) {
+            const MinikinPaint& paint = *run->getPaint();
+            writePaint(writer, paint, *indexer.findCollection(paint.font.get()));
+            writer->write<uint8_t>(static_cast<uint8_t>(run->lineBreakStyle()));
+            writer->write<uint8_t>(static_cast<uint8_t>(run->lineBreakWordStyle()));
+            writer->write<uint8_t>(run->isRtl());
+        } else {
+            writer->write<float>(static_cast<const ReplacementRun&>(*run).getWidth());
+            writeLocaleList(writer, run->getLocaleListId());
+        }
+    }
+
+    // The widths are written uncompacted, and compacted again by readFrom if enabled.
+    writer->write<uint32_t>(getCharCount());
+    for (uint32_t i = 0; i < getCharCount(); ++i) {
+        writer->write<float>(getCharWidth(i));
+    }
+    writer->write<uint8_t>(!widthPrefixSums.empty());
+
+    writer->write<uint32_t>(hyphenBreaks.size());
+    for (const HyphenBreak& hyphenBreak : hyphenBreaks) {
+        writer->write<uint32_t>(hyphenBreak.offset);
+        writer->write<uint8_t>(static_cast<uint8_t>(hyphenBreak.type));
+        writer->write<float>(hyphenBreak.first);
+        writer->write<float>(hyphenBreak.second);
+    }
+
+    writer->write<uint32_t>(wordBreaks.segments.size());
+    for (const WordBreakRecord::Segment& segment : wordBreaks.segments) {
+        writer->write<uint32_t>(segment.start);
+        writer->write<uint64_t>(segment.localeId);
+        writer->write<uint8_t>(static_cast<uint8_t>(segment.lbStyle));
+        writer->write<uint8_t>(static_cast<uint8_t>(segment.lbWordStyle));
+        writer->write<uint32_t>(segment.boundaryStart);
+        writer->write<uint32_t>(segment.boundaryEnd);
+        writer->write<uint8_t>(segment.reachesEnd);
+    }
+    writer->writeArray<uint32_t>(wordBreaks.boundaries.data(), wordBreaks.boundaries.size());
+
+    // The paints and the pieces are written once and referred to by index from the keys. The ones
+    // using fonts out of the collections are skipped with their keys.
+    // The paints are written in the order of their IDs, so that readFrom gives them the same IDs.
+    std::vector<const MinikinPaint*> paints(layoutPieces.nextPaintId);
+    std::vector<std::optional<uint32_t>> paintCollections(layoutPieces.nextPaintId);
+    uint32_t paintCount = 0;
+    for (const auto& [paint, paintId] : layoutPieces.paintMap) {
+        paints[paintId] = &paint;
+        paintCollections[paintId] = indexer.findCollection(paint.font.get());
+        paintCount += paintCollections[paintId].has_value();
+    }
+    writer->write<uint32_t>(paintCount);
+    for (uint32_t paintId = 0; paintId < paints.size(); ++paintId) {
+        if (paintCollections[paintId]) {
+            writer->write<uint32_t>(paintId);
+            writePaint(writer, *paints[paintId], *paintCollections[paintId]);
+        }
+    }
+
+    std::unordered_map<const LayoutPiece*, std::optional<uint32_t>> pieceIndices;
+    std::vector<std::pair<const LayoutPiece*, std::vector<FontPosition>>> pieces;
+    uint32_t keyCount = 0;
+    for (const auto& [key, piece] : layoutPieces.offsetMap) {
+        auto [it, inserted] = pieceIndices.emplace(piece.get(), std::nullopt);
+        if (inserted) {
+            std::optional<std::vector<FontPosition>> fonts = findFonts(*piece, indexer);
+            if (fonts) {
+                it->second = pieces.size();
+                pieces.emplace_back(piece.get(), std::move(*fonts));
+            }
+        }
+        keyCount += it->second.has_value() && paintCollections[key.paintId].has_value();
+    }
+    writer->write<uint32_t>(pieces.size());
+    for (const auto& [piece, fonts] : pieces) {
+        writer->write<uint32_t>(fonts.size());
+        for (uint32_t i = 0; i < fonts.size(); ++i) {
+            FontFakery fakery = piece->fonts()[i].fakery;
+            writer->write<uint32_t>(fonts[i].collection);
+            writer->write<uint32_t>(fonts[i].family);
+            writer->write<uint32_t>(fonts[i].font);
+            writer->write<uint8_t>((fakery.isFakeBold() ? 0b01 : 0) |
+                                   (fakery.isFakeItalic() ? 0b10 : 0));
+        }
+        piece->writeTo(writer);
+    }
+    writer->write<uint32_t>(keyCount);
+    for (const auto& [key, piece] : layoutPieces.offsetMap) {
+        const std::optional<uint32_t>& pieceIndex = pieceIndices[piece.get()];
+        if (pieceIndex && paintCollections[key.paintId]) {
+            writer->write<uint32_t>(key.range.getStart());
+            writer->write<uint32_t>(key.range.getEnd());
+            writer->write<uint8_t>(key.hyphenEdit);
+            writer->write<uint8_t>(key.dir);
+            writer->write<uint32_t>(key.paintId);
+            writer->write<uint32_t>(*pieceIndex);
+        }
+    }
+    return true;
+}
+
+// static
+std::unique_ptr<MeasuredText> MeasuredText::readFrom(
+        BufferReader* reader, const std::vector<std::shared_ptr<FontCollection>>& fontCollections) {
+    if (reader->read<uint32_t>() != kFormatVersion) {
+        return nullptr;
+    }
+    // Unable to use make_unique here since make_unique is not a friend of MeasuredText.
+    std::unique_ptr<MeasuredText> mt(new MeasuredText());
+    mt->mComputeHyphenation = reader->read<uint8_t>();
+    mt->mComputeLayout = reader->read<uint8_t>();
+    mt->mIgnoreHyphenKerning = reader->read<uint8_t>();
+    mt->mHyphenationDeferred = reader->read<uint8_t>();
+    mt->mCacheBreakCandidates = reader->read<uint8_t>();
+    mt->mLineExtentsDeferred = reader->read<uint8_t>();
+    mt->mMeasuredInParallel = reader->read<uint8_t>();
+    mt->mHyphenPiecesEstimated = reader->read<uint8_t>();
+    mt->mTextClass.hasTab = reader->read<uint8_t>();
+
+    const uint32_t runCount = reader->read<uint32_t>();
+    for (uint32_t i = 0; i < runCount; ++i) {
+        const Run::Type type = static_cast<Run::Type>(reader->read<uint8_t>());
+        const uint32_t start = reader->read<uint32_t>();
+        const Range range(start, reader->read<uint32_t>());
+        if (type == Run::Type::Style) {
+            std::optional<MinikinPaint> paint = readPaint(reader, fontCollections);
+            if (!paint) {
+                return nullptr;
+            }
+            const uint8_t lineBreakStyle = reader->read<uint8_t>();
+            const uint8_t lineBreakWordStyle = reader->read<uint8_t>();
+            const bool isRtl = reader->read<uint8_t>();
+            mt->runs.push_back(std::make_unique<StyleRun>(range, std::move(*paint), lineBreakStyle,
+                                                          lineBreakWordStyle, isRtl));
+        } else if (type == Run::Type::Replacement) {
+            const float width = reader->read<float>();
+            mt->runs.push_back(
+                    std::make_unique<ReplacementRun>(range, width, readLocaleList(reader)));
+        } else {
+            return nullptr;
+        }
+    }
+
+    const uint32_t charCount = reader->read<uint32_t>();
+    mt->widths.reserve(charCount);
+    for (uint32_t i = 0; i < charCount; ++i) {
+        mt->widths.push_back(reader->read<float>());
+        mt->mHasNegativeWidth |= mt->widths.back() < 0;
+    }
+    if (reader->read<uint8_t>()) {
+        mt->buildWidthPrefixSums();
+    }
+
+    const uint32_t hyphenBreakCount = reader->read<uint32_t>();
+    mt->hyphenBreaks.reserve(hyphenBreakCount);
+    for (uint32_t i = 0; i < hyphenBreakCount; ++i) {
+        const uint32_t offset = reader->read<uint32_t>();
+        const HyphenationType type = static_cast<HyphenationType>(reader->read<uint8_t>());
+        const float first = reader->read<float>();
+        mt->hyphenBreaks.emplace_back(offset, type, first, reader->read<float>());
+    }
+
+    const uint32_t segmentCount = reader->read<uint32_t>();
+    mt->wordBreaks.segments.resize(segmentCount);
+    for (WordBreakRecord::Segment& segment : mt->wordBreaks.segments) {
+        segment.start = reader->read<uint32_t>();
+        segment.localeId = reader->read<uint64_t>();
+        segment.lbStyle = static_cast<LineBreakStyle>(reader->read<uint8_t>());
+        segment.lbWordStyle = static_cast<LineBreakWordStyle>(reader->read<uint8_t>());
+        segment.boundaryStart = reader->read<uint32_t>();
+        segment.boundaryEnd = reader->read<uint32_t>();
+        segment.reachesEnd = reader->read<uint8_t>();
+    }
+    auto [boundaries, boundaryCount] = reader->readArray<uint32_t>();
+    mt->wordBreaks.boundaries.assign(boundaries, boundaries + boundaryCount);
+
+    // The paints skipped by writeTo leave gaps in the IDs, so the IDs are mapped.
+    std::unordered_map<uint32_t, uint32_t> paintIds;
+    const uint32_t paintCount = reader->read<uint32_t>();
+    for (uint32_t i = 0; i < paintCount; ++i) {
+        const uint32_t paintId = reader->read<uint32_t>();
+        std::optional<MinikinPaint> paint = readPaint(reader, fontCollections);
+        if (!paint) {
+            return nullptr;
+        }
+        paintIds[paintId] = mt->layoutPieces.addPaint(*paint);
+    }
+
+    std::vector<std::shared_ptr<const LayoutPiece>> pieces;
+    const uint32_t pieceCount = reader->read<uint32_t>();
+    pieces.reserve(pieceCount);
+    for (uint32_t i = 0; i < pieceCount; ++i) {
+        std::optional<std::vector<FakedFont>> fonts = readFonts(reader, fontCollections);
+        if (!fonts) {
+            return nullptr;
+        }
+        pieces.push_back(std::make_shared<LayoutPiece>(reader, *fonts));
+    }
+
+    const uint32_t keyCount = reader->read<uint32_t>();
+    for (uint32_t i = 0; i < keyCount; ++i) {
+        const uint32_t start = reader->read<uint32_t>();
+        const Range range(start, reader->read<uint32_t>());
+        const HyphenEdit hyphenEdit = reader->read<uint8_t>();
+        const bool dir = reader->read<uint8_t>();
+        const auto paintIt = paintIds.find(reader->read<uint32_t>());
+        const uint32_t pieceIndex = reader->read<uint32_t>();
+        if (paintIt == paintIds.end() || pieceIndex >= pieces.size()) {
+            return nullptr;
+        }
+        mt->layoutPieces.offsetMap.emplace(
+                LayoutPieces::Key(range, hyphenEdit, dir, paintIt->second), pieces[pieceIndex]);
+    }
+
+    mt->compactWidthsIfEnabled();
+    return mt;
+}
+
+}  // namespace minikin
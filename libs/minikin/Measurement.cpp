@@ -16,13 +16,18 @@
 
 #include "minikin/Measurement.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <vector>
 
 #include "BidiUtils.h"
 #include "LayoutSplitter.h"
 #include "minikin/BoundsCache.h"
 #include "minikin/GraphemeBreak.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutProfile.h"
+#include "minikin/TextScan.h"
 
 namespace {
 bool isAsciiOrBidiControlCharacter(uint16_t c) {
@@ -31,6 +36,21 @@ bool isAsciiOrBidiControlCharacter(uint16_t c) {
            || (0x202A <= c && c <= 0x202E) || (0x2066 <= c && c <= 0x2069);
 }
 
+// Returns true if none of the advances is zero, i.e. no cluster spans more than one code unit.
+bool hasNoZeroAdvance(const float* advances, size_t count) {
+    return minikin::scanAll(0, count, [advances](size_t i) { return advances[i] != 0.0f; });
+}
+
+// Returns true if every code unit has an advance and is in [U+0020, U+0300), i.e. below the
+// combining marks and free of CR, LF, surrogates and Hangul jamo. Every offset of such a run is a
+// grapheme break, so the grapheme break iteration can be skipped.
+bool isSimpleRun(const float* advances, const uint16_t* buf, size_t count) {
+    return minikin::scanAll(0, count, [advances, buf](size_t i) {
+        // Not &&, which would branch.
+        return (static_cast<uint16_t>(buf[i] - 0x0020) < 0x0300 - 0x0020) & (advances[i] != 0.0f);
+    });
+}
+
 }  // namespace
 
 namespace minikin {
@@ -109,6 +129,11 @@ static float getRunAdvance(const float* advances, const uint16_t* buf, size_t la
  * @param count the number of the characters in this run.
  */
 void distributeAdvances(float* advances, const uint16_t* buf, size_t start, size_t count) {
+    if (hasNoZeroAdvance(advances, count)) {
+        // Every cluster is a single code unit, so there is no ligature to distribute.
+        return;
+    }
+    std::vector<bool> graphemeBreaks;  // Computed for the first cluster of many code units.
     size_t clusterStart = start;
     while (clusterStart < start + count) {
         float clusterAdvance = advances[clusterStart - start];
@@ -119,9 +144,17 @@ void distributeAdvances(float* advances, const uint16_t* buf, size_t start, size
                 break;
             }
         }
+        if (clusterEnd - clusterStart == 1) {
+            // A single code unit is at most one grapheme, there is nothing to distribute.
+            clusterStart = clusterEnd;
+            continue;
+        }
+        if (graphemeBreaks.empty()) {
+            GraphemeBreak::getGraphemeBreaks(advances, buf, start, count, &graphemeBreaks);
+        }
         size_t numGraphemeClusters = 0;
         for (size_t i = clusterStart; i < clusterEnd; i++) {
-            if (GraphemeBreak::isGraphemeBreak(advances, buf, start, count, i)) {
+            if (graphemeBreaks[i - start]) {
                 numGraphemeClusters++;
             }
         }
@@ -129,7 +162,7 @@ void distributeAdvances(float* advances, const uint16_t* buf, size_t start, size
         // And we will distribute the width to each grapheme.
         if (numGraphemeClusters > 1) {
             for (size_t i = clusterStart; i < clusterEnd; ++i) {
-                if (GraphemeBreak::isGraphemeBreak(advances, buf, start, count, i)) {
+                if (graphemeBreaks[i - start]) {
                     // Only distribute the advance to the first character of the cluster.
                     advances[i - start] = clusterAdvance / numGraphemeClusters;
                 }
@@ -152,12 +185,50 @@ float getRunAdvance(const float* advances, const uint16_t* buf, size_t start, si
  * The actual implementation fast-forwards through clusters to get "close", then does a finer-grain
  * search within the cluster and grapheme breaks.
  */
+// Same as getOffsetForAdvance() but for the runs accepted by isSimpleRun(). The additions are done
+// in the same order as the generic implementation so that the result is identical.
+static size_t getOffsetForAdvanceSimple(const float* advances, size_t start, size_t count,
+                                        float advance) {
+    float x = 0.0f, xLastClusterStart = 0.0f, xSearchStart = 0.0f;
+    size_t lastClusterStart = start, searchStart = start;
+    for (size_t i = start; i < start + count; i++) {
+        searchStart = lastClusterStart;
+        xSearchStart = xLastClusterStart;
+        lastClusterStart = i;
+        xLastClusterStart = x;
+        x += advances[i - start];
+        if (x > advance) {
+            break;
+        }
+    }
+    size_t best = searchStart;
+    float bestDist = FLT_MAX;
+    float runAdvance = 0.0f;  // getRunAdvance() from searchStart to i.
+    for (size_t i = searchStart; i <= start + count; i++) {
+        const float delta = runAdvance + xSearchStart - advance;
+        if (std::abs(delta) < bestDist) {
+            bestDist = std::abs(delta);
+            best = i;
+        }
+        if (delta >= 0.0f || i == start + count) {
+            break;
+        }
+        runAdvance += advances[i - start];
+    }
+    return best;
+}
+
 size_t getOffsetForAdvance(const float* advances, const uint16_t* buf, size_t start, size_t count,
                            float advance) {
+    if (isSimpleRun(advances, buf + start, count)) {
+        return getOffsetForAdvanceSimple(advances, start, count, advance);
+    }
+    std::vector<bool> graphemeBreaks;
+    GraphemeBreak::getGraphemeBreaks(advances, buf, start, count, &graphemeBreaks);
     float x = 0.0f, xLastClusterStart = 0.0f, xSearchStart = 0.0f;
     size_t lastClusterStart = start, searchStart = start;
     for (size_t i = start; i < start + count; i++) {
-        if (GraphemeBreak::isGraphemeBreak(advances, buf, start, count, i)) {
+        if (graphemeBreaks[i - start]) {
             searchStart = lastClusterStart;
             xSearchStart = xLastClusterStart;
         }
@@ -174,7 +245,7 @@ size_t getOffsetForAdvance(const float* advances, const uint16_t* buf, size_t st
     size_t best = searchStart;
     float bestDist = FLT_MAX;
     for (size_t i = searchStart; i <= start + count; i++) {
-        if (GraphemeBreak::isGraphemeBreak(advances, buf, start, count, i)) {
+        if (graphemeBreaks[i - start]) {
             // "getRunAdvance(layout, buf, start, count, i) - advance" but more efficient
             float delta = getRunAdvance(advances, buf, start, searchStart, count - searchStart, i)
 
@@ -191,6 +262,118 @@ size_t getOffsetForAdvance(const float* advances, const uint16_t* buf, size_t st
     return best;
 }
 
+RunHitTestIndex::RunHitTestIndex(const float* advances, const uint16_t* buf, size_t start,
+                                 size_t count)
+        : mAdvances(advances), mBuf(buf), mStart(start), mCount(count) {
+    std::vector<bool> graphemeBreaks;
+    GraphemeBreak::getGraphemeBreaks(advances, buf, start, count, &graphemeBreaks);
+    mPrefixAdvances.resize(count + 1);
+    mBreakCounts.resize(count + 1);
+    float x = 0.0f;
+    uint32_t breakCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        // The sums are done in the same order as getRunAdvance() so that the results are identical.
+        mPrefixAdvances[i] = x;
+        mBreakCounts[i] = breakCount;
+        const float width = advances[i];
+        if (width != 0.0f) {
+            x += width;
+            mAdvancedOffsets.push_back(start + i);
+        }
+        if (width < 0.0f) {
+            mHasNegativeAdvance = true;
+        }
+        if (isAsciiOrBidiControlCharacter(buf[start + i])) {
+            mControlOffsets.push_back(start + i);
+        }
+        if (graphemeBreaks[i]) {
+            breakCount++;
+        }
+    }
+    mPrefixAdvances[count] = x;
+    mBreakCounts[count] = breakCount;
+}
+
+bool RunHitTestIndex::isGraphemeBreak(size_t offset) const {
+    // Rule GB2, ÷ eot
+    return offset == mStart + mCount ||
+           mBreakCounts[offset - mStart + 1] != mBreakCounts[offset - mStart];
+}
+
+// Returns the last offset of the sorted offsets below the given one, or fallback if none.
+static size_t lastOffsetBefore(const std::vector<size_t>& offsets, size_t offset, size_t fallback) {
+    auto it = std::lower_bound(offsets.begin(), offsets.end(), offset);
+    return it == offsets.begin() ? fallback : *(it - 1);
+}
+
+// Returns the first offset of the sorted offsets above the given one, or fallback if none.
+static size_t firstOffsetAfter(const std::vector<size_t>& offsets, size_t offset, size_t fallback) {
+    auto it = std::upper_bound(offsets.begin(), offsets.end(), offset);
+    return it == offsets.end() ? fallback : *it;
+}
+
+float RunHitTestIndex::getRunAdvance(size_t offset) const {
+    const size_t end = mStart + mCount;
+    float advance = mPrefixAdvances[offset - mStart];
+    if (offset < end && !isAsciiOrBidiControlCharacter(mBuf[offset]) &&
+        mAdvances[offset - mStart] == 0.0f) {
+        // In the middle of a cluster, same as the generic getRunAdvance().
+        const size_t lastCluster = lastOffsetBefore(mAdvancedOffsets, offset, mStart);
+        // Without an advance before the offset, the last cluster is the start, which has none.
+        const float clusterWidth = mAdvances[lastCluster - mStart];
+        const size_t nextCluster = std::min(firstOffsetAfter(mAdvancedOffsets, offset, end),
+                                            firstOffsetAfter(mControlOffsets, offset, end));
+        const int numGraphemeClusters =
+                mBreakCounts[nextCluster - mStart] - mBreakCounts[lastCluster - mStart];
+        const int numGraphemeClustersAfter =
+                mBreakCounts[nextCluster - mStart] - mBreakCounts[offset - mStart];
+        if (numGraphemeClusters > 0) {
+            advance -= clusterWidth * numGraphemeClustersAfter / numGraphemeClusters;
+        }
+    }
+    return advance;
+}
+
+size_t RunHitTestIndex::getOffsetForAdvance(float advance) const {
+    if (mCount == 0 || mHasNegativeAdvance) {
+        // The prefix sums can't be searched if they are not sorted.
+        return minikin::getOffsetForAdvance(mAdvances, mBuf, mStart, mCount, advance);
+    }
+    // The first code unit whose advance takes the sum beyond the given one is where the scan of
+    // getOffsetForAdvance() stops, or the last code unit if there is none.
+    const size_t end = mStart + mCount;
+    const auto stopIt =
+            std::upper_bound(mPrefixAdvances.begin() + 1, mPrefixAdvances.end(), advance);
+    const size_t stop = mStart + (stopIt - mPrefixAdvances.begin()) - 1;
+    const size_t lastStop = std::min(stop, end - 1);
+    // The search starts at the last cluster before the last grapheme break up to there.
+    const uint32_t breakCount = mBreakCounts[lastStop - mStart + 1];
+    const size_t lastBreak =
+            mStart + (std::lower_bound(mBreakCounts.begin(), mBreakCounts.end(), breakCount) -
+                      mBreakCounts.begin()) -
+            1;
+    const size_t searchStart = lastOffsetBefore(mAdvancedOffsets, lastBreak, mStart);
+    const float xSearchStart = mPrefixAdvances[searchStart - mStart];
+
+    size_t best = searchStart;
+    float bestDist = FLT_MAX;
+    for (size_t i = searchStart; i <= end; i++) {
+        if (isGraphemeBreak(i)) {
+            float delta = minikin::getRunAdvance(mAdvances, mBuf, mStart, searchStart,
+                                                 mCount - searchStart, i) +
+                          xSearchStart - advance;
+            if (std::abs(delta) < bestDist) {
+                bestDist = std::abs(delta);
+                best = i;
+            }
+            if (delta >= 0.0f) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
 struct BoundsComposer {
     BoundsComposer() : mAdvance(0) {}
 
@@ -208,6 +391,7 @@ struct BoundsComposer {
 void getBounds(const U16StringPiece& str, const Range& range, Bidi bidiFlag,
                const MinikinPaint& paint, StartHyphenEdit startHyphen, EndHyphenEdit endHyphen,
                MinikinRect* out) {
+    Layout::purgeDestroyedCollections();
     BoundsComposer bc;
     for (const BidiText::RunInfo info : BidiText(str, range, bidiFlag)) {
         for (const auto [context, piece] : LayoutSplitter(str, info.range, info.isRtl)) {
@@ -215,6 +399,9 @@ void getBounds(const U16StringPiece& str, const Range& range, Bidi bidiFlag,
                     (piece.getStart() == range.getStart()) ? startHyphen : StartHyphenEdit::NO_EDIT;
             const EndHyphenEdit pieceEndHyphen =
                     (piece.getEnd() == range.getEnd()) ? endHyphen : EndHyphenEdit::NO_EDIT;
+            LayoutProfile::getInstance().record(str.substr(context), piece - context.getStart(),
+                                                paint, info.isRtl, pieceStartHyphen,
+                                                pieceEndHyphen, true /* need bounds */);
             BoundsCache::getInstance().getOrCreate(str.substr(context), piece - context.getStart(),
                                                    paint, info.isRtl, pieceStartHyphen,
                                                    pieceEndHyphen, bc);
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/MemoryUsage.h"
+
+#include <atomic>
+#include <chrono>
+
+#include "minikin/BoundsCache.h"
+#include "minikin/CachePartition.h"
+#include "minikin/Font.h"
+#include "minikin/FontExtentCache.h"
+#include "minikin/GlyphBoundsCache.h"
+#include "minikin/ItemizeCache.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+#include "minikin/LineLayoutCache.h"
+
+#include "HyphenatorMap.h"
+#include "LocaleListCache.h"
+#include "MinikinTrace.h"
+#include "PhraseBreakCache.h"
+#include "WordBreaker.h"
+
+namespace minikin {
+
+namespace {
+
+// Returns the percentage of the memory of the caches to keep on a trim request of the level. The
+// running levels are sent to the foreground app, and the others once the app is hidden, so the
+// two ranges are mapped separately.
+uint32_t getRetainedPercent(TrimMemoryLevel level) {
+    if (level >= TrimMemoryLevel::MODERATE) {
+        return 0;
+    } else if (level >= TrimMemoryLevel::BACKGROUND) {
+        return 25;
+    } else if (level >= TrimMemoryLevel::UI_HIDDEN) {
+        return 50;
+    } else if (level >= TrimMemoryLevel::RUNNING_CRITICAL) {
+        return 25;
+    } else if (level >= TrimMemoryLevel::RUNNING_LOW) {
+        return 50;
+    } else if (level >= TrimMemoryLevel::RUNNING_MODERATE) {
+        return 75;
+    }
+    return 100;
+}
+
+}  // namespace
+
+size_t MemoryUsage::getTotal() const {
+    size_t total = 0;
+    for (const Entry& entry : entries) {
+        total += entry.bytes;
+    }
+    return total;
+}
+
+MemoryUsage getMemoryUsage() {
+    LayoutCache& layoutCache = LayoutCache::getInstance(CachePartition::Interactive);
+    LayoutCache& bulkLayoutCache = LayoutCache::getInstance(CachePartition::Bulk);
+    MemoryUsage usage;
+    usage.entries = {
+            {"LayoutCache", layoutCache.getMemoryUsage()},
+            {"LayoutSegmentCache", layoutCache.getSegmentCacheMemoryUsage()},
+            {"LayoutCache (bulk)", bulkLayoutCache.getMemoryUsage()},
+            {"LayoutSegmentCache (bulk)", bulkLayoutCache.getSegmentCacheMemoryUsage()},
+            {"LineLayoutCache", LineLayoutCache::getInstance().getMemoryUsage()},
+            {"BoundsCache", BoundsCache::getInstance(CachePartition::Interactive).getMemoryUsage()},
+            {"BoundsCache (bulk)", BoundsCache::getInstance(CachePartition::Bulk).getMemoryUsage()},
+            {"GlyphBoundsCache", GlyphBoundsCache::getInstance().getMemoryUsage()},
+            {"FontExtentCache", FontExtentCache::getInstance().getMemoryUsage()},
+            {"ItemizeCache", ItemizeCache::getInstance().getMemoryUsage()},
+            {"PhraseBreakCache", PhraseBreakCache::getInstance().getMemoryUsage()},
+            {"LocaleListCache", LocaleListCache::getMemoryUsage()},
+            {"HyphenatorMap", HyphenatorMap::getMemoryUsage()},
+            {"ExternalRefs", Font::getExternalRefsMemoryUsage()},
+    };
+    return usage;
+}
+
+#if defined(MINIKIN_ENABLE_TRACING)
+void traceMemoryUsageInternal() {
+    static std::atomic<int64_t> lastTraceMs(-kTraceMemoryUsageIntervalMs);
+    const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  std::chrono::steady_clock::now().time_since_epoch())
+                                  .count();
+    int64_t lastMs = lastTraceMs.load(std::memory_order_relaxed);
+    if (nowMs - lastMs < kTraceMemoryUsageIntervalMs ||
+        !lastTraceMs.compare_exchange_strong(lastMs, nowMs, std::memory_order_relaxed)) {
+        return;  // Traced recently, or being traced by another thread.
+    }
+    for (const MemoryUsage::Entry& entry : getMemoryUsage().entries) {
+        ATRACE_INT64(entry.name, entry.bytes);
+    }
+}
+#endif  // defined(MINIKIN_ENABLE_TRACING)
+
+void trimMemory(TrimMemoryLevel level) {
+    const uint32_t percent = getRetainedPercent(level);
+    if (percent == 100) {
+        return;
+    }
+    // The entries of the destroyed collections are never looked up again.
+    Layout::purgeDestroyedCollections();
+    // LayoutCache also trims its segment cache.
+    for (CachePartition partition : kCachePartitions) {
+        LayoutCache::getInstance(partition).trim(percent);
+        BoundsCache::getInstance(partition).trim(percent);
+    }
+    LineLayoutCache::getInstance().trim(percent);
+    GlyphBoundsCache::getInstance().trim(percent);
+    FontExtentCache::getInstance().trim(percent);
+    ItemizeCache::getInstance().trim(percent);
+    PhraseBreakCache::getInstance().trim(percent);
+    if (percent <= 25) {
+        ICULineBreakerPoolImpl::getInstance().clearPool();
+        Font::releaseIdleExternalRefs();
+    }
+}
+
+}  // namespace minikin
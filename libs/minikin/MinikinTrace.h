@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_TRACE_H
+#define MINIKIN_TRACE_H
+
+// The trace sections and counters of minikin, shown in systrace and Perfetto under the view
+// category. They are compiled in only with MINIKIN_ENABLE_TRACING, and cost a load of the enabled
+// tags while the category is not traced.
+#if defined(MINIKIN_ENABLE_TRACING)
+
+#define ATRACE_TAG ATRACE_TAG_VIEW
+#include <utils/Trace.h>
+
+#include <cstdint>
+
+// Traces the rest of the enclosing scope. The name must be a string literal.
+#define MINIKIN_TRACE_NAME(name) ATRACE_NAME(name)
+
+namespace minikin {
+
+void traceMemoryUsageInternal();
+
+// Sets the counter of each cache to its memory usage while the view category is traced, at most
+// every kTraceMemoryUsageIntervalMs. Collecting the usage locks every cache, so the check is
+// inlined into the callers and nothing else is done while the category is not traced.
+constexpr int64_t kTraceMemoryUsageIntervalMs = 100;
+inline void traceMemoryUsage() {
+    if (ATRACE_ENABLED()) {
+        traceMemoryUsageInternal();
+    }
+}
+
+}  // namespace minikin
+
+#else  // defined(MINIKIN_ENABLE_TRACING)
+
+#define MINIKIN_TRACE_NAME(name)
+
+namespace minikin {
+
+inline void traceMemoryUsage() {}
+
+}  // namespace minikin
+
+#endif  // defined(MINIKIN_ENABLE_TRACING)
+
+#endif  // MINIKIN_TRACE_H
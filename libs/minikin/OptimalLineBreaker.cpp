@@ -17,7 +17,9 @@
 #include "OptimalLineBreaker.h"
 
 #include <algorithm>
+#include <cmath>
 #include <limits>
+#include <memory>
 
 #include "minikin/Characters.h"
 #include "minikin/Layout.h"
@@ -96,32 +98,14 @@ struct OptimizeContext {
     // fonts), it's only guaranteed to pick one.
     float spaceWidth = 0.0f;
 
-    // Append desperate break point to the candidates.
-    inline void pushDesperate(uint32_t offset, ParaWidth sumOfCharWidths, uint32_t spaceCount,
-                              bool isRtl) {
-        candidates.emplace_back(offset, sumOfCharWidths, sumOfCharWidths, SCORE_DESPERATE,
-                                spaceCount, spaceCount,
-                                HyphenationType::BREAK_AND_DONT_INSERT_HYPHEN, isRtl);
-    }
-
-    // Append hyphenation break point to the candidates.
-    inline void pushHyphenation(uint32_t offset, ParaWidth preBreak, ParaWidth postBreak,
-                                float penalty, uint32_t spaceCount, HyphenationType type,
-                                bool isRtl) {
-        candidates.emplace_back(offset, preBreak, postBreak, penalty, spaceCount, spaceCount, type,
-                                isRtl);
-    }
-
-    // Append word break point to the candidates.
-    inline void pushWordBreak(uint32_t offset, ParaWidth preBreak, ParaWidth postBreak,
-                              float penalty, uint32_t preSpaceCount, uint32_t postSpaceCount,
-                              bool isRtl) {
-        candidates.emplace_back(offset, preBreak, postBreak, penalty, preSpaceCount, postSpaceCount,
-                                HyphenationType::DONT_BREAK, isRtl);
-    }
+    OptimizeContext() { clear(); }
 
-    OptimizeContext() {
+    // Resets the context to a new one, keeping the capacity of the candidates.
+    void clear() {
+        candidates.clear();
         candidates.emplace_back(0, 0.0f, 0.0f, 0.0f, 0, 0, HyphenationType::DONT_BREAK, false);
+        linePenalty = 0.0f;
+        spaceWidth = 0.0f;
     }
 };
 
@@ -148,188 +132,459 @@ std::pair<float, float> computePenalties(const Run& run, const LineWidth& lineWi
     return std::make_pair(hyphenPenalty, linePenalty);
 }
 
-// Represents a desperate break point.
-struct DesperateBreak {
-    // The break offset.
-    uint32_t offset;
+}  // namespace
+
+// The break candidates of a measured text, except for what depends on the line width: the
+// penalties scale with the hyphen penalty of their run, which is proportional to the first line
+// width, and the desperate breaks of a word are only candidates if the word is wider than the
+// narrowest line. Since the rest, i.e. the word breaking, the hyphenation points and the widths,
+// is the same at any width, the text keeps it for its next line breakings if
+// MeasuredText::setBreakCandidatesCachingEnabled was enabled when it was measured.
+class OptimalBreakCandidates {
+public:
+    // Returns true if breaking the text at the line width needs the hyphenation points, which are
+    // not computed yet if the hyphenation is deferred.
+    static bool needsDeferredHyphenation(const U16StringPiece& textBuf,
+                                         const MeasuredText& measured, const LineWidth& lineWidth,
+                                         BreakStrategy strategy, HyphenationFrequency frequency);
+
+    // Returns the candidates of the text, from the ones kept in the text if possible. The deferred
+    // hyphenation points are only computed if withDeferredHyphenation is true. The candidates not
+    // kept in the text are owned by *owned.
+    static const OptimalBreakCandidates* get(const U16StringPiece& textBuf,
+                                             const MeasuredText& measured,
+                                             bool withDeferredHyphenation,
+                                             std::unique_ptr<const OptimalBreakCandidates>* owned);
+
+    // Sets out to the candidates at the given line width, without the hyphenation points unless
+    // doHyphenation is true.
+    void instantiate(const MeasuredText& measured, const LineWidth& lineWidth,
+                     HyphenationFrequency frequency, bool justified, bool doHyphenation,
+                     OptimizeContext* out) const;
+
+private:
+    // A word break or hyphenation candidate. The penalty is the multiplier of the hyphen penalty
+    // of the run.
+    struct Entry {
+        Candidate candidate;
+        uint32_t runIndex;
+        bool isHyphenation;
+    };
+
+    // A word which can have desperate breaks.
+    struct Word {
+        Range range;
+        ParaWidth width;
+        // The width and the space count before the word.
+        ParaWidth widthBefore;
+        uint32_t spaceCount;
+        bool isRtl;
+        // The entries of the hyphenation points of the word.
+        uint32_t firstEntry;
+        uint32_t hyphenCount;
+    };
 
-    // The sum of the character width from the beginning of the word.
-    ParaWidth sumOfChars;
+    // Enumerate all line break candidates.
+    void populate(const U16StringPiece& textBuf, const MeasuredText& measured,
+                  const std::vector<HyphenBreak>& hyphenBreaks);
 
-    DesperateBreak(uint32_t offset, ParaWidth sumOfChars)
-            : offset(offset), sumOfChars(sumOfChars){};
+    std::vector<Entry> mEntries;
+    std::vector<Word> mWords;
+    // See OptimizeContext::spaceWidth.
+    float mSpaceWidth = 0.0f;
+    // False if the deferred hyphenation points were not computed for the candidates.
+    bool mHasHyphenation = true;
 };
 
-// Retrieves desperate break points from a word.
-std::vector<DesperateBreak> populateDesperatePoints(const MeasuredText& measured,
-                                                    const Range& range) {
-    std::vector<DesperateBreak> out;
-    ParaWidth width = measured.widths[range.getStart()];
-    for (uint32_t i = range.getStart() + 1; i < range.getEnd(); ++i) {
-        const float w = measured.widths[i];
-        if (w == 0) {
-            continue;  // w == 0 means here is not a grapheme bounds. Don't break here.
-        }
-        out.emplace_back(i, width);
-        width += w;
-    }
-    return out;
+// static
+bool OptimalBreakCandidates::needsDeferredHyphenation(const U16StringPiece& textBuf,
+                                                      const MeasuredText& measured,
+                                                      const LineWidth& lineWidth,
+                                                      BreakStrategy strategy,
+                                                      HyphenationFrequency frequency) {
+    // Unless balanced, a paragraph fitting in its first line is never broken at a hyphen, since
+    // any break only adds penalties to the score of the single line.
+    return measured.isHyphenationDeferred() && frequency != HyphenationFrequency::None &&
+           (strategy == BreakStrategy::Balanced ||
+            measured.getWidth(Range(0, textBuf.size())) > lineWidth.getAt(0));
 }
 
-// Append hyphenation break points and desperate break points.
-// If an offset is a both candidate for hyphenation and desperate break points, place desperate
-// break candidate first and hyphenation break points second since the result width of the desperate
-// break is shorter than hyphenation break.
-// This is important since DP in computeBreaksOptimal assumes that the result line width is
-// increased by break offset.
-void appendWithMerging(std::vector<HyphenBreak>::const_iterator hyIter,
-                       std::vector<HyphenBreak>::const_iterator endHyIter,
-                       const std::vector<DesperateBreak>& desperates, const CharProcessor& proc,
-                       float hyphenPenalty, bool isRtl, OptimizeContext* out) {
-    auto d = desperates.begin();
-    while (hyIter != endHyIter || d != desperates.end()) {
-        // If both hyphen breaks and desperate breaks point to the same offset, push desperate
-        // breaks first.
-        if (d != desperates.end() && (hyIter == endHyIter || d->offset <= hyIter->offset)) {
-            out->pushDesperate(d->offset, proc.sumOfCharWidthsAtPrevWordBreak + d->sumOfChars,
-                               proc.effectiveSpaceCount, isRtl);
-            d++;
-        } else {
-            out->pushHyphenation(hyIter->offset, proc.sumOfCharWidths - hyIter->second,
-                                 proc.sumOfCharWidthsAtPrevWordBreak + hyIter->first, hyphenPenalty,
-                                 proc.effectiveSpaceCount, hyIter->type, isRtl);
-            hyIter++;
+// static
+const OptimalBreakCandidates* OptimalBreakCandidates::get(
+        const U16StringPiece& textBuf, const MeasuredText& measured, bool withDeferredHyphenation,
+        std::unique_ptr<const OptimalBreakCandidates>* owned) {
+    if (measured.mCacheBreakCandidates) {
+        const OptimalBreakCandidates* cached = measured.mBreakCandidates.get();
+        if (cached != nullptr && (cached->mHasHyphenation || !withDeferredHyphenation)) {
+            return cached;
         }
     }
-}
-
-// Enumerate all line break candidates.
-OptimizeContext populateCandidates(const U16StringPiece& textBuf, const MeasuredText& measured,
-                                   const LineWidth& lineWidth, HyphenationFrequency frequency,
-                                   bool isJustified) {
-    const ParaWidth minLineWidth = lineWidth.getMin();
-    CharProcessor proc(textBuf);
 
-    OptimizeContext result;
+    auto candidates = std::make_unique<OptimalBreakCandidates>();
+    if (!measured.isHyphenationDeferred()) {
+        candidates->populate(textBuf, measured, measured.hyphenBreaks);
+    } else if (withDeferredHyphenation) {
+        candidates->populate(textBuf, measured, measured.computeHyphenBreaks(textBuf));
+    } else {
+        candidates->populate(textBuf, measured, std::vector<HyphenBreak>());
+        candidates->mHasHyphenation = false;
+    }
+    if (measured.mCacheBreakCandidates) {
+        // Another thread may have published candidates meanwhile. They are kept unless these ones
+        // add the hyphenation points, so the text keeps at most two of them.
+        const bool hasHyphenation = candidates->mHasHyphenation;
+        return measured.mBreakCandidates.publishUnless(
+                std::move(candidates), [hasHyphenation](const OptimalBreakCandidates& current) {
+                    return current.mHasHyphenation || !hasHyphenation;
+                });
+    }
+    *owned = std::move(candidates);
+    return owned->get();
+}
 
-    const bool doHyphenation = frequency != HyphenationFrequency::None;
-    auto hyIter = std::begin(measured.hyphenBreaks);
+void OptimalBreakCandidates::populate(const U16StringPiece& textBuf, const MeasuredText& measured,
+                                      const std::vector<HyphenBreak>& hyphenBreaks) {
+    CharProcessor proc(textBuf, measured.wordBreaks);
 
-    for (const auto& run : measured.runs) {
-        const bool isRtl = run->isRtl();
-        const Range& range = run->getRange();
+    auto hyIter = std::begin(hyphenBreaks);
 
-        // Compute penalty parameters.
-        float hyphenPenalty = 0.0f;
-        if (run->canBreak()) {
-            auto penalties = computePenalties(*run, lineWidth, frequency, isJustified);
-            hyphenPenalty = penalties.first;
-            result.linePenalty = std::max(penalties.second, result.linePenalty);
-        }
+    for (uint32_t runIndex = 0; runIndex < measured.runs.size(); ++runIndex) {
+        const Run& run = *measured.runs[runIndex];
+        const bool isRtl = run.isRtl();
+        const Range& range = run.getRange();
 
-        proc.updateLocaleIfNecessary(*run);
+        proc.updateLocaleIfNecessary(run);
 
         for (uint32_t i = range.getStart(); i < range.getEnd(); ++i) {
             MINIKIN_ASSERT(textBuf[i] != CHAR_TAB, "TAB is not supported in optimal line breaker");
             // Even if the run is not a candidate of line break, treat the end of run as the line
             // break candidate.
-            const bool canBreak = run->canBreak() || (i + 1) == range.getEnd();
-            proc.feedChar(i, textBuf[i], measured.widths[i], canBreak);
+            const bool canBreak = run.canBreak() || (i + 1) == range.getEnd();
+            proc.feedChar(i, textBuf[i], measured.getCharWidth(i), canBreak);
 
             const uint32_t nextCharOffset = i + 1;
             if (nextCharOffset != proc.nextWordBreak) {
                 continue;  // Wait until word break point.
             }
 
-            // Add hyphenation and desperate break points.
-            std::vector<HyphenBreak> hyphenedBreaks;
-            std::vector<DesperateBreak> desperateBreaks;
+            // Add hyphenation break points. The desperate break points are added by instantiate.
             const Range contextRange = proc.contextRange();
-
-            auto beginHyIter = hyIter;
-            while (hyIter != std::end(measured.hyphenBreaks) &&
+            const uint32_t firstEntry = mEntries.size();
+            while (hyIter != std::end(hyphenBreaks) &&
                    hyIter->offset < contextRange.getEnd()) {
+                mEntries.push_back({Candidate(hyIter->offset, proc.sumOfCharWidths - hyIter->second,
+                                              proc.sumOfCharWidthsAtPrevWordBreak + hyIter->first,
+                                              1.0f, proc.effectiveSpaceCount,
+                                              proc.effectiveSpaceCount, hyIter->type, isRtl),
+                                    runIndex, true /* isHyphenation */});
                 hyIter++;
             }
-            if (proc.widthFromLastWordBreak() > minLineWidth) {
-                desperateBreaks = populateDesperatePoints(measured, contextRange);
+            if (contextRange.getLength() > 1) {
+                mWords.push_back({contextRange, proc.widthFromLastWordBreak(),
+                                  proc.sumOfCharWidthsAtPrevWordBreak, proc.effectiveSpaceCount,
+                                  isRtl, firstEntry,
+                                  static_cast<uint32_t>(mEntries.size() - firstEntry)});
             }
-            appendWithMerging(beginHyIter, doHyphenation ? hyIter : beginHyIter, desperateBreaks,
-                              proc, hyphenPenalty, isRtl, &result);
 
             // We skip breaks for zero-width characters inside replacement spans.
-            if (run->getPaint() != nullptr || nextCharOffset == range.getEnd() ||
-                measured.widths[nextCharOffset] > 0) {
-                const float penalty = hyphenPenalty * proc.wordBreakPenalty();
-                result.pushWordBreak(nextCharOffset, proc.sumOfCharWidths, proc.effectiveWidth,
-                                     penalty, proc.rawSpaceCount, proc.effectiveSpaceCount, isRtl);
+            if (run.getPaint() != nullptr || nextCharOffset == range.getEnd() ||
+                measured.getCharWidth(nextCharOffset) > 0) {
+                mEntries.push_back({Candidate(nextCharOffset, proc.sumOfCharWidths,
+                                              proc.effectiveWidth, proc.wordBreakPenalty(),
+                                              proc.rawSpaceCount, proc.effectiveSpaceCount,
+                                              HyphenationType::DONT_BREAK, isRtl),
+                                    runIndex, false /* isHyphenation */});
             }
         }
     }
-    result.spaceWidth = proc.spaceWidth;
-    return result;
+    mSpaceWidth = proc.spaceWidth;
+}
+
+void OptimalBreakCandidates::instantiate(const MeasuredText& measured, const LineWidth& lineWidth,
+                                         HyphenationFrequency frequency, bool justified,
+                                         bool doHyphenation, OptimizeContext* out) const {
+    OptimizeContext& result = *out;
+    result.clear();
+
+    // Compute penalty parameters.
+    std::vector<float> hyphenPenalties(measured.runs.size(), 0.0f);
+    for (uint32_t runIndex = 0; runIndex < measured.runs.size(); ++runIndex) {
+        const Run& run = *measured.runs[runIndex];
+        if (run.canBreak()) {
+            auto penalties = computePenalties(run, lineWidth, frequency, justified);
+            hyphenPenalties[runIndex] = penalties.first;
+            result.linePenalty = std::max(penalties.second, result.linePenalty);
+        }
+    }
+
+    auto pushEntry = [&](const Entry& entry) {
+        if (entry.isHyphenation) {
+            if (doHyphenation) {
+                result.candidates.push_back(entry.candidate);
+                result.candidates.back().penalty = hyphenPenalties[entry.runIndex];
+            }
+        } else {
+            result.candidates.push_back(entry.candidate);
+            result.candidates.back().penalty *= hyphenPenalties[entry.runIndex];
+        }
+    };
+
+    const ParaWidth minLineWidth = lineWidth.getMin();
+    result.candidates.reserve(mEntries.size() + 1);
+    uint32_t entryIndex = 0;
+    for (const Word& word : mWords) {
+        if (word.width <= minLineWidth) {
+            continue;
+        }
+        for (; entryIndex < word.firstEntry; entryIndex++) {
+            pushEntry(mEntries[entryIndex]);
+        }
+
+        // If an offset is a both candidate for hyphenation and desperate break points, place
+        // desperate break candidate first and hyphenation break points second since the result
+        // width of the desperate break is shorter than hyphenation break.
+        // This is important since DP in computeBreaksOptimal assumes that the result line width
+        // is increased by break offset.
+        // The desperate breaks are the grapheme bounds, i.e. the characters with a non-zero width,
+        // after the first one. They are visited in place rather than collected per word first,
+        // since a long URL or a CJK run without word breaks has as many of them as characters.
+        const uint32_t endEntry = word.firstEntry + word.hyphenCount;
+        ParaWidth sumOfChars = measured.getCharWidth(word.range.getStart());
+        uint32_t d = word.range.getStart() + 1;
+        auto skipNonBounds = [&]() {
+            while (d < word.range.getEnd() && measured.getCharWidth(d) == 0) {
+                d++;
+            }
+        };
+        skipNonBounds();
+        while (entryIndex != endEntry || d < word.range.getEnd()) {
+            if (d < word.range.getEnd() &&
+                (entryIndex == endEntry || d <= mEntries[entryIndex].candidate.offset)) {
+                const ParaWidth width = word.widthBefore + sumOfChars;
+                result.candidates.emplace_back(d, width, width, SCORE_DESPERATE, word.spaceCount,
+                                               word.spaceCount,
+                                               HyphenationType::BREAK_AND_DONT_INSERT_HYPHEN,
+                                               word.isRtl);
+                sumOfChars += measured.getCharWidth(d);
+                d++;
+                skipNonBounds();
+            } else {
+                pushEntry(mEntries[entryIndex]);
+                entryIndex++;
+            }
+        }
+    }
+    for (; entryIndex < mEntries.size(); entryIndex++) {
+        pushEntry(mEntries[entryIndex]);
+    }
+    result.spaceWidth = mSpaceWidth;
+}
+
+namespace {
+
+// The scores of the computed candidates with the minimum of each block of them. When all the lines
+// have the same width, the candidates the optimizer skips for a line end don't change its state,
+// so that it can skip whole blocks instead of visiting each of the skipped candidates.
+class BlockedScores {
+public:
+    // The scores are appended to by the optimizer, and each of them is added here by set. The
+    // minimums are kept in blockMins, whose previous content is discarded.
+    BlockedScores(const std::vector<float>& scores, uint32_t size, std::vector<float>* blockMins)
+            : mScores(scores), mBlockMins(*blockMins) {
+        mBlockMins.assign((size + BLOCK_SIZE - 1) / BLOCK_SIZE, kNoScore);
+    }
+
+    void set(uint32_t index) {
+        const float score = mScores[index];
+        // NaN compares false, so a NaN score is never skipped. Keep it in the minimums as -inf.
+        const float value = std::isnan(score) ? -kNoScore : score;
+        float& blockMin = mBlockMins[index / BLOCK_SIZE];
+        blockMin = std::min(blockMin, value);
+    }
+
+    // Returns the first index in [start, end) whose score the optimizer doesn't skip, i.e. for
+    // which "score + bestHope >= best" is false, or end if there is none. Since the float addition
+    // is monotonic, a block is skipped as a whole if its minimum score is skipped.
+    uint32_t findNext(uint32_t start, uint32_t end, float bestHope, float best) const {
+        uint32_t i = start;
+        for (; i < end && i % BLOCK_SIZE != 0; i++) {
+            if (!(mScores[i] + bestHope >= best)) {
+                return i;
+            }
+        }
+        while (i < end && mBlockMins[i / BLOCK_SIZE] + bestHope >= best) {
+            i += BLOCK_SIZE;
+        }
+        for (; i < end; i++) {
+            if (!(mScores[i] + bestHope >= best)) {
+                return i;
+            }
+        }
+        return end;
+    }
+
+private:
+    static constexpr uint32_t BLOCK_SIZE = 16;
+    static constexpr float kNoScore = std::numeric_limits<float>::infinity();
+
+    const std::vector<float>& mScores;
+    std::vector<float>& mBlockMins;
+};
+
+// The number of candidates a line can start at from which the optimizer skips the blocks of
+// BlockedScores.
+constexpr uint32_t MIN_CANDIDATES_TO_SKIP_BLOCKS = 32;
+
+// Returns true if all the lines the candidates can make have the same width.
+bool hasConstantWidth(const LineWidth& lineWidth, uint32_t maxLineCount) {
+    const float width = lineWidth.getAt(0);
+    for (uint32_t lineNumber = 1; lineNumber < maxLineCount; lineNumber++) {
+        if (lineWidth.getAt(lineNumber) != width) {
+            return false;
+        }
+    }
+    return true;
 }
 
+// Data used to compute optimal line breaks, with an element per candidate in each array. The
+// inner loop of computeBreaksData reads the scores and the line numbers of all the candidates a
+// line can start at, so they are kept in arrays of their own rather than in a struct with the
+// links only read by finishBreaksOptimal.
+struct OptimalBreaksData {
+    std::vector<float> scores;          // best score found for this break
+    std::vector<uint32_t> prevs;        // index to previous break
+    std::vector<uint32_t> lineNumbers;  // the computed line number of the candidate
+    // The widths before the candidates, see computeBreaksData.
+    std::vector<ParaWidth> preBreaks;
+    // The storage of BlockedScores.
+    std::vector<float> blockMins;
+};
+
 class LineBreakOptimizer {
 public:
-    LineBreakOptimizer() {}
+    // The optimizer keeps its state in data, reusing the capacity of its arrays.
+    explicit LineBreakOptimizer(OptimalBreaksData* data) : mData(*data) {}
 
-    LineBreakResult computeBreaks(const OptimizeContext& context, const U16StringPiece& textBuf,
-                                  const MeasuredText& measuredText, const LineWidth& lineWidth,
-                                  BreakStrategy strategy, bool justified);
+    // Sets out to the first maxLines lines of the optimal breaks.
+    void computeBreaks(const OptimizeContext& context, const U16StringPiece& textBuf,
+                       const MeasuredText& measuredText, const LineWidth& lineWidth,
+                       BreakStrategy strategy, bool justified, uint32_t maxLines,
+                       LineBreakResult* out);
+
+    // Returns the number of lines of computeBreaks, without building the result.
+    uint32_t computeLineCount(const OptimizeContext& context, const LineWidth& lineWidth,
+                              BreakStrategy strategy, bool justified);
 
 private:
-    // Data used to compute optimal line breaks
-    struct OptimalBreaksData {
-        float score;          // best score found for this break
-        uint32_t prev;        // index to previous break
-        uint32_t lineNumber;  // the computed line number of the candidate
-    };
-    LineBreakResult finishBreaksOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
-                                        const std::vector<OptimalBreaksData>& breaksData,
-                                        const std::vector<Candidate>& candidates);
+    void computeBreaksData(const OptimizeContext& context, const LineWidth& lineWidth,
+                           BreakStrategy strategy, bool justified);
+    void finishBreaksOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                             const std::vector<Candidate>& candidates, uint32_t maxLines,
+                             LineBreakResult* out);
+
+    OptimalBreaksData& mData;
 };
 
-// Follow "prev" links in candidates array, and copy to result arrays.
-LineBreakResult LineBreakOptimizer::finishBreaksOptimal(
-        const U16StringPiece& textBuf, const MeasuredText& measured,
-        const std::vector<OptimalBreaksData>& breaksData,
-        const std::vector<Candidate>& candidates) {
-    LineBreakResult result;
+// Follow "prev" links in candidates array, and copy to result arrays. The lines are written in
+// place from their line numbers, so that the result doesn't have to be reversed.
+void LineBreakOptimizer::finishBreaksOptimal(const U16StringPiece& textBuf,
+                                             const MeasuredText& measured,
+                                             const std::vector<Candidate>& candidates,
+                                             uint32_t maxLines, LineBreakResult* out) {
     const uint32_t nCand = candidates.size();
+    const uint32_t lineCount = std::min(mData.lineNumbers[nCand - 1], maxLines);
+    const bool deferredExtents = measured.isLineExtentsDeferred();
+    out->clear();
+    out->breakPoints.resize(lineCount);
+    out->widths.resize(lineCount);
+    out->flags.resize(lineCount);
+    if (!deferredExtents) {
+        out->ascents.resize(lineCount);
+        out->descents.resize(lineCount);
+    }
     uint32_t prevIndex;
     for (uint32_t i = nCand - 1; i > 0; i = prevIndex) {
-        prevIndex = breaksData[i].prev;
+        prevIndex = mData.prevs[i];
+        const uint32_t lineNumber = mData.lineNumbers[i];
+        if (lineNumber > maxLines) {
+            continue;  // The extents of the lines after maxLines are never computed.
+        }
+        const uint32_t line = lineNumber - 1;
         const Candidate& cand = candidates[i];
         const Candidate& prev = candidates[prevIndex];
 
-        result.breakPoints.push_back(cand.offset);
-        result.widths.push_back(cand.postBreak - prev.preBreak);
-        MinikinExtent extent = measured.getExtent(textBuf, Range(prev.offset, cand.offset));
-        result.ascents.push_back(extent.ascent);
-        result.descents.push_back(extent.descent);
+        out->breakPoints[line] = cand.offset;
+        out->widths[line] = cand.postBreak - prev.preBreak;
+        if (!deferredExtents) {
+            MinikinExtent extent = measured.getExtent(textBuf, Range(prev.offset, cand.offset));
+            out->ascents[line] = extent.ascent;
+            out->descents[line] = extent.descent;
+        }
 
         const HyphenEdit edit =
                 packHyphenEdit(editForNextLine(prev.hyphenType), editForThisLine(cand.hyphenType));
-        result.flags.push_back(static_cast<int>(edit));
+        out->flags[line] = static_cast<int>(edit);
     }
-    result.reverse();
-    return result;
+    if (deferredExtents) {
+        out->deferExtents();
+    }
+}
+
+void LineBreakOptimizer::computeBreaks(const OptimizeContext& context,
+                                       const U16StringPiece& textBuf, const MeasuredText& measured,
+                                       const LineWidth& lineWidth, BreakStrategy strategy,
+                                       bool justified, uint32_t maxLines, LineBreakResult* out) {
+    computeBreaksData(context, lineWidth, strategy, justified);
+    finishBreaksOptimal(textBuf, measured, context.candidates, maxLines, out);
+}
+
+uint32_t LineBreakOptimizer::computeLineCount(const OptimizeContext& context,
+                                              const LineWidth& lineWidth, BreakStrategy strategy,
+                                              bool justified) {
+    computeBreaksData(context, lineWidth, strategy, justified);
+    // The last candidate is always the end of the last line.
+    return mData.lineNumbers.back();
 }
 
-LineBreakResult LineBreakOptimizer::computeBreaks(const OptimizeContext& context,
-                                                  const U16StringPiece& textBuf,
-                                                  const MeasuredText& measured,
-                                                  const LineWidth& lineWidth,
-                                                  BreakStrategy strategy, bool justified) {
+void LineBreakOptimizer::computeBreaksData(const OptimizeContext& context,
+                                           const LineWidth& lineWidth, BreakStrategy strategy,
+                                           bool justified) {
     const std::vector<Candidate>& candidates = context.candidates;
     uint32_t active = 0;
     const uint32_t nCand = candidates.size();
     const float maxShrink = justified ? SHRINKABILITY * context.spaceWidth : 0.0f;
 
-    std::vector<OptimalBreaksData> breaksData;
-    breaksData.reserve(nCand);
-    breaksData.push_back({0.0, 0, 0});  // The first candidate is always at the first line.
+    // The widths before the candidates are also read for every line start, so they are copied out
+    // of the candidates for the same reason as the scores.
+    std::vector<ParaWidth>& preBreaks = mData.preBreaks;
+    preBreaks.resize(nCand);
+    for (uint32_t i = 0; i < nCand; i++) {
+        preBreaks[i] = candidates[i].preBreak;
+    }
+
+    std::vector<float>& scores = mData.scores;
+    std::vector<uint32_t>& prevs = mData.prevs;
+    std::vector<uint32_t>& lineNumbers = mData.lineNumbers;
+    scores.clear();
+    prevs.clear();
+    lineNumbers.clear();
+    scores.reserve(nCand);
+    prevs.reserve(nCand);
+    lineNumbers.reserve(nCand);
+    // The first candidate is always at the first line.
+    scores.push_back(0.0);
+    prevs.push_back(0);
+    lineNumbers.push_back(0);
+
+    // With the same width for all the lines, the candidates skipped by the "bestHope" check are
+    // found by the blocks of minimum scores. The breaks are the same, but the cost of a line end
+    // no longer grows with all the candidates fitting in the line, which can be hundreds for wide
+    // or justified lines.
+    const bool constantWidth = hasConstantWidth(lineWidth, nCand);
+    BlockedScores minScores(scores, constantWidth ? nCand : 0, &mData.blockMins);
+    if (constantWidth) {
+        minScores.set(0);
+    }
 
     // "i" iterates through candidates for the end of the line.
     for (uint32_t i = 1; i < nCand; i++) {
@@ -337,27 +592,16 @@ LineBreakResult LineBreakOptimizer::computeBreaks(const OptimizeContext& context
         float best = SCORE_INFTY;
         uint32_t bestPrev = 0;
 
-        uint32_t lineNumberLast = breaksData[active].lineNumber;
+        uint32_t lineNumberLast = lineNumbers[active];
         float width = lineWidth.getAt(lineNumberLast);
 
         ParaWidth leftEdge = candidates[i].postBreak - width;
         float bestHope = 0;
 
-        // "j" iterates through candidates for the beginning of the line.
-        for (uint32_t j = active; j < i; j++) {
-            const uint32_t lineNumber = breaksData[j].lineNumber;
-            if (lineNumber != lineNumberLast) {
-                const float widthNew = lineWidth.getAt(lineNumber);
-                if (widthNew != width) {
-                    leftEdge = candidates[i].postBreak - width;
-                    bestHope = 0;
-                    width = widthNew;
-                }
-                lineNumberLast = lineNumber;
-            }
-            const float jScore = breaksData[j].score;
-            if (jScore + bestHope >= best) continue;
-            const float delta = candidates[j].preBreak - leftEdge;
+        // Scores the line from the candidate j to the candidate i.
+        auto scoreLine = [&](uint32_t j) {
+            const float jScore = scores[j];
+            const float delta = preBreaks[j] - leftEdge;
 
             // compute width score for line
 
@@ -394,26 +638,164 @@ LineBreakResult LineBreakOptimizer::computeBreaks(const OptimizeContext& context
                 best = score;
                 bestPrev = j;
             }
+        };
+
+        // "j" iterates through candidates for the beginning of the line.
+        if (constantWidth && i - active >= MIN_CANDIDATES_TO_SKIP_BLOCKS) {
+            // Same as below, the line width and the skipped candidates don't change anything.
+            for (uint32_t j = minScores.findNext(active, i, bestHope, best); j < i;
+                 j = minScores.findNext(j + 1, i, bestHope, best)) {
+                scoreLine(j);
+            }
+        } else {
+            for (uint32_t j = active; j < i; j++) {
+                const uint32_t lineNumber = lineNumbers[j];
+                if (lineNumber != lineNumberLast) {
+                    const float widthNew = lineWidth.getAt(lineNumber);
+                    if (widthNew != width) {
+                        leftEdge = candidates[i].postBreak - width;
+                        bestHope = 0;
+                        width = widthNew;
+                    }
+                    lineNumberLast = lineNumber;
+                }
+                if (scores[j] + bestHope >= best) continue;
+                scoreLine(j);
+            }
         }
-        breaksData.push_back({best + candidates[i].penalty + context.linePenalty,  // score
-                              bestPrev,                                            // prev
-                              breaksData[bestPrev].lineNumber + 1});               // lineNumber
+        scores.push_back(best + candidates[i].penalty + context.linePenalty);
+        prevs.push_back(bestPrev);
+        lineNumbers.push_back(lineNumbers[bestPrev] + 1);
+        if (constantWidth) {
+            minScores.set(i);
+        }
+    }
+}
+
+// Calls fn with the optimization context at each of the line widths, which is kept in context. The
+// candidates are only enumerated once for all the widths.
+template <typename Fn>
+void forEachLineWidth(const U16StringPiece& textBuf, const MeasuredText& measured,
+                      const std::vector<const LineWidth*>& lineWidths, BreakStrategy strategy,
+                      HyphenationFrequency frequency, bool justified, OptimizeContext* context,
+                      Fn fn) {
+    std::vector<bool> needsDeferredHyphenation;
+    bool withDeferredHyphenation = false;
+    for (const LineWidth* lineWidth : lineWidths) {
+        needsDeferredHyphenation.push_back(OptimalBreakCandidates::needsDeferredHyphenation(
+                textBuf, measured, *lineWidth, strategy, frequency));
+        withDeferredHyphenation |= needsDeferredHyphenation.back();
+    }
+    std::unique_ptr<const OptimalBreakCandidates> ownedCandidates;
+    const OptimalBreakCandidates* candidates = OptimalBreakCandidates::get(
+            textBuf, measured, withDeferredHyphenation, &ownedCandidates);
+    for (size_t i = 0; i < lineWidths.size(); ++i) {
+        // Without the deferred hyphenation points if the width doesn't need them, the same as the
+        // breaking at this width alone.
+        const bool doHyphenation =
+                frequency != HyphenationFrequency::None &&
+                (!measured.isHyphenationDeferred() || needsDeferredHyphenation[i]);
+        candidates->instantiate(measured, *lineWidths[i], frequency, justified, doHyphenation,
+                                context);
+        fn(*context, *lineWidths[i]);
     }
-    return finishBreaksOptimal(textBuf, measured, breaksData, candidates);
 }
 
 }  // namespace
 
+// The scratch memory of the optimal line breaking, see LineBreakScratch.
+class OptimalBreakScratch {
+public:
+    OptimizeContext context;
+    OptimalBreaksData breaksData;
+};
+
+LineBreakScratch::LineBreakScratch() : mOptimal(std::make_unique<OptimalBreakScratch>()) {}
+
+LineBreakScratch::~LineBreakScratch() {}
+
 LineBreakResult breakLineOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
                                  const LineWidth& lineWidth, BreakStrategy strategy,
                                  HyphenationFrequency frequency, bool justified) {
+    return breakLineOptimal(textBuf, measured, lineWidth, strategy, frequency, justified,
+                            std::numeric_limits<uint32_t>::max());
+}
+
+LineBreakResult breakLineOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                                 const LineWidth& lineWidth, BreakStrategy strategy,
+                                 HyphenationFrequency frequency, bool justified,
+                                 uint32_t maxLines) {
+    LineBreakResult result;
+    OptimalBreakScratch scratch;
+    breakLineOptimal(textBuf, measured, lineWidth, strategy, frequency, justified, maxLines,
+                     &scratch, &result);
+    return result;
+}
+
+void breakLineOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                      const LineWidth& lineWidth, BreakStrategy strategy,
+                      HyphenationFrequency frequency, bool justified, uint32_t maxLines,
+                      OptimalBreakScratch* scratch, LineBreakResult* out) {
+    if (textBuf.size() == 0 || maxLines == 0) {
+        out->clear();
+        return;
+    }
+    forEachLineWidth(textBuf, measured, {&lineWidth}, strategy, frequency, justified,
+                     &scratch->context,
+                     [&](const OptimizeContext& context, const LineWidth& width) {
+                         LineBreakOptimizer optimizer(&scratch->breaksData);
+                         optimizer.computeBreaks(context, textBuf, measured, width, strategy,
+                                                 justified, maxLines, out);
+                     });
+}
+
+uint32_t countLinesOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                           const LineWidth& lineWidth, BreakStrategy strategy,
+                           HyphenationFrequency frequency, bool justified) {
+    return countLinesOptimal(textBuf, measured, {&lineWidth}, strategy, frequency, justified)[0];
+}
+
+std::vector<LineBreakResult> breakLineOptimal(const U16StringPiece& textBuf,
+                                              const MeasuredText& measured,
+                                              const std::vector<const LineWidth*>& lineWidths,
+                                              BreakStrategy strategy,
+                                              HyphenationFrequency frequency, bool justified) {
+    std::vector<LineBreakResult> results(lineWidths.size());
+    if (textBuf.size() == 0) {
+        return results;
+    }
+    size_t i = 0;
+    OptimalBreakScratch scratch;
+    forEachLineWidth(textBuf, measured, lineWidths, strategy, frequency, justified,
+                     &scratch.context,
+                     [&](const OptimizeContext& context, const LineWidth& width) {
+                         LineBreakOptimizer optimizer(&scratch.breaksData);
+                         optimizer.computeBreaks(context, textBuf, measured, width, strategy,
+                                                 justified, std::numeric_limits<uint32_t>::max(),
+                                                 &results[i++]);
+                     });
+    return results;
+}
+
+std::vector<uint32_t> countLinesOptimal(const U16StringPiece& textBuf,
+                                        const MeasuredText& measured,
+                                        const std::vector<const LineWidth*>& lineWidths,
+                                        BreakStrategy strategy, HyphenationFrequency frequency,
+                                        bool justified) {
+    std::vector<uint32_t> counts;
     if (textBuf.size() == 0) {
-        return LineBreakResult();
+        counts.resize(lineWidths.size(), 0);
+        return counts;
     }
-    const OptimizeContext context =
-            populateCandidates(textBuf, measured, lineWidth, frequency, justified);
-    LineBreakOptimizer optimizer;
-    return optimizer.computeBreaks(context, textBuf, measured, lineWidth, strategy, justified);
+    OptimalBreakScratch scratch;
+    forEachLineWidth(textBuf, measured, lineWidths, strategy, frequency, justified,
+                     &scratch.context,
+                     [&](const OptimizeContext& context, const LineWidth& width) {
+                         LineBreakOptimizer optimizer(&scratch.breaksData);
+                         counts.push_back(
+                                 optimizer.computeLineCount(context, width, strategy, justified));
+                     });
+    return counts;
 }
 
 }  // namespace minikin
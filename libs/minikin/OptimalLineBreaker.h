@@ -17,6 +17,8 @@
 #ifndef MINIKIN_OPTIMAL_LINE_BREAKER_H
 #define MINIKIN_OPTIMAL_LINE_BREAKER_H
 
+#include <vector>
+
 #include "minikin/LineBreaker.h"
 #include "minikin/MeasuredText.h"
 #include "minikin/U16StringPiece.h"
@@ -27,6 +29,40 @@ LineBreakResult breakLineOptimal(const U16StringPiece& textBuf, const MeasuredTe
                                  const LineWidth& lineWidthLimits, BreakStrategy strategy,
                                  HyphenationFrequency frequency, bool justified);
 
+// Same as above, but only returns the first maxLines lines. The breaks are still optimized for the
+// whole text, so the lines are the same as the first lines of the above.
+LineBreakResult breakLineOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                                 const LineWidth& lineWidthLimits, BreakStrategy strategy,
+                                 HyphenationFrequency frequency, bool justified,
+                                 uint32_t maxLines);
+
+// Same as above, but writes the lines to out, reusing the capacity of its vectors, and keeps the
+// break candidates and the optimization state in scratch.
+void breakLineOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                      const LineWidth& lineWidthLimits, BreakStrategy strategy,
+                      HyphenationFrequency frequency, bool justified, uint32_t maxLines,
+                      OptimalBreakScratch* scratch, LineBreakResult* out);
+
+// Returns the number of lines of breakLineOptimal, without building the result.
+uint32_t countLinesOptimal(const U16StringPiece& textBuf, const MeasuredText& measured,
+                           const LineWidth& lineWidthLimits, BreakStrategy strategy,
+                           HyphenationFrequency frequency, bool justified);
+
+// Same as breakLineOptimal at each of the line widths, with the break candidates enumerated once
+// for all the widths.
+std::vector<LineBreakResult> breakLineOptimal(const U16StringPiece& textBuf,
+                                              const MeasuredText& measured,
+                                              const std::vector<const LineWidth*>& lineWidths,
+                                              BreakStrategy strategy,
+                                              HyphenationFrequency frequency, bool justified);
+
+// Returns the number of lines of each result of the above, without building the results.
+std::vector<uint32_t> countLinesOptimal(const U16StringPiece& textBuf,
+                                        const MeasuredText& measured,
+                                        const std::vector<const LineWidth*>& lineWidths,
+                                        BreakStrategy strategy, HyphenationFrequency frequency,
+                                        bool justified);
+
 }  // namespace minikin
 
 #endif  // MINIKIN_OPTIMAL_LINE_BREAKER_H
@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Minikin"
+
+#include "minikin/PersistentLayoutCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include <optional>
+
+#include <log/log.h>
+
+#include "minikin/FontCollection.h"
+#include "minikin/LocaleList.h"
+
+#include "MinikinInternal.h"
+
+namespace minikin {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x43504C4D;  // "MLPC" in little endian.
+// Bump this when changing the format of the keys or the values.
+constexpr uint32_t kFormatVersion = 3;
+constexpr size_t kHeaderSize = sizeof(uint32_t) * 2;
+// The key size, the value size, the checksum of the key and the value, and a padding.
+constexpr size_t kRecordHeaderSize = sizeof(uint32_t) * 4;
+// The appended records are written to the file once this many bytes are pending.
+constexpr size_t kFlushThreshold = 64 * 1024;
+
+// The records start at the multiples of the maximum alignment of BufferReader, so that the values
+// can be read in place from the mapped file, whose head is page aligned.
+constexpr size_t alignRecord(size_t size) {
+    constexpr size_t kAlignment = BufferReader::kMaxAlignment;
+    return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+// The 32-bit FNV-1a hash of the key and the value of a record, which is checked when the file is
+// opened, so that a corrupted record is never read.
+IGNORE_INTEGER_OVERFLOW uint32_t computeRecordChecksum(const uint8_t* key, size_t keySize,
+                                                       const uint8_t* value, size_t valueSize) {
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < keySize; ++i) {
+        hash = (hash ^ key[i]) * 0x01000193;
+    }
+    for (size_t i = 0; i < valueSize; ++i) {
+        hash = (hash ^ value[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+// Returns the checkSumAdjustment of the head table, which changes whenever the font file changes.
+uint32_t computeFontChecksum(const Font& font) {
+    Font::ExternalRefsGuard externalRefsGuard;
+    HbBlob head(font.baseFont(), HB_TAG('h', 'e', 'a', 'd'));
+    if (!head || head.size() < 12) {
+        return 0;
+    }
+    const uint8_t* data = head.get() + 8;
+    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+std::vector<uint8_t> writeKey(const U16StringPiece& text, const Range& range,
+                              const MinikinPaint& paint, bool dir, StartHyphenEdit startHyphen,
+                              EndHyphenEdit endHyphen) {
+    // The locale list and the font feature IDs are local to the process, so the strings are
+    // written instead.
+    const std::string locales = getLocaleString(paint.localeListId);
+    return BufferWriter::writeToVector([&](BufferWriter* writer) {
+        writer->write<uint64_t>(paint.font->getStableId());
+        writer->writeArray<uint16_t>(text.data(), text.size());
+        writer->write<uint32_t>(range.getStart());
+        writer->write<uint32_t>(range.getEnd());
+        paint.fontStyle.writeTo(writer);
+        writer->write<float>(paint.size);
+        writer->write<float>(paint.scaleX);
+        writer->write<float>(paint.skewX);
+        writer->write<float>(paint.letterSpacing);
+        writer->write<uint32_t>(paint.fontFlags);
+        writer->writeString(locales);
+        writer->write<uint8_t>(static_cast<uint8_t>(paint.familyVariant));
+        writer->writeString(paint.fontFeatureSettings.str());
+        writer->write<uint8_t>(static_cast<uint8_t>(startHyphen));
+        writer->write<uint8_t>(static_cast<uint8_t>(endHyphen));
+        writer->write<uint8_t>(dir);
+    });
+}
+
+std::string_view toStringView(const uint8_t* data, size_t size) {
+    return std::string_view(reinterpret_cast<const char*>(data), size);
+}
+
+struct FontPosition {
+    uint32_t family;
+    uint32_t font;
+};
+
+std::optional<FontPosition> findFont(const FontCollection& collection, const Font* font) {
+    for (uint32_t f = 0; f < collection.getFamilyCount(); ++f) {
+        const FontFamily& family = *collection.getFamilyAt(f);
+        for (uint32_t i = 0; i < family.getNumFonts(); ++i) {
+            if (family.getFont(i) == font) {
+                return FontPosition{f, i};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+bool writeFully(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+}  // namespace
+
+PersistentLayoutCache::PersistentLayoutCache()
+        : mEnabled(false),
+          mFd(-1),
+          mMapped(nullptr),
+          mMappedSize(0),
+          mFileSize(0),
+          mMaxFileSize(0) {}
+
+PersistentLayoutCache::~PersistentLayoutCache() {
+    close();
+}
+
+bool PersistentLayoutCache::open(const std::string& path, size_t maxFileSize) {
+#ifdef _WIN32
+    (void)path;
+    (void)maxFileSize;
+    return false;
+#else
+    std::lock_guard<std::mutex> lock(mMutex);
+    closeLocked();
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        ALOGW("Failed to open the layout cache file %s", path.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_t fileSize = st.st_size;
+    const uint8_t* mapped = nullptr;
+    if (fileSize >= kHeaderSize) {
+        void* addr = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            mapped = static_cast<const uint8_t*>(addr);
+        }
+    }
+    size_t validSize = 0;
+    if (mapped != nullptr) {
+        BufferReader header(mapped);
+        if (header.read<uint32_t>() == kMagic && header.read<uint32_t>() == kFormatVersion) {
+            // A record is its header, the key and the value. A record cut by a crash while
+            // appending or corrupted otherwise ends the valid part of the file.
+            validSize = kHeaderSize;
+            while (validSize + kRecordHeaderSize <= fileSize) {
+                BufferReader reader(mapped + validSize);
+                const uint32_t keySize = reader.read<uint32_t>();
+                const uint32_t valueSize = reader.read<uint32_t>();
+                const uint32_t checksum = reader.read<uint32_t>();
+                if (keySize > fileSize || valueSize > fileSize) {
+                    break;
+                }
+                const size_t keyOffset = validSize + kRecordHeaderSize;
+                const size_t valueOffset = keyOffset + alignRecord(keySize);
+                const size_t end = valueOffset + alignRecord(valueSize);
+                if (end > fileSize ||
+                    computeRecordChecksum(mapped + keyOffset, keySize, mapped + valueOffset,
+                                          valueSize) != checksum) {
+                    break;
+                }
+                // A key appended again, e.g. after a font update, replaces the older record.
+                mIndex[toStringView(mapped + keyOffset, keySize)] = {valueOffset, valueSize};
+                validSize = end;
+            }
+        }
+    }
+    if (validSize == 0) {
+        // A new file, or one written by a different version.
+        mIndex.clear();
+        if (mapped != nullptr) {
+            munmap(const_cast<uint8_t*>(mapped), fileSize);
+            mapped = nullptr;
+        }
+        const uint32_t header[] = {kMagic, kFormatVersion};
+        if (ftruncate(fd, 0) != 0 ||
+            !writeFully(fd, reinterpret_cast<const uint8_t*>(header), kHeaderSize)) {
+            ::close(fd);
+            return false;
+        }
+        validSize = kHeaderSize;
+    } else if (validSize < fileSize) {
+        // The mapping beyond the valid part is never read.
+        if (ftruncate(fd, validSize) != 0) {
+            mIndex.clear();
+            munmap(const_cast<uint8_t*>(mapped), fileSize);
+            ::close(fd);
+            return false;
+        }
+    }
+    if (lseek(fd, validSize, SEEK_SET) < 0) {
+        mIndex.clear();
+        if (mapped != nullptr) {
+            munmap(const_cast<uint8_t*>(mapped), fileSize);
+        }
+        ::close(fd);
+        return false;
+    }
+    mFd = fd;
+    mMapped = mapped;
+    mMappedSize = mapped != nullptr ? fileSize : 0;
+    mFileSize = validSize;
+    mMaxFileSize = maxFileSize;
+    mEnabled.store(true, std::memory_order_relaxed);
+    return true;
+#endif
+}
+
+void PersistentLayoutCache::close() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    closeLocked();
+}
+
+void PersistentLayoutCache::closeLocked() {
+    mEnabled.store(false, std::memory_order_relaxed);
+    if (mFd < 0) {
+        return;
+    }
+    flushLocked();
+    mIndex.clear();
+    mAppendedKeys.clear();
+    mFontChecksums.clear();
+#ifndef _WIN32
+    if (mMapped != nullptr) {
+        munmap(const_cast<uint8_t*>(mMapped), mMappedSize);
+    }
+#endif
+    ::close(mFd);
+    mFd = -1;
+    mMapped = nullptr;
+    mMappedSize = 0;
+    mFileSize = 0;
+}
+
+void PersistentLayoutCache::flush() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    flushLocked();
+}
+
+void PersistentLayoutCache::flushLocked() {
+    if (mFd < 0 || mPending.empty()) {
+        mPending.clear();
+        return;
+    }
+    if (!writeFully(mFd, mPending.data(), mPending.size())) {
+        // Don't append after a partial record. The next open drops it.
+        ALOGW("Failed to write the layout cache file");
+        mMaxFileSize = 0;
+    }
+    mPending.clear();
+}
+
+std::shared_ptr<const LayoutPiece> PersistentLayoutCache::getOrCreate(
+        const U16StringPiece& text, const Range& range, const MinikinPaint& paint, bool dir,
+        StartHyphenEdit startHyphen, EndHyphenEdit endHyphen, bool advancesOnly) {
+    const std::vector<uint8_t> key = writeKey(text, range, paint, dir, startHyphen, endHyphen);
+    std::shared_ptr<const LayoutPiece> layout = find(key, *paint.font);
+    if (layout) {
+        mStats.recordHit();
+        return layout;
+    }
+    const CacheStats::TimePoint shapingStart = CacheStats::now();
+    layout = std::make_shared<LayoutPiece>(text, range, dir, paint, startHyphen, endHyphen,
+                                           nullptr /* cluster info */, advancesOnly);
+    mStats.recordMiss(shapingStart);
+    if (!advancesOnly) {
+        append(key, *layout, *paint.font);
+    }
+    return layout;
+}
+
+std::shared_ptr<const LayoutPiece> PersistentLayoutCache::find(const std::vector<uint8_t>& key,
+                                                               const FontCollection& collection) {
+    std::vector<FakedFont> fonts;
+    std::vector<FontPosition> positions;
+    std::vector<uint32_t> checksums;
+    std::shared_ptr<const LayoutPiece> layout;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mIndex.find(toStringView(key.data(), key.size()));
+        if (it == mIndex.end()) {
+            return nullptr;
+        }
+        // The record was checked when the file was opened, but the reads are still bounded by
+        // the value.
+        BufferReader reader(mMapped + it->second.valueOffset, 0, it->second.valueSize);
+        const uint32_t count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < count && !reader.overflowed(); ++i) {
+            const uint32_t family = reader.read<uint32_t>();
+            const uint32_t font = reader.read<uint32_t>();
+            const uint8_t fakery = reader.read<uint8_t>();
+            checksums.push_back(reader.read<uint32_t>());
+            if (family >= collection.getFamilyCount() ||
+                font >= collection.getFamilyAt(family)->getNumFonts()) {
+                return nullptr;
+            }
+            positions.push_back({family, font});
+            fonts.push_back(FakedFont{collection.getFamilyAt(family)->getFontRef(font),
+                                      FontFakery(fakery & 0b01, fakery & 0b10)});
+        }
+        if (reader.overflowed() || !LayoutPiece::isValidBuffer(reader, fonts.size())) {
+            return nullptr;
+        }
+        layout = std::make_shared<LayoutPiece>(&reader, fonts);
+    }
+    // The font files may have been updated in place since the layout was written.
+    for (size_t i = 0; i < fonts.size(); ++i) {
+        if (getFontChecksum(collection, positions[i].family, positions[i].font) != checksums[i]) {
+            return nullptr;
+        }
+    }
+    return layout;
+}
+
+uint32_t PersistentLayoutCache::getFontChecksum(const FontCollection& collection, uint32_t family,
+                                                uint32_t font) {
+    // The collection ID is never reused, and a family index fits in 16 bits, see
+    // MAX_WIDE_FAMILY_COUNT.
+    const bool cacheable = font <= UINT16_MAX;
+    const uint64_t key = (static_cast<uint64_t>(collection.getId()) << 32) | (family << 16) | font;
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mFontChecksums.find(key);
+        if (it != mFontChecksums.end()) {
+            return it->second;
+        }
+    }
+    const uint32_t checksum = computeFontChecksum(*collection.getFamilyAt(family)->getFont(font));
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFontChecksums.emplace(key, checksum);
+    }
+    return checksum;
+}
+
+void PersistentLayoutCache::append(const std::vector<uint8_t>& key, const LayoutPiece& layout,
+                                   const FontCollection& collection) {
+    std::vector<FontPosition> positions;
+    std::vector<uint32_t> checksums;
+    for (const FakedFont& font : layout.fonts()) {
+        std::optional<FontPosition> position = findFont(collection, font.font.get());
+        if (!position) {
+            return;
+        }
+        positions.push_back(*position);
+        checksums.push_back(getFontChecksum(collection, position->family, position->font));
+    }
+    const std::vector<uint8_t> value = BufferWriter::writeToVector([&](BufferWriter* writer) {
+        writer->write<uint32_t>(positions.size());
+        for (size_t i = 0; i < positions.size(); ++i) {
+            FontFakery fakery = layout.fonts()[i].fakery;
+            writer->write<uint32_t>(positions[i].family);
+            writer->write<uint32_t>(positions[i].font);
+            writer->write<uint8_t>((fakery.isFakeBold() ? 0b01 : 0) |
+                                   (fakery.isFakeItalic() ? 0b10 : 0));
+            writer->write<uint32_t>(checksums[i]);
+        }
+        layout.writeTo(writer);
+    });
+    const size_t recordSize =
+            kRecordHeaderSize + alignRecord(key.size()) + alignRecord(value.size());
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFd < 0 || mFileSize + recordSize > mMaxFileSize) {
+        return;
+    }
+    if (!mAppendedKeys.emplace(toStringView(key.data(), key.size())).second) {
+        return;
+    }
+    const size_t offset = mPending.size();
+    mPending.resize(offset + recordSize, 0);
+    BufferWriter writer(mPending.data() + offset);
+    writer.write<uint32_t>(key.size());
+    writer.write<uint32_t>(value.size());
+    writer.write<uint32_t>(
+            computeRecordChecksum(key.data(), key.size(), value.data(), value.size()));
+    uint8_t* record = mPending.data() + offset + kRecordHeaderSize;
+    memcpy(record, key.data(), key.size());
+    memcpy(record + alignRecord(key.size()), value.data(), value.size());
+    mFileSize += recordSize;
+    if (mPending.size() >= kFlushThreshold) {
+        flushLocked();
+    }
+}
+
+uint32_t PersistentLayoutCache::size() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mIndex.size() + mAppendedKeys.size();
+}
+
+}  // namespace minikin
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PhraseBreakCache.h"
+
+#include <memory>
+
+#include "WordBreaker.h"
+
+namespace minikin {
+
+void PhraseBreakCache::record(const U16StringPiece& text, const Locale& locale,
+                              LineBreakStyle lbStyle, const Range& range, WordBreakRecord* out) {
+    WordBreakRecord::Segment segment = {};
+    segment.start = range.getStart();
+    segment.localeId = locale.getIdentifier();
+    segment.lbStyle = lbStyle;
+    segment.lbWordStyle = LineBreakWordStyle::Phrase;
+
+    PhraseBreakKey key(text, range, segment.localeId, lbStyle);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        PhraseBreakEntry* entry = mCache.get(key);
+        if (entry != nullptr) {
+            mStats.recordHit();
+            segment.boundaryStart = out->boundaries.size();
+            out->boundaries.insert(out->boundaries.end(), entry->boundaries.begin(),
+                                   entry->boundaries.end());
+            segment.boundaryEnd = out->boundaries.size();
+            segment.reachesEnd = entry->reachesEnd;
+            out->segments.push_back(segment);
+            return;
+        }
+    }
+
+    // Same as ItemizeCache, release the mutex during the segmentation and don't care even if the
+    // same text is recorded in other thread.
+    const CacheStats::TimePoint start = CacheStats::now();
+    const size_t segmentCount = out->segments.size();
+    WordBreaker::record(text, locale, lbStyle, LineBreakWordStyle::Phrase, range, out);
+    mStats.recordMiss(start);
+    if (out->segments.size() == segmentCount) {
+        return;  // ICU failed, nothing to cache.
+    }
+    const WordBreakRecord::Segment& recorded = out->segments.back();
+    auto entry = std::make_unique<PhraseBreakEntry>();
+    entry->boundaries.assign(out->boundaries.begin() + recorded.boundaryStart,
+                             out->boundaries.begin() + recorded.boundaryEnd);
+    entry->reachesEnd = recorded.reachesEnd;
+    key.copyText();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t sizeBefore = mCache.size();
+        if (!mCache.put(key, entry.get())) {
+            // The same value has been inserted by other thread.
+            key.freeText();
+            return;
+        }
+        mMemoryUsage += getEntryMemoryUsage(key, *entry);
+        entry.release();
+        // The LruCache evicts the oldest entry by itself when it is full.
+        mStats.recordEvictions(sizeBefore + 1 - mCache.size());
+    }
+}
+
+}  // namespace minikin
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_PHRASE_BREAK_CACHE_H
+#define MINIKIN_PHRASE_BREAK_CACHE_H
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <utils/LruCache.h>
+
+#include "minikin/Allocator.h"
+#include "minikin/CacheStats.h"
+#include "minikin/Hasher.h"
+#include "minikin/LineBreakStyle.h"
+#include "minikin/Macros.h"
+#include "minikin/Range.h"
+#include "minikin/U16StringPiece.h"
+#include "minikin/WordBreakRecord.h"
+
+#include "Locale.h"
+
+namespace minikin {
+
+// The key of the phrase boundaries of a range. ICU looks at the text around the range, so the
+// whole text is in the key.
+class PhraseBreakKey {
+public:
+    PhraseBreakKey(const U16StringPiece& text, const Range& range, uint64_t localeId,
+                   LineBreakStyle lbStyle)
+            : mChars(text.data()),
+              mNchars(text.size()),
+              mRange(range),
+              mLocaleId(localeId),
+              mLbStyle(lbStyle),
+              mHash(computeHash()) {}
+
+    bool operator==(const PhraseBreakKey& o) const {
+        return mRange == o.mRange && mLocaleId == o.mLocaleId && mLbStyle == o.mLbStyle &&
+               mNchars == o.mNchars && !memcmp(mChars, o.mChars, mNchars * sizeof(uint16_t));
+    }
+
+    android::hash_t hash() const { return mHash; }
+
+    void copyText() {
+        uint16_t* charsCopy = static_cast<uint16_t*>(allocateBlock(mNchars * sizeof(uint16_t)));
+        memcpy(charsCopy, mChars, mNchars * sizeof(uint16_t));
+        mChars = charsCopy;
+    }
+    void freeText() {
+        if (mChars != nullptr) {
+            freeBlock(const_cast<uint16_t*>(mChars));
+        }
+        mChars = nullptr;
+    }
+
+    uint32_t getMemoryUsage() const { return sizeof(PhraseBreakKey) + sizeof(uint16_t) * mNchars; }
+
+private:
+    android::hash_t computeHash() const {
+        return Hasher()
+                .update(mRange.getStart())
+                .update(mRange.getEnd())
+                .update(mLocaleId)
+                .update(static_cast<uint32_t>(mLbStyle))
+                .updateShorts(mChars, mNchars)
+                .hash();
+    }
+
+    const uint16_t* mChars;
+    uint32_t mNchars;
+    Range mRange;
+    uint64_t mLocaleId;
+    LineBreakStyle mLbStyle;
+    android::hash_t mHash;
+};
+
+inline android::hash_t hash_type(const PhraseBreakKey& key) {
+    return key.hash();
+}
+
+// The boundaries of a recorded segment, see WordBreakRecord::Segment.
+struct PhraseBreakEntry {
+    std::vector<uint32_t> boundaries;
+    bool reachesEnd;
+};
+
+// An LRU cache of the ICU boundaries of the phrase based line breaking, i.e.
+// LineBreakWordStyle::Phrase. The phrase segmentation is several times slower than the plain line
+// breaking, and a paragraph is measured again with the same text whenever its styles or its
+// layout change.
+class PhraseBreakCache : private android::OnEntryRemoved<PhraseBreakKey, PhraseBreakEntry*> {
+public:
+    void clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCache.clear();
+    }
+
+    // Same as LayoutCache::trim().
+    void trim(uint32_t percent) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const size_t target = mMemoryUsage * percent / 100;
+        while (mMemoryUsage > target && mCache.removeOldest()) {
+            mStats.recordEvictions(1);
+        }
+    }
+
+    // Appends the same segment to the record as WordBreaker::record with the phrase word style,
+    // from the cache if the range of the same text has been recorded before.
+    void record(const U16StringPiece& text, const Locale& locale, LineBreakStyle lbStyle,
+                const Range& range, WordBreakRecord* out);
+
+    static PhraseBreakCache& getInstance() {
+        static PhraseBreakCache cache(kMaxEntries);
+        return cache;
+    }
+
+    const CacheStats& getStats() const { return mStats; }
+
+    size_t getMemoryUsage() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMemoryUsage;
+    }
+
+protected:
+    PhraseBreakCache(uint32_t maxEntries) : mCache(maxEntries), mMemoryUsage(0) {
+        mCache.setOnEntryRemovedListener(this);
+    }
+
+private:
+    static size_t getEntryMemoryUsage(const PhraseBreakKey& key, const PhraseBreakEntry& entry) {
+        return key.getMemoryUsage() + sizeof(PhraseBreakEntry) +
+               sizeof(uint32_t) * entry.boundaries.size();
+    }
+
+    // callback for OnEntryRemoved
+    void operator()(PhraseBreakKey& key, PhraseBreakEntry*& value) {
+        mMemoryUsage -= getEntryMemoryUsage(key, *value);
+        key.freeText();
+        delete value;
+    }
+
+    std::mutex mMutex;
+    android::LruCache<PhraseBreakKey, PhraseBreakEntry*> mCache GUARDED_BY(mMutex);
+    size_t mMemoryUsage GUARDED_BY(mMutex);
+    CacheStats mStats;
+    // A few screens of paragraphs.
+    static const size_t kMaxEntries = 100;
+};
+
+}  // namespace minikin
+#endif  // MINIKIN_PHRASE_BREAK_CACHE_H
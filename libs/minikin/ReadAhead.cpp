@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/ReadAhead.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+
+#include "minikin/FontFileParser.h"
+
+namespace minikin {
+
+namespace {
+
+std::atomic<bool> gReadAheadEnabled = {false};
+std::atomic<uint64_t> gAdviceCount = {0};
+std::atomic<uint64_t> gAdvisedBytes = {0};
+std::atomic<uint64_t> gFailureCount = {0};
+
+uintptr_t getPageSize() {
+#ifdef _WIN32
+    return 4096;
+#else
+    static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    return pageSize;
+#endif
+}
+
+}  // namespace
+
+// static
+void ReadAhead::setEnabled(bool enabled) {
+    gReadAheadEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+bool ReadAhead::isEnabled() {
+    return gReadAheadEnabled.load(std::memory_order_relaxed);
+}
+
+// static
+size_t ReadAhead::advise(const void* data, size_t size) {
+    if (data == nullptr || size == 0) {
+        return 0;
+    }
+#ifdef _WIN32
+    return 0;
+#else
+    const uintptr_t pageMask = getPageSize() - 1;
+    const uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~pageMask;
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + size + pageMask) & ~pageMask;
+    if (madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED) != 0) {
+        gFailureCount.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    gAdviceCount.fetch_add(1, std::memory_order_relaxed);
+    gAdvisedBytes.fetch_add(end - start, std::memory_order_relaxed);
+    return end - start;
+#endif
+}
+
+// static
+size_t ReadAhead::adviseFont(const void* data, size_t size, uint32_t index) {
+    if (data == nullptr) {
+        return 0;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    const uintptr_t pageMask = getPageSize() - 1;
+    size_t advised = 0;
+    size_t start = 0;
+    size_t end = 0;
+    // The small tables are often next to each other, so the ranges in the same or adjacent pages
+    // are merged into one call.
+    for (const Range& range : FontFileParser::getHotTableRanges(data, size, index)) {
+        const uintptr_t pageEnd =
+                (reinterpret_cast<uintptr_t>(bytes + end) + pageMask) & ~pageMask;
+        if (end != 0 && reinterpret_cast<uintptr_t>(bytes + range.getStart()) <= pageEnd) {
+            end = std::max<size_t>(end, range.getEnd());
+            continue;
+        }
+        if (end != 0) {
+            advised += advise(bytes + start, end - start);
+        }
+        start = range.getStart();
+        end = range.getEnd();
+    }
+    if (end != 0) {
+        advised += advise(bytes + start, end - start);
+    }
+    return advised;
+}
+
+// static
+ReadAhead::Stats ReadAhead::getStats() {
+    return {gAdviceCount.load(std::memory_order_relaxed),
+            gAdvisedBytes.load(std::memory_order_relaxed),
+            gFailureCount.load(std::memory_order_relaxed)};
+}
+
+// static
+void ReadAhead::dump(int fd) {
+    const Stats stats = getStats();
+    if (stats.adviceCount == 0 && stats.failureCount == 0) {
+        return;
+    }
+    dprintf(fd, "  ReadAhead:\n");
+    dprintf(fd, "    advices: %" PRIu64 " (%" PRIu64 " KB, %" PRIu64 " pages), failures: %" PRIu64
+            "\n",
+            stats.adviceCount, stats.advisedBytes / 1024, stats.advisedBytes / getPageSize(),
+            stats.failureCount);
+}
+
+}  // namespace minikin
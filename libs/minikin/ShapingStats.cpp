@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/ShapingStats.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#include "minikin/Font.h"
+#include "minikin/MinikinFont.h"
+
+namespace minikin {
+
+namespace {
+
+// The runs this thread shapes before the next sampled one.
+thread_local uint32_t gRunsUntilSample = 0;
+
+}  // namespace
+
+bool ShapingStats::shouldSampleInternal(uint32_t interval) {
+    if (gRunsUntilSample == 0) {
+        gRunsUntilSample = interval - 1;
+        return true;
+    }
+    gRunsUntilSample = std::min(gRunsUntilSample - 1, interval - 1);
+    return false;
+}
+
+void ShapingStats::record(uint32_t script, const Font& font, const std::string& fontFeatureSettings,
+                          uint64_t nanos) {
+    const uint32_t interval = std::max(1u, getSamplingInterval());
+    const MinikinFont& typeface = *font.typeface();
+    Key key(script, typeface.GetFontPath(), typeface.GetFontIndex(), fontFeatureSettings);
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mCosts.find(key);
+    if (it == mCosts.end()) {
+        if (mCosts.size() >= kMaxEntries) {
+            return;
+        }
+        it = mCosts.emplace(std::move(key), Cost()).first;
+    }
+    it->second.calls += interval;
+    it->second.nanos += nanos * interval;
+}
+
+std::vector<ShapingStats::Entry> ShapingStats::getEntries() const {
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        entries.reserve(mCosts.size());
+        for (const auto& [key, cost] : mCosts) {
+            entries.push_back({std::get<0>(key), std::get<1>(key), std::get<2>(key),
+                               std::get<3>(key), cost.calls, cost.nanos});
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry& l, const Entry& r) { return l.nanos > r.nanos; });
+    return entries;
+}
+
+void ShapingStats::dump(int fd) const {
+    const uint32_t interval = getSamplingInterval();
+    if (interval == 0) {
+        return;
+    }
+    const std::vector<Entry> entries = getEntries();
+    dprintf(fd, "  Shaping cost (1 in %u runs sampled):\n", interval);
+    for (size_t i = 0; i < entries.size() && i < kMaxDumpedEntries; ++i) {
+        const Entry& e = entries[i];
+        dprintf(fd, "    %c%c%c%c %s#%d \"%s\": %" PRIu64 " runs, %.3f ms\n",
+                static_cast<char>(e.script >> 24), static_cast<char>(e.script >> 16),
+                static_cast<char>(e.script >> 8), static_cast<char>(e.script),
+                e.fontPath.c_str(), e.fontIndex, e.fontFeatureSettings.c_str(), e.calls,
+                e.nanos / 1e6);
+    }
+}
+
+void ShapingStats::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCosts.clear();
+}
+
+}  // namespace minikin
@@ -16,6 +16,12 @@
 
 #include "minikin/SparseBitSet.h"
 
+#include <unicode/utf16.h>
+
+#include <array>
+#include <map>
+#include <vector>
+
 #include "MinikinInternal.h"
 
 namespace minikin {
@@ -58,7 +64,6 @@ void SparseBitSet::initFromRanges(const uint32_t* ranges, size_t nRanges) {
     uint32_t nPages = calcNumPages(ranges, nRanges);
     uint32_t bitmapsCount = nPages << (kLogValuesPerPage - kLogBitsPerEl);
     MappableData* data = MappableData::allocate(indicesCount, bitmapsCount);
-    mData.reset(data);
     data->mMaxVal = maxVal;
     uint16_t* indices = data->indices();
     element* bitmaps = data->bitmaps();
@@ -102,6 +107,48 @@ void SparseBitSet::initFromRanges(const uint32_t* ranges, size_t nRanges) {
         }
         nonzeroPageEnd = endPage + 1;
     }
+    mData.reset(mergeIdenticalPages(data));
+}
+
+// static
+SparseBitSet::MappableData* SparseBitSet::mergeIdenticalPages(MappableData* data) {
+    constexpr uint32_t kElementsPerPage = 1 << (kLogValuesPerPage - kLogBitsPerEl);
+    using Page = std::array<element, kElementsPerPage>;
+    const uint32_t pageCount = data->mBitmapsCount / kElementsPerPage;
+    // The new index of every page, and the old index of every distinct page.
+    std::vector<uint16_t> newPageIndices(pageCount);
+    std::vector<uint16_t> distinctPages;
+    std::map<Page, uint16_t> pageToIndex;
+    for (uint32_t i = 0; i < pageCount; ++i) {
+        Page page;
+        std::copy_n(data->bitmaps() + i * kElementsPerPage, kElementsPerPage, page.begin());
+        const auto [it, inserted] = pageToIndex.emplace(page, distinctPages.size());
+        if (inserted) {
+            distinctPages.push_back(i);
+        }
+        newPageIndices[i] = it->second;
+    }
+    if (distinctPages.size() == pageCount) {
+        return data;
+    }
+    MappableData* merged =
+            MappableData::allocate(data->mIndicesCount, distinctPages.size() * kElementsPerPage);
+    merged->mMaxVal = data->mMaxVal;
+    for (size_t i = 0; i < distinctPages.size(); ++i) {
+        std::copy_n(data->bitmaps() + distinctPages[i] * kElementsPerPage, kElementsPerPage,
+                    merged->bitmaps() + i * kElementsPerPage);
+    }
+    // The indices are the offsets of the pages in elements.
+    for (uint32_t i = 0; i < data->mIndicesCount; ++i) {
+        merged->indices()[i] = newPageIndices[data->indices()[i] / kElementsPerPage] *
+                               kElementsPerPage;
+    }
+    merged->mZeroPageIndex =
+            data->mZeroPageIndex == noZeroPage
+                    ? noZeroPage
+                    : newPageIndices[data->mZeroPageIndex / kElementsPerPage] * kElementsPerPage;
+    free(data);
+    return merged;
 }
 
 void SparseBitSet::initFromBuffer(BufferReader* reader) {
@@ -165,6 +212,35 @@ uint32_t SparseBitSet::nextSetBit(uint32_t fromIndex) const {
     return kNotFound;
 }
 
+size_t SparseBitSet::findFirstUnset(const uint16_t* text, size_t size) const {
+    const uint32_t maxVal = length();
+    // The bitmap of the page of the previous code point, which is usually the page of the next
+    // one as well.
+    uint32_t bitmapPage = ~0u;
+    const element* bitmap = nullptr;
+    size_t i = 0;
+    while (i < size) {
+        const size_t offset = i;
+        uint32_t ch = text[i++];
+        if (U16_IS_LEAD(ch) && i < size && U16_IS_TRAIL(text[i])) {
+            ch = U16_GET_SUPPLEMENTARY(ch, text[i++]);
+        }
+        if (ch >= maxVal) {
+            return offset;
+        }
+        const uint32_t page = ch >> kLogValuesPerPage;
+        if (page != bitmapPage) {
+            bitmapPage = page;
+            bitmap = mData->bitmaps() + mData->indices()[page];
+        }
+        const uint32_t index = ch & kPageMask;
+        if ((bitmap[index >> kLogBitsPerEl] & (kElFirst >> (index & kElMask))) == 0) {
+            return offset;
+        }
+    }
+    return size;
+}
+
 // static
 SparseBitSet::MappableData* SparseBitSet::MappableData::allocate(uint32_t indicesCount,
                                                                  uint32_t bitmapsCount) {
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/StreamingMeasuredText.h"
+
+#include <algorithm>
+
+#include "minikin/Characters.h"
+
+#include "LineBreakerUtil.h"
+
+namespace minikin {
+
+StreamingMeasuredText::StreamingMeasuredText(const U16StringPiece& text, RunProvider runProvider,
+                                             bool computeHyphenation, bool computeLayout,
+                                             bool ignoreHyphenKerning, uint32_t memoryBudget)
+        : mText(text),
+          mRunProvider(std::move(runProvider)),
+          mComputeHyphenation(computeHyphenation),
+          mComputeLayout(computeLayout),
+          mIgnoreHyphenKerning(ignoreHyphenKerning),
+          mMemoryBudget(memoryBudget) {
+    uint32_t start = 0;
+    while (start < text.size()) {
+        const uint32_t limit = std::min<uint32_t>(text.size(), start + kMaxChunkLength);
+        uint32_t end = start;
+        while (end < limit && text[end] != CHAR_LINE_FEED) {
+            end++;
+        }
+        if (end < limit) {
+            end++;  // The line feed ends its paragraph.
+        } else if (end < text.size()) {
+            // Too long a paragraph. Split it after the last space in the limit if there is one, so
+            // that the split is where a line could break anyway.
+            for (uint32_t i = end; i > start + 1; --i) {
+                if (isLineEndSpace(text[i - 1])) {
+                    end = i;
+                    break;
+                }
+            }
+        }
+        Chunk chunk;
+        chunk.range = Range(start, end);
+        mChunks.push_back(std::move(chunk));
+        start = end;
+    }
+}
+
+StreamingMeasuredText::~StreamingMeasuredText() {}
+
+size_t StreamingMeasuredText::findChunk(uint32_t offset) const {
+    auto it = std::upper_bound(
+            mChunks.begin(), mChunks.end(), offset,
+            [](uint32_t offset, const Chunk& chunk) { return offset < chunk.range.getEnd(); });
+    if (it == mChunks.end()) {
+        return mChunks.empty() ? 0 : mChunks.size() - 1;
+    }
+    return it - mChunks.begin();
+}
+
+std::shared_ptr<const MeasuredText> StreamingMeasuredText::getChunk(size_t chunk) {
+    Chunk& c = mChunks[chunk];
+    if (c.measured != nullptr) {
+        mLru.splice(mLru.begin(), mLru, c.lruIt);
+        return c.measured;
+    }
+
+    MeasuredTextBuilder builder;
+    mRunProvider(c.range, &builder);
+    return insert(chunk, builder.build(mText.substr(c.range), mComputeHyphenation, mComputeLayout,
+                                       mIgnoreHyphenKerning, nullptr /* no hint */));
+}
+
+std::shared_ptr<const MeasuredText> StreamingMeasuredText::insert(
+        size_t chunk, std::unique_ptr<MeasuredText>&& measured) {
+    Chunk& c = mChunks[chunk];
+    c.measured = std::move(measured);
+    c.memoryUsage = c.measured->getMemoryUsage();
+    mMemoryUsage += c.memoryUsage;
+    mLru.push_front(chunk);
+    c.lruIt = mLru.begin();
+
+    while (mMemoryUsage > mMemoryBudget && mLru.size() > 1) {
+        evict(mLru.back());
+    }
+    return c.measured;
+}
+
+LineBreakResult StreamingMeasuredText::breakChunkIntoLines(size_t chunk, BreakStrategy strategy,
+                                                           HyphenationFrequency frequency,
+                                                           bool justified,
+                                                           const LineWidth& lineWidth,
+                                                           const TabStops& tabStops) {
+    std::shared_ptr<const MeasuredText> measured = getChunk(chunk);
+    return breakIntoLines(mText.substr(mChunks[chunk].range), strategy, frequency, justified,
+                          *measured, lineWidth, tabStops);
+}
+
+std::unique_ptr<MeasureHandle> StreamingMeasuredText::measureAsync(size_t chunk) {
+    const Range& range = mChunks[chunk].range;
+    MeasuredTextBuilder builder;
+    mRunProvider(range, &builder);
+    return builder.buildAsync(mText.substr(range), mComputeHyphenation, mComputeLayout,
+                              mIgnoreHyphenKerning, MeasurePriority::High);
+}
+
+void StreamingMeasuredText::streamLines(size_t firstChunk, BreakStrategy strategy,
+                                        HyphenationFrequency frequency, bool justified,
+                                        const LineWidth& lineWidth, const TabStops& tabStops,
+                                        const LineCallback& callback) {
+    std::unique_ptr<MeasureHandle> next;
+    for (size_t chunk = firstChunk; chunk < mChunks.size(); ++chunk) {
+        std::shared_ptr<const MeasuredText> measured;
+        if (next != nullptr) {
+            std::unique_ptr<MeasuredText> prefetched = next->get();
+            next.reset();
+            // The callback may have measured the chunk in the meantime.
+            if (prefetched != nullptr && !isResident(chunk)) {
+                measured = insert(chunk, std::move(prefetched));
+            }
+        }
+        if (measured == nullptr) {
+            measured = getChunk(chunk);
+        }
+        if (chunk + 1 < mChunks.size() && !isResident(chunk + 1)) {
+            next = measureAsync(chunk + 1);
+        }
+        LineBreakResult lines = breakIntoLines(mText.substr(mChunks[chunk].range), strategy,
+                                               frequency, justified, *measured, lineWidth,
+                                               tabStops);
+        if (!callback(chunk, std::move(lines))) {
+            break;
+        }
+    }
+    if (next != nullptr) {
+        next->cancel();
+    }
+}
+
+void StreamingMeasuredText::evictOutside(size_t first, size_t last) {
+    for (auto it = mLru.begin(); it != mLru.end();) {
+        const size_t chunk = *it++;
+        if (chunk < first || chunk > last) {
+            evict(chunk);
+        }
+    }
+}
+
+void StreamingMeasuredText::evict(size_t chunk) {
+    Chunk& c = mChunks[chunk];
+    mLru.erase(c.lruIt);
+    c.measured.reset();
+    mMemoryUsage -= c.memoryUsage;
+    c.memoryUsage = 0;
+}
+
+}  // namespace minikin
@@ -18,8 +18,37 @@
 
 #include "minikin/SystemFonts.h"
 
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <log/log.h>
+
+#include "minikin/Macros.h"
+
 namespace minikin {
 
+namespace {
+
+// "MKSF" in the file.
+constexpr uint32_t kSnapshotMagic = 0x46534B4D;
+// Changed with the format of the snapshot or of the serialized collections, families and fonts.
+constexpr uint32_t kSnapshotVersion = 7;
+// The collection index of the missing default fallback.
+constexpr uint32_t kNoCollection = UINT32_MAX;
+
+// The 32-bit FNV-1a hash of the payload. It is stored in the file, so unlike Hasher it is fixed
+// across builds and versions.
+IGNORE_INTEGER_OVERFLOW uint32_t computeChecksum(const uint8_t* data, size_t size) {
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+}  // namespace
+
 SystemFonts& SystemFonts::getInstance() {
     static SystemFonts systemFonts;
     return systemFonts;
@@ -27,32 +56,132 @@ SystemFonts& SystemFonts::getInstance() {
 
 std::shared_ptr<FontCollection> SystemFonts::findFontCollectionInternal(
         const std::string& familyName) {
-    std::lock_guard<std::mutex> lock(mMutex);
-    auto it = mSystemFallbacks.find(familyName);
-    if (it != mSystemFallbacks.end()) {
+    const std::shared_ptr<const Registry> registry = load();
+    auto it = registry->fallbacks.find(familyName);
+    if (it != registry->fallbacks.end()) {
         return it->second;
     }
     // TODO: Lookup by PostScript name.
-    return mDefaultFallback;
+    return registry->defaultFallback;
+}
+
+void SystemFonts::getFontSetInternal(
+        std::function<void(const std::vector<std::shared_ptr<Font>>&)> func) {
+    // The registry is kept alive while the callback uses its fonts.
+    const std::shared_ptr<const Registry> registry = load();
+    func(registry->getFontSet());
 }
 
-void SystemFonts::buildFontSetLocked() {
-    std::unordered_set<FontFamily*> uniqueFamilies;
+const std::vector<std::shared_ptr<Font>>& SystemFonts::Registry::getFontSet() const {
+    std::call_once(fontSetOnce, [this]() {
+        std::unordered_set<FontFamily*> uniqueFamilies;
+
+        for (const auto& collection : collections) {
+            for (size_t i = 0; i < collection->getFamilyCount(); ++i) {
+                const auto& family = collection->getFamilyAt(i);
+                uniqueFamilies.insert(family.get());
+            }
+        }
+
+        for (const auto family : uniqueFamilies) {
+            for (size_t i = 0; i < family->getNumFonts(); ++i) {
+                fontSet.push_back(family->getFontRef(i));
+            }
+        }
+    });
+    return fontSet;
+}
 
-    for (const auto& collection : mCollections) {
-        for (size_t i = 0; i < collection->getFamilyCount(); ++i) {
-            const auto& family = collection->getFamilyAt(i);
-            uniqueFamilies.insert(family.get());
+void SystemFonts::writeSnapshotInternal(BufferWriter* writer) {
+    const std::shared_ptr<const Registry> registry = load();
+    std::vector<std::shared_ptr<FontCollection>> collections;
+    std::unordered_map<const FontCollection*, uint32_t> indices;
+    auto indexOf = [&](const std::shared_ptr<FontCollection>& collection) {
+        auto [it, inserted] = indices.emplace(collection.get(), collections.size());
+        if (inserted) {
+            collections.push_back(collection);
         }
+        return it->second;
+    };
+    const uint32_t defaultIndex =
+            registry->defaultFallback ? indexOf(registry->defaultFallback) : kNoCollection;
+    std::vector<uint32_t> fallbackIndices;
+    for (const auto& [name, collection] : registry->fallbacks) {
+        fallbackIndices.push_back(indexOf(collection));
+    }
+    std::vector<uint32_t> fontMapIndices;
+    for (const auto& collection : registry->collections) {
+        fontMapIndices.push_back(indexOf(collection));
+    }
+
+    // The header is filled after the payload for the checksum.
+    uint32_t* header = writer->reserve<uint32_t>(kSnapshotHeaderSize);
+    const size_t payloadStart = writer->size();
+    FontCollection::writeVector(writer, collections);
+    writer->write<uint32_t>(defaultIndex);
+    writer->write<uint32_t>(registry->fallbacks.size());
+    size_t i = 0;
+    for (const auto& [name, collection] : registry->fallbacks) {
+        writer->writeString(name);
+        writer->write<uint32_t>(fallbackIndices[i++]);
     }
+    writer->writeArray<uint32_t>(fontMapIndices.data(), fontMapIndices.size());
 
-    std::vector<std::shared_ptr<Font>> result;
-    for (const auto family : uniqueFamilies) {
-        for (size_t i = 0; i < family->getNumFonts(); ++i) {
-            result.push_back(family->getFontRef(i));
+    if (header != nullptr) {
+        const uint32_t payloadSize = writer->size() - payloadStart;
+        const uint8_t* payload = reinterpret_cast<const uint8_t*>(header) + kSnapshotHeaderSize;
+        memset(header, 0, kSnapshotHeaderSize);
+        header[0] = kSnapshotMagic;
+        header[1] = kSnapshotVersion;
+        header[2] = payloadSize;
+        header[3] = computeChecksum(payload, payloadSize);
+    }
+}
+
+bool SystemFonts::adoptSnapshotInternal(const void* data, size_t size) {
+    if (size < kSnapshotHeaderSize) {
+        return false;
+    }
+    const uint32_t* header = reinterpret_cast<const uint32_t*>(data);
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(data) + kSnapshotHeaderSize;
+    if (header[0] != kSnapshotMagic || header[1] != kSnapshotVersion) {
+        ALOGW("The system font snapshot is of an unknown format.");
+        return false;
+    }
+    if (header[2] > size - kSnapshotHeaderSize ||
+        computeChecksum(payload, header[2]) != header[3]) {
+        ALOGW("The system font snapshot is truncated or corrupted.");
+        return false;
+    }
+
+    BufferReader reader(data, kSnapshotHeaderSize);
+    std::vector<std::shared_ptr<FontCollection>> collections = FontCollection::readVector(&reader);
+    const uint32_t defaultIndex = reader.read<uint32_t>();
+    if (defaultIndex != kNoCollection && defaultIndex >= collections.size()) {
+        return false;
+    }
+    auto registry = std::make_shared<Registry>();
+    registry->defaultFallback = defaultIndex == kNoCollection ? nullptr : collections[defaultIndex];
+    const uint32_t fallbackCount = reader.read<uint32_t>();
+    for (uint32_t i = 0; i < fallbackCount; ++i) {
+        std::string name(reader.readString());
+        const uint32_t index = reader.read<uint32_t>();
+        if (index >= collections.size()) {
+            return false;
         }
+        registry->fallbacks.emplace(std::move(name), collections[index]);
     }
-    mFonts = std::move(result);
+    auto [fontMapIndices, fontMapCount] = reader.readArray<uint32_t>();
+    for (uint32_t i = 0; i < fontMapCount; ++i) {
+        if (fontMapIndices[i] >= collections.size()) {
+            return false;
+        }
+        registry->collections.push_back(collections[fontMapIndices[i]]);
+    }
+
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mUpdateMutex);
+    std::atomic_store(&mRegistry, std::shared_ptr<const Registry>(std::move(registry)));
+    return true;
 }
 
 }  // namespace minikin
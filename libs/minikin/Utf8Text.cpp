@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/Utf8Text.h"
+
+#include <unicode/utf16.h>
+#include <unicode/utf8.h>
+
+#include <algorithm>
+
+namespace minikin {
+
+Utf8Text::Utf8Text(std::string_view utf8) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(utf8.data());
+    const int32_t size = utf8.size();
+    // UTF-16 is never longer than UTF-8 in code units.
+    mText.reserve(size);
+    mUtf8Offsets.reserve(size + 1);
+    int32_t offset = 0;
+    while (offset < size) {
+        const uint32_t start = offset;
+        UChar32 c;
+        U8_NEXT(data, offset, size, c);
+        if (c < 0) {
+            c = 0xFFFD;
+        }
+        if (U16_LENGTH(c) == 2) {
+            mText.push_back(U16_LEAD(c));
+            mText.push_back(U16_TRAIL(c));
+            mUtf8Offsets.push_back(start);
+            mUtf8Offsets.push_back(start);
+        } else {
+            mText.push_back(c);
+            mUtf8Offsets.push_back(start);
+        }
+    }
+    mUtf8Offsets.push_back(size);
+}
+
+uint32_t Utf8Text::toUtf16Offset(uint32_t utf8Offset) const {
+    const uint32_t offset =
+            std::lower_bound(mUtf8Offsets.begin(), mUtf8Offsets.end(), utf8Offset) -
+            mUtf8Offsets.begin();
+    return std::min<uint32_t>(offset, mText.size());
+}
+
+}  // namespace minikin
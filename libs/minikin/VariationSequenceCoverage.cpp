@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/VariationSequenceCoverage.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "MinikinInternal.h"
+
+namespace minikin {
+
+VariationSequenceCoverage::VariationSequenceCoverage(std::vector<SparseBitSet>&& coverages)
+        : VariationSequenceCoverage() {
+    MINIKIN_ASSERT(coverages.size() <= std::numeric_limits<uint16_t>::max(),
+                   "Too many variation selectors.");
+    mOwnedEntries.reserve(coverages.size());
+    std::vector<uint32_t> codePoints;
+    for (SparseBitSet& coverage : coverages) {
+        // Collect up to one more than kMaxSortedSize code points to tell the large sets apart.
+        codePoints.clear();
+        for (uint32_t cp = coverage.nextSetBit(0);
+             cp != SparseBitSet::kNotFound && codePoints.size() <= kMaxSortedSize;
+             cp = coverage.nextSetBit(cp + 1)) {
+            codePoints.push_back(cp);
+        }
+        if (codePoints.size() > kMaxSortedSize) {
+            mOwnedEntries.push_back({static_cast<uint32_t>(mBitSets.size()), kBitSetEntry});
+            mBitSets.push_back(std::move(coverage));
+        } else {
+            const uint32_t start = mOwnedCodePoints.size();
+            mOwnedCodePoints.insert(mOwnedCodePoints.end(), codePoints.begin(), codePoints.end());
+            mOwnedEntries.push_back({start, static_cast<uint32_t>(mOwnedCodePoints.size())});
+            coverage = SparseBitSet();
+        }
+    }
+    mOwnedCodePoints.shrink_to_fit();
+    mEntries = mOwnedEntries.data();
+    mEntryCount = static_cast<uint16_t>(mOwnedEntries.size());
+    mCodePoints = mOwnedCodePoints.data();
+    mCodePointCount = mOwnedCodePoints.size();
+}
+
+VariationSequenceCoverage::VariationSequenceCoverage(BufferReader* reader)
+        : VariationSequenceCoverage() {
+    static_assert(sizeof(Entry) == 8);
+    const auto [entries, entryCount] = reader->readArray<Entry>();
+    mEntries = entries;
+    mEntryCount = static_cast<uint16_t>(entryCount);
+    const auto [codePoints, codePointCount] = reader->readArray<uint32_t>();
+    mCodePoints = codePoints;
+    mCodePointCount = codePointCount;
+    const uint32_t bitSetCount = reader->read<uint32_t>();
+    mBitSets.reserve(bitSetCount);
+    for (uint32_t i = 0; i < bitSetCount; i++) {
+        mBitSets.emplace_back(reader);
+    }
+}
+
+VariationSequenceCoverage& VariationSequenceCoverage::operator=(
+        VariationSequenceCoverage&& o) noexcept {
+    // Moving the vectors keeps their buffers, so the pointers stay valid.
+    mEntries = o.mEntries;
+    mEntryCount = o.mEntryCount;
+    mCodePoints = o.mCodePoints;
+    mCodePointCount = o.mCodePointCount;
+    mOwnedEntries = std::move(o.mOwnedEntries);
+    mOwnedCodePoints = std::move(o.mOwnedCodePoints);
+    mBitSets = std::move(o.mBitSets);
+    o.mEntries = nullptr;
+    o.mEntryCount = 0;
+    o.mCodePoints = nullptr;
+    o.mCodePointCount = 0;
+    return *this;
+}
+
+void VariationSequenceCoverage::writeTo(BufferWriter* writer) const {
+    writer->writeArray<Entry>(mEntries, mEntryCount);
+    writer->writeArray<uint32_t>(mCodePoints, mCodePointCount);
+    writer->write<uint32_t>(mBitSets.size());
+    for (const SparseBitSet& bitSet : mBitSets) {
+        bitSet.writeTo(writer);
+    }
+}
+
+bool VariationSequenceCoverage::containsSorted(const Entry& entry, uint32_t codePoint) const {
+    if (entry.start == entry.end) {
+        return false;
+    }
+    const uint32_t* begin = mCodePoints + entry.start;
+    const uint32_t* end = mCodePoints + entry.end;
+    // The sets are sorted, so most of the code points are rejected by the first or the last one.
+    if (codePoint < *begin || codePoint > *(end - 1)) {
+        return false;
+    }
+    return std::binary_search(begin, end, codePoint);
+}
+
+}  // namespace minikin
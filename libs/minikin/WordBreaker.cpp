@@ -16,6 +16,7 @@
 
 #include "WordBreaker.h"
 
+#include <algorithm>
 #include <list>
 #include <map>
 
@@ -28,12 +29,57 @@
 
 #include "Locale.h"
 #include "MinikinInternal.h"
+#include "MinikinTrace.h"
 
 namespace minikin {
 
+// Returned by asciiNextBreak if ICU is needed.
+constexpr int32_t ASCII_BREAK_UNKNOWN = -2;
+
+// The characters email addresses and URLs are made of: ASCII characters other than spaces.
+static bool isEmailOrUrlChar(uint16_t c) {
+    return ' ' < c && c <= 0x007E;
+}
+
+static bool isAsciiDigit(uint16_t c) {
+    return '0' <= c && c <= '9';
+}
+
+static bool isAsciiAlnum(uint16_t c) {
+    return isAsciiDigit(c) || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+// The characters of the words the ASCII fast path breaks without ICU.
+static bool isAsciiWordChar(uint16_t c) {
+    return isAsciiAlnum(c) || c == '-' || c == '\'' || c == '.' || c == ',';
+}
+
+// Returns true unless the locale may tailor the breaks of ASCII text, as the Chinese, Japanese and
+// Korean line break styles and phrase breaking do.
+static bool isAsciiFastPathLocale(const Locale& locale, LineBreakWordStyle lbWordStyle) {
+    if (lbWordStyle != LineBreakWordStyle::None) {
+        return false;
+    }
+    static const uint64_t kLanguageMask = ~((1ull << 49) - 1);
+    static const uint64_t kCjkLanguages[] = {
+            Locale("ja").getIdentifier() & kLanguageMask,
+            Locale("ko").getIdentifier() & kLanguageMask,
+            Locale("yue").getIdentifier() & kLanguageMask,
+            Locale("zh").getIdentifier() & kLanguageMask,
+    };
+    const uint64_t language = locale.getIdentifier() & kLanguageMask;
+    for (uint64_t cjkLanguage : kCjkLanguages) {
+        if (language == cjkLanguage) {
+            return false;
+        }
+    }
+    return true;
+}
+
 namespace {
 static UBreakIterator* createNewIterator(const Locale& locale, LineBreakStyle lbStyle,
                                          LineBreakWordStyle lbWordStyle) {
+    MINIKIN_TRACE_NAME("ICULineBreakerPool::createIterator");
     // TODO: handle failure status
     UErrorCode status = U_ZERO_ERROR;
     char localeID[ULOC_FULLNAME_CAPACITY] = {};
@@ -43,29 +89,83 @@ static UBreakIterator* createNewIterator(const Locale& locale, LineBreakStyle lb
 }
 }  // namespace
 
+namespace {
+// The breakers released on this thread. Each thread only uses its own, so no lock is needed.
+std::list<ICULineBreakerPool::Slot>& getThreadCache() {
+    thread_local std::list<ICULineBreakerPool::Slot> cache;
+    return cache;
+}
+
+bool takeSlot(std::list<ICULineBreakerPool::Slot>* slots, uint64_t id, LineBreakStyle lbStyle,
+              LineBreakWordStyle lbWordStyle, ICULineBreakerPool::Slot* out) {
+    for (auto i = slots->begin(); i != slots->end(); i++) {
+        if (i->localeId == id && i->lbStyle == lbStyle && i->lbWordStyle == lbWordStyle) {
+            *out = std::move(*i);
+            slots->erase(i);
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace
+
 ICULineBreakerPool::Slot ICULineBreakerPoolImpl::acquire(const Locale& locale,
                                                          LineBreakStyle lbStyle,
                                                          LineBreakWordStyle lbWordStyle) {
     const uint64_t id = locale.getIdentifier();
-    std::lock_guard<std::mutex> lock(mMutex);
-    for (auto i = mPool.begin(); i != mPool.end(); i++) {
-        if (i->localeId == id && i->lbStyle == lbStyle && i->lbWordStyle == lbWordStyle) {
-            Slot slot = std::move(*i);
-            mPool.erase(i);
+    Slot slot;
+    if (mThreadCacheSize > 0 && takeSlot(&getThreadCache(), id, lbStyle, lbWordStyle, &slot)) {
+        return slot;
+    }
+    const UBreakIterator* prototype;
+    {
+        std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
+        if (takeSlot(&mPool, id, lbStyle, lbWordStyle, &slot)) {
             return slot;
         }
+        prototype = getPrototype(locale, lbStyle, lbWordStyle);
+    }
+    mMissCount++;
+
+    // Not found in pool. Clone a new one out of the lock, the prototypes are never modified nor
+    // removed.
+    if (prototype != nullptr) {
+        MINIKIN_TRACE_NAME("ICULineBreakerPool::cloneIterator");
+        UErrorCode status = U_ZERO_ERROR;
+        IcuUbrkUniquePtr clone(ubrk_clone(prototype, &status));
+        if (U_SUCCESS(status) && clone.get() != nullptr) {
+            return {id, lbStyle, lbWordStyle, std::move(clone)};
+        }
     }
-
-    // Not found in pool. Create new one.
     return {id, lbStyle, lbWordStyle,
             IcuUbrkUniquePtr(createNewIterator(locale, lbStyle, lbWordStyle))};
 }
 
+const UBreakIterator* ICULineBreakerPoolImpl::getPrototype(const Locale& locale,
+                                                          LineBreakStyle lbStyle,
+                                                          LineBreakWordStyle lbWordStyle) {
+    IcuUbrkUniquePtr& prototype =
+            mPrototypes[std::make_tuple(locale.getIdentifier(), lbStyle, lbWordStyle)];
+    if (prototype.get() == nullptr) {
+        // Only formats the locale string and loads the rules once per combination.
+        prototype.reset(createNewIterator(locale, lbStyle, lbWordStyle));
+    }
+    return prototype.get();
+}
+
 void ICULineBreakerPoolImpl::release(ICULineBreakerPool::Slot&& slot) {
     if (slot.breaker.get() == nullptr) {
         return;  // Already released slot. Do nothing.
     }
-    std::lock_guard<std::mutex> lock(mMutex);
+    const size_t threadCacheSize = mThreadCacheSize;
+    if (threadCacheSize > 0) {
+        std::list<Slot>& threadCache = getThreadCache();
+        if (threadCache.size() < threadCacheSize) {
+            threadCache.push_front(std::move(slot));
+            return;
+        }
+    }
+    std::unique_lock<std::mutex> lock = mLockStats.lock(mMutex);
     if (mPool.size() >= MAX_POOL_SIZE) {
         // Pool is full. Move to local variable, so that the given slot will be released when the
         // variable leaves the scope.
@@ -85,11 +185,19 @@ ssize_t WordBreaker::followingWithLocale(const Locale& locale, LineBreakStyle lb
     if (!mUText) {
         return mCurrent;
     }
-    mIcuBreaker = mPool->acquire(locale, lbStyle, lbWordStyle);
-    UErrorCode status = U_ZERO_ERROR;
     MINIKIN_ASSERT(mText != nullptr, "setText must be called first");
-    // TODO: handle failure status
-    ubrk_setUText(mIcuBreaker.breaker.get(), mUText.get(), &status);
+    mSegment = mRecord != nullptr
+                       ? mRecord->find(from, locale.getIdentifier(), lbStyle, lbWordStyle)
+                       : nullptr;
+    mAsciiFastPath = isAsciiFastPathLocale(locale, lbWordStyle);
+    // ICU is only set once the replay or the fast path can't tell the break.
+    mLocale = locale;
+    mLbStyle = lbStyle;
+    mLbWordStyle = lbWordStyle;
+    mIcuBreakerSet = false;
+    if (mSegment == nullptr && !mAsciiFastPath) {
+        startIcuBreaker(locale, lbStyle, lbWordStyle);
+    }
     if (mInEmailOrUrl) {
         // Note:
         // Don't reset mCurrent, mLast, or mScanOffset for keeping email/URL context.
@@ -104,6 +212,21 @@ ssize_t WordBreaker::followingWithLocale(const Locale& locale, LineBreakStyle lb
     return mCurrent;
 }
 
+void WordBreaker::startIcuBreaker(const Locale& locale, LineBreakStyle lbStyle,
+                                  LineBreakWordStyle lbWordStyle) {
+    mSegment = nullptr;
+    if (mIcuBreaker.breaker.get() == nullptr || mIcuBreaker.localeId != locale.getIdentifier() ||
+        mIcuBreaker.lbStyle != lbStyle || mIcuBreaker.lbWordStyle != lbWordStyle) {
+        // The breaker held for the previous texts or locale goes back to the pool.
+        mPool->release(std::move(mIcuBreaker));
+        mIcuBreaker = mPool->acquire(locale, lbStyle, lbWordStyle);
+    }
+    mIcuBreakerSet = true;
+    UErrorCode status = U_ZERO_ERROR;
+    // TODO: handle failure status
+    ubrk_setUText(mIcuBreaker.breaker.get(), mUText.get(), &status);
+}
+
 void WordBreaker::setText(const uint16_t* data, size_t size) {
     mText = data;
     mTextSize = size;
@@ -111,8 +234,30 @@ void WordBreaker::setText(const uint16_t* data, size_t size) {
     mCurrent = 0;
     mScanOffset = 0;
     mInEmailOrUrl = false;
+    // The ICU breaker kept from the previous text is set to this text when needed.
+    mIcuBreakerSet = false;
     UErrorCode status = U_ZERO_ERROR;
-    mUText.reset(utext_openUChars(nullptr, reinterpret_cast<const UChar*>(data), size, &status));
+    // Reuses the UText of the previous text, if any.
+    mUText.reset(utext_openUChars(mUText.release(), reinterpret_cast<const UChar*>(data), size,
+                                  &status));
+
+    // The email addresses and URLs are only looked for in the words found here.
+    mEmailOrUrlCandidates.clear();
+    size_t wordStart = 0;
+    bool isCandidate = false;
+    for (size_t i = 0; i <= size; i++) {
+        const uint16_t c = i < size ? data[i] : 0;
+        if (isEmailOrUrlChar(c)) {
+            isCandidate |= c == '@' || (c == ':' && i + 2 < size && data[i + 1] == '/' &&
+                                        data[i + 2] == '/');
+            continue;
+        }
+        if (isCandidate) {
+            mEmailOrUrlCandidates.push_back(Range(wordStart, i));
+            isCandidate = false;
+        }
+        wordStart = i + 1;
+    }
 }
 
 ssize_t WordBreaker::current() const {
@@ -171,6 +316,19 @@ static bool isValidBreak(const uint16_t* buf, size_t bufEnd, int32_t i) {
 // Customized iteratorNext that takes care of both resets and our modifications
 // to ICU's behavior.
 int32_t WordBreaker::iteratorNext() {
+    if (mAsciiFastPath) {
+        const int32_t result = asciiNextBreak(mCurrent);
+        if (result != ASCII_BREAK_UNKNOWN) {
+            return result;
+        }
+    }
+    if (mSegment != nullptr || !mIcuBreakerSet) {
+        int32_t result = following(mCurrent);
+        while (!isValidBreak(mText, mTextSize, result)) {
+            result = following(result);
+        }
+        return result;
+    }
     int32_t result = ubrk_following(mIcuBreaker.breaker.get(), mCurrent);
     while (!isValidBreak(mText, mTextSize, result)) {
         result = ubrk_next(mIcuBreaker.breaker.get());
@@ -178,6 +336,138 @@ int32_t WordBreaker::iteratorNext() {
     return result;
 }
 
+int32_t WordBreaker::following(int32_t offset) {
+    if (mSegment != nullptr) {
+        // The boundaries before the segment start are unknown.
+        if (offset >= 0 && static_cast<uint32_t>(offset) >= mSegment->start) {
+            const uint32_t* begin = mRecord->boundaries.data() + mSegment->boundaryStart;
+            const uint32_t* end = mRecord->boundaries.data() + mSegment->boundaryEnd;
+            const uint32_t* it = std::upper_bound(begin, end, static_cast<uint32_t>(offset));
+            if (it != end) {
+                return *it;
+            }
+            if (mSegment->reachesEnd) {
+                return UBRK_DONE;
+            }
+        }
+        startIcuBreaker(mLocale, mLbStyle, mLbWordStyle);
+    } else if (!mIcuBreakerSet) {
+        startIcuBreaker(mLocale, mLbStyle, mLbWordStyle);
+    }
+    return ubrk_following(mIcuBreaker.breaker.get(), offset);
+}
+
+bool WordBreaker::isBoundary(int32_t offset) {
+    if (mSegment != nullptr) {
+        if (offset >= 0 && static_cast<uint32_t>(offset) > mSegment->start) {
+            const uint32_t* begin = mRecord->boundaries.data() + mSegment->boundaryStart;
+            const uint32_t* end = mRecord->boundaries.data() + mSegment->boundaryEnd;
+            const uint32_t position = static_cast<uint32_t>(offset);
+            if (mSegment->reachesEnd || (begin != end && position <= *(end - 1))) {
+                return std::binary_search(begin, end, position);
+            }
+        }
+        startIcuBreaker(mLocale, mLbStyle, mLbWordStyle);
+    } else if (!mIcuBreakerSet) {
+        startIcuBreaker(mLocale, mLbStyle, mLbWordStyle);
+    }
+    return ubrk_isBoundary(mIcuBreaker.breaker.get(), offset);
+}
+
+int32_t WordBreaker::asciiNextBreak(int32_t offset) const {
+    if (offset < 0 || static_cast<size_t>(offset) >= mTextSize) {
+        return ASCII_BREAK_UNKNOWN;
+    }
+    // A plain loop over the characters, which the compiler is free to unroll.
+    for (size_t i = offset + 1;; ++i) {
+        const uint16_t prev = mText[i - 1];
+        if (prev != ' ' && !isAsciiWordChar(prev)) {
+            return ASCII_BREAK_UNKNOWN;
+        }
+        if (i == mTextSize) {
+            return i;  // The end of the text is always a break.
+        }
+        const uint16_t c = mText[i];
+        if (prev == ' ') {
+            if (c == ' ') {
+                continue;  // No break before spaces (LB7).
+            } else if (!isAsciiAlnum(c)) {
+                return ASCII_BREAK_UNKNOWN;
+            }
+            // Break after spaces (LB18), unless a rule looking over the spaces applies, which
+            // never happens after a word character.
+            size_t spaceStart = i - 1;
+            while (spaceStart > 0 && mText[spaceStart - 1] == ' ') {
+                spaceStart--;
+            }
+            if (spaceStart == 0 || !isAsciiWordChar(mText[spaceStart - 1])) {
+                return ASCII_BREAK_UNKNOWN;
+            }
+            return i;
+        }
+        // No break inside words: letters and numbers (LB23, LB28), before hyphens and infix
+        // separators (LB13, LB21, LB29) and around apostrophes (LB19). The breaks after hyphens
+        // are not valid breaks. A number after a separator depends on the Unicode version.
+        if ((prev == '.' || prev == ',') && isAsciiDigit(c)) {
+            return ASCII_BREAK_UNKNOWN;
+        }
+    }
+}
+
+// static
+void WordBreaker::record(const U16StringPiece& text, const Locale& locale, LineBreakStyle lbStyle,
+                         LineBreakWordStyle lbWordStyle, const Range& range,
+                         WordBreakRecord* out) {
+    ICULineBreakerPool& pool = ICULineBreakerPoolImpl::getInstance();
+    ICULineBreakerPool::Slot slot = pool.acquire(locale, lbStyle, lbWordStyle);
+    UErrorCode status = U_ZERO_ERROR;
+    std::unique_ptr<UText, decltype(&utext_close)> utext(
+            utext_openUChars(nullptr, reinterpret_cast<const UChar*>(text.data()), text.size(),
+                             &status),
+            &utext_close);
+    if (slot.breaker.get() == nullptr || U_FAILURE(status)) {
+        pool.release(std::move(slot));
+        return;  // Left to ICU when breaking.
+    }
+    ubrk_setUText(slot.breaker.get(), utext.get(), &status);
+
+    WordBreakRecord::Segment segment = {};
+    segment.start = range.getStart();
+    segment.localeId = locale.getIdentifier();
+    segment.lbStyle = lbStyle;
+    segment.lbWordStyle = lbWordStyle;
+    segment.boundaryStart = out->boundaries.size();
+    for (int32_t boundary = ubrk_following(slot.breaker.get(), range.getStart());;
+         boundary = ubrk_next(slot.breaker.get())) {
+        if (boundary == UBRK_DONE) {
+            segment.reachesEnd = true;
+            break;
+        }
+        out->boundaries.push_back(boundary);
+        // The line breakers may look one break past the range before changing the locale.
+        if (static_cast<uint32_t>(boundary) > range.getEnd() &&
+            isValidBreak(text.data(), text.size(), boundary)) {
+            break;
+        }
+    }
+    segment.boundaryEnd = out->boundaries.size();
+    out->segments.push_back(segment);
+    pool.release(std::move(slot));
+}
+
+const WordBreakRecord::Segment* WordBreakRecord::find(uint32_t start, uint64_t localeId,
+                                                      LineBreakStyle lbStyle,
+                                                      LineBreakWordStyle lbWordStyle) const {
+    auto it = std::lower_bound(
+            segments.begin(), segments.end(), start,
+            [](const Segment& segment, uint32_t offset) { return segment.start < offset; });
+    if (it == segments.end() || it->start != start || it->localeId != localeId ||
+        it->lbStyle != lbStyle || it->lbWordStyle != lbWordStyle) {
+        return nullptr;
+    }
+    return &*it;
+}
+
 // Chicago Manual of Style recommends breaking after these characters in URLs and email addresses
 static bool breakAfter(uint16_t c) {
     return c == ':' || c == '=' || c == '&';
@@ -197,15 +487,27 @@ enum ScanState {
     SAW_COLON_SLASH_SLASH,
 };
 
+bool WordBreaker::mayBeInEmailOrUrl(size_t offset) const {
+    auto it = std::upper_bound(
+            mEmailOrUrlCandidates.begin(), mEmailOrUrlCandidates.end(), offset,
+            [](size_t offset, const Range& range) { return offset < range.getStart(); });
+    return it != mEmailOrUrlCandidates.begin() && (it - 1)->contains(offset);
+}
+
 void WordBreaker::detectEmailOrUrl() {
     // scan forward from current ICU position for email address or URL
     if (mLast >= mScanOffset) {
+        if (!mayBeInEmailOrUrl(mLast)) {
+            // The scan would stop at the end of the word without finding one.
+            mInEmailOrUrl = false;
+            return;
+        }
         ScanState state = START;
         size_t i;
         for (i = mLast; i < mTextSize; i++) {
             uint16_t c = mText[i];
             // scan only ASCII characters, stop at space
-            if (!(' ' < c && c <= 0x007E)) {
+            if (!isEmailOrUrlChar(c)) {
                 break;
             }
             if (state == START && c == '@') {
@@ -221,11 +523,11 @@ void WordBreaker::detectEmailOrUrl() {
             }
         }
         if (state == SAW_AT || state == SAW_COLON_SLASH_SLASH) {
-            if (!ubrk_isBoundary(mIcuBreaker.breaker.get(), i)) {
+            if (!isBoundary(i)) {
                 // If there are combining marks or such at the end of the URL or the email address,
                 // consider them a part of the URL or the email, and skip to the next actual
                 // boundary.
-                i = ubrk_following(mIcuBreaker.breaker.get(), i);
+                i = following(i);
             }
             mInEmailOrUrl = true;
         } else {
@@ -319,10 +621,51 @@ int WordBreaker::breakBadness() const {
     return (mInEmailOrUrl && mCurrent < mScanOffset) ? 1 : 0;
 }
 
-void WordBreaker::finish() {
+void WordBreaker::finishText() {
     mText = nullptr;
+    mRecord = nullptr;
+    mSegment = nullptr;
+}
+
+void WordBreaker::finish() {
+    finishText();
     mUText.reset();
     mPool->release(std::move(mIcuBreaker));
 }
 
+namespace {
+
+struct ThreadWordBreaker {
+    WordBreaker breaker;
+    bool isLent = false;
+};
+
+ThreadWordBreaker& getThreadWordBreaker() {
+    // The thread cache must be destroyed after the word breaker, which releases its ICU breaker
+    // into it. The thread local variables are destroyed in the reverse order of construction.
+    getThreadCache();
+    thread_local ThreadWordBreaker threadWordBreaker;
+    return threadWordBreaker;
+}
+
+}  // namespace
+
+ScopedWordBreaker::ScopedWordBreaker() {
+    ThreadWordBreaker& threadWordBreaker = getThreadWordBreaker();
+    if (threadWordBreaker.isLent) {
+        mOwnedBreaker = std::make_unique<WordBreaker>();
+        mBreaker = mOwnedBreaker.get();
+    } else {
+        threadWordBreaker.isLent = true;
+        mBreaker = &threadWordBreaker.breaker;
+    }
+}
+
+ScopedWordBreaker::~ScopedWordBreaker() {
+    if (mOwnedBreaker == nullptr) {
+        mBreaker->finishText();
+        getThreadWordBreaker().isLent = false;
+    }
+}
+
 }  // namespace minikin
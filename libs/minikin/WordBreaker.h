@@ -25,15 +25,22 @@
 
 #include <unicode/ubrk.h>
 
+#include <atomic>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <tuple>
+#include <vector>
 
 #include "Locale.h"
+#include "minikin/CacheStats.h"
 #include "minikin/IcuUtils.h"
 #include "minikin/LineBreakStyle.h"
 #include "minikin/Macros.h"
 #include "minikin/Range.h"
+#include "minikin/U16StringPiece.h"
+#include "minikin/WordBreakRecord.h"
 
 namespace minikin {
 
@@ -70,6 +77,10 @@ public:
 
 // An singleton implementation of the ICU line breaker pool.
 // Since creating ICU line breaker instance takes some time. Pool it for later use.
+//
+// The released breakers are first kept in a cache of the calling thread, and then in the pool
+// shared by all the threads. A missing breaker is cloned from a prototype of its locale and line
+// break styles, which is cheaper than loading the break rules again.
 class ICULineBreakerPoolImpl : public ICULineBreakerPool {
 public:
     Slot acquire(const Locale& locale, LineBreakStyle lbStyle,
@@ -77,22 +88,59 @@ public:
     void release(Slot&& slot) override;
 
     static ICULineBreakerPoolImpl& getInstance() {
-        static ICULineBreakerPoolImpl pool;
+        static ICULineBreakerPoolImpl pool(DEFAULT_THREAD_CACHE_SIZE);
         return pool;
     }
 
+    // Sets the number of breakers each thread keeps for itself. Zero disables the thread caches.
+    void setThreadCacheSize(size_t size) { mThreadCacheSize = size; }
+
+    // Returns the number of acquire calls which found no released breaker, each of which clones or
+    // creates an ICU breaker.
+    uint64_t getMissCount() const { return mMissCount; }
+
+    // The contention on the lock of the pool shared by the threads.
+    const LockStats& getLockStats() const { return mLockStats; }
+
+    // Deletes the released breakers kept in the pool shared by the threads, e.g. on a memory trim
+    // request. The prototypes and the caches of the threads are kept.
+    void clearPool() {
+        std::list<Slot> pool;
+        std::lock_guard<std::mutex> lock(mMutex);
+        pool.swap(mPool);
+    }
+
 protected:
     // protected for testing purposes.
     static constexpr size_t MAX_POOL_SIZE = 4;
-    ICULineBreakerPoolImpl(){};  // singleton.
+    static constexpr size_t DEFAULT_THREAD_CACHE_SIZE = 4;
+    // The instances made for testing have no thread cache unless they set one.
+    ICULineBreakerPoolImpl() : ICULineBreakerPoolImpl(0 /* thread cache size */) {}
+    explicit ICULineBreakerPoolImpl(size_t threadCacheSize) : mThreadCacheSize(threadCacheSize) {}
     size_t getPoolSize() const {
         std::lock_guard<std::mutex> lock(mMutex);
         return mPool.size();
     }
+    size_t getPrototypeCount() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mPrototypes.size();
+    }
 
 private:
+    // Returns the breaker the slots of the given locale and styles are cloned from, creating it
+    // on the first call. Returns nullptr if ICU fails to create it.
+    const UBreakIterator* getPrototype(const Locale& locale, LineBreakStyle lbStyle,
+                                       LineBreakWordStyle lbWordStyle)
+            EXCLUSIVE_LOCKS_REQUIRED(mMutex);
+
+    std::atomic<size_t> mThreadCacheSize;
+    std::atomic<uint64_t> mMissCount = {0};
     std::list<Slot> mPool GUARDED_BY(mMutex);
+    // The breakers the slots are cloned from, which never have a text.
+    std::map<std::tuple<uint64_t, LineBreakStyle, LineBreakWordStyle>, IcuUbrkUniquePtr>
+            mPrototypes GUARDED_BY(mMutex);
     mutable std::mutex mMutex;
+    LockStats mLockStats;
 };
 
 class WordBreaker {
@@ -103,6 +151,16 @@ public:
 
     void setText(const uint16_t* data, size_t size);
 
+    // Takes the ICU boundaries from the record of the text where it has them instead of running
+    // ICU. Must be called after setText. Doesn't take ownership, the record must outlive the
+    // breaking.
+    void setRecord(const WordBreakRecord* record) { mRecord = record; }
+
+    // Records the boundaries a breaker set at the start of the range with the locale and styles
+    // finds in the range, and up to the next valid break after the range.
+    static void record(const U16StringPiece& text, const Locale& locale, LineBreakStyle lbStyle,
+                       LineBreakWordStyle lbWordStyle, const Range& range, WordBreakRecord* out);
+
     // Advance iterator to next word break with current locale. Return offset, or -1 if EOT
     ssize_t next();
 
@@ -130,6 +188,10 @@ public:
 
     int breakBadness() const;
 
+    // Forgets the text and the record, but keeps the UText and the ICU breaker for the next text
+    // set, unlike finish() which releases them.
+    void finishText();
+
     void finish();
 
 protected:
@@ -139,7 +201,19 @@ protected:
 
 private:
     int32_t iteratorNext();
+    // Same as ubrk_following and ubrk_isBoundary, from the record segment if there is one.
+    int32_t following(int32_t offset);
+    bool isBoundary(int32_t offset);
+    // Sets the ICU breaker of the locale and styles and stops replaying the segment.
+    void startIcuBreaker(const Locale& locale, LineBreakStyle lbStyle,
+                         LineBreakWordStyle lbWordStyle);
+    // Returns the next valid break after the offset if the text up to the break is made of simple
+    // ASCII characters whose breaks are known without ICU, or -2.
+    int32_t asciiNextBreak(int32_t offset) const;
     void detectEmailOrUrl();
+    // Returns true if the offset is in a word of the text containing '@' or "://", the only
+    // words detectEmailOrUrl may find an email address or a URL in.
+    bool mayBeInEmailOrUrl(size_t offset) const;
     ssize_t findNextBreakInEmailOrUrl();
 
     // Doesn't take ownership. Must not be nullptr. Must be set in constructor.
@@ -147,6 +221,19 @@ private:
 
     ICULineBreakerPool::Slot mIcuBreaker;
 
+    // The record of the text and the replayed segment, or nullptr.
+    const WordBreakRecord* mRecord = nullptr;
+    const WordBreakRecord::Segment* mSegment = nullptr;
+    // The arguments of the last followingWithLocale, to run ICU past the replayed segment.
+    Locale mLocale;
+    LineBreakStyle mLbStyle = LineBreakStyle::None;
+    LineBreakWordStyle mLbWordStyle = LineBreakWordStyle::None;
+    // True if mIcuBreaker is set for the last followingWithLocale. ICU isn't set until needed for
+    // the segments and the ASCII fast path.
+    bool mIcuBreakerSet = false;
+    // True if the locale and styles don't tailor the breaks of the simple ASCII characters.
+    bool mAsciiFastPath = false;
+
     std::unique_ptr<UText, decltype(&utext_close)> mUText;
     const uint16_t* mText = nullptr;
     size_t mTextSize;
@@ -156,6 +243,27 @@ private:
     // state for the email address / url detector
     ssize_t mScanOffset;
     bool mInEmailOrUrl;
+    // The sorted ranges of the ASCII words containing '@' or "://", found by setText.
+    std::vector<Range> mEmailOrUrlCandidates;
+};
+
+// Lends the word breaker of the calling thread while alive. The breaker keeps its UText and its ICU
+// breaker from one text to the next, so that breaking many short paragraphs, e.g. the messages of a
+// list, doesn't set them up again for each one. A new word breaker is made instead if the one of
+// the thread is already lent, e.g. to the hyphenation run by the line breaker using it.
+class ScopedWordBreaker {
+public:
+    ScopedWordBreaker();
+    ~ScopedWordBreaker();
+
+    WordBreaker& get() { return *mBreaker; }
+
+private:
+    WordBreaker* mBreaker;
+    // Only set if the word breaker of the thread is already lent.
+    std::unique_ptr<WordBreaker> mOwnedBreaker;
+
+    MINIKIN_PREVENT_COPY_AND_ASSIGN(ScopedWordBreaker);
 };
 
 }  // namespace minikin
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace minikin {
+
+namespace {
+
+// The upper bound of the threads of the process wide pool. Shaping a cold paragraph does not scale
+// much beyond this, and the threads stay around for the lifetime of the process.
+constexpr uint32_t kMaxDefaultThreadCount = 3;
+
+// True while the thread runs a task of some pool. The parallelFor calls of the tasks run on their
+// own thread, so that a task never waits for the other tasks of the same pool.
+thread_local bool gIsRunningTask = false;
+
+}  // namespace
+
+WorkerPool::WorkerPool(uint32_t threadCount) : mStopping(false), mExecutor(nullptr) {
+    mThreads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        mThreads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::WorkerPool(Executor* executor) : mStopping(false), mExecutor(executor) {}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWorkCv.notify_all();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+// static
+WorkerPool& WorkerPool::getInstance() {
+    // The calling thread also works, so leave one core for it.
+    const uint32_t cores = std::thread::hardware_concurrency();
+    // Intentionally leaked so that the threads are never joined during the process exit.
+    static WorkerPool* pool =
+            Executor::getInstance() != nullptr
+                    ? new WorkerPool(Executor::getInstance())
+                    : new WorkerPool(std::min(kMaxDefaultThreadCount, cores > 1 ? cores - 1 : 0u));
+    return *pool;
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    const uint32_t helperCount = getThreadCount();
+    if (helperCount == 0 || count < 2 || gIsRunningTask) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    std::shared_ptr<Job> job = std::make_shared<Job>(fn, count);
+    CancellationToken token;
+    if (mExecutor != nullptr) {
+        for (size_t i = 0; i < std::min<size_t>(helperCount, count - 1); ++i) {
+            mExecutor->execute([job]() { runJob(job.get()); }, TaskPriority::High, token);
+        }
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJobs.push_back(job);
+        }
+        mWorkCv.notify_all();
+    }
+    runJob(job.get());
+
+    {
+        std::unique_lock<std::mutex> lock(job->doneMutex);
+        job->doneCv.wait(lock, [&job] { return job->finished.load() == job->count; });
+    }
+    // The helpers which haven't started have nothing left to do.
+    token.cancel();
+    if (mExecutor == nullptr) {
+        // Workers may still hold the job, but they never touch fn again since no index is left.
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = std::find(mJobs.begin(), mJobs.end(), job);
+        if (it != mJobs.end()) {
+            mJobs.erase(it);
+        }
+    }
+}
+
+// static
+void WorkerPool::runJob(Job* job) {
+    const CachePartitionScope partitionScope(job->cachePartition);
+    gIsRunningTask = true;
+    for (size_t i = job->next.fetch_add(1); i < job->count; i = job->next.fetch_add(1)) {
+        job->fn(i);
+        if (job->finished.fetch_add(1) + 1 == job->count) {
+            // Take the lock so that the notification can't fall between the predicate check and
+            // the wait of the calling thread.
+            std::lock_guard<std::mutex> lock(job->doneMutex);
+            job->doneCv.notify_all();
+        }
+    }
+    gIsRunningTask = false;
+}
+
+void WorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mWorkCv.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(mMutex) {
+            return mStopping || !mJobs.empty();
+        });
+        if (mStopping) {
+            return;
+        }
+        std::shared_ptr<Job> job = mJobs.front();
+        lock.unlock();
+        runJob(job.get());
+        lock.lock();
+        // All the indices of the job have been taken, so don't let the other workers pick it.
+        if (!mJobs.empty() && mJobs.front() == job) {
+            mJobs.pop_front();
+        }
+    }
+}
+
+}  // namespace minikin
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MINIKIN_WORKER_POOL_H
+#define MINIKIN_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "minikin/CachePartition.h"
+#include "minikin/Executor.h"
+#include "minikin/Macros.h"
+
+namespace minikin {
+
+// A fixed set of worker threads which helps the calling thread to run independent tasks, e.g.
+// shaping the words missing from the layout cache. The helpers can also be the tasks of an
+// Executor of the host instead of threads of the pool.
+class WorkerPool {
+public:
+    // Creates a pool of the given number of threads. A pool of zero threads runs everything on the
+    // calling thread.
+    explicit WorkerPool(uint32_t threadCount);
+
+    // Creates a pool without threads, which runs its helpers as tasks of the executor. The
+    // executor must outlive the pool.
+    explicit WorkerPool(Executor* executor);
+
+    // Waits for the tasks being run and joins the threads.
+    ~WorkerPool();
+
+    // Returns the process wide pool, which is created on the first call with the registered
+    // Executor, or with a few threads if there is none.
+    static WorkerPool& getInstance();
+
+    // The number of the threads or executor tasks helping the calling thread at most.
+    uint32_t getThreadCount() const {
+        return mExecutor != nullptr ? mExecutor->getConcurrency() : mThreads.size();
+    }
+
+    // Calls fn(i) for every i in [0, count) and returns when all the calls have finished. The
+    // calling thread takes part in the work, so this never waits for an idle worker to start.
+    // The order and the threads of the calls are unspecified. If called from a task of a pool, all
+    // the calls run on the calling thread.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+private:
+    struct Job {
+        Job(const std::function<void(size_t)>& fn, size_t count)
+                : fn(fn),
+                  count(count),
+                  cachePartition(CachePartitionScope::getCurrent()),
+                  next(0),
+                  finished(0) {}
+
+        const std::function<void(size_t)>& fn;
+        const size_t count;
+        // The cache partition of the calling thread, which the tasks run with.
+        const CachePartition cachePartition;
+        std::atomic<size_t> next;
+        std::atomic<size_t> finished;
+        // Notified once all the indices are finished. The helpers only need the job, so an
+        // executor task left over after the call doesn't refer to the pool.
+        std::mutex doneMutex;
+        std::condition_variable doneCv;
+    };
+
+    void workerLoop();
+    static void runJob(Job* job);
+
+    std::mutex mMutex;
+    std::condition_variable mWorkCv;
+    std::deque<std::shared_ptr<Job>> mJobs GUARDED_BY(mMutex);
+    bool mStopping GUARDED_BY(mMutex);
+    std::vector<std::thread> mThreads;
+    Executor* const mExecutor;
+
+    MINIKIN_PREVENT_COPY_ASSIGN_AND_MOVE(WorkerPool);
+};
+
+}  // namespace minikin
+
+#endif  // MINIKIN_WORKER_POOL_H
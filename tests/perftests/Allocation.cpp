@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The allocations of the layout, the measurement and the line breaking of an English paragraph,
+// and the memory held by each entry of the layout caches.
+//
+// The global operator new of this binary is replaced to count the allocations of the calling
+// thread. The "allocs" and "bytes" counters are the allocations per iteration. Only the C++
+// allocations are counted, not the ones of HarfBuzz and ICU, which use malloc.
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/BoundsCache.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+#include "minikin/Measurement.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace {
+
+thread_local uint64_t gAllocationCount = 0;
+thread_local uint64_t gAllocatedBytes = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+    gAllocationCount++;
+    gAllocatedBytes += size;
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace minikin {
+
+namespace {
+
+constexpr float kTextSize = 10.0f;
+constexpr float kLineWidth = 1000.0f;
+constexpr size_t kWordCount = 100;
+
+class ConstantLineWidth : public LineWidth {
+public:
+    ConstantLineWidth(float width) : mWidth(width) {}
+    virtual ~ConstantLineWidth() {}
+
+    float getAt(size_t) const override { return mWidth; }
+    float getMin() const override { return mWidth; }
+
+private:
+    float mWidth;
+};
+
+const std::vector<std::string>& getCorpusWords() {
+    static const std::vector<std::string> words = [] {
+        std::vector<std::string> words;
+        for (const std::string& line : readLines(getTestDataDir() + "hyphenation-en.txt")) {
+            std::istringstream stream(line);
+            std::string word;
+            while (stream >> word) {
+                words.push_back(word);
+            }
+        }
+        return words;
+    }();
+    return words;
+}
+
+std::vector<uint16_t> buildParagraph() {
+    const std::vector<std::string>& words = getCorpusWords();
+    std::string text;
+    for (size_t i = 0; i < kWordCount; ++i) {
+        if (i != 0) {
+            text += ' ';
+        }
+        text += words[i % words.size()];
+    }
+    return utf8ToUtf16(text);
+}
+
+MinikinPaint getPaint() {
+    static const std::shared_ptr<FontCollection> font = buildFontCollection("Ascii.ttf");
+    MinikinPaint paint(font);
+    paint.size = kTextSize;
+    paint.localeListId = registerLocaleList("en-US");
+    return paint;
+}
+
+std::unique_ptr<MeasuredText> measureParagraph(const std::vector<uint16_t>& text) {
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), getPaint(), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, false /* hyphenation */, false /* compute full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+void setAllocationCounters(benchmark::State& state, uint64_t count, uint64_t bytes) {
+    state.counters["allocs"] =
+            benchmark::Counter(static_cast<double>(count), benchmark::Counter::kAvgIterations);
+    state.counters["bytes"] =
+            benchmark::Counter(static_cast<double>(bytes), benchmark::Counter::kAvgIterations);
+}
+
+// Counts the allocations of the calling thread from the construction.
+class AllocationCounter {
+public:
+    AllocationCounter() : mCount(gAllocationCount), mBytes(gAllocatedBytes) {}
+
+    // Reports the allocations as the counts per iteration.
+    void report(benchmark::State& state) const {
+        setAllocationCounters(state, gAllocationCount - mCount, gAllocatedBytes - mBytes);
+    }
+
+private:
+    const uint64_t mCount;
+    const uint64_t mBytes;
+};
+
+void layoutParagraph(const std::vector<uint16_t>& text, const MinikinPaint& paint) {
+    Layout layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                  EndHyphenEdit::NO_EDIT);
+    benchmark::DoNotOptimize(layout.getAdvance());
+}
+
+}  // namespace
+
+// The Layout of the paragraph, with every word missing the cache or found in it.
+static void BM_Allocation_layout(benchmark::State& state, bool warm) {
+    const std::vector<uint16_t> text = buildParagraph();
+    const MinikinPaint paint = getPaint();
+    Layout::purgeCaches();
+    layoutParagraph(text, paint);
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    for (auto _ : state) {
+        if (!warm) {
+            state.PauseTiming();
+            Layout::purgeCaches();
+            state.ResumeTiming();
+        }
+        const uint64_t countBefore = gAllocationCount;
+        const uint64_t bytesBefore = gAllocatedBytes;
+        layoutParagraph(text, paint);
+        count += gAllocationCount - countBefore;
+        bytes += gAllocatedBytes - bytesBefore;
+    }
+    // The purges between the iterations are not counted.
+    setAllocationCounters(state, count, bytes);
+}
+
+BENCHMARK_CAPTURE(BM_Allocation_layout, cold, false);
+BENCHMARK_CAPTURE(BM_Allocation_layout, warm, true);
+
+// MeasuredTextBuilder::build of the paragraph, with the words in LayoutCache.
+static void BM_Allocation_measure(benchmark::State& state) {
+    const std::vector<uint16_t> text = buildParagraph();
+    measureParagraph(text);
+    const AllocationCounter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(measureParagraph(text));
+    }
+    counter.report(state);
+}
+
+BENCHMARK(BM_Allocation_measure);
+
+// breakIntoLines of the measured paragraph.
+static void BM_Allocation_breakIntoLines(benchmark::State& state) {
+    const std::vector<uint16_t> text = buildParagraph();
+    std::unique_ptr<MeasuredText> measured = measureParagraph(text);
+    const ConstantLineWidth lineWidth(kLineWidth);
+    const TabStops tabStops(nullptr, 0, kTextSize * 4);
+    const BreakStrategy strategy = static_cast<BreakStrategy>(state.range(0));
+    const AllocationCounter counter;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(breakIntoLines(text, strategy, HyphenationFrequency::None,
+                                                false /* justified */, *measured, lineWidth,
+                                                tabStops));
+    }
+    counter.report(state);
+}
+
+BENCHMARK(BM_Allocation_breakIntoLines)
+        ->ArgName("strategy")
+        ->Arg((int)BreakStrategy::Greedy)
+        ->Arg((int)BreakStrategy::HighQuality);
+
+// The bytes held by each entry of LayoutCache and BoundsCache, as counted by the caches, after
+// the distinct words of the corpus are laid out and measured.
+static void BM_Memory_cacheEntry(benchmark::State& state) {
+    const MinikinPaint paint = getPaint();
+    // Below the capacity of BoundsCache, so that no entry is evicted.
+    constexpr size_t kEntryCount = 200;
+    size_t layoutBytes = 0;
+    size_t boundsBytes = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Layout::purgeCaches();
+        state.ResumeTiming();
+        const std::vector<std::string>& words = getCorpusWords();
+        for (size_t i = 0; i < kEntryCount; ++i) {
+            // The index makes the words distinct.
+            const std::vector<uint16_t> word = utf8ToUtf16(words[i % words.size()] +
+                                                           std::to_string(i));
+            MinikinRect rect;
+            getBounds(word, Range(0, word.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                      EndHyphenEdit::NO_EDIT, &rect);
+        }
+        layoutBytes = LayoutCache::getInstance().getMemoryUsage();
+        boundsBytes = BoundsCache::getInstance().getMemoryUsage();
+    }
+    state.counters["LayoutCache bytes/entry"] = static_cast<double>(layoutBytes) / kEntryCount;
+    state.counters["BoundsCache bytes/entry"] = static_cast<double>(boundsBytes) / kEntryCount;
+    Layout::purgeCaches();
+}
+
+BENCHMARK(BM_Memory_cacheEntry);
+
+}  // namespace minikin
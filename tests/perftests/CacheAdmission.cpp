@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The hit rate of LayoutCache with and without the frequency admission, on a trace alternating
+// the words of a paragraph, e.g. the UI of an app, with a scan over twice as many unique words
+// as the cache holds, e.g. a log scrolled once.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+constexpr size_t kRounds = 10;
+constexpr size_t kScanLength = 10000;
+
+std::vector<std::vector<uint16_t>> getHotWords() {
+    std::vector<std::vector<uint16_t>> words;
+    const std::string paragraph = readLines(getTestDataDir() + "hyphenation-en.txt").front();
+    size_t start = 0;
+    while (start < paragraph.size()) {
+        size_t end = paragraph.find(' ', start);
+        if (end == std::string::npos) {
+            end = paragraph.size();
+        }
+        if (end > start) {
+            words.push_back(utf8ToUtf16(paragraph.substr(start, end - start)));
+        }
+        start = end + 1;
+    }
+    return words;
+}
+
+void layoutWord(LayoutCache& cache, const std::vector<uint16_t>& word, const MinikinPaint& paint) {
+    auto f = [](const std::shared_ptr<const LayoutPiece>& layout, const MinikinPaint&) {
+        benchmark::DoNotOptimize(layout.get());
+    };
+    cache.getOrCreate(word, Range(0, word.size()), paint, false /* LTR */,
+                      StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f);
+}
+
+double getHitRate(uint64_t hits, uint64_t misses) {
+    return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+}
+
+}  // namespace
+
+// The argument enables the frequency admission, 0 is the plain LRU.
+static void BM_LayoutCache_scanHitRate(benchmark::State& state) {
+    const std::vector<std::vector<uint16_t>> hotWords = getHotWords();
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    LayoutCache& cache = LayoutCache::getInstance();
+    cache.setFrequencyAdmission(state.range(0) != 0);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t hotHits = 0;
+    uint64_t hotMisses = 0;
+    for (auto _ : state) {
+        Layout::purgeCaches();
+        const CacheStats& stats = cache.getStats();
+        const uint64_t startHits = stats.getHitCount();
+        const uint64_t startMisses = stats.getMissCount();
+        for (size_t round = 0; round < kRounds; ++round) {
+            const uint64_t roundHits = stats.getHitCount();
+            const uint64_t roundMisses = stats.getMissCount();
+            for (const std::vector<uint16_t>& word : hotWords) {
+                layoutWord(cache, word, paint);
+            }
+            hotHits += stats.getHitCount() - roundHits;
+            hotMisses += stats.getMissCount() - roundMisses;
+            for (size_t i = 0; i < kScanLength; ++i) {
+                const std::string word = "scan" + std::to_string(round * kScanLength + i);
+                layoutWord(cache, utf8ToUtf16(word), paint);
+            }
+        }
+        hits += stats.getHitCount() - startHits;
+        misses += stats.getMissCount() - startMisses;
+    }
+    state.counters["hit_rate"] = getHitRate(hits, misses);
+    state.counters["hot_hit_rate"] = getHitRate(hotHits, hotMisses);
+
+    cache.setFrequencyAdmission(false);
+    Layout::purgeCaches();
+}
+
+BENCHMARK(BM_LayoutCache_scanHitRate)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+}  // namespace minikin
@@ -16,9 +16,16 @@
 
 #include "minikin/GraphemeBreak.h"
 
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 #include <cutils/log.h>
 
+#include "FileUtils.h"
+#include "PathUtils.h"
 #include "UnicodeUtils.h"
 
 namespace minikin {
@@ -77,4 +84,37 @@ BENCHMARK(BM_GraphemeBreak_Emoji_Flags)
         ->Arg(4)    // After flag sequence. Here is boundary of grapheme cluster.
         ->Arg(10);  // Middle of 3rd flag sequence.
 
+// Asks for every offset of the paragraphs of tests/data/breaking-*.txt, one per line, whether it is
+// a grapheme cluster boundary. Besides the time, reports the boundaries found per second.
+static void BM_GraphemeBreak_Corpus(benchmark::State& state, const char* file) {
+    const std::string path = getTestDataDir() + file;
+    if (access(path.c_str(), R_OK) != 0) {
+        state.SkipWithError("Corpus not found");
+        return;
+    }
+    std::vector<std::vector<uint16_t>> paragraphs;
+    for (const std::string& line : readLines(path)) {
+        paragraphs.push_back(utf8ToUtf16(line));
+    }
+    size_t breakCount = 0;
+    for (auto _ : state) {
+        breakCount = 0;
+        for (const std::vector<uint16_t>& paragraph : paragraphs) {
+            for (size_t offset = 0; offset <= paragraph.size(); offset++) {
+                breakCount += GraphemeBreak::isGraphemeBreak(nullptr, paragraph.data(), 0,
+                                                             paragraph.size(), offset);
+            }
+        }
+        benchmark::DoNotOptimize(breakCount);
+    }
+    state.counters["breaks"] = benchmark::Counter(static_cast<double>(breakCount),
+                                                  benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK_CAPTURE(BM_GraphemeBreak_Corpus, th, "breaking-th.txt");
+BENCHMARK_CAPTURE(BM_GraphemeBreak_Corpus, ja, "breaking-ja.txt");
+BENCHMARK_CAPTURE(BM_GraphemeBreak_Corpus, zh, "breaking-zh.txt");
+BENCHMARK_CAPTURE(BM_GraphemeBreak_Corpus, ar, "breaking-ar.txt");
+BENCHMARK_CAPTURE(BM_GraphemeBreak_Corpus, hi, "breaking-hi.txt");
+BENCHMARK_CAPTURE(BM_GraphemeBreak_Corpus, enWithUrls, "breaking-en-url.txt");
+
 }  // namespace minikin
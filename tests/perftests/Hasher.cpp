@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The hash of the cache keys, alone and on the layout cache hits. Build with
+// MINIKIN_JENKINS_HASHER defined to compare with the Jenkins hash.
+
+#include <unordered_set>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/Hasher.h"
+#include "minikin/LayoutCache.h"
+
+#include "FontTestUtils.h"
+
+namespace minikin {
+
+namespace {
+
+// Distinct lowercase words of 3 to 10 letters.
+std::vector<std::vector<uint16_t>> buildWords(size_t count) {
+    std::vector<std::vector<uint16_t>> words;
+    for (uint32_t i = 0; i < count; ++i) {
+        std::vector<uint16_t> word(3 + i % 8, 'a');
+        for (uint32_t j = 0, n = i; j < word.size(); ++j, n /= 26) {
+            word[j] += n % 26;
+        }
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+}  // namespace
+
+// The argument is the length of the text.
+static void BM_Hasher_updateShorts(benchmark::State& state) {
+    const std::vector<uint16_t> text(state.range(0), 'a');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Hasher().updateShorts(text.data(), text.size()).hash());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() * sizeof(uint16_t));
+}
+
+BENCHMARK(BM_Hasher_updateShorts)->Arg(4)->Arg(16)->Arg(64);
+
+// Looks up words already in the layout cache. The "collisions" counter is the number of words
+// sharing the low 16 bits of the key hash with a previous word.
+static void BM_LayoutCache_hit(benchmark::State& state) {
+    const std::vector<std::vector<uint16_t>> words = buildWords(1000);
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    auto f = [](const LayoutPiece& layout, const MinikinPaint&) {
+        benchmark::DoNotOptimize(layout.advance());
+    };
+    LayoutCache& cache = LayoutCache::getInstance();
+    std::unordered_set<uint32_t> buckets;
+    size_t collisions = 0;
+    for (const std::vector<uint16_t>& word : words) {
+        const U16StringPiece text(word);
+        const Range range(0, word.size());
+        cache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                          EndHyphenEdit::NO_EDIT, f);
+        const LayoutCacheKey key(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                 EndHyphenEdit::NO_EDIT);
+        if (!buckets.insert(key.hash() & 0xFFFF).second) {
+            collisions++;
+        }
+    }
+    for (auto _ : state) {
+        for (const std::vector<uint16_t>& word : words) {
+            cache.getOrCreate(word, Range(0, word.size()), paint, false /* LTR */,
+                              StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f);
+        }
+    }
+    state.counters["collisions"] = collisions;
+    state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+BENCHMARK(BM_LayoutCache_hit);
+
+}  // namespace minikin
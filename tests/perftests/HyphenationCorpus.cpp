@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput of the hyphenation over the paragraphs of tests/data/hyphenation-*.txt. Besides the
+// time, each benchmark reports the words and the bytes of text processed per second.
+//
+// The patterns are read from /system/usr/hyphen-data/, or from the directory given in the
+// MINIKIN_HYPHEN_DATA_DIR environment variable, e.g. when running on host.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <unicode/uchar.h>
+
+#include "minikin/Hyphenator.h"
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "HyphenatorMap.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+struct CorpusLanguage {
+    const char* locale;
+    const char* corpusFile;
+    const char* patternFile;
+    int minPrefix;
+    int minSuffix;
+};
+
+const CorpusLanguage kEnglish = {"en-US", "hyphenation-en.txt", "hyph-en-us.hyb", 2, 3};
+const CorpusLanguage kGerman = {"de-DE", "hyphenation-de.txt", "hyph-de-1996.hyb", 2, 2};
+const CorpusLanguage kFrench = {"fr-FR", "hyphenation-fr.txt", "hyph-fr.hyb", 2, 2};
+
+struct Corpus {
+    std::vector<uint8_t> patternData;
+    Hyphenator* hyphenator = nullptr;
+    uint32_t localeListId = 0;
+
+    // The whole corpus, one paragraph per line.
+    std::vector<uint16_t> text;
+    std::vector<Range> paragraphs;
+    // The words of each paragraph, in the offsets of the text.
+    std::vector<std::vector<Range>> paragraphWords;
+
+    size_t wordCount = 0;
+    size_t longestWord = 0;
+};
+
+std::string getHyphenDataDir() {
+    const char* dir = getenv("MINIKIN_HYPHEN_DATA_DIR");
+    if (dir == nullptr) {
+        return "/system/usr/hyphen-data/";
+    }
+    return std::string(dir) + "/";
+}
+
+std::unique_ptr<Corpus> loadCorpus(const CorpusLanguage& language) {
+    const std::string patternPath = getHyphenDataDir() + language.patternFile;
+    const std::string corpusPath = getTestDataDir() + language.corpusFile;
+    if (access(patternPath.c_str(), R_OK) != 0 || access(corpusPath.c_str(), R_OK) != 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Corpus> corpus = std::make_unique<Corpus>();
+    corpus->patternData = readWholeFile(patternPath);
+    corpus->hyphenator = Hyphenator::loadBinary(corpus->patternData.data(), language.minPrefix,
+                                                language.minSuffix, language.locale);
+    corpus->localeListId = registerLocaleList(language.locale);
+    // The measured texts look up the hyphenator of their locale.
+    HyphenatorMap::add(language.locale, corpus->hyphenator);
+
+    const std::vector<uint8_t> utf8 = readWholeFile(corpusPath);
+    corpus->text = utf8ToUtf16(std::string(utf8.begin(), utf8.end()));
+
+    const std::vector<uint16_t>& text = corpus->text;
+    uint32_t lineStart = 0;
+    for (uint32_t i = 0; i <= text.size(); ++i) {
+        if (i != text.size() && text[i] != '\n') {
+            continue;
+        }
+        if (i != lineStart) {
+            corpus->paragraphs.push_back(Range(lineStart, i));
+            std::vector<Range> words;
+            uint32_t wordStart = lineStart;
+            for (uint32_t j = lineStart; j <= i; ++j) {
+                // The corpus only holds BMP letters.
+                if (j != i && u_isalpha(text[j])) {
+                    continue;
+                }
+                if (j != wordStart) {
+                    words.push_back(Range(wordStart, j));
+                    corpus->longestWord = std::max<size_t>(corpus->longestWord, j - wordStart);
+                }
+                wordStart = j + 1;
+            }
+            corpus->wordCount += words.size();
+            corpus->paragraphWords.push_back(std::move(words));
+        }
+        lineStart = i + 1;
+    }
+    return corpus;
+}
+
+// Returns nullptr if the patterns or the corpus are not available.
+const Corpus* getCorpus(const CorpusLanguage& language) {
+    static std::map<const CorpusLanguage*, std::unique_ptr<Corpus>> corpora;
+    auto it = corpora.find(&language);
+    if (it == corpora.end()) {
+        it = corpora.emplace(&language, loadCorpus(language)).first;
+    }
+    return it->second.get();
+}
+
+void setCounters(benchmark::State& state, const Corpus& corpus) {
+    state.counters["words"] = benchmark::Counter(static_cast<double>(corpus.wordCount),
+                                                 benchmark::Counter::kIsIterationInvariantRate);
+    state.SetBytesProcessed(state.iterations() * corpus.text.size() * sizeof(uint16_t));
+}
+
+std::unique_ptr<MeasuredText> buildParagraph(const Corpus& corpus, const Range& paragraph,
+                                             const std::shared_ptr<FontCollection>& font) {
+    const U16StringPiece text = U16StringPiece(corpus.text).substr(paragraph);
+    MinikinPaint paint(font);
+    paint.size = 10.0f;
+    paint.localeListId = corpus.localeListId;
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, true /* compute hyphenation */, false /* compute full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+}  // namespace
+
+// Hyphenates the words of the corpus one by one.
+static void BM_HyphenationCorpus_hyphenate(benchmark::State& state,
+                                           const CorpusLanguage* language) {
+    const Corpus* corpus = getCorpus(*language);
+    if (corpus == nullptr) {
+        state.SkipWithError("Hyphenation patterns or corpus not found");
+        return;
+    }
+    const U16StringPiece text(corpus->text);
+    std::vector<HyphenationType> result(corpus->longestWord);
+    for (auto _ : state) {
+        for (const std::vector<Range>& words : corpus->paragraphWords) {
+            for (const Range& word : words) {
+                corpus->hyphenator->hyphenate(text.substr(word), result.data());
+            }
+        }
+        benchmark::DoNotOptimize(result.data());
+    }
+    setCounters(state, *corpus);
+}
+
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_hyphenate, en, &kEnglish);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_hyphenate, de, &kGerman);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_hyphenate, fr, &kFrench);
+
+// Hyphenates the words of each paragraph at once.
+static void BM_HyphenationCorpus_hyphenateBatch(benchmark::State& state,
+                                                const CorpusLanguage* language) {
+    const Corpus* corpus = getCorpus(*language);
+    if (corpus == nullptr) {
+        state.SkipWithError("Hyphenation patterns or corpus not found");
+        return;
+    }
+    std::vector<HyphenationType> result(corpus->text.size());
+    for (auto _ : state) {
+        for (const std::vector<Range>& words : corpus->paragraphWords) {
+            corpus->hyphenator->hyphenateBatch(corpus->text, words, result.data());
+        }
+        benchmark::DoNotOptimize(result.data());
+    }
+    setCounters(state, *corpus);
+}
+
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_hyphenateBatch, en, &kEnglish);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_hyphenateBatch, de, &kGerman);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_hyphenateBatch, fr, &kFrench);
+
+// Computes the hyphenation points of the measured paragraphs, i.e. the hyphenation and the
+// populateHyphenationPoints pass which measures the pieces around each point.
+static void BM_HyphenationCorpus_computeHyphenBreaks(benchmark::State& state,
+                                                     const CorpusLanguage* language) {
+    const Corpus* corpus = getCorpus(*language);
+    if (corpus == nullptr) {
+        state.SkipWithError("Hyphenation patterns or corpus not found");
+        return;
+    }
+    std::shared_ptr<FontCollection> font = buildFontCollection("Ascii.ttf");
+    MeasuredText::setDeferredHyphenationEnabled(true);
+    std::vector<std::unique_ptr<MeasuredText>> measuredTexts;
+    for (const Range& paragraph : corpus->paragraphs) {
+        measuredTexts.push_back(buildParagraph(*corpus, paragraph, font));
+    }
+    MeasuredText::setDeferredHyphenationEnabled(false);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < measuredTexts.size(); ++i) {
+            const U16StringPiece text = U16StringPiece(corpus->text).substr(corpus->paragraphs[i]);
+            benchmark::DoNotOptimize(measuredTexts[i]->computeHyphenBreaks(text));
+        }
+    }
+    setCounters(state, *corpus);
+}
+
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_computeHyphenBreaks, en, &kEnglish);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_computeHyphenBreaks, de, &kGerman);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_computeHyphenBreaks, fr, &kFrench);
+
+// Measures the paragraphs with the hyphenation. The layouts are cached after the first
+// iteration, so this is mostly the cost of the hyphenation in MeasuredTextBuilder::build.
+static void BM_HyphenationCorpus_buildMeasuredText(benchmark::State& state,
+                                                   const CorpusLanguage* language) {
+    const Corpus* corpus = getCorpus(*language);
+    if (corpus == nullptr) {
+        state.SkipWithError("Hyphenation patterns or corpus not found");
+        return;
+    }
+    std::shared_ptr<FontCollection> font = buildFontCollection("Ascii.ttf");
+    for (auto _ : state) {
+        for (const Range& paragraph : corpus->paragraphs) {
+            benchmark::DoNotOptimize(buildParagraph(*corpus, paragraph, font));
+        }
+    }
+    setCounters(state, *corpus);
+}
+
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_buildMeasuredText, en, &kEnglish);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_buildMeasuredText, de, &kGerman);
+BENCHMARK_CAPTURE(BM_HyphenationCorpus_buildMeasuredText, fr, &kFrench);
+
+}  // namespace minikin
@@ -52,6 +52,43 @@ static void BM_Hyphenator_long_word(benchmark::State& state) {
 // TODO: Use BENCHMARK_CAPTURE for parametrise.
 BENCHMARK(BM_Hyphenator_long_word);
 
+const char* mlHyph = "/system/usr/hyphen-data/hyph-ml.hyb";
+const int mlMinPrefix = 2;
+const int mlMinSuffix = 2;
+
+static void BM_Hyphenator_malayalam_word(benchmark::State& state) {
+    std::vector<uint8_t> patternData = readWholeFile(mlHyph);
+    Hyphenator* hyphenator =
+            Hyphenator::loadBinary(patternData.data(), mlMinPrefix, mlMinSuffix, "ml");
+    // "Malayalam" in Malayalam.
+    std::vector<uint16_t> word = utf8ToUtf16("\u0D2E\u0D32\u0D2F\u0D3E\u0D33\u0D02");
+    std::vector<HyphenationType> result;
+    while (state.KeepRunning()) {
+        hyphenator->hyphenate(word, &result);
+    }
+}
+
+BENCHMARK(BM_Hyphenator_malayalam_word);
+
+const char* deHyph = "/system/usr/hyphen-data/hyph-de-1996.hyb";
+const int deMinPrefix = 2;
+const int deMinSuffix = 2;
+
+static void BM_Hyphenator_german_compound_word(benchmark::State& state) {
+    std::vector<uint8_t> patternData = readWholeFile(deHyph);
+    Hyphenator* hyphenator =
+            Hyphenator::loadBinary(patternData.data(), deMinPrefix, deMinSuffix, "de");
+    // Longer than what used to fit the buffers on the stack.
+    std::vector<uint16_t> word = utf8ToUtf16(
+            "Grundstuecksverkehrsgenehmigungszustaendigkeitsuebertragungsverordnung");
+    std::vector<HyphenationType> result;
+    while (state.KeepRunning()) {
+        hyphenator->hyphenate(word, &result);
+    }
+}
+
+BENCHMARK(BM_Hyphenator_german_compound_word);
+
 // TODO: Add more tests for other languages.
 
 }  // namespace minikin
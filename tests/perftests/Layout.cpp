@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The layout and the measurement of a paragraph of each script, with the caches cleared before
+// every iteration ("cold"), filled by a first run ("warm"), or with a new word in every
+// iteration, so that each paragraph is one miss and hits otherwise ("mixed").
+//
+// The fonts are the ones of tests/data, which cover a few characters of each script. The other
+// characters are shaped with the .notdef glyph, so the benchmarks measure the work of minikin and
+// HarfBuzz rather than the complex shaping of the real fonts. There is no Devanagari font, and
+// the Hindi text is shaped with the .notdef glyph of the first family.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/FontCollection.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutCore.h"
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+#include "minikin/Measurement.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+constexpr float kTextSize = 10.0f;
+
+enum class Script : int { Latin, Arabic, Devanagari, Cjk, Emoji };
+
+struct Paragraph {
+    std::vector<uint16_t> text;
+    Bidi bidi;
+    const char* locale;
+};
+
+std::string readParagraph(const std::string& fileName) {
+    return readLines(getTestDataDir() + fileName).front();
+}
+
+const Paragraph& getParagraph(Script script) {
+    static const std::vector<Paragraph> paragraphs = [] {
+        // The woman, cooking, woman and skin tone emoji of the test emoji fonts.
+        std::string emoji;
+        for (int i = 0; i < 32; ++i) {
+            emoji += "\xF0\x9F\x91\xA9 \xF0\x9F\x8D\xB3 \xF0\x9F\x91\xA9\xF0\x9F\x8F\xBD ";
+        }
+        return std::vector<Paragraph>{
+                {utf8ToUtf16(readParagraph("hyphenation-en.txt")), Bidi::LTR, "en-US"},
+                {utf8ToUtf16(readParagraph("breaking-ar.txt")), Bidi::RTL, "ar"},
+                {utf8ToUtf16(readParagraph("breaking-hi.txt")), Bidi::LTR, "hi"},
+                {utf8ToUtf16(readParagraph("breaking-ja.txt")), Bidi::LTR, "ja"},
+                {utf8ToUtf16(emoji), Bidi::LTR, "en-US"},
+        };
+    }();
+    return paragraphs[static_cast<int>(script)];
+}
+
+MinikinPaint getPaint(Script script) {
+    static const std::shared_ptr<FontCollection> collection =
+            FontCollection::create({buildFontFamily("Ascii.ttf"), buildFontFamily("Arabic.ttf"),
+                                    buildFontFamily("Ja.ttf", "ja"),
+                                    buildFontFamily("ColorEmojiFont.ttf", "und-Zsye"),
+                                    buildFontFamily("Emoji.ttf", "und-Zsye")});
+    MinikinPaint paint(collection);
+    paint.size = kTextSize;
+    paint.localeListId = registerLocaleList(getParagraph(script).locale);
+    return paint;
+}
+
+float layoutText(const std::vector<uint16_t>& text, Bidi bidi, const MinikinPaint& paint) {
+    return Layout(text, Range(0, text.size()), bidi, paint, StartHyphenEdit::NO_EDIT,
+                  EndHyphenEdit::NO_EDIT)
+            .getAdvance();
+}
+
+float measureText(const std::vector<uint16_t>& text, Bidi bidi, const MinikinPaint& paint) {
+    return Layout::measureText(text, Range(0, text.size()), bidi, paint, StartHyphenEdit::NO_EDIT,
+                               EndHyphenEdit::NO_EDIT, nullptr /* advances */);
+}
+
+MinikinRect boundsOfText(const std::vector<uint16_t>& text, Bidi bidi, const MinikinPaint& paint) {
+    MinikinRect rect;
+    getBounds(text, Range(0, text.size()), bidi, paint, StartHyphenEdit::NO_EDIT,
+              EndHyphenEdit::NO_EDIT, &rect);
+    return rect;
+}
+
+void setTimePerChar(benchmark::State& state, size_t charCount) {
+    state.counters["time/char"] = benchmark::Counter(
+            static_cast<double>(charCount),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+void scriptArgs(benchmark::internal::Benchmark* b) {
+    b->ArgName("script");
+    for (Script script : {Script::Latin, Script::Arabic, Script::Devanagari, Script::Cjk,
+                          Script::Emoji}) {
+        b->Arg(static_cast<int>(script));
+    }
+}
+
+// Runs f on the paragraph of the script with the caches cleared before every iteration.
+template <typename F>
+void runCold(benchmark::State& state, F f) {
+    const Script script = static_cast<Script>(state.range(0));
+    const Paragraph& paragraph = getParagraph(script);
+    const MinikinPaint paint = getPaint(script);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Layout::purgeCaches();
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(f(paragraph.text, paragraph.bidi, paint));
+    }
+    setTimePerChar(state, paragraph.text.size());
+}
+
+// Runs f on the paragraph of the script once the caches are filled by a first run.
+template <typename F>
+void runWarm(benchmark::State& state, F f) {
+    const Script script = static_cast<Script>(state.range(0));
+    const Paragraph& paragraph = getParagraph(script);
+    const MinikinPaint paint = getPaint(script);
+    Layout::purgeCaches();
+    f(paragraph.text, paragraph.bidi, paint);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(f(paragraph.text, paragraph.bidi, paint));
+    }
+    setTimePerChar(state, paragraph.text.size());
+}
+
+// Runs f on the paragraph of the script preceded by a word never seen before, so that every
+// iteration has a single cache miss.
+template <typename F>
+void runMixed(benchmark::State& state, F f) {
+    const Script script = static_cast<Script>(state.range(0));
+    const Paragraph& paragraph = getParagraph(script);
+    const MinikinPaint paint = getPaint(script);
+    Layout::purgeCaches();
+    std::vector<uint16_t> text = paragraph.text;
+    f(text, paragraph.bidi, paint);
+    uint32_t counter = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        const std::vector<uint16_t> word = utf8ToUtf16(std::to_string(counter++) + " ");
+        text = word;
+        text.insert(text.end(), paragraph.text.begin(), paragraph.text.end());
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(f(text, paragraph.bidi, paint));
+    }
+    setTimePerChar(state, text.size());
+    Layout::purgeCaches();
+}
+
+}  // namespace
+
+// The Layout constructor, which shapes every word on a cache miss.
+static void BM_Layout_cold(benchmark::State& state) {
+    runCold(state, layoutText);
+}
+
+static void BM_Layout_warm(benchmark::State& state) {
+    runWarm(state, layoutText);
+}
+
+static void BM_Layout_mixed(benchmark::State& state) {
+    runMixed(state, layoutText);
+}
+
+BENCHMARK(BM_Layout_cold)->Apply(scriptArgs);
+BENCHMARK(BM_Layout_warm)->Apply(scriptArgs);
+BENCHMARK(BM_Layout_mixed)->Apply(scriptArgs);
+
+// Layout::measureText, which only needs the advances.
+static void BM_Layout_measureText_cold(benchmark::State& state) {
+    runCold(state, measureText);
+}
+
+static void BM_Layout_measureText_warm(benchmark::State& state) {
+    runWarm(state, measureText);
+}
+
+static void BM_Layout_measureText_mixed(benchmark::State& state) {
+    runMixed(state, measureText);
+}
+
+BENCHMARK(BM_Layout_measureText_cold)->Apply(scriptArgs);
+BENCHMARK(BM_Layout_measureText_warm)->Apply(scriptArgs);
+BENCHMARK(BM_Layout_measureText_mixed)->Apply(scriptArgs);
+
+// getBounds, which is served by BoundsCache once warm.
+static void BM_BoundsCache_getBounds_cold(benchmark::State& state) {
+    runCold(state, boundsOfText);
+}
+
+static void BM_BoundsCache_getBounds_warm(benchmark::State& state) {
+    runWarm(state, boundsOfText);
+}
+
+BENCHMARK(BM_BoundsCache_getBounds_cold)->Apply(scriptArgs);
+BENCHMARK(BM_BoundsCache_getBounds_warm)->Apply(scriptArgs);
+
+// The shaping of the whole paragraph as a single LayoutPiece, without any cache.
+static void BM_LayoutPiece_shape(benchmark::State& state) {
+    const Script script = static_cast<Script>(state.range(0));
+    const Paragraph& paragraph = getParagraph(script);
+    const MinikinPaint paint = getPaint(script);
+    const std::vector<uint16_t>& text = paragraph.text;
+    for (auto _ : state) {
+        LayoutPiece piece(text, Range(0, text.size()), paragraph.bidi == Bidi::RTL, paint,
+                          StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+        benchmark::DoNotOptimize(piece.advance());
+    }
+    setTimePerChar(state, text.size());
+}
+
+BENCHMARK(BM_LayoutPiece_shape)->Apply(scriptArgs);
+
+// MeasuredText::buildLayout of the whole paragraph from the pieces kept by the measurement.
+static void BM_MeasuredText_buildLayout(benchmark::State& state) {
+    const Script script = static_cast<Script>(state.range(0));
+    const Paragraph& paragraph = getParagraph(script);
+    const MinikinPaint paint = getPaint(script);
+    const std::vector<uint16_t>& text = paragraph.text;
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), MinikinPaint(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, paragraph.bidi == Bidi::RTL);
+    std::unique_ptr<MeasuredText> measured =
+            builder.build(text, false /* hyphenation */, true /* compute full layout */,
+                          false /* ignore kerning */, nullptr /* no hint */);
+    const Range range(0, text.size());
+    for (auto _ : state) {
+        Layout layout = measured->buildLayout(text, range, range, paint, StartHyphenEdit::NO_EDIT,
+                                              EndHyphenEdit::NO_EDIT);
+        benchmark::DoNotOptimize(layout.getAdvance());
+    }
+    setTimePerChar(state, text.size());
+}
+
+BENCHMARK(BM_MeasuredText_buildLayout)->Apply(scriptArgs);
+
+}  // namespace minikin
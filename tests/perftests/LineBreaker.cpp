@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The measurement and the line breaking of English paragraphs of 10 to 10k words, taken in turn
+// from tests/data/hyphenation-en.txt and laid out with Ascii.ttf. Besides the time, each benchmark
+// reports the time per character in the "time/char" counter.
+//
+// The hyphenation patterns are read from /system/usr/hyphen-data/, or from the directory given in
+// the MINIKIN_HYPHEN_DATA_DIR environment variable, e.g. when running on host. The benchmarks with
+// hyphenation are skipped if the patterns are not found.
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/Hyphenator.h"
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "HyphenatorMap.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+// A letter of Ascii.ttf is 10px wide at this size, so a line holds about 100 letters.
+constexpr float kTextSize = 10.0f;
+constexpr float kLineWidth = 1000.0f;
+
+class ConstantLineWidth : public LineWidth {
+public:
+    ConstantLineWidth(float width) : mWidth(width) {}
+    virtual ~ConstantLineWidth() {}
+
+    float getAt(size_t) const override { return mWidth; }
+    float getMin() const override { return mWidth; }
+
+private:
+    float mWidth;
+};
+
+std::string getHyphenDataDir() {
+    const char* dir = getenv("MINIKIN_HYPHEN_DATA_DIR");
+    if (dir == nullptr) {
+        return "/system/usr/hyphen-data/";
+    }
+    return std::string(dir) + "/";
+}
+
+// Registers the en-US hyphenator once. Returns false if the patterns are not available.
+bool loadEnglishHyphenator() {
+    static const bool loaded = [] {
+        const std::string path = getHyphenDataDir() + "hyph-en-us.hyb";
+        if (access(path.c_str(), R_OK) != 0) {
+            return false;
+        }
+        // The hyphenator refers to the pattern data, which is kept for the whole run.
+        static const std::vector<uint8_t> patternData = readWholeFile(path);
+        HyphenatorMap::add("en-US", Hyphenator::loadBinary(patternData.data(), 2 /* min prefix */,
+                                                           3 /* min suffix */, "en-US"));
+        return true;
+    }();
+    return loaded;
+}
+
+// A single paragraph of the given number of words of the English corpus, repeated as needed.
+std::vector<uint16_t> buildParagraph(size_t wordCount) {
+    static const std::vector<std::string> corpusWords = [] {
+        std::vector<std::string> words;
+        for (const std::string& line : readLines(getTestDataDir() + "hyphenation-en.txt")) {
+            std::istringstream stream(line);
+            std::string word;
+            while (stream >> word) {
+                words.push_back(word);
+            }
+        }
+        return words;
+    }();
+    std::string text;
+    for (size_t i = 0; i < wordCount; ++i) {
+        if (i != 0) {
+            text += ' ';
+        }
+        text += corpusWords[i % corpusWords.size()];
+    }
+    return utf8ToUtf16(text);
+}
+
+std::unique_ptr<MeasuredText> measureParagraph(const std::vector<uint16_t>& text,
+                                               bool computeHyphenation) {
+    static const std::shared_ptr<FontCollection> font = buildFontCollection("Ascii.ttf");
+    MinikinPaint paint(font);
+    paint.size = kTextSize;
+    paint.localeListId = registerLocaleList("en-US");
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, computeHyphenation, false /* compute full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+void setTimePerChar(benchmark::State& state, size_t charCount) {
+    state.counters["time/char"] = benchmark::Counter(
+            static_cast<double>(charCount),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+void wordCountArgs(benchmark::internal::Benchmark* b) {
+    b->ArgName("words");
+    for (int words : {10, 100, 1000, 10000}) {
+        b->Arg(words);
+    }
+}
+
+// The arguments are the break strategy, whether the text is hyphenated, whether it is justified
+// and the number of words.
+void lineBreakArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"strategy", "hyphen", "justified", "words"});
+    for (int strategy : {(int)BreakStrategy::Greedy, (int)BreakStrategy::HighQuality,
+                         (int)BreakStrategy::Balanced}) {
+        for (int hyphen : {0, 1}) {
+            for (int justified : {0, 1}) {
+                for (int words : {10, 100, 1000, 10000}) {
+                    b->Args({strategy, hyphen, justified, words});
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+// MeasuredTextBuilder::build of the paragraph, with and without the hyphenation.
+static void BM_LineBreaker_measure(benchmark::State& state, bool hyphenate) {
+    if (hyphenate && !loadEnglishHyphenator()) {
+        state.SkipWithError("Hyphenation patterns not found");
+        return;
+    }
+    const std::vector<uint16_t> text = buildParagraph(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(measureParagraph(text, hyphenate));
+    }
+    setTimePerChar(state, text.size());
+}
+
+BENCHMARK_CAPTURE(BM_LineBreaker_measure, noHyphen, false)->Apply(wordCountArgs);
+BENCHMARK_CAPTURE(BM_LineBreaker_measure, hyphen, true)->Apply(wordCountArgs);
+
+// breakIntoLines of an already measured paragraph.
+static void BM_LineBreaker_breakIntoLines(benchmark::State& state) {
+    const BreakStrategy strategy = static_cast<BreakStrategy>(state.range(0));
+    const bool hyphenate = state.range(1) != 0;
+    const bool justified = state.range(2) != 0;
+    if (hyphenate && !loadEnglishHyphenator()) {
+        state.SkipWithError("Hyphenation patterns not found");
+        return;
+    }
+    const std::vector<uint16_t> text = buildParagraph(state.range(3));
+    std::unique_ptr<MeasuredText> measured = measureParagraph(text, hyphenate);
+
+    const HyphenationFrequency frequency =
+            hyphenate ? HyphenationFrequency::Normal : HyphenationFrequency::None;
+    const ConstantLineWidth lineWidth(kLineWidth);
+    const TabStops tabStops(nullptr, 0, kTextSize * 4);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(breakIntoLines(text, strategy, frequency, justified, *measured,
+                                                lineWidth, tabStops));
+    }
+    setTimePerChar(state, text.size());
+}
+
+BENCHMARK(BM_LineBreaker_breakIntoLines)->Apply(lineBreakArgs);
+
+}  // namespace minikin
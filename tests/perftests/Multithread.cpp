@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The throughput of the layout, the measurement and the line breaking of English paragraphs run
+// by 1 to 8 threads at once, either on the same words in every thread ("shared") or on words
+// which differ between the threads ("disjoint"). The "items_per_second" is the number of the
+// paragraphs processed per second by all the threads, and the "<lock> wait us" counters are the
+// time spent waiting for the locks of the caches during the run, summed over the threads.
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/BoundsCache.h"
+#include "minikin/CacheStats.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "LocaleListCache.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+#include "WordBreaker.h"
+
+namespace minikin {
+
+namespace {
+
+constexpr float kTextSize = 10.0f;
+constexpr float kLineWidth = 1000.0f;
+constexpr size_t kWordCount = 100;
+constexpr int kMaxThreads = 8;
+
+class ConstantLineWidth : public LineWidth {
+public:
+    ConstantLineWidth(float width) : mWidth(width) {}
+    virtual ~ConstantLineWidth() {}
+
+    float getAt(size_t) const override { return mWidth; }
+    float getMin() const override { return mWidth; }
+
+private:
+    float mWidth;
+};
+
+// The paragraph of the thread. The words of a disjoint paragraph end with a letter of the thread.
+std::vector<uint16_t> buildParagraph(int threadIndex, bool disjoint) {
+    static const std::vector<std::string> corpusWords = [] {
+        std::vector<std::string> words;
+        for (const std::string& line : readLines(getTestDataDir() + "hyphenation-en.txt")) {
+            std::istringstream stream(line);
+            std::string word;
+            while (stream >> word) {
+                words.push_back(word);
+            }
+        }
+        return words;
+    }();
+    std::string text;
+    for (size_t i = 0; i < kWordCount; ++i) {
+        if (i != 0) {
+            text += ' ';
+        }
+        text += corpusWords[i % corpusWords.size()];
+        if (disjoint) {
+            text += static_cast<char>('a' + threadIndex);
+        }
+    }
+    return utf8ToUtf16(text);
+}
+
+MinikinPaint getPaint() {
+    static const std::shared_ptr<FontCollection> font = buildFontCollection("Ascii.ttf");
+    MinikinPaint paint(font);
+    paint.size = kTextSize;
+    paint.localeListId = registerLocaleList("en-US");
+    return paint;
+}
+
+std::unique_ptr<MeasuredText> measureParagraph(const std::vector<uint16_t>& text) {
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), getPaint(), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, false /* hyphenation */, false /* compute full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+// The wait times of the locks since the construction.
+class LockWaits {
+public:
+    LockWaits() : mStart(now()) {}
+
+    // Reports the waits as counters averaged over the threads. Every thread sees the waits of all
+    // of them, so the average is the total of the run.
+    void report(benchmark::State& state) const {
+        const std::vector<uint64_t> end = now();
+        static const char* kNames[] = {"LayoutCache wait us", "BoundsCache wait us",
+                                       "LocaleListCache wait us", "ICULineBreakerPool wait us"};
+        for (size_t i = 0; i < end.size(); ++i) {
+            state.counters[kNames[i]] =
+                    benchmark::Counter((end[i] - mStart[i]) / 1e3, benchmark::Counter::kAvgThreads);
+        }
+    }
+
+private:
+    static std::vector<uint64_t> now() {
+        return {LayoutCache::getInstance().getStats().getLockStats().getWaitNanos(),
+                BoundsCache::getInstance().getStats().getLockStats().getWaitNanos(),
+                LocaleListCache::getLockStats().getWaitNanos(),
+                ICULineBreakerPoolImpl::getInstance().getLockStats().getWaitNanos()};
+    }
+
+    const std::vector<uint64_t> mStart;
+};
+
+}  // namespace
+
+// The Layout of the paragraph, which looks up every word in LayoutCache.
+static void BM_Multithread_layout(benchmark::State& state, bool disjoint) {
+    const std::vector<uint16_t> text = buildParagraph(state.thread_index(), disjoint);
+    const MinikinPaint paint = getPaint();
+    const LockWaits waits;
+    for (auto _ : state) {
+        Layout layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                      EndHyphenEdit::NO_EDIT);
+        benchmark::DoNotOptimize(layout.getAdvance());
+    }
+    state.SetItemsProcessed(state.iterations());
+    waits.report(state);
+}
+
+BENCHMARK_CAPTURE(BM_Multithread_layout, shared, false)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Multithread_layout, disjoint, true)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseRealTime();
+
+// MeasuredTextBuilder::build of the paragraph.
+static void BM_Multithread_measure(benchmark::State& state, bool disjoint) {
+    const std::vector<uint16_t> text = buildParagraph(state.thread_index(), disjoint);
+    const LockWaits waits;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(measureParagraph(text));
+    }
+    state.SetItemsProcessed(state.iterations());
+    waits.report(state);
+}
+
+BENCHMARK_CAPTURE(BM_Multithread_measure, shared, false)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Multithread_measure, disjoint, true)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseRealTime();
+
+// breakIntoLines of the measured paragraph, which acquires the ICU line breakers from the pool.
+static void BM_Multithread_breakIntoLines(benchmark::State& state, bool disjoint) {
+    const std::vector<uint16_t> text = buildParagraph(state.thread_index(), disjoint);
+    std::unique_ptr<MeasuredText> measured = measureParagraph(text);
+    const ConstantLineWidth lineWidth(kLineWidth);
+    const TabStops tabStops(nullptr, 0, kTextSize * 4);
+    const LockWaits waits;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(breakIntoLines(text, BreakStrategy::HighQuality,
+                                                HyphenationFrequency::None, false /* justified */,
+                                                *measured, lineWidth, tabStops));
+    }
+    state.SetItemsProcessed(state.iterations());
+    waits.report(state);
+}
+
+BENCHMARK_CAPTURE(BM_Multithread_breakIntoLines, shared, false)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Multithread_breakIntoLines, disjoint, true)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseRealTime();
+
+}  // namespace minikin
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The optimal line breaking of a long paragraph made of the lines of tests/data/hyphenation-en.txt,
+// at the line width of a phone, a tablet and a desktop window.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FileUtils.h"
+#include "FontTestUtils.h"
+#include "OptimalLineBreaker.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+class ConstantLineWidth : public LineWidth {
+public:
+    ConstantLineWidth(float width) : mWidth(width) {}
+    virtual ~ConstantLineWidth() {}
+
+    float getAt(size_t) const override { return mWidth; }
+    float getMin() const override { return mWidth; }
+
+private:
+    float mWidth;
+};
+
+// The English corpus repeated a few times, as a single paragraph of about 1200 words.
+std::vector<uint16_t> buildLongText() {
+    std::string text;
+    for (int i = 0; i < 4; ++i) {
+        for (const std::string& line : readLines(getTestDataDir() + "hyphenation-en.txt")) {
+            text += line + " ";
+        }
+    }
+    return utf8ToUtf16(text);
+}
+
+}  // namespace
+
+std::unique_ptr<MeasuredText> measureText(const std::vector<uint16_t>& text) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    paint.localeListId = registerLocaleList("en-US");
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, false /* compute hyphenation */, false /* compute full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+// The arguments are the line width and whether the text is justified. A letter of Ascii.ttf is
+// 10px wide, so the lines hold about 40, 100 and 250 letters.
+static void BM_OptimalLineBreaker_longParagraph(benchmark::State& state) {
+    const std::vector<uint16_t> text = buildLongText();
+    std::unique_ptr<MeasuredText> measured = measureText(text);
+
+    const ConstantLineWidth lineWidth(state.range(0));
+    const bool justified = state.range(1) != 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(breakLineOptimal(text, *measured, lineWidth,
+                                                  BreakStrategy::HighQuality,
+                                                  HyphenationFrequency::None, justified));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() * sizeof(uint16_t));
+}
+
+BENCHMARK(BM_OptimalLineBreaker_longParagraph)
+        ->Args({400, 0})
+        ->Args({400, 1})
+        ->Args({1000, 0})
+        ->Args({1000, 1})
+        ->Args({2500, 0})
+        ->Args({2500, 1});
+
+// Breaks a newly measured paragraph at several widths, as auto-sized text does. The argument is
+// whether the text keeps its break candidates, see MeasuredText::setBreakCandidatesCachingEnabled.
+static void BM_OptimalLineBreaker_severalWidths(benchmark::State& state) {
+    const std::vector<uint16_t> text = buildLongText();
+    MeasuredText::setBreakCandidatesCachingEnabled(state.range(0) != 0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<MeasuredText> measured = measureText(text);
+        state.ResumeTiming();
+        for (float width : {400.0f, 600.0f, 800.0f, 1000.0f, 1200.0f}) {
+            benchmark::DoNotOptimize(breakLineOptimal(text, *measured, ConstantLineWidth(width),
+                                                      BreakStrategy::HighQuality,
+                                                      HyphenationFrequency::None, false));
+        }
+    }
+    MeasuredText::setBreakCandidatesCachingEnabled(false);
+}
+
+BENCHMARK(BM_OptimalLineBreaker_severalWidths)->Arg(0)->Arg(1);
+
+}  // namespace minikin
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Tab stop lookups, alone and while greedily breaking tab-dense text such as source code.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/LineBreakStyle.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FontTestUtils.h"
+#include "GreedyLineBreaker.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+class ConstantLineWidth : public LineWidth {
+public:
+    ConstantLineWidth(float width) : mWidth(width) {}
+    virtual ~ConstantLineWidth() {}
+
+    float getAt(size_t) const override { return mWidth; }
+    float getMin() const override { return mWidth; }
+
+private:
+    float mWidth;
+};
+
+// Tab stops every 40px, as a column layout would set them.
+std::vector<float> buildStops(size_t count) {
+    std::vector<float> stops(count);
+    for (size_t i = 0; i < count; ++i) {
+        stops[i] = (i + 1) * 40.0f;
+    }
+    return stops;
+}
+
+std::unique_ptr<MeasuredText> measureTabText(const std::vector<uint16_t>& text) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    paint.localeListId = registerLocaleList("en-US");
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, false /* compute hyphenation */, false /* compute full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+}  // namespace
+
+// The argument is the number of tab stops. The queried widths sweep all of them.
+static void BM_TabStops_nextTab(benchmark::State& state) {
+    const std::vector<float> stops = buildStops(state.range(0));
+    const TabStops tabStops(stops.data(), stops.size(), 40.0f);
+    const float maxWidth = (stops.size() + 1) * 40.0f;
+    for (auto _ : state) {
+        for (float width = 0; width < maxWidth; width += 7.0f) {
+            benchmark::DoNotOptimize(tabStops.nextTab(width));
+        }
+    }
+}
+
+BENCHMARK(BM_TabStops_nextTab)->Arg(0)->Arg(8)->Arg(64)->Arg(512);
+
+// The argument is the number of tab stops. Every line of the text is indented and aligned with
+// tabs, so a tab stop is looked up every few characters.
+static void BM_TabStops_greedyLineBreak(benchmark::State& state) {
+    std::string code;
+    for (int i = 0; i < 200; ++i) {
+        code += "\t\tint\tvalue\t=\t0;\t// comment\n";
+    }
+    const std::vector<uint16_t> text = utf8ToUtf16(code);
+    std::unique_ptr<MeasuredText> measured = measureTabText(text);
+
+    const std::vector<float> stops = buildStops(state.range(0));
+    const TabStops tabStops(stops.data(), stops.size(), 40.0f);
+    const ConstantLineWidth lineWidth(400);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(breakLineGreedy(text, *measured, lineWidth, tabStops,
+                                                 false /* enable hyphenation */));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() * sizeof(uint16_t));
+}
+
+BENCHMARK(BM_TabStops_greedyLineBreak)->Arg(0)->Arg(8)->Arg(64);
+
+}  // namespace minikin
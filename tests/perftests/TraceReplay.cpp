@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a trace recorded with ApiTrace, which is read from the file given in the
+// MINIKIN_TRACE_FILE environment variable. The fonts are looked up by their file names in
+// /system/fonts/, or in the directory given in MINIKIN_TRACE_FONT_DIR. The calls of the
+// collections without any font found are skipped.
+//
+// Each iteration replays the whole trace in order from empty caches, as the app did after its
+// start. Besides the time, the 50th, 90th and 99th percentiles of the latency of each kind of call
+// are reported in microseconds.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "minikin/ApiTrace.h"
+#include "minikin/Font.h"
+#include "minikin/FontCollection.h"
+#include "minikin/FontFamily.h"
+#include "minikin/Layout.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FileUtils.h"
+#include "FreeTypeMinikinFontForTest.h"
+
+namespace minikin {
+
+namespace {
+
+constexpr size_t kCallTypeCount = 4;
+const char* kCallTypeNames[kCallTypeCount] = {"layout", "measureText", "build",
+                                              "breakIntoLines"};
+
+class RecordedLineWidth : public LineWidth {
+public:
+    RecordedLineWidth(const std::vector<float>& widths, float min) : mWidths(widths), mMin(min) {}
+    virtual ~RecordedLineWidth() {}
+
+    float getAt(size_t lineNo) const override {
+        return mWidths[std::min(lineNo, mWidths.size() - 1)];
+    }
+    float getMin() const override { return mMin; }
+
+private:
+    const std::vector<float>& mWidths;
+    float mMin;
+};
+
+std::string getFontDir() {
+    const char* dir = getenv("MINIKIN_TRACE_FONT_DIR");
+    if (dir == nullptr) {
+        return "/system/fonts/";
+    }
+    return std::string(dir) + "/";
+}
+
+// Returns nullptr if none of the fonts of the collection is found.
+std::shared_ptr<FontCollection> buildCollection(
+        const std::vector<ApiTrace::FamilyEntry>& families) {
+    const std::string fontDir = getFontDir();
+    std::vector<std::shared_ptr<FontFamily>> built;
+    for (const ApiTrace::FamilyEntry& family : families) {
+        std::vector<std::shared_ptr<Font>> fonts;
+        for (const ApiTrace::FontEntry& entry : family.fonts) {
+            const std::string path = fontDir + entry.fileName;
+            if (access(path.c_str(), R_OK) != 0) {
+                continue;
+            }
+            auto typeface = std::make_shared<FreeTypeMinikinFontForTest>(path, entry.index);
+            std::shared_ptr<Font> font = Font::Builder(typeface).setStyle(entry.style).build();
+            if (!entry.axes.empty()) {
+                std::shared_ptr<Font> varied = font->createFontWithVariation(entry.axes);
+                if (varied) {
+                    font = std::move(varied);
+                }
+            }
+            fonts.push_back(std::move(font));
+        }
+        if (!fonts.empty()) {
+            built.push_back(FontFamily::create(registerLocaleList(family.locales), family.variant,
+                                               std::move(fonts), family.isCustomFallback,
+                                               false /* isDefaultFallback */));
+        }
+    }
+    if (built.empty()) {
+        return nullptr;
+    }
+    return FontCollection::create(built);
+}
+
+// Returns false if the collection of the paint was not built. The index of the collection is
+// checked by ApiTrace::readFrom().
+bool makePaint(const ApiTrace::PaintEntry& entry,
+               const std::vector<std::shared_ptr<FontCollection>>& collections,
+               MinikinPaint* out) {
+    if (!collections[entry.collection]) {
+        return false;
+    }
+    out->font = collections[entry.collection];
+    out->size = entry.size;
+    out->scaleX = entry.scaleX;
+    out->skewX = entry.skewX;
+    out->letterSpacing = entry.letterSpacing;
+    out->wordSpacing = entry.wordSpacing;
+    out->fontFlags = entry.fontFlags;
+    out->localeListId = registerLocaleList(entry.locales);
+    out->fontStyle = entry.fontStyle;
+    out->familyVariant = entry.familyVariant;
+    out->fontFeatureSettings = entry.fontFeatureSettings;
+    return true;
+}
+
+// The arguments of a call, resolved once before the replay.
+struct ReplayCall {
+    const ApiTrace::Call* call;
+    MinikinPaint paint;
+    // The paints of the runs of a Build call, copied to a builder at each replay.
+    std::vector<MinikinPaint> runPaints;
+};
+
+// Returns false if the call can't be replayed.
+bool resolveCall(const ApiTrace::Call& call,
+                 const std::vector<std::shared_ptr<FontCollection>>& collections,
+                 const std::vector<bool>& replayable, ReplayCall* out) {
+    out->call = &call;
+    switch (call.type) {
+        case ApiTrace::CallType::Layout:
+        case ApiTrace::CallType::MeasureText:
+            return makePaint(call.paint, collections, &out->paint);
+        case ApiTrace::CallType::Build:
+            for (const ApiTrace::RunEntry& run : call.runs) {
+                out->runPaints.emplace_back(nullptr);
+                if (run.isStyleRun && !makePaint(run.paint, collections, &out->runPaints.back())) {
+                    return false;
+                }
+            }
+            return true;
+        case ApiTrace::CallType::BreakIntoLines:
+            return replayable[call.measuredText];
+    }
+    return false;
+}
+
+// Replays the index-th call of the trace. The measured texts of the Build calls are kept at their
+// indices for the BreakIntoLines calls.
+void replay(const ReplayCall& replayCall, const ApiTrace::Trace& trace, size_t index,
+            std::vector<std::unique_ptr<MeasuredText>>* measuredTexts) {
+    const ApiTrace::Call& call = *replayCall.call;
+    switch (call.type) {
+        case ApiTrace::CallType::Layout: {
+            Layout layout(call.text, call.range, call.bidi, replayCall.paint, call.startHyphen,
+                          call.endHyphen);
+            benchmark::DoNotOptimize(layout.getAdvance());
+            break;
+        }
+        case ApiTrace::CallType::MeasureText:
+            benchmark::DoNotOptimize(Layout::measureText(call.text, call.range, call.bidi,
+                                                         replayCall.paint, call.startHyphen,
+                                                         call.endHyphen, nullptr));
+            break;
+        case ApiTrace::CallType::Build: {
+            MeasuredTextBuilder builder;
+            for (size_t i = 0; i < call.runs.size(); ++i) {
+                const ApiTrace::RunEntry& run = call.runs[i];
+                if (run.isStyleRun) {
+                    builder.addStyleRun(run.range.getStart(), run.range.getEnd(),
+                                        replayCall.runPaints[i], run.lineBreakStyle,
+                                        run.lineBreakWordStyle, run.isRtl);
+                } else {
+                    builder.addReplacementRun(run.range.getStart(), run.range.getEnd(), run.width,
+                                              registerLocaleList(run.locales));
+                }
+            }
+            (*measuredTexts)[index] =
+                    builder.build(call.text, call.computeHyphenation, call.computeLayout,
+                                  call.ignoreHyphenKerning, nullptr /* no hint */);
+            break;
+        }
+        case ApiTrace::CallType::BreakIntoLines: {
+            const RecordedLineWidth lineWidth(call.lineWidths, call.minLineWidth);
+            const TabStops tabStops(call.tabStops.data(), call.tabStops.size(), call.tabWidth);
+            const LineBreakResult result =
+                    breakIntoLines(trace.calls[call.measuredText].text, call.strategy,
+                                   call.frequency, call.justified,
+                                   *(*measuredTexts)[call.measuredText], lineWidth, tabStops,
+                                   call.maxLines);
+            benchmark::DoNotOptimize(result.breakPoints.size());
+            break;
+        }
+    }
+}
+
+double getPercentile(std::vector<double>* latencies, double percentile) {
+    if (latencies->empty()) {
+        return 0.0;
+    }
+    const size_t index =
+            std::min(latencies->size() - 1, static_cast<size_t>(latencies->size() * percentile));
+    std::nth_element(latencies->begin(), latencies->begin() + index, latencies->end());
+    return (*latencies)[index];
+}
+
+}  // namespace
+
+static void BM_TraceReplay(benchmark::State& state) {
+    const char* tracePath = getenv("MINIKIN_TRACE_FILE");
+    if (tracePath == nullptr || access(tracePath, R_OK) != 0) {
+        state.SkipWithError("Trace not found");
+        return;
+    }
+    const std::vector<uint8_t> buffer = readWholeFile(tracePath);
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    ApiTrace::Trace trace;
+    if (!ApiTrace::readFrom(&reader, &trace)) {
+        state.SkipWithError("Unsupported or malformed trace");
+        return;
+    }
+
+    std::vector<std::shared_ptr<FontCollection>> collections;
+    for (const std::vector<ApiTrace::FamilyEntry>& families : trace.collections) {
+        collections.push_back(buildCollection(families));
+    }
+    std::vector<ReplayCall> calls;
+    std::vector<bool> replayable(trace.calls.size(), false);
+    std::vector<size_t> callIndices;
+    for (size_t i = 0; i < trace.calls.size(); ++i) {
+        ReplayCall call = {nullptr, MinikinPaint(nullptr), {}};
+        if (resolveCall(trace.calls[i], collections, replayable, &call)) {
+            replayable[i] = true;
+            calls.push_back(std::move(call));
+            callIndices.push_back(i);
+        }
+    }
+
+    std::vector<double> latencies[kCallTypeCount];
+    std::vector<std::unique_ptr<MeasuredText>> measuredTexts(trace.calls.size());
+    for (auto _ : state) {
+        state.PauseTiming();
+        Layout::purgeCaches();
+        state.ResumeTiming();
+        for (size_t i = 0; i < calls.size(); ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            replay(calls[i], trace, callIndices[i], &measuredTexts);
+            const std::chrono::duration<double, std::micro> elapsed =
+                    std::chrono::steady_clock::now() - start;
+            latencies[static_cast<size_t>(calls[i].call->type)].push_back(elapsed.count());
+        }
+    }
+
+    state.counters["replayed"] = calls.size();
+    state.counters["skipped"] = trace.calls.size() - calls.size();
+    for (size_t type = 0; type < kCallTypeCount; ++type) {
+        if (latencies[type].empty()) {
+            continue;
+        }
+        const std::string name = kCallTypeNames[type];
+        state.counters[name + "_p50_us"] = getPercentile(&latencies[type], 0.5);
+        state.counters[name + "_p90_us"] = getPercentile(&latencies[type], 0.9);
+        state.counters[name + "_p99_us"] = getPercentile(&latencies[type], 0.99);
+    }
+}
+BENCHMARK(BM_TraceReplay)->Unit(benchmark::kMillisecond);
+
+}  // namespace minikin
@@ -15,9 +15,18 @@
  */
 #include "WordBreaker.h"
 
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 
+#include "minikin/LineBreakStyle.h"
+
+#include "FileUtils.h"
 #include "Locale.h"
+#include "PathUtils.h"
 #include "UnicodeUtils.h"
 
 namespace minikin {
@@ -38,6 +47,113 @@ static void BM_WordBreaker_English(benchmark::State& state) {
 }
 BENCHMARK(BM_WordBreaker_English);
 
-// TODO: Add more tests for other languages.
+// The paragraphs of tests/data/breaking-*.txt, one per line. Thai, Japanese and Chinese are
+// segmented with the ICU dictionaries, the other ones only with the rules.
+struct BreakCorpus {
+    const char* locale;
+    const char* file;
+};
+
+static const BreakCorpus kThai = {"th-TH", "breaking-th.txt"};
+static const BreakCorpus kJapanese = {"ja-JP", "breaking-ja.txt"};
+static const BreakCorpus kChinese = {"zh-Hans-CN", "breaking-zh.txt"};
+static const BreakCorpus kArabic = {"ar-EG", "breaking-ar.txt"};
+static const BreakCorpus kHindi = {"hi-IN", "breaking-hi.txt"};
+static const BreakCorpus kEnglishWithUrls = {"en-US", "breaking-en-url.txt"};
+
+static std::vector<std::vector<uint16_t>> loadParagraphs(const BreakCorpus& corpus) {
+    const std::string path = getTestDataDir() + corpus.file;
+    std::vector<std::vector<uint16_t>> paragraphs;
+    if (access(path.c_str(), R_OK) == 0) {
+        for (const std::string& line : readLines(path)) {
+            paragraphs.push_back(utf8ToUtf16(line));
+        }
+    }
+    return paragraphs;
+}
+
+// Returns the number of breaks found.
+static size_t breakParagraphs(WordBreaker* wb, const std::vector<std::vector<uint16_t>>& paragraphs,
+                              const Locale& locale) {
+    size_t breakCount = 0;
+    for (const std::vector<uint16_t>& paragraph : paragraphs) {
+        wb->setText(paragraph.data(), paragraph.size());
+        wb->followingWithLocale(locale, LineBreakStyle::None, LineBreakWordStyle::None, 0);
+        for (breakCount++; wb->next() != -1; breakCount++) {
+        }
+        // Gives the ICU breaker back to the pool.
+        wb->finish();
+    }
+    return breakCount;
+}
+
+// Besides the time, the corpus benchmarks report the breaks found per second and the ICU breakers
+// the pool had to clone or create per iteration, i.e. the pool misses.
+static void setCounters(benchmark::State& state, size_t breakCount, uint64_t missCountBefore) {
+    const uint64_t missCount = ICULineBreakerPoolImpl::getInstance().getMissCount();
+    state.counters["breaks"] = benchmark::Counter(static_cast<double>(breakCount),
+                                                  benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["icuCreations"] = benchmark::Counter(
+            static_cast<double>(missCount - missCountBefore), benchmark::Counter::kAvgIterations);
+}
+
+// Breaks the paragraphs of one language.
+static void BM_WordBreaker_Corpus(benchmark::State& state, const BreakCorpus* corpus) {
+    const std::vector<std::vector<uint16_t>> paragraphs = loadParagraphs(*corpus);
+    if (paragraphs.empty()) {
+        state.SkipWithError("Corpus not found");
+        return;
+    }
+    const Locale locale(corpus->locale);
+    WordBreaker wb;
+    // The first run creates the breaker, the iterations only measure the breaking.
+    const size_t breakCount = breakParagraphs(&wb, paragraphs, locale);
+    const uint64_t missCount = ICULineBreakerPoolImpl::getInstance().getMissCount();
+    for (auto _ : state) {
+        breakParagraphs(&wb, paragraphs, locale);
+    }
+    setCounters(state, breakCount, missCount);
+}
+
+BENCHMARK_CAPTURE(BM_WordBreaker_Corpus, th, &kThai);
+BENCHMARK_CAPTURE(BM_WordBreaker_Corpus, ja, &kJapanese);
+BENCHMARK_CAPTURE(BM_WordBreaker_Corpus, zh, &kChinese);
+BENCHMARK_CAPTURE(BM_WordBreaker_Corpus, ar, &kArabic);
+BENCHMARK_CAPTURE(BM_WordBreaker_Corpus, hi, &kHindi);
+BENCHMARK_CAPTURE(BM_WordBreaker_Corpus, enWithUrls, &kEnglishWithUrls);
+
+// Breaks the paragraphs of all the languages in turn, with the number of breakers each thread
+// keeps given as argument. Without the thread cache the pool can't keep a breaker of each locale,
+// so that some of them are cloned again at each iteration.
+static void BM_WordBreaker_Corpus_allLanguages(benchmark::State& state) {
+    const BreakCorpus* corpora[] = {&kThai,   &kJapanese, &kChinese,
+                                    &kArabic, &kHindi,    &kEnglishWithUrls};
+    std::vector<std::pair<Locale, std::vector<std::vector<uint16_t>>>> languages;
+    for (const BreakCorpus* corpus : corpora) {
+        languages.emplace_back(Locale(corpus->locale), loadParagraphs(*corpus));
+        if (languages.back().second.empty()) {
+            state.SkipWithError("Corpus not found");
+            return;
+        }
+    }
+    ICULineBreakerPoolImpl& pool = ICULineBreakerPoolImpl::getInstance();
+    pool.setThreadCacheSize(state.range(0));
+    WordBreaker wb;
+    size_t breakCount = 0;
+    for (const auto& [locale, paragraphs] : languages) {
+        breakCount += breakParagraphs(&wb, paragraphs, locale);
+    }
+    const uint64_t missCount = pool.getMissCount();
+    for (auto _ : state) {
+        for (const auto& [locale, paragraphs] : languages) {
+            breakParagraphs(&wb, paragraphs, locale);
+        }
+    }
+    setCounters(state, breakCount, missCount);
+    pool.setThreadCacheSize(4);  // Back to the default.
+}
+BENCHMARK(BM_WordBreaker_Corpus_allLanguages)
+        ->Arg(0)   // Only the shared pool.
+        ->Arg(4);  // The default thread cache.
 
 }  // namespace minikin
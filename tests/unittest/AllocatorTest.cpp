@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/Allocator.h"
+
+#include <gtest/gtest.h>
+
+#include <new>
+
+#include "minikin/LayoutCache.h"
+#include "minikin/LayoutCore.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+// Counts the blocks and forwards to operator new.
+class CountingAllocator : public Allocator {
+public:
+    void* allocate(size_t bytes) override {
+        mAllocations++;
+        return ::operator new(bytes);
+    }
+
+    void deallocate(void* ptr) override {
+        mDeallocations++;
+        ::operator delete(ptr);
+    }
+
+    int mAllocations = 0;
+    int mDeallocations = 0;
+};
+
+class AllocatorTest : public testing::Test {
+protected:
+    void SetUp() override { Allocator::set(&mAllocator); }
+    void TearDown() override { Allocator::set(nullptr); }
+
+    CountingAllocator mAllocator;
+};
+
+}  // namespace
+
+TEST_F(AllocatorTest, layoutPieceTest) {
+    auto text = utf8ToUtf16("android");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    {
+        LayoutPiece piece(text, Range(0, text.size()), false /* LTR */, paint,
+                          StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+        // The glyphs, and the text copied by the ItemizeCache.
+        EXPECT_EQ(2, mAllocator.mAllocations);
+        LayoutPiece copy(piece);
+        EXPECT_EQ(3, mAllocator.mAllocations);
+    }
+    // The text of the ItemizeCache is still cached.
+    EXPECT_EQ(2, mAllocator.mDeallocations);
+}
+
+TEST_F(AllocatorTest, layoutCacheKeyTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    auto shortText = utf8ToUtf16("android");
+    LayoutCacheKey shortKey(shortText, Range(0, shortText.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+    shortKey.copyText();
+    // Short texts are copied into the key.
+    EXPECT_EQ(0, mAllocator.mAllocations);
+    shortKey.freeText();
+
+    auto longText = utf8ToUtf16("android android android android");
+    LayoutCacheKey longKey(longText, Range(0, longText.size()), paint, false /* LTR */,
+                           StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+    longKey.copyText();
+    EXPECT_EQ(1, mAllocator.mAllocations);
+    longKey.freeText();
+    EXPECT_EQ(1, mAllocator.mDeallocations);
+}
+
+TEST_F(AllocatorTest, ownerTest) {
+    AllocatedBytes counted = allocateBytes(16);
+    EXPECT_EQ(1, mAllocator.mAllocations);
+    Allocator::set(nullptr);
+    // The block is freed by the allocator which allocated it, and the other way around.
+    counted.reset();
+    EXPECT_EQ(1, mAllocator.mDeallocations);
+
+    AllocatedBytes uncounted = allocateBytes(16);
+    Allocator::set(&mAllocator);
+    uncounted.reset();
+    EXPECT_EQ(1, mAllocator.mAllocations);
+    EXPECT_EQ(1, mAllocator.mDeallocations);
+}
+
+TEST(AllocatorDefaultTest, defaultTest) {
+    AllocatedBytes bytes = allocateBytes(16);
+    ASSERT_NE(nullptr, bytes.get());
+    bytes[15] = 1;
+    EXPECT_EQ(1, bytes[15]);
+}
+
+}  // namespace minikin
@@ -18,6 +18,11 @@
 
 #include <gtest/gtest.h>
 
+#include "minikin/MeasuredText.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
 namespace minikin {
 namespace android {
 
@@ -54,5 +59,65 @@ TEST(AndroidLineWidth, negativeWidthTest) {
     }
 }
 
+namespace {
+
+std::unique_ptr<MeasuredText> buildText(const std::vector<uint16_t>& text) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, false /* hyphenation */, false /* full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+}  // namespace
+
+TEST(StaticLayoutNative, computeBreaksSharedTest) {
+    const std::vector<uint16_t> text = utf8ToUtf16("This is an example text.");
+    const StaticLayoutNative layout(BreakStrategy::HighQuality, HyphenationFrequency::None,
+                                    false /* justified */, std::vector<float>());
+    const float tabStops[] = {40.0f};
+    auto computeBreaks = [&](const MeasuredText& mt, float width, float tabWidth) {
+        return layout.computeBreaksShared(text, mt, width, 1, width, 0, tabStops, 1, tabWidth);
+    };
+
+    MeasuredText::setLineBreakResultCachingEnabled(true);
+    std::unique_ptr<MeasuredText> cached = buildText(text);
+    MeasuredText::setLineBreakResultCachingEnabled(false);
+    ASSERT_NE(nullptr, cached->getLineBreakResultCache());
+    const uint32_t emptyMemoryUsage = cached->getMemoryUsage();
+    EXPECT_EQ(0u, cached->getLineBreakResultCache()->getMemoryUsage());
+
+    auto first = computeBreaks(*cached, 100, 20);
+    // The cached result is counted in the memory usage of the text.
+    const uint32_t resultMemoryUsage = cached->getLineBreakResultCache()->getMemoryUsage();
+    EXPECT_LE(sizeof(int) * first->breakPoints.size() + sizeof(float) * first->widths.size(),
+              resultMemoryUsage);
+    EXPECT_EQ(emptyMemoryUsage + resultMemoryUsage, cached->getMemoryUsage());
+    EXPECT_EQ(first, computeBreaks(*cached, 100, 20));
+    const LineBreakResult expected =
+            layout.computeBreaks(text, *cached, 100, 1, 100, 0, tabStops, 1, 20);
+    EXPECT_EQ(expected.breakPoints, first->breakPoints);
+    EXPECT_EQ(expected.widths, first->widths);
+
+    // The width and the tab stops are part of the key.
+    auto narrow = computeBreaks(*cached, 50, 20);
+    EXPECT_NE(first, narrow);
+    EXPECT_NE(first, computeBreaks(*cached, 100, 30));
+    EXPECT_EQ(narrow, computeBreaks(*cached, 50, 20));
+
+    // The least recently used result is dropped.
+    for (size_t i = 0; i < LineBreakResultCache::kMaxEntries; ++i) {
+        computeBreaks(*cached, 200 + i, 20);
+    }
+    EXPECT_NE(first, computeBreaks(*cached, 100, 20));
+
+    // Not cached by default.
+    std::unique_ptr<MeasuredText> uncached = buildText(text);
+    EXPECT_EQ(nullptr, uncached->getLineBreakResultCache());
+    EXPECT_NE(computeBreaks(*uncached, 100, 20), computeBreaks(*uncached, 100, 20));
+}
+
 }  // namespace android
 }  // namespace minikin
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/ApiTrace.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/Layout.h"
+#include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
+#include "minikin/MeasuredText.h"
+
+#include "FontTestUtils.h"
+#include "LineBreakerTestHelper.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+std::unique_ptr<MeasuredText> buildText(const std::vector<uint16_t>& text,
+                                        const MinikinPaint& paint) {
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, text.size(), paint, (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    return builder.build(text, true /* hyphenation */, false /* full layout */,
+                         false /* ignore kerning */, nullptr /* no hint */);
+}
+
+// Records the calls of the function and writes them.
+template <typename F>
+std::vector<uint8_t> recordBuffer(bool anonymize, F f) {
+    ApiTrace& trace = ApiTrace::getInstance();
+    trace.clear();
+    trace.setRecording(true, anonymize);
+    f();
+    trace.setRecording(false);
+    std::vector<uint8_t> buffer = BufferWriter::writeToVector(
+            [&trace](BufferWriter* writer) { trace.writeTo(writer); });
+    trace.clear();
+    return buffer;
+}
+
+// Records the calls of the function and reads them back.
+template <typename F>
+ApiTrace::Trace recordTrace(bool anonymize, F f) {
+    const std::vector<uint8_t> buffer = recordBuffer(anonymize, f);
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    ApiTrace::Trace out;
+    EXPECT_TRUE(ApiTrace::readFrom(&reader, &out));
+    return out;
+}
+
+}  // namespace
+
+TEST(ApiTraceTest, notRecordingByDefaultTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    ApiTrace& trace = ApiTrace::getInstance();
+    trace.clear();
+    EXPECT_FALSE(trace.isRecording());
+    const std::vector<uint16_t> text = utf8ToUtf16("android is fun");
+    Layout::measureText(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                        EndHyphenEdit::NO_EDIT, nullptr);
+    EXPECT_EQ(0u, trace.size());
+}
+
+TEST(ApiTraceTest, recordTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    paint.localeListId = registerLocaleList("en-US");
+    const std::vector<uint16_t> text = utf8ToUtf16("android is fun");
+    const line_breaker_test_helper::RectangleLineWidth lineWidth(50);
+    const TabStops tabStops(nullptr, 0, 10);
+    size_t lineCount = 0;
+
+    const ApiTrace::Trace trace = recordTrace(false /* anonymize */, [&] {
+        Layout(text, Range(0, 7), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+               EndHyphenEdit::INSERT_HYPHEN);
+        Layout::measureText(text, Range(0, text.size()), Bidi::RTL, paint,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, nullptr);
+        std::unique_ptr<MeasuredText> mt = buildText(text, paint);
+        lineCount = breakIntoLines(text, BreakStrategy::Greedy, HyphenationFrequency::Normal,
+                                   false /* justified */, *mt, lineWidth, tabStops)
+                            .breakPoints.size();
+    });
+
+    // The collection is written once.
+    ASSERT_EQ(1u, trace.collections.size());
+    ASSERT_EQ(1u, trace.collections[0].size());
+    ASSERT_EQ(1u, trace.collections[0][0].fonts.size());
+    EXPECT_EQ("Ascii.ttf", trace.collections[0][0].fonts[0].fileName);
+
+    ASSERT_EQ(4u, trace.calls.size());
+    const ApiTrace::Call& layout = trace.calls[0];
+    EXPECT_EQ(ApiTrace::CallType::Layout, layout.type);
+    EXPECT_EQ(text, layout.text);
+    EXPECT_EQ(Range(0, 7), layout.range);
+    EXPECT_EQ(Bidi::LTR, layout.bidi);
+    EXPECT_EQ(EndHyphenEdit::INSERT_HYPHEN, layout.endHyphen);
+    EXPECT_EQ(0u, layout.paint.collection);
+    EXPECT_EQ(10.0f, layout.paint.size);
+    EXPECT_EQ("en-US", layout.paint.locales);
+
+    const ApiTrace::Call& measure = trace.calls[1];
+    EXPECT_EQ(ApiTrace::CallType::MeasureText, measure.type);
+    EXPECT_EQ(Bidi::RTL, measure.bidi);
+
+    const ApiTrace::Call& build = trace.calls[2];
+    EXPECT_EQ(ApiTrace::CallType::Build, build.type);
+    EXPECT_EQ(text, build.text);
+    EXPECT_TRUE(build.computeHyphenation);
+    EXPECT_FALSE(build.computeLayout);
+    ASSERT_EQ(1u, build.runs.size());
+    EXPECT_TRUE(build.runs[0].isStyleRun);
+    EXPECT_EQ(Range(0, text.size()), build.runs[0].range);
+
+    const ApiTrace::Call& breaking = trace.calls[3];
+    EXPECT_EQ(ApiTrace::CallType::BreakIntoLines, breaking.type);
+    EXPECT_EQ(2u, breaking.measuredText);
+    EXPECT_EQ(BreakStrategy::Greedy, breaking.strategy);
+    EXPECT_EQ(HyphenationFrequency::Normal, breaking.frequency);
+    EXPECT_EQ(lineCount + 1, breaking.lineWidths.size());
+    EXPECT_EQ(50.0f, breaking.lineWidths[0]);
+    EXPECT_EQ(10.0f, breaking.tabWidth);
+}
+
+TEST(ApiTraceTest, textBuiltBeforeRecordingTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint16_t> text = utf8ToUtf16("android is fun");
+    std::unique_ptr<MeasuredText> mt = buildText(text, paint);
+    const line_breaker_test_helper::RectangleLineWidth lineWidth(50);
+    const TabStops tabStops(nullptr, 0, 10);
+
+    const ApiTrace::Trace trace = recordTrace(false /* anonymize */, [&] {
+        breakIntoLines(text, BreakStrategy::HighQuality, HyphenationFrequency::Normal,
+                       false /* justified */, *mt, lineWidth, tabStops);
+    });
+    // The measured text can't be replayed.
+    EXPECT_TRUE(trace.calls.empty());
+}
+
+TEST(ApiTraceTest, anonymizeTest) {
+    const std::vector<uint16_t> text = utf8ToUtf16("Hi, 42 مرحبا");
+    const std::vector<uint16_t> anonymized = ApiTrace::anonymize(text);
+    ASSERT_EQ(text.size(), anonymized.size());
+    // The letters of a script become the same letter.
+    EXPECT_EQ(anonymized[0], anonymized[1]);
+    EXPECT_NE(text[0], anonymized[0]);
+    // The punctuation and the spaces are kept.
+    EXPECT_EQ(text[2], anonymized[2]);
+    EXPECT_EQ(text[3], anonymized[3]);
+    // The digits become zeros.
+    EXPECT_EQ('0', anonymized[4]);
+    EXPECT_EQ('0', anonymized[5]);
+    // The Arabic letters are still Arabic.
+    EXPECT_EQ(anonymized[7], anonymized[11]);
+    EXPECT_LE(0x0600, anonymized[7]);
+    EXPECT_GT(0x0700, anonymized[7]);
+
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const ApiTrace::Trace trace = recordTrace(true /* anonymize */, [&] {
+        Layout::measureText(text, Range(0, text.size()), Bidi::LTR, paint,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, nullptr);
+    });
+    ASSERT_EQ(1u, trace.calls.size());
+    EXPECT_EQ(anonymized, trace.calls[0].text);
+}
+
+TEST(ApiTraceTest, malformedTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint16_t> text = utf8ToUtf16("android is fun");
+    const line_breaker_test_helper::RectangleLineWidth lineWidth(50);
+    const TabStops tabStops(nullptr, 0, 10);
+    const std::vector<uint8_t> buffer = recordBuffer(false /* anonymize */, [&] {
+        Layout::measureText(text, Range(0, text.size()), Bidi::LTR, paint,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, nullptr);
+        std::unique_ptr<MeasuredText> mt = buildText(text, paint);
+        breakIntoLines(text, BreakStrategy::Greedy, HyphenationFrequency::Normal,
+                       false /* justified */, *mt, lineWidth, tabStops);
+    });
+
+    // Every truncation is detected.
+    for (size_t size = 0; size < buffer.size(); ++size) {
+        BufferReader reader(buffer.data(), 0, size);
+        ApiTrace::Trace out;
+        EXPECT_FALSE(ApiTrace::readFrom(&reader, &out)) << size;
+    }
+
+    // A count of more collections than the trace can hold is rejected without allocating them.
+    const std::vector<uint8_t> corrupted =
+            BufferWriter::writeToVector([&buffer](BufferWriter* writer) {
+                writer->write<uint32_t>(BufferReader(buffer.data()).read<uint32_t>());
+                writer->write<uint32_t>(UINT32_MAX);
+            });
+    BufferReader reader(corrupted.data(), 0, corrupted.size());
+    ApiTrace::Trace out;
+    EXPECT_FALSE(ApiTrace::readFrom(&reader, &out));
+}
+
+}  // namespace minikin
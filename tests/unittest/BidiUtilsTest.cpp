@@ -533,4 +533,86 @@ TEST(BidiUtilsTest, RTL_LTR_RTL_CharText) {
     }
 }
 
+TEST(BidiUtilsTest, LTRParagraphWithoutRTLChars) {
+    // Embeddings, overrides and supplementary RTL characters still give several runs.
+    for (Bidi bidi : {Bidi::LTR, Bidi::DEFAULT_LTR}) {
+        auto text = utf8ToUtf16("Hello \u202EWorld\u202C!");
+        BidiText bidiText(text, Range(0, text.size()), bidi);
+        auto it = bidiText.begin();
+        EXPECT_NE(bidiText.end(), it);
+        EXPECT_FALSE((*it).isRtl);
+        ++it;
+        EXPECT_NE(bidiText.end(), it);
+        EXPECT_TRUE((*it).isRtl);
+    }
+    for (Bidi bidi : {Bidi::LTR, Bidi::DEFAULT_LTR}) {
+        auto text = utf8ToUtf16("Hello \U00010900\U00010901");
+        BidiText bidiText(text, Range(0, text.size()), bidi);
+        auto it = bidiText.begin();
+        EXPECT_NE(bidiText.end(), it);
+        EXPECT_EQ(Range(0, 6), (*it).range);
+        EXPECT_FALSE((*it).isRtl);
+        ++it;
+        EXPECT_NE(bidiText.end(), it);
+        EXPECT_EQ(Range(6, 10), (*it).range);
+        EXPECT_TRUE((*it).isRtl);
+        ++it;
+        EXPECT_EQ(bidiText.end(), it);
+    }
+    // Neutral and non-RTL characters beyond Latin are a single LTR run.
+    for (Bidi bidi : {Bidi::LTR, Bidi::DEFAULT_LTR}) {
+        auto text = utf8ToUtf16("(\u3042\u0915) 123 \u2014 \U0001F600");
+        BidiText bidiText(text, Range(1, text.size()), bidi);
+        auto it = bidiText.begin();
+        EXPECT_NE(bidiText.end(), it);
+        EXPECT_EQ(Range(1, text.size()), (*it).range);
+        EXPECT_FALSE((*it).isRtl);
+        ++it;
+        EXPECT_EQ(bidiText.end(), it);
+    }
+}
+
+TEST(BidiUtilsTest, RTLCharAfterFirstScanBlock) {
+    // The RTL character is found past the blocks of Latin text.
+    std::string str(100, 'a');
+    str += RTL_1;
+    auto text = utf8ToUtf16(str);
+    BidiText bidiText(text, Range(0, text.size()), Bidi::DEFAULT_LTR);
+    auto it = bidiText.begin();
+    EXPECT_NE(bidiText.end(), it);
+    EXPECT_EQ(Range(0, 100), (*it).range);
+    EXPECT_FALSE((*it).isRtl);
+    ++it;
+    EXPECT_NE(bidiText.end(), it);
+    EXPECT_EQ(Range(100, text.size()), (*it).range);
+    EXPECT_TRUE((*it).isRtl);
+    ++it;
+    EXPECT_EQ(bidiText.end(), it);
+}
+
+TEST(BidiUtilsTest, NestedBidiTexts) {
+    // The UBiDi objects are reused within a thread, but never shared by live BidiTexts.
+    auto text = utf8ToUtf16(std::string(LTR_1) + RTL_1);
+    auto text2 = utf8ToUtf16(std::string(RTL_2) + LTR_2);
+    for (int i = 0; i < 3; ++i) {
+        BidiText outer(text, Range(0, text.size()), Bidi::LTR);
+        {
+            BidiText inner(text2, Range(0, text2.size()), Bidi::RTL);
+            auto it = inner.begin();
+            EXPECT_NE(inner.end(), it);
+            EXPECT_EQ(Range(utf8ToUtf16(RTL_2).size(), text2.size()), (*it).range);
+            EXPECT_FALSE((*it).isRtl);
+        }
+        auto it = outer.begin();
+        EXPECT_NE(outer.end(), it);
+        EXPECT_EQ(Range(0, utf8ToUtf16(LTR_1).size()), (*it).range);
+        EXPECT_FALSE((*it).isRtl);
+        ++it;
+        EXPECT_NE(outer.end(), it);
+        EXPECT_TRUE((*it).isRtl);
+        ++it;
+        EXPECT_EQ(outer.end(), it);
+    }
+}
+
 }  // namespace minikin
@@ -169,4 +169,33 @@ TEST(BoundsCacheTest, cacheOverflowTest) {
     EXPECT_EQ(bounds1.advance(), bounds3.advance());
 }
 
+TEST(BoundsCacheTest, attachToLayoutCacheTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+
+    TestableBoundsCache boundsCache(10);
+
+    BoundsCapture bounds1;
+    boundsCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, bounds1);
+    boundsCache.clear();
+    EXPECT_EQ(0u, boundsCache.getMemoryUsage());
+
+    boundsCache.setAttachToLayoutCache(true);
+    BoundsCapture bounds2;
+    boundsCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, bounds2);
+    BoundsCapture bounds3;
+    boundsCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, bounds3);
+
+    // Nothing is stored in the BoundsCache itself.
+    EXPECT_EQ(0u, boundsCache.getMemoryUsage());
+    EXPECT_EQ(bounds1.rect(), bounds2.rect());
+    EXPECT_EQ(bounds1.advance(), bounds2.advance());
+    EXPECT_EQ(bounds1.rect(), bounds3.rect());
+    EXPECT_EQ(bounds1.advance(), bounds3.advance());
+}
+
 }  // namespace minikin
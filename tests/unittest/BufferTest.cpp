@@ -97,4 +97,60 @@ TEST(BufferTest, testSkip) {
     ASSERT_EQ(reader.current(), buffer.data() + 24u);
 }
 
+TEST(BufferTest, testReserveArray) {
+    const uint64_t expected[] = {0x123456789ABCDEF0ull, 0x0FEDCBA987654321ull};
+    auto writeFunc = [&](BufferWriter* writer) {
+        writer->write<uint8_t>(0xAB);
+        // padding (3), array size (4), uint64_t (8) * 2
+        uint64_t* array = writer->reserveArray<uint64_t>(2);
+        if (array != nullptr) {
+            array[0] = expected[0];
+            array[1] = expected[1];
+        }
+        // The same layout as writeArray.
+        writer->writeArray<uint64_t>(expected, 2);
+    };
+    std::vector<uint8_t> buffer = BufferWriter::writeToVector(writeFunc);
+    ASSERT_EQ(buffer.size(), 48u);
+
+    BufferReader reader(buffer.data());
+    ASSERT_EQ(reader.read<uint8_t>(), 0xABu);
+    for (int i = 0; i < 2; ++i) {
+        auto [array, size] = reader.readArray<uint64_t>();
+        ASSERT_EQ(size, 2u);
+        EXPECT_EQ(array[0], expected[0]);
+        EXPECT_EQ(array[1], expected[1]);
+    }
+    ASSERT_EQ(reader.current(), buffer.data() + 48u);
+}
+
+TEST(BufferTest, testBoundedRead) {
+    TestObject testObject;
+    std::vector<uint8_t> buffer = BufferWriter::writeToVector(
+            [&testObject](BufferWriter* writer) { testObject.writeTo(writer); });
+    ASSERT_EQ(buffer.size(), 24u);
+    {
+        BufferReader reader(buffer.data(), 0, buffer.size());
+        reader.read<uint8_t>();
+        reader.read<uint16_t>();
+        reader.read<uint8_t>();
+        EXPECT_EQ(reader.readArray<uint32_t>().second, 2u);
+        EXPECT_NE(nullptr, reader.map<uint16_t>(4));
+        EXPECT_FALSE(reader.overflowed());
+    }
+    {
+        // The array goes past the end.
+        BufferReader reader(buffer.data(), 0, 16);
+        EXPECT_EQ(reader.read<uint8_t>(), 0xABu);
+        reader.read<uint16_t>();
+        reader.read<uint8_t>();
+        EXPECT_FALSE(reader.overflowed());
+        EXPECT_EQ(reader.readArray<uint32_t>().second, 0u);
+        EXPECT_TRUE(reader.overflowed());
+        EXPECT_EQ(reader.read<uint32_t>(), 0u);
+        EXPECT_EQ(nullptr, reader.map<uint16_t>(4));
+        EXPECT_EQ(reader.current(), buffer.data() + 16u);
+    }
+}
+
 }  // namespace minikin
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/CachePartition.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "minikin/BoundsCache.h"
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+#include "WorkerPool.h"
+
+namespace minikin {
+
+namespace {
+
+void layoutWord(const std::string& word) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint16_t> text = utf8ToUtf16(word);
+    Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+           EndHyphenEdit::NO_EDIT);
+}
+
+}  // namespace
+
+TEST(CachePartitionTest, scopeTest) {
+    EXPECT_EQ(CachePartition::Interactive, CachePartitionScope::getCurrent());
+    {
+        CachePartitionScope bulk(CachePartition::Bulk);
+        EXPECT_EQ(CachePartition::Bulk, CachePartitionScope::getCurrent());
+        {
+            CachePartitionScope interactive(CachePartition::Interactive);
+            EXPECT_EQ(CachePartition::Interactive, CachePartitionScope::getCurrent());
+        }
+        EXPECT_EQ(CachePartition::Bulk, CachePartitionScope::getCurrent());
+    }
+    EXPECT_EQ(CachePartition::Interactive, CachePartitionScope::getCurrent());
+}
+
+TEST(CachePartitionTest, getInstanceTest) {
+    LayoutCache& interactive = LayoutCache::getInstance(CachePartition::Interactive);
+    LayoutCache& bulk = LayoutCache::getInstance(CachePartition::Bulk);
+    EXPECT_NE(&interactive, &bulk);
+    EXPECT_EQ(&interactive, &LayoutCache::getInstance());
+    EXPECT_NE(&BoundsCache::getInstance(CachePartition::Interactive),
+              &BoundsCache::getInstance(CachePartition::Bulk));
+
+    CachePartitionScope scope(CachePartition::Bulk);
+    EXPECT_EQ(&bulk, &LayoutCache::getInstance());
+    EXPECT_EQ(&BoundsCache::getInstance(CachePartition::Bulk), &BoundsCache::getInstance());
+}
+
+TEST(CachePartitionTest, layoutTest) {
+    Layout::purgeCaches();
+    LayoutCache& interactive = LayoutCache::getInstance(CachePartition::Interactive);
+    LayoutCache& bulk = LayoutCache::getInstance(CachePartition::Bulk);
+
+    layoutWord("interactive");
+    const size_t interactiveUsage = interactive.getMemoryUsage();
+    EXPECT_NE(0u, interactiveUsage);
+    EXPECT_EQ(0u, bulk.getMemoryUsage());
+
+    {
+        CachePartitionScope scope(CachePartition::Bulk);
+        layoutWord("bulk");
+    }
+    // The bulk work leaves the interactive partition untouched.
+    EXPECT_EQ(interactiveUsage, interactive.getMemoryUsage());
+    EXPECT_NE(0u, bulk.getMemoryUsage());
+
+    // purgeCaches clears every partition.
+    Layout::purgeCaches();
+    EXPECT_EQ(0u, interactive.getMemoryUsage());
+    EXPECT_EQ(0u, bulk.getMemoryUsage());
+}
+
+TEST(CachePartitionTest, workerPoolTest) {
+    WorkerPool pool(2);
+    std::atomic<int> bulkCount(0);
+    CachePartitionScope scope(CachePartition::Bulk);
+    pool.parallelFor(16, [&bulkCount](size_t) {
+        if (CachePartitionScope::getCurrent() == CachePartition::Bulk) {
+            bulkCount++;
+        }
+    });
+    EXPECT_EQ(16, bulkCount.load());
+}
+
+}  // namespace minikin
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/CacheStats.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace minikin {
+
+TEST(LockStatsTest, uncontendedTest) {
+    LockStats stats;
+    std::mutex mutex;
+    {
+        std::unique_lock<std::mutex> lock = stats.lock(mutex);
+        EXPECT_TRUE(lock.owns_lock());
+    }
+    EXPECT_EQ(0u, stats.getWaitCount());
+    EXPECT_EQ(0u, stats.getWaitNanos());
+}
+
+namespace {
+
+// A mutex which tells when a thread starts blocking on it.
+class SignalingMutex {
+public:
+    explicit SignalingMutex(std::promise<void>* blocking) : mBlocking(blocking) {}
+
+    bool try_lock() { return mMutex.try_lock(); }
+    void lock() {
+        mBlocking->set_value();
+        mMutex.lock();
+    }
+    void unlock() { mMutex.unlock(); }
+
+private:
+    std::mutex mMutex;
+    std::promise<void>* mBlocking;
+};
+
+}  // namespace
+
+TEST(LockStatsTest, contendedTest) {
+    LockStats stats;
+    std::promise<void> blocking;
+    std::future<void> blocked = blocking.get_future();
+    SignalingMutex mutex(&blocking);
+    std::unique_lock<SignalingMutex> held(mutex, std::try_to_lock);
+    ASSERT_TRUE(held.owns_lock());
+    std::thread waiter([&] {
+        std::unique_lock<SignalingMutex> lock = stats.lock(mutex);
+        EXPECT_TRUE(lock.owns_lock());
+    });
+    blocked.wait();
+    held.unlock();
+    waiter.join();
+    EXPECT_EQ(1u, stats.getWaitCount());
+    EXPECT_NE(0u, stats.getWaitNanos());
+    // The wait is in a single bucket, whichever its length is.
+    uint64_t bucketWaits = 0;
+    for (size_t i = 0; i < LockStats::kWaitBucketCount; ++i) {
+        bucketWaits += stats.getWaitCount(i);
+    }
+    EXPECT_EQ(1u, bucketWaits);
+    EXPECT_EQ(1u, stats.getWaitCount(LockStats::getWaitBucket(stats.getWaitNanos())));
+}
+
+TEST(LockStatsTest, waitBucketTest) {
+    EXPECT_EQ(0u, LockStats::getWaitBucket(0));
+    EXPECT_EQ(0u, LockStats::getWaitBucket(999));
+    EXPECT_EQ(1u, LockStats::getWaitBucket(1000));
+    EXPECT_EQ(2u, LockStats::getWaitBucket(10 * 1000));
+    EXPECT_EQ(3u, LockStats::getWaitBucket(100 * 1000));
+    EXPECT_EQ(4u, LockStats::getWaitBucket(1000 * 1000));
+    EXPECT_EQ(4u, LockStats::getWaitBucket(9999999));
+    EXPECT_EQ(5u, LockStats::getWaitBucket(10 * 1000 * 1000));
+    EXPECT_EQ(LockStats::kWaitBucketCount - 1, LockStats::getWaitBucket(UINT64_MAX));
+}
+
+TEST(LockStatsTest, acquisitionCountTest) {
+    LockStats stats;
+    std::mutex mutex;
+    stats.lock(mutex);
+    EXPECT_EQ(0u, stats.getAcquisitionCount());
+
+    LockStats::setAcquisitionCountEnabled(true);
+    stats.lock(mutex);
+    stats.lock(mutex);
+    LockStats::setAcquisitionCountEnabled(false);
+    EXPECT_EQ(2u, stats.getAcquisitionCount());
+    EXPECT_EQ(0u, stats.getWaitCount());
+}
+
+}  // namespace minikin
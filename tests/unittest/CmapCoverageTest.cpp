@@ -1213,4 +1213,45 @@ TEST(CmapCoverageTest, TableSelection_vsTableOnly) {
     ASSERT_FALSE(vsTables[vsIndex].empty());
     EXPECT_TRUE(vsTables[vsIndex].get('a'));
 }
+
+TEST(CmapCoverageTest, cacheTest) {
+    auto buildCmap = [](uint16_t end) {
+        CmapBuilder builder(2);
+        builder.appendTable(0, 0, buildCmapFormat4Table(std::vector<uint16_t>({'a', end})));
+        builder.appendTable(VS_PLATFORM_ID, VS_ENCODING_ID,
+                            buildCmapFormat14Table(std::vector<VariationSelectorRecord>(
+                                    {{0xFE0F, {'a', 'b'}, {}}})));
+        return builder.build();
+    };
+    std::vector<uint8_t> cmap = buildCmap('z');
+    std::vector<uint8_t> sameCmap = buildCmap('z');
+    std::vector<uint8_t> otherCmap = buildCmap('c');
+
+    std::vector<SparseBitSet> expectedVsTables;
+    SparseBitSet expected = CmapCoverage::getCoverage(cmap.data(), cmap.size(), &expectedVsTables);
+
+    CmapCoverage::setCacheEnabled(true);
+    for (int i = 0; i < 2; ++i) {
+        // The cached coverage of the same table is returned for another copy of it.
+        const std::vector<uint8_t>& table = i == 0 ? cmap : sameCmap;
+        std::vector<SparseBitSet> vsTables;
+        SparseBitSet coverage = CmapCoverage::getCoverage(table.data(), table.size(), &vsTables);
+        for (uint32_t c = 0; c < 0x80; ++c) {
+            EXPECT_EQ(expected.get(c), coverage.get(c)) << c;
+        }
+        ASSERT_EQ(expectedVsTables.size(), vsTables.size());
+        for (size_t vs = 0; vs < vsTables.size(); ++vs) {
+            for (uint32_t c = 0; c < 0x80; ++c) {
+                EXPECT_EQ(expectedVsTables[vs].get(c), vsTables[vs].get(c)) << vs << " " << c;
+            }
+        }
+    }
+    // A different table is parsed on its own.
+    std::vector<SparseBitSet> vsTables;
+    SparseBitSet coverage =
+            CmapCoverage::getCoverage(otherCmap.data(), otherCmap.size(), &vsTables);
+    CmapCoverage::setCacheEnabled(false);
+    EXPECT_TRUE(coverage.get('c'));
+    EXPECT_FALSE(coverage.get('d'));
+}
 }  // namespace minikin
@@ -113,6 +113,19 @@ TEST(EmojiTest, isEmojiBaseTest) {
     EXPECT_FALSE(isEmojiBase(0x29E3D));  // A han character.
 }
 
+TEST(EmojiTest, matchesIcuTest) {
+    // The lookup tables must agree with ICU for every code point, in and out of the tables.
+    for (uint32_t c = 0; c <= 0x10FFFF; ++c) {
+        ASSERT_EQ(u_hasBinaryProperty(c, UCHAR_EMOJI), isEmoji(c)) << std::hex << c;
+        ASSERT_EQ(u_hasBinaryProperty(c, UCHAR_EMOJI_MODIFIER), isEmojiModifier(c))
+                << std::hex << c;
+        if (c != 0x1F91D && c != 0x1F93C) {
+            ASSERT_EQ(u_hasBinaryProperty(c, UCHAR_EMOJI_MODIFIER_BASE), isEmojiBase(c))
+                    << std::hex << c;
+        }
+    }
+}
+
 TEST(EmojiTest, emojiBidiOverrideTest) {
     EXPECT_EQ(U_RIGHT_TO_LEFT, emojiBidiOverride(nullptr, 0x05D0));  // HEBREW LETTER ALEF
     EXPECT_EQ(U_LEFT_TO_RIGHT,
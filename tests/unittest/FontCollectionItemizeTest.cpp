@@ -1629,6 +1629,182 @@ TEST(FontCollectionItemizeTest, customFallbackTest) {
     EXPECT_EQ(customFallbackFamily->getFont(0), runs[0].fakedFont.font.get());
 }
 
+TEST(FontCollectionItemizeTest, itemize_cachedFamilyForChar) {
+    auto latinFamily = buildFontFamily(kLatinFont);
+    auto jaFamily = buildFontFamily(kJAFont, "ja-JP");
+    auto zhFamily = buildFontFamily(kZH_HansFont, "zh-Hans");
+    auto jaCollection = FontCollection::create({latinFamily, jaFamily});
+    auto zhCollection = FontCollection::create({latinFamily, zhFamily});
+    auto bothCollection = FontCollection::create({latinFamily, jaFamily, zhFamily});
+
+    // The memoized results must not leak between collections or locales.
+    for (int i = 0; i < 2; ++i) {
+        auto runs = itemize(jaCollection, "U+9AA8", "");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kJAFont, getFontName(runs[0]));
+        runs = itemize(zhCollection, "U+9AA8", "");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kZH_HansFont, getFontName(runs[0]));
+        runs = itemize(bothCollection, "U+9AA8", "ja-JP");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kJAFont, getFontName(runs[0]));
+        runs = itemize(bothCollection, "U+9AA8", "zh-Hans");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kZH_HansFont, getFontName(runs[0]));
+    }
+}
+
+TEST(FontCollectionItemizeTest, itemize_primaryFamilySpan) {
+    auto latinFamily = buildFontFamily(kLatinFont, "", true /* isCustomFallback */);
+    auto jaFamily = buildFontFamily(kJAFont, "ja-JP");
+    auto collection = FontCollection::create({latinFamily, jaFamily});
+
+    // The characters supported by the primary family are appended to its run without looking up
+    // the family for each of them.
+    auto runs = itemize(collection, "'a' 'b' 'c' U+3042 U+3044 'd' 'e' 'f' 'g'", "");
+    ASSERT_EQ(3U, runs.size());
+    EXPECT_EQ(0, runs[0].start);
+    EXPECT_EQ(3, runs[0].end);
+    EXPECT_EQ(kLatinFont, getFontName(runs[0]));
+    EXPECT_EQ(3, runs[1].start);
+    EXPECT_EQ(5, runs[1].end);
+    EXPECT_EQ(kJAFont, getFontName(runs[1]));
+    EXPECT_EQ(5, runs[2].start);
+    EXPECT_EQ(9, runs[2].end);
+    EXPECT_EQ(kLatinFont, getFontName(runs[2]));
+}
+
+TEST(FontCollectionItemizeTest, itemize_styleRanges) {
+    auto collection = FontCollection::create(
+            {buildFontFamily(kLatinFont, "", true /* isCustomFallback */),
+             buildFontFamily(kJAFont, "ja-JP"), buildFontFamily(kZH_HansFont, "zh-Hans"),
+             buildFontFamily(kNoCmapFormat14Font)});
+    auto text = utf8ToUtf16("ab \u9AA8\u9AA8 cd \u9AA8 \u82A6\uFE00 e");
+    const uint32_t jaLocaleListId = registerLocaleList("ja-JP");
+    const uint32_t zhLocaleListId = registerLocaleList("zh-Hans");
+    using StyleRange = FontCollection::StyleRange;
+    auto expectSameRuns = [](const std::vector<FontCollection::Run>& expected,
+                             const std::vector<FontCollection::Run>& actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(expected[i].start, actual[i].start);
+            EXPECT_EQ(expected[i].end, actual[i].end);
+            EXPECT_EQ(expected[i].familyMatch, actual[i].familyMatch);
+        }
+    };
+
+    // A single style range is the same as the plain itemization.
+    const std::vector<StyleRange> singleRange = {
+            {0, static_cast<uint32_t>(text.size()), jaLocaleListId, FamilyVariant::DEFAULT}};
+    expectSameRuns(collection->itemize(text, FontStyle(), jaLocaleListId, FamilyVariant::DEFAULT),
+                   collection->itemize(text, singleRange));
+
+    // Each style range uses its own locales for the fallback.
+    const std::vector<StyleRange> styleRanges = {
+            {0, 4, jaLocaleListId, FamilyVariant::DEFAULT},
+            {4, static_cast<uint32_t>(text.size()), zhLocaleListId, FamilyVariant::DEFAULT}};
+    auto runs = collection->itemize(text, styleRanges);
+    ASSERT_LE(3u, runs.size());
+    EXPECT_EQ(3, runs[1].start);
+    EXPECT_EQ(4, runs[1].end);
+    EXPECT_EQ(kJAFont, getBasename(collection->getBestFont(text, runs[1], FontStyle())
+                                           .font->typeface()
+                                           ->GetFontPath()));
+    EXPECT_EQ(4, runs[2].start);
+    EXPECT_EQ(5, runs[2].end);
+    EXPECT_EQ(kZH_HansFont, getBasename(collection->getBestFont(text, runs[2], FontStyle())
+                                                .font->typeface()
+                                                ->GetFontPath()));
+
+    // The sliced runs are the same as the runs of the substring.
+    bool isSliced = false;
+    for (uint32_t start = 0; start < text.size(); ++start) {
+        for (uint32_t end = start + 1; end <= text.size(); ++end) {
+            const uint32_t localeListId = end <= 4 ? jaLocaleListId : zhLocaleListId;
+            if (start < 4 && 4 < end) {
+                continue;  // Not in a single style range.
+            }
+            std::vector<FontCollection::Run> slicedRuns;
+            if (collection->sliceParagraphRuns(text, runs, Range(start, end), localeListId,
+                                               FamilyVariant::DEFAULT, &slicedRuns)) {
+                isSliced = true;
+                expectSameRuns(collection->itemize(U16StringPiece(text).substr(Range(start, end)),
+                                                   FontStyle(), localeListId,
+                                                   FamilyVariant::DEFAULT),
+                               slicedRuns);
+            }
+        }
+    }
+    EXPECT_TRUE(isSliced);
+}
+
+TEST(FontCollectionItemizeTest, itemize_parallel) {
+    auto collection = buildFontCollectionFromXml(kItemizeFontXml);
+    // Latin, CJK, emoji sequences, combining marks and variation selectors, so that the chunk
+    // boundaries fall in every kind of run.
+    const std::vector<uint16_t> unit = utf8ToUtf16(
+            "ab \u9AA8\u9AA8 cd \u3042\u3044 \U0001F469\u200D\u2764\uFE0F a\u0301 "
+            "1\uFE0F\u20E3 \U0001F44B\U0001F3FD \u82A6\uFE00.\n");
+    std::vector<uint16_t> text;
+    while (text.size() < 50000) {
+        text.insert(text.end(), unit.begin(), unit.end());
+    }
+    const uint32_t jaLocaleListId = registerLocaleList("ja-JP");
+    const uint32_t zhLocaleListId = registerLocaleList("zh-Hans");
+    const std::vector<FontCollection::StyleRange> styleRanges = {
+            {0, 20001, jaLocaleListId, FamilyVariant::DEFAULT},
+            {20001, 30000, zhLocaleListId, FamilyVariant::COMPACT},
+            {30000, static_cast<uint32_t>(text.size()), jaLocaleListId, FamilyVariant::DEFAULT}};
+    auto expectSameRuns = [](const std::vector<FontCollection::Run>& expected,
+                             const std::vector<FontCollection::Run>& actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(expected[i].start, actual[i].start);
+            EXPECT_EQ(expected[i].end, actual[i].end);
+            EXPECT_EQ(expected[i].familyMatch, actual[i].familyMatch);
+        }
+    };
+
+    auto sequential = collection->itemize(text, FontStyle(), jaLocaleListId,
+                                          FamilyVariant::DEFAULT);
+    auto sequentialStyled = collection->itemize(text, styleRanges);
+    FontCollection::setParallelItemizationEnabled(true);
+    auto parallel = collection->itemize(text, FontStyle(), jaLocaleListId, FamilyVariant::DEFAULT);
+    auto parallelStyled = collection->itemize(text, styleRanges);
+    // The limited itemizations are sequential.
+    auto limited = collection->itemize(text, FontStyle(), jaLocaleListId, FamilyVariant::DEFAULT,
+                                       3);
+    FontCollection::setParallelItemizationEnabled(false);
+
+    expectSameRuns(sequential, parallel);
+    expectSameRuns(sequentialStyled, parallelStyled);
+    expectSameRuns(std::vector<FontCollection::Run>(sequential.begin(), sequential.begin() + 3),
+                   limited);
+}
+
+TEST(FontCollectionItemizeTest, itemize_manyLocaleLists) {
+    auto collection = buildFontCollectionFromXml(kItemizeFontXml);
+
+    // The locale matching scores are memoized only for a few locale lists. The fallback must not
+    // depend on how many locale lists have been used with the collection.
+    for (int i = 0; i < 2; ++i) {
+        for (const char* locale : {"en-US", "ko-KR", "zh-Hant", "fr-FR", "de-DE", "es-ES"}) {
+            itemize(collection, "U+9AA8", locale);
+        }
+        auto runs = itemize(collection, "U+9AA8", "ja-Jpan");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kJAFont, getFontName(runs[0]));
+
+        runs = itemize(collection, "U+9AA8", "zh-Hans");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kZH_HansFont, getFontName(runs[0]));
+
+        runs = itemize(collection, "U+9AA8", "ja-Jpan,zh-Hans");
+        ASSERT_EQ(1U, runs.size());
+        EXPECT_EQ(kJAFont, getFontName(runs[0]));
+    }
+}
+
 struct ItemizeResult {
     int start;
     int end;
@@ -16,11 +16,18 @@
 
 #include "minikin/FontCollection.h"
 
+#include <sys/mman.h>
+
+#include <iomanip>
+#include <sstream>
+
 #include <gtest/gtest.h>
 
 #include "FontTestUtils.h"
 #include "FreeTypeMinikinFontForTest.h"
+#include "LocaleListCache.h"
 #include "MinikinInternal.h"
+#include "UnicodeUtils.h"
 
 namespace minikin {
 
@@ -198,6 +205,68 @@ std::vector<uint8_t> writeToBuffer(
     return buffer;
 }
 
+TEST(FontCollectionTest, stableId) {
+    // The separately built collections of the same fonts have the same ID.
+    std::shared_ptr<FontCollection> fc = buildFontCollection(kVsTestFont);
+    std::shared_ptr<FontCollection> sameFc = buildFontCollection(kVsTestFont);
+    EXPECT_NE(fc->getId(), sameFc->getId());
+    EXPECT_EQ(fc->getStableId(), sameFc->getStableId());
+    EXPECT_NE(0u, fc->getStableId());
+
+    std::shared_ptr<FontCollection> multiAxisFc = buildFontCollection("MultiAxis.ttf");
+    EXPECT_NE(fc->getStableId(), multiAxisFc->getStableId());
+    std::shared_ptr<FontCollection> jaFc =
+            FontCollection::create(buildFontFamily(kVsTestFont, "ja-JP"));
+    EXPECT_NE(fc->getStableId(), jaFc->getStableId());
+
+    // The ID is kept in the buffer.
+    std::vector<uint8_t> buffer = writeToBuffer({fc, multiAxisFc});
+    BufferReader reader(buffer.data());
+    std::vector<std::shared_ptr<FontCollection>> copied = FontCollection::readVector(&reader);
+    ASSERT_EQ(2u, copied.size());
+    EXPECT_EQ(fc->getStableId(), copied[0]->getStableId());
+    EXPECT_EQ(multiAxisFc->getStableId(), copied[1]->getStableId());
+}
+
+TEST(FontCollectionTest, createWithVariations_shared) {
+    std::shared_ptr<FontCollection> multiAxisFc = buildFontCollection("MultiAxis.ttf");
+    std::vector<FontVariation> variations = {{MinikinFont::MakeTag('w', 'g', 'h', 't'), 700.0f}};
+    std::shared_ptr<FontCollection> newFc = multiAxisFc->createCollectionWithVariation(variations);
+    ASSERT_NE(nullptr, newFc);
+
+    // The same variations get the same collection while it is alive.
+    EXPECT_EQ(newFc, multiAxisFc->createCollectionWithVariation(variations));
+    std::vector<FontVariation> otherVariations = {
+            {MinikinFont::MakeTag('w', 'g', 'h', 't'), 400.0f}};
+    std::shared_ptr<FontCollection> otherFc =
+            multiAxisFc->createCollectionWithVariation(otherVariations);
+    EXPECT_NE(newFc, otherFc);
+
+    // The coverage is shared with the original family.
+    ASSERT_EQ(multiAxisFc->getFamilyCount(), newFc->getFamilyCount());
+    EXPECT_NE(multiAxisFc->getFamilyAt(0), newFc->getFamilyAt(0));
+    EXPECT_EQ(&multiAxisFc->getFamilyAt(0)->getCoverage(), &newFc->getFamilyAt(0)->getCoverage());
+
+    auto text = utf8ToUtf16("abc");
+    auto expectedRuns = multiAxisFc->itemize(text, FontStyle(), kEmptyLocaleListId,
+                                             FamilyVariant::DEFAULT);
+    auto actualRuns = newFc->itemize(text, FontStyle(), kEmptyLocaleListId, FamilyVariant::DEFAULT);
+    ASSERT_EQ(expectedRuns.size(), actualRuns.size());
+    for (size_t i = 0; i < expectedRuns.size(); ++i) {
+        EXPECT_EQ(expectedRuns[i].start, actualRuns[i].start);
+        EXPECT_EQ(expectedRuns[i].end, actualRuns[i].end);
+        EXPECT_EQ(expectedRuns[i].familyMatch, actualRuns[i].familyMatch);
+    }
+
+    // The derived collection is written as if it was created from the families.
+    std::vector<std::shared_ptr<FontCollection>> derived({newFc});
+    std::vector<uint8_t> buffer = writeToBuffer(derived);
+    BufferReader reader(buffer.data());
+    auto copied = FontCollection::readVector(&reader);
+    ASSERT_EQ(1u, copied.size());
+    EXPECT_EQ(buffer, writeToBuffer(copied));
+}
+
 TEST(FontCollectionTest, bufferTest) {
     FreeTypeMinikinFontForTestFactory::init();
     {
@@ -249,6 +318,233 @@ TEST(FontCollectionTest, bufferTest) {
     }
 }
 
+TEST(FontCollectionTest, readOnlyBufferTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    std::vector<std::shared_ptr<FontCollection>> original(
+            {buildFontCollection(kVsTestFont), buildFontCollection("MultiAxis.ttf")});
+    std::vector<uint8_t> buffer = writeToBuffer(original);
+
+    // The collections are used in place of a read-only mapping, e.g. a file shared by processes.
+    void* mapped = mmap(nullptr, buffer.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, mapped);
+    memcpy(mapped, buffer.data(), buffer.size());
+    ASSERT_EQ(0, mprotect(mapped, buffer.size(), PROT_READ));
+    {
+        BufferReader reader(mapped);
+        auto copied = FontCollection::readVector(&reader);
+        ASSERT_EQ(2u, copied.size());
+        expectVSGlyphsForVsTestFont(copied[0].get());
+        ASSERT_EQ(2u, copied[1]->getSupportedAxesCount());
+        EXPECT_EQ(MinikinFont::MakeTag('w', 'd', 't', 'h'), copied[1]->getSupportedAxisAt(0));
+        EXPECT_EQ(MinikinFont::MakeTag('w', 'g', 'h', 't'), copied[1]->getSupportedAxisAt(1));
+
+        std::vector<FontVariation> variations = {
+                {MinikinFont::MakeTag('w', 'g', 'h', 't'), 700.0f}};
+        std::shared_ptr<FontCollection> newFc =
+                copied[1]->createCollectionWithVariation(variations);
+        ASSERT_NE(nullptr, newFc);
+        EXPECT_EQ(2u, newFc->getSupportedAxesCount());
+        EXPECT_EQ(2u, newFc->getFamilyAt(0)->getSupportedAxesCount());
+
+        EXPECT_EQ(buffer, writeToBuffer(copied));
+    }
+    munmap(mapped, buffer.size());
+}
+
+TEST(FontCollectionTest, familyLookupTableTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    std::vector<std::shared_ptr<FontFamily>> families = {
+            buildFontFamily("Ascii.ttf", "", true /* isCustomFallback */),
+            buildFontFamily("Ja.ttf", "ja-JP"), buildFontFamily("ZhHans.ttf", "zh-Hans")};
+    auto reference = FontCollection::create(families);
+    auto collection = FontCollection::create(families);
+    auto text = utf8ToUtf16("abc \u3042\u9AA8\u5FCD");
+    const std::vector<uint32_t> localeListIds = {registerLocaleList("ja-JP"),
+                                                 registerLocaleList("zh-Hans")};
+    auto expectSameItemization = [&](const FontCollection& actual) {
+        for (uint32_t localeListId : localeListIds) {
+            FontCollection::setFamilyLookupTableEnabled(false);
+            auto expectedRuns =
+                    reference->itemize(text, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+            FontCollection::setFamilyLookupTableEnabled(true);
+            auto actualRuns =
+                    actual.itemize(text, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+            ASSERT_EQ(expectedRuns.size(), actualRuns.size());
+            for (size_t i = 0; i < expectedRuns.size(); ++i) {
+                EXPECT_EQ(expectedRuns[i].start, actualRuns[i].start);
+                EXPECT_EQ(expectedRuns[i].end, actualRuns[i].end);
+                EXPECT_EQ(expectedRuns[i].familyMatch, actualRuns[i].familyMatch);
+            }
+        }
+    };
+
+    std::vector<std::shared_ptr<FontCollection>> original({collection});
+    std::vector<uint8_t> bufferWithoutTable = writeToBuffer(original);
+
+    FontCollection::setFamilyLookupTableEnabled(true);
+    std::vector<uint8_t> buffer = writeToBuffer(original);
+    EXPECT_LT(bufferWithoutTable.size(), buffer.size());
+    BufferReader reader(buffer.data());
+    auto copied = FontCollection::readVector(&reader);
+    ASSERT_EQ(1u, copied.size());
+    // The table read from the buffer is written as is.
+    EXPECT_EQ(buffer, writeToBuffer(copied));
+
+    expectSameItemization(*collection);
+    expectSameItemization(*copied[0]);
+    FontCollection::setFamilyLookupTableEnabled(false);
+}
+
+TEST(FontCollectionTest, lazyCoverageTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto buildFamilies = [] {
+        return std::vector<std::shared_ptr<FontFamily>>{
+                buildFontFamily("Ascii.ttf", "", true /* isCustomFallback */),
+                buildFontFamily("Ja.ttf", "ja-JP"), buildFontFamily("ZhHans.ttf", "zh-Hans"),
+                buildFontFamily(kVsTestFont)};
+    };
+    auto reference = FontCollection::create(buildFamilies());
+    FontFamily::setLazyCoverageEnabled(true);
+    auto collection = FontCollection::create(buildFamilies());
+    FontFamily::setLazyCoverageEnabled(false);
+
+    auto text = utf8ToUtf16("abc \u3042\u9AA8\u5FCD \u82A6\uFE00\u717D\uFE02 \U0002F800");
+    for (const char* locale : {"ja-JP", "zh-Hans"}) {
+        const uint32_t localeListId = registerLocaleList(locale);
+        auto expectedRuns =
+                reference->itemize(text, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+        auto actualRuns =
+                collection->itemize(text, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+        ASSERT_EQ(expectedRuns.size(), actualRuns.size());
+        for (size_t i = 0; i < expectedRuns.size(); ++i) {
+            EXPECT_EQ(expectedRuns[i].start, actualRuns[i].start);
+            EXPECT_EQ(expectedRuns[i].end, actualRuns[i].end);
+            EXPECT_EQ(expectedRuns[i].familyMatch, actualRuns[i].familyMatch);
+        }
+    }
+    EXPECT_TRUE(collection->hasVariationSelector(0x82A6, 0xFE00));
+    EXPECT_FALSE(collection->hasVariationSelector(0x82A6, 0xFE01));
+
+    // The lazily built collection is written in the same way as the eagerly built one.
+    std::vector<std::shared_ptr<FontCollection>> expected({reference});
+    std::vector<std::shared_ptr<FontCollection>> actual({collection});
+    EXPECT_EQ(writeToBuffer(expected), writeToBuffer(actual));
+}
+
+TEST(FontCollectionTest, createBatchTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    std::vector<std::shared_ptr<FontFamily>> families = {
+            buildFontFamily("Ascii.ttf", "", true /* isCustomFallback */),
+            buildFontFamily("Ja.ttf", "ja-JP"), buildFontFamily("ZhHans.ttf", "zh-Hans"),
+            buildFontFamily(kVsTestFont)};
+    std::vector<FontFamily::BatchEntry> entries;
+    for (const std::shared_ptr<FontFamily>& family : families) {
+        std::vector<std::shared_ptr<Font>> fonts;
+        for (size_t i = 0; i < family->getNumFonts(); ++i) {
+            fonts.push_back(family->getFontRef(i));
+        }
+        entries.push_back({family->localeListId(), family->variant(), std::move(fonts),
+                           family->isCustomFallback(), family->isDefaultFallback()});
+    }
+    std::vector<std::shared_ptr<FontFamily>> batchFamilies =
+            FontFamily::createBatch(std::move(entries));
+    ASSERT_EQ(families.size(), batchFamilies.size());
+    for (size_t i = 0; i < families.size(); ++i) {
+        EXPECT_EQ(families[i]->localeListId(), batchFamilies[i]->localeListId());
+        EXPECT_EQ(families[i]->getCoverage().length(), batchFamilies[i]->getCoverage().length());
+        EXPECT_EQ(families[i]->hasVSTable(), batchFamilies[i]->hasVSTable());
+    }
+
+    std::vector<std::shared_ptr<FontCollection>> expected = {
+            FontCollection::create(families),
+            FontCollection::create({families[0], families[1]}),
+            FontCollection::create({families[3], families[2]})};
+    std::vector<std::shared_ptr<FontCollection>> actual =
+            FontCollection::createBatch({batchFamilies,
+                                         {batchFamilies[0], batchFamilies[1]},
+                                         {batchFamilies[3], batchFamilies[2]}});
+    // The families are written with the collections, so this also compares the coverages.
+    ASSERT_EQ(expected.size(), actual.size());
+    EXPECT_EQ(writeToBuffer(expected), writeToBuffer(actual));
+    EXPECT_TRUE(actual[2]->hasVariationSelector(0x82A6, 0xFE00));
+}
+
+// Enables the interning until the end of the scope, so that a failed assertion doesn't leave it
+// enabled for the following tests.
+class ScopedInterning {
+public:
+    ScopedInterning() { FontCollection::setInterningEnabled(true); }
+    ~ScopedInterning() { FontCollection::setInterningEnabled(false); }
+};
+
+TEST(FontCollectionTest, interningTest) {
+    std::vector<std::shared_ptr<FontFamily>> families = {buildFontFamily("MultiAxis.ttf"),
+                                                         buildFontFamily("Ascii.ttf")};
+    const std::vector<FontVariation> variations = {
+            {MinikinFont::MakeTag('w', 'd', 't', 'h'), 1.0f}};
+
+    // The collections are not shared by default.
+    auto first = FontCollection::create(families);
+    EXPECT_NE(first, FontCollection::create(families));
+
+    ScopedInterning interning;
+    auto interned = FontCollection::create(families);
+    auto same = FontCollection::create(families);
+    EXPECT_EQ(interned, same);
+    EXPECT_EQ(interned->getId(), same->getId());
+    // The order of the families makes a different collection.
+    EXPECT_NE(interned, FontCollection::create({families[1], families[0]}));
+
+    auto interned2 = FontCollection::create({buildFontFamily("MultiAxis.ttf"), families[1]});
+    EXPECT_NE(interned, interned2);
+    // The collections created with the same variations from the equivalent collections, here the
+    // one created before the interning was enabled, are shared too.
+    auto varied = interned->createCollectionWithVariation(variations);
+    ASSERT_NE(nullptr, varied);
+    EXPECT_EQ(varied, first->createCollectionWithVariation(variations));
+    EXPECT_NE(varied, interned2->createCollectionWithVariation(variations));
+
+    // A destroyed collection is not returned.
+    const uint32_t id = interned->getId();
+    interned.reset();
+    same.reset();
+    varied.reset();
+    EXPECT_NE(id, FontCollection::create(families)->getId());
+}
+
+TEST(FontCollectionTest, variationSequenceCandidatesTest) {
+    // The lazily built collection tries all the families for a variation sequence, so it is the
+    // reference for the candidates narrowed down to the families with variation sequence tables.
+    auto reference = buildFontCollectionFromXml(kEmojiXmlFile);
+    FontFamily::setLazyCoverageEnabled(true);
+    auto lazyReference = buildFontCollectionFromXml(kEmojiXmlFile);
+    FontFamily::setLazyCoverageEnabled(false);
+
+    const uint32_t texts[][2] = {{0x00A9, 0xFE0E}, {0x00A9, 0xFE0F}, {0x203C, 0xFE0E},
+                                 {0x203C, 0xFE0F}, {0x231A, 0xFE0E}, {0x23E9, 0xFE0F},
+                                 {0x26F9, 0xFE0F}, {0x26FA, 0xFE0E}, {0x2603, 0xFE0F},
+                                 {0x1F38A, 0xFE0E}, {0x0061, 0xFE0F}};
+    for (const auto& [base, vs] : texts) {
+        std::ostringstream ss;
+        ss << std::hex << std::setfill('0') << "U+" << std::setw(4) << base << " U+" << vs
+           << " U+" << std::setw(4) << base;
+        auto text = parseUnicodeString(ss.str());
+        auto expectedRuns = lazyReference->itemize(text, FontStyle(), kEmptyLocaleListId,
+                                                   FamilyVariant::DEFAULT);
+        auto actualRuns =
+                reference->itemize(text, FontStyle(), kEmptyLocaleListId, FamilyVariant::DEFAULT);
+        ASSERT_EQ(expectedRuns.size(), actualRuns.size());
+        for (size_t i = 0; i < expectedRuns.size(); ++i) {
+            EXPECT_EQ(expectedRuns[i].start, actualRuns[i].start);
+            EXPECT_EQ(expectedRuns[i].end, actualRuns[i].end);
+            EXPECT_EQ(expectedRuns[i].familyMatch, actualRuns[i].familyMatch);
+        }
+        EXPECT_EQ(lazyReference->hasVariationSelector(base, vs),
+                  reference->hasVariationSelector(base, vs));
+    }
+}
+
 TEST(FontCollectionTest, FamilyMatchResultBuilderTest) {
     using Builder = FontCollection::FamilyMatchResult::Builder;
     EXPECT_TRUE(Builder().empty());
@@ -332,4 +628,94 @@ TEST(FontCollectionTest, FamilyMatchResultTest_intersect) {
                                                            Builder().add(1).add(3).add(5).build()));
 }
 
+TEST(FontCollectionTest, FamilyMatchResultTest_wide) {
+    using Builder = FontCollection::FamilyMatchResult::Builder;
+    // More than three indices are held out of line.
+    auto r = Builder(true /* wide */).add(300).add(1).add(65000).add(4).build();
+    EXPECT_TRUE(r.isWide());
+    EXPECT_FALSE(Builder().add(1).build().isWide());
+    ASSERT_EQ(4u, r.size());
+    EXPECT_EQ(300u, r[0]);
+    EXPECT_EQ(1u, r[1]);
+    EXPECT_EQ(65000u, r[2]);
+    EXPECT_EQ(4u, r[3]);
+    EXPECT_EQ(r, Builder(true).add(300).add(1).add(65000).add(4).build());
+    EXPECT_FALSE(r == Builder(true).add(300).add(1).add(65000).build());
+
+    // The builder doesn't modify the results already built.
+    Builder b(true);
+    b.add(1).add(2).add(3).add(4);
+    auto first = b.build();
+    b.add(5);
+    EXPECT_EQ(4u, first.size());
+    EXPECT_EQ(5u, b.build().size());
+
+    EXPECT_EQ(Builder(true).add(300).build(),
+              FontCollection::FamilyMatchResult::intersect(
+                      Builder(true).add(1).add(300).build(),
+                      Builder(true).add(2).add(300).add(400).build()));
+    EXPECT_EQ(Builder(true).add(1).add(2).add(3).add(4).build(),
+              FontCollection::FamilyMatchResult::intersect(
+                      Builder(true).add(1).add(2).add(3).add(4).add(5).build(),
+                      Builder(true).add(0).add(1).add(2).add(3).add(4).build()));
+}
+
+TEST(FontCollectionTest, wideCollectionTest) {
+    // More families than fit in the byte indices. The only family supporting Hiragana is last.
+    auto ascii = buildFontFamily("Ascii.ttf");
+    auto ja = buildFontFamily("Ja.ttf", "ja-JP");
+    std::vector<std::shared_ptr<FontFamily>> families(MAX_FAMILY_COUNT + 50, ascii);
+    families.back() = ja;
+    auto collection = FontCollection::create(families);
+    ASSERT_EQ(MAX_FAMILY_COUNT + 50, collection->getFamilyCount());
+
+    auto text = utf8ToUtf16("ab\u3042\u3044c");
+    auto expectRuns = [&](const FontCollection& fc) {
+        auto runs = fc.itemize(text, FontStyle(), kEmptyLocaleListId, FamilyVariant::DEFAULT);
+        ASSERT_EQ(3u, runs.size());
+        EXPECT_EQ(2, runs[1].start);
+        EXPECT_EQ(4, runs[1].end);
+        EXPECT_TRUE(runs[1].familyMatch.isWide());
+        EXPECT_EQ(MAX_FAMILY_COUNT + 49, runs[1].familyMatch[0]);
+        EXPECT_EQ(0u, runs[2].familyMatch[0]);
+    };
+    expectRuns(*collection);
+    EXPECT_EQ(ja, collection->getFamilyAt(MAX_FAMILY_COUNT + 49));
+
+    // The pages are written in 16 bits, even with the family lookup table.
+    FontCollection::setFamilyLookupTableEnabled(true);
+    std::vector<uint8_t> buffer = writeToBuffer({collection});
+    FontCollection::setFamilyLookupTableEnabled(false);
+    BufferReader reader(buffer.data());
+    auto copied = FontCollection::readVector(&reader);
+    ASSERT_EQ(1u, copied.size());
+    expectRuns(*copied[0]);
+}
+
+TEST(FontCollectionTest, wideCollectionManyMatchesTest) {
+    // Five families supporting Hiragana equally well, more than packed in a wide result.
+    auto ascii = buildFontFamily("Ascii.ttf");
+    std::vector<std::shared_ptr<FontFamily>> families(MAX_FAMILY_COUNT + 50, ascii);
+    for (size_t i = families.size() - 5; i < families.size(); ++i) {
+        families[i] = buildFontFamily("Ja.ttf", "ja-JP");
+    }
+    auto collection = FontCollection::create(families);
+
+    auto text = utf8ToUtf16("\u3042\u3044");
+    // The second itemization reads the matches of the characters from the cache, if any.
+    for (int i = 0; i < 2; ++i) {
+        auto runs = collection->itemize(text, FontStyle(), kEmptyLocaleListId,
+                                        FamilyVariant::DEFAULT);
+        ASSERT_EQ(1u, runs.size());
+        const auto& familyMatch = runs[0].familyMatch;
+        EXPECT_TRUE(familyMatch.isWide());
+        ASSERT_EQ(5u, familyMatch.size());
+        for (uint32_t j = 0; j < 5; ++j) {
+            EXPECT_EQ(MAX_FAMILY_COUNT + 45 + j, familyMatch[j]);
+        }
+        EXPECT_EQ(families[MAX_FAMILY_COUNT + 45]->getFont(0),
+                  collection->getBestFont(text, runs[0], FontStyle()).font->get());
+    }
+}
+
 }  // namespace minikin
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/FontExtentCache.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/FontCollection.h"
+
+#include "FreeTypeMinikinFontForTest.h"
+#include "PathUtils.h"
+
+namespace minikin {
+
+class TestableFontExtentCache : public FontExtentCache {
+public:
+    TestableFontExtentCache(uint32_t maxEntries) : FontExtentCache(maxEntries) {}
+};
+
+namespace {
+
+// Counts the calls of GetFontExtent.
+class CountingFont : public FreeTypeMinikinFontForTest {
+public:
+    explicit CountingFont(const std::string& path) : FreeTypeMinikinFontForTest(path) {}
+
+    void GetFontExtent(MinikinExtent* extent, const MinikinPaint& paint,
+                       const FontFakery& fakery) const override {
+        count++;
+        FreeTypeMinikinFontForTest::GetFontExtent(extent, paint, fakery);
+    }
+
+    mutable uint32_t count = 0;
+};
+
+}  // namespace
+
+TEST(FontExtentCacheTest, extentReuseTest) {
+    auto font = std::make_shared<CountingFont>(getTestFontPath("LayoutTestFont.ttf"));
+    std::vector<std::shared_ptr<Font>> fonts = {Font::Builder(font).build()};
+    auto family = FontFamily::create(std::move(fonts));
+    const FakedFont fakedFont{family->getFontRef(0), FontFakery()};
+    MinikinPaint paint(FontCollection::create(family));
+    paint.size = 10.0f;
+    TestableFontExtentCache cache(10);
+
+    MinikinExtent expected;
+    font->GetFontExtent(&expected, paint, FontFakery());
+    font->count = 0;
+    EXPECT_EQ(expected, cache.getExtent(fakedFont, paint));
+    EXPECT_EQ(1u, font->count);
+    EXPECT_EQ(expected, cache.getExtent(fakedFont, paint));
+    EXPECT_EQ(1u, font->count);
+    EXPECT_EQ(1u, cache.getStats().getHitCount());
+
+    // The letter spacing doesn't change the extent.
+    MinikinPaint spacedPaint = paint;
+    spacedPaint.letterSpacing = 1.0f;
+    EXPECT_EQ(expected, cache.getExtent(fakedFont, spacedPaint));
+    EXPECT_EQ(1u, font->count);
+
+    // The extent of a different size is asked for again.
+    MinikinPaint largePaint = paint;
+    largePaint.size = 20.0f;
+    MinikinExtent largeExtent = cache.getExtent(fakedFont, largePaint);
+    EXPECT_EQ(2u, font->count);
+    EXPECT_EQ(expected.ascent * 2, largeExtent.ascent);
+    EXPECT_EQ(expected.descent * 2, largeExtent.descent);
+
+    // So is the extent of a fake bold font.
+    cache.getExtent(FakedFont{family->getFontRef(0), FontFakery(true, false)}, paint);
+    EXPECT_EQ(3u, font->count);
+}
+
+TEST(FontExtentCacheTest, evictionTest) {
+    auto font = std::make_shared<CountingFont>(getTestFontPath("LayoutTestFont.ttf"));
+    std::vector<std::shared_ptr<Font>> fonts = {Font::Builder(font).build()};
+    auto family = FontFamily::create(std::move(fonts));
+    const FakedFont fakedFont{family->getFontRef(0), FontFakery()};
+    MinikinPaint paint(FontCollection::create(family));
+    TestableFontExtentCache cache(2);
+
+    for (float size : {10.0f, 20.0f, 30.0f}) {
+        paint.size = size;
+        cache.getExtent(fakedFont, paint);
+    }
+    EXPECT_EQ(1u, cache.getStats().getEvictionCount());
+    font->count = 0;
+    // The size 10 is the oldest entry, so it has been evicted.
+    paint.size = 30.0f;
+    cache.getExtent(fakedFont, paint);
+    EXPECT_EQ(0u, font->count);
+    paint.size = 10.0f;
+    cache.getExtent(fakedFont, paint);
+    EXPECT_EQ(1u, font->count);
+}
+
+}  // namespace minikin
@@ -326,6 +326,19 @@ TEST(LocaleTest, ScriptMatchTest) {
     }
 }
 
+TEST(LocaleListTest, hbLanguageForScriptTest) {
+    const LocaleList& locales = createLocaleList("en-Latn,ja-Jpan,ko-Kore");
+    ASSERT_EQ(3u, locales.size());
+    EXPECT_EQ(locales.getHbLanguage(0), locales.getHbLanguageForScript(HB_TAG('L', 'a', 't', 'n')));
+    EXPECT_EQ(locales.getHbLanguage(1), locales.getHbLanguageForScript(HB_TAG('H', 'i', 'r', 'a')));
+    EXPECT_EQ(locales.getHbLanguage(2), locales.getHbLanguageForScript(HB_TAG('H', 'a', 'n', 'g')));
+    // The first locale supporting the script wins.
+    EXPECT_EQ(locales.getHbLanguage(1), locales.getHbLanguageForScript(HB_TAG('H', 'a', 'n', 'i')));
+    // The first locale is used for the scripts no locale supports.
+    EXPECT_EQ(locales.getHbLanguage(0), locales.getHbLanguageForScript(HB_TAG('A', 'r', 'a', 'b')));
+    EXPECT_NE(locales.getHbLanguage(0), locales.getHbLanguage(1));
+}
+
 TEST(LocaleListTest, basicTests) {
     LocaleList emptyLocales;
     EXPECT_EQ(0u, emptyLocales.size());
@@ -682,6 +695,32 @@ TEST_F(FontFamilyTest, createFamilyWithVariationTest) {
     }
 }
 
+TEST_F(FontFamilyTest, createFamilyWithVariationSharedCoverageTest) {
+    std::shared_ptr<FontFamily> multiAxisFamily = buildFontFamily("MultiAxis.ttf");
+    std::shared_ptr<FontFamily> noAxisFamily = buildFontFamily("Regular.ttf");
+
+    std::vector<FontVariation> variations = {{MinikinFont::MakeTag('w', 'd', 't', 'h'), 1.0f}};
+    std::shared_ptr<FontFamily> newFamily =
+            FontFamily::createFamilyWithVariation(multiAxisFamily, variations);
+    ASSERT_NE(nullptr, newFamily);
+    EXPECT_NE(multiAxisFamily, newFamily);
+    EXPECT_EQ(&multiAxisFamily->getCoverage(), &newFamily->getCoverage());
+    EXPECT_EQ(multiAxisFamily->hasVSTable(), newFamily->hasVSTable());
+    EXPECT_EQ(multiAxisFamily->getSupportedAxesCount(), newFamily->getSupportedAxesCount());
+    EXPECT_EQ(multiAxisFamily->localeListId(), newFamily->localeListId());
+    EXPECT_EQ(multiAxisFamily->variant(), newFamily->variant());
+
+    // A family derived from a derived family still refers to the original coverage.
+    std::vector<FontVariation> otherVariations = {
+            {MinikinFont::MakeTag('w', 'g', 'h', 't'), 1.0f}};
+    std::shared_ptr<FontFamily> otherFamily =
+            FontFamily::createFamilyWithVariation(newFamily, otherVariations);
+    ASSERT_NE(nullptr, otherFamily);
+    EXPECT_EQ(&multiAxisFamily->getCoverage(), &otherFamily->getCoverage());
+
+    EXPECT_EQ(nullptr, FontFamily::createFamilyWithVariation(noAxisFamily, variations));
+}
+
 TEST_F(FontFamilyTest, coverageTableSelectionTest) {
     // This font supports U+0061. The cmap subtable is format 4 and its platform ID is 0 and
     // encoding ID is 1.
@@ -820,6 +859,37 @@ TEST_F(FontFamilyTest, closestMatch) {
     }
 }
 
+TEST_F(FontFamilyTest, closestMatchMemoTest) {
+    std::vector<std::shared_ptr<Font>> fonts;
+    for (uint16_t weight : {100, 300, 400, 500, 700, 900}) {
+        for (FontStyle::Slant slant : {FontStyle::Slant::UPRIGHT, FontStyle::Slant::ITALIC}) {
+            std::shared_ptr<MinikinFont> font(
+                    new FreeTypeMinikinFontForTest(getTestFontPath("Ascii.ttf")));
+            fonts.push_back(Font::Builder(font).setStyle(FontStyle(weight, slant)).build());
+        }
+    }
+    std::vector<std::shared_ptr<Font>> fontsCopy = fonts;
+    std::shared_ptr<FontFamily> family = FontFamily::create(std::move(fonts));
+
+    // The weights 300 and 700 share a slot, so are 450 and 400. Each style is matched against a
+    // fresh family which has never seen any other style.
+    std::vector<FontStyle> styles;
+    for (uint16_t weight : {300, 700, 450, 400, 1000, 0, 300, 450, 700}) {
+        styles.emplace_back(weight, FontStyle::Slant::UPRIGHT);
+        styles.emplace_back(weight, FontStyle::Slant::ITALIC);
+    }
+    for (int round = 0; round < 2; ++round) {
+        for (FontStyle style : styles) {
+            std::vector<std::shared_ptr<Font>> freshFonts = fontsCopy;
+            std::shared_ptr<FontFamily> freshFamily = FontFamily::create(std::move(freshFonts));
+            FakedFont expected = freshFamily->getClosestMatch(style);
+            FakedFont actual = family->getClosestMatch(style);
+            EXPECT_EQ(expected.font.get(), actual.font.get()) << fontStyleToString(style);
+            EXPECT_EQ(expected.fakery, actual.fakery) << fontStyleToString(style);
+        }
+    }
+}
+
 std::vector<uint8_t> writeToBuffer(const std::vector<std::shared_ptr<FontFamily>>& families) {
     BufferWriter fakeWriter(nullptr);
     FontFamily::writeVector(&fakeWriter, families);
@@ -873,4 +943,24 @@ TEST_F(FontFamilyTest, bufferTest) {
     EXPECT_EQ(baseHeapSize, getHeapSize());
 }
 
+TEST_F(FontFamilyTest, bufferTest_lazyCoverage) {
+    FreeTypeMinikinFontForTestFactory::init();
+    std::vector<std::shared_ptr<FontFamily>> original = {
+            buildFontFamily(kVsTestFont),
+            buildFontFamily("MultiAxis.ttf"),
+    };
+    std::vector<uint8_t> buffer = writeToBuffer(original);
+    BufferReader reader(buffer.data());
+    FontFamily::setLazyCoverageEnabled(true);
+    std::vector<std::shared_ptr<FontFamily>> copied = FontFamily::readVector(&reader);
+    FontFamily::setLazyCoverageEnabled(false);
+    ASSERT_EQ(2u, copied.size());
+    // The coverages are skipped, so the families following them are read as before.
+    expectFontFamilyEquals(original[0], copied[0]);
+    expectFontFamilyEquals(original[1], copied[1]);
+    expectVSGlyphsForVsTestFont(copied[0].get());
+    EXPECT_TRUE(copied[1]->getCoverage().get('a'));
+    ASSERT_EQ(buffer, writeToBuffer(copied));
+}
+
 }  // namespace minikin
@@ -147,4 +147,46 @@ TEST_F(DefaultFontFeatureTest, palt_disable_chws_large_letter_spacing) {
     EXPECT_TRUE(f[2].value);
 }
 
+TEST_F(DefaultFontFeatureTest, cached) {
+    auto expectSameFeatures = [](const std::vector<hb_feature_t>& expected,
+                                 const std::vector<hb_feature_t>& actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(expected[i].tag, actual[i].tag);
+            EXPECT_EQ(expected[i].value, actual[i].value);
+        }
+    };
+    for (const char* settings : {"", "\"palt\" on", "\"chws\" off, \"ruby\" on"}) {
+        for (float letterSpacing : {0.0f, 1.0f}) {
+            auto paint = MinikinPaint(font);
+            paint.fontFeatureSettings = settings;
+            paint.letterSpacing = letterSpacing;
+
+            const std::vector<hb_feature_t>& f = getFontFeatures(paint);
+            expectSameFeatures(cleanAndAddDefaultFontFeatures(paint), f);
+            // The parsed features are shared.
+            EXPECT_EQ(&f, &getFontFeatures(paint));
+        }
+    }
+}
+
+TEST_F(DefaultFontFeatureTest, interned) {
+    auto paint = MinikinPaint(font);
+    EXPECT_EQ(0u, paint.fontFeatureSettings.getId());
+
+    // The settings are interned when set, so the paints compare by the ID.
+    paint.fontFeatureSettings = "\"palt\" on";
+    auto samePaint = MinikinPaint(font);
+    samePaint.fontFeatureSettings = std::string("\"palt\" ") + "on";
+    EXPECT_NE(0u, paint.fontFeatureSettings.getId());
+    EXPECT_EQ(paint.fontFeatureSettings.getId(), samePaint.fontFeatureSettings.getId());
+    EXPECT_TRUE(paint == samePaint);
+    EXPECT_EQ(paint.hash(), samePaint.hash());
+
+    samePaint.fontFeatureSettings = "\"halt\" on";
+    EXPECT_NE(paint.fontFeatureSettings.getId(), samePaint.fontFeatureSettings.getId());
+    EXPECT_FALSE(paint == samePaint);
+    EXPECT_EQ("\"halt\" on", samePaint.fontFeatureSettings.str());
+}
+
 }  // namespace minikin
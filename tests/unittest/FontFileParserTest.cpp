@@ -16,6 +16,8 @@
 
 #include "minikin/FontFileParser.h"
 
+#include <algorithm>
+
 #include <gtest/gtest.h>
 
 #include "FontTestUtils.h"
@@ -128,5 +130,96 @@ TEST(FontFileParserTest, parseFontForPSName) {
     EXPECT_EQ("SampleFont-Regular", psName.value());
 }
 
+static void expectSameMetadata(const void* buffer, size_t size, uint32_t index) {
+    const FontFileParser parser(buffer, size, index);
+    const FontFileParser::Metadata metadata = FontFileParser::readMetadata(buffer, size, index);
+    EXPECT_EQ(parser.getFontRevision(), metadata.fontRevision);
+    EXPECT_EQ(parser.getPostScriptName(), metadata.postScriptName);
+    EXPECT_EQ(parser.isPostScriptType1Font(), metadata.isPostScriptType1Font);
+}
+
+TEST(FontFileParserTest, readMetadata) {
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    const FontFileParser::Metadata metadata =
+            FontFileParser::readMetadata(minikinFont->GetFontData(), minikinFont->GetFontSize(), 0);
+    EXPECT_EQ(0x00010000u, metadata.fontRevision);
+    EXPECT_EQ("SampleFont-Regular", metadata.postScriptName);
+    EXPECT_EQ(false, metadata.isPostScriptType1Font);
+
+    for (const char* file : {"Ascii.ttf", "Bold.ttf", "Emoji.ttf", "Ja.ttf", "MultiAxis.ttf",
+                             "NoGlyphFont.ttf", "VariationSelectorTest-Regular.ttf"}) {
+        SCOPED_TRACE(file);
+        auto font = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath(file));
+        expectSameMetadata(font->GetFontData(), font->GetFontSize(), 0);
+    }
+
+    const char kNotFont[] = "This is not a font file.";
+    expectSameMetadata(kNotFont, sizeof(kNotFont), 0);
+    // Truncated in the table directory.
+    expectSameMetadata(minikinFont->GetFontData(), 20, 0);
+}
+
+TEST(FontFileParserTest, readMetadataFromCollection) {
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    const uint8_t* font = reinterpret_cast<const uint8_t*>(minikinFont->GetFontData());
+    const size_t fontSize = minikinFont->GetFontSize();
+
+    // A collection of the font only, moved after the 16 byte collection header.
+    constexpr size_t kHeaderSize = 16;
+    std::vector<uint8_t> ttc(kHeaderSize + fontSize);
+    size_t pos = writeU32(0x74746366, ttc.data(), 0);  // 'ttcf'
+    pos = writeU32(0x00010000, ttc.data(), pos);       // version
+    pos = writeU32(1, ttc.data(), pos);                // numFonts
+    writeU32(kHeaderSize, ttc.data(), pos);            // offset of the font
+    std::copy(font, font + fontSize, ttc.begin() + kHeaderSize);
+    const size_t numTables = font[4] << 8 | font[5];
+    for (size_t i = 0; i < numTables; ++i) {
+        const size_t offsetPos = kHeaderSize + 12 + i * 16 + 8;
+        const uint32_t offset = static_cast<uint32_t>(ttc[offsetPos]) << 24 |
+                                ttc[offsetPos + 1] << 16 | ttc[offsetPos + 2] << 8 |
+                                ttc[offsetPos + 3];
+        writeU32(offset + kHeaderSize, ttc.data(), offsetPos);
+    }
+
+    const FontFileParser::Metadata metadata =
+            FontFileParser::readMetadata(ttc.data(), ttc.size(), 0);
+    EXPECT_EQ(0x00010000u, metadata.fontRevision);
+    EXPECT_EQ("SampleFont-Regular", metadata.postScriptName);
+    expectSameMetadata(ttc.data(), ttc.size(), 0);
+    // Out of the collection.
+    expectSameMetadata(ttc.data(), ttc.size(), 1);
+}
+
+TEST(FontFileParserTest, getHotTableRanges) {
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    const void* data = minikinFont->GetFontData();
+    const size_t size = minikinFont->GetFontSize();
+    const std::vector<Range> ranges = FontFileParser::getHotTableRanges(data, size, 0);
+    ASSERT_FALSE(ranges.empty());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        EXPECT_FALSE(ranges[i].isEmpty());
+        EXPECT_LE(ranges[i].getEnd(), size);
+        if (i > 0) {
+            EXPECT_LE(ranges[i - 1].getStart(), ranges[i].getStart());
+        }
+    }
+
+    // The cmap table is one of them.
+    HbBlobUniquePtr blob(hb_blob_create(static_cast<const char*>(data), size,
+                                        HB_MEMORY_MODE_READONLY, nullptr, nullptr));
+    HbFaceUniquePtr face(hb_face_create(blob.get(), 0));
+    HbBlobUniquePtr cmap(hb_face_reference_table(face.get(), HB_TAG('c', 'm', 'a', 'p')));
+    unsigned int cmapLength = 0;
+    const char* cmapData = hb_blob_get_data(cmap.get(), &cmapLength);
+    ASSERT_NE(0u, cmapLength);
+    const Range cmapRange(cmapData - static_cast<const char*>(data),
+                          cmapData - static_cast<const char*>(data) + cmapLength);
+    EXPECT_NE(ranges.end(), std::find(ranges.begin(), ranges.end(), cmapRange));
+
+    // Not a font.
+    const std::vector<uint8_t> garbage(64, 0xAB);
+    EXPECT_TRUE(FontFileParser::getHotTableRanges(garbage.data(), garbage.size(), 0).empty());
+}
+
 }  // namespace
 }  // namespace minikin
@@ -18,6 +18,10 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "minikin/LocaleList.h"
 
 #include "LocaleListCache.h"
@@ -82,4 +86,37 @@ TEST(LocaleListCacheTest, buffer) {
     }
 }
 
+TEST(LocaleListCacheTest, getById_manyLists) {
+    // More lists than the first chunk holds, so that the lists of several chunks are read.
+    std::vector<std::pair<std::string, const LocaleList*>> lists;
+    for (int i = 0; i < 200; ++i) {
+        const std::string region = std::to_string(100 + i);
+        lists.emplace_back(region, &LocaleListCache::getById(
+                                           LocaleListCache::getId("en-" + region + ",ja")));
+    }
+    const Locale& japanese = LocaleListCache::getById(LocaleListCache::getId("ja"))[0];
+    for (const auto& [region, list] : lists) {
+        // The lists added since then haven't moved the list.
+        EXPECT_EQ(list, &LocaleListCache::getById(LocaleListCache::getId("en-" + region + ",ja")));
+        ASSERT_EQ(2UL, list->size());
+        EXPECT_EQ(LocaleListCache::getById(LocaleListCache::getId("en-" + region))[0], (*list)[0])
+                << "region = " << region;
+        EXPECT_EQ(japanese, (*list)[1]);
+    }
+}
+
+TEST(LocaleListCacheTest, getId_manyStrings) {
+    // More strings than the lock-free table takes, so that some are found with the lock held.
+    std::vector<std::pair<std::string, uint32_t>> ids;
+    for (int i = 0; i < 1000; ++i) {
+        const std::string locales = "en,ja,x-test" + std::to_string(i);
+        ids.emplace_back(locales, LocaleListCache::getId(locales));
+    }
+    const Locale& english = LocaleListCache::getById(LocaleListCache::getId("en"))[0];
+    for (const auto& [locales, id] : ids) {
+        EXPECT_EQ(id, LocaleListCache::getId(locales)) << "locales = " << locales;
+        EXPECT_EQ(english, LocaleListCache::getById(id)[0]) << "locales = " << locales;
+    }
+}
+
 }  // namespace minikin
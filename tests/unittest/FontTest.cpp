@@ -16,7 +16,12 @@
 
 #include "minikin/Font.h"
 
+#include <thread>
+
 #include <gtest/gtest.h>
+#include <hb.h>
+
+#include "minikin/Characters.h"
 
 #include "BufferUtils.h"
 #include "FontTestUtils.h"
@@ -56,6 +61,130 @@ TEST(FontTest, BufferTest) {
     EXPECT_EQ(buffer, newBuffer);
 }
 
+TEST(FontTest, SimpleAsciiGlyphsTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    {
+        // Ascii.ttf has no layout tables and supports all the printable ASCII characters.
+        auto minikinFont =
+                std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+        std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+        const SimpleAsciiGlyphs* glyphs = font->getSimpleAsciiGlyphs();
+        ASSERT_NE(nullptr, glyphs);
+        EXPECT_TRUE(glyphs->isSimple);
+        for (uint32_t c = SimpleAsciiGlyphs::kFirst; c <= SimpleAsciiGlyphs::kLast; ++c) {
+            EXPECT_NE(0u, glyphs->glyphIds[c - SimpleAsciiGlyphs::kFirst]) << c;
+        }
+        // The result is computed only once.
+        EXPECT_EQ(glyphs, font->getSimpleAsciiGlyphs());
+    }
+    {
+        // Ligature.ttf has a GSUB table.
+        auto minikinFont =
+                std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ligature.ttf"));
+        std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+        EXPECT_EQ(nullptr, font->getSimpleAsciiGlyphs());
+    }
+}
+
+TEST(FontTest, getHyphenCharTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    {
+        // Ascii.ttf supports U+2010 HYPHEN but none of the script specific hyphens.
+        auto minikinFont =
+                std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+        std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+        EXPECT_EQ(CHAR_HYPHEN, font->getHyphenChar(CHAR_HYPHEN));
+        EXPECT_EQ(CHAR_HYPHEN, font->getHyphenChar(CHAR_ARMENIAN_HYPHEN));
+        EXPECT_EQ(CHAR_HYPHEN, font->getHyphenChar(CHAR_MAQAF));
+        EXPECT_EQ(CHAR_HYPHEN, font->getHyphenChar(CHAR_UCAS_HYPHEN));
+        // The other characters are never replaced.
+        EXPECT_EQ(CHAR_ZWJ, font->getHyphenChar(CHAR_ZWJ));
+    }
+    {
+        // Bold.ttf doesn't support U+2010 HYPHEN.
+        auto minikinFont =
+                std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Bold.ttf"));
+        std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+        EXPECT_EQ(0x002Du, font->getHyphenChar(CHAR_HYPHEN));
+        EXPECT_EQ(0x002Du, font->getHyphenChar(CHAR_ARMENIAN_HYPHEN));
+        EXPECT_EQ(CHAR_ZWJ, font->getHyphenChar(CHAR_ZWJ));
+    }
+}
+
+TEST(FontTest, isColorBitmapFontTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+    EXPECT_FALSE(font->isColorBitmapFont());
+    // The cached value is returned from the second call.
+    EXPECT_FALSE(font->isColorBitmapFont());
+}
+
+TEST(FontTest, getSupportedAxesTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    const AxisTag wdth = MinikinFont::MakeTag('w', 'd', 't', 'h');
+    const AxisTag wght = MinikinFont::MakeTag('w', 'g', 'h', 't');
+    {
+        auto minikinFont =
+                std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+        std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+        EXPECT_TRUE(font->getSupportedAxes().empty());
+        EXPECT_FALSE(font->isAxisSupported(wght));
+    }
+    {
+        auto minikinFont =
+                std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("MultiAxis.ttf"));
+        std::shared_ptr<Font> original = Font::Builder(minikinFont).build();
+        // Sorted.
+        EXPECT_EQ(std::vector<AxisTag>({wdth, wght}), original->getSupportedAxes().toVector());
+        EXPECT_TRUE(original->isAxisSupported(wdth));
+        EXPECT_TRUE(original->isAxisSupported(wght));
+        EXPECT_FALSE(original->isAxisSupported(MinikinFont::MakeTag('s', 'l', 'n', 't')));
+
+        // The axes are read from the buffer without creating the typeface.
+        std::vector<uint8_t> buffer = writeToBuffer<Font>(*original);
+        BufferReader reader(buffer.data());
+        Font font(&reader);
+        EXPECT_EQ(original->getSupportedAxes(), font.getSupportedAxes());
+        EXPECT_EQ(nullptr, font.mExternalRefsHolder.load());
+    }
+}
+
+TEST(FontTest, createFontWithVariationTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto minikinFont =
+            std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("MultiAxis.ttf"));
+    std::shared_ptr<Font> font = Font::Builder(minikinFont).build();
+    const std::vector<FontVariation> bold = {{MinikinFont::MakeTag('w', 'g', 'h', 't'), 700.0f}};
+    const std::vector<FontVariation> light = {{MinikinFont::MakeTag('w', 'g', 'h', 't'), 300.0f}};
+
+    std::shared_ptr<Font> boldFont = font->createFontWithVariation(bold);
+    ASSERT_NE(nullptr, boldFont);
+    EXPECT_EQ(font->style(), boldFont->style());
+    EXPECT_EQ(font->getSupportedAxes(), boldFont->getSupportedAxes());
+    // The face is shared with the original font.
+    EXPECT_EQ(hb_font_get_face(font->baseFont().get()),
+              hb_font_get_face(boldFont->baseFont().get()));
+    EXPECT_NE(font->baseFont(), boldFont->baseFont());
+
+    // The same variations share the instanced HarfBuzz font.
+    std::shared_ptr<Font> lightFont = font->createFontWithVariation(light);
+    ASSERT_NE(nullptr, lightFont);
+    EXPECT_NE(boldFont->baseFont(), lightFont->baseFont());
+    std::shared_ptr<Font> boldFont2 = font->createFontWithVariation(bold);
+    ASSERT_NE(nullptr, boldFont2);
+    EXPECT_NE(boldFont, boldFont2);
+    EXPECT_EQ(boldFont->baseFont(), boldFont2->baseFont());
+
+    // The instanced fonts outlive the original font.
+    const hb_font_t* boldBaseFont = boldFont->baseFont().get();
+    font.reset();
+    boldFont2.reset();
+    EXPECT_EQ(boldBaseFont, boldFont->baseFont().get());
+    hb_codepoint_t glyph;
+    EXPECT_TRUE(hb_font_get_nominal_glyph(boldFont->baseFont().get(), 'a', &glyph));
+}
+
 TEST(FontTest, MoveConstructorTest) {
     FreeTypeMinikinFontForTestFactory::init();
     // Note: by definition, only BufferReader-based Font can be moved.
@@ -141,4 +270,111 @@ TEST(FontTest, MoveAssignmentTest) {
     EXPECT_EQ(baseHeapSize, getHeapSize());
 }
 
+TEST(FontTest, warmUpTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    std::shared_ptr<Font> original = Font::Builder(minikinFont).build();
+    std::vector<uint8_t> buffer = writeToBuffer<Font>(*original);
+
+    BufferReader reader(buffer.data());
+    auto font = std::make_shared<Font>(&reader);
+    BufferReader reader2(buffer.data());
+    auto otherFont = std::make_shared<Font>(&reader2);
+    ASSERT_EQ(nullptr, font->mExternalRefsHolder.load());
+    ASSERT_EQ(nullptr, otherFont->mExternalRefsHolder.load());
+
+    std::shared_future<void> done = Font::warmUpAsync({font, otherFont});
+    done.wait();
+    const Font::ExternalRefs* refs = font->mExternalRefsHolder.load();
+    EXPECT_NE(nullptr, refs);
+    EXPECT_NE(nullptr, otherFont->mExternalRefsHolder.load());
+    // The warmed up objects are used by the layout.
+    EXPECT_EQ(refs->mTypeface, font->typeface());
+    EXPECT_EQ(refs, font->mExternalRefsHolder.load());
+}
+
+TEST(FontTest, concurrentExternalRefsTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    std::shared_ptr<Font> original = Font::Builder(minikinFont).build();
+    std::vector<uint8_t> buffer = writeToBuffer<Font>(*original);
+
+    BufferReader reader(buffer.data());
+    Font font(&reader);
+    std::vector<const MinikinFont*> typefaces(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < typefaces.size(); ++i) {
+        threads.emplace_back([&font, &typefaces, i] { typefaces[i] = font.typeface().get(); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const MinikinFont* typeface : typefaces) {
+        EXPECT_EQ(font.typeface().get(), typeface);
+    }
+}
+
+TEST(FontTest, releaseIdleExternalRefsTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    std::shared_ptr<Font> original = Font::Builder(minikinFont).build();
+    std::vector<uint8_t> buffer = writeToBuffer<Font>(*original);
+
+    BufferReader reader(buffer.data());
+    Font font(&reader);
+    BufferReader reader2(buffer.data());
+    Font idleFont(&reader2);
+    font.typeface();
+    idleFont.typeface();
+
+    // Both are used since the last call.
+    Font::releaseIdleExternalRefs();
+    EXPECT_NE(nullptr, font.mExternalRefsHolder.load());
+    EXPECT_NE(nullptr, idleFont.mExternalRefsHolder.load());
+
+    // Only the idle one is released.
+    font.typeface();
+    EXPECT_LE(1u, Font::releaseIdleExternalRefs());
+    EXPECT_NE(nullptr, font.mExternalRefsHolder.load());
+    EXPECT_EQ(nullptr, idleFont.mExternalRefsHolder.load());
+
+    // It is created again on the next use.
+    EXPECT_NE(nullptr, idleFont.typeface());
+    EXPECT_NE(nullptr, idleFont.baseFont());
+    EXPECT_NE(nullptr, idleFont.mExternalRefsHolder.load());
+
+    // The fonts built from a typeface are never released.
+    original->typeface();
+    Font::releaseIdleExternalRefs();
+    Font::releaseIdleExternalRefs();
+    EXPECT_NE(nullptr, original->mExternalRefsHolder.load());
+    EXPECT_EQ(minikinFont, original->typeface());
+}
+
+TEST(FontTest, releaseIdleExternalRefsGuardTest) {
+    FreeTypeMinikinFontForTestFactory::init();
+    auto minikinFont = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    std::shared_ptr<Font> original = Font::Builder(minikinFont).build();
+    std::vector<uint8_t> buffer = writeToBuffer<Font>(*original);
+
+    BufferReader reader(buffer.data());
+    Font font(&reader);
+    std::weak_ptr<MinikinFont> weakTypeface;
+    {
+        Font::ExternalRefsGuard guard;
+        const std::shared_ptr<MinikinFont>& typeface = font.typeface();
+        weakTypeface = typeface;
+        // Released by the second call, and not deleted by the later ones while the guard is alive.
+        for (int i = 0; i < 4; ++i) {
+            Font::releaseIdleExternalRefs();
+        }
+        EXPECT_EQ(nullptr, font.mExternalRefsHolder.load());
+        EXPECT_FALSE(weakTypeface.expired());
+        EXPECT_EQ(minikinFont->GetFontSize(), typeface->GetFontSize());
+    }
+    // Deleted by the next call once the guard is gone.
+    Font::releaseIdleExternalRefs();
+    EXPECT_TRUE(weakTypeface.expired());
+}
+
 }  // namespace minikin
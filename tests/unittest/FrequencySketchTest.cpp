@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/FrequencySketch.h"
+
+#include <gtest/gtest.h>
+
+namespace minikin {
+
+TEST(FrequencySketchTest, incrementTest) {
+    FrequencySketch sketch(100);
+    EXPECT_EQ(0u, sketch.frequency(1));
+    EXPECT_EQ(1u, sketch.increment(1));
+    EXPECT_EQ(2u, sketch.increment(1));
+    EXPECT_EQ(2u, sketch.frequency(1));
+    EXPECT_EQ(1u, sketch.increment(2));
+    EXPECT_EQ(2u, sketch.frequency(1));
+}
+
+TEST(FrequencySketchTest, saturationTest) {
+    FrequencySketch sketch(100);
+    for (uint32_t i = 0; i < FrequencySketch::kMaxCount + 5; ++i) {
+        sketch.increment(1);
+    }
+    EXPECT_EQ(FrequencySketch::kMaxCount, sketch.frequency(1));
+}
+
+TEST(FrequencySketchTest, halvingTest) {
+    FrequencySketch sketch(100);
+    ASSERT_EQ(100u, sketch.getSampleSize());
+    for (uint32_t i = 0; i < 8; ++i) {
+        sketch.increment(1);
+    }
+    EXPECT_EQ(8u, sketch.frequency(1));
+    // The unique keys fill the rest of the sample, which halves the counts.
+    for (uint32_t i = 0; i < sketch.getSampleSize() - 8; ++i) {
+        sketch.increment(1000 + i);
+    }
+    EXPECT_EQ(4u, sketch.frequency(1));
+}
+
+TEST(FrequencySketchTest, scanTest) {
+    // A single pass over unique keys leaves almost all of them below 2.
+    FrequencySketch sketch(1000);
+    uint32_t repeated = 0;
+    for (uint32_t i = 0; i < sketch.getSampleSize() - 1; ++i) {
+        if (sketch.increment(i * 2654435761u) >= 2) {
+            repeated++;
+        }
+    }
+    EXPECT_GT(sketch.getSampleSize() / 10, repeated);
+}
+
+TEST(FrequencySketchTest, clearTest) {
+    FrequencySketch sketch(100);
+    sketch.increment(1);
+    sketch.increment(1);
+    sketch.clear();
+    EXPECT_EQ(0u, sketch.frequency(1));
+}
+
+}  // namespace minikin
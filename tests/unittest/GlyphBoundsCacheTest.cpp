@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/GlyphBoundsCache.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/FontCollection.h"
+
+#include "FreeTypeMinikinFontForTest.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+class TestableGlyphBoundsCache : public GlyphBoundsCache {
+public:
+    TestableGlyphBoundsCache(uint32_t maxEntries) : GlyphBoundsCache(maxEntries) {}
+};
+
+namespace {
+
+// Counts the glyphs whose bounds are asked for.
+class CountingFont : public FreeTypeMinikinFontForTest {
+public:
+    explicit CountingFont(const std::string& path) : FreeTypeMinikinFontForTest(path) {}
+
+    void GetBounds(MinikinRect* bounds, uint32_t glyphId, const MinikinPaint& paint,
+                   const FontFakery& fakery) const override {
+        count++;
+        FreeTypeMinikinFontForTest::GetBounds(bounds, glyphId, paint, fakery);
+    }
+
+    mutable uint32_t count = 0;
+};
+
+LayoutPiece buildLayout(const std::string& text, const MinikinPaint& paint) {
+    auto utf16 = utf8ToUtf16(text);
+    return LayoutPiece(utf16, Range(0, utf16.size()), false /* rtl */, paint,
+                       StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+}
+
+}  // namespace
+
+TEST(GlyphBoundsCacheTest, glyphReuseTest) {
+    auto font = std::make_shared<CountingFont>(getTestFontPath("LayoutTestFont.ttf"));
+    std::vector<std::shared_ptr<Font>> fonts = {Font::Builder(font).build()};
+    MinikinPaint paint(FontCollection::create(FontFamily::create(std::move(fonts))));
+    paint.size = 10.0f;
+    TestableGlyphBoundsCache cache(10);
+
+    const LayoutPiece first = buildLayout("IVX", paint);
+    const MinikinRect firstBounds = cache.calculateBounds(first, paint);
+    EXPECT_EQ(3u, font->count);
+
+    // A new text of the same glyphs is answered by the cache, with the same bounds as the fonts
+    // give.
+    const LayoutPiece second = buildLayout("XVII", paint);
+    TestableGlyphBoundsCache emptyCache(10);
+    const MinikinRect expected = emptyCache.calculateBounds(second, paint);
+    font->count = 0;
+    EXPECT_EQ(expected, cache.calculateBounds(second, paint));
+    EXPECT_EQ(0u, font->count);
+    EXPECT_EQ(firstBounds, cache.calculateBounds(first, paint));
+    EXPECT_EQ(0u, font->count);
+
+    // The glyphs of a different size are looked up again.
+    MinikinPaint largePaint = paint;
+    largePaint.size = 20.0f;
+    cache.calculateBounds(buildLayout("IVX", largePaint), largePaint);
+    EXPECT_EQ(3u, font->count);
+}
+
+TEST(GlyphBoundsCacheTest, evictionTest) {
+    auto font = std::make_shared<CountingFont>(getTestFontPath("LayoutTestFont.ttf"));
+    std::vector<std::shared_ptr<Font>> fonts = {Font::Builder(font).build()};
+    MinikinPaint paint(FontCollection::create(FontFamily::create(std::move(fonts))));
+    paint.size = 10.0f;
+    TestableGlyphBoundsCache cache(2);
+
+    cache.calculateBounds(buildLayout("IVX", paint), paint);
+    EXPECT_EQ(1u, cache.getStats().getEvictionCount());
+    font->count = 0;
+    // I is the oldest glyph, so it has been evicted.
+    cache.calculateBounds(buildLayout("VX", paint), paint);
+    EXPECT_EQ(0u, font->count);
+    cache.calculateBounds(buildLayout("I", paint), paint);
+    EXPECT_EQ(1u, font->count);
+}
+
+}  // namespace minikin
@@ -233,6 +233,15 @@ TEST(GraphemeBreak, tailoring) {
     EXPECT_TRUE(IsBreak("U+0628 U+200D | U+2764"));
 }
 
+TEST(GraphemeBreak, propertiesBeyondFirstPlanes) {
+    // The properties above U+1FFFF are looked up in ICU instead of the table.
+    EXPECT_FALSE(IsBreak("U+20000 | U+0301"));         // ideograph + combining acute accent
+    EXPECT_TRUE(IsBreak("U+20000 | U+20001"));         // two ideographs
+    EXPECT_FALSE(IsBreak("U+0915 U+094D | U+20000"));  // virama + other letter
+    EXPECT_FALSE(IsBreak("U+20000 | U+E0041"));        // tag character
+    EXPECT_TRUE(IsBreak("U+E0041 | U+20000"));
+}
+
 TEST(GraphemeBreak, emojiModifiers) {
     EXPECT_FALSE(IsBreak("U+261D | U+1F3FB"));   // white up pointing index + modifier
     EXPECT_FALSE(IsBreak("U+270C | U+1F3FB"));   // victory hand + modifier
@@ -317,4 +326,48 @@ TEST(GraphemeBreak, startWithZWJ) {
     IsBreak("U+200D | U+1F5E8");  // UB sanitizer will catch if minikin looks the char before ZWJ
 }
 
+// Compares getGraphemeBreaks() with isGraphemeBreak() at every offset of the range.
+void expectSameBreaks(const float* advances, const std::vector<uint16_t>& text, size_t start,
+                      size_t count) {
+    std::vector<bool> breaks;
+    GraphemeBreak::getGraphemeBreaks(advances, text.data(), start, count, &breaks);
+    ASSERT_EQ(count + 1, breaks.size());
+    for (size_t i = start; i <= start + count; ++i) {
+        EXPECT_EQ(GraphemeBreak::isGraphemeBreak(advances, text.data(), start, count, i),
+                  breaks[i - start])
+                << "offset " << i;
+    }
+}
+
+TEST(GraphemeBreak, getGraphemeBreaks) {
+    const std::vector<uint16_t> text = utf8ToUtf16(
+            "a\r\n\u0301\u1100\u1161\u11A8\u0915\u094D\u0915\U0001F469\u0301\u200D"
+            "\U0001F4BC\U0001F1FA\U0001F1F8\U0001F1EF\u200D\U0001F5E8");
+    for (size_t start = 0; start < text.size(); ++start) {
+        for (size_t count = 0; start + count <= text.size(); ++count) {
+            expectSameBreaks(nullptr, text, start, count);
+        }
+    }
+    std::vector<float> advances(text.size(), 0.0f);
+    for (size_t i = 0; i < advances.size(); i += 3) {
+        advances[i] = 1.0f;
+    }
+    expectSameBreaks(advances.data(), text, 0, text.size());
+
+    // Invalid UTF-16 and a range starting in the middle of a surrogate pair.
+    const std::vector<uint16_t> invalid = {0xDC00, 0xD800, 'a', 0xD83C, 0xDDFA, 0xD800, 0xDC00};
+    for (size_t start = 0; start < invalid.size(); ++start) {
+        expectSameBreaks(nullptr, invalid, start, invalid.size() - start);
+    }
+
+    // Regional indicators beyond the look back of 1000 code units.
+    std::vector<uint16_t> flags;
+    for (size_t i = 0; i < 1001; ++i) {
+        flags.push_back(0xD83C);
+        flags.push_back(0xDDE6 + i % 26);
+    }
+    expectSameBreaks(nullptr, flags, 0, flags.size());
+    expectSameBreaks(nullptr, flags, 2, flags.size() - 2);
+}
+
 }  // namespace minikin
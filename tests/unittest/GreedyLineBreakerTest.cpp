@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <cstring>
 #include <memory>
+#include <string>
 
 #include <gtest/gtest.h>
 
@@ -909,6 +911,31 @@ TEST_F(GreedyLineBreakerTest, CrashFix_Space_Tab) {
     }
 }
 
+TEST_F(GreedyLineBreakerTest, TabStops_nextTab) {
+    {
+        const float stops[] = {10, 25, 25, 40};
+        TabStops tabStops(stops, 4, 100);
+        EXPECT_EQ(10, tabStops.nextTab(0));
+        EXPECT_EQ(25, tabStops.nextTab(10));
+        EXPECT_EQ(25, tabStops.nextTab(24.5));
+        EXPECT_EQ(40, tabStops.nextTab(25));
+        EXPECT_EQ(100, tabStops.nextTab(40));
+        EXPECT_EQ(200, tabStops.nextTab(150));
+    }
+    {
+        // Unsorted stops keep returning the first stop after the given width in array order.
+        const float stops[] = {30, 10, 20};
+        TabStops tabStops(stops, 3, 100);
+        EXPECT_EQ(30, tabStops.nextTab(0));
+        EXPECT_EQ(30, tabStops.nextTab(15));
+        EXPECT_EQ(100, tabStops.nextTab(30));
+    }
+    {
+        TabStops tabStops(nullptr, 0, 0);
+        EXPECT_EQ(0, tabStops.nextTab(15));
+    }
+}
+
 TEST_F(GreedyLineBreakerTest, ExtentTest) {
     constexpr bool NO_HYPHEN = false;  // No hyphenation in this test case.
     const std::vector<uint16_t> textBuf = utf8ToUtf16("The \u3042\u3044\u3046 is Japanese.");
@@ -1589,5 +1616,200 @@ TEST_F(GreedyLineBreakerTest, testControllCharAfterSpace) {
                                                    << toString(textBuf, actual);
     }
 }
+
+TEST_F(GreedyLineBreakerTest, wordBreakRecording) {
+    const std::vector<uint16_t> textBuf =
+            utf8ToUtf16("This is an example text, see http://example.com/a/b for hyphenation.");
+    for (float lineWidth : {50.0f, 100.0f, 150.0f, 1000.0f}) {
+        for (bool doHyphenation : {false, true}) {
+            SCOPED_TRACE(lineWidth);
+            LineBreakResult expected = doLineBreak(textBuf, doHyphenation, lineWidth);
+            MeasuredText::setWordBreakRecordingEnabled(true);
+            LineBreakResult actual = doLineBreak(textBuf, doHyphenation, lineWidth);
+            MeasuredText::setWordBreakRecordingEnabled(false);
+            EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+            EXPECT_EQ(expected.widths, actual.widths);
+            EXPECT_EQ(expected.flags, actual.flags);
+        }
+    }
+}
+
+TEST_F(GreedyLineBreakerTest, desperateBreakWithPrefixSums) {
+    constexpr float CHAR_WIDTH = 10.0;
+    const std::vector<uint16_t> textBuf = utf8ToUtf16(
+            "see https://example.com/0123456789abcdef0123456789abcdef0123456789abcdef and "
+            "あいうえおあいうえおあいう");
+    auto build = [&](bool computeHyphenation) {
+        MeasuredTextBuilder builder;
+        builder.addCustomRun<ConstantRun>(Range(0, 77), "en-US", CHAR_WIDTH, ASCENT, DESCENT);
+        builder.addCustomRun<ConstantRun>(Range(77, textBuf.size()), "ja-JP", CHAR_WIDTH, ASCENT,
+                                          DESCENT);
+        return builder.build(textBuf, computeHyphenation, false /* compute full layout */,
+                             false /* ignore kerning */, nullptr /* no hint */);
+    };
+    // The desperate breaks are binary searched in the prefix sums, which are only built with the
+    // hyphenation.
+    std::unique_ptr<MeasuredText> scanned = build(false /* compute hyphenation */);
+    std::unique_ptr<MeasuredText> searched = build(true /* compute hyphenation */);
+    ASSERT_TRUE(scanned->widthPrefixSums.empty());
+    ASSERT_FALSE(searched->widthPrefixSums.empty());
+
+    TabStops tabStops(nullptr, 0, CHAR_WIDTH);
+    for (float lineWidth : {0.0f, 5.0f, 10.0f, 35.0f, 100.0f, 1000.0f}) {
+        SCOPED_TRACE(lineWidth);
+        RectangleLineWidth rectangleLineWidth(lineWidth);
+        LineBreakResult expected = breakLineGreedy(textBuf, *scanned, rectangleLineWidth,
+                                                   tabStops, false /* do hyphenation */);
+        LineBreakResult actual = breakLineGreedy(textBuf, *searched, rectangleLineWidth, tabStops,
+                                                 false /* do hyphenation */);
+        EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+        EXPECT_EQ(expected.widths, actual.widths);
+        EXPECT_EQ(expected.flags, actual.flags);
+    }
+}
+
+TEST_F(GreedyLineBreakerTest, maxLines) {
+    const std::vector<uint16_t> textBuf =
+            utf8ToUtf16("This is an example text, see http://example.com/a/b for hyphenation.");
+    MeasuredTextBuilder builder;
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;  // Make 1em=10px
+    paint.localeListId = LocaleListCache::getId("en-US");
+    builder.addStyleRun(0, textBuf.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false);
+    std::unique_ptr<MeasuredText> measuredText =
+            builder.build(textBuf, false /* compute hyphenation */, false /* compute full layout */,
+                          false /* ignore kerning */, nullptr /* no hint */);
+    TabStops tabStops(nullptr, 0, 10);
+    for (float lineWidth : {50.0f, 100.0f, 1000.0f}) {
+        SCOPED_TRACE(lineWidth);
+        RectangleLineWidth rectangleLineWidth(lineWidth);
+        LineBreakResult full = breakLineGreedy(textBuf, *measuredText, rectangleLineWidth,
+                                               tabStops, true /* do hyphenation */);
+        EXPECT_EQ(full.breakPoints.size(),
+                  countLinesGreedy(textBuf, *measuredText, rectangleLineWidth, tabStops,
+                                   true /* do hyphenation */));
+        for (uint32_t maxLines : {0u, 1u, 2u, 100u}) {
+            SCOPED_TRACE(maxLines);
+            LineBreakResult actual = breakLineGreedy(textBuf, *measuredText, rectangleLineWidth,
+                                                     tabStops, true /* do hyphenation */, maxLines);
+            const size_t lineCount = std::min<size_t>(maxLines, full.breakPoints.size());
+            ASSERT_EQ(lineCount, actual.breakPoints.size());
+            for (size_t i = 0; i < lineCount; ++i) {
+                EXPECT_EQ(full.breakPoints[i], actual.breakPoints[i]);
+                EXPECT_EQ(full.widths[i], actual.widths[i]);
+                EXPECT_EQ(full.ascents[i], actual.ascents[i]);
+                EXPECT_EQ(full.descents[i], actual.descents[i]);
+                EXPECT_EQ(full.flags[i], actual.flags[i]);
+            }
+        }
+    }
+}
+
+TEST_F(GreedyLineBreakerTest, deferredLineExtents) {
+    const std::vector<uint16_t> textBuf =
+            utf8ToUtf16("The \u3042\u3044\u3046 is Japanese. This is an example text.");
+    std::vector<std::shared_ptr<FontFamily>> families = {buildFontFamily("Ascii.ttf"),
+                                                         buildFontFamily("CustomExtent.ttf")};
+    std::shared_ptr<FontCollection> fc = FontCollection::create(families);
+    auto build = [&]() {
+        MeasuredTextBuilder builder;
+        MinikinPaint paint(fc);
+        paint.size = 10.0f;  // Make 1em=10px
+        paint.localeListId = LocaleListCache::getId("en-US");
+        builder.addStyleRun(0, textBuf.size(), std::move(paint), (int)LineBreakStyle::None,
+                            (int)LineBreakWordStyle::None, false);
+        return builder.build(textBuf, false /* compute hyphenation */,
+                             false /* compute full layout */, false /* ignore kerning */,
+                             nullptr /* no hint */);
+    };
+    std::unique_ptr<MeasuredText> eager = build();
+    MeasuredText::setDeferredLineExtentsEnabled(true);
+    std::unique_ptr<MeasuredText> deferred = build();
+    MeasuredText::setDeferredLineExtentsEnabled(false);
+
+    TabStops tabStops(nullptr, 0, 10);
+    for (float lineWidth : {50.0f, 100.0f, 1000.0f}) {
+        SCOPED_TRACE(lineWidth);
+        RectangleLineWidth rectangleLineWidth(lineWidth);
+        LineBreakResult expected = breakLineGreedy(textBuf, *eager, rectangleLineWidth, tabStops,
+                                                   false /* do hyphenation */);
+        LineBreakResult actual = breakLineGreedy(textBuf, *deferred, rectangleLineWidth,
+                                                 tabStops, false /* do hyphenation */);
+        EXPECT_TRUE(actual.hasDeferredExtents());
+        EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+        EXPECT_EQ(expected.widths, actual.widths);
+        EXPECT_EQ(expected.flags, actual.flags);
+        EXPECT_TRUE(actual.ascents.empty());
+        EXPECT_TRUE(actual.descents.empty());
+        for (size_t i = 0; i < actual.breakPoints.size(); ++i) {
+            EXPECT_EQ(MinikinExtent(expected.ascents[i], expected.descents[i]),
+                      actual.getLineExtent(i, textBuf, *deferred));
+        }
+    }
+}
+
+TEST_F(GreedyLineBreakerTest, incrementalBreak) {
+    const std::string text =
+            "This is an example text, see http://example.com/a/b for hyphenation. The quick "
+            "brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog.";
+    struct Edit {
+        uint32_t offset;
+        uint32_t removedLength;
+        const char* inserted;
+    };
+    const std::vector<Edit> edits = {
+            {0, 0, "A "},         // Before the first line.
+            {52, 0, "very "},     // In the middle.
+            {52, 4, ""},          // Remove a word.
+            {36, 7, "ex"},        // In the URL.
+            {25, 26, "x"},        // Remove the URL.
+            {104, 0, "black "},   // Near the end.
+            {154, 4, "cat."},     // At the end.
+            {4, 0, "  "},         // Spaces only.
+            {0, 150, "Short. "},  // Almost everything.
+    };
+    auto build = [](const std::vector<uint16_t>& textBuf) {
+        MeasuredTextBuilder builder;
+        MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+        paint.size = 10.0f;  // Make 1em=10px
+        paint.localeListId = LocaleListCache::getId("en-US");
+        builder.addStyleRun(0, textBuf.size(), std::move(paint), (int)LineBreakStyle::None,
+                            (int)LineBreakWordStyle::None, false);
+        return builder.build(textBuf, false /* compute hyphenation */,
+                             false /* compute full layout */, false /* ignore kerning */,
+                             nullptr /* no hint */);
+    };
+    const std::vector<uint16_t> oldText = utf8ToUtf16(text);
+    std::unique_ptr<MeasuredText> oldMeasured = build(oldText);
+    TabStops tabStops(nullptr, 0, 10);
+    for (float lineWidth : {50.0f, 100.0f, 300.0f, 1000.0f}) {
+        RectangleLineWidth rectangleLineWidth(lineWidth);
+        LineBreakResult prev = breakLineGreedy(oldText, *oldMeasured, rectangleLineWidth,
+                                               tabStops, true /* do hyphenation */);
+        for (const Edit& edit : edits) {
+            SCOPED_TRACE(std::to_string(lineWidth) + " " + std::to_string(edit.offset));
+            std::string newString = text;
+            newString.replace(edit.offset, edit.removedLength, edit.inserted);
+            const std::vector<uint16_t> newText = utf8ToUtf16(newString);
+            std::unique_ptr<MeasuredText> newMeasured = build(newText);
+            LineBreakResult expected = breakLineGreedy(newText, *newMeasured, rectangleLineWidth,
+                                                       tabStops, true /* do hyphenation */);
+            LineBreakResult actual = breakLineGreedyIncremental(
+                    newText, *newMeasured, rectangleLineWidth, tabStops, true /* do hyphenation */,
+                    prev, TextEdit(edit.offset, edit.removedLength, strlen(edit.inserted)));
+            EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+            // The widths of the restarted lines are summed from the line starts, so they may
+            // differ in the last bits.
+            ASSERT_EQ(expected.widths.size(), actual.widths.size());
+            for (size_t i = 0; i < expected.widths.size(); ++i) {
+                EXPECT_FLOAT_EQ(expected.widths[i], actual.widths[i]);
+            }
+            EXPECT_EQ(expected.ascents, actual.ascents);
+            EXPECT_EQ(expected.descents, actual.descents);
+            EXPECT_EQ(expected.flags, actual.flags);
+        }
+    }
+}
 }  // namespace
 }  // namespace minikin
@@ -16,6 +16,9 @@
 
 #include "minikin/Hasher.h"
 
+#include <algorithm>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 namespace minikin {
@@ -40,4 +43,29 @@ TEST(HasherTest, hasherTestFloat) {
     EXPECT_NE(Hasher().update(x).hash(), Hasher().update(1).hash());
 }
 
+TEST(HasherTest, hasherTestLength) {
+    // The trailing zeros and the order of the code units change the hash.
+    const uint16_t shorts[] = {1, 2, 3, 0, 0};
+    const uint16_t reversed[] = {3, 2, 1};
+    EXPECT_NE(Hasher().updateShorts(shorts, 3).hash(), Hasher().updateShorts(shorts, 4).hash());
+    EXPECT_NE(Hasher().updateShorts(shorts, 4).hash(), Hasher().updateShorts(shorts, 5).hash());
+    EXPECT_NE(Hasher().updateShorts(shorts, 3).hash(), Hasher().updateShorts(reversed, 3).hash());
+    EXPECT_NE(Hasher().updateString("abc").hash(), Hasher().updateString("cba").hash());
+    EXPECT_NE(Hasher().updateString("abc").hash(),
+              Hasher().updateString(std::string("abc\0", 4)).hash());
+}
+
+TEST(HasherTest, hasherTestDistribution) {
+    // Short consecutive texts, bucketed by the low bits as the hash tables do.
+    constexpr uint32_t kBucketCount = 4096;
+    std::vector<uint32_t> buckets(kBucketCount);
+    for (uint32_t i = 0; i < kBucketCount; ++i) {
+        const uint16_t text[] = {static_cast<uint16_t>('a' + i % 26),
+                                 static_cast<uint16_t>('a' + i / 26 % 26),
+                                 static_cast<uint16_t>('a' + i / 676)};
+        buckets[Hasher().update(1).updateShorts(text, 3).hash() % kBucketCount]++;
+    }
+    EXPECT_LE(*std::max_element(buckets.begin(), buckets.end()), 10u);
+}
+
 }  // namespace minikin
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/HbMinikinFont.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/FontCollection.h"
+#include "minikin/Layout.h"
+#include "minikin/MinikinExtent.h"
+#include "minikin/MinikinPaint.h"
+#include "minikin/MinikinRect.h"
+
+#include "FontTestUtils.h"
+#include "FreeTypeMinikinFontForTest.h"
+#include "PathUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+// The 26.6 rounding of FreeType.
+constexpr float kTolerance = 1.0f / 64;
+
+std::shared_ptr<FontCollection> buildCollection(const std::shared_ptr<MinikinFont>& typeface) {
+    std::vector<std::shared_ptr<Font>> fonts;
+    fonts.push_back(Font::Builder(typeface).build());
+    return FontCollection::create(FontFamily::create(std::move(fonts)));
+}
+
+float layoutAdvance(const std::shared_ptr<FontCollection>& collection, const std::string& str) {
+    MinikinPaint paint(collection);
+    paint.size = 10.0f;
+    // Letter spacing keeps the text off the simple ASCII path, so that HarfBuzz shapes it.
+    paint.letterSpacing = 0.1f;
+    const std::vector<uint16_t> text = utf8ToUtf16(str);
+    return Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                  EndHyphenEdit::NO_EDIT)
+            .getAdvance();
+}
+
+void expectNear(const MinikinRect& expected, const MinikinRect& actual) {
+    EXPECT_NEAR(expected.mLeft, actual.mLeft, kTolerance);
+    EXPECT_NEAR(expected.mTop, actual.mTop, kTolerance);
+    EXPECT_NEAR(expected.mRight, actual.mRight, kTolerance);
+    EXPECT_NEAR(expected.mBottom, actual.mBottom, kTolerance);
+}
+
+}  // namespace
+
+TEST(HbMinikinFontTest, createTest) {
+    EXPECT_EQ(nullptr, HbMinikinFont::create(getTestFontPath("NoSuchFont.ttf"), 0));
+
+    std::shared_ptr<HbMinikinFont> font = HbMinikinFont::create(getTestFontPath("Ascii.ttf"), 0);
+    ASSERT_NE(nullptr, font);
+    EXPECT_EQ(getTestFontPath("Ascii.ttf"), font->GetFontPath());
+    EXPECT_NE(nullptr, font->GetFontData());
+    EXPECT_NE(0u, font->GetFontSize());
+    EXPECT_TRUE(font->HasHarfBuzzAdvances());
+}
+
+TEST(HbMinikinFontTest, metricsTest) {
+    std::shared_ptr<HbMinikinFont> font = HbMinikinFont::create(getTestFontPath("Ascii.ttf"), 0);
+    ASSERT_NE(nullptr, font);
+    FreeTypeMinikinFontForTest freeType(getTestFontPath("Ascii.ttf"));
+    MinikinPaint paint(nullptr);
+    paint.size = 10.0f;
+    const FontFakery fakery;
+
+    uint16_t glyphs[] = {1, 2, 3, 4};
+    float advances[4];
+    font->GetHorizontalAdvances(glyphs, 4, paint, fakery, advances);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_NEAR(freeType.GetHorizontalAdvance(glyphs[i], paint, fakery), advances[i],
+                    kTolerance);
+        EXPECT_EQ(font->GetHorizontalAdvance(glyphs[i], paint, fakery), advances[i]);
+    }
+
+    MinikinExtent extent;
+    MinikinExtent expectedExtent;
+    font->GetFontExtent(&extent, paint, fakery);
+    freeType.GetFontExtent(&expectedExtent, paint, fakery);
+    EXPECT_NEAR(expectedExtent.ascent, extent.ascent, kTolerance);
+    EXPECT_NEAR(expectedExtent.descent, extent.descent, kTolerance);
+}
+
+TEST(HbMinikinFontTest, boundsTest) {
+    std::shared_ptr<HbMinikinFont> font = HbMinikinFont::create(getTestFontPath("Bbox.ttf"), 0);
+    ASSERT_NE(nullptr, font);
+    MinikinPaint paint(nullptr);
+    paint.size = 10.0f;
+    const FontFakery fakery;
+
+    // The y axis of the bounds goes down. See Bbox.ttx for the boxes of the glyphs.
+    MinikinRect bounds;
+    font->GetBounds(&bounds, 2 /* 2emx2em */, paint, fakery);
+    expectNear(MinikinRect(0.0f, -20.0f, 20.0f, 0.0f), bounds);
+    font->GetBounds(&bounds, 5 /* 1emx1em_y1em_origin */, paint, fakery);
+    expectNear(MinikinRect(0.0f, -20.0f, 10.0f, -10.0f), bounds);
+
+    paint.scaleX = 2.0f;
+    font->GetBounds(&bounds, 5 /* 1emx1em_y1em_origin */, paint, fakery);
+    expectNear(MinikinRect(0.0f, -20.0f, 20.0f, -10.0f), bounds);
+}
+
+TEST(HbMinikinFontTest, layoutTest) {
+    std::shared_ptr<HbMinikinFont> font = HbMinikinFont::create(getTestFontPath("Ascii.ttf"), 0);
+    ASSERT_NE(nullptr, font);
+    Layout::purgeCaches();
+    const float advance = layoutAdvance(buildCollection(font), "Hello, world");
+    Layout::purgeCaches();
+    EXPECT_NEAR(layoutAdvance(buildFontCollection("Ascii.ttf"), "Hello, world"), advance,
+                12 * kTolerance);
+}
+
+TEST(HbMinikinFontTest, factoryTest) {
+    std::shared_ptr<HbMinikinFont> font = HbMinikinFont::create(getTestFontPath("Ascii.ttf"), 0);
+    ASSERT_NE(nullptr, font);
+    std::shared_ptr<MinikinFont> varied = font->createFontWithVariation({{0x77676874, 700.0f}});
+    ASSERT_NE(nullptr, varied);
+    EXPECT_EQ(font->GetFontData(), varied->GetFontData());
+
+    // The tests run with the factory of the FreeType fonts, so use this one directly.
+    const HbMinikinFontFactory& factory = HbMinikinFontFactory::getInstance();
+    std::vector<uint8_t> buffer = BufferWriter::writeToVector([&](BufferWriter* writer) {
+        factory.write(writer, varied.get());
+    });
+    BufferReader reader(buffer.data());
+    std::shared_ptr<MinikinFont> read = factory.create(reader);
+    ASSERT_NE(nullptr, read);
+    EXPECT_EQ(varied->GetFontPath(), read->GetFontPath());
+    ASSERT_EQ(1u, read->GetAxes().size());
+    EXPECT_EQ(700.0f, read->GetAxes()[0].value);
+
+    BufferReader skipReader(buffer.data());
+    factory.skip(&skipReader);
+    EXPECT_EQ(buffer.data() + buffer.size(), skipReader.current());
+}
+
+}  // namespace minikin
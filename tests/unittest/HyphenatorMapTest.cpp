@@ -16,6 +16,9 @@
 
 #include "HyphenatorMap.h"
 
+#include <atomic>
+#include <thread>
+
 #include <gtest/gtest.h>
 
 #include "LocaleListCache.h"
@@ -68,6 +71,8 @@ public:
 
     using HyphenatorMap::addAliasInternal;
     using HyphenatorMap::addInternal;
+    using HyphenatorMap::addLoaderInternal;
+    using HyphenatorMap::getMemoryUsageInternal;
     using HyphenatorMap::lookupInternal;
 };
 
@@ -143,6 +148,22 @@ protected:
         return mMap.lookupInternal(getLocale(localeStr));
     }
 
+    const Hyphenator* lookupLocale(const Locale& locale) { return mMap.lookupInternal(locale); }
+
+    void addLoader(const std::string& localeStr, HyphenatorLoader&& loader) {
+        mMap.addLoaderInternal(localeStr, std::move(loader));
+    }
+
+    void add(const std::string& localeStr, const Hyphenator* hyphenator) {
+        mMap.addInternal(localeStr, hyphenator);
+    }
+
+    void addAlias(const std::string& fromLocaleStr, const std::string& toLocaleStr) {
+        mMap.addAliasInternal(fromLocaleStr, toLocaleStr);
+    }
+
+    size_t getMemoryUsage() { return mMap.getMemoryUsageInternal(); }
+
 private:
     TestableHyphenatorMap mMap;
 };
@@ -303,5 +324,102 @@ TEST_F(HyphenatorMapTest, CyrlScriptFallback) {
     EXPECT_NE(MN_CYRL_HYPHENATOR, lookup("und-Cyrl"));
 }
 
+TEST_F(HyphenatorMapTest, lazyLoading) {
+    const Hyphenator* FI_HYPHENATOR = FAKE_ADDRESS++;
+    int loadCount = 0;
+    addLoader("fi", [&loadCount, FI_HYPHENATOR] {
+        loadCount++;
+        return FI_HYPHENATOR;
+    });
+    addAlias("fi-AX", "fi");
+    EXPECT_EQ(0, loadCount);
+
+    EXPECT_EQ(FI_HYPHENATOR, lookup("fi-FI"));
+    EXPECT_EQ(FI_HYPHENATOR, lookup("fi"));
+    EXPECT_EQ(FI_HYPHENATOR, lookup("fi-AX"));
+    EXPECT_EQ(1, loadCount);
+
+    // A failed load falls back to the soft hyphen only hyphenator, without retrying.
+    int failedLoadCount = 0;
+    addLoader("sv", [&failedLoadCount]() -> const Hyphenator* {
+        failedLoadCount++;
+        return nullptr;
+    });
+    const Hyphenator* softHyphenOnly = lookup("ja");
+    EXPECT_EQ(softHyphenOnly, lookup("sv"));
+    EXPECT_EQ(softHyphenOnly, lookup("sv-SE"));
+    EXPECT_EQ(1, failedLoadCount);
+}
+
+TEST_F(HyphenatorMapTest, registrationAfterLookup) {
+    const Hyphenator* softHyphenOnly = lookup("ja");
+    EXPECT_EQ(softHyphenOnly, lookup("is"));
+    EXPECT_EQ(softHyphenOnly, lookup("is-IS"));
+
+    // The memoized lookups must see the new registrations.
+    const Hyphenator* IS_HYPHENATOR = FAKE_ADDRESS++;
+    add("is", IS_HYPHENATOR);
+    EXPECT_EQ(IS_HYPHENATOR, lookup("is"));
+    // The fallback resolved before the registration is kept, as without the memoization.
+    EXPECT_EQ(softHyphenOnly, lookup("is-IS"));
+    EXPECT_EQ(IS_HYPHENATOR, lookup("is-FO"));
+
+    addAlias("is-IS", "is");
+    EXPECT_EQ(IS_HYPHENATOR, lookup("is-IS"));
+}
+
+TEST_F(HyphenatorMapTest, lookupsDontGrowMemoryTest) {
+    const Hyphenator* IS_HYPHENATOR = FAKE_ADDRESS++;
+    add("is", IS_HYPHENATOR);
+    EXPECT_EQ(IS_HYPHENATOR, lookup("is"));
+    lookup("ja");
+    const size_t memoryUsage = getMemoryUsage();
+
+    // Only a registration or a new locale replaces the snapshot, not the lookups of known ones.
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(IS_HYPHENATOR, lookup("is"));
+        lookup("ja");
+    }
+    EXPECT_EQ(memoryUsage, getMemoryUsage());
+}
+
+TEST_F(HyphenatorMapTest, concurrentLookupTest) {
+    const Hyphenator* softHyphenOnly = lookup("ja");
+    const std::vector<std::pair<const Locale*, const Hyphenator*>> expected = {
+            {&getLocale("en-US"), EN_US_HYPHENATOR},
+            {&getLocale("fr-FR"), FR_HYPHENATOR},
+            {&getLocale("de"), DE_1996_HYPHENATOR},
+            {&getLocale("ja"), softHyphenOnly},
+    };
+    const std::vector<std::string> newLocales = {"is", "lt", "lv", "mk", "ms", "sq", "sr", "sw"};
+    for (const std::string& localeStr : newLocales) {
+        getLocale(localeStr);
+    }
+
+    // The snapshots replaced by the registrations and the new locales stay valid for the lookups
+    // searching them.
+    std::atomic<bool> done(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([this, &expected, &done] {
+            while (!done.load()) {
+                for (const auto& [locale, hyphenator] : expected) {
+                    EXPECT_EQ(hyphenator, lookupLocale(*locale));
+                }
+            }
+        });
+    }
+    for (const std::string& localeStr : newLocales) {
+        const Hyphenator* hyphenator = FAKE_ADDRESS++;
+        add(localeStr, hyphenator);
+        EXPECT_EQ(hyphenator, lookup(localeStr));
+        EXPECT_EQ(hyphenator, lookup(localeStr + "-XX"));
+    }
+    done.store(true);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
 }  // namespace
 }  // namespace minikin
@@ -16,6 +16,10 @@
 
 #include "minikin/Hyphenator.h"
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
 #include <gtest/gtest.h>
 
 #include "FileUtils.h"
@@ -58,6 +62,243 @@ TEST(HyphenatorTest, usEnglishAutomaticHyphenation) {
     EXPECT_EQ(HyphenationType::DONT_BREAK, result[4]);
 }
 
+TEST(HyphenatorTest, wordCache) {
+    std::vector<uint8_t> patternData = readWholeFile(usHyph);
+    std::unique_ptr<Hyphenator> reference(Hyphenator::loadBinary(patternData.data(), 2, 3, "en"));
+    std::unique_ptr<Hyphenator> cached(Hyphenator::loadBinary(patternData.data(), 2, 3, "en"));
+    const std::vector<uint16_t> words[] = {
+            {'h', 'y', 'p', 'h', 'e', 'n', 'a', 't', 'i', 'o', 'n'},
+            {'t', 'a', 'b', 'l', 'e'},
+            {'H', 'y', 'p', 'h', 'e', 'n', 'a', 't', 'i', 'o', 'n'},
+            {'h', 'y', 'p', 'h', 'e', 'n', 'a', 't', 'i', 'o', 'n'},
+    };
+
+    EXPECT_EQ(nullptr, cached->getWordCacheStats());
+    Hyphenator::setWordCacheEnabled(true);
+    for (const std::vector<uint16_t>& word : words) {
+        std::vector<HyphenationType> expected;
+        std::vector<HyphenationType> actual;
+        Hyphenator::setWordCacheEnabled(false);
+        reference->hyphenate(word, &expected);
+        Hyphenator::setWordCacheEnabled(true);
+        cached->hyphenate(word, &actual);
+        EXPECT_EQ(expected, actual);
+    }
+    Hyphenator::setWordCacheEnabled(false);
+
+    // The capitalized word shares the entry of the lower case one.
+    const CacheStats* stats = cached->getWordCacheStats();
+    ASSERT_NE(nullptr, stats);
+    EXPECT_EQ(2u, stats->getMissCount());
+    EXPECT_EQ(2u, stats->getHitCount());
+    EXPECT_EQ(nullptr, reference->getWordCacheStats());
+}
+
+TEST(HyphenatorTest, hyphenateBatch) {
+    std::vector<uint8_t> patternData = readWholeFile(usHyph);
+    std::unique_ptr<Hyphenator> hyphenator(Hyphenator::loadBinary(patternData.data(), 2, 3, "en"));
+    const std::vector<uint16_t> text = {'t', 'a', 'b', 'l', 'e', ' ', 'h', 'y', 'p', 'h',
+                                        'e', 'n', 'a', 't', 'i', 'o', 'n', ' ', 'a', 'n'};
+    const std::vector<Range> wordRanges = {Range(0, 5), Range(6, 17), Range(18, 20)};
+    const HyphenationType UNTOUCHED = HyphenationType::BREAK_AND_INSERT_HYPHEN_AT_NEXT_LINE;
+    std::vector<HyphenationType> actual(text.size(), UNTOUCHED);
+    hyphenator->hyphenateBatch(text, wordRanges, actual.data());
+
+    std::vector<HyphenationType> expected(text.size(), UNTOUCHED);
+    for (const Range& range : wordRanges) {
+        std::vector<HyphenationType> word;
+        hyphenator->hyphenate(U16StringPiece(text).substr(range), &word);
+        std::copy(word.begin(), word.end(), expected.begin() + range.getStart());
+    }
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(HyphenationType::BREAK_AND_INSERT_HYPHEN, actual[2]);
+    EXPECT_EQ(UNTOUCHED, actual[5]);
+    EXPECT_EQ(UNTOUCHED, actual[17]);
+}
+
+TEST(HyphenatorTest, longWord) {
+    std::vector<uint8_t> patternData = readWholeFile(usHyph);
+    std::unique_ptr<Hyphenator> hyphenator(Hyphenator::loadBinary(patternData.data(), 2, 3, "en"));
+    // Longer than the buffers on the stack.
+    std::vector<uint16_t> word;
+    const char* part = "hyphenation";
+    for (int i = 0; i < 8; i++) {
+        word.insert(word.end(), part, part + strlen(part));
+    }
+    ASSERT_GT(word.size(), 64u);
+    std::vector<HyphenationType> result;
+    hyphenator->hyphenate(word, &result);
+    ASSERT_EQ(word.size(), result.size());
+    EXPECT_NE(result.end(), std::find(result.begin(), result.end(),
+                                      HyphenationType::BREAK_AND_INSERT_HYPHEN));
+    // No break within the minimum prefix and suffix.
+    EXPECT_EQ(HyphenationType::DONT_BREAK, result[0]);
+    EXPECT_EQ(HyphenationType::DONT_BREAK, result[1]);
+    EXPECT_EQ(HyphenationType::DONT_BREAK, result[word.size() - 1]);
+    EXPECT_EQ(HyphenationType::DONT_BREAK, result[word.size() - 2]);
+
+    // The same result with the word cache, which doesn't keep such words.
+    Hyphenator::setWordCacheEnabled(true);
+    std::vector<HyphenationType> cachedResult;
+    hyphenator->hyphenate(word, &cachedResult);
+    Hyphenator::setWordCacheEnabled(false);
+    EXPECT_EQ(result, cachedResult);
+}
+
+// Generated by mk_hyb_file.py from the patterns "a1b", ".ab2c", "b3c" and "1ca", the exception
+// "ab-ca" and the alphabet "aA", "bB" and "cC". The trie is small enough for 16-bit entries.
+const std::vector<uint8_t> SMALL_HYB_TRIE_V1 = {
+        0x68, 0x79, 0xad, 0x62, 0x00, 0x00, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00,
+        0x48, 0x00, 0x00, 0x00, 0x84, 0x00, 0x00, 0x00, 0xb2, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x41, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00,
+        0x01, 0x02, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x00,
+        0x01, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+        0x7c, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x11, 0x00, 0x00, 0x00,
+        0x0c, 0x00, 0x91, 0x00, 0x0a, 0x00, 0x1b, 0x00, 0x1d, 0x00, 0x97, 0x01,
+        0x06, 0x00, 0x21, 0x00, 0x00, 0x02, 0x26, 0x00, 0x00, 0x01, 0xb5, 0x02,
+        0x2b, 0x00, 0x2c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00,
+        0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x04,
+        0x01, 0x00, 0x10, 0x04, 0x02, 0x00, 0x10, 0x04, 0x00, 0x00, 0x20, 0x04,
+        0x03, 0x00, 0x20, 0x0c, 0x01, 0x02, 0x03, 0x0a, 0x0b, 0x0a,
+};
+
+// Converts the trie of a hyb file to version 0, with 32-bit entries.
+std::vector<uint8_t> widenTrie(const std::vector<uint8_t>& hyb) {
+    uint32_t header[6];
+    memcpy(header, hyb.data(), sizeof(header));
+    const uint32_t trieOffset = header[3];
+    const uint32_t patternOffset = header[4];
+    const uint32_t fileSize = header[5];
+    uint32_t trieHeader[6];
+    memcpy(trieHeader, hyb.data() + trieOffset, sizeof(trieHeader));
+    EXPECT_EQ(1u, trieHeader[0]);
+    trieHeader[0] = 0;
+    std::vector<uint32_t> trie(trieHeader, trieHeader + 6);
+    for (uint32_t i = 0; i < trieHeader[5]; i++) {
+        uint16_t entry;
+        memcpy(&entry, hyb.data() + trieOffset + sizeof(trieHeader) + i * sizeof(entry),
+               sizeof(entry));
+        trie.push_back(entry);
+    }
+    std::vector<uint8_t> result(hyb.begin(), hyb.begin() + trieOffset);
+    const uint8_t* trieBytes = reinterpret_cast<const uint8_t*>(trie.data());
+    result.insert(result.end(), trieBytes, trieBytes + trie.size() * sizeof(uint32_t));
+    header[4] = result.size();
+    result.insert(result.end(), hyb.begin() + patternOffset, hyb.begin() + fileSize);
+    header[5] = result.size();
+    memcpy(result.data(), header, sizeof(header));
+    return result;
+}
+
+TEST(HyphenatorTest, trieVersions) {
+    std::vector<uint8_t> v0Data = widenTrie(SMALL_HYB_TRIE_V1);
+    std::unique_ptr<Hyphenator> v1(Hyphenator::loadBinary(SMALL_HYB_TRIE_V1.data(), 2, 2, "xx"));
+    std::unique_ptr<Hyphenator> v0(Hyphenator::loadBinary(v0Data.data(), 2, 2, "xx"));
+
+    const uint16_t exception[] = {'a', 'b', 'c', 'a'};
+    std::vector<HyphenationType> result;
+    v1->hyphenate(exception, &result);
+    EXPECT_EQ((std::vector<HyphenationType>{
+                      HyphenationType::DONT_BREAK, HyphenationType::DONT_BREAK,
+                      HyphenationType::BREAK_AND_INSERT_HYPHEN, HyphenationType::DONT_BREAK}),
+              result);
+
+    const std::vector<uint16_t> words[] = {
+            {'a', 'b', 'a', 'b', 'c', 'a'},
+            {'c', 'a', 'b', 'c', 'a', 'b'},
+            {'B', 'a', 'c', 'c', 'a', 'b', 'c'},
+    };
+    for (const std::vector<uint16_t>& word : words) {
+        std::vector<HyphenationType> expected;
+        std::vector<HyphenationType> actual;
+        v0->hyphenate(word, &expected);
+        v1->hyphenate(word, &actual);
+        EXPECT_EQ(expected, actual);
+    }
+}
+
+// Packs the hyb files into a container as mk_hyb_file.py -p does.
+std::vector<uint8_t> packHybFiles(const std::vector<std::pair<std::string, std::string>>& files) {
+    std::vector<uint32_t> words = {0x62ad7963, 0, static_cast<uint32_t>(files.size()), 0};
+    const size_t entryWords = 8;
+    size_t offset = (words.size() + entryWords * files.size()) * sizeof(uint32_t);
+    std::vector<std::vector<uint8_t>> hybs;
+    for (const auto& [locale, path] : files) {
+        hybs.push_back(readWholeFile(path));
+        uint32_t entry[entryWords] = {};
+        strncpy(reinterpret_cast<char*>(entry), locale.c_str(), 15);
+        entry[4] = 2;  // min_prefix
+        entry[5] = 3;  // min_suffix
+        entry[6] = offset;
+        entry[7] = hybs.back().size();
+        words.insert(words.end(), entry, entry + entryWords);
+        offset += (hybs.back().size() + 3) & ~3;
+    }
+    words[3] = offset;
+    std::vector<uint8_t> result(offset);
+    memcpy(result.data(), words.data(), words.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < hybs.size(); i++) {
+        const uint32_t* entry = words.data() + 4 + entryWords * i;
+        memcpy(result.data() + entry[6], hybs[i].data(), hybs[i].size());
+    }
+    return result;
+}
+
+TEST(HyphenatorTest, loadPackedBinary) {
+    std::vector<uint8_t> packed = packHybFiles({{"en", usHyph}, {"ml", malayalamHyph}});
+    std::vector<Hyphenator::PackedEntry> entries =
+            Hyphenator::loadPackedBinary(packed.data(), packed.size());
+    ASSERT_EQ(2u, entries.size());
+    EXPECT_EQ("en", entries[0].locale);
+    EXPECT_EQ("ml", entries[1].locale);
+    std::unique_ptr<Hyphenator> english(entries[0].hyphenator);
+    std::unique_ptr<Hyphenator> malayalam(entries[1].hyphenator);
+
+    // Same results as the hyphenators loaded from the separate files.
+    std::vector<uint8_t> usData = readWholeFile(usHyph);
+    std::vector<uint8_t> mlData = readWholeFile(malayalamHyph);
+    std::unique_ptr<Hyphenator> usReference(Hyphenator::loadBinary(usData.data(), 2, 3, "en"));
+    std::unique_ptr<Hyphenator> mlReference(Hyphenator::loadBinary(mlData.data(), 2, 3, "ml"));
+    const uint16_t usWord[] = {'t', 'a', 'b', 'l', 'e'};
+    const uint16_t mlWord[] = {MALAYALAM_KA, MALAYALAM_KA, MALAYALAM_KA, MALAYALAM_KA};
+    std::vector<HyphenationType> expected;
+    std::vector<HyphenationType> actual;
+    usReference->hyphenate(usWord, &expected);
+    english->hyphenate(usWord, &actual);
+    EXPECT_EQ(expected, actual);
+    mlReference->hyphenate(mlWord, &expected);
+    malayalam->hyphenate(mlWord, &actual);
+    EXPECT_EQ(expected, actual);
+}
+
+TEST(HyphenatorTest, loadPackedBinaryMalformed) {
+    EXPECT_TRUE(Hyphenator::loadPackedBinary(nullptr, 0).empty());
+
+    // Only the header, with a wrong magic.
+    const uint32_t badMagic[] = {0x62ad7968, 0, 0, 16};
+    EXPECT_TRUE(Hyphenator::loadPackedBinary(reinterpret_cast<const uint8_t*>(badMagic),
+                                             sizeof(badMagic))
+                        .empty());
+
+    // An entry pointing past the end of the container.
+    uint32_t outOfBounds[12] = {0x62ad7963, 0, 1, sizeof(outOfBounds)};
+    outOfBounds[4] = 'e' | 'n' << 8;
+    outOfBounds[10] = sizeof(outOfBounds);
+    outOfBounds[11] = 64;
+    EXPECT_TRUE(Hyphenator::loadPackedBinary(reinterpret_cast<const uint8_t*>(outOfBounds),
+                                             sizeof(outOfBounds))
+                        .empty());
+
+    // Too many entries for the size.
+    const uint32_t tooManyEntries[] = {0x62ad7963, 0, 1000, 16};
+    EXPECT_TRUE(Hyphenator::loadPackedBinary(reinterpret_cast<const uint8_t*>(tooManyEntries),
+                                             sizeof(tooManyEntries))
+                        .empty());
+}
+
 // Catalan l·l should break as l-/l
 TEST(HyphenatorTest, catalanMiddleDot) {
     Hyphenator* hyphenator = Hyphenator::loadBinary(nullptr, 2, 2, "ca");
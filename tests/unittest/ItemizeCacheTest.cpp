@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "minikin/ItemizeCache.h"
+#include "minikin/LayoutCache.h"
+
+#include "FontTestUtils.h"
+#include "LocaleListCache.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+class TestableItemizeCache : public ItemizeCache {
+public:
+    TestableItemizeCache(uint32_t maxEntries) : ItemizeCache(maxEntries) {}
+};
+
+void expectSameRuns(const std::vector<FontCollection::Run>& expected,
+                    const std::vector<FontCollection::Run>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].start, actual[i].start);
+        EXPECT_EQ(expected[i].end, actual[i].end);
+        EXPECT_EQ(expected[i].familyMatch, actual[i].familyMatch);
+    }
+}
+
+TEST(ItemizeCacheTest, cacheHitTest) {
+    auto text = utf8ToUtf16("android αβγ");
+    auto collection = buildFontCollection("Ascii.ttf");
+    const uint32_t localeListId = registerLocaleList("en-US");
+
+    TestableItemizeCache itemizeCache(10);
+    auto runs1 = itemizeCache.itemize(*collection, text, FontStyle(), localeListId,
+                                      FamilyVariant::DEFAULT);
+    auto runs2 = itemizeCache.itemize(*collection, text, FontStyle(), localeListId,
+                                      FamilyVariant::DEFAULT);
+
+    expectSameRuns(collection->itemize(text, FontStyle(), localeListId, FamilyVariant::DEFAULT),
+                   runs1);
+    expectSameRuns(runs1, runs2);
+    EXPECT_EQ(1u, itemizeCache.getStats().getMissCount());
+    EXPECT_EQ(1u, itemizeCache.getStats().getHitCount());
+}
+
+TEST(ItemizeCacheTest, cacheMissTest) {
+    auto text1 = utf8ToUtf16("android");
+    auto text2 = utf8ToUtf16("αβγδζ");
+    auto collection1 = buildFontCollection("Ascii.ttf");
+    auto collection2 = buildFontCollection("Ascii.ttf");
+    const uint32_t localeListId = registerLocaleList("en-US");
+
+    TestableItemizeCache itemizeCache(10);
+    itemizeCache.itemize(*collection1, text1, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+    itemizeCache.itemize(*collection1, text2, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+    itemizeCache.itemize(*collection2, text1, FontStyle(), localeListId, FamilyVariant::DEFAULT);
+    itemizeCache.itemize(*collection1, text1, FontStyle(FontStyle::Weight::BOLD), localeListId,
+                         FamilyVariant::DEFAULT);
+    itemizeCache.itemize(*collection1, text1, FontStyle(), registerLocaleList("ja-JP"),
+                         FamilyVariant::DEFAULT);
+    itemizeCache.itemize(*collection1, text1, FontStyle(), localeListId, FamilyVariant::ELEGANT);
+    EXPECT_EQ(6u, itemizeCache.getStats().getMissCount());
+    EXPECT_EQ(0u, itemizeCache.getStats().getHitCount());
+}
+
+TEST(ItemizeCacheTest, tooLongTextTest) {
+    std::vector<uint16_t> text(LENGTH_LIMIT_CACHE, 'a');
+    auto collection = buildFontCollection("Ascii.ttf");
+    const uint32_t localeListId = registerLocaleList("en-US");
+
+    TestableItemizeCache itemizeCache(10);
+    auto runs = itemizeCache.itemize(*collection, text, FontStyle(), localeListId,
+                                     FamilyVariant::DEFAULT);
+    expectSameRuns(collection->itemize(text, FontStyle(), localeListId, FamilyVariant::DEFAULT),
+                   runs);
+    EXPECT_EQ(1u, itemizeCache.getStats().getBypassCount(CacheStats::BypassReason::TooLong));
+    EXPECT_EQ(0u, itemizeCache.getMemoryUsage());
+}
+
+TEST(ItemizeCacheTest, paragraphScopeTest) {
+    auto text = utf8ToUtf16("android ios");
+    auto collection = buildFontCollection("Ascii.ttf");
+    const uint32_t localeListId = registerLocaleList("en-US");
+    const U16StringPiece word = U16StringPiece(text).substr(Range(8, 11));
+
+    TestableItemizeCache itemizeCache(10);
+    {
+        ParagraphItemizeScope scope(text);
+        scope.addStyleRun(collection.get(), Range(0, text.size()), localeListId,
+                          FamilyVariant::DEFAULT);
+        // The word is taken out of the paragraph.
+        expectSameRuns(
+                collection->itemize(word, FontStyle(), localeListId, FamilyVariant::DEFAULT),
+                itemizeCache.itemize(*collection, word, FontStyle(), localeListId,
+                                     FamilyVariant::DEFAULT));
+        EXPECT_EQ(0u, itemizeCache.getStats().getMissCount());
+
+        // The text out of the paragraph and the different locales are itemized as usual.
+        auto otherText = utf8ToUtf16("ios");
+        itemizeCache.itemize(*collection, otherText, FontStyle(), localeListId,
+                             FamilyVariant::DEFAULT);
+        itemizeCache.itemize(*collection, word, FontStyle(), registerLocaleList("ja-JP"),
+                             FamilyVariant::DEFAULT);
+        EXPECT_EQ(2u, itemizeCache.getStats().getMissCount());
+    }
+    EXPECT_EQ(nullptr, ParagraphItemizeScope::getCurrent());
+}
+
+}  // namespace minikin
@@ -16,6 +16,9 @@
 
 #include "minikin/Layout.h"
 
+#include <future>
+#include <thread>
+
 #include <gtest/gtest.h>
 
 #include "minikin/LayoutCache.h"
@@ -29,7 +32,14 @@ namespace minikin {
 class TestableLayoutCache : public LayoutCache {
 public:
     TestableLayoutCache(uint32_t maxEntries) : LayoutCache(maxEntries) {}
+    TestableLayoutCache(uint32_t maxEntries, uint32_t shardCount)
+            : LayoutCache(maxEntries, shardCount) {}
+    TestableLayoutCache(uint32_t maxEntries, uint32_t shardCount, bool lockFreeReads)
+            : LayoutCache(maxEntries, shardCount, lockFreeReads) {}
     using LayoutCache::getCacheSize;
+    using LayoutCache::getSegmentCacheSize;
+    using LayoutCache::getShardCount;
+    using LayoutCache::waitForInFlightWaiters;
 };
 
 class LayoutCapture {
@@ -62,6 +72,30 @@ TEST(LayoutCacheTest, cacheHitTest) {
     EXPECT_EQ(layout1.get(), layout2.get());
 }
 
+TEST(LayoutCacheTest, cacheHitWithFontFeatureSettingsTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    auto collection = buildFontCollection("Ascii.ttf");
+
+    TestableLayoutCache layoutCache(10);
+
+    MinikinPaint paint1(collection);
+    paint1.fontFeatureSettings = "'tnum' on";
+    LayoutCapture layout1;
+    layoutCache.getOrCreate(text, range, paint1, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout1);
+
+    // A different string object with the same settings.
+    MinikinPaint paint2(collection);
+    paint2.fontFeatureSettings = std::string("'tnum' ") + "on";
+    LayoutCapture layout2;
+    layoutCache.getOrCreate(text, range, paint2, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout2);
+
+    EXPECT_EQ(layout1.get(), layout2.get());
+    EXPECT_EQ(1u, layoutCache.getCacheSize());
+}
+
 TEST(LayoutCacheTest, cacheMissTest) {
     auto text1 = utf8ToUtf16("android");
     auto text2 = utf8ToUtf16("ANDROID");
@@ -193,7 +227,8 @@ TEST(LayoutCacheTest, cacheMissTest) {
         paint2.wordSpacing = 1.0f;
         layoutCache.getOrCreate(text1, Range(0, text1.size()), paint2, false /* LTR */,
                                 StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout2);
-        EXPECT_NE(layout1.get(), layout2.get());
+        // The word spacing is applied outside of the shaping, so the layout is shared.
+        EXPECT_EQ(layout1.get(), layout2.get());
     }
     {
         SCOPED_TRACE("Different paint flags");
@@ -273,6 +308,70 @@ TEST(LayoutCacheTest, cacheOverflowTest) {
     EXPECT_NE(layout1.get(), layout3.get());
 }
 
+TEST(LayoutCacheTest, statsTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(2);
+
+    auto text1 = utf8ToUtf16("android");
+    auto text2 = utf8ToUtf16("minikin");
+    auto text3 = utf8ToUtf16("layout");
+    LayoutCapture layout;
+    for (const auto& text : {text1, text1, text2, text3}) {
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    }
+    std::vector<uint16_t> longText(LENGTH_LIMIT_CACHE, 'a');
+    layoutCache.getOrCreate(longText, Range(0, longText.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+
+    const CacheStats& stats = layoutCache.getStats();
+    EXPECT_EQ(1u, stats.getHitCount());
+    EXPECT_EQ(3u, stats.getMissCount());
+    EXPECT_EQ(1u, stats.getEvictionCount());
+    EXPECT_EQ(1u, stats.getBypassCount(CacheStats::BypassReason::TooLong));
+}
+
+TEST(LayoutCacheTest, frequencyAdmissionTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+
+    TestableLayoutCache layoutCache(5);
+    layoutCache.setFrequencyAdmission(true);
+
+    // The cache is not full yet, so the first miss is admitted.
+    LayoutCapture layout1;
+    layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout1);
+
+    // A scan over unique words only fills the free entries.
+    for (char c = 'a'; c <= 'z'; c++) {
+        auto text1 = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout2;
+        layoutCache.getOrCreate(text1, Range(0, text1.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout2);
+    }
+    EXPECT_EQ(5u, layoutCache.getCacheSize());
+    EXPECT_EQ(22u, layoutCache.getStats().getRejectionCount());
+    EXPECT_EQ(0u, layoutCache.getStats().getEvictionCount());
+
+    LayoutCapture layout3;
+    layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout3);
+    EXPECT_EQ(layout1.get(), layout3.get());
+
+    // A word missed again is admitted and evicts the least recently used entry.
+    auto text4 = utf8ToUtf16(std::string(10, 'z'));
+    LayoutCapture layout4;
+    layoutCache.getOrCreate(text4, Range(0, text4.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout4);
+    LayoutCapture layout5;
+    layoutCache.getOrCreate(text4, Range(0, text4.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout5);
+    EXPECT_EQ(layout4.get(), layout5.get());
+    EXPECT_EQ(1u, layoutCache.getStats().getEvictionCount());
+}
+
 TEST(LayoutCacheTest, cacheLengthLimitTest) {
     auto text = utf8ToUtf16(std::string(130, 'a'));
     Range range(0, text.size());
@@ -287,4 +386,671 @@ TEST(LayoutCacheTest, cacheLengthLimitTest) {
     EXPECT_EQ(layoutCache.getCacheSize(), 0u);
 }
 
+TEST(LayoutCacheTest, keyTextCopyTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(10);
+
+    // Short texts are stored inline in the key, longer ones on the heap.
+    for (size_t length : {3u, LayoutCacheKey::kInlineCharsCapacity,
+                          LayoutCacheKey::kInlineCharsCapacity + 1, 100u}) {
+        SCOPED_TRACE(length);
+        auto text = utf8ToUtf16(std::string(length, 'a'));
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout1);
+        // The cache must not refer the caller's buffer after the insertion.
+        std::fill(text.begin(), text.end(), 'b');
+
+        auto text2 = utf8ToUtf16(std::string(length, 'a'));
+        LayoutCapture layout2;
+        layoutCache.getOrCreate(text2, Range(0, text2.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout2);
+        EXPECT_EQ(layout1.get(), layout2.get());
+    }
+}
+
+TEST(LayoutCacheTest, shardCountTest) {
+    EXPECT_EQ(1u, TestableLayoutCache(10).getShardCount());
+    EXPECT_EQ(1u, TestableLayoutCache(10, 0).getShardCount());
+    EXPECT_EQ(1u, TestableLayoutCache(10, 1).getShardCount());
+    EXPECT_EQ(4u, TestableLayoutCache(10, 3).getShardCount());
+    EXPECT_EQ(8u, TestableLayoutCache(10, 8).getShardCount());
+    EXPECT_EQ(LayoutCache::kMaxShardCount,
+              TestableLayoutCache(10, LayoutCache::kMaxShardCount * 2).getShardCount());
+}
+
+TEST(LayoutCacheTest, shardedCacheHitTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(100, 8);
+
+    for (char c = 'a'; c <= 'z'; c++) {
+        auto text = utf8ToUtf16(std::string(3, c));
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout1);
+        LayoutCapture layout2;
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout2);
+        EXPECT_EQ(layout1.get(), layout2.get());
+    }
+    EXPECT_EQ(26u, layoutCache.getCacheSize());
+
+    layoutCache.clear();
+    EXPECT_EQ(0u, layoutCache.getCacheSize());
+}
+
+TEST(LayoutCacheTest, shardedCacheOverflowTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(8, 4);
+
+    for (char c = 'a'; c <= 'z'; c++) {
+        auto text = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout;
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    }
+    // Each shard holds at most two entries.
+    EXPECT_LE(layoutCache.getCacheSize(), 8u);
+}
+
+TEST(LayoutCacheTest, memoryBudgetTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(100);
+
+    auto text = utf8ToUtf16(std::string(10, 'a'));
+    LayoutCapture layout;
+    layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    EXPECT_EQ(1u, layoutCache.getCacheSize());
+    // All test strings have the same length, so every entry has the same footprint.
+    const size_t entryUsage = layoutCache.getMemoryUsage();
+    EXPECT_LT(0u, entryUsage);
+
+    layoutCache.setMemoryBudget(entryUsage * 5);
+    for (char c = 'b'; c <= 'z'; c++) {
+        auto text1 = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text1, Range(0, text1.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout1);
+    }
+    EXPECT_EQ(5u, layoutCache.getCacheSize());
+    EXPECT_EQ(entryUsage * 5, layoutCache.getMemoryUsage());
+
+    // Shrinking the budget evicts immediately.
+    layoutCache.setMemoryBudget(entryUsage * 2);
+    EXPECT_EQ(2u, layoutCache.getCacheSize());
+    EXPECT_EQ(entryUsage * 2, layoutCache.getMemoryUsage());
+
+    // Disabling the budget falls back to the entry count limit.
+    layoutCache.setMemoryBudget(0);
+    for (char c = 'a'; c <= 'z'; c++) {
+        auto text1 = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text1, Range(0, text1.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout1);
+    }
+    EXPECT_EQ(26u, layoutCache.getCacheSize());
+}
+
+TEST(LayoutCacheTest, trimTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(100);
+
+    for (char c = 'a'; c < 'a' + 10; c++) {
+        auto text = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout;
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    }
+    EXPECT_EQ(10u, layoutCache.getCacheSize());
+    const size_t usage = layoutCache.getMemoryUsage();
+
+    layoutCache.trim(100);
+    EXPECT_EQ(10u, layoutCache.getCacheSize());
+
+    layoutCache.trim(50);
+    EXPECT_EQ(5u, layoutCache.getCacheSize());
+    EXPECT_EQ(usage / 2, layoutCache.getMemoryUsage());
+
+    // The most recently used entries survive.
+    auto text = utf8ToUtf16(std::string(10, 'a' + 9));
+    LayoutCapture layout;
+    layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    EXPECT_EQ(5u, layoutCache.getCacheSize());
+
+    layoutCache.trim(0);
+    EXPECT_EQ(0u, layoutCache.getCacheSize());
+    EXPECT_EQ(0u, layoutCache.getMemoryUsage());
+}
+
+// Blocks the thread doing the layout until the given future becomes ready. The entered future
+// becomes ready once the layout is done and the thread is blocked.
+class BlockingLayoutCapture {
+public:
+    BlockingLayoutCapture(std::shared_future<void> release) : mRelease(release) {}
+
+    std::future<void> entered() { return mEntered.get_future(); }
+
+    void operator()(const LayoutPiece& layout, const MinikinPaint& /* dir */) {
+        mLayout = &layout;
+        mEntered.set_value();
+        mRelease.wait();
+    }
+
+    const LayoutPiece* get() const { return mLayout; }
+
+private:
+    std::shared_future<void> mRelease;
+    std::promise<void> mEntered;
+    const LayoutPiece* mLayout;
+};
+
+TEST(LayoutCacheTest, deduplicateMissesTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+
+    TestableLayoutCache layoutCache(10);
+    layoutCache.setDeduplicateMisses(true);
+
+    std::promise<void> release;
+    BlockingLayoutCapture layout1(release.get_future().share());
+    std::future<void> entered = layout1.entered();
+    std::thread shaper([&] {
+        layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout1);
+    });
+    entered.wait();
+
+    // The shaper is blocked inside the callback, i.e. the layout is still in flight. The second
+    // lookup must wait for it instead of doing the layout again.
+    LayoutCapture layout2;
+    std::thread waiter([&] {
+        layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout2);
+    });
+    layoutCache.waitForInFlightWaiters(LayoutCacheKey(text, range, paint, false /* LTR */,
+                                                      StartHyphenEdit::NO_EDIT,
+                                                      EndHyphenEdit::NO_EDIT),
+                                       1);
+    release.set_value();
+    shaper.join();
+    waiter.join();
+
+    EXPECT_EQ(layout1.get(), layout2.get());
+    EXPECT_EQ(1u, layoutCache.getDeduplicatedMissCount());
+    EXPECT_EQ(1u, layoutCache.getCacheSize());
+}
+
+TEST(LayoutCacheTest, lockFreeCacheHitTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+
+    TestableLayoutCache layoutCache(10, 1, true /* lock-free reads */);
+
+    LayoutCapture layout1;
+    layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout1);
+    LayoutCapture layout2;
+    layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout2);
+    EXPECT_EQ(layout1.get(), layout2.get());
+
+    LayoutCapture layout3;
+    layoutCache.getOrCreate(text, range, paint, true /* RTL */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout3);
+    EXPECT_NE(layout1.get(), layout3.get());
+    EXPECT_EQ(2u, layoutCache.getCacheSize());
+
+    layoutCache.clear();
+    EXPECT_EQ(0u, layoutCache.getCacheSize());
+    EXPECT_EQ(0u, layoutCache.getMemoryUsage());
+}
+
+TEST(LayoutCacheTest, lockFreeCacheOverflowTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+
+    TestableLayoutCache layoutCache(5, 1, true /* lock-free reads */);
+
+    LayoutCapture layout1;
+    layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout1);
+    for (char c = 'a'; c <= 'z'; c++) {
+        auto text1 = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout2;
+        layoutCache.getOrCreate(text1, Range(0, text1.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout2);
+    }
+    EXPECT_EQ(5u, layoutCache.getCacheSize());
+
+    LayoutCapture layout3;
+    layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout3);
+    EXPECT_NE(layout1.get(), layout3.get());
+}
+
+TEST(LayoutCacheTest, lockFreeCacheSecondChanceTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(3, 1, true /* lock-free reads */);
+
+    auto hot = utf8ToUtf16("hot");
+    LayoutCapture hotLayout;
+    layoutCache.getOrCreate(hot, Range(0, hot.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, hotLayout);
+    for (char c = 'a'; c <= 'z'; c++) {
+        // Keep referencing the hot entry. The clock hand must skip it.
+        LayoutCapture layout;
+        layoutCache.getOrCreate(hot, Range(0, hot.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+        EXPECT_EQ(hotLayout.get(), layout.get());
+
+        auto text = utf8ToUtf16(std::string(10, c));
+        layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    }
+}
+
+TEST(LayoutCacheTest, lockFreeCacheMemoryBudgetTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    TestableLayoutCache layoutCache(100, 1, true /* lock-free reads */);
+
+    auto text = utf8ToUtf16(std::string(10, 'a'));
+    LayoutCapture layout;
+    layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+    const size_t entryUsage = layoutCache.getMemoryUsage();
+
+    layoutCache.setMemoryBudget(entryUsage * 4);
+    for (char c = 'b'; c <= 'z'; c++) {
+        auto text1 = utf8ToUtf16(std::string(10, c));
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text1, Range(0, text1.size()), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout1);
+    }
+    EXPECT_EQ(4u, layoutCache.getCacheSize());
+
+    layoutCache.trim(50);
+    EXPECT_EQ(2u, layoutCache.getCacheSize());
+    EXPECT_EQ(entryUsage * 2, layoutCache.getMemoryUsage());
+}
+
+TEST(LayoutCacheTest, lockFreeCacheMultithreadTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    // Small enough to have evictions while the other threads are reading.
+    TestableLayoutCache layoutCache(8, 1, true /* lock-free reads */);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&layoutCache, &paint, i] {
+            for (int j = 0; j < 1000; ++j) {
+                auto text = utf8ToUtf16(std::string(3, 'a' + (i + j) % 16));
+                // The layout is only guaranteed to be alive inside the callback.
+                float advance = 0;
+                auto f = [&advance](const LayoutPiece& layout, const MinikinPaint&) {
+                    advance = layout.advance();
+                };
+                layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                                        StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f);
+                // All characters in Ascii.ttf has 1.0em horizontal advance.
+                ASSERT_EQ(30.0f, advance);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_LE(layoutCache.getCacheSize(), 8u);
+}
+
+TEST(LayoutCacheTest, segmentCacheTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    TestableLayoutCache layoutCache(10);
+
+    std::string word = "abcdefghi ";
+    std::string longText;
+    for (int i = 0; i < 20; ++i) {
+        longText += word;
+    }
+    auto text = utf8ToUtf16(longText);
+    ASSERT_LE(LENGTH_LIMIT_CACHE, text.size());
+
+    std::vector<float> advances1;
+    std::vector<float> advances2;
+    float advance1 = 0;
+    float advance2 = 0;
+    auto f1 = [&](const LayoutPiece& layout, const MinikinPaint&) {
+        advances1 = layout.advances().toVector();
+        advance1 = layout.advance();
+    };
+    auto f2 = [&](const LayoutPiece& layout, const MinikinPaint&) {
+        advances2 = layout.advances().toVector();
+        advance2 = layout.advance();
+    };
+
+    // Long runs are not cached unless the segment cache has a budget.
+    layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f1);
+    EXPECT_EQ(0u, layoutCache.getSegmentCacheSize());
+    EXPECT_EQ(0u, layoutCache.getCacheSize());
+
+    layoutCache.setSegmentCacheBudget(1024 * 1024);
+    layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f1);
+    // The run is stored as the split points and a few segments.
+    EXPECT_LT(2u, layoutCache.getSegmentCacheSize());
+    EXPECT_EQ(0u, layoutCache.getCacheSize());
+    const uint32_t segmentCacheSize = layoutCache.getSegmentCacheSize();
+
+    // The second call is rebuilt from the cached segments.
+    layoutCache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f2);
+    EXPECT_EQ(segmentCacheSize, layoutCache.getSegmentCacheSize());
+    EXPECT_EQ(advances1, advances2);
+    EXPECT_EQ(advance1, advance2);
+    // All characters in Ascii.ttf has 1.0em horizontal advance.
+    EXPECT_EQ(10.0f * text.size(), advance2);
+
+    layoutCache.setSegmentCacheBudget(0);
+    EXPECT_EQ(0u, layoutCache.getSegmentCacheSize());
+}
+
+TEST(LayoutCacheTest, batchTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    TestableLayoutCache layoutCache(10);
+
+    auto text = utf8ToUtf16("abc de abc fghi");
+    std::vector<LayoutCache::BatchEntry> entries = {
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+            {text, Range(4, 6), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+            // The same key as the first entry, since the start is a part of the key.
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+            {text, Range(11, 15), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+    };
+    // Make the second word a hit.
+    LayoutCapture layout;
+    layoutCache.getOrCreate(text, Range(4, 6), paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, layout);
+
+    std::vector<size_t> indices;
+    std::vector<float> advances;
+    auto f = [&](size_t index, const LayoutPiece& layout, const MinikinPaint&) {
+        indices.push_back(index);
+        advances.push_back(layout.advance());
+    };
+    layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, f);
+
+    EXPECT_EQ(std::vector<size_t>({0, 1, 2, 3}), indices);
+    // All characters in Ascii.ttf has 1.0em horizontal advance.
+    EXPECT_EQ(std::vector<float>({30.0f, 20.0f, 30.0f, 40.0f}), advances);
+    // "abc" is shaped only once.
+    EXPECT_EQ(3u, layoutCache.getCacheSize());
+    EXPECT_EQ(3u, layoutCache.getStats().getMissCount());
+    EXPECT_EQ(2u, layoutCache.getStats().getHitCount());
+}
+
+TEST(LayoutCacheTest, parallelShapingTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    auto text = utf8ToUtf16("a bb ccc dddd a eeeee ffffff bb");
+    std::vector<LayoutCache::BatchEntry> entries;
+    // The start is a part of the key, so the repeated words are requested with the same ranges.
+    for (const Range& range : {Range(0, 1), Range(2, 4), Range(5, 8), Range(9, 13), Range(0, 1),
+                               Range(16, 21), Range(22, 28), Range(2, 4)}) {
+        entries.push_back({text, range, StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT});
+    }
+    for (bool lockFreeReads : {false, true}) {
+        TestableLayoutCache layoutCache(100, 4, lockFreeReads);
+        layoutCache.setParallelShaping(true);
+
+        std::vector<size_t> indices;
+        std::vector<float> advances;
+        auto f = [&](size_t index, const LayoutPiece& layout, const MinikinPaint&) {
+            indices.push_back(index);
+            advances.push_back(layout.advance());
+        };
+        layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, f);
+
+        // The callbacks are made in order and the results are the same as the serial shaping.
+        EXPECT_EQ(std::vector<size_t>({0, 1, 2, 3, 4, 5, 6, 7}), indices);
+        EXPECT_EQ(std::vector<float>({10.0f, 20.0f, 30.0f, 40.0f, 10.0f, 50.0f, 60.0f, 20.0f}),
+                  advances);
+        // The repeated words are shaped only once.
+        EXPECT_EQ(6u, layoutCache.getCacheSize());
+        EXPECT_EQ(6u, layoutCache.getStats().getMissCount());
+    }
+}
+
+TEST(LayoutCacheTest, advancesOnlyMeasurementTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    auto text = utf8ToUtf16("abc");
+    std::vector<LayoutCache::BatchEntry> entries = {
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT}};
+    for (bool lockFreeReads : {false, true}) {
+        TestableLayoutCache layoutCache(10, 1, lockFreeReads);
+        layoutCache.setAdvancesOnlyMeasurement(true);
+
+        std::shared_ptr<const LayoutPiece> measured;
+        auto f = [&](size_t, const std::shared_ptr<const LayoutPiece>& layout,
+                     const MinikinPaint&) { measured = layout; };
+        layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, f, false /* need glyphs */);
+        ASSERT_TRUE(measured);
+        EXPECT_TRUE(measured->isAdvancesOnly());
+        EXPECT_EQ(0u, measured->glyphCount());
+        EXPECT_EQ(30.0f, measured->advance());
+        EXPECT_EQ(std::vector<float>({10.0f, 10.0f, 10.0f}), measured->advances().toVector());
+
+        // A lookup which needs the glyphs replaces the entry.
+        LayoutCapture layout;
+        layoutCache.getOrCreate(text, Range(0, 3), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, layout);
+        EXPECT_FALSE(layout.get()->isAdvancesOnly());
+        EXPECT_EQ(3u, layout.get()->glyphCount());
+        EXPECT_EQ(measured->advances(), layout.get()->advances());
+        EXPECT_EQ(1u, layoutCache.getCacheSize());
+        EXPECT_EQ(2u, layoutCache.getStats().getMissCount());
+
+        // Then the measurement uses the full layout.
+        layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, f, false /* need glyphs */);
+        EXPECT_EQ(layout.get(), measured.get());
+        EXPECT_EQ(1u, layoutCache.getStats().getHitCount());
+    }
+}
+
+TEST(LayoutCacheTest, scalableLayoutsTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.fontFlags = LinearMetrics_Flag | Subpixel_Flag;
+    auto text = utf8ToUtf16("abc");
+    std::vector<LayoutCache::BatchEntry> entries = {
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT}};
+
+    TestableLayoutCache layoutCache(10);
+    layoutCache.setScalableLayouts(true);
+    std::shared_ptr<const LayoutPiece> layout;
+    auto f = [&](const std::shared_ptr<const LayoutPiece>& l, const MinikinPaint&) { layout = l; };
+    for (float size : {10.0f, 12.5f, 20.0f}) {
+        paint.size = size;
+        layoutCache.getOrCreate(text, Range(0, 3), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f);
+        const LayoutPiece expected(text, Range(0, 3), false /* LTR */, paint,
+                                   StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+        ASSERT_TRUE(layout);
+        EXPECT_EQ(expected.advance(), layout->advance());
+        EXPECT_EQ(expected.advances(), layout->advances());
+        EXPECT_FLOAT_EQ(expected.extent().ascent, layout->extent().ascent);
+        EXPECT_FLOAT_EQ(expected.extent().descent, layout->extent().descent);
+        ASSERT_EQ(expected.glyphCount(), layout->glyphCount());
+        for (uint32_t i = 0; i < expected.glyphCount(); ++i) {
+            EXPECT_EQ(expected.glyphIdAt(i), layout->glyphIdAt(i));
+            EXPECT_EQ(expected.pointAt(i), layout->pointAt(i));
+        }
+
+        std::shared_ptr<const LayoutPiece> batchLayout;
+        auto g = [&](size_t, const std::shared_ptr<const LayoutPiece>& l, const MinikinPaint&) {
+            batchLayout = l;
+        };
+        layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, g);
+        ASSERT_TRUE(batchLayout);
+        EXPECT_EQ(expected.advances(), batchLayout->advances());
+    }
+    // All the sizes share the layout shaped at the first lookup.
+    EXPECT_EQ(1u, layoutCache.getCacheSize());
+    EXPECT_EQ(1u, layoutCache.getStats().getMissCount());
+
+    // The paints whose metrics may not be linear are cached per size.
+    paint.fontFlags = LinearMetrics_Flag;
+    layoutCache.getOrCreate(text, Range(0, 3), paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, f);
+    EXPECT_EQ(2u, layoutCache.getCacheSize());
+}
+
+TEST(LayoutCacheTest, deferredLetterSpacingTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    auto text = utf8ToUtf16("abc");
+    std::vector<LayoutCache::BatchEntry> entries = {
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT}};
+
+    TestableLayoutCache layoutCache(10);
+    layoutCache.setDeferredLetterSpacing(true);
+    std::shared_ptr<const LayoutPiece> layout;
+    auto f = [&](const std::shared_ptr<const LayoutPiece>& l, const MinikinPaint&) { layout = l; };
+    for (float letterSpacing : {0.05f, 0.2f, -0.5f}) {
+        paint.letterSpacing = letterSpacing;
+        layoutCache.getOrCreate(text, Range(0, 3), paint, false /* LTR */,
+                                StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, f);
+        const LayoutPiece expected(text, Range(0, 3), false /* LTR */, paint,
+                                   StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+        ASSERT_TRUE(layout);
+        EXPECT_FLOAT_EQ(expected.advance(), layout->advance());
+        ASSERT_EQ(expected.advances().size(), layout->advances().size());
+        for (uint32_t i = 0; i < expected.advances().size(); ++i) {
+            EXPECT_FLOAT_EQ(expected.advances()[i], layout->advances()[i]);
+        }
+        ASSERT_EQ(expected.glyphCount(), layout->glyphCount());
+        for (uint32_t i = 0; i < expected.glyphCount(); ++i) {
+            EXPECT_EQ(expected.glyphIdAt(i), layout->glyphIdAt(i));
+            EXPECT_FLOAT_EQ(expected.pointAt(i).x, layout->pointAt(i).x);
+        }
+
+        std::shared_ptr<const LayoutPiece> batchLayout;
+        auto g = [&](size_t, const std::shared_ptr<const LayoutPiece>& l, const MinikinPaint&) {
+            batchLayout = l;
+        };
+        layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, g);
+        ASSERT_TRUE(batchLayout);
+        EXPECT_FLOAT_EQ(expected.advance(), batchLayout->advance());
+    }
+    // All the letter spacings without the ligatures share the layout shaped at the first lookup.
+    EXPECT_EQ(1u, layoutCache.getCacheSize());
+    EXPECT_EQ(1u, layoutCache.getStats().getMissCount());
+
+    // The letter spacings keeping the ligatures are shaped with other features.
+    paint.letterSpacing = 0.02f;
+    layoutCache.getOrCreate(text, Range(0, 3), paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                            EndHyphenEdit::NO_EDIT, f);
+    EXPECT_EQ(2u, layoutCache.getCacheSize());
+    layoutCache.setDeferredLetterSpacing(false);
+}
+
+TEST(LayoutCacheTest, removeCollectionsTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint1(buildFontCollection("Ascii.ttf"));
+    MinikinPaint paint2(buildFontCollection("Ascii.ttf"));
+
+    for (bool lockFreeReads : {false, true}) {
+        SCOPED_TRACE(lockFreeReads ? "Lock-free reads" : "Shards");
+        TestableLayoutCache layoutCache(10, 4, lockFreeReads);
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text, range, paint1, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout1);
+        LayoutCapture layout2;
+        layoutCache.getOrCreate(text, range, paint2, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout2);
+        EXPECT_EQ(2u, layoutCache.getCacheSize());
+
+        layoutCache.removeCollections({paint1.font->getId()});
+        EXPECT_EQ(1u, layoutCache.getCacheSize());
+        LayoutCapture layout3;
+        layoutCache.getOrCreate(text, range, paint2, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout3);
+        EXPECT_EQ(layout2.get(), layout3.get());
+        EXPECT_EQ(1u, layoutCache.getCacheSize());
+    }
+}
+
+TEST(LayoutCacheTest, threadLocalCacheTest) {
+    auto text = utf8ToUtf16("android");
+    Range range(0, text.size());
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+
+    for (bool lockFreeReads : {false, true}) {
+        SCOPED_TRACE(lockFreeReads ? "Lock-free reads" : "Shards");
+        TestableLayoutCache layoutCache(10, 1, lockFreeReads);
+        layoutCache.setThreadLocalCache(true);
+        LayoutCapture layout1;
+        layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout1);
+        LayoutCapture layout2;
+        layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout2);
+        EXPECT_EQ(layout1.get(), layout2.get());
+        EXPECT_EQ(1u, layoutCache.getStats().getHitCount());
+
+        // Other instances never see the thread local entries of this one.
+        TestableLayoutCache otherCache(10, 1, lockFreeReads);
+        otherCache.setThreadLocalCache(true);
+        LayoutCapture layout3;
+        otherCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                               EndHyphenEdit::NO_EDIT, layout3);
+        EXPECT_EQ(1u, otherCache.getStats().getMissCount());
+
+        // The thread local entries are invalidated by clear().
+        layoutCache.clear();
+        LayoutCapture layout4;
+        layoutCache.getOrCreate(text, range, paint, false /* LTR */, StartHyphenEdit::NO_EDIT,
+                                EndHyphenEdit::NO_EDIT, layout4);
+        EXPECT_EQ(2u, layoutCache.getStats().getMissCount());
+        EXPECT_EQ(1u, layoutCache.getCacheSize());
+    }
+}
+
+TEST(LayoutCacheTest, threadLocalCacheBatchTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    TestableLayoutCache layoutCache(10);
+    layoutCache.setThreadLocalCache(true);
+
+    auto text = utf8ToUtf16("abc de abc");
+    std::vector<LayoutCache::BatchEntry> entries = {
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+            {text, Range(4, 6), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+            // The same key as the first entry, since the start is a part of the key.
+            {text, Range(0, 3), StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT},
+    };
+    for (int i = 0; i < 2; ++i) {
+        std::vector<size_t> indices;
+        std::vector<float> advances;
+        auto f = [&](size_t index, const LayoutPiece& layout, const MinikinPaint&) {
+            indices.push_back(index);
+            advances.push_back(layout.advance());
+        };
+        layoutCache.getOrCreateBatch(entries, paint, false /* LTR */, f);
+        EXPECT_EQ(std::vector<size_t>({0, 1, 2}), indices);
+        // All characters in Ascii.ttf has 1.0em horizontal advance.
+        EXPECT_EQ(std::vector<float>({30.0f, 20.0f, 30.0f}), advances);
+    }
+    EXPECT_EQ(2u, layoutCache.getStats().getMissCount());
+    // The repeated "abc" of the first batch, and all the words of the second one.
+    EXPECT_EQ(4u, layoutCache.getStats().getHitCount());
+}
+
 }  // namespace minikin
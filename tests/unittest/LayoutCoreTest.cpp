@@ -22,6 +22,8 @@
 #include "minikin/LayoutPieces.h"
 
 #include "FontTestUtils.h"
+#include "FreeTypeMinikinFontForTest.h"
+#include "PathUtils.h"
 #include "UnicodeUtils.h"
 
 namespace minikin {
@@ -250,5 +252,183 @@ TEST(LayoutPieceTest, doLayoutTest_Ligature) {
     }
 }
 
+TEST(LayoutPieceTest, sliceAndConcatTest) {
+    auto fc = makeFontCollection({"LayoutTestFont.ttf"});
+    MinikinPaint paint(fc);
+    paint.size = 10.0f;  // make 1em = 10px
+    auto text = utf8ToUtf16("IVX CL");
+
+    LayoutPiece::ClusterInfo clusterInfo;
+    LayoutPiece layout(text, Range(0, text.size()), false /* rtl */, paint,
+                       StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, &clusterInfo);
+    EXPECT_EQ(6u, clusterInfo.clusters.size());
+    EXPECT_FALSE(clusterInfo.safeBreaks.empty());
+
+    LayoutPiece first(layout, clusterInfo, Range(0, 4), false /* rtl */, paint);
+    LayoutPiece second(layout, clusterInfo, Range(4, 6), false /* rtl */, paint);
+    EXPECT_EQ(4u, first.glyphCount());
+    EXPECT_EQ(2u, second.glyphCount());
+    EXPECT_EQ(260.0f, first.advance());
+    EXPECT_EQ(1500.0f, second.advance());
+    EXPECT_EQ(Point(0, 0), second.pointAt(0));
+
+    LayoutPiece joined({&first, &second}, false /* rtl */);
+    EXPECT_EQ(layout.glyphCount(), joined.glyphCount());
+    EXPECT_EQ(layout.advances(), joined.advances());
+    EXPECT_EQ(layout.advance(), joined.advance());
+    EXPECT_EQ(layout.extent(), joined.extent());
+    for (uint32_t i = 0; i < layout.glyphCount(); ++i) {
+        EXPECT_EQ(layout.glyphIdAt(i), joined.glyphIdAt(i));
+        EXPECT_EQ(layout.pointAt(i), joined.pointAt(i));
+    }
+}
+
+TEST(LayoutPieceTest, copyTest) {
+    auto fc = makeFontCollection({"LayoutTestFont.ttf"});
+    auto layout = buildLayout("IVX CL", fc);
+    LayoutPiece copy(layout);
+
+    EXPECT_EQ(layout.glyphCount(), copy.glyphCount());
+    EXPECT_EQ(layout.advances(), copy.advances());
+    EXPECT_EQ(layout.fontIndices(), copy.fontIndices());
+    EXPECT_EQ(layout.fonts(), copy.fonts());
+    EXPECT_EQ(layout.advance(), copy.advance());
+    EXPECT_EQ(layout.getMemoryUsage(), copy.getMemoryUsage());
+    for (uint32_t i = 0; i < layout.glyphCount(); ++i) {
+        EXPECT_EQ(layout.glyphIdAt(i), copy.glyphIdAt(i));
+        EXPECT_EQ(layout.pointAt(i), copy.pointAt(i));
+        EXPECT_EQ(layout.fontAt(i), copy.fontAt(i));
+    }
+}
+
+TEST(LayoutPieceTest, reusedSubFontTest) {
+    // Sub-fonts are reused between pieces, so make sure the scale of the paint is still honored
+    // when the same font is shaped with different sizes one after another.
+    auto fc = makeFontCollection({"LayoutTestFont.ttf"});
+    MinikinPaint paint(fc);
+    for (int i = 0; i < 2; ++i) {
+        paint.size = 10.0f;
+        EXPECT_EQ(50.0f, buildLayout("V", paint).advance());
+        paint.size = 20.0f;
+        EXPECT_EQ(100.0f, buildLayout("V", paint).advance());
+        paint.scaleX = 2.0f;
+        EXPECT_EQ(200.0f, buildLayout("V", paint).advance());
+        paint.scaleX = 1.0f;
+    }
+}
+
+TEST(LayoutPieceTest, advancesOnlyTest) {
+    auto fc = makeFontCollection({"LayoutTestFont.ttf"});
+    MinikinPaint paint(fc);
+    paint.size = 10.0f;
+    auto text = utf8ToUtf16("IVX CL");
+    const Range range(0, text.size());
+    LayoutPiece full(text, range, false /* rtl */, paint, StartHyphenEdit::NO_EDIT,
+                     EndHyphenEdit::NO_EDIT);
+    LayoutPiece advancesOnly(text, range, false /* rtl */, paint, StartHyphenEdit::NO_EDIT,
+                             EndHyphenEdit::NO_EDIT, nullptr /* cluster info */,
+                             true /* advances only */);
+
+    EXPECT_FALSE(full.isAdvancesOnly());
+    EXPECT_TRUE(advancesOnly.isAdvancesOnly());
+    EXPECT_EQ(0u, advancesOnly.glyphCount());
+    EXPECT_EQ(full.advances(), advancesOnly.advances());
+    EXPECT_EQ(full.advance(), advancesOnly.advance());
+    EXPECT_EQ(full.extent(), advancesOnly.extent());
+    EXPECT_LT(advancesOnly.getMemoryUsage(), full.getMemoryUsage());
+}
+
+TEST(LayoutPieceTest, letterSpacingsRecordedTest) {
+    auto fc = makeFontCollection({"LayoutTestFont.ttf"});
+    MinikinPaint paint(fc);
+    paint.size = 10.0f;
+    paint.letterSpacing = 0.1f;
+    auto text = utf8ToUtf16("IVX CL");
+    const Range range(0, text.size());
+    LayoutPiece unrecorded(text, range, false /* rtl */, paint, StartHyphenEdit::NO_EDIT,
+                           EndHyphenEdit::NO_EDIT);
+    LayoutPiece::setLetterSpacingsRecorded(true);
+    LayoutPiece recorded(text, range, false /* rtl */, paint, StartHyphenEdit::NO_EDIT,
+                         EndHyphenEdit::NO_EDIT);
+    LayoutPiece::setLetterSpacingsRecorded(false);
+
+    // The letter spacing is applied either way, but only recorded while enabled.
+    EXPECT_FALSE(unrecorded.hasLetterSpacings());
+    EXPECT_TRUE(recorded.hasLetterSpacings());
+    EXPECT_EQ(recorded.advances(), unrecorded.advances());
+    EXPECT_LT(unrecorded.getMemoryUsage(), recorded.getMemoryUsage());
+}
+
+TEST(LayoutPieceTest, cachedAdvancesTest) {
+    // Counts the glyphs whose advances are asked for.
+    class CountingFont : public FreeTypeMinikinFontForTest {
+        using Base = FreeTypeMinikinFontForTest;
+
+    public:
+        explicit CountingFont(const std::string& path) : Base(path) {}
+
+        float GetHorizontalAdvance(uint32_t glyphId, const MinikinPaint& paint,
+                                   const FontFakery& fakery) const override {
+            count++;
+            return Base::GetHorizontalAdvance(glyphId, paint, fakery);
+        }
+
+        void GetHorizontalAdvances(uint16_t* glyphIds, uint32_t glyphCount,
+                                   const MinikinPaint& paint, const FontFakery& fakery,
+                                   float* outAdvances) const override {
+            count += glyphCount;
+            for (uint32_t i = 0; i < glyphCount; ++i) {
+                outAdvances[i] = Base::GetHorizontalAdvance(glyphIds[i], paint, fakery);
+            }
+        }
+
+        mutable uint32_t count = 0;
+    };
+    auto font = std::make_shared<CountingFont>(getTestFontPath("LayoutTestFont.ttf"));
+    std::vector<std::shared_ptr<Font>> fonts = {Font::Builder(font).build()};
+    MinikinPaint paint(FontCollection::create(FontFamily::create(std::move(fonts))));
+    paint.size = 10.0f;
+    MinikinPaint referencePaint(makeFontCollection({"LayoutTestFont.ttf"}));
+    referencePaint.size = 10.0f;
+    // RTL text is shaped by HarfBuzz, which asks for the advances.
+    auto layoutRtl = [](const std::string& text, const MinikinPaint& layoutPaint) {
+        auto utf16 = utf8ToUtf16(text);
+        return LayoutPiece(utf16, Range(0, utf16.size()), true /* rtl */, layoutPaint,
+                           StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+    };
+
+    EXPECT_EQ(layoutRtl("IVX", referencePaint).advances(), layoutRtl("IVX", paint).advances());
+    const uint32_t count = font->count;
+    EXPECT_NE(0u, count);
+    // The same glyphs with the same paint are not asked for again.
+    EXPECT_EQ(layoutRtl("XVI", referencePaint).advances(), layoutRtl("XVI", paint).advances());
+    EXPECT_EQ(count, font->count);
+
+    // The advances may depend on the font flags.
+    paint.fontFlags = referencePaint.fontFlags = 1;
+    EXPECT_EQ(layoutRtl("XVI", referencePaint).advances(), layoutRtl("XVI", paint).advances());
+    EXPECT_LT(count, font->count);
+}
+
+TEST(LayoutPieceTest, simpleAsciiClusterInfoTest) {
+    // LayoutTestFont.ttf has no layout tables, so the text is laid out without HarfBuzz.
+    auto fc = makeFontCollection({"LayoutTestFont.ttf"});
+    MinikinPaint paint(fc);
+    paint.size = 10.0f;
+    auto text = utf8ToUtf16("IVX");
+    LayoutPiece::ClusterInfo clusterInfo;
+    LayoutPiece layout(text, Range(0, text.size()), false /* rtl */, paint,
+                       StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, &clusterInfo);
+
+    EXPECT_EQ(3u, layout.glyphCount());
+    EXPECT_EQ(Point(0, 0), layout.pointAt(0));
+    EXPECT_EQ(Point(10, 0), layout.pointAt(1));
+    EXPECT_EQ(Point(60, 0), layout.pointAt(2));
+    EXPECT_EQ(std::vector<float>({10.0f, 50.0f, 100.0f}), layout.advances().toVector());
+    EXPECT_EQ(160.0f, layout.advance());
+    EXPECT_EQ(std::vector<uint32_t>({0, 1, 2}), clusterInfo.clusters);
+    EXPECT_EQ(std::vector<uint32_t>({1, 2}), clusterInfo.safeBreaks);
+}
+
 }  // namespace
 }  // namespace minikin
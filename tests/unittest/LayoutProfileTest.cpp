@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/LayoutProfile.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "minikin/BoundsCache.h"
+#include "minikin/Layout.h"
+#include "minikin/Measurement.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+void layout(const std::string& utf8, const MinikinPaint& paint) {
+    const std::vector<uint16_t> text = utf8ToUtf16(utf8);
+    Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+           EndHyphenEdit::NO_EDIT);
+}
+
+MinikinRect bounds(const std::string& utf8, const MinikinPaint& paint) {
+    const std::vector<uint16_t> text = utf8ToUtf16(utf8);
+    MinikinRect rect;
+    getBounds(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+              EndHyphenEdit::NO_EDIT, &rect);
+    return rect;
+}
+
+// Records the words of the function and returns the profile written with the collection at 0.
+template <typename F>
+std::vector<uint8_t> recordProfile(const std::shared_ptr<FontCollection>& collection,
+                                   uint32_t maxEntries, F f) {
+    LayoutProfile& profile = LayoutProfile::getInstance();
+    profile.clear();
+    profile.setRecording(true);
+    f();
+    profile.setRecording(false);
+    std::vector<uint8_t> buffer = BufferWriter::writeToVector([&](BufferWriter* writer) {
+        profile.writeTo(writer, maxEntries, [&collection](const FontCollection& c) {
+            return &c == collection.get() ? 0 : -1;
+        });
+    });
+    profile.clear();
+    return buffer;
+}
+
+}  // namespace
+
+TEST(LayoutProfileTest, notRecordingByDefaultTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    LayoutProfile& profile = LayoutProfile::getInstance();
+    profile.clear();
+    EXPECT_FALSE(profile.isRecording());
+    layout("android is fun", paint);
+    EXPECT_EQ(0u, profile.size());
+}
+
+TEST(LayoutProfileTest, warmUpLayoutCacheTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint8_t> buffer =
+            recordProfile(paint.font, 100, [&paint] { layout("android is fun", paint); });
+
+    Layout::purgeCaches();
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    EXPECT_NE(0u, LayoutProfile::warmUp(&reader, [&paint](uint32_t index) {
+                  return index == 0 ? paint.font : nullptr;
+              }));
+    EXPECT_EQ(buffer.size(), static_cast<size_t>(reinterpret_cast<const uint8_t*>(
+                                                         reader.current()) -
+                                                 buffer.data()));
+
+    const CacheStats& stats = LayoutCache::getInstance().getStats();
+    const uint64_t missCount = stats.getMissCount();
+    layout("android is fun", paint);
+    EXPECT_EQ(missCount, stats.getMissCount());
+    Layout::purgeCaches();
+}
+
+TEST(LayoutProfileTest, warmUpBoundsCacheTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint8_t> buffer =
+            recordProfile(paint.font, 100, [&paint] { bounds("android", paint); });
+
+    Layout::purgeCaches();
+    const MinikinRect expected = bounds("android", paint);
+    Layout::purgeCaches();
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    EXPECT_EQ(1u, LayoutProfile::warmUp(&reader, [&paint](uint32_t) { return paint.font; }));
+
+    const CacheStats& stats = BoundsCache::getInstance().getStats();
+    const uint64_t missCount = stats.getMissCount();
+    EXPECT_EQ(expected, bounds("android", paint));
+    EXPECT_EQ(missCount, stats.getMissCount());
+    Layout::purgeCaches();
+}
+
+TEST(LayoutProfileTest, mostFrequentFirstTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint8_t> buffer = recordProfile(paint.font, 1, [&paint] {
+        layout("android", paint);
+        layout("fun", paint);
+        layout("fun", paint);
+    });
+
+    Layout::purgeCaches();
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    EXPECT_EQ(1u, LayoutProfile::warmUp(&reader, [&paint](uint32_t) { return paint.font; }));
+
+    const CacheStats& stats = LayoutCache::getInstance().getStats();
+    const uint64_t missCount = stats.getMissCount();
+    layout("fun", paint);
+    EXPECT_EQ(missCount, stats.getMissCount());
+    layout("android", paint);
+    EXPECT_EQ(missCount + 1, stats.getMissCount());
+    Layout::purgeCaches();
+}
+
+TEST(LayoutProfileTest, unresolvedCollectionTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint8_t> buffer =
+            recordProfile(paint.font, 100, [&paint] { layout("android", paint); });
+
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    EXPECT_EQ(0u, LayoutProfile::warmUp(&reader, [](uint32_t) { return nullptr; }));
+    EXPECT_EQ(buffer.size(), static_cast<size_t>(reinterpret_cast<const uint8_t*>(
+                                                         reader.current()) -
+                                                 buffer.data()));
+}
+
+TEST(LayoutProfileTest, versionMismatchTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    std::vector<uint8_t> buffer =
+            recordProfile(paint.font, 100, [&paint] { layout("android", paint); });
+    buffer[0]++;
+
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    EXPECT_EQ(0u, LayoutProfile::warmUp(&reader, [&paint](uint32_t) { return paint.font; }));
+}
+
+TEST(LayoutProfileTest, truncatedTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const std::vector<uint8_t> buffer = recordProfile(paint.font, 100, [&paint] {
+        layout("android", paint);
+        layout("fun", paint);
+    });
+
+    // The second word is cut off.
+    BufferReader reader(buffer.data(), 0, buffer.size() - 1);
+    EXPECT_EQ(1u, LayoutProfile::warmUp(&reader, [&paint](uint32_t) { return paint.font; }));
+    EXPECT_TRUE(reader.overflowed());
+    Layout::purgeCaches();
+}
+
+TEST(LayoutProfileTest, rangeOutOfTextTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    std::vector<uint8_t> buffer =
+            recordProfile(paint.font, 100, [&paint] { layout("android", paint); });
+
+    // Points the end of the range past the text.
+    BufferReader header(buffer.data());
+    header.skip<uint32_t>();  // version
+    header.skip<uint32_t>();  // count
+    header.skip<uint32_t>();  // collection index
+    header.skipArray<uint16_t>();
+    header.skip<uint32_t>();  // start
+    const size_t offset = static_cast<const uint8_t*>(header.current()) - buffer.data();
+    const uint32_t end = 100;
+    memcpy(buffer.data() + offset, &end, sizeof(end));
+
+    BufferReader reader(buffer.data(), 0, buffer.size());
+    EXPECT_EQ(0u, LayoutProfile::warmUp(&reader, [&paint](uint32_t) { return paint.font; }));
+    EXPECT_FALSE(reader.overflowed());
+}
+
+}  // namespace minikin
@@ -19,6 +19,7 @@
 #include <gtest/gtest.h>
 
 #include "minikin/FontCollection.h"
+#include "minikin/LayoutCache.h"
 #include "minikin/LayoutPieces.h"
 #include "minikin/Measurement.h"
 
@@ -352,6 +353,86 @@ TEST_F(LayoutTest, doLayoutTest_rtlTest) {
     }
 }
 
+TEST_F(LayoutTest, sharePiecesTest) {
+    MinikinPaint paint(mCollection);
+    paint.size = 10.0f;
+    paint.wordSpacing = 5.0f;
+
+    std::vector<uint16_t> text = utf8ToUtf16("This is an example text.");
+    Range range(0, text.size());
+    Layout copied(text, range, Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                  EndHyphenEdit::NO_EDIT);
+    Layout shared(text, range, Bidi::LTR, paint, StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT,
+                  true /* share pieces */);
+
+    ASSERT_EQ(copied.nGlyphs(), shared.nGlyphs());
+    EXPECT_EQ(copied.getAdvance(), shared.getAdvance());
+    EXPECT_EQ(copied.getAdvances(), shared.getAdvances());
+    for (size_t i = 0; i < copied.nGlyphs(); ++i) {
+        EXPECT_EQ(copied.getFont(i), shared.getFont(i));
+        EXPECT_EQ(copied.getGlyphId(i), shared.getGlyphId(i));
+        EXPECT_EQ(copied.getX(i), shared.getX(i));
+        EXPECT_EQ(copied.getY(i), shared.getY(i));
+    }
+
+    size_t index = 0;
+    shared.forEachGlyph([&](const FakedFont& font, uint32_t glyphId, float x, float y) {
+        EXPECT_EQ(copied.getFont(index), font.font.get());
+        EXPECT_EQ(copied.getGlyphId(index), glyphId);
+        EXPECT_EQ(copied.getX(index), x);
+        EXPECT_EQ(copied.getY(index), y);
+        index++;
+    });
+    EXPECT_EQ(copied.nGlyphs(), index);
+}
+
+TEST_F(LayoutTest, getGlyphRunsTest) {
+    std::vector<std::shared_ptr<FontFamily>> families = {buildFontFamily("Ascii.ttf"),
+                                                         buildFontFamily("Hiragana.ttf")};
+    MinikinPaint paint(FontCollection::create(families));
+    paint.size = 10.0f;
+
+    std::vector<uint16_t> text = utf8ToUtf16("ab \u3042\u3044 cd");
+    Range range(0, text.size());
+    for (bool sharePieces : {false, true}) {
+        Layout layout(text, range, Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                      EndHyphenEdit::NO_EDIT, sharePieces);
+        GlyphRuns runs;
+        layout.getGlyphRuns(&runs);
+
+        // "ab ", "\u3042\u3044" and " cd".
+        ASSERT_EQ(3u, runs.size());
+        EXPECT_EQ(layout.nGlyphs(), runs.glyphCount());
+        EXPECT_EQ(3u, runs.getGlyphIds(0).size());
+        EXPECT_EQ(2u, runs.getGlyphIds(1).size());
+        EXPECT_EQ(3u, runs.getGlyphIds(2).size());
+        EXPECT_NE(runs.getFont(0), runs.getFont(1));
+        EXPECT_EQ(runs.getFont(0), runs.getFont(2));
+
+        size_t index = 0;
+        for (size_t run = 0; run < runs.size(); ++run) {
+            const ArrayView<uint32_t> glyphIds = runs.getGlyphIds(run);
+            const ArrayView<Point> positions = runs.getPositions(run);
+            ASSERT_EQ(glyphIds.size(), positions.size());
+            for (size_t i = 0; i < glyphIds.size(); ++i, ++index) {
+                EXPECT_EQ(layout.getFont(index), runs.getFont(run).font.get());
+                EXPECT_EQ(layout.getFakery(index), runs.getFont(run).fakery);
+                EXPECT_EQ(layout.getGlyphId(index), glyphIds[i]);
+                EXPECT_EQ(Point(layout.getX(index), layout.getY(index)), positions[i]);
+            }
+        }
+        EXPECT_EQ(layout.nGlyphs(), index);
+
+        // The storage is reused for other layouts.
+        Layout hiragana(text, Range(3, 5), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                        EndHyphenEdit::NO_EDIT, sharePieces);
+        hiragana.getGlyphRuns(&runs);
+        ASSERT_EQ(1u, runs.size());
+        EXPECT_EQ(2u, runs.glyphCount());
+        EXPECT_EQ(Point(20.0f, 0.0f), runs.getPositions(0)[1]);
+    }
+}
+
 // Test that single-run RTL layouts of LTR-only text is laid out identical to an LTR layout.
 TEST_F(LayoutTest, singleRunBidiTest) {
     MinikinPaint paint(mCollection);
@@ -479,6 +560,98 @@ TEST_F(LayoutTest, measuredTextTest) {
     }
 }
 
+TEST_F(LayoutTest, measureTextsTest) {
+    MinikinPaint paint(mCollection);
+    paint.size = 10.0f;
+    paint.wordSpacing = 3.0f;
+    auto text = utf8ToUtf16("abc de fghi abc  j");
+    const std::vector<Range> ranges = {Range(0, 3), Range(4, 11), Range(0, 0), Range(12, 18),
+                                       Range(0, text.size())};
+    for (Bidi bidi : {Bidi::LTR, Bidi::RTL, Bidi::FORCE_RTL}) {
+        const std::vector<float> widths = Layout::measureTexts(text, ranges, bidi, paint);
+        ASSERT_EQ(ranges.size(), widths.size());
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            EXPECT_EQ(Layout::measureText(text, ranges[i], bidi, paint, StartHyphenEdit::NO_EDIT,
+                                          EndHyphenEdit::NO_EDIT, nullptr),
+                      widths[i]);
+        }
+    }
+    // All characters in Ascii.ttf has 1.0em horizontal advance.
+    EXPECT_EQ(73.0f, Layout::measureTexts(text, {Range(4, 11)}, Bidi::LTR, paint)[0]);
+    EXPECT_TRUE(Layout::measureTexts(text, {}, Bidi::LTR, paint).empty());
+}
+
+TEST_F(LayoutTest, fitPrefixTest) {
+    MinikinPaint paint(mCollection);
+    paint.size = 10.0f;
+    auto text = utf8ToUtf16("abc de fghi");
+    const Range range(0, text.size());
+    float width = -1;
+    // All characters in Ascii.ttf has 1.0em horizontal advance.
+    EXPECT_EQ(5u, Layout::fitPrefix(text, range, Bidi::LTR, paint, 55.0f, &width));
+    EXPECT_EQ(50.0f, width);
+    EXPECT_EQ(3u, Layout::fitPrefix(text, range, Bidi::LTR, paint, 30.0f, &width));
+    EXPECT_EQ(30.0f, width);
+    EXPECT_EQ(0u, Layout::fitPrefix(text, range, Bidi::LTR, paint, 5.0f, &width));
+    EXPECT_EQ(0.0f, width);
+    EXPECT_EQ(11u, Layout::fitPrefix(text, range, Bidi::LTR, paint, 1000.0f, &width));
+    EXPECT_EQ(110.0f, width);
+    // The prefix is in the logical order for RTL too.
+    EXPECT_EQ(5u, Layout::fitPrefix(text, range, Bidi::FORCE_RTL, paint, 55.0f, nullptr));
+    EXPECT_EQ(7u, Layout::fitPrefix(text, Range(4, 11), Bidi::LTR, paint, 35.0f, nullptr));
+
+    // The prefix never ends between a character and its combining mark.
+    auto combined = utf8ToUtf16("abc\u0301d");
+    EXPECT_NE(3u, Layout::fitPrefix(combined, Range(0, combined.size()), Bidi::LTR, paint, 35.0f,
+                                    nullptr));
+}
+
+TEST_F(LayoutTest, boundsAndExtentTest) {
+    MinikinPaint paint(mCollection);
+    paint.size = 10.0f;
+    paint.wordSpacing = 5.0f;
+
+    std::vector<uint16_t> text = utf8ToUtf16("This is an example text.");
+    Range range(0, text.size());
+    MinikinRect expectedBounds;
+    getBounds(text, Bidi::LTR, paint, &expectedBounds);
+    const MinikinExtent expectedExtent = getFontExtent(text, range, Bidi::LTR, paint);
+
+    for (bool sharePieces : {false, true}) {
+        Layout layout(text, range, Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                      EndHyphenEdit::NO_EDIT, sharePieces);
+        EXPECT_EQ(expectedBounds, layout.getBounds(paint));
+        EXPECT_EQ(expectedExtent, layout.getExtent());
+    }
+}
+
 // TODO: Add more test cases, e.g. measure text, letter spacing.
 
+TEST_F(LayoutTest, purgeDestroyedCollectionsTest) {
+    Layout::purgeCaches();
+    auto text = utf8ToUtf16("android");
+    MinikinPaint paint(mCollection);
+    paint.size = 10.0f;
+    Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+           EndHyphenEdit::NO_EDIT);
+    const size_t usage = LayoutCache::getInstance().getMemoryUsage();
+    {
+        MinikinPaint tempPaint(buildFontCollection("Ascii.ttf"));
+        tempPaint.size = 10.0f;
+        Layout(text, Range(0, text.size()), Bidi::LTR, tempPaint, StartHyphenEdit::NO_EDIT,
+               EndHyphenEdit::NO_EDIT);
+        EXPECT_LT(usage, LayoutCache::getInstance().getMemoryUsage());
+    }
+    // The entries of the destroyed collection are evicted by the next layout.
+    EXPECT_TRUE(FontCollection::hasDestroyedIds());
+    Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+           EndHyphenEdit::NO_EDIT);
+    EXPECT_FALSE(FontCollection::hasDestroyedIds());
+    EXPECT_EQ(usage, LayoutCache::getInstance().getMemoryUsage());
+
+    // Or by an explicit call.
+    Layout::purgeCaches(mCollection->getId());
+    EXPECT_EQ(0u, LayoutCache::getInstance().getMemoryUsage());
+}
+
 }  // namespace minikin
@@ -502,4 +502,32 @@ TEST(WordBreakTest, goPrevWordBreakTest) {
     ExpectPrevWordBreakForCache(1000, "U+4444 U+302D U+302D | U+4444");
 }
 
+TEST(WordBreakTest, getWordBreaksForCacheTest) {
+    const size_t BUF_SIZE = 256U;
+    uint16_t buf[BUF_SIZE];
+    size_t size = 0U;
+    // Spaces, CJK and a space run crossing the 32 code unit scan blocks.
+    ParseUnicode(buf, BUF_SIZE,
+                 "'a' 'b' U+0020 'c' U+4E00 U+4E8C 'd' 'e' 'f' 'g' 'h' 'i' 'j' 'k' 'l' 'm' 'n' "
+                 "'o' 'p' 'q' 'r' 's' 't' 'u' 'v' 'w' 'x' 'y' 'z' 'a' 'b' U+2000 U+2000 U+0020 "
+                 "'c' 'd' U+3042 'e'",
+                 &size, nullptr);
+    const U16StringPiece text(buf, size);
+
+    std::vector<uint32_t> breaks;
+    for (uint32_t start = 0; start <= size; ++start) {
+        for (uint32_t end = start; end <= size; ++end) {
+            std::vector<uint32_t> expected;
+            if (start != end) {
+                expected.push_back(getPrevWordBreakForCache(text, start + 1));
+                while (expected.back() < end) {
+                    expected.push_back(getNextWordBreakForCache(text, expected.back()));
+                }
+            }
+            getWordBreaksForCache(text, Range(start, end), &breaks);
+            EXPECT_EQ(expected, breaks) << "range (" << start << ", " << end << ")";
+        }
+    }
+}
+
 }  // namespace minikin
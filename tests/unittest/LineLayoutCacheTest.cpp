@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "minikin/LineLayoutCache.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+class TestableLineLayoutCache : public LineLayoutCache {
+public:
+    TestableLineLayoutCache() : LineLayoutCache() {}
+};
+
+namespace {
+
+std::shared_ptr<const Layout> getOrCreate(LineLayoutCache& cache, const std::vector<uint16_t>& text,
+                                          Bidi bidiFlags, const MinikinPaint& paint) {
+    return cache.getOrCreate(text, Range(0, text.size()), bidiFlags, paint,
+                             StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+}
+
+}  // namespace
+
+TEST(LineLayoutCacheTest, disabledByDefaultTest) {
+    auto text = utf8ToUtf16("android is fun");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+
+    TestableLineLayoutCache cache;
+    EXPECT_FALSE(cache.isEnabled());
+    std::shared_ptr<const Layout> layout1 = getOrCreate(cache, text, Bidi::LTR, paint);
+    std::shared_ptr<const Layout> layout2 = getOrCreate(cache, text, Bidi::LTR, paint);
+    EXPECT_NE(layout1, layout2);
+    EXPECT_EQ(140.0f, layout1->getAdvance());
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(LineLayoutCacheTest, cacheHitTest) {
+    auto text = utf8ToUtf16("android is fun");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+
+    TestableLineLayoutCache cache;
+    cache.setMemoryBudget(1024 * 1024);
+    std::shared_ptr<const Layout> layout1 = getOrCreate(cache, text, Bidi::LTR, paint);
+    std::shared_ptr<const Layout> layout2 = getOrCreate(cache, text, Bidi::LTR, paint);
+    EXPECT_EQ(layout1, layout2);
+    EXPECT_EQ(1u, cache.getStats().getHitCount());
+    EXPECT_EQ(1u, cache.getStats().getMissCount());
+
+    // Same as the layout created without the cache.
+    const Layout expected(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                          EndHyphenEdit::NO_EDIT);
+    EXPECT_EQ(expected.getAdvance(), layout1->getAdvance());
+    EXPECT_EQ(expected.getAdvances(), layout1->getAdvances());
+    ASSERT_EQ(expected.nGlyphs(), layout1->nGlyphs());
+    for (size_t i = 0; i < expected.nGlyphs(); ++i) {
+        EXPECT_EQ(expected.getGlyphId(i), layout1->getGlyphId(i));
+        EXPECT_EQ(expected.getX(i), layout1->getX(i));
+    }
+}
+
+TEST(LineLayoutCacheTest, cacheMissTest) {
+    auto text = utf8ToUtf16("android is fun");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+
+    TestableLineLayoutCache cache;
+    cache.setMemoryBudget(1024 * 1024);
+    std::shared_ptr<const Layout> layout = getOrCreate(cache, text, Bidi::LTR, paint);
+    {
+        SCOPED_TRACE("Different bidi flags");
+        EXPECT_NE(layout, getOrCreate(cache, text, Bidi::DEFAULT_LTR, paint));
+    }
+    {
+        SCOPED_TRACE("Different range");
+        EXPECT_NE(layout, cache.getOrCreate(text, Range(0, 7), Bidi::LTR, paint,
+                                            StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT));
+    }
+    {
+        SCOPED_TRACE("Different hyphen edit");
+        EXPECT_NE(layout, cache.getOrCreate(text, Range(0, text.size()), Bidi::LTR, paint,
+                                            StartHyphenEdit::NO_EDIT,
+                                            EndHyphenEdit::INSERT_HYPHEN));
+    }
+    {
+        SCOPED_TRACE("Different paint");
+        MinikinPaint paint2(paint);
+        paint2.size = 20.0f;
+        EXPECT_NE(layout, getOrCreate(cache, text, Bidi::LTR, paint2));
+    }
+    EXPECT_EQ(5u, cache.size());
+}
+
+TEST(LineLayoutCacheTest, memoryBudgetTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+
+    TestableLineLayoutCache cache;
+    cache.setMemoryBudget(1024 * 1024);
+    std::shared_ptr<const Layout> layout =
+            getOrCreate(cache, utf8ToUtf16("android is fun"), Bidi::LTR, paint);
+    const size_t entrySize = cache.getMemoryUsage();
+    EXPECT_LT(layout->getMemoryUsage(), entrySize);
+
+    // Only the latest line fits. The lines have the same length, so the same memory usage.
+    cache.setMemoryBudget(entrySize);
+    getOrCreate(cache, utf8ToUtf16("android is sun"), Bidi::LTR, paint);
+    EXPECT_EQ(1u, cache.size());
+    EXPECT_EQ(1u, cache.getStats().getEvictionCount());
+
+    cache.trim(0);
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(0u, cache.getMemoryUsage());
+
+    // Disabling clears the cache.
+    getOrCreate(cache, utf8ToUtf16("android"), Bidi::LTR, paint);
+    cache.setMemoryBudget(0);
+    EXPECT_FALSE(cache.isEnabled());
+    EXPECT_EQ(0u, cache.size());
+}
+
+}  // namespace minikin
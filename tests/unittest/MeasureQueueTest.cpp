@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MeasureQueue.h"
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "minikin/MeasuredText.h"
+
+#include "LineBreakerTestHelper.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+using namespace line_breaker_test_helper;
+
+namespace {
+
+constexpr float CHAR_WIDTH = 10.0;
+
+// The names of the runs in the order their measurements started.
+struct RunOrder {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> names;
+};
+
+// A run which records its name when its measurement starts, then waits for the given future.
+class BlockingRun : public ConstantRun {
+public:
+    BlockingRun(const Range& range, std::shared_future<void> start, int name, RunOrder* order)
+            : ConstantRun(range, "en-US", CHAR_WIDTH, 10.0f /* ascent */, 2.0f /* descent */),
+              mStart(start),
+              mName(name),
+              mOrder(order) {}
+
+    void getMetrics(const U16StringPiece& text, std::vector<float>* advances,
+                    LayoutPieces* precomputed, LayoutPieces* outPieces) const override {
+        {
+            std::lock_guard<std::mutex> lock(mOrder->mutex);
+            mOrder->names.push_back(mName);
+        }
+        mOrder->cv.notify_all();
+        mStart.wait();
+        ConstantRun::getMetrics(text, advances, precomputed, outPieces);
+    }
+
+private:
+    std::shared_future<void> mStart;
+    int mName;
+    RunOrder* mOrder;
+};
+
+}  // namespace
+
+TEST(MeasureQueueTest, buildAsync) {
+    const std::vector<uint16_t> text = utf8ToUtf16("This is an example text.");
+    MeasuredTextBuilder builder;
+    builder.addCustomRun<ConstantRun>(Range(0, text.size()), "en-US", CHAR_WIDTH,
+                                      10.0f /* ascent */, 2.0f /* descent */);
+    std::unique_ptr<MeasureHandle> handle =
+            builder.buildAsync(text, false /* hyphenation */, false /* full layout */,
+                               false /* ignore kerning */, MeasurePriority::High);
+    std::unique_ptr<MeasuredText> measured = handle->get();
+    ASSERT_NE(nullptr, measured);
+    EXPECT_TRUE(handle->isDone());
+    EXPECT_EQ(std::vector<float>(text.size(), CHAR_WIDTH), measured->widths);
+    // The result is only returned once.
+    EXPECT_EQ(nullptr, handle->get());
+}
+
+TEST(MeasureQueueTest, cancelAndPriority) {
+    const std::vector<uint16_t> text = utf8ToUtf16("This is an example text.");
+    std::promise<void> start;
+    std::shared_future<void> started = start.get_future().share();
+    RunOrder order;
+    const auto post = [&](int name, MeasurePriority priority) {
+        MeasuredTextBuilder builder;
+        builder.addCustomRun<BlockingRun>(Range(0, text.size()), started, name, &order);
+        return builder.buildAsync(text, false /* hyphenation */, false /* full layout */,
+                                  false /* ignore kerning */, priority);
+    };
+
+    // The first one keeps the queue busy until the others are posted.
+    std::unique_ptr<MeasureHandle> blocking = post(0, MeasurePriority::Low);
+    {
+        std::unique_lock<std::mutex> lock(order.mutex);
+        order.cv.wait(lock, [&order] { return !order.names.empty(); });
+    }
+    std::unique_ptr<MeasureHandle> low = post(1, MeasurePriority::Low);
+    std::unique_ptr<MeasureHandle> cancelled = post(2, MeasurePriority::Low);
+    std::unique_ptr<MeasureHandle> high = post(3, MeasurePriority::High);
+
+    // A queued request is done as soon as it is cancelled.
+    cancelled->cancel();
+    EXPECT_TRUE(cancelled->isDone());
+    EXPECT_EQ(nullptr, cancelled->get());
+
+    start.set_value();
+    EXPECT_NE(nullptr, blocking->get());
+    EXPECT_NE(nullptr, low->get());
+    EXPECT_NE(nullptr, high->get());
+    std::lock_guard<std::mutex> lock(order.mutex);
+    EXPECT_EQ(std::vector<int>({0, 3, 1}), order.names);
+}
+
+TEST(MeasureQueueTest, cancellationScope) {
+    EXPECT_FALSE(MeasureCancellationScope::isCancelled());
+    std::atomic<bool> cancelled = {false};
+    {
+        MeasureCancellationScope scope(&cancelled);
+        EXPECT_FALSE(MeasureCancellationScope::isCancelled());
+        cancelled.store(true);
+        EXPECT_TRUE(MeasureCancellationScope::isCancelled());
+        {
+            MeasureCancellationScope inner(nullptr);
+            EXPECT_FALSE(MeasureCancellationScope::isCancelled());
+        }
+        EXPECT_TRUE(MeasureCancellationScope::isCancelled());
+    }
+    EXPECT_FALSE(MeasureCancellationScope::isCancelled());
+}
+
+}  // namespace minikin
@@ -16,12 +16,17 @@
 
 #include "minikin/MeasuredText.h"
 
+#include <cmath>
+#include <unordered_set>
+
 #include <gtest/gtest.h>
 
 #include "minikin/LineBreaker.h"
+#include "minikin/LocaleList.h"
 #include "minikin/Measurement.h"
 
 #include "FontTestUtils.h"
+#include "LineBreakerTestHelper.h"
 #include "UnicodeUtils.h"
 
 namespace minikin {
@@ -60,6 +65,46 @@ TEST(MeasuredTextTest, RunTests) {
     EXPECT_EQ(expectedWidths, measuredText->widths);
 }
 
+TEST(MeasuredTextTest, getWidthTest) {
+    constexpr float REPLACEMENT_WIDTH = 20.0f;
+    auto font = buildFontCollection("Ascii.ttf");
+    int lbStyle = (int)LineBreakStyle::None;
+    int lbWordStyle = (int)LineBreakWordStyle::None;
+    std::vector<uint16_t> text(6, 'a');
+
+    for (bool computeHyphenation : {true, false}) {
+        MeasuredTextBuilder builder;
+        MinikinPaint paint1(font);
+        paint1.size = 10.0f;  // make 1em = 10px
+        builder.addStyleRun(0, 2, std::move(paint1), lbStyle, lbWordStyle, false /* is RTL */);
+        builder.addReplacementRun(2, 4, REPLACEMENT_WIDTH, 0 /* locale list id */);
+        MinikinPaint paint2(font);
+        paint2.size = 10.0f;  // make 1em = 10px
+        builder.addStyleRun(4, 6, std::move(paint2), lbStyle, lbWordStyle, false /* is RTL */);
+        auto mt = builder.build(text, computeHyphenation, false /* compute full layout */,
+                                false /* ignore kerning */, nullptr /* no hint */);
+
+        // The prefix sums are only needed for the line breaking.
+        EXPECT_EQ(computeHyphenation ? text.size() + 1 : 0u, mt->widthPrefixSums.size());
+
+        EXPECT_EQ(0.0f, mt->getWidth(Range(0, 0)));
+        EXPECT_EQ(CHAR_WIDTH, mt->getWidth(Range(0, 1)));
+        EXPECT_EQ(2 * CHAR_WIDTH + REPLACEMENT_WIDTH, mt->getWidth(Range(0, 3)));
+        EXPECT_EQ(REPLACEMENT_WIDTH, mt->getWidth(Range(2, 4)));
+        EXPECT_EQ(4 * CHAR_WIDTH + REPLACEMENT_WIDTH, mt->getWidth(Range(0, 6)));
+
+        EXPECT_EQ(0u, mt->getOffsetForWidth(Range(0, 6), 0.0f));
+        EXPECT_EQ(0u, mt->getOffsetForWidth(Range(0, 6), 9.0f));
+        EXPECT_EQ(1u, mt->getOffsetForWidth(Range(0, 6), 10.0f));
+        // The zero width character following the replacement fits as well.
+        EXPECT_EQ(4u, mt->getOffsetForWidth(Range(0, 6), 40.0f));
+        EXPECT_EQ(4u, mt->getOffsetForWidth(Range(1, 6), 30.0f));
+        EXPECT_EQ(6u, mt->getOffsetForWidth(Range(0, 6), 100.0f));
+        EXPECT_EQ(4u, mt->getOffsetForWidth(Range(3, 6), 5.0f));
+        EXPECT_EQ(2u, mt->getOffsetForWidth(Range(2, 2), 100.0f));
+    }
+}
+
 TEST(MeasuredTextTest, getBoundsTest) {
     auto text = utf8ToUtf16("Hello, World!");
     auto font = buildFontCollection("Ascii.ttf");
@@ -140,6 +185,33 @@ TEST(MeasuredTextTest, getBoundsTest_multiStyle) {
     EXPECT_EQ(MinikinRect(0.0f, 10.0f, 190.0f, 0.0f), mt->getBounds(text, Range(0, text.size())));
 }
 
+TEST(MeasuredTextTest, getBoundsTest_ranges) {
+    auto text = utf8ToUtf16("Hello, World!");
+    auto font = buildFontCollection("Ascii.ttf");
+    uint32_t helloLength = 7;  // length of "Hello, "
+    int lbStyle = (int)LineBreakStyle::None;
+    int lbWordStyle = (int)LineBreakWordStyle::None;
+
+    MeasuredTextBuilder builder;
+    MinikinPaint paint(font);
+    paint.size = 10.0f;
+    builder.addStyleRun(0, helloLength, std::move(paint), lbStyle, lbWordStyle, false /* is RTL */);
+    MinikinPaint paint2(font);
+    paint2.size = 20.0f;
+    builder.addStyleRun(helloLength, text.size(), std::move(paint2), lbStyle, lbWordStyle,
+                        false /* is RTL */);
+    auto mt = builder.build(text, true /* hyphenation */, true /* full layout */,
+                            false /* ignore kerning */, nullptr /* no hint */);
+
+    const std::vector<Range> ranges = {Range(0, 0), Range(0, 2), Range(1, 2), Range(6, 8),
+                                       Range(7, 7), Range(7, 8), Range(8, text.size())};
+    const std::vector<MinikinRect> bounds = mt->getBounds(text, ranges);
+    ASSERT_EQ(ranges.size(), bounds.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        EXPECT_EQ(mt->getBounds(text, ranges[i]), bounds[i]) << "range " << i;
+    }
+}
+
 TEST(MeasuredTextTest, getExtentTest) {
     auto text = utf8ToUtf16("Hello, World!");
     auto font = buildFontCollection("Ascii.ttf");
@@ -558,6 +630,52 @@ TEST(MeasuredTextTest, buildLayoutTest_multiStyle_differentPaint) {
     EXPECT_EQ(MinikinRect(0.0f, 30.0f, 390.0f, 0.0f), rect);
 }
 
+TEST(MeasuredTextTest, layoutPiecesAreShared) {
+    auto text = utf8ToUtf16("word word word word");
+    MeasuredTextBuilder builder;
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    auto mt = builder.build(text, false /* hyphenation */, true /* full layout */,
+                            false /* ignore kerning */, nullptr /* no hint */);
+
+    // The repeated words refer to the same cached piece instead of holding a copy each.
+    std::unordered_set<const LayoutPiece*> pieces;
+    for (const auto& [key, piece] : mt->layoutPieces.offsetMap) {
+        pieces.insert(piece.get());
+    }
+    EXPECT_LT(pieces.size(), mt->layoutPieces.offsetMap.size());
+}
+
+TEST(MeasuredTextTest, layoutPiecesPaintIds) {
+    auto text = utf8ToUtf16("word word word word");
+    auto font = buildFontCollection("Ascii.ttf");
+    MinikinPaint paint1(font);
+    paint1.size = 10.0f;
+    MinikinPaint paint2(font);
+    paint2.size = 20.0f;
+    paint2.fontFeatureSettings = "'liga' off";
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, 10, MinikinPaint(paint1), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    builder.addStyleRun(10, text.size(), MinikinPaint(paint2), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    auto mt = builder.build(text, false /* hyphenation */, true /* full layout */,
+                            false /* ignore kerning */, nullptr /* no hint */);
+
+    // The pieces of each run are keyed with the ID of the paint of the run.
+    const uint32_t paintId1 = mt->layoutPieces.findPaintId(paint1);
+    const uint32_t paintId2 = mt->layoutPieces.findPaintId(paint2);
+    ASSERT_NE(LayoutPieces::kNoPaintId, paintId1);
+    ASSERT_NE(LayoutPieces::kNoPaintId, paintId2);
+    EXPECT_NE(paintId1, paintId2);
+    EXPECT_EQ(2u, mt->layoutPieces.paintMap.size());
+    for (const auto& [key, piece] : mt->layoutPieces.offsetMap) {
+        EXPECT_EQ(key.range.getStart() < 10 ? paintId1 : paintId2, key.paintId);
+    }
+}
+
 TEST(MeasuredTextTest, testLineBreakStyle_from_builder) {
     auto text = utf8ToUtf16("Hello, World!");
     auto font = buildFontCollection("Ascii.ttf");
@@ -617,4 +735,495 @@ TEST(MeasuredTextTest, testLineBreakStyle_from_run) {
     EXPECT_EQ(LineBreakWordStyle::None, replacementRun.lineBreakWordStyle());
 }
 
+std::unique_ptr<MeasuredText> buildIncrementalForTest(const std::vector<uint16_t>& text,
+                                                      const Range& styleRange,
+                                                      const MeasuredText* prev,
+                                                      const TextEdit& edit) {
+    auto font = buildFontCollection("Ascii.ttf");
+    int lbStyle = (int)LineBreakStyle::None;
+    int lbWordStyle = (int)LineBreakWordStyle::None;
+
+    MeasuredTextBuilder builder;
+    MinikinPaint paint1(font);
+    paint1.size = 10.0f;  // make 1em = 10px
+    builder.addStyleRun(0, styleRange.getStart(), std::move(paint1), lbStyle, lbWordStyle,
+                        false /* is RTL */);
+    MinikinPaint paint2(font);
+    paint2.size = 20.0f;  // make 1em = 20px
+    builder.addStyleRun(styleRange.getStart(), styleRange.getEnd(), std::move(paint2), lbStyle,
+                        lbWordStyle, false /* is RTL */);
+    MinikinPaint paint3(font);
+    paint3.size = 10.0f;  // make 1em = 10px
+    builder.addStyleRun(styleRange.getEnd(), text.size(), std::move(paint3), lbStyle, lbWordStyle,
+                        false /* is RTL */);
+    if (prev == nullptr) {
+        return builder.build(text, true /* hyphenation */, true /* full layout */,
+                             false /* ignore kerning */, nullptr /* no hint */);
+    }
+    return builder.buildIncremental(text, true /* hyphenation */, true /* full layout */,
+                                    false /* ignore kerning */, *prev, edit);
+}
+
+void expectSameMeasuredText(const MeasuredText& expected, const MeasuredText& actual) {
+    EXPECT_EQ(expected.widths, actual.widths);
+    EXPECT_EQ(expected.widthPrefixSums, actual.widthPrefixSums);
+    EXPECT_EQ(expected.getTextClass(), actual.getTextClass());
+    ASSERT_EQ(expected.hyphenBreaks.size(), actual.hyphenBreaks.size());
+    for (size_t i = 0; i < expected.hyphenBreaks.size(); ++i) {
+        EXPECT_EQ(expected.hyphenBreaks[i].offset, actual.hyphenBreaks[i].offset);
+        EXPECT_EQ(expected.hyphenBreaks[i].type, actual.hyphenBreaks[i].type);
+        EXPECT_EQ(expected.hyphenBreaks[i].first, actual.hyphenBreaks[i].first);
+        EXPECT_EQ(expected.hyphenBreaks[i].second, actual.hyphenBreaks[i].second);
+    }
+    EXPECT_EQ(expected.layoutPieces.offsetMap.size(), actual.layoutPieces.offsetMap.size());
+    for (const auto& [key, piece] : expected.layoutPieces.offsetMap) {
+        EXPECT_NE(actual.layoutPieces.offsetMap.end(), actual.layoutPieces.offsetMap.find(key));
+    }
+}
+
+TEST(MeasuredTextTest, buildIncrementalTest_insert) {
+    auto prevText = utf8ToUtf16("This is an example text.");
+    auto prev = buildIncrementalForTest(prevText, Range(8, 10), nullptr, TextEdit(0, 0, 0));
+
+    // Insert "bigger " before "example", i.e. into the third run.
+    auto text = utf8ToUtf16("This is an bigger example text.");
+    const TextEdit edit(11, 0, 7);
+    auto incremental = buildIncrementalForTest(text, Range(8, 10), prev.get(), edit);
+    auto expected = buildIncrementalForTest(text, Range(8, 10), nullptr, edit);
+    expectSameMeasuredText(*expected, *incremental);
+
+    // Insert into the middle of a word in the styled run.
+    text = utf8ToUtf16("This is aan example text.");
+    auto incremental2 = buildIncrementalForTest(text, Range(8, 11), prev.get(), TextEdit(9, 0, 1));
+    auto expected2 = buildIncrementalForTest(text, Range(8, 11), nullptr, TextEdit(9, 0, 1));
+    expectSameMeasuredText(*expected2, *incremental2);
+}
+
+TEST(MeasuredTextTest, buildIncrementalTest_remove) {
+    auto prevText = utf8ToUtf16("This is an example text.");
+    auto prev = buildIncrementalForTest(prevText, Range(8, 10), nullptr, TextEdit(0, 0, 0));
+
+    // Remove the space between "an" and "example", joining the two words.
+    auto text = utf8ToUtf16("This is anexample text.");
+    const TextEdit edit(10, 1, 0);
+    auto incremental = buildIncrementalForTest(text, Range(8, 10), prev.get(), edit);
+    auto expected = buildIncrementalForTest(text, Range(8, 10), nullptr, edit);
+    expectSameMeasuredText(*expected, *incremental);
+
+    // Replace the end of the text.
+    text = utf8ToUtf16("This is an example!");
+    auto incremental2 = buildIncrementalForTest(text, Range(8, 10), prev.get(), TextEdit(18, 6, 1));
+    auto expected2 = buildIncrementalForTest(text, Range(8, 10), nullptr, TextEdit(18, 6, 1));
+    expectSameMeasuredText(*expected2, *incremental2);
+}
+
+TEST(MeasuredTextTest, buildIncrementalTest_mismatchedRuns) {
+    auto prevText = utf8ToUtf16("This is an example text.");
+    auto prev = buildIncrementalForTest(prevText, Range(8, 10), nullptr, TextEdit(0, 0, 0));
+
+    // The styled run moved, so the whole text is measured again.
+    auto text = utf8ToUtf16("This is an example texts.");
+    const TextEdit edit(23, 0, 1);
+    auto incremental = buildIncrementalForTest(text, Range(11, 18), prev.get(), edit);
+    auto expected = buildIncrementalForTest(text, Range(11, 18), nullptr, edit);
+    expectSameMeasuredText(*expected, *incremental);
+    EXPECT_EQ(2 * CHAR_WIDTH, incremental->getWidth(Range(8, 10)));  // No longer styled.
+}
+
+TEST(MeasuredTextTest, deferredHyphenation) {
+    // Only the soft hyphens are hyphenated, no hyphenator is registered.
+    auto text = utf8ToUtf16("This is an exam\u00ADple text.");
+    auto expected = buildIncrementalForTest(text, Range(8, 10), nullptr, TextEdit(0, 0, 0));
+    ASSERT_FALSE(expected->hyphenBreaks.empty());
+    EXPECT_FALSE(expected->isHyphenationDeferred());
+
+    MeasuredText::setDeferredHyphenationEnabled(true);
+    auto deferred = buildIncrementalForTest(text, Range(8, 10), nullptr, TextEdit(0, 0, 0));
+    MeasuredText::setDeferredHyphenationEnabled(false);
+    EXPECT_TRUE(deferred->isHyphenationDeferred());
+    EXPECT_TRUE(deferred->hyphenBreaks.empty());
+    EXPECT_EQ(expected->widths, deferred->widths);
+
+    const std::vector<HyphenBreak> actual = deferred->computeHyphenBreaks(text);
+    ASSERT_EQ(expected->hyphenBreaks.size(), actual.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        EXPECT_EQ(expected->hyphenBreaks[i].offset, actual[i].offset);
+        EXPECT_EQ(expected->hyphenBreaks[i].type, actual[i].type);
+        EXPECT_EQ(expected->hyphenBreaks[i].first, actual[i].first);
+        EXPECT_EQ(expected->hyphenBreaks[i].second, actual[i].second);
+    }
+}
+
+std::unique_ptr<MeasuredText> buildLongTextForTest(const std::vector<uint16_t>& text,
+                                                   bool parallel) {
+    MeasuredText::setParallelMeasurementEnabled(parallel);
+    MeasuredTextBuilder builder;
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    builder.addStyleRun(0, text.size(), std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    auto result = builder.build(text, true /* hyphenation */, true /* full layout */,
+                                false /* ignore kerning */, nullptr /* no hint */);
+    MeasuredText::setParallelMeasurementEnabled(false);
+    return result;
+}
+
+TEST(MeasuredTextTest, parallelMeasurement) {
+    // A single run long enough to be split into several chunks, with hyphenated words.
+    std::string str;
+    for (int i = 0; i < 1000; ++i) {
+        str += "exam\u00ADple text ";
+    }
+    const std::vector<uint16_t> text = utf8ToUtf16(str);
+    auto expected = buildLongTextForTest(text, false /* parallel */);
+    auto actual = buildLongTextForTest(text, true /* parallel */);
+    ASSERT_FALSE(expected->hyphenBreaks.empty());
+    expectSameMeasuredText(*expected, *actual);
+}
+
+TEST(MeasuredTextTest, parallelMeasurement_customRuns) {
+    constexpr float CHAR_WIDTH = 10.0;
+    std::string str;
+    for (int i = 0; i < 400; ++i) {
+        str += "exam\u00ADple ";
+    }
+    const std::vector<uint16_t> text = utf8ToUtf16(str);
+    const auto build = [&](bool parallel) {
+        MeasuredText::setParallelMeasurementEnabled(parallel);
+        MeasuredTextBuilder builder;
+        const uint32_t runLength = text.size() / 4;
+        for (uint32_t start = 0; start < text.size(); start += runLength) {
+            const uint32_t end = std::min<uint32_t>(start + runLength, text.size());
+            builder.addCustomRun<line_breaker_test_helper::ConstantRun>(
+                    Range(start, end), "en-US", CHAR_WIDTH, 10.0f /* ascent */,
+                    2.0f /* descent */);
+        }
+        auto result = builder.build(text, true /* hyphenation */, false /* full layout */,
+                                    false /* ignore kerning */, nullptr /* no hint */);
+        MeasuredText::setParallelMeasurementEnabled(false);
+        return result;
+    };
+    auto expected = build(false);
+    auto actual = build(true);
+    ASSERT_FALSE(expected->hyphenBreaks.empty());
+    expectSameMeasuredText(*expected, *actual);
+}
+
+TEST(MeasuredTextTest, compactWidths) {
+    // More distinct widths than the palette holds, so that the last ones are escaped.
+    std::vector<float> widths;
+    for (int i = 0; i < 1000; ++i) {
+        widths.push_back(i % 3 == 0 ? 0.0f : (i % 300) * 0.25f);
+    }
+    widths.push_back(-0.0f);
+    CompactWidths compact;
+    ASSERT_TRUE(compact.build(widths));
+    ASSERT_EQ(widths.size(), compact.size());
+    for (uint32_t i = 0; i < widths.size(); ++i) {
+        EXPECT_EQ(widths[i], compact.get(i)) << i;
+    }
+    EXPECT_TRUE(std::signbit(compact.get(widths.size() - 1)));
+    EXPECT_GT(sizeof(float) * widths.size(), compact.getMemoryUsage());
+
+    // All distinct widths are not worth compacting.
+    std::vector<float> distinct;
+    for (int i = 0; i < 1000; ++i) {
+        distinct.push_back(i);
+    }
+    CompactWidths notCompacted;
+    EXPECT_FALSE(notCompacted.build(distinct));
+    EXPECT_EQ(0u, notCompacted.size());
+}
+
+TEST(MeasuredTextTest, compactWidths_lineBreak) {
+    constexpr float CHAR_WIDTH = 10.0;
+    const std::vector<uint16_t> text =
+            utf8ToUtf16("This is an exam\u00ADple text. And the second sentence of it.");
+    const auto build = [&](bool compact) {
+        MeasuredText::setCompactWidthsEnabled(compact);
+        MeasuredTextBuilder builder;
+        builder.addCustomRun<line_breaker_test_helper::ConstantRun>(
+                Range(0, 20), "en-US", CHAR_WIDTH, 10.0f /* ascent */, 2.0f /* descent */);
+        builder.addCustomRun<line_breaker_test_helper::ConstantRun>(
+                Range(20, text.size()), "en-US", CHAR_WIDTH * 1.5f, 10.0f /* ascent */,
+                2.0f /* descent */);
+        auto result = builder.build(text, true /* hyphenation */, false /* full layout */,
+                                    false /* ignore kerning */, nullptr /* no hint */);
+        MeasuredText::setCompactWidthsEnabled(false);
+        return result;
+    };
+    auto expected = build(false);
+    auto actual = build(true);
+    EXPECT_TRUE(actual->widths.empty());
+    ASSERT_EQ(expected->getCharCount(), actual->getCharCount());
+    for (uint32_t i = 0; i < text.size(); ++i) {
+        EXPECT_EQ(expected->getCharWidth(i), actual->getCharWidth(i));
+    }
+    EXPECT_GT(expected->getMemoryUsage(), actual->getMemoryUsage());
+
+    const line_breaker_test_helper::RectangleLineWidth lineWidth(120);
+    const TabStops tabStops(nullptr, 0, 0);
+    for (BreakStrategy strategy : {BreakStrategy::Greedy, BreakStrategy::HighQuality}) {
+        const LineBreakResult expectedLines =
+                breakIntoLines(text, strategy, HyphenationFrequency::Normal, false /* justified */,
+                               *expected, lineWidth, tabStops);
+        const LineBreakResult actualLines =
+                breakIntoLines(text, strategy, HyphenationFrequency::Normal, false /* justified */,
+                               *actual, lineWidth, tabStops);
+        EXPECT_EQ(expectedLines.breakPoints, actualLines.breakPoints);
+        EXPECT_EQ(expectedLines.widths, actualLines.widths);
+    }
+}
+
+// A ConstantRun counting the hyphenated pieces it shapes, whose hyphen is as wide as a character.
+class HyphenCountingRun : public line_breaker_test_helper::ConstantRun {
+public:
+    HyphenCountingRun(const Range& range, const std::string& lang, float width, float ascent,
+                      float descent)
+            : ConstantRun(range, lang, width, ascent, descent), mWidth(width) {}
+
+    float measureHyphenPiece(const U16StringPiece& text, const Range& range,
+                             StartHyphenEdit start, EndHyphenEdit end,
+                             LayoutPieces* pieces) const override {
+        hyphenPieceCount++;
+        return ConstantRun::measureHyphenPiece(text, range, start, end, pieces);
+    }
+
+    float measureText(const U16StringPiece& text) const override {
+        measureTextCount++;
+        return mWidth * text.size();
+    }
+
+    mutable int hyphenPieceCount = 0;
+    mutable int measureTextCount = 0;
+
+private:
+    float mWidth;
+};
+
+TEST(MeasuredTextTest, hyphenPieceEstimation) {
+    constexpr float CHAR_WIDTH = 10.0;
+    // Two Latin words and a Hebrew one, whose pieces are still shaped.
+    const std::vector<uint16_t> text =
+            utf8ToUtf16("exam\u00ADple text\u00ADbook \u05D0\u05D1\u00AD\u05D2\u05D3");
+    const auto build = [&](bool estimate) {
+        MeasuredText::setHyphenPieceEstimationEnabled(estimate);
+        MeasuredTextBuilder builder;
+        builder.addCustomRun<HyphenCountingRun>(Range(0, text.size()), "en-US", CHAR_WIDTH,
+                                                10.0f /* ascent */, 2.0f /* descent */);
+        auto result = builder.build(text, true /* hyphenation */, false /* full layout */,
+                                    false /* ignore kerning */, nullptr /* no hint */);
+        MeasuredText::setHyphenPieceEstimationEnabled(false);
+        return result;
+    };
+    auto expected = build(false);
+    auto actual = build(true);
+    ASSERT_EQ(3u, expected->hyphenBreaks.size());
+    ASSERT_EQ(expected->hyphenBreaks.size(), actual->hyphenBreaks.size());
+    for (size_t i = 0; i < expected->hyphenBreaks.size(); ++i) {
+        EXPECT_EQ(expected->hyphenBreaks[i].offset, actual->hyphenBreaks[i].offset);
+        EXPECT_EQ(expected->hyphenBreaks[i].type, actual->hyphenBreaks[i].type);
+        EXPECT_EQ(expected->hyphenBreaks[i].first, actual->hyphenBreaks[i].first);
+        EXPECT_EQ(expected->hyphenBreaks[i].second, actual->hyphenBreaks[i].second);
+    }
+
+    const auto& shapedRun = static_cast<const HyphenCountingRun&>(*expected->runs[0]);
+    const auto& estimatedRun = static_cast<const HyphenCountingRun&>(*actual->runs[0]);
+    EXPECT_EQ(6, shapedRun.hyphenPieceCount);
+    EXPECT_EQ(0, shapedRun.measureTextCount);
+    // Only the Hebrew word is shaped, and the hyphen is measured once.
+    EXPECT_EQ(2, estimatedRun.hyphenPieceCount);
+    EXPECT_EQ(1, estimatedRun.measureTextCount);
+}
+
+TEST(MeasuredTextTest, singleRunFastPathTest) {
+    auto font = buildFontCollection("Ascii.ttf");
+    int lbStyle = (int)LineBreakStyle::None;
+    int lbWordStyle = (int)LineBreakWordStyle::None;
+    // Long enough for more than one batch of words.
+    std::string utf8;
+    for (int i = 0; i < 40; ++i) {
+        utf8 += "This is an exam\u00ADple text.\tAnd ";
+    }
+    const std::vector<uint16_t> text = utf8ToUtf16(utf8);
+    const auto build = [&](bool fastPath) {
+        MeasuredText::setSingleRunFastPathEnabled(fastPath);
+        MeasuredTextBuilder builder;
+        MinikinPaint paint(font);
+        paint.size = 10.0f;
+        builder.addStyleRun(0, text.size(), std::move(paint), lbStyle, lbWordStyle,
+                            false /* is RTL */);
+        auto result = builder.build(text, true /* hyphenation */, true /* full layout */,
+                                    false /* ignore kerning */, nullptr /* no hint */);
+        MeasuredText::setSingleRunFastPathEnabled(false);
+        return result;
+    };
+    auto expected = build(false);
+    auto actual = build(true);
+    EXPECT_TRUE(actual->isSingleLtrStyleRun());
+    expectSameMeasuredText(*expected, *actual);
+
+    const line_breaker_test_helper::RectangleLineWidth lineWidth(300);
+    const TabStops tabStops(nullptr, 0, 40);
+    const LineBreakResult expectedLines =
+            breakIntoLines(text, BreakStrategy::Greedy, HyphenationFrequency::Normal,
+                           false /* justified */, *expected, lineWidth, tabStops);
+    const LineBreakResult actualLines =
+            breakIntoLines(text, BreakStrategy::Greedy, HyphenationFrequency::Normal,
+                           false /* justified */, *actual, lineWidth, tabStops);
+    EXPECT_EQ(expectedLines.breakPoints, actualLines.breakPoints);
+    EXPECT_EQ(expectedLines.widths, actualLines.widths);
+}
+
+std::vector<uint8_t> writeMeasuredText(
+        const MeasuredText& mt, const std::vector<std::shared_ptr<FontCollection>>& collections) {
+    BufferWriter fakeWriter(nullptr);
+    EXPECT_TRUE(mt.writeTo(&fakeWriter, collections));
+    std::vector<uint8_t> buffer(fakeWriter.size(), 0xFFu);
+    BufferWriter writer(buffer.data());
+    EXPECT_TRUE(mt.writeTo(&writer, collections));
+    EXPECT_EQ(buffer.size(), writer.size());
+    return buffer;
+}
+
+TEST(MeasuredTextTest, writeTo) {
+    auto text = utf8ToUtf16("Hello, wonder\u00ADful World!");
+    auto font = buildFontCollection("Ascii.ttf");
+    auto otherFont = buildFontCollection("Bbox.ttf");
+    MeasuredTextBuilder builder;
+    MinikinPaint paint(font);
+    paint.size = 10.0f;
+    paint.localeListId = registerLocaleList("en-US");
+    builder.addStyleRun(0, 7, std::move(paint), (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    builder.addReplacementRun(7, 8, 25.0f, registerLocaleList("en-US"));
+    MinikinPaint paint2(font);
+    paint2.size = 20.0f;
+    builder.addStyleRun(8, text.size(), std::move(paint2), (int)LineBreakStyle::Strict,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    auto expected = builder.build(text, true /* hyphenation */, true /* full layout */,
+                                  false /* ignore kerning */, nullptr /* no hint */);
+
+    const std::vector<std::shared_ptr<FontCollection>> collections = {otherFont, font};
+    std::vector<uint8_t> buffer = writeMeasuredText(*expected, collections);
+    BufferReader reader(buffer.data());
+    auto actual = MeasuredText::readFrom(&reader, collections);
+    ASSERT_TRUE(actual);
+    expectSameMeasuredText(*expected, *actual);
+    ASSERT_EQ(3u, actual->runs.size());
+    EXPECT_EQ(font.get(), actual->runs[0]->getPaint()->font.get());
+    EXPECT_EQ(10.0f, actual->runs[0]->getPaint()->size);
+    EXPECT_EQ(registerLocaleList("en-US"), actual->runs[0]->getLocaleListId());
+    EXPECT_EQ(Range(7, 8), actual->runs[1]->getRange());
+    EXPECT_EQ(registerLocaleList("en-US"), actual->runs[1]->getLocaleListId());
+    EXPECT_EQ(LineBreakStyle::Strict, actual->runs[2]->lineBreakStyle());
+    EXPECT_EQ(expected->layoutPieces.offsetMap.size(), actual->layoutPieces.offsetMap.size());
+
+    // The restored pieces are used for the layout.
+    MinikinPaint samePaint(font);
+    samePaint.size = 20.0f;
+    const Range range(8, text.size());
+    Layout expectedLayout = expected->buildLayout(text, range, range, samePaint,
+                                                  StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+    Layout actualLayout = actual->buildLayout(text, range, range, samePaint,
+                                              StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT);
+    ASSERT_EQ(expectedLayout.nGlyphs(), actualLayout.nGlyphs());
+    for (uint32_t i = 0; i < expectedLayout.nGlyphs(); ++i) {
+        EXPECT_EQ(expectedLayout.getGlyphId(i), actualLayout.getGlyphId(i));
+        EXPECT_EQ(expectedLayout.getFont(i), actualLayout.getFont(i));
+        EXPECT_EQ(expectedLayout.getX(i), actualLayout.getX(i));
+    }
+    EXPECT_EQ(expectedLayout.getAdvances(), actualLayout.getAdvances());
+
+    // The fonts are written as indices, so they must be the same collections.
+    BufferReader otherReader(buffer.data());
+    EXPECT_FALSE(MeasuredText::readFrom(&otherReader, {otherFont}));
+    BufferWriter writer(nullptr);
+    EXPECT_FALSE(expected->writeTo(&writer, {otherFont}));
+}
+
+TEST(MeasuredTextTest, writeTo_runsWithoutFont) {
+    std::vector<uint16_t> text(6, 'a');
+    MeasuredTextBuilder builder;
+    builder.addReplacementRun(0, 2, 20.0f, 0 /* locale list id */);
+    builder.addReplacementRun(2, 6, -5.0f, registerLocaleList("ja-JP"));
+    auto expected = builder.build(text, true /* hyphenation */, false /* full layout */,
+                                  false /* ignore kerning */, nullptr /* no hint */);
+    std::vector<uint8_t> buffer = writeMeasuredText(*expected, {});
+    BufferReader reader(buffer.data());
+    auto actual = MeasuredText::readFrom(&reader, {});
+    ASSERT_TRUE(actual);
+    expectSameMeasuredText(*expected, *actual);
+    ASSERT_EQ(2u, actual->runs.size());
+    EXPECT_EQ(registerLocaleList("ja-JP"), actual->runs[1]->getLocaleListId());
+    EXPECT_EQ(2u, actual->getOffsetForWidth(Range(0, 6), 20.0f));
+
+    // The custom runs can't be written.
+    MeasuredTextBuilder customBuilder;
+    customBuilder.addCustomRun<line_breaker_test_helper::ConstantRun>(
+            Range(0, text.size()), "en-US", 10.0f /* width */, 10.0f /* ascent */,
+            2.0f /* descent */);
+    auto custom = customBuilder.build(text, true /* hyphenation */, false /* full layout */,
+                                      false /* ignore kerning */, nullptr /* no hint */);
+    BufferWriter writer(nullptr);
+    EXPECT_FALSE(custom->writeTo(&writer, {}));
+}
+
+TEST(MeasuredTextTest, recycle) {
+    auto text = utf8ToUtf16("Hello, World! Hello, Minikin!");
+    auto font = buildFontCollection("Ascii.ttf");
+    MinikinPaint paint(font);
+    paint.size = 10.0f;
+    MinikinPaint paint2(font);
+    paint2.size = 20.0f;
+    paint2.fontFeatureSettings = "'liga' off";
+    auto addRuns = [&](MeasuredTextBuilder* builder) {
+        builder->addStyleRun(0, 14, paint, (int)LineBreakStyle::None,
+                             (int)LineBreakWordStyle::None, false /* is RTL */);
+        builder->addReplacementRun(14, 15, 5.0f, 0 /* locale list id */);
+        builder->addStyleRun(15, text.size(), paint2, (int)LineBreakStyle::Strict,
+                             (int)LineBreakWordStyle::None, true /* is RTL */);
+    };
+
+    MeasuredTextBuilder builder;
+    addRuns(&builder);
+    auto first = builder.build(text, true /* hyphenation */, true /* full layout */,
+                               false /* ignore kerning */, nullptr /* no hint */);
+    const Run* firstStyleRun = first->runs[0].get();
+    const Run* secondStyleRun = first->runs[2].get();
+
+    // The style runs of the recycled text are reused, the replacement run is not.
+    builder.recycle(std::move(first));
+    addRuns(&builder);
+    auto actual = builder.build(text, true /* hyphenation */, true /* full layout */,
+                                false /* ignore kerning */, nullptr /* no hint */);
+    ASSERT_EQ(3u, actual->runs.size());
+    EXPECT_EQ(secondStyleRun, actual->runs[0].get());
+    EXPECT_EQ(firstStyleRun, actual->runs[2].get());
+    EXPECT_EQ(Range(0, 14), actual->runs[0]->getRange());
+    EXPECT_EQ(paint, *actual->runs[0]->getPaint());
+    EXPECT_FALSE(actual->runs[0]->isRtl());
+    EXPECT_EQ(LineBreakStyle::None, actual->runs[0]->lineBreakStyle());
+    EXPECT_EQ(Range(15, text.size()), actual->runs[2]->getRange());
+    EXPECT_EQ(paint2, *actual->runs[2]->getPaint());
+    EXPECT_TRUE(actual->runs[2]->isRtl());
+    EXPECT_EQ(LineBreakStyle::Strict, actual->runs[2]->lineBreakStyle());
+
+    MeasuredTextBuilder freshBuilder;
+    addRuns(&freshBuilder);
+    auto expected = freshBuilder.build(text, true /* hyphenation */, true /* full layout */,
+                                       false /* ignore kerning */, nullptr /* no hint */);
+    expectSameMeasuredText(*expected, *actual);
+
+    // The runs added but not built are discarded by a reset.
+    addRuns(&builder);
+    builder.reset();
+    builder.addStyleRun(0, text.size(), paint, (int)LineBreakStyle::None,
+                        (int)LineBreakWordStyle::None, false /* is RTL */);
+    auto single = builder.build(text, false /* hyphenation */, false /* full layout */,
+                                false /* ignore kerning */, nullptr /* no hint */);
+    ASSERT_EQ(1u, single->runs.size());
+    EXPECT_EQ(Range(0, text.size()), single->runs[0]->getRange());
+}
+
 }  // namespace minikin
@@ -149,4 +149,69 @@ TEST(Measurement, distributeAdvances_surrogate_in_ligature) {
     EXPECT_EQ(ligated[3], 0.0);
 }
 
+size_t getOffsetForAdvance(const float* advances, const char* src, int count, float advance) {
+    const size_t BUF_SIZE = 256;
+    uint16_t buf[BUF_SIZE];
+    size_t offset;
+    size_t size;
+    ParseUnicode(buf, BUF_SIZE, src, &size, &offset);
+    return getOffsetForAdvance(advances, buf, offset, count, advance);
+}
+
+TEST(Measurement, getOffsetForAdvance_simple) {
+    // Every code unit is a grapheme cluster with an advance. The carets are at 0, 10, 30 and 60.
+    const float advances[] = {10.0, 20.0, 30.0};
+    EXPECT_EQ(0u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, -5.0));
+    EXPECT_EQ(0u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, 5.0));
+    EXPECT_EQ(1u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, 6.0));
+    EXPECT_EQ(1u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, 19.0));
+    EXPECT_EQ(2u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, 21.0));
+    EXPECT_EQ(3u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, 60.0));
+    EXPECT_EQ(3u, getOffsetForAdvance(advances, "| 'a' 'b' 'c'", 3, 100.0));
+    // With a non zero start.
+    EXPECT_EQ(2u, getOffsetForAdvance(advances, "'x' | 'a' 'b' 'c'", 3, 19.0));
+}
+
+TEST(Measurement, getOffsetForAdvance_combining_mark) {
+    // The acute accent forms a grapheme cluster with 'e', so the offset between them is skipped.
+    const float advances[] = {10.0, 20.0, 0.0, 30.0};
+    EXPECT_EQ(1u, getOffsetForAdvance(advances, "| 'a' 'e' U+0301 'c'", 4, 19.0));
+    EXPECT_EQ(3u, getOffsetForAdvance(advances, "| 'a' 'e' U+0301 'c'", 4, 21.0));
+}
+
+TEST(Measurement, distributeAdvances_no_ligature) {
+    float advances[] = {10.0, 20.0, 30.0};
+    distributeAdvances(advances, "| 'a' 'b' 'c'", 3);
+    EXPECT_EQ(advances[0], 10.0);
+    EXPECT_EQ(advances[1], 20.0);
+    EXPECT_EQ(advances[2], 30.0);
+}
+
+TEST(Measurement, RunHitTestIndex) {
+    // Ligatures, a combining mark, a surrogate pair and control characters, from a non zero start.
+    const size_t BUF_SIZE = 256;
+    uint16_t buf[BUF_SIZE];
+    size_t start;
+    size_t size;
+    ParseUnicode(buf, BUF_SIZE,
+                 "'x' | 'f' 'i' 'a' 'e' U+0301 U+1F600 U+2066 'f' 'f' 'i' U+202C U+0915 U+094D "
+                 "U+0915",
+                 &size, &start);
+    const float advances[] = {40.0, 0.0, 10.0, 20.0, 0.0, 30.0, 0.0, 0.0,
+                              60.0, 0.0, 0.0,  0.0,  30.0, 0.0, 0.0};
+    const size_t count = size - start;
+    ASSERT_EQ(sizeof(advances) / sizeof(float), count);
+
+    RunHitTestIndex index(advances, buf, start, count);
+    for (size_t offset = start; offset <= size; ++offset) {
+        EXPECT_EQ(getRunAdvance(advances, buf, start, count, offset), index.getRunAdvance(offset))
+                << "offset " << offset;
+    }
+    for (float advance = -10.0f; advance <= 250.0f; advance += 2.5f) {
+        EXPECT_EQ(getOffsetForAdvance(advances, buf, start, count, advance),
+                  index.getOffsetForAdvance(advance))
+                << "advance " << advance;
+    }
+}
+
 }  // namespace minikin
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/MemoryUsage.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/Layout.h"
+#include "minikin/LayoutCache.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+size_t getBytes(const MemoryUsage& usage, const std::string& name) {
+    for (const MemoryUsage::Entry& entry : usage.entries) {
+        if (name == entry.name) {
+            return entry.bytes;
+        }
+    }
+    ADD_FAILURE() << name << " is not reported";
+    return 0;
+}
+
+// The total of the caches which are cleared by purgeCaches() and trimMemory(). The locale lists
+// and the hyphenator registrations are never evicted, and the ExternalRefs belong to the fonts.
+size_t getCacheTotal(const MemoryUsage& usage) {
+    return usage.getTotal() - getBytes(usage, "LocaleListCache") -
+           getBytes(usage, "HyphenatorMap") - getBytes(usage, "ExternalRefs");
+}
+
+void layoutWords(size_t count) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    for (size_t i = 0; i < count; ++i) {
+        const std::vector<uint16_t> text = utf8ToUtf16("word" + std::to_string(i));
+        Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+               EndHyphenEdit::NO_EDIT);
+    }
+}
+
+}  // namespace
+
+TEST(MemoryUsageTest, getMemoryUsageTest) {
+    Layout::purgeCaches();
+    EXPECT_EQ(0u, getCacheTotal(getMemoryUsage()));
+
+    layoutWords(10);
+    const MemoryUsage usage = getMemoryUsage();
+    EXPECT_EQ(LayoutCache::getInstance().getMemoryUsage(), getBytes(usage, "LayoutCache"));
+    EXPECT_NE(0u, getBytes(usage, "LayoutCache"));
+    EXPECT_EQ(0u, getBytes(usage, "LineLayoutCache"));
+    EXPECT_EQ(0u, getBytes(usage, "LayoutSegmentCache (bulk)"));
+    // Always has the empty list.
+    EXPECT_NE(0u, getBytes(usage, "LocaleListCache"));
+
+    size_t total = 0;
+    for (const MemoryUsage::Entry& entry : usage.entries) {
+        total += entry.bytes;
+    }
+    EXPECT_EQ(total, usage.getTotal());
+    Layout::purgeCaches();
+}
+
+TEST(MemoryUsageTest, trimMemoryTest) {
+    Layout::purgeCaches();
+    layoutWords(100);
+    const size_t before = getCacheTotal(getMemoryUsage());
+    ASSERT_NE(0u, before);
+
+    // The running levels keep more than the hidden ones.
+    trimMemory(TrimMemoryLevel::RUNNING_MODERATE);
+    const size_t afterModerate = getCacheTotal(getMemoryUsage());
+    EXPECT_LE(afterModerate, before * 3 / 4);
+    EXPECT_NE(0u, afterModerate);
+
+    trimMemory(TrimMemoryLevel::BACKGROUND);
+    const size_t afterBackground = getCacheTotal(getMemoryUsage());
+    EXPECT_LE(afterBackground, afterModerate / 4);
+
+    trimMemory(TrimMemoryLevel::COMPLETE);
+    EXPECT_EQ(0u, getCacheTotal(getMemoryUsage()));
+}
+
+}  // namespace minikin
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <limits>
 #include <memory>
 
 #include <gtest/gtest.h>
@@ -1870,5 +1871,391 @@ TEST_F(OptimalLineBreakerTest, roundingError) {
     EXPECT_EQ(1u, r.breakPoints.size());
 }
 
+TEST_F(OptimalLineBreakerTest, deferredHyphenation) {
+    const std::vector<uint16_t> textBuf = utf8ToUtf16("This is an example text for hyphenation.");
+    const std::string lang = "en-US";
+    for (BreakStrategy strategy : {BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+        for (float lineWidth : {50.0f, 100.0f, 150.0f, 1000.0f}) {
+            for (bool ignoreKerning : {false, true}) {
+                SCOPED_TRACE(lineWidth);
+                LineBreakResult expected =
+                        doLineBreak(textBuf, strategy, HyphenationFrequency::Full, lang, lineWidth,
+                                    ignoreKerning);
+                MeasuredText::setDeferredHyphenationEnabled(true);
+                LineBreakResult actual =
+                        doLineBreak(textBuf, strategy, HyphenationFrequency::Full, lang, lineWidth,
+                                    ignoreKerning);
+                MeasuredText::setDeferredHyphenationEnabled(false);
+                EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+                EXPECT_EQ(expected.widths, actual.widths);
+                EXPECT_EQ(expected.flags, actual.flags);
+            }
+        }
+    }
+}
+
+TEST_F(OptimalLineBreakerTest, wordBreakRecording) {
+    const std::vector<uint16_t> textBuf =
+            utf8ToUtf16("This is an example text, see http://example.com/a/b for hyphenation.");
+    const std::string lang = "en-US";
+    for (BreakStrategy strategy : {BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+        for (float lineWidth : {50.0f, 100.0f, 150.0f, 1000.0f}) {
+            SCOPED_TRACE(lineWidth);
+            LineBreakResult expected = doLineBreak(textBuf, strategy, HyphenationFrequency::Full,
+                                                   lang, lineWidth, false /* ignoreKerning */);
+            MeasuredText::setWordBreakRecordingEnabled(true);
+            LineBreakResult actual = doLineBreak(textBuf, strategy, HyphenationFrequency::Full,
+                                                 lang, lineWidth, false /* ignoreKerning */);
+            MeasuredText::setWordBreakRecordingEnabled(false);
+            EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+            EXPECT_EQ(expected.widths, actual.widths);
+            EXPECT_EQ(expected.flags, actual.flags);
+        }
+    }
+}
+
+TEST_F(OptimalLineBreakerTest, breakCandidatesCaching) {
+    const std::vector<uint16_t> textBuf = utf8ToUtf16(
+            "This is an example text, see http://example.com/a/b for hyphenation. "
+            "Pneumonoultramicroscopicsilicovolcanoconiosis is a word.");
+    const std::string lang = "en-US";
+    for (bool deferred : {false, true}) {
+        SCOPED_TRACE(deferred);
+        MeasuredText::setDeferredHyphenationEnabled(deferred);
+        MeasuredTextBuilder builder;
+        std::vector<std::shared_ptr<FontFamily>> families = {buildFontFamily("Ascii.ttf"),
+                                                             buildFontFamily("CustomExtent.ttf")};
+        MinikinPaint paint(FontCollection::create(families));
+        paint.size = 10.0f;  // Make 1em=10px
+        paint.localeListId = LocaleListCache::getId(lang);
+        builder.addStyleRun(0, textBuf.size(), std::move(paint), 0, 0, false);
+        MeasuredText::setBreakCandidatesCachingEnabled(true);
+        std::unique_ptr<MeasuredText> cached =
+                builder.build(textBuf, true /* computeHyphenation */, false /* computeLayout */,
+                              false /* ignoreKerning */, nullptr /* no hint */);
+        MeasuredText::setBreakCandidatesCachingEnabled(false);
+
+        // The candidates are kept from the first breaking, which may skip the deferred
+        // hyphenation, and reused at the other widths and options.
+        for (float lineWidth : {2000.0f, 30.0f, 100.0f, 150.0f, 1000.0f}) {
+            for (HyphenationFrequency frequency :
+                 {HyphenationFrequency::Full, HyphenationFrequency::None}) {
+                for (BreakStrategy strategy :
+                     {BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+                    SCOPED_TRACE(lineWidth);
+                    LineBreakResult expected = doLineBreak(textBuf, strategy, frequency, lang,
+                                                           lineWidth, false /* ignoreKerning */);
+                    LineBreakResult actual =
+                            doLineBreak(textBuf, *cached, strategy, frequency, lineWidth);
+                    EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+                    EXPECT_EQ(expected.widths, actual.widths);
+                    EXPECT_EQ(expected.flags, actual.flags);
+                }
+            }
+        }
+        MeasuredText::setDeferredHyphenationEnabled(false);
+    }
+}
+
+TEST_F(OptimalLineBreakerTest, multipleWidths) {
+    const std::vector<uint16_t> textBuf = utf8ToUtf16(
+            "This is an example text, see http://example.com/a/b for hyphenation. "
+            "Pneumonoultramicroscopicsilicovolcanoconiosis is a word.");
+    const std::string lang = "en-US";
+    std::vector<RectangleLineWidth> lineWidths = {2000.0f, 30.0f, 100.0f, 150.0f, 1000.0f};
+    std::vector<const LineWidth*> lineWidthPtrs;
+    for (const RectangleLineWidth& lineWidth : lineWidths) {
+        lineWidthPtrs.push_back(&lineWidth);
+    }
+    for (bool deferred : {false, true}) {
+        SCOPED_TRACE(deferred);
+        MeasuredText::setDeferredHyphenationEnabled(deferred);
+        MeasuredTextBuilder builder;
+        std::vector<std::shared_ptr<FontFamily>> families = {buildFontFamily("Ascii.ttf"),
+                                                             buildFontFamily("CustomExtent.ttf")};
+        MinikinPaint paint(FontCollection::create(families));
+        paint.size = 10.0f;  // Make 1em=10px
+        paint.localeListId = LocaleListCache::getId(lang);
+        builder.addStyleRun(0, textBuf.size(), std::move(paint), 0, 0, false);
+        std::unique_ptr<MeasuredText> measured =
+                builder.build(textBuf, true /* computeHyphenation */, false /* computeLayout */,
+                              false /* ignoreKerning */, nullptr /* no hint */);
+        MeasuredText::setDeferredHyphenationEnabled(false);
+
+        for (BreakStrategy strategy : {BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+            const std::vector<LineBreakResult> results =
+                    breakLineOptimal(textBuf, *measured, lineWidthPtrs, strategy,
+                                     HyphenationFrequency::Full, false /* justified */);
+            const std::vector<uint32_t> counts =
+                    countLinesOptimal(textBuf, *measured, lineWidthPtrs, strategy,
+                                      HyphenationFrequency::Full, false /* justified */);
+            ASSERT_EQ(lineWidths.size(), results.size());
+            ASSERT_EQ(lineWidths.size(), counts.size());
+            for (size_t i = 0; i < lineWidths.size(); ++i) {
+                SCOPED_TRACE(lineWidths[i].getAt(0));
+                LineBreakResult expected = doLineBreak(textBuf, *measured, strategy,
+                                                       HyphenationFrequency::Full,
+                                                       lineWidths[i].getAt(0));
+                EXPECT_EQ(expected.breakPoints, results[i].breakPoints);
+                EXPECT_EQ(expected.widths, results[i].widths);
+                EXPECT_EQ(expected.ascents, results[i].ascents);
+                EXPECT_EQ(expected.descents, results[i].descents);
+                EXPECT_EQ(expected.flags, results[i].flags);
+                EXPECT_EQ(expected.breakPoints.size(), counts[i]);
+            }
+        }
+    }
+
+    const std::vector<uint16_t> emptyText;
+    MeasuredTextBuilder builder;
+    std::unique_ptr<MeasuredText> measured =
+            builder.build(emptyText, false /* computeHyphenation */, false /* computeLayout */,
+                          false /* ignoreKerning */, nullptr /* no hint */);
+    EXPECT_EQ(std::vector<uint32_t>(lineWidths.size(), 0),
+              countLinesOptimal(emptyText, *measured, lineWidthPtrs, BreakStrategy::HighQuality,
+                                HyphenationFrequency::None, false /* justified */));
+}
+
+TEST_F(OptimalLineBreakerTest, maxLines) {
+    const std::vector<uint16_t> textBuf =
+            utf8ToUtf16("This is an example text, see http://example.com/a/b for hyphenation.");
+    MeasuredTextBuilder builder;
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;  // Make 1em=10px
+    paint.localeListId = LocaleListCache::getId("en-US");
+    builder.addStyleRun(0, textBuf.size(), std::move(paint), 0, 0, false);
+    std::unique_ptr<MeasuredText> measured =
+            builder.build(textBuf, true /* computeHyphenation */, false /* computeLayout */,
+                          false /* ignoreKerning */, nullptr /* no hint */);
+    for (BreakStrategy strategy : {BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+        for (float lineWidth : {50.0f, 100.0f, 1000.0f}) {
+            SCOPED_TRACE(lineWidth);
+            RectangleLineWidth rectangleLineWidth(lineWidth);
+            LineBreakResult full =
+                    breakLineOptimal(textBuf, *measured, rectangleLineWidth, strategy,
+                                     HyphenationFrequency::Full, false /* justified */);
+            EXPECT_EQ(full.breakPoints.size(),
+                      countLinesOptimal(textBuf, *measured, rectangleLineWidth, strategy,
+                                        HyphenationFrequency::Full, false /* justified */));
+            for (uint32_t maxLines : {0u, 1u, 2u, 100u}) {
+                SCOPED_TRACE(maxLines);
+                LineBreakResult actual = breakLineOptimal(textBuf, *measured, rectangleLineWidth,
+                                                          strategy, HyphenationFrequency::Full,
+                                                          false /* justified */, maxLines);
+                const size_t lineCount = std::min<size_t>(maxLines, full.breakPoints.size());
+                ASSERT_EQ(lineCount, actual.breakPoints.size());
+                for (size_t i = 0; i < lineCount; ++i) {
+                    EXPECT_EQ(full.breakPoints[i], actual.breakPoints[i]);
+                    EXPECT_EQ(full.widths[i], actual.widths[i]);
+                    EXPECT_EQ(full.ascents[i], actual.ascents[i]);
+                    EXPECT_EQ(full.descents[i], actual.descents[i]);
+                    EXPECT_EQ(full.flags[i], actual.flags[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(OptimalLineBreakerTest, deferredLineExtents) {
+    const std::vector<uint16_t> textBuf =
+            utf8ToUtf16("The \u3042\u3044\u3046 is Japanese. This is an example text.");
+    const std::string lang = "en-US";
+    std::vector<std::shared_ptr<FontFamily>> families = {buildFontFamily("Ascii.ttf"),
+                                                         buildFontFamily("CustomExtent.ttf")};
+    std::shared_ptr<FontCollection> fc = FontCollection::create(families);
+    auto build = [&]() {
+        MeasuredTextBuilder builder;
+        MinikinPaint paint(fc);
+        paint.size = 10.0f;  // Make 1em=10px
+        paint.localeListId = LocaleListCache::getId(lang);
+        builder.addStyleRun(0, textBuf.size(), std::move(paint), 0, 0, false);
+        return builder.build(textBuf, true /* computeHyphenation */, false /* computeLayout */,
+                             false /* ignoreKerning */, nullptr /* no hint */);
+    };
+    std::unique_ptr<MeasuredText> eager = build();
+    MeasuredText::setDeferredLineExtentsEnabled(true);
+    std::unique_ptr<MeasuredText> deferred = build();
+    MeasuredText::setDeferredLineExtentsEnabled(false);
+    EXPECT_FALSE(eager->isLineExtentsDeferred());
+    EXPECT_TRUE(deferred->isLineExtentsDeferred());
+
+    for (float lineWidth : {50.0f, 100.0f, 1000.0f}) {
+        SCOPED_TRACE(lineWidth);
+        LineBreakResult expected = doLineBreak(textBuf, *eager, BreakStrategy::HighQuality,
+                                               HyphenationFrequency::Full, lineWidth);
+        LineBreakResult actual = doLineBreak(textBuf, *deferred, BreakStrategy::HighQuality,
+                                             HyphenationFrequency::Full, lineWidth);
+        EXPECT_FALSE(expected.hasDeferredExtents());
+        EXPECT_TRUE(actual.hasDeferredExtents());
+        EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+        EXPECT_EQ(expected.widths, actual.widths);
+        EXPECT_EQ(expected.flags, actual.flags);
+        EXPECT_TRUE(actual.ascents.empty());
+        EXPECT_TRUE(actual.descents.empty());
+        // The lines are visited backwards, and twice for the kept extents.
+        for (int pass = 0; pass < 2; ++pass) {
+            for (size_t i = actual.breakPoints.size(); i > 0; --i) {
+                EXPECT_EQ(MinikinExtent(expected.ascents[i - 1], expected.descents[i - 1]),
+                          actual.getLineExtent(i - 1, textBuf, *deferred));
+                EXPECT_EQ(MinikinExtent(expected.ascents[i - 1], expected.descents[i - 1]),
+                          expected.getLineExtent(i - 1, textBuf, *eager));
+            }
+        }
+    }
+}
+
+// The same width as RectangleLineWidth until a line number no paragraph reaches, which
+// makes the optimizer visit all the candidates of each line.
+class FarChangingLineWidth : public LineWidth {
+public:
+    FarChangingLineWidth(float width) : mWidth(width) {}
+    virtual ~FarChangingLineWidth() {}
+
+    float getAt(size_t lineNo) const override { return lineNo < 100000 ? mWidth : mWidth + 1; }
+    float getMin() const override { return mWidth; }
+
+private:
+    float mWidth;
+};
+
+TEST_F(OptimalLineBreakerTest, constantWidthLongParagraph) {
+    std::string text;
+    const char* words[] = {"a", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog"};
+    for (int i = 0; i < 200; i++) {
+        text += std::string(words[(i * 7) % 9]) + (i % 13 == 0 ? ", " : " ");
+    }
+    const std::vector<uint16_t> textBuf = utf8ToUtf16(text);
+
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;  // Make 1em=10px
+    paint.localeListId = LocaleListCache::getId("en-US");
+    MeasuredTextBuilder builder;
+    builder.addStyleRun(0, textBuf.size(), std::move(paint), 0, 0, false);
+    std::unique_ptr<MeasuredText> measured =
+            builder.build(textBuf, true /* computeHyphenation */, false /* computeLayout */,
+                          false /* ignoreKernel */, nullptr /* no hint */);
+
+    for (BreakStrategy strategy : {BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+        for (bool justified : {false, true}) {
+            for (float lineWidth : {100.0f, 1000.0f, 3000.0f}) {
+                SCOPED_TRACE(lineWidth);
+                LineBreakResult expected =
+                        breakLineOptimal(textBuf, *measured, FarChangingLineWidth(lineWidth),
+                                         strategy, HyphenationFrequency::Full, justified);
+                LineBreakResult actual =
+                        breakLineOptimal(textBuf, *measured, RectangleLineWidth(lineWidth),
+                                         strategy, HyphenationFrequency::Full, justified);
+                EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+                EXPECT_EQ(expected.widths, actual.widths);
+                EXPECT_EQ(expected.flags, actual.flags);
+            }
+        }
+    }
+}
+
+TEST_F(OptimalLineBreakerTest, parallelParagraphs) {
+    const std::vector<std::vector<uint16_t>> paragraphs = {
+            utf8ToUtf16("This is an example text, see http://example.com/a/b for hyphenation."),
+            utf8ToUtf16("Pneumonoultramicroscopicsilicovolcanoconiosis is a word."),
+            utf8ToUtf16("A\tB C"),
+            utf8ToUtf16(""),
+            utf8ToUtf16("The quick brown fox jumps over the lazy dog. The quick brown fox."),
+    };
+    std::vector<std::unique_ptr<MeasuredText>> measuredTexts;
+    for (const std::vector<uint16_t>& textBuf : paragraphs) {
+        MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+        paint.size = 10.0f;  // Make 1em=10px
+        paint.localeListId = LocaleListCache::getId("en-US");
+        MeasuredTextBuilder builder;
+        if (!textBuf.empty()) {
+            builder.addStyleRun(0, textBuf.size(), std::move(paint), 0, 0, false);
+        }
+        measuredTexts.push_back(builder.build(textBuf, true /* computeHyphenation */,
+                                              false /* computeLayout */,
+                                              false /* ignoreKerning */, nullptr /* no hint */));
+    }
+
+    const RectangleLineWidth narrow(60.0f);
+    const RectangleLineWidth wide(300.0f);
+    const TabStops tabStops(nullptr, 0, 40.0f);
+    std::vector<ParagraphBreakRequest> requests;
+    for (BreakStrategy strategy :
+         {BreakStrategy::Greedy, BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+        for (size_t i = 0; i < paragraphs.size(); ++i) {
+            // The same measured text is broken at several widths at the same time.
+            for (const LineWidth* lineWidth : {&narrow, &wide}) {
+                requests.push_back({paragraphs[i], strategy, HyphenationFrequency::Full,
+                                    false /* justified */, measuredTexts[i].get(), lineWidth,
+                                    &tabStops});
+            }
+        }
+    }
+
+    const std::vector<LineBreakResult> results = breakParagraphsIntoLines(requests);
+    ASSERT_EQ(requests.size(), results.size());
+    for (size_t i = 0; i < requests.size(); ++i) {
+        SCOPED_TRACE(i);
+        const ParagraphBreakRequest& request = requests[i];
+        LineBreakResult expected = breakIntoLines(
+                request.textBuffer, request.strategy, request.frequency, request.justified,
+                *request.measuredText, *request.lineWidth, *request.tabStops);
+        EXPECT_EQ(expected.breakPoints, results[i].breakPoints);
+        EXPECT_EQ(expected.widths, results[i].widths);
+        EXPECT_EQ(expected.ascents, results[i].ascents);
+        EXPECT_EQ(expected.descents, results[i].descents);
+        EXPECT_EQ(expected.flags, results[i].flags);
+    }
+
+    EXPECT_TRUE(breakParagraphsIntoLines(std::vector<ParagraphBreakRequest>()).empty());
+}
+
+TEST_F(OptimalLineBreakerTest, reusedScratchAndResult) {
+    constexpr float CHAR_WIDTH = 10.0;
+    const std::vector<std::vector<uint16_t>> paragraphs = {
+            utf8ToUtf16("This is an example text, see http://example.com/a/b for hyphenation."),
+            utf8ToUtf16("Short."),
+            utf8ToUtf16(""),
+            utf8ToUtf16("Pneumonoultramicroscopicsilicovolcanoconiosis is a word."),
+            utf8ToUtf16("A\tB C"),
+    };
+    std::vector<std::unique_ptr<MeasuredText>> measuredTexts;
+    for (const std::vector<uint16_t>& textBuf : paragraphs) {
+        MeasuredTextBuilder builder;
+        if (!textBuf.empty()) {
+            builder.addCustomRun<ConstantRun>(Range(0, textBuf.size()), "en-US", CHAR_WIDTH,
+                                              ASCENT, DESCENT);
+        }
+        measuredTexts.push_back(builder.build(textBuf, true /* computeHyphenation */,
+                                              false /* computeLayout */,
+                                              false /* ignoreKerning */, nullptr /* no hint */));
+    }
+
+    const RectangleLineWidth lineWidth(100.0f);
+    const TabStops tabStops(nullptr, 0, 40.0f);
+    // A single scratch and result for all the paragraphs, whose lines must not leak into the next.
+    LineBreakScratch scratch;
+    LineBreakResult actual;
+    for (BreakStrategy strategy :
+         {BreakStrategy::Greedy, BreakStrategy::HighQuality, BreakStrategy::Balanced}) {
+        for (uint32_t maxLines : {1u, 2u, std::numeric_limits<uint32_t>::max()}) {
+            for (size_t i = 0; i < paragraphs.size(); ++i) {
+                SCOPED_TRACE(i);
+                LineBreakResult expected =
+                        breakIntoLines(paragraphs[i], strategy, HyphenationFrequency::Normal,
+                                       false /* justified */, *measuredTexts[i], lineWidth,
+                                       tabStops, maxLines);
+                breakIntoLines(paragraphs[i], strategy, HyphenationFrequency::Normal,
+                               false /* justified */, *measuredTexts[i], lineWidth, tabStops,
+                               maxLines, &scratch, &actual);
+                EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+                EXPECT_EQ(expected.widths, actual.widths);
+                EXPECT_EQ(expected.ascents, actual.ascents);
+                EXPECT_EQ(expected.descents, actual.descents);
+                EXPECT_EQ(expected.flags, actual.flags);
+            }
+        }
+    }
+}
+
 }  // namespace
 }  // namespace minikin
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/PersistentLayoutCache.h"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+class TestablePersistentLayoutCache : public PersistentLayoutCache {
+public:
+    TestablePersistentLayoutCache() : PersistentLayoutCache() {}
+};
+
+namespace {
+
+constexpr size_t kMaxFileSize = 1024 * 1024;
+
+std::string getCachePath() {
+    return testing::TempDir() + "minikin_persistent_layout_cache";
+}
+
+std::shared_ptr<const LayoutPiece> getOrCreate(PersistentLayoutCache& cache,
+                                               const std::vector<uint16_t>& text,
+                                               const MinikinPaint& paint,
+                                               bool advancesOnly = false) {
+    return cache.getOrCreate(text, Range(0, text.size()), paint, false /* LTR */,
+                             StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, advancesOnly);
+}
+
+class PersistentLayoutCacheTest : public testing::Test {
+protected:
+    void SetUp() override { unlink(getCachePath().c_str()); }
+    void TearDown() override { unlink(getCachePath().c_str()); }
+};
+
+}  // namespace
+
+TEST_F(PersistentLayoutCacheTest, disabledByDefaultTest) {
+    TestablePersistentLayoutCache cache;
+    EXPECT_FALSE(cache.isEnabled());
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    EXPECT_TRUE(cache.isEnabled());
+    cache.close();
+    EXPECT_FALSE(cache.isEnabled());
+}
+
+TEST_F(PersistentLayoutCacheTest, reopenTest) {
+    auto text = utf8ToUtf16("android");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    std::shared_ptr<const LayoutPiece> expected;
+    {
+        TestablePersistentLayoutCache cache;
+        ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+        expected = getOrCreate(cache, text, paint);
+        EXPECT_EQ(1u, cache.getStats().getMissCount());
+        EXPECT_EQ(1u, cache.size());
+    }
+
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    EXPECT_EQ(1u, cache.size());
+    std::shared_ptr<const LayoutPiece> layout = getOrCreate(cache, text, paint);
+    EXPECT_EQ(1u, cache.getStats().getHitCount());
+    EXPECT_EQ(0u, cache.getStats().getMissCount());
+
+    EXPECT_EQ(expected->advance(), layout->advance());
+    EXPECT_EQ(expected->advances(), layout->advances());
+    EXPECT_EQ(expected->extent(), layout->extent());
+    ASSERT_EQ(expected->glyphCount(), layout->glyphCount());
+    for (uint32_t i = 0; i < expected->glyphCount(); ++i) {
+        EXPECT_EQ(expected->glyphIdAt(i), layout->glyphIdAt(i));
+        EXPECT_EQ(expected->pointAt(i), layout->pointAt(i));
+        EXPECT_EQ(expected->fontAt(i).font, layout->fontAt(i).font);
+    }
+}
+
+TEST_F(PersistentLayoutCacheTest, cacheMissTest) {
+    auto text = utf8ToUtf16("android");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    {
+        TestablePersistentLayoutCache cache;
+        ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+        getOrCreate(cache, text, paint);
+    }
+
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    {
+        SCOPED_TRACE("Different text");
+        getOrCreate(cache, utf8ToUtf16("androic"), paint);
+        EXPECT_EQ(1u, cache.getStats().getMissCount());
+    }
+    {
+        SCOPED_TRACE("Different paint");
+        MinikinPaint paint2(paint);
+        paint2.size = 20.0f;
+        getOrCreate(cache, text, paint2);
+        EXPECT_EQ(2u, cache.getStats().getMissCount());
+    }
+    {
+        SCOPED_TRACE("Different collection");
+        MinikinPaint paint2(paint);
+        paint2.font = buildFontCollection("Emoji.ttf");
+        getOrCreate(cache, text, paint2);
+        EXPECT_EQ(3u, cache.getStats().getMissCount());
+    }
+    EXPECT_EQ(0u, cache.getStats().getHitCount());
+}
+
+TEST_F(PersistentLayoutCacheTest, advancesOnlyTest) {
+    auto text = utf8ToUtf16("android");
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    EXPECT_TRUE(getOrCreate(cache, text, paint, true /* advances only */)->isAdvancesOnly());
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(PersistentLayoutCacheTest, maxFileSizeTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), 0));
+    getOrCreate(cache, utf8ToUtf16("android"), paint);
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(PersistentLayoutCacheTest, truncatedFileTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    {
+        TestablePersistentLayoutCache cache;
+        ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+        getOrCreate(cache, utf8ToUtf16("android"), paint);
+        getOrCreate(cache, utf8ToUtf16("minikin"), paint);
+    }
+    // Cut the last record as if the process crashed while appending it.
+    FILE* file = fopen(getCachePath().c_str(), "r+");
+    ASSERT_NE(nullptr, file);
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    ASSERT_EQ(0, ftruncate(fileno(file), size - 4));
+    fclose(file);
+
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST_F(PersistentLayoutCacheTest, corruptedFileTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    {
+        TestablePersistentLayoutCache cache;
+        ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+        getOrCreate(cache, utf8ToUtf16("android"), paint);
+        getOrCreate(cache, utf8ToUtf16("minikin"), paint);
+    }
+    // Flip a byte of the key of the first record, right after the file header and the record
+    // header.
+    FILE* file = fopen(getCachePath().c_str(), "r+");
+    ASSERT_NE(nullptr, file);
+    fseek(file, 24, SEEK_SET);
+    const int c = fgetc(file);
+    fseek(file, 24, SEEK_SET);
+    fputc(c ^ 0xFF, file);
+    fclose(file);
+
+    // The corrupted record ends the valid part of the file.
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(PersistentLayoutCacheTest, invalidHeaderTest) {
+    FILE* file = fopen(getCachePath().c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    fputs("not a layout cache file", file);
+    fclose(file);
+
+    TestablePersistentLayoutCache cache;
+    ASSERT_TRUE(cache.open(getCachePath(), kMaxFileSize));
+    EXPECT_EQ(0u, cache.size());
+}
+
+}  // namespace minikin
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Locale.h"
+#include "PhraseBreakCache.h"
+#include "UnicodeUtils.h"
+#include "WordBreaker.h"
+
+namespace minikin {
+
+class TestablePhraseBreakCache : public PhraseBreakCache {
+public:
+    TestablePhraseBreakCache(uint32_t maxEntries) : PhraseBreakCache(maxEntries) {}
+};
+
+static void expectSameRecord(const WordBreakRecord& expected, const WordBreakRecord& actual) {
+    ASSERT_EQ(expected.segments.size(), actual.segments.size());
+    for (size_t i = 0; i < expected.segments.size(); ++i) {
+        const WordBreakRecord::Segment& e = expected.segments[i];
+        const WordBreakRecord::Segment& a = actual.segments[i];
+        EXPECT_EQ(e.start, a.start);
+        EXPECT_EQ(e.localeId, a.localeId);
+        EXPECT_EQ(e.lbStyle, a.lbStyle);
+        EXPECT_EQ(e.lbWordStyle, a.lbWordStyle);
+        EXPECT_EQ(e.boundaryStart, a.boundaryStart);
+        EXPECT_EQ(e.boundaryEnd, a.boundaryEnd);
+        EXPECT_EQ(e.reachesEnd, a.reachesEnd);
+    }
+    EXPECT_EQ(expected.boundaries, actual.boundaries);
+}
+
+TEST(PhraseBreakCacheTest, cacheHitTest) {
+    const std::vector<uint16_t> text = utf8ToUtf16("本日は晴天なり。明日は雨でしょう。");
+    const Locale locale("ja-JP");
+    const Range range(0, text.size());
+
+    WordBreakRecord expected;
+    WordBreaker::record(text, locale, LineBreakStyle::None, LineBreakWordStyle::Phrase, range,
+                        &expected);
+    ASSERT_FALSE(expected.boundaries.empty());
+
+    TestablePhraseBreakCache cache(10);
+    WordBreakRecord first;
+    cache.record(text, locale, LineBreakStyle::None, range, &first);
+    WordBreakRecord second;
+    cache.record(text, locale, LineBreakStyle::None, range, &second);
+
+    expectSameRecord(expected, first);
+    expectSameRecord(expected, second);
+    EXPECT_EQ(1u, cache.getStats().getMissCount());
+    EXPECT_EQ(1u, cache.getStats().getHitCount());
+    EXPECT_NE(0u, cache.getMemoryUsage());
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.getMemoryUsage());
+}
+
+TEST(PhraseBreakCacheTest, appendTest) {
+    const std::vector<uint16_t> text = utf8ToUtf16("本日は晴天なり。明日は雨でしょう。");
+    const Locale locale("ja-JP");
+
+    // The cached boundaries are appended after the segments already in the record.
+    WordBreakRecord expected;
+    WordBreaker::record(text, locale, LineBreakStyle::None, LineBreakWordStyle::None, Range(0, 8),
+                        &expected);
+    WordBreaker::record(text, locale, LineBreakStyle::None, LineBreakWordStyle::Phrase,
+                        Range(8, text.size()), &expected);
+
+    TestablePhraseBreakCache cache(10);
+    for (int i = 0; i < 2; ++i) {
+        WordBreakRecord record;
+        WordBreaker::record(text, locale, LineBreakStyle::None, LineBreakWordStyle::None,
+                            Range(0, 8), &record);
+        cache.record(text, locale, LineBreakStyle::None, Range(8, text.size()), &record);
+        expectSameRecord(expected, record);
+    }
+    EXPECT_EQ(1u, cache.getStats().getHitCount());
+}
+
+TEST(PhraseBreakCacheTest, cacheMissTest) {
+    const std::vector<uint16_t> text1 = utf8ToUtf16("本日は晴天なり。");
+    const std::vector<uint16_t> text2 = utf8ToUtf16("明日は雨でしょう。");
+    const Locale locale("ja-JP");
+
+    TestablePhraseBreakCache cache(10);
+    WordBreakRecord record;
+    cache.record(text1, locale, LineBreakStyle::None, Range(0, text1.size()), &record);
+    cache.record(text2, locale, LineBreakStyle::None, Range(0, text2.size()), &record);
+    cache.record(text1, locale, LineBreakStyle::Strict, Range(0, text1.size()), &record);
+    cache.record(text1, locale, LineBreakStyle::None, Range(3, text1.size()), &record);
+    cache.record(text1, Locale("ko-KR"), LineBreakStyle::None, Range(0, text1.size()), &record);
+    EXPECT_EQ(5u, cache.getStats().getMissCount());
+    EXPECT_EQ(0u, cache.getStats().getHitCount());
+}
+
+TEST(PhraseBreakCacheTest, evictionTest) {
+    const std::vector<uint16_t> text1 = utf8ToUtf16("本日は晴天なり。");
+    const std::vector<uint16_t> text2 = utf8ToUtf16("明日は雨でしょう。");
+    const Locale locale("ja-JP");
+
+    TestablePhraseBreakCache cache(1);
+    WordBreakRecord record;
+    cache.record(text1, locale, LineBreakStyle::None, Range(0, text1.size()), &record);
+    cache.record(text2, locale, LineBreakStyle::None, Range(0, text2.size()), &record);
+    cache.record(text1, locale, LineBreakStyle::None, Range(0, text1.size()), &record);
+    EXPECT_EQ(3u, cache.getStats().getMissCount());
+    EXPECT_EQ(2u, cache.getStats().getEvictionCount());
+}
+
+}  // namespace minikin
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/ReadAhead.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/Font.h"
+
+#include "FreeTypeMinikinFontForTest.h"
+#include "PathUtils.h"
+
+namespace minikin {
+
+TEST(ReadAheadTest, adviseTest) {
+    auto typeface = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    const ReadAhead::Stats before = ReadAhead::getStats();
+    const size_t advised = ReadAhead::advise(typeface->GetFontData(), typeface->GetFontSize());
+    // Rounded to whole pages.
+    EXPECT_GE(advised, typeface->GetFontSize());
+    EXPECT_EQ(before.adviceCount + 1, ReadAhead::getStats().adviceCount);
+    EXPECT_EQ(before.advisedBytes + advised, ReadAhead::getStats().advisedBytes);
+
+    EXPECT_EQ(0u, ReadAhead::advise(nullptr, 100));
+    EXPECT_EQ(0u, ReadAhead::advise(typeface->GetFontData(), 0));
+
+    // The test font is smaller than a page, so the hot tables are advised at once.
+    const ReadAhead::Stats beforeFont = ReadAhead::getStats();
+    EXPECT_NE(0u, ReadAhead::adviseFont(typeface->GetFontData(), typeface->GetFontSize(),
+                                        typeface->GetFontIndex()));
+    EXPECT_EQ(beforeFont.adviceCount + 1, ReadAhead::getStats().adviceCount);
+}
+
+TEST(ReadAheadTest, fontTest) {
+    auto typeface = std::make_shared<FreeTypeMinikinFontForTest>(getTestFontPath("Ascii.ttf"));
+    const uint64_t adviceCount = ReadAhead::getStats().adviceCount;
+    Font::Builder(typeface).build();
+    // Disabled by default.
+    EXPECT_EQ(adviceCount, ReadAhead::getStats().adviceCount);
+
+    ReadAhead::setEnabled(true);
+    Font::Builder(typeface).build();
+    ReadAhead::setEnabled(false);
+    EXPECT_LT(adviceCount, ReadAhead::getStats().adviceCount);
+}
+
+}  // namespace minikin
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/ShapingStats.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/Layout.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+void layoutWord(const std::string& word, const std::string& fontFeatureSettings) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    // Letter spacing keeps the word off the simple ASCII path, which doesn't call HarfBuzz.
+    paint.letterSpacing = 0.1f;
+    paint.fontFeatureSettings = fontFeatureSettings;
+    const std::vector<uint16_t> text = utf8ToUtf16(word);
+    Layout(text, Range(0, text.size()), Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+           EndHyphenEdit::NO_EDIT);
+}
+
+}  // namespace
+
+TEST(ShapingStatsTest, disabledByDefaultTest) {
+    ShapingStats& stats = ShapingStats::getInstance();
+    EXPECT_EQ(0u, stats.getSamplingInterval());
+    Layout::purgeCaches();
+    layoutWord("disabled", "");
+    EXPECT_TRUE(stats.getEntries().empty());
+}
+
+TEST(ShapingStatsTest, recordTest) {
+    ShapingStats& stats = ShapingStats::getInstance();
+    stats.clear();
+    stats.setSamplingInterval(1);
+    Layout::purgeCaches();
+    layoutWord("abc", "");
+    layoutWord("def", "");
+    layoutWord("abc", "\"liga\" off");
+    stats.setSamplingInterval(0);
+
+    const std::vector<ShapingStats::Entry> entries = stats.getEntries();
+    ASSERT_EQ(2u, entries.size());
+    uint64_t calls = 0;
+    for (const ShapingStats::Entry& entry : entries) {
+        EXPECT_EQ(HB_TAG('L', 'a', 't', 'n'), entry.script);
+        EXPECT_NE(std::string::npos, entry.fontPath.find("Ascii.ttf"));
+        calls += entry.calls;
+    }
+    EXPECT_EQ(3u, calls);
+    stats.clear();
+    EXPECT_TRUE(stats.getEntries().empty());
+}
+
+TEST(ShapingStatsTest, samplingTest) {
+    ShapingStats& stats = ShapingStats::getInstance();
+    stats.clear();
+    stats.setSamplingInterval(4);
+    Layout::purgeCaches();
+    for (int i = 0; i < 8; ++i) {
+        layoutWord("word" + std::to_string(i), "");
+    }
+    stats.setSamplingInterval(0);
+
+    // Two of the eight runs are timed, each counted as four runs.
+    const std::vector<ShapingStats::Entry> entries = stats.getEntries();
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ(8u, entries[0].calls);
+    stats.clear();
+}
+
+}  // namespace minikin
@@ -83,4 +83,60 @@ TEST(SparseBitSetTest, sizeTest) {
     ASSERT_EQ(sizeof(void*), sizeof(SparseBitSet));
 }
 
+TEST(SparseBitSetTest, findFirstUnsetTest) {
+    // [0x20, 0x7F), [0x3040, 0x3100) and [0x1F600, 0x1F650).
+    const uint32_t range[] = {0x20, 0x7F, 0x3040, 0x3100, 0x1F600, 0x1F650};
+    SparseBitSet bitset(range, 3);
+
+    const uint16_t covered[] = {'a', ' ', 0x3042, 0xD83D, 0xDE00, '~'};
+    EXPECT_EQ(6u, bitset.findFirstUnset(covered, 6));
+    EXPECT_EQ(0u, bitset.findFirstUnset(covered, 0));
+
+    const uint16_t uncoveredBmp[] = {'a', 'b', 0x00E9, 'c'};
+    EXPECT_EQ(2u, bitset.findFirstUnset(uncoveredBmp, 4));
+
+    // The offset of a supplementary character is the one of its lead surrogate.
+    const uint16_t uncoveredSupplementary[] = {'a', 0xD83D, 0xDE80, 'b'};
+    EXPECT_EQ(1u, bitset.findFirstUnset(uncoveredSupplementary, 4));
+
+    // An unpaired surrogate is looked up as is.
+    const uint16_t unpaired[] = {'a', 0xD83D, 'b'};
+    EXPECT_EQ(1u, bitset.findFirstUnset(unpaired, 3));
+
+    // Beyond the maximum value.
+    const uint16_t beyond[] = {'a', 0xD83E, 0xDD00};
+    EXPECT_EQ(1u, bitset.findFirstUnset(beyond, 3));
+
+    EXPECT_EQ(0u, SparseBitSet().findFirstUnset(covered, 6));
+}
+
+TEST(SparseBitSetTest, identicalPagesTest) {
+    // 64 full pages, a partial page, a gap of zero pages and the same partial page again.
+    const uint32_t range[] = {0x4E00, 0x8E00, 0x8E10, 0x8E20, 0x9F10, 0x9F20};
+    SparseBitSet bitset(range, 3);
+    const uint32_t smallRange[] = {0x4E00, 0x4F00, 0x8E10, 0x8E20};
+    SparseBitSet smallBitset(smallRange, 2);
+
+    // The full pages are stored once, so the size is about the same as the one with a full page.
+    EXPECT_EQ(writeToBuffer(smallBitset).size() + sizeof(uint16_t) * 16,
+              writeToBuffer(bitset).size());
+
+    for (uint32_t ch = 0x4D00; ch < 0xA000; ++ch) {
+        const bool expected = (0x4E00 <= ch && ch < 0x8E00) || (0x8E10 <= ch && ch < 0x8E20) ||
+                              (0x9F10 <= ch && ch < 0x9F20);
+        ASSERT_EQ(expected, bitset.get(ch)) << std::hex << ch;
+    }
+    EXPECT_EQ(0x4E00u, bitset.nextSetBit(0));
+    EXPECT_EQ(0x8E10u, bitset.nextSetBit(0x8E00));
+    EXPECT_EQ(0x9F10u, bitset.nextSetBit(0x8E20));
+    EXPECT_EQ(SparseBitSet::kNotFound, bitset.nextSetBit(0x9F20));
+
+    // The merged pages are kept through the buffer.
+    std::vector<uint8_t> buffer = writeToBuffer(bitset);
+    BufferReader reader(buffer.data());
+    SparseBitSet copied(&reader);
+    EXPECT_EQ(0x9F10u, copied.nextSetBit(0x8E20));
+    EXPECT_EQ(buffer, writeToBuffer(copied));
+}
+
 }  // namespace minikin
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/StreamingMeasuredText.h"
+
+#include <limits>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "LineBreakerTestHelper.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+using namespace line_breaker_test_helper;
+
+namespace {
+
+constexpr float CHAR_WIDTH = 10.0;
+
+StreamingMeasuredText::RunProvider constantRuns() {
+    return [](const Range& chunk, MeasuredTextBuilder* builder) {
+        builder->addCustomRun<ConstantRun>(Range(0, chunk.getLength()), "en-US", CHAR_WIDTH,
+                                           10.0f /* ascent */, 2.0f /* descent */);
+    };
+}
+
+}  // namespace
+
+TEST(StreamingMeasuredTextTest, chunks) {
+    std::string str = "First paragraph.\nSecond one.\n";
+    for (uint32_t i = 0; i < StreamingMeasuredText::kMaxChunkLength / 4; ++i) {
+        str += "abc ";
+    }
+    str += "end";
+    const std::vector<uint16_t> text = utf8ToUtf16(str);
+    StreamingMeasuredText streaming(text, constantRuns(), false /* hyphenation */,
+                                    false /* full layout */, false /* ignore kerning */,
+                                    std::numeric_limits<uint32_t>::max());
+
+    ASSERT_EQ(4u, streaming.getChunkCount());
+    EXPECT_EQ(Range(0, 17), streaming.getChunkRange(0));
+    EXPECT_EQ(Range(17, 29), streaming.getChunkRange(1));
+    // The long paragraph is split after a word.
+    EXPECT_EQ(29u, streaming.getChunkRange(2).getStart());
+    EXPECT_GE(29 + StreamingMeasuredText::kMaxChunkLength, streaming.getChunkRange(2).getEnd());
+    EXPECT_EQ(' ', text[streaming.getChunkRange(2).getEnd() - 1]);
+    EXPECT_EQ(text.size(), streaming.getChunkRange(3).getEnd());
+
+    EXPECT_EQ(0u, streaming.findChunk(0));
+    EXPECT_EQ(0u, streaming.findChunk(16));
+    EXPECT_EQ(1u, streaming.findChunk(17));
+    EXPECT_EQ(3u, streaming.findChunk(text.size()));
+
+    EXPECT_FALSE(streaming.isResident(1));
+    std::shared_ptr<const MeasuredText> measured = streaming.getChunk(1);
+    EXPECT_TRUE(streaming.isResident(1));
+    EXPECT_EQ(std::vector<float>(12, CHAR_WIDTH), measured->widths);
+    EXPECT_EQ(measured->getMemoryUsage(), streaming.getMemoryUsage());
+}
+
+TEST(StreamingMeasuredTextTest, eviction) {
+    const std::vector<uint16_t> text = utf8ToUtf16("aaaa\nbbbb\ncccc\ndddd\n");
+    // Room for two chunks of five widths.
+    StreamingMeasuredText streaming(text, constantRuns(), false /* hyphenation */,
+                                    false /* full layout */, false /* ignore kerning */,
+                                    2 * 5 * sizeof(float));
+    ASSERT_EQ(4u, streaming.getChunkCount());
+
+    std::shared_ptr<const MeasuredText> first = streaming.getChunk(0);
+    streaming.getChunk(1);
+    streaming.getChunk(0);
+    streaming.getChunk(2);
+    // The least recently used one is evicted.
+    EXPECT_TRUE(streaming.isResident(0));
+    EXPECT_FALSE(streaming.isResident(1));
+    EXPECT_TRUE(streaming.isResident(2));
+    // The evicted texts stay valid for their holders.
+    EXPECT_EQ(5u, first->widths.size());
+
+    streaming.evictOutside(2, 3);
+    EXPECT_FALSE(streaming.isResident(0));
+    EXPECT_TRUE(streaming.isResident(2));
+    EXPECT_EQ(5 * sizeof(float), streaming.getMemoryUsage());
+}
+
+TEST(StreamingMeasuredTextTest, breakChunkIntoLines) {
+    const std::vector<uint16_t> text =
+            utf8ToUtf16("This is an example text.\nAnd the second paragraph of it.");
+    StreamingMeasuredText streaming(text, constantRuns(), true /* hyphenation */,
+                                    false /* full layout */, false /* ignore kerning */,
+                                    std::numeric_limits<uint32_t>::max());
+    ASSERT_EQ(2u, streaming.getChunkCount());
+    const RectangleLineWidth lineWidth(100);
+    const TabStops tabStops(nullptr, 0, 0);
+
+    for (size_t chunk = 0; chunk < streaming.getChunkCount(); ++chunk) {
+        const Range range = streaming.getChunkRange(chunk);
+        const U16StringPiece chunkText = U16StringPiece(text).substr(range);
+        MeasuredTextBuilder builder;
+        builder.addCustomRun<ConstantRun>(Range(0, range.getLength()), "en-US", CHAR_WIDTH,
+                                          10.0f /* ascent */, 2.0f /* descent */);
+        auto measured = builder.build(chunkText, true /* hyphenation */, false /* full layout */,
+                                      false /* ignore kerning */, nullptr /* no hint */);
+        const LineBreakResult expected =
+                breakIntoLines(chunkText, BreakStrategy::HighQuality, HyphenationFrequency::Normal,
+                               false /* justified */, *measured, lineWidth, tabStops);
+        const LineBreakResult actual = streaming.breakChunkIntoLines(
+                chunk, BreakStrategy::HighQuality, HyphenationFrequency::Normal,
+                false /* justified */, lineWidth, tabStops);
+        EXPECT_EQ(expected.breakPoints, actual.breakPoints);
+        EXPECT_EQ(expected.widths, actual.widths);
+    }
+}
+
+TEST(StreamingMeasuredTextTest, streamLines) {
+    const std::vector<uint16_t> text = utf8ToUtf16(
+            "This is an example text.\nAnd the second paragraph of it.\nThe third one.\nEnd.");
+    StreamingMeasuredText streaming(text, constantRuns(), true /* hyphenation */,
+                                    false /* full layout */, false /* ignore kerning */,
+                                    std::numeric_limits<uint32_t>::max());
+    ASSERT_EQ(4u, streaming.getChunkCount());
+    const RectangleLineWidth lineWidth(100);
+    const TabStops tabStops(nullptr, 0, 0);
+
+    std::vector<size_t> chunks;
+    streaming.streamLines(1, BreakStrategy::HighQuality, HyphenationFrequency::Normal,
+                          false /* justified */, lineWidth, tabStops,
+                          [&](size_t chunk, LineBreakResult&& lines) {
+                              chunks.push_back(chunk);
+                              const LineBreakResult expected = streaming.breakChunkIntoLines(
+                                      chunk, BreakStrategy::HighQuality,
+                                      HyphenationFrequency::Normal, false /* justified */,
+                                      lineWidth, tabStops);
+                              EXPECT_EQ(expected.breakPoints, lines.breakPoints);
+                              EXPECT_EQ(expected.widths, lines.widths);
+                              return true;
+                          });
+    EXPECT_EQ(std::vector<size_t>({1, 2, 3}), chunks);
+    EXPECT_FALSE(streaming.isResident(0));
+    EXPECT_TRUE(streaming.isResident(3));
+}
+
+TEST(StreamingMeasuredTextTest, streamLinesStop) {
+    const std::vector<uint16_t> text = utf8ToUtf16("aaaa\nbbbb\ncccc\ndddd\n");
+    StreamingMeasuredText streaming(text, constantRuns(), false /* hyphenation */,
+                                    false /* full layout */, false /* ignore kerning */,
+                                    std::numeric_limits<uint32_t>::max());
+    const RectangleLineWidth lineWidth(100);
+    const TabStops tabStops(nullptr, 0, 0);
+
+    size_t count = 0;
+    streaming.streamLines(0, BreakStrategy::Greedy, HyphenationFrequency::None,
+                          false /* justified */, lineWidth, tabStops,
+                          [&count](size_t, LineBreakResult&& lines) {
+                              EXPECT_EQ(1u, lines.breakPoints.size());
+                              return ++count < 2;
+                          });
+    EXPECT_EQ(2u, count);
+    // The chunks after the stop are not kept, even if they were being measured.
+    EXPECT_TRUE(streaming.isResident(1));
+    EXPECT_FALSE(streaming.isResident(3));
+}
+
+}  // namespace minikin
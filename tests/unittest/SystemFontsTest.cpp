@@ -21,6 +21,7 @@
 #include "minikin/FontCollection.h"
 
 #include "FontTestUtils.h"
+#include "FreeTypeMinikinFontForTest.h"
 #include "PathUtils.h"
 
 namespace minikin {
@@ -49,6 +50,15 @@ public:
     }
 
     void registerDefault(const std::shared_ptr<FontCollection>& fc) { registerDefaultInternal(fc); }
+
+    std::vector<uint8_t> writeSnapshot() {
+        return BufferWriter::writeToVector(
+                [this](BufferWriter* writer) { writeSnapshotInternal(writer); });
+    }
+
+    bool adoptSnapshot(const std::vector<uint8_t>& buffer) {
+        return adoptSnapshotInternal(buffer.data(), buffer.size());
+    }
 };
 
 TEST(SystemFontsTest, registerAndLookup) {
@@ -114,5 +124,83 @@ TEST(SystemFontTest, getAvailableFont_dedupFonts) {
     });
 }
 
+TEST(SystemFontsTest, updateInsideGetFontSet) {
+    TestableSystemFonts systemFonts;
+    systemFonts.addFontMap(buildFontCollection("Ascii.ttf"));
+    auto boldFc = buildFontCollection("Bold.ttf");
+
+    // The callback doesn't block the updates, and keeps the fonts registered at the call.
+    systemFonts.getFontSet([&](const std::vector<std::shared_ptr<Font>>& fonts) {
+        systemFonts.registerFallback("sans", boldFc);
+        systemFonts.addFontMap(std::shared_ptr<FontCollection>(boldFc));
+        EXPECT_EQ(1u, fonts.size());
+        EXPECT_EQ(boldFc, systemFonts.findFontCollection("sans"));
+    });
+    systemFonts.getFontSet([](const std::vector<std::shared_ptr<Font>>& fonts) {
+        EXPECT_EQ(2u, fonts.size());  // Ascii and Bold
+    });
+}
+
+TEST(SystemFontsTest, snapshot) {
+    FreeTypeMinikinFontForTestFactory::init();
+    TestableSystemFonts systemFonts;
+    auto asciiFamily = buildFontFamily("Ascii.ttf", "en-US");
+    auto boldFamily = buildFontFamily("Bold.ttf", "ja-JP");
+    auto fc1 = FontCollection::create(std::vector<std::shared_ptr<FontFamily>>{asciiFamily});
+    auto fc2 = FontCollection::create(
+            std::vector<std::shared_ptr<FontFamily>>{boldFamily, asciiFamily});
+    systemFonts.registerDefault(fc1);
+    systemFonts.registerFallback("sans", fc2);
+    systemFonts.registerFallback("serif", fc1);
+    systemFonts.addFontMap(std::shared_ptr<FontCollection>(fc2));
+    std::vector<uint8_t> buffer = systemFonts.writeSnapshot();
+    ASSERT_LT(TestableSystemFonts::kSnapshotHeaderSize, buffer.size());
+
+    TestableSystemFonts restored;
+    ASSERT_TRUE(restored.adoptSnapshot(buffer));
+    auto defaultFc = restored.findFontCollection("unknown-name");
+    auto sansFc = restored.findFontCollection("sans");
+    ASSERT_NE(nullptr, defaultFc);
+    ASSERT_NE(nullptr, sansFc);
+    // The collections shared in the original are shared in the snapshot.
+    EXPECT_EQ(defaultFc, restored.findFontCollection("serif"));
+    ASSERT_EQ(2u, sansFc->getFamilyCount());
+    EXPECT_EQ(defaultFc->getFamilyAt(0), sansFc->getFamilyAt(1));
+    EXPECT_EQ(boldFamily->localeListId(), sansFc->getFamilyAt(0)->localeListId());
+    EXPECT_EQ(asciiFamily->localeListId(), defaultFc->getFamilyAt(0)->localeListId());
+    restored.getFontSet([](const std::vector<std::shared_ptr<Font>>& fonts) {
+        EXPECT_EQ(2u, fonts.size());  // Ascii and Bold of the font map.
+    });
+    // The snapshot of the restored fonts is the same.
+    EXPECT_EQ(buffer, restored.writeSnapshot());
+}
+
+TEST(SystemFontsTest, snapshot_invalid) {
+    FreeTypeMinikinFontForTestFactory::init();
+    TestableSystemFonts systemFonts;
+    auto fc = buildFontCollection("Ascii.ttf");
+    systemFonts.registerDefault(fc);
+    std::vector<uint8_t> buffer = systemFonts.writeSnapshot();
+
+    TestableSystemFonts restored;
+    auto otherFc = buildFontCollection("Bold.ttf");
+    restored.registerDefault(otherFc);
+
+    // The truncated and the corrupted snapshots are rejected, keeping the fonts.
+    std::vector<uint8_t> truncated(buffer.begin(), buffer.end() - 1);
+    EXPECT_FALSE(restored.adoptSnapshot(truncated));
+    std::vector<uint8_t> corrupted = buffer;
+    corrupted.back() ^= 0xFF;
+    EXPECT_FALSE(restored.adoptSnapshot(corrupted));
+    std::vector<uint8_t> otherVersion = buffer;
+    otherVersion[4] ^= 0xFF;
+    EXPECT_FALSE(restored.adoptSnapshot(otherVersion));
+    EXPECT_FALSE(restored.adoptSnapshot(std::vector<uint8_t>(16)));
+    EXPECT_EQ(otherFc, restored.findFontCollection("unknown-name"));
+
+    EXPECT_TRUE(restored.adoptSnapshot(buffer));
+    EXPECT_NE(otherFc, restored.findFontCollection("unknown-name"));
+}
+
 }  // namespace
 }  // namespace minikin
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/TextScan.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "minikin/MeasuredText.h"
+
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+TEST(TextScanTest, scanAllTest) {
+    std::vector<uint16_t> text(3 * kScanBlockSize + 5, 'a');
+    const auto isA = [&text](size_t i) { return text[i] == 'a'; };
+    EXPECT_TRUE(scanAll(0, text.size(), isA));
+    EXPECT_TRUE(scanAll(0, 0, isA));
+
+    // In the last partial block.
+    text.back() = 'b';
+    EXPECT_FALSE(scanAll(0, text.size(), isA));
+    EXPECT_TRUE(scanAll(0, text.size() - 1, isA));
+    // In the middle of a block.
+    text.back() = 'a';
+    text[kScanBlockSize + 3] = 'b';
+    EXPECT_FALSE(scanAll(0, text.size(), isA));
+    EXPECT_TRUE(scanAll(kScanBlockSize + 4, text.size(), isA));
+}
+
+TEST(TextScanTest, scanCandidateBlocksTest) {
+    std::vector<uint16_t> text(4 * kScanBlockSize, 'a');
+    text[kScanBlockSize + 1] = ' ';
+    text[3 * kScanBlockSize] = ' ';
+    const auto isSpace = [&text](size_t i) { return text[i] == ' '; };
+
+    std::vector<size_t> blockStarts;
+    EXPECT_TRUE(scanCandidateBlocks(0, text.size(), isSpace,
+                                    [&blockStarts](size_t blockStart, size_t blockEnd) {
+                                        EXPECT_EQ(blockStart + kScanBlockSize, blockEnd);
+                                        blockStarts.push_back(blockStart);
+                                        return true;
+                                    }));
+    EXPECT_EQ((std::vector<size_t>{kScanBlockSize, 3 * kScanBlockSize}), blockStarts);
+
+    // Stopped at the first block.
+    blockStarts.clear();
+    EXPECT_FALSE(scanCandidateBlocks(0, text.size(), isSpace,
+                                     [&blockStarts](size_t blockStart, size_t) {
+                                         blockStarts.push_back(blockStart);
+                                         return false;
+                                     }));
+    EXPECT_EQ((std::vector<size_t>{kScanBlockSize}), blockStarts);
+}
+
+TEST(TextScanTest, maxCodeUnitTest) {
+    EXPECT_EQ(0, maxCodeUnit(nullptr, 0));
+    const std::vector<uint16_t> text = utf8ToUtf16("abcéd");
+    EXPECT_EQ(0x00E9, maxCodeUnit(text.data(), text.size()));
+}
+
+TEST(TextScanTest, textClassTest) {
+    EXPECT_FALSE(TextClass::of(U16StringPiece()).hasTab);
+    EXPECT_TRUE(TextClass::of(utf8ToUtf16("Hello\tWorld")).hasTab);
+    EXPECT_FALSE(TextClass::of(utf8ToUtf16("\U0001F600\n")).hasTab);
+}
+
+TEST(TextScanTest, measuredTextTest) {
+    const std::vector<uint16_t> text = utf8ToUtf16("a\tb");
+    MeasuredTextBuilder builder;
+    builder.addReplacementRun(0, text.size(), 10.0f, 0 /* locale list id */);
+    auto mt = builder.build(text, false /* hyphenation */, false /* full layout */,
+                            false /* ignore kerning */, nullptr /* no hint */);
+    EXPECT_EQ(TextClass::of(text), mt->getTextClass());
+    EXPECT_TRUE(mt->getTextClass().hasTab);
+}
+
+}  // namespace minikin
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/Utf8Text.h"
+
+#include <gtest/gtest.h>
+
+#include "minikin/Layout.h"
+
+#include "FontTestUtils.h"
+#include "UnicodeUtils.h"
+
+namespace minikin {
+
+namespace {
+
+std::vector<uint16_t> toVector(const U16StringPiece& text) {
+    return std::vector<uint16_t>(text.data(), text.data() + text.size());
+}
+
+}  // namespace
+
+TEST(Utf8TextTest, transcodeTest) {
+    // "a", U+00E9, U+3042 and U+1F600.
+    const Utf8Text text("a\xC3\xA9\xE3\x81\x82\xF0\x9F\x98\x80");
+    EXPECT_EQ(std::vector<uint16_t>({0x0061, 0x00E9, 0x3042, 0xD83D, 0xDE00}),
+              toVector(text.utf16()));
+    EXPECT_EQ(10u, text.utf8Size());
+}
+
+TEST(Utf8TextTest, illFormedTest) {
+    // A lone continuation byte and a truncated sequence.
+    const Utf8Text text("a\x80" "b\xE3\x81");
+    EXPECT_EQ(std::vector<uint16_t>({0x0061, 0xFFFD, 0x0062, 0xFFFD}), toVector(text.utf16()));
+    EXPECT_EQ(3u, text.toUtf8Offset(3));
+    EXPECT_EQ(4u, text.toUtf16Offset(5));
+}
+
+TEST(Utf8TextTest, offsetTest) {
+    const Utf8Text text("a\xC3\xA9\xE3\x81\x82\xF0\x9F\x98\x80");
+    EXPECT_EQ(0u, text.toUtf8Offset(0));
+    EXPECT_EQ(1u, text.toUtf8Offset(1));
+    EXPECT_EQ(3u, text.toUtf8Offset(2));
+    EXPECT_EQ(6u, text.toUtf8Offset(3));
+    // The trailing surrogate maps to its character.
+    EXPECT_EQ(6u, text.toUtf8Offset(4));
+    EXPECT_EQ(10u, text.toUtf8Offset(5));
+
+    EXPECT_EQ(0u, text.toUtf16Offset(0));
+    EXPECT_EQ(1u, text.toUtf16Offset(1));
+    // In the middle of U+00E9.
+    EXPECT_EQ(2u, text.toUtf16Offset(2));
+    EXPECT_EQ(3u, text.toUtf16Offset(6));
+    EXPECT_EQ(5u, text.toUtf16Offset(10));
+
+    EXPECT_EQ(Range(1, 3), text.toUtf16(Range(1, 6)));
+    EXPECT_EQ(Range(3, 10), text.toUtf8(Range(2, 5)));
+}
+
+TEST(Utf8TextTest, layoutTest) {
+    MinikinPaint paint(buildFontCollection("Ascii.ttf"));
+    paint.size = 10.0f;
+    const Utf8Text text("Hello, World.");
+    const std::vector<uint16_t> expected = utf8ToUtf16("Hello, World.");
+    const Range range = text.toUtf16(Range(7, 13));
+    EXPECT_EQ(Layout::measureText(expected, Range(7, 13), Bidi::LTR, paint,
+                                  StartHyphenEdit::NO_EDIT, EndHyphenEdit::NO_EDIT, nullptr),
+              Layout::measureText(text.utf16(), range, Bidi::LTR, paint, StartHyphenEdit::NO_EDIT,
+                                  EndHyphenEdit::NO_EDIT, nullptr));
+}
+
+}  // namespace minikin
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "minikin/VariationSequenceCoverage.h"
+
+#include <gtest/gtest.h>
+
+#include "BufferUtils.h"
+
+namespace minikin {
+
+namespace {
+
+constexpr uint32_t kLargeSetStart = 0x4E00;
+constexpr uint32_t kLargeSetEnd = kLargeSetStart + VariationSequenceCoverage::kMaxSortedSize + 1;
+
+// VS index 0 is empty, 1 is a small set and 2 is a set stored as a bit set.
+VariationSequenceCoverage buildCoverage() {
+    const uint32_t smallRanges[] = {0x4E00, 0x4E01, 0x4E08, 0x4E0A, 0x9F9C, 0x9F9D};
+    const uint32_t largeRanges[] = {kLargeSetStart, kLargeSetEnd};
+    std::vector<SparseBitSet> coverages;
+    coverages.emplace_back();
+    coverages.emplace_back(smallRanges, 3);
+    coverages.emplace_back(largeRanges, 1);
+    return VariationSequenceCoverage(std::move(coverages));
+}
+
+void expectCoverage(const VariationSequenceCoverage& coverage) {
+    EXPECT_EQ(3u, coverage.size());
+    EXPECT_FALSE(coverage.empty());
+
+    EXPECT_FALSE(coverage.get(0x4E00, 0));
+
+    EXPECT_TRUE(coverage.get(0x4E00, 1));
+    EXPECT_FALSE(coverage.get(0x4E01, 1));
+    EXPECT_TRUE(coverage.get(0x4E08, 1));
+    EXPECT_TRUE(coverage.get(0x4E09, 1));
+    EXPECT_TRUE(coverage.get(0x9F9C, 1));
+    EXPECT_FALSE(coverage.get(0x4DFF, 1));
+    EXPECT_FALSE(coverage.get(0x9F9D, 1));
+
+    EXPECT_FALSE(coverage.get(kLargeSetStart - 1, 2));
+    for (uint32_t cp = kLargeSetStart; cp < kLargeSetEnd; ++cp) {
+        EXPECT_TRUE(coverage.get(cp, 2)) << std::hex << cp;
+    }
+    EXPECT_FALSE(coverage.get(kLargeSetEnd, 2));
+
+    EXPECT_FALSE(coverage.get(0x4E00, 3));
+    EXPECT_FALSE(coverage.get(0x4E00, 0xFFFF));
+}
+
+}  // namespace
+
+TEST(VariationSequenceCoverageTest, getTest) {
+    expectCoverage(buildCoverage());
+}
+
+TEST(VariationSequenceCoverageTest, emptyTest) {
+    VariationSequenceCoverage coverage;
+    EXPECT_TRUE(coverage.empty());
+    EXPECT_EQ(0u, coverage.size());
+    EXPECT_FALSE(coverage.get(0x4E00, 0));
+}
+
+TEST(VariationSequenceCoverageTest, moveTest) {
+    VariationSequenceCoverage original = buildCoverage();
+    VariationSequenceCoverage moved(std::move(original));
+    expectCoverage(moved);
+    EXPECT_TRUE(original.empty());
+
+    VariationSequenceCoverage assigned;
+    assigned = std::move(moved);
+    expectCoverage(assigned);
+    EXPECT_TRUE(moved.empty());
+}
+
+TEST(VariationSequenceCoverageTest, bufferTest) {
+    const VariationSequenceCoverage original = buildCoverage();
+    std::vector<uint8_t> buffer = writeToBuffer(original);
+    BufferReader reader(buffer.data());
+    const VariationSequenceCoverage coverage(&reader);
+    expectCoverage(coverage);
+    EXPECT_EQ(buffer, writeToBuffer(coverage));
+}
+
+}  // namespace minikin
@@ -17,6 +17,7 @@
 #include "WordBreaker.h"
 
 #include <cstdio>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -423,6 +424,36 @@ TEST(WordBreakerTest, url) {
     EXPECT_EQ(0, breaker.breakBadness());
 }
 
+// Only the words containing '@' or "://" are scanned for an email address or URL.
+TEST(WordBreakerTest, emailAfterOtherWords) {
+    std::vector<uint16_t> buf = utf8ToUtf16("at 10:30 a:b/c, foo@bar.com x");
+    auto lbStyle = LineBreakStyle::None;
+    auto lbWordStyle = LineBreakWordStyle::None;
+    WordBreaker breaker;
+    breaker.setText(buf.data(), buf.size());
+    EXPECT_EQ(3, breaker.followingWithLocale(Locale("en-US"), lbStyle, lbWordStyle,
+                                             0));  // after "at "
+    EXPECT_EQ(0, breaker.breakBadness());
+    EXPECT_EQ(9, breaker.next());  // after "10:30 "
+    EXPECT_EQ(3, breaker.wordStart());
+    EXPECT_EQ(8, breaker.wordEnd());
+    EXPECT_EQ(0, breaker.breakBadness());
+    EXPECT_EQ(13, breaker.next());  // after "a:b/"
+    EXPECT_EQ(0, breaker.breakBadness());
+    EXPECT_EQ(16, breaker.next());  // after "c, "
+    EXPECT_EQ(0, breaker.breakBadness());
+    EXPECT_EQ(23, breaker.next());  // after "foo@bar"
+    EXPECT_TRUE(breaker.wordStart() >= breaker.wordEnd());
+    EXPECT_EQ(1, breaker.breakBadness());
+    EXPECT_EQ(28, breaker.next());  // after ".com "
+    EXPECT_TRUE(breaker.wordStart() >= breaker.wordEnd());
+    EXPECT_EQ(0, breaker.breakBadness());
+    EXPECT_EQ((ssize_t)buf.size(), breaker.next());  // end
+    EXPECT_EQ(28, breaker.wordStart());              // "x"
+    EXPECT_EQ(29, breaker.wordEnd());
+    EXPECT_EQ(0, breaker.breakBadness());
+}
+
 // Breaks according to section 14.12 of Chicago Manual of Style, *URLs or DOIs and line breaks*
 TEST(WordBreakerTest, urlBreakChars) {
     uint16_t buf[] = {'h', 't', 't', 'p', ':', '/', '/', 'a', '.', 'b', '/',
@@ -618,6 +649,7 @@ public:
     TestableICULineBreakerPoolImpl() : ICULineBreakerPoolImpl() {}
 
     using ICULineBreakerPoolImpl::getPoolSize;
+    using ICULineBreakerPoolImpl::getPrototypeCount;
     using ICULineBreakerPoolImpl::MAX_POOL_SIZE;
 };
 
@@ -727,4 +759,288 @@ TEST(WordBreakerTest, LineBreakerPool_exceeds_pool_size) {
     }
 }
 
+TEST(WordBreakerTest, LineBreakerPool_thread_cache) {
+    TestableICULineBreakerPoolImpl pool;
+    pool.setThreadCacheSize(1);
+
+    const Locale enUS("en-Latn-US");
+    UBreakIterator* sharedBreakerPtr = nullptr;
+
+    // The thread caches start empty on the new threads.
+    std::thread([&pool, &enUS, &sharedBreakerPtr] {
+        ICULineBreakerPool::Slot slot =
+                pool.acquire(enUS, LineBreakStyle::None, LineBreakWordStyle::None);
+        UBreakIterator* breakerPtr = slot.breaker.get();
+        EXPECT_NE(nullptr, breakerPtr);
+
+        // The released breaker stays in the thread cache.
+        pool.release(std::move(slot));
+        EXPECT_EQ(0U, pool.getPoolSize());
+        ICULineBreakerPool::Slot slot2 =
+                pool.acquire(enUS, LineBreakStyle::None, LineBreakWordStyle::None);
+        EXPECT_EQ(breakerPtr, slot2.breaker.get());
+
+        // A new breaker is cloned while the other one is in use.
+        ICULineBreakerPool::Slot slot3 =
+                pool.acquire(enUS, LineBreakStyle::None, LineBreakWordStyle::None);
+        EXPECT_NE(nullptr, slot3.breaker.get());
+        EXPECT_NE(breakerPtr, slot3.breaker.get());
+
+        // The thread cache is full, so the second breaker goes to the shared pool.
+        pool.release(std::move(slot2));
+        sharedBreakerPtr = slot3.breaker.get();
+        pool.release(std::move(slot3));
+        EXPECT_EQ(1U, pool.getPoolSize());
+    }).join();
+
+    // Another thread takes the breaker from the shared pool.
+    std::thread([&pool, &enUS, sharedBreakerPtr] {
+        ICULineBreakerPool::Slot slot =
+                pool.acquire(enUS, LineBreakStyle::None, LineBreakWordStyle::None);
+        EXPECT_EQ(sharedBreakerPtr, slot.breaker.get());
+        EXPECT_EQ(0U, pool.getPoolSize());
+    }).join();
+}
+
+TEST(WordBreakerTest, LineBreakerPool_clone_from_prototype) {
+    TestableICULineBreakerPoolImpl pool;
+
+    const Locale enUS("en-Latn-US");
+    const Locale frFR("fr-Latn-FR");
+
+    ICULineBreakerPool::Slot enUSBreaker =
+            pool.acquire(enUS, LineBreakStyle::None, LineBreakWordStyle::None);
+    ICULineBreakerPool::Slot enUSBreaker2 =
+            pool.acquire(enUS, LineBreakStyle::None, LineBreakWordStyle::None);
+    EXPECT_EQ(1U, pool.getPrototypeCount());
+
+    pool.acquire(enUS, LineBreakStyle::Strict, LineBreakWordStyle::None);
+    pool.acquire(frFR, LineBreakStyle::None, LineBreakWordStyle::None);
+    EXPECT_EQ(3U, pool.getPrototypeCount());
+
+    // The clones break the same way.
+    std::vector<uint16_t> text = utf8ToUtf16("hello world, again");
+    UErrorCode status = U_ZERO_ERROR;
+    const UChar* chars = reinterpret_cast<const UChar*>(text.data());
+    ubrk_setText(enUSBreaker.breaker.get(), chars, text.size(), &status);
+    ubrk_setText(enUSBreaker2.breaker.get(), chars, text.size(), &status);
+    ASSERT_TRUE(U_SUCCESS(status));
+    int32_t offset;
+    do {
+        offset = ubrk_next(enUSBreaker.breaker.get());
+        EXPECT_EQ(offset, ubrk_next(enUSBreaker2.breaker.get()));
+    } while (offset != UBRK_DONE);
+}
+
+// Compares the breaks of a breaker replaying the record with the ones of a breaker running ICU,
+// after both are set at the given offsets with the given locales.
+static void expectSameBreaks(const std::vector<uint16_t>& text, const WordBreakRecord& record,
+                             const std::vector<std::pair<uint32_t, Locale>>& localeStarts) {
+    WordBreaker icuBreaker;
+    icuBreaker.setText(text.data(), text.size());
+    WordBreaker replayBreaker;
+    replayBreaker.setText(text.data(), text.size());
+    replayBreaker.setRecord(&record);
+
+    for (size_t i = 0; i < localeStarts.size(); ++i) {
+        const auto& [start, locale] = localeStarts[i];
+        const ssize_t end = i + 1 < localeStarts.size() ? localeStarts[i + 1].first : text.size();
+        ssize_t offset = icuBreaker.followingWithLocale(locale, LineBreakStyle::None,
+                                                        LineBreakWordStyle::None, start);
+        EXPECT_EQ(offset, replayBreaker.followingWithLocale(locale, LineBreakStyle::None,
+                                                            LineBreakWordStyle::None, start));
+        while (offset != -1 && offset < end) {
+            SCOPED_TRACE(offset);
+            EXPECT_EQ(icuBreaker.wordStart(), replayBreaker.wordStart());
+            EXPECT_EQ(icuBreaker.wordEnd(), replayBreaker.wordEnd());
+            EXPECT_EQ(icuBreaker.breakBadness(), replayBreaker.breakBadness());
+            offset = icuBreaker.next();
+            EXPECT_EQ(offset, replayBreaker.next());
+        }
+    }
+}
+
+TEST(WordBreakerTest, replayRecord) {
+    const Locale enUS("en-Latn-US");
+    for (const char* str : {
+                 "Hello, (quoted) world ",
+                 "soft\u00ADhyphen and hard-hyphen",
+                 "mail foo@example.com now",
+                 "see http://example.com/a/b?c=d#e or not",
+                 "\U0001F468\u200D\U0001F469 emoji",
+         }) {
+        SCOPED_TRACE(str);
+        const std::vector<uint16_t> text = utf8ToUtf16(str);
+        WordBreakRecord record;
+        WordBreaker::record(text, enUS, LineBreakStyle::None, LineBreakWordStyle::None,
+                            Range(0, text.size()), &record);
+        ASSERT_EQ(1U, record.segments.size());
+        EXPECT_TRUE(record.segments[0].reachesEnd);
+        expectSameBreaks(text, record, {{0, enUS}});
+    }
+}
+
+TEST(WordBreakerTest, replayRecord_localeChange) {
+    const Locale enUS("en-Latn-US");
+    const Locale frFR("fr-Latn-FR");
+    const std::vector<uint16_t> text = utf8ToUtf16("An English text, puis du texte ?");
+    const uint32_t frStart = 17;
+
+    WordBreakRecord record;
+    WordBreaker::record(text, enUS, LineBreakStyle::None, LineBreakWordStyle::None,
+                        Range(0, frStart), &record);
+    WordBreaker::record(text, frFR, LineBreakStyle::None, LineBreakWordStyle::None,
+                        Range(frStart, text.size()), &record);
+    ASSERT_EQ(2U, record.segments.size());
+    EXPECT_FALSE(record.segments[0].reachesEnd);
+    EXPECT_EQ(&record.segments[1], record.find(frStart, frFR.getIdentifier(),
+                                               LineBreakStyle::None, LineBreakWordStyle::None));
+    EXPECT_EQ(nullptr, record.find(frStart, enUS.getIdentifier(), LineBreakStyle::None,
+                                   LineBreakWordStyle::None));
+    expectSameBreaks(text, record, {{0, enUS}, {frStart, frFR}});
+
+    // The offsets out of the record are left to ICU.
+    WordBreakRecord firstSegmentOnly;
+    WordBreaker::record(text, enUS, LineBreakStyle::None, LineBreakWordStyle::None,
+                        Range(0, frStart), &firstSegmentOnly);
+    expectSameBreaks(text, firstSegmentOnly, {{0, enUS}, {frStart, frFR}});
+    expectSameBreaks(text, firstSegmentOnly, {{0, enUS}});
+}
+
+class CountingICULineBreakerPool : public ICULineBreakerPool {
+public:
+    Slot acquire(const Locale& locale, LineBreakStyle lbStyle,
+                 LineBreakWordStyle lbWordStyle) override {
+        acquireCount++;
+        return ICULineBreakerPoolImpl::getInstance().acquire(locale, lbStyle, lbWordStyle);
+    }
+    void release(Slot&& slot) override {
+        ICULineBreakerPoolImpl::getInstance().release(std::move(slot));
+    }
+
+    int acquireCount = 0;
+};
+
+class TestableWordBreaker : public WordBreaker {
+public:
+    TestableWordBreaker(ICULineBreakerPool* pool) : WordBreaker(pool) {}
+};
+
+static std::vector<ssize_t> getBreaks(WordBreaker* breaker, const std::vector<uint16_t>& text,
+                                      const Locale& locale) {
+    breaker->setText(text.data(), text.size());
+    std::vector<ssize_t> breaks;
+    ssize_t offset = breaker->followingWithLocale(locale, LineBreakStyle::None,
+                                                  LineBreakWordStyle::None, 0);
+    for (; offset != -1 && breaks.size() <= text.size(); offset = breaker->next()) {
+        breaks.push_back(offset);
+        if (static_cast<size_t>(offset) == text.size()) {
+            break;
+        }
+    }
+    breaker->finishText();
+    return breaks;
+}
+
+TEST(WordBreakerTest, asciiFastPath) {
+    CountingICULineBreakerPool pool;
+    const Locale enUS("en-Latn-US");
+    {
+        TestableWordBreaker breaker(&pool);
+        const std::vector<uint16_t> text = utf8ToUtf16("It's a well-known text, 15 times  longer");
+        EXPECT_EQ((std::vector<ssize_t>{5, 7, 18, 24, 27, 34, 40}),
+                  getBreaks(&breaker, text, enUS));
+        EXPECT_EQ(0, pool.acquireCount);
+    }
+    {
+        // ICU is used from the first character the fast path doesn't know.
+        TestableWordBreaker breaker(&pool);
+        const std::vector<uint16_t> text = utf8ToUtf16("A text (with parentheses)");
+        EXPECT_EQ((std::vector<ssize_t>{2, 7, 13, 25}), getBreaks(&breaker, text, enUS));
+        EXPECT_EQ(1, pool.acquireCount);
+    }
+    {
+        // The Japanese line break rules are left to ICU.
+        TestableWordBreaker breaker(&pool);
+        const std::vector<uint16_t> text = utf8ToUtf16("A text");
+        EXPECT_EQ((std::vector<ssize_t>{2, 6}), getBreaks(&breaker, text, Locale("ja-JP")));
+        EXPECT_EQ(2, pool.acquireCount);
+    }
+}
+
+TEST(WordBreakerTest, asciiFastPath_sameAsIcu) {
+    // All the texts of up to four characters, mixing the characters of the fast path with others.
+    const char kChars[] = {'a', '1', ' ', '.', '-', '\'', '(', '!'};
+    const size_t kCharCount = sizeof(kChars);
+    for (const char* localeStr : {"en-US", "fr-FR", "pl-PL"}) {
+        const Locale locale(localeStr);
+        for (size_t length = 1; length <= 4; ++length) {
+            size_t textCount = 1;
+            for (size_t i = 0; i < length; ++i) {
+                textCount *= kCharCount;
+            }
+            for (size_t n = 0; n < textCount; ++n) {
+                std::vector<uint16_t> text;
+                for (size_t i = 0, rest = n; i < length; ++i, rest /= kCharCount) {
+                    text.push_back(kChars[rest % kCharCount]);
+                }
+
+                // ICU without the breaks after hyphens, which the word breaker never returns.
+                ICULineBreakerPool::Slot slot = ICULineBreakerPoolImpl::getInstance().acquire(
+                        locale, LineBreakStyle::None, LineBreakWordStyle::None);
+                UErrorCode status = U_ZERO_ERROR;
+                ubrk_setText(slot.breaker.get(), reinterpret_cast<const UChar*>(text.data()),
+                             text.size(), &status);
+                ASSERT_TRUE(U_SUCCESS(status));
+                std::vector<ssize_t> expected;
+                for (int32_t offset = ubrk_following(slot.breaker.get(), 0); offset != UBRK_DONE;
+                     offset = ubrk_next(slot.breaker.get())) {
+                    if (static_cast<size_t>(offset) == text.size() || text[offset - 1] != '-') {
+                        expected.push_back(offset);
+                    }
+                }
+                ICULineBreakerPoolImpl::getInstance().release(std::move(slot));
+
+                WordBreaker breaker;
+                EXPECT_EQ(expected, getBreaks(&breaker, text, locale))
+                        << localeStr << " \"" << utf16ToUtf8(text) << "\"";
+            }
+        }
+    }
+}
+
+TEST(WordBreakerTest, reuseAcrossTexts) {
+    CountingICULineBreakerPool pool;
+    const Locale jaJP("ja-JP");
+    TestableWordBreaker breaker(&pool);
+    const std::vector<uint16_t> text1 = utf8ToUtf16("本日は晴天なり。");
+    const std::vector<uint16_t> text2 = utf8ToUtf16("明日は雨。");
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ((std::vector<ssize_t>{1, 2, 3, 4, 5, 6, 8}), getBreaks(&breaker, text1, jaJP));
+        EXPECT_EQ((std::vector<ssize_t>{1, 2, 3, 5}), getBreaks(&breaker, text2, jaJP));
+    }
+    // The ICU breaker is kept as long as the locale doesn't change.
+    EXPECT_EQ(1, pool.acquireCount);
+    EXPECT_EQ((std::vector<ssize_t>{1, 2, 3, 4, 5, 6, 8}),
+              getBreaks(&breaker, text1, Locale("zh-Hans")));
+    EXPECT_EQ(2, pool.acquireCount);
+}
+
+TEST(WordBreakerTest, scopedWordBreaker) {
+    WordBreaker* threadBreaker;
+    {
+        ScopedWordBreaker scoped;
+        threadBreaker = &scoped.get();
+        {
+            // Nested scopes get their own breaker.
+            ScopedWordBreaker nested;
+            EXPECT_NE(threadBreaker, &nested.get());
+        }
+    }
+    ScopedWordBreaker scoped;
+    EXPECT_EQ(threadBreaker, &scoped.get());
+    const std::vector<uint16_t> text = utf8ToUtf16("A text");
+    EXPECT_EQ((std::vector<ssize_t>{2, 6}), getBreaks(&scoped.get(), text, Locale("en-US")));
+}
+
 }  // namespace minikin
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace minikin {
+
+namespace {
+
+// An executor of the host running the tasks on a single thread, in the order of submission.
+class TestExecutor : public Executor {
+public:
+    TestExecutor() : mStopping(false), mThread(&TestExecutor::threadLoop, this) {}
+
+    ~TestExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mCv.notify_all();
+        mThread.join();
+    }
+
+    void execute(std::function<void()>&& task, TaskPriority,
+                 const CancellationToken& token) override {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTasks.emplace_back(std::move(task), token);
+            mSubmitted++;
+        }
+        mCv.notify_all();
+    }
+
+    uint32_t getConcurrency() const override { return 1; }
+
+    int getSubmittedCount() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mSubmitted;
+    }
+
+private:
+    void threadLoop() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mCv.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+            if (mTasks.empty()) {
+                return;
+            }
+            auto [task, token] = std::move(mTasks.front());
+            mTasks.pop_front();
+            lock.unlock();
+            if (!token.isCancelled()) {
+                task();
+            }
+            lock.lock();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::deque<std::pair<std::function<void()>, CancellationToken>> mTasks;
+    int mSubmitted = 0;
+    bool mStopping;
+    std::thread mThread;
+};
+
+}  // namespace
+
+TEST(WorkerPoolTest, parallelForTest) {
+    for (uint32_t threadCount : {0u, 1u, 3u}) {
+        WorkerPool pool(threadCount);
+        EXPECT_EQ(threadCount, pool.getThreadCount());
+        for (size_t count : {0u, 1u, 2u, 100u}) {
+            std::vector<std::atomic<int>> calls(count);
+            pool.parallelFor(count, [&calls](size_t i) { calls[i].fetch_add(1); });
+            for (size_t i = 0; i < count; ++i) {
+                EXPECT_EQ(1, calls[i].load()) << "threads: " << threadCount << ", index: " << i;
+            }
+        }
+    }
+}
+
+TEST(WorkerPoolTest, repeatedJobsTest) {
+    WorkerPool pool(2);
+    std::atomic<size_t> sum(0);
+    for (int i = 0; i < 100; ++i) {
+        pool.parallelFor(10, [&sum](size_t i) { sum.fetch_add(i); });
+    }
+    EXPECT_EQ(100u * 45u, sum.load());
+}
+
+TEST(WorkerPoolTest, nestedParallelForTest) {
+    WorkerPool pool(2);
+    std::vector<std::atomic<int>> calls(100);
+    pool.parallelFor(10, [&pool, &calls](size_t i) {
+        // The nested calls run on the thread of the outer task.
+        const std::thread::id outerThread = std::this_thread::get_id();
+        pool.parallelFor(10, [&calls, i, outerThread](size_t j) {
+            EXPECT_EQ(outerThread, std::this_thread::get_id());
+            calls[i * 10 + j].fetch_add(1);
+        });
+    });
+    for (size_t i = 0; i < calls.size(); ++i) {
+        EXPECT_EQ(1, calls[i].load()) << "index: " << i;
+    }
+}
+
+TEST(WorkerPoolTest, executorTest) {
+    TestExecutor executor;
+    {
+        WorkerPool pool(&executor);
+        EXPECT_EQ(1u, pool.getThreadCount());
+        std::vector<std::atomic<int>> calls(100);
+        pool.parallelFor(calls.size(), [&calls](size_t i) { calls[i].fetch_add(1); });
+        for (size_t i = 0; i < calls.size(); ++i) {
+            EXPECT_EQ(1, calls[i].load()) << "index: " << i;
+        }
+        // A single helper task for the concurrency of one.
+        EXPECT_EQ(1, executor.getSubmittedCount());
+
+        // A single index is run on the calling thread.
+        pool.parallelFor(1, [](size_t) {});
+        EXPECT_EQ(1, executor.getSubmittedCount());
+    }
+    // The tasks left over after the pool is gone don't refer to it.
+}
+
+}  // namespace minikin
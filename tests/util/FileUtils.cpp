@@ -34,3 +34,22 @@ std::vector<uint8_t> readWholeFile(const std::string& filePath) {
     fclose(fp);
     return result;
 }
+
+std::vector<std::string> readLines(const std::string& filePath) {
+    const std::vector<uint8_t> data = readWholeFile(filePath);
+    std::vector<std::string> lines;
+    auto lineStart = data.begin();
+    for (auto it = data.begin();; ++it) {
+        if (it != data.end() && *it != '\n') {
+            continue;
+        }
+        if (it != lineStart) {
+            lines.emplace_back(lineStart, it);
+        }
+        if (it == data.end()) {
+            break;
+        }
+        lineStart = it + 1;
+    }
+    return lines;
+}
@@ -18,3 +18,6 @@
 #include <vector>
 
 std::vector<uint8_t> readWholeFile(const std::string& filePath);
+
+// Returns the non-empty lines of the file, without the line feeds.
+std::vector<std::string> readLines(const std::string& filePath);
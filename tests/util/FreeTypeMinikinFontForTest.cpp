@@ -65,24 +65,44 @@ FreeTypeMinikinFontForTest::FreeTypeMinikinFontForTest(const std::string& font_p
     LOG_ALWAYS_FATAL_IF(fd == -1, "Open failed: %s", font_path.c_str());
     struct stat st = {};
     LOG_ALWAYS_FATAL_IF(fstat(fd, &st) != 0);
-    mFontSize = st.st_size;
-    mFontData = mmap(NULL, mFontSize, PROT_READ, MAP_SHARED, fd, 0);
-    LOG_ALWAYS_FATAL_IF(mFontData == nullptr);
+    const size_t fontSize = st.st_size;
+    mFontSize = fontSize;
+    void* fontData = mmap(NULL, mFontSize, PROT_READ, MAP_SHARED, fd, 0);
+    LOG_ALWAYS_FATAL_IF(fontData == nullptr);
+    mFontData = std::shared_ptr<void>(fontData, [fontSize](void* data) { munmap(data, fontSize); });
     close(fd);
+    openFace();
+}
+
+FreeTypeMinikinFontForTest::FreeTypeMinikinFontForTest(const FreeTypeMinikinFontForTest& base,
+                                                       const std::vector<FontVariation>& variations)
+        : mFontPath(base.mFontPath),
+          mFontIndex(base.mFontIndex),
+          mFontData(base.mFontData),
+          mFontSize(base.mFontSize),
+          mAxes(variations) {
+    openFace();
+}
 
+void FreeTypeMinikinFontForTest::openFace() {
     LOG_ALWAYS_FATAL_IF(FT_Init_FreeType(&mFtLibrary), "Failed to initialize FreeType");
 
     FT_Open_Args args;
     args.flags = FT_OPEN_MEMORY;
-    args.memory_base = static_cast<const FT_Byte*>(mFontData);
+    args.memory_base = static_cast<const FT_Byte*>(mFontData.get());
     args.memory_size = mFontSize;
-    LOG_ALWAYS_FATAL_IF(FT_Open_Face(mFtLibrary, &args, index, &mFtFace), "Failed to open FT_Face");
+    LOG_ALWAYS_FATAL_IF(FT_Open_Face(mFtLibrary, &args, mFontIndex, &mFtFace),
+                        "Failed to open FT_Face");
 }
 
 FreeTypeMinikinFontForTest::~FreeTypeMinikinFontForTest() {
     FT_Done_Face(mFtFace);
     FT_Done_FreeType(mFtLibrary);
-    munmap(mFontData, mFontSize);
+}
+
+std::shared_ptr<MinikinFont> FreeTypeMinikinFontForTest::createFontWithVariation(
+        const std::vector<FontVariation>& variations) const {
+    return std::shared_ptr<MinikinFont>(new FreeTypeMinikinFontForTest(*this, variations));
 }
 
 float FreeTypeMinikinFontForTest::GetHorizontalAdvance(uint32_t glyphId, const MinikinPaint& paint,
@@ -47,15 +47,25 @@ public:
                        const FontFakery& fakery) const override;
 
     const std::string& GetFontPath() const override { return mFontPath; }
-    const void* GetFontData() const { return mFontData; }
+    const void* GetFontData() const { return mFontData.get(); }
     size_t GetFontSize() const { return mFontSize; }
     int GetFontIndex() const { return mFontIndex; }
     const std::vector<minikin::FontVariation>& GetAxes() const { return mAxes; }
 
+    // Shares the font data with this font. Note that the variations don't affect the FreeType
+    // metrics.
+    std::shared_ptr<MinikinFont> createFontWithVariation(
+            const std::vector<FontVariation>& variations) const override;
+
 private:
+    FreeTypeMinikinFontForTest(const FreeTypeMinikinFontForTest& base,
+                               const std::vector<FontVariation>& variations);
+
+    void openFace();
+
     const std::string mFontPath;
     const int mFontIndex;
-    void* mFontData;
+    std::shared_ptr<void> mFontData;  // mmap-ed
     size_t mFontSize;
     std::vector<minikin::FontVariation> mAxes;
 
@@ -18,10 +18,20 @@
 Convert hyphen files in standard TeX format (a trio of pat, chr, and hyp)
 into binary format. See doc/hyb_file_format.md for more information.
 
-Usage: mk_hyb_file.py [-v] hyph-foo.pat.txt hyph-foo.hyb
+Usage: mk_hyb_file.py [-v] [-c] hyph-foo.pat.txt hyph-foo.hyb
 
 Optional -v parameter turns on verbose debugging.
 
+Optional -c parameter places the children of each trie node within a cache line where possible,
+at the cost of a slightly larger trie.
+
+The hyb files of several locales can also be packed into a single container file:
+
+Usage: mk_hyb_file.py -p hyph.hybc foo:2:3:hyph-foo.hyb [bar:2:2:hyph-bar.hyb ...]
+
+Each argument after the container file name is the locale, the minimum prefix, the minimum
+suffix and the hyb file, separated by colons.
+
 """
 
 from __future__ import print_function
@@ -192,7 +202,10 @@ class Hyph:
             t = t.succ[c]
         t.res = result
 
-    def pack(self, node_list, ch_map, use_node=False):
+    # If line_entries is set, the entries of a node and its edges are placed within an aligned
+    # block of line_entries entries where they fit, so that walking a node touches a single cache
+    # line.
+    def pack(self, node_list, ch_map, use_node=False, line_entries=None):
         size = 0
         self.node_map = {}
         nodes = Freelist()
@@ -201,13 +214,16 @@ class Hyph:
         for node in node_list:
             succ = sorted([ch_map[c] + edge_start for c in node.succ.keys()])
             if len(succ):
+                group = line_entries is not None and succ[-1] < line_entries
                 cursor = 0
                 while True:
                     edge_ix, cursor = edges.next(cursor)
                     ix = edge_ix - succ[0]
                     if (ix >= 0 and nodes.is_free(ix) and
                             all(edges.is_free(ix + s) for s in succ) and
-                            ((not use_node) or edges.is_free(ix))):
+                            ((not use_node) or edges.is_free(ix)) and
+                            ((not group) or ix // line_entries ==
+                             (ix + succ[-1]) // line_entries)):
                         break
             elif use_node:
                 ix, _ = edges.next(0)
@@ -343,6 +359,15 @@ def generate_alphabet(ch_map):
     return binary
 
 
+CACHE_LINE_SIZE = 64
+
+
+# The size of the trie entries in bytes, 2 for version 1 if all the fields fit in 16 bits.
+def trie_entry_size(ch_map, n_trie, patmap):
+    pattern_shift = num_bits(max(ch_map.values())) + num_bits(n_trie - 1)
+    return 2 if pattern_shift + num_bits(max(patmap.values())) <= 16 else 4
+
+
 # assumes hyph structure has been packed, ie node.ix values have been set
 def generate_trie(hyph, ch_map, n_trie, dedup_ix, dedup_nodes, patmap):
     ch_array = [0] * n_trie
@@ -352,7 +377,11 @@ def generate_trie(hyph, ch_map, n_trie, dedup_ix, dedup_nodes, patmap):
     char_mask = (1 << link_shift) - 1
     pattern_shift = link_shift + num_bits(n_trie - 1)
     link_mask = (1 << pattern_shift) - (1 << link_shift)
-    result = [struct.pack('<6I', 0, char_mask, link_shift, link_mask, pattern_shift, n_trie)]
+    if trie_entry_size(ch_map, n_trie, patmap) == 2:
+        version, entry_format = 1, '<H'
+    else:
+        version, entry_format = 0, '<I'
+    result = [struct.pack('<6I', version, char_mask, link_shift, link_mask, pattern_shift, n_trie)]
 
     for node in dedup_nodes:
         ix = node.ix
@@ -371,8 +400,11 @@ def generate_trie(hyph, ch_map, n_trie, dedup_ix, dedup_nodes, patmap):
     for i in range(n_trie):
         #print((pat_array[i], link_array[i], ch_array[i]))
         packed = (pat_array[i] << pattern_shift) | (link_array[i] << link_shift) | ch_array[i]
-        result.append(struct.pack('<I', packed))
-    return b''.join(result)
+        result.append(struct.pack(entry_format, packed))
+    binary = b''.join(result)
+    if len(binary) % 4 != 0:
+        binary += b'\x00' * (4 - len(binary) % 4)
+    return binary
 
 
 def generate_pattern(pats):
@@ -407,12 +439,22 @@ def generate_pattern(pats):
     return patmap, b''.join(result)
 
 
-def generate_hyb_file(hyph, ch_map, hyb_fn):
+def generate_hyb_file(hyph, ch_map, hyb_fn, group_lines=False):
     bfs = hyph.bfs(ch_map)
     dedup_ix, dedup_nodes = hyph.dedup()
     n_trie = hyph.pack(dedup_nodes, ch_map)
     alphabet = generate_alphabet(ch_map)
     patmap, pattern = generate_pattern([n.res for n in hyph.node_list])
+    if group_lines:
+        entry_size = trie_entry_size(ch_map, n_trie, patmap)
+        n_grouped = hyph.pack(dedup_nodes, ch_map, line_entries=CACHE_LINE_SIZE // entry_size)
+        if trie_entry_size(ch_map, n_grouped, patmap) == entry_size:
+            n_trie = n_grouped
+        else:
+            # The grouping would need wider entries, which defeats its purpose.
+            n_trie = hyph.pack(dedup_nodes, ch_map)
+        if VERBOSE:
+            print('trie of', n_trie, 'entries of', entry_size, 'bytes')
     trie = generate_trie(hyph, ch_map, n_trie, dedup_ix, dedup_nodes, patmap)
     header = generate_header(alphabet, trie, pattern)
 
@@ -423,6 +465,47 @@ def generate_hyb_file(hyph, ch_map, hyb_fn):
         f.write(pattern)
 
 
+HYB_MAGIC = 0x62ad7968
+HYB_CONTAINER_MAGIC = 0x62ad7963
+HYB_CONTAINER_LOCALE_SIZE = 16
+
+
+def align4(n):
+    return (n + 3) & ~3
+
+
+# Pack the hyb files into a container, see doc/hyb_file_format.md. Each entry is a tuple of
+# (locale, min_prefix, min_suffix, hyb_fn).
+def generate_hyb_container(entries, out_fn):
+    header_size = 16
+    entry_size = HYB_CONTAINER_LOCALE_SIZE + 16
+    offset = header_size + entry_size * len(entries)
+    directory = []
+    payload = []
+    for (locale, min_prefix, min_suffix, hyb_fn) in entries:
+        locale_bytes = locale.encode('ascii')
+        assert len(locale_bytes) < HYB_CONTAINER_LOCALE_SIZE, 'locale too long: ' + locale
+        with open(hyb_fn, 'rb') as f:
+            hyb_data = f.read()
+        assert struct.unpack('<I', hyb_data[:4])[0] == HYB_MAGIC, 'not a hyb file: ' + hyb_fn
+        directory.append(struct.pack('<%ds4I' % HYB_CONTAINER_LOCALE_SIZE, locale_bytes,
+                                     min_prefix, min_suffix, offset, len(hyb_data)))
+        padding = align4(len(hyb_data)) - len(hyb_data)
+        payload.append(hyb_data + b'\0' * padding)
+        offset += len(hyb_data) + padding
+    header = struct.pack('<4I', HYB_CONTAINER_MAGIC, 0, len(entries), offset)
+
+    with open(out_fn, 'wb') as f:
+        f.write(header)
+        f.write(b''.join(directory))
+        f.write(b''.join(payload))
+
+
+def parse_container_entry(arg):
+    locale, min_prefix, min_suffix, hyb_fn = arg.split(':', 3)
+    return (locale, int(min_prefix), int(min_suffix), hyb_fn)
+
+
 # Verify that the file contains the same lines as the lines argument, in arbitrary order
 def verify_file_sorted(lines, fn):
     file_lines = [l.strip() for l in io.open(fn, encoding='UTF-8')]
@@ -466,9 +549,15 @@ def get_pattern(pattern_data, ix):
     return pattern_data[offset: offset + pat_len] + b'\0' * pat_shift
 
 
+def get_trie_entry(trie_data, ix):
+    if struct.unpack('<I', trie_data[:4])[0] == 1:
+        return struct.unpack('<H', trie_data[24 + ix * 2: 24 + ix * 2 + 2])[0]
+    return struct.unpack('<I', trie_data[24 + ix * 4: 24 + ix * 4 + 4])[0]
+
+
 def traverse_trie(ix, s, trie_data, ch_map, pattern_data, patterns, exceptions):
     (char_mask, link_shift, link_mask, pattern_shift) = struct.unpack('<4I', trie_data[4:20])
-    node_entry = struct.unpack('<I', trie_data[24 + ix * 4: 24 + ix * 4 + 4])[0]
+    node_entry = get_trie_entry(trie_data, ix)
     pattern = node_entry >> pattern_shift
     if pattern:
         result = []
@@ -500,7 +589,7 @@ def traverse_trie(ix, s, trie_data, ch_map, pattern_data, patterns, exceptions):
         else:
             patterns.append(pat_str)
     for ch in ch_map:
-        edge_entry = struct.unpack('<I', trie_data[24 + (ix + ch) * 4: 24 + (ix + ch) * 4 + 4])[0]
+        edge_entry = get_trie_entry(trie_data, ix + ch)
         link = (edge_entry & link_mask) >> link_shift
         if link != 0 and ch == (edge_entry & char_mask):
             sch = s + ch_map[ch]
@@ -590,13 +679,22 @@ def verify_hyb_file(hyb_fn, pat_fn, chr_fn, hyp_fn):
 def main():
     global VERBOSE
     try:
-        opts, args = getopt.getopt(sys.argv[1:], 'v')
+        opts, args = getopt.getopt(sys.argv[1:], 'vpc')
     except getopt.GetoptError as err:
         print(str(err))
         sys.exit(1)
+    pack = False
+    group_lines = False
     for o, _ in opts:
         if o == '-v':
             VERBOSE = True
+        elif o == '-p':
+            pack = True
+        elif o == '-c':
+            group_lines = True
+    if pack:
+        generate_hyb_container([parse_container_entry(arg) for arg in args[1:]], args[0])
+        return
     pat_fn, out_fn = args
     hyph = load(pat_fn)
     if pat_fn.endswith('.pat.txt'):
@@ -604,7 +702,7 @@ def main():
         ch_map = load_chr(chr_fn)
         hyp_fn = pat_fn[:-8] + '.hyp.txt'
         load_hyp(hyph, hyp_fn)
-        generate_hyb_file(hyph, ch_map, out_fn)
+        generate_hyb_file(hyph, ch_map, out_fn, group_lines)
         verify_hyb_file(out_fn, pat_fn, chr_fn, hyp_fn)
 
 if __name__ == '__main__':